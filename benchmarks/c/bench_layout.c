@@ -0,0 +1,146 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* A microbenchmark of the layouts of nodes in memory: it compares serializing and scanning an array
+* of records and an array of strings with their nodes
+*   - on the heap in a shuffled order, like a document that was built by many writes,
+*   - in an arena in the order that the parser creates them, like a document that was just set,
+*   - in an arena with every container's children in a row, as the binary encoding loads them
+*     (i.e. after an RDB load, a copy-on-write or JSON.DEBUG COMPACT), see Node_SetSlot.
+*
+* Usage: bench_layout [-n iterations] [records]
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "../../src/json_object.h"
+#include "../../src/object_binary.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A record with a few members, and a name that's too long to be inlined in the array of strings */
+static Node *generateRecord(int i) {
+    char name[64];
+    int len = snprintf(name, sizeof(name), "user number %d living at http://x.io/%d", i, i * 7);
+    Node *rec = NewDictNode(4);
+    Node_DictSet(rec, "id", NewIntNode(1000000 + i));
+    Node_DictSet(rec, "name", NewStringNode(name, len));
+    Node_DictSet(rec, "score", NewDoubleNode(i * 1.37 + 0.001));
+    Node_DictSet(rec, "active", NewBoolNode(i % 3));
+    return rec;
+}
+
+/* A document of records and of their names, which are created in a shuffled order on the heap */
+static Node *generateDocument(int records) {
+    Node **recs = malloc(records * sizeof(Node *)), **names = malloc(records * sizeof(Node *));
+    for (int i = 0; i < records; i++) {
+        recs[i] = generateRecord(i);
+        Node *name;
+        Node_DictGet(recs[i], "name", &name);
+        names[i] = NewStringNode(name->value.strval.data, name->value.strval.len);
+    }
+    srand(1);
+    for (int i = records - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        Node *t = recs[i];
+        recs[i] = recs[j];
+        recs[j] = t;
+        t = names[i];
+        names[i] = names[j];
+        names[j] = t;
+    }
+    Node *root = NewDictNode(2), *arr = NewArrayNode(records), *strs = NewArrayNode(records);
+    for (int i = 0; i < records; i++) {
+        Node_ArrayAppend(arr, recs[i]);
+        Node_ArrayAppend(strs, names[i]);
+    }
+    Node_DictSet(root, "records", arr);
+    Node_DictSet(root, "names", strs);
+    free(recs);
+    free(names);
+    return root;
+}
+
+static void run(const char *name, Node *doc, int iterations) {
+    JSONSerializeOpt opt = {"", "", ""};
+    Node *arr, *strs, *missing = NewCStringNode("user number -1 living at http://x.io/-7");
+    Node_DictGet(doc, "records", &arr);
+    Node_DictGet(doc, "names", &strs);
+
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        sds json = sdsempty();
+        SerializeNodeToJSON(doc, &opt, &json);
+        sdsfree(json);
+    }
+    double serialize = now() - start;
+    start = now();
+    for (int i = 0; i < iterations; i++) {
+        if (-1 != Node_ArrayIndex(arr, missing, 0, 0)) printf("  unexpected index\n");
+        if (-1 != Node_ArrayIndex(strs, missing, 0, 0)) printf("  unexpected index\n");
+    }
+    double scan = now() - start;
+    printf("  %-8s %10.3f ms serialize %10.3f ms arrindex\n", name, serialize * 1000 / iterations,
+           scan * 1000 / iterations);
+    Node_Free(missing);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 20, records = 200000;
+    int i = 1;
+
+    if (argc > 2 && !strcmp("-n", argv[1])) {
+        iterations = atoi(argv[2]);
+        i = 3;
+    }
+    if (i < argc) records = atoi(argv[i]);
+
+    Node *heap = generateDocument(records);
+    printf("%d records\n", records);
+    run("heap", heap, iterations);
+
+    JSONSerializeOpt opt = {"", "", ""};
+    sds json = sdsempty();
+    SerializeNodeToJSON(heap, &opt, &json);
+    NodeArena *parsedArena = NewNodeArena();
+    NodeArena *prev = Node_SetArena(parsedArena);
+    Node *parsed;
+    CreateNodeFromJSON(json, sdslen(json), &parsed, NULL);
+    Node_SetArena(prev);
+    run("parsed", parsed, iterations);
+
+    sds bin = sdsempty();
+    SerializeNodeToBinary(heap, &bin);
+    NodeArena *loadedArena = NewNodeArena();
+    prev = Node_SetArena(loadedArena);
+    Node *loaded;
+    CreateNodeFromBinary(bin, sdslen(bin), &loaded);
+    Node_SetArena(prev);
+    run("loaded", loaded, iterations);
+
+    Node_Free(heap);
+    NodeArena_Free(parsedArena);
+    NodeArena_Free(loadedArena);
+    sdsfree(json);
+    sdsfree(bin);
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* A microbenchmark of the value formats of JSON.SET and JSON.GET: it compares the size, encoding
+* and decoding times of JSON, which is parsed by CreateNodeFromJSON, and of MessagePack and CBOR,
+* which are decoded into nodes without a lexer.
+*
+* Usage: bench_pack [-n iterations] [file.json ...]
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "../../src/json_object.h"
+#include "../../src/object_pack.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *format, size_t size, double encode, double decode, int iterations) {
+    printf("  %-11s %10zu bytes %10.3f ms encode %10.3f ms decode\n", format, size,
+           encode * 1000 / iterations, decode * 1000 / iterations);
+}
+
+static void bench(const char *title, const sds json, int iterations) {
+    Node *doc;
+    char *err = NULL;
+    if (JSONOBJECT_OK != CreateNodeFromJSON(json, sdslen(json), &doc, &err)) {
+        printf("%s: can't parse: %s\n", title, err);
+        free(err);
+        return;
+    }
+    printf("%s (%zu bytes of JSON)\n", title, sdslen(json));
+
+    JSONSerializeOpt opt = {"", "", ""};
+    sds buf = sdsempty();
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        sdsclear(buf);
+        SerializeNodeToJSON(doc, &opt, &buf);
+    }
+    double encode = now() - start;
+    start = now();
+    for (int i = 0; i < iterations; i++) {
+        Node *n;
+        CreateNodeFromJSON(buf, sdslen(buf), &n, NULL);
+        Node_Free(n);
+    }
+    report("JSON", sdslen(buf), encode, now() - start, iterations);
+
+    for (int f = PACK_MSGPACK; f <= PACK_CBOR; f++) {
+        start = now();
+        for (int i = 0; i < iterations; i++) {
+            sdsclear(buf);
+            SerializeNodeToPack(doc, f, &buf);
+        }
+        encode = now() - start;
+        start = now();
+        for (int i = 0; i < iterations; i++) {
+            Node *n;
+            CreateNodeFromPack(buf, sdslen(buf), f, &n, NULL);
+            Node_Free(n);
+        }
+        report(Pack_FormatName(f), sdslen(buf), encode, now() - start, iterations);
+    }
+    sdsfree(buf);
+    Node_Free(doc);
+}
+
+/* A document of records with short strings, small numbers and nested values */
+static sds generateDocument(int records) {
+    sds json = sdsnew("[");
+
+    for (int i = 0; i < records; i++) {
+        if (i) json = sdscat(json, ",");
+        json = sdscatprintf(json,
+                            "{\"id\":%d,\"name\":\"user %d\",\"active\":%s,\"score\":%d.%d,"
+                            "\"address\":{\"street\":\"%d Main St.\",\"zip\":\"%05d\"},"
+                            "\"history\":[%d,%d,%d],\"tags\":[\"a\",\"b\",null]}",
+                            1000000 + i, i, i % 3 ? "true" : "false", i % 100, i % 7, i, i * 13,
+                            i % 50, i % 20, -i % 10);
+    }
+    return sdscat(json, "]");
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 20;
+    int i = 1;
+
+    if (argc > 2 && !strcmp("-n", argv[1])) {
+        iterations = atoi(argv[2]);
+        i = 3;
+    }
+
+    if (i == argc) {
+        sds json = generateDocument(20000);
+        bench("generated (20000 records)", json, iterations);
+        sdsfree(json);
+    }
+
+    for (; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            fprintf(stderr, "can't open %s\n", argv[i]);
+            return 1;
+        }
+        sds json = sdsempty();
+        char chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f))) json = sdscatlen(json, chunk, n);
+        fclose(f);
+        bench(argv[i], json, iterations);
+        sdsfree(json);
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* A microbenchmark of the JSON parser backends: it times CreateNodeFromJSONWith with jsonsl and with
+* the direct parser, on a generated document or on the JSON files given as arguments.
+*
+* Usage: bench_parser [-n iterations] [file.json ...]
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "../../src/json_object.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A document of records with short strings, numbers, nested dictionaries and numeric arrays */
+static sds generateDocument(int records) {
+    sds json = sdsnew("[");
+
+    for (int i = 0; i < records; i++) {
+        if (i) json = sdscat(json, ",");
+        json = sdscatprintf(json,
+                            "{\"id\":%d,\"name\":\"user %d\",\"active\":%s,\"score\":%d.%d,"
+                            "\"address\":{\"street\":\"%d Main St.\",\"zip\":\"%05d\"},"
+                            "\"history\":[%d,%d,%d,%d,%d,%d],\"weights\":[0.%d,1.%d,2.5],"
+                            "\"tags\":[\"a\",\"b\",null]}",
+                            1000000 + i, i, i % 3 ? "true" : "false", i % 100, i % 7, i, i * 13,
+                            i, i + 1, i * 2, i * 3, -i, 42, i % 10, i % 9);
+    }
+    return sdscat(json, "]");
+}
+
+static void bench(const char *title, const sds json, int iterations) {
+    const char *names[] = {"jsonsl", "direct"};
+    JSONParser parsers[] = {JSONPARSER_JSONSL, JSONPARSER_DIRECT};
+
+    printf("%s (%zu bytes)\n", title, sdslen(json));
+    for (int p = 0; p < sizeof(parsers) / sizeof(JSONParser); p++) {
+        double start = now();
+        for (int i = 0; i < iterations; i++) {
+            Node *doc = NULL;
+            char *err = NULL;
+            if (JSONOBJECT_OK != CreateNodeFromJSONWith(parsers[p], json, sdslen(json), &doc, &err)) {
+                printf("  %-10s can't parse: %s\n", names[p], err);
+                free(err);
+                break;
+            }
+            if (doc) Node_Free(doc);
+        }
+        double elapsed = now() - start;
+        printf("  %-10s %10.3f ms/op %10.2f MB/s\n", names[p], elapsed * 1000 / iterations,
+               sdslen(json) * iterations / elapsed / (1024 * 1024));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 50;
+    int i = 1;
+
+    if (argc > 2 && !strcmp("-n", argv[1])) {
+        iterations = atoi(argv[2]);
+        i = 3;
+    }
+
+    if (i == argc) {
+        sds json = generateDocument(20000);
+        bench("generated (20000 records)", json, iterations);
+        sdsfree(json);
+    }
+
+    for (; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            fprintf(stderr, "can't open %s\n", argv[i]);
+            return 1;
+        }
+        sds json = sdsempty();
+        char chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f))) json = sdscatlen(json, chunk, n);
+        fclose(f);
+        bench(argv[i], json, iterations);
+        sdsfree(json);
+    }
+
+    return 0;
+}
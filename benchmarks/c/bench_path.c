@@ -0,0 +1,122 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* A microbenchmark of path lookups: it resolves a set of paths in a document by parsing them for
+* every lookup, like commands did before the path cache, and through the path cache. It then
+* resolves many paths under a deep common prefix one by one and with SearchPath_FindAll.
+*
+* Usage: bench_path [-n iterations]
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "../../src/json_object.h"
+#include "../../src/path_cache.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 200000;
+    const char *json =
+        "{\"user\":{\"name\":\"x\",\"address\":{\"city\":\"y\",\"zip\":\"z\"},\"tags\":[1,2,3]},"
+        "\"orders\":[{\"id\":1,\"items\":[{\"sku\":\"a\",\"qty\":2}]}],\"stats\":{\"visits\":7}}";
+    const char *paths[] = {".",
+                           ".user",
+                           ".user.name",
+                           ".user.address.city",
+                           "user.address.zip",
+                           ".user.tags[2]",
+                           ".orders[0].id",
+                           ".orders[0].items[0].sku",
+                           "['orders'][0]['items'][0][\"qty\"]",
+                           ".stats.visits"};
+    int npaths = sizeof(paths) / sizeof(char *);
+    Node *root, *n, *p, tmp;
+    int errlevel;
+    long found = 0;
+
+    if (argc > 2 && !strcmp("-n", argv[1])) iterations = atoi(argv[2]);
+    CreateNodeFromJSON(json, strlen(json), &root, NULL);
+
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        for (int j = 0; j < npaths; j++) {
+            SearchPath sp = NewSearchPath(0);
+            ParseJSONPath(paths[j], strlen(paths[j]), &sp, NULL);
+            found += E_OK == SearchPath_FindEx(&sp, root, &tmp, &n, &p, &errlevel);
+            SearchPath_Free(&sp);
+        }
+    }
+    double elapsed = now() - start;
+    printf("  %-8s %10.1f ns/lookup\n", "parse", elapsed * 1e9 / iterations / npaths);
+
+    start = now();
+    for (int i = 0; i < iterations; i++) {
+        for (int j = 0; j < npaths; j++) {
+            CompiledPath *cp = PathCache_Get(paths[j], strlen(paths[j]), NULL);
+            found += E_OK == SearchPath_FindEx(&cp->sp, root, &tmp, &n, &p, &errlevel);
+            PathCache_Release(cp);
+        }
+    }
+    elapsed = now() - start;
+    printf("  %-8s %10.1f ns/lookup\n", "cached", elapsed * 1e9 / iterations / npaths);
+
+    // 30 fields of a record that's deep in the document
+    Node *record = NewDictNode(30);
+    CompiledPath *many[30];
+    SearchPathMatch matches[30];
+    for (int j = 0; j < 30; j++) {
+        char field[64];
+        snprintf(field, sizeof(field), "field%d", j);
+        Node_DictSet(record, field, NewIntNode(j));
+        snprintf(field, sizeof(field), ".orders[0].items[0].record.field%d", j);
+        many[j] = PathCache_Get(field, strlen(field), NULL);
+    }
+    Node *item;
+    SearchPath sp = NewSearchPath(0);
+    ParseJSONPath(".orders[0].items[0]", 19, &sp, NULL);
+    SearchPath_Find(&sp, root, &tmp, &item);
+    SearchPath_Free(&sp);
+    Node_DictSet(item, "record", record);
+
+    start = now();
+    for (int i = 0; i < iterations / 10; i++) {
+        for (int j = 0; j < 30; j++) {
+            found += E_OK == SearchPath_FindEx(&many[j]->sp, root, &tmp, &n, &p, &errlevel);
+        }
+    }
+    elapsed = now() - start;
+    printf("  %-8s %10.1f ns/lookup\n", "each", elapsed * 1e9 / (iterations / 10) / 30);
+
+    start = now();
+    for (int i = 0; i < iterations / 10; i++) {
+        for (int j = 0; j < 30; j++) matches[j].path = &many[j]->sp;
+        SearchPath_FindAll(matches, 30, root);
+        found += E_OK == matches[29].err;
+    }
+    elapsed = now() - start;
+    printf("  %-8s %10.1f ns/lookup\n", "findall", elapsed * 1e9 / (iterations / 10) / 30);
+
+    for (int j = 0; j < 30; j++) PathCache_Release(many[j]);
+    Node_Free(root);
+    return found ? 0 : 1;
+}
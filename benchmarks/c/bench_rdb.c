@@ -0,0 +1,316 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* A microbenchmark of the RDB encodings: it compares the size, save and load times of encoding
+* version 0, which saves every node with its own module API calls, and version 1, which saves one
+* binary encoded buffer. Version 0 is modelled in memory the way Redis writes module values: every
+* call is prefixed by an opcode, lengths and integers use the RDB length encoding, doubles take 8
+* bytes and each loaded string buffer is a new allocation (RDB compression is left out). The "lazy"
+* load is the one that LAZY_RDB_LOAD makes of version 1, which copies and validates the buffer
+* without building nodes, i.e. what a restart takes per document.
+*
+* Usage: bench_rdb [-n iterations] [file.json ...]
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "../../src/json_object.h"
+#include "../../src/object_binary.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* === The version 0 model === */
+
+typedef struct {
+    sds buf;
+    size_t pos;
+} _RDB;
+
+static void saveLen(_RDB *rdb, uint64_t len) {
+    unsigned char b[9];
+    size_t n;
+    if (len < 1 << 6) {
+        b[0] = len;
+        n = 1;
+    } else if (len < 1 << 14) {
+        b[0] = 0x40 | (len >> 8);
+        b[1] = len & 0xff;
+        n = 2;
+    } else if (len <= UINT32_MAX) {
+        b[0] = 0x80;
+        for (int i = 0; i < 4; i++) b[1 + i] = len >> (24 - i * 8);
+        n = 5;
+    } else {
+        b[0] = 0x81;
+        for (int i = 0; i < 8; i++) b[1 + i] = len >> (56 - i * 8);
+        n = 9;
+    }
+    rdb->buf = sdscatlen(rdb->buf, b, n);
+}
+
+static uint64_t loadLen(_RDB *rdb) {
+    const unsigned char *p = (const unsigned char *)rdb->buf + rdb->pos;
+    uint64_t len = 0;
+    switch (p[0] >> 6) {
+        case 0:
+            rdb->pos += 1;
+            return p[0];
+        case 1:
+            rdb->pos += 2;
+            return ((p[0] & 0x3f) << 8) | p[1];
+        default:
+            if (0x80 == p[0]) {
+                for (int i = 0; i < 4; i++) len = (len << 8) | p[1 + i];
+                rdb->pos += 5;
+            } else {
+                for (int i = 0; i < 8; i++) len = (len << 8) | p[1 + i];
+                rdb->pos += 9;
+            }
+            return len;
+    }
+}
+
+static void saveUnsigned(_RDB *rdb, uint64_t v) {
+    saveLen(rdb, 2);  // the opcode
+    saveLen(rdb, v);
+}
+
+static uint64_t loadUnsigned(_RDB *rdb) {
+    loadLen(rdb);
+    return loadLen(rdb);
+}
+
+static void saveDouble(_RDB *rdb, double v) {
+    saveLen(rdb, 4);
+    rdb->buf = sdscatlen(rdb->buf, &v, sizeof(double));
+}
+
+static double loadDouble(_RDB *rdb) {
+    double v;
+    loadLen(rdb);
+    memcpy(&v, rdb->buf + rdb->pos, sizeof(double));
+    rdb->pos += sizeof(double);
+    return v;
+}
+
+static void saveString(_RDB *rdb, const char *s, size_t len) {
+    saveLen(rdb, 5);
+    saveLen(rdb, len);
+    rdb->buf = sdscatlen(rdb->buf, s, len);
+}
+
+static char *loadString(_RDB *rdb, size_t *len) {
+    loadLen(rdb);
+    *len = loadLen(rdb);
+    char *s = malloc(*len);
+    memcpy(s, rdb->buf + rdb->pos, *len);
+    rdb->pos += *len;
+    return s;
+}
+
+/* Saves like _ObjectTypeSave_Begin */
+static void saveV0(Node *n, void *ctx) {
+    _RDB *rdb = ctx;
+    if (!n) {
+        saveUnsigned(rdb, N_NULL);
+        return;
+    }
+    saveUnsigned(rdb, n->type);
+    switch (n->type) {
+        case N_BOOLEAN:
+            saveString(rdb, n->value.boolval ? "1" : "0", 1);
+            break;
+        case N_INTEGER:
+            saveUnsigned(rdb, (uint64_t)n->value.intval);
+            break;
+        case N_NUMBER:
+            saveDouble(rdb, Node_Number(n));
+            break;
+        case N_STRING:
+            saveString(rdb, n->value.strval.data, n->value.strval.len);
+            break;
+        case N_KEYVAL:
+            saveString(rdb, n->value.kvval.key, strlen(n->value.kvval.key));
+            break;
+        case N_DICT:
+            saveUnsigned(rdb, n->value.dictval.len);
+            break;
+        case N_ARRAY:
+            saveUnsigned(rdb, n->value.arrval.len);
+            break;
+        case N_NULL:
+            break;
+    }
+}
+
+/* Loads like ObjectTypeRdbLoad, only recursively */
+static Node *loadV0(_RDB *rdb) {
+    uint64_t type = loadUnsigned(rdb), len;
+    size_t slen;
+    char *s;
+    Node *n;
+
+    switch (type) {
+        case N_BOOLEAN:
+            s = loadString(rdb, &slen);
+            n = NewBoolNode('1' == s[0]);
+            free(s);
+            return n;
+        case N_INTEGER:
+            return NewIntNode((int64_t)loadUnsigned(rdb));
+        case N_NUMBER:
+            return NewDoubleNode(loadDouble(rdb));
+        case N_STRING:
+            s = loadString(rdb, &slen);
+            n = NewStringNode(s, slen);
+            free(s);
+            return n;
+        case N_DICT:
+            len = loadUnsigned(rdb);
+            n = NewDictNode(len);
+            while (len--) {
+                loadUnsigned(rdb);  // N_KEYVAL
+                s = loadString(rdb, &slen);
+                Node *kv = NewKeyValNode(s, slen, NULL);
+                free(s);
+                kv->value.kvval.val = loadV0(rdb);
+                Node_DictSetKeyVal(n, kv);
+            }
+            return n;
+        case N_ARRAY:
+            len = loadUnsigned(rdb);
+            n = NewArrayNode(len);
+            while (len--) Node_ArrayAppend(n, loadV0(rdb));
+            return n;
+        default:
+            return NULL;
+    }
+}
+
+/* === The benchmark === */
+
+static void bench(const char *title, const sds json, int iterations) {
+    Node *doc;
+    char *err = NULL;
+    if (JSONOBJECT_OK != CreateNodeFromJSON(json, sdslen(json), &doc, &err)) {
+        printf("%s: can't parse: %s\n", title, err);
+        free(err);
+        return;
+    }
+    printf("%s (%zu bytes of JSON)\n", title, sdslen(json));
+
+    NodeSerializerOpt nso = {.fBegin = saveV0, .xBegin = 0xff};
+    _RDB rdb = {sdsempty(), 0};
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        sdsclear(rdb.buf);
+        Node_Serializer(doc, &nso, &rdb);
+    }
+    double save = now() - start;
+    start = now();
+    for (int i = 0; i < iterations; i++) {
+        rdb.pos = 0;
+        Node_Free(loadV0(&rdb));
+    }
+    double load = now() - start;
+    printf("  %-8s %10zu bytes %10.3f ms save %10.3f ms load\n", "encver 0", sdslen(rdb.buf),
+           save * 1000 / iterations, load * 1000 / iterations);
+    sdsfree(rdb.buf);
+
+    sds bin = sdsempty();
+    start = now();
+    for (int i = 0; i < iterations; i++) {
+        sdsclear(bin);
+        SerializeNodeToBinary(doc, &bin);
+    }
+    save = now() - start;
+    start = now();
+    for (int i = 0; i < iterations; i++) {
+        Node *n;
+        CreateNodeFromBinary(bin, sdslen(bin), &n);
+        Node_Free(n);
+    }
+    load = now() - start;
+    printf("  %-8s %10zu bytes %10.3f ms save %10.3f ms load\n", "encver 1", sdslen(bin),
+           save * 1000 / iterations, load * 1000 / iterations);
+    start = now();
+    for (int i = 0; i < iterations; i++) {
+        char *buf = malloc(sdslen(bin));
+        memcpy(buf, bin, sdslen(bin));
+        if (OBJ_OK != ValidateBinary(buf, sdslen(bin))) printf("  invalid encoding\n");
+        free(buf);
+    }
+    load = now() - start;
+    printf("  %-8s %10zu bytes %10.3f ms save %10.3f ms load\n", "lazy", sdslen(bin),
+           save * 1000 / iterations, load * 1000 / iterations);
+    sdsfree(bin);
+    Node_Free(doc);
+}
+
+/* A document of records with short strings, small numbers and nested values */
+static sds generateDocument(int records) {
+    sds json = sdsnew("[");
+
+    for (int i = 0; i < records; i++) {
+        if (i) json = sdscat(json, ",");
+        json = sdscatprintf(json,
+                            "{\"id\":%d,\"name\":\"user %d\",\"active\":%s,\"score\":%d.%d,"
+                            "\"address\":{\"street\":\"%d Main St.\",\"zip\":\"%05d\"},"
+                            "\"history\":[%d,%d,%d],\"tags\":[\"a\",\"b\",null]}",
+                            1000000 + i, i, i % 3 ? "true" : "false", i % 100, i % 7, i, i * 13,
+                            i % 50, i % 20, -i % 10);
+    }
+    return sdscat(json, "]");
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 20;
+    int i = 1;
+
+    if (argc > 2 && !strcmp("-n", argv[1])) {
+        iterations = atoi(argv[2]);
+        i = 3;
+    }
+
+    if (i == argc) {
+        sds json = generateDocument(20000);
+        bench("generated (20000 records)", json, iterations);
+        sdsfree(json);
+    }
+
+    for (; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            fprintf(stderr, "can't open %s\n", argv[i]);
+            return 1;
+        }
+        sds json = sdsempty();
+        char chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f))) json = sdscatlen(json, chunk, n);
+        fclose(f);
+        bench(argv[i], json, iterations);
+        sdsfree(json);
+    }
+
+    return 0;
+}
@@ -0,0 +1,247 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* A microbenchmark of JSON.RESP's reply formats: it compares the size of the replies, the time to
+* write them, and the time that a client takes to decode them into a tree of replies as hiredis
+* does. The replies are written to a buffer in the wire protocol with the writer of
+* ObjectTypeWriteResp, the module API being pointed to libc's allocator.
+*
+* Usage: bench_resp [-n iterations] [file.json ...]
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "../../src/json_object.h"
+#include "../../src/object_type.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A reply that's being written, and whether it's for a RESP3 client */
+typedef struct {
+    sds buf;
+    int resp3;
+} RespBuffer;
+
+static void writeArray(void *ctx, long len) {
+    RespBuffer *b = ctx;
+    b->buf = sdscatfmt(b->buf, "*%I\r\n", (long long)len);
+}
+
+static void writeMap(void *ctx, long len) {
+    RespBuffer *b = ctx;
+    b->buf = sdscatfmt(b->buf, "%%%I\r\n", (long long)len);
+}
+
+static void writeNull(void *ctx) {
+    RespBuffer *b = ctx;
+    b->buf = sdscatlen(b->buf, b->resp3 ? "_\r\n" : "$-1\r\n", b->resp3 ? 3 : 5);
+}
+
+static void writeBool(void *ctx, int val) {
+    RespBuffer *b = ctx;
+    b->buf = sdscatlen(b->buf, val ? "#t\r\n" : "#f\r\n", 4);
+}
+
+static void writeInteger(void *ctx, long long val) {
+    RespBuffer *b = ctx;
+    b->buf = sdscatfmt(b->buf, ":%I\r\n", val);
+}
+
+/* Doubles are bulk strings for RESP2 clients, as Redis' RedisModule_ReplyWithDouble replies */
+static void writeNumber(void *ctx, double val) {
+    RespBuffer *b = ctx;
+    char dbuf[32];
+    int len = snprintf(dbuf, sizeof(dbuf), "%.17g", val);
+    if (b->resp3) {
+        b->buf = sdscatprintf(b->buf, ",%s\r\n", dbuf);
+    } else {
+        b->buf = sdscatprintf(b->buf, "$%d\r\n%s\r\n", len, dbuf);
+    }
+}
+
+static void writeString(void *ctx, const char *str, size_t len) {
+    RespBuffer *b = ctx;
+    b->buf = sdscatfmt(b->buf, "$%U\r\n", (unsigned long long)len);
+    b->buf = sdscatlen(b->buf, str, len);
+    b->buf = sdscatlen(b->buf, "\r\n", 2);
+}
+
+static void writeSimple(void *ctx, const char *str) {
+    RespBuffer *b = ctx;
+    b->buf = sdscatfmt(b->buf, "+%s\r\n", str);
+}
+
+static const ObjectRespWriter bufferWriter = {
+    writeArray, writeMap, writeNull, writeBool, writeInteger, writeNumber, writeString, writeSimple};
+
+/* A decoded reply, as hiredis' redisReply: maps have the keys and values as their elements */
+typedef struct RespReply {
+    char type;
+    long long integer;
+    double dval;
+    char *str;
+    size_t len;
+    size_t elements;
+    struct RespReply **element;
+} RespReply;
+
+static void freeReply(RespReply *r) {
+    for (size_t i = 0; i < r->elements; i++) freeReply(r->element[i]);
+    free(r->element);
+    free(r->str);
+    free(r);
+}
+
+/* Decodes the reply at *p, moving *p past it */
+static RespReply *decodeReply(const char **p) {
+    RespReply *r = calloc(1, sizeof(RespReply));
+    char *end;
+    r->type = *(*p)++;
+    switch (r->type) {
+        case '+':
+            end = strchr(*p, '\r');
+            r->len = end - *p;
+            r->str = strndup(*p, r->len);
+            *p = end + 2;
+            break;
+        case ':':
+            r->integer = strtoll(*p, &end, 10);
+            *p = end + 2;
+            break;
+        case ',':
+            r->dval = strtod(*p, &end);
+            *p = end + 2;
+            break;
+        case '#':
+            r->integer = 't' == **p;
+            *p += 3;
+            break;
+        case '_':
+            *p += 2;
+            break;
+        case '$': {
+            long long len = strtoll(*p, &end, 10);
+            *p = end + 2;
+            if (len < 0) break;
+            r->len = len;
+            r->str = malloc(len + 1);
+            memcpy(r->str, *p, len);
+            r->str[len] = '\0';
+            *p += len + 2;
+        } break;
+        case '*':
+        case '%':
+            r->elements = strtoll(*p, &end, 10) * ('%' == r->type ? 2 : 1);
+            *p = end + 2;
+            r->element = malloc(r->elements * sizeof(RespReply *));
+            for (size_t i = 0; i < r->elements; i++) r->element[i] = decodeReply(p);
+            break;
+    }
+    return r;
+}
+
+static void bench(const char *title, const sds json, int iterations) {
+    static const char *names[] = {"legacy", "compact", "resp3"};
+    Node *doc;
+    char *err = NULL;
+    if (JSONOBJECT_OK != CreateNodeFromJSON(json, sdslen(json), &doc, &err)) {
+        printf("%s: can't parse: %s\n", title, err);
+        free(err);
+        return;
+    }
+    printf("%s (%zu bytes of JSON)\n", title, sdslen(json));
+
+    for (int f = OBJECT_RESP_LEGACY; f <= OBJECT_RESP_3; f++) {
+        RespBuffer b = {.buf = sdsempty(), .resp3 = OBJECT_RESP_3 == f};
+        double start = now();
+        for (int i = 0; i < iterations; i++) {
+            sdsclear(b.buf);
+            ObjectTypeWriteResp(doc, f, &bufferWriter, &b);
+        }
+        double write = now() - start;
+        start = now();
+        for (int i = 0; i < iterations; i++) {
+            const char *p = b.buf;
+            freeReply(decodeReply(&p));
+        }
+        double decode = now() - start;
+        printf("  %-8s %10zu bytes %10.3f ms write %10.3f ms decode\n", names[f], sdslen(b.buf),
+               write * 1000 / iterations, decode * 1000 / iterations);
+        sdsfree(b.buf);
+    }
+    Node_Free(doc);
+}
+
+/* A document of records with short strings, small numbers and nested values */
+static sds generateDocument(int records) {
+    sds json = sdsnew("[");
+
+    for (int i = 0; i < records; i++) {
+        if (i) json = sdscat(json, ",");
+        json = sdscatprintf(json,
+                            "{\"id\":%d,\"name\":\"user %d\",\"active\":%s,\"score\":%d.%d,"
+                            "\"address\":{\"street\":\"%d Main St.\",\"zip\":\"%05d\"},"
+                            "\"history\":[%d,%d,%d],\"tags\":[\"a\",\"b\",null]}",
+                            1000000 + i, i, i % 3 ? "true" : "false", i % 100, i % 7, i, i * 13,
+                            i % 50, i % 20, -i % 10);
+    }
+    return sdscat(json, "]");
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 20;
+    int i = 1;
+
+    RedisModule_Alloc = malloc;
+    RedisModule_Calloc = calloc;
+    RedisModule_Realloc = realloc;
+    RedisModule_Free = free;
+    RedisModule_Strdup = strdup;
+
+    if (argc > 2 && !strcmp("-n", argv[1])) {
+        iterations = atoi(argv[2]);
+        i = 3;
+    }
+
+    if (i == argc) {
+        sds json = generateDocument(20000);
+        bench("generated (20000 records)", json, iterations);
+        sdsfree(json);
+    }
+
+    for (; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            fprintf(stderr, "can't open %s\n", argv[i]);
+            return 1;
+        }
+        sds json = sdsempty();
+        char chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f))) json = sdscatlen(json, chunk, n);
+        fclose(f);
+        bench(argv[i], json, iterations);
+        sdsfree(json);
+    }
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* A microbenchmark of JSON.ARRINDEX and JSON.ARRCOUNT: it searches for a missing value and counts a
+* value in packed arrays of integers and doubles with each of the kernels that the CPU supports,
+* and in a generic array of strings, and then in the same arrays once they're indexed (USEINDEX).
+*
+* Usage: bench_search [-n iterations] [length]
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "../../src/object.h"
+#include "../../src/object_search.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, Node *arr, Node *missing, Node *value, int iterations) {
+    int count = 0;
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        if (-1 != Node_ArrayIndex(arr, missing, 0, 0)) printf("  unexpected index\n");
+    }
+    double index = now() - start;
+    start = now();
+    for (int i = 0; i < iterations; i++) count += Node_ArrayCount(arr, value, 0, 0);
+    double counting = now() - start;
+    printf("  %-16s %10.3f ms arrindex %10.3f ms arrcount (%d)\n", name,
+           index * 1000 / iterations, counting * 1000 / iterations, count / iterations);
+}
+
+int main(int argc, char *argv[]) {
+    const char *kernels[] = {"avx2", "sse2", "neon", "scalar"};
+    int iterations = 100, length = 1000000;
+    int i = 1;
+    char name[32];
+
+    if (argc > 2 && !strcmp("-n", argv[1])) {
+        iterations = atoi(argv[2]);
+        i = 3;
+    }
+    if (i < argc) length = atoi(argv[i]);
+
+    Node *ints = NewArrayNode(length), *nums = NewArrayNode(length), *strs = NewArrayNode(length);
+    for (i = 0; i < length; i++) {
+        snprintf(name, sizeof(name), "member %d", i % 1000);
+        Node_ArrayAppendInt(ints, i % 1000);
+        Node_ArrayAppendDouble(nums, (i % 1000) * 0.5);
+        Node_ArrayAppend(strs, NewCStringNode(name));
+    }
+    Node *missingInt = NewIntNode(-1), *missingNum = NewDoubleNode(-1), *int7 = NewIntNode(7),
+         *num7 = NewDoubleNode(3.5), *missingStr = NewCStringNode("member -1"),
+         *str7 = NewCStringNode("member 7");
+
+    printf("%d items\n", length);
+    const char *kernel = ObjectSearch_Kernel();
+    for (i = 0; i < 4; i++) {
+        if (!ObjectSearch_UseKernel(kernels[i])) continue;
+        snprintf(name, sizeof(name), "integers %s", kernels[i]);
+        run(name, ints, missingInt, int7, iterations);
+        snprintf(name, sizeof(name), "doubles %s", kernels[i]);
+        run(name, nums, missingNum, num7, iterations);
+    }
+    ObjectSearch_UseKernel(kernel);
+    run("strings", strs, missingStr, str7, iterations);
+
+    Node_ArraySetIndexed(ints, 1);
+    Node_ArraySetIndexed(nums, 1);
+    Node_ArraySetIndexed(strs, 1);
+    double start = now();
+    Node_ArrayIndex(ints, missingInt, 0, 0);
+    Node_ArrayIndex(nums, missingNum, 0, 0);
+    Node_ArrayIndex(strs, missingStr, 0, 0);
+    printf("  %-16s %10.3f ms\n", "building indexes", (now() - start) * 1000);
+    run("integers indexed", ints, missingInt, int7, iterations);
+    run("doubles indexed", nums, missingNum, num7, iterations);
+    run("strings indexed", strs, missingStr, str7, iterations);
+
+    Node_Free(ints);
+    Node_Free(nums);
+    Node_Free(strs);
+    Node_Free(missingInt);
+    Node_Free(missingNum);
+    Node_Free(int7);
+    Node_Free(num7);
+    Node_Free(missingStr);
+    Node_Free(str7);
+    return 0;
+}
@@ -0,0 +1,285 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* A microbenchmark of the JSON serializer: it compares SerializeNodeToJSON with the original
+* printf-based serializer, which is kept here as a baseline, on a generated document or on the JSON
+* files given as arguments.
+*
+* Usage: bench_serializer [-n iterations] [file.json ...]
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "../../src/json_object.h"
+
+/* === The original serializer === */
+
+typedef struct {
+    sds buf;
+    int depth;
+    int indent;
+    sds indentstr;
+    sds newlinestr;
+    sds spacestr;
+    sds delimstr;
+} _LegacyContext;
+
+#define _Legacy_Indent(b) \
+    if (b->indent)        \
+        for (int i = 0; i < b->depth; i++) b->buf = sdscatsds(b->buf, b->indentstr);
+
+static void _Legacy_StringValue(Node *n, void *ctx) {
+    _LegacyContext *b = (_LegacyContext *)ctx;
+    size_t len = n->value.strval.len;
+    const char *p = n->value.strval.data;
+
+    b->buf = sdsMakeRoomFor(b->buf, len + 2);
+    b->buf = sdscatlen(b->buf, "\"", 1);
+    while (len--) {
+        switch (*p) {
+            case '"':
+            case '\\':
+                b->buf = sdscatprintf(b->buf, "\\%c", *p);
+                break;
+            case '/':
+                b->buf = sdscatlen(b->buf, "\\/", 2);
+                break;
+            case '\b':
+                b->buf = sdscatlen(b->buf, "\\b", 2);
+                break;
+            case '\f':
+                b->buf = sdscatlen(b->buf, "\\f", 2);
+                break;
+            case '\n':
+                b->buf = sdscatlen(b->buf, "\\n", 2);
+                break;
+            case '\r':
+                b->buf = sdscatlen(b->buf, "\\r", 2);
+                break;
+            case '\t':
+                b->buf = sdscatlen(b->buf, "\\t", 2);
+                break;
+            default:
+                if ((unsigned char)*p > 31 && isprint(*p))
+                    b->buf = sdscatprintf(b->buf, "%c", *p);
+                else
+                    b->buf = sdscatprintf(b->buf, "\\u%04x", (unsigned char)*p);
+                break;
+        }
+        p++;
+    }
+    b->buf = sdscatlen(b->buf, "\"", 1);
+}
+
+static void _Legacy_BeginValue(Node *n, void *ctx) {
+    _LegacyContext *b = (_LegacyContext *)ctx;
+
+    if (!n) {
+        b->buf = sdscatlen(b->buf, "null", 4);
+        return;
+    }
+    switch (n->type) {
+        case N_BOOLEAN:
+            if (n->value.boolval)
+                b->buf = sdscatlen(b->buf, "true", 4);
+            else
+                b->buf = sdscatlen(b->buf, "false", 5);
+            break;
+        case N_INTEGER:
+            b->buf = sdscatfmt(b->buf, "%I", n->value.intval);
+            break;
+        case N_NUMBER: {
+            double v = Node_Number(n);
+            if (fabs(floor(v) - v) <= DBL_EPSILON && fabs(v) < 1.0e60)
+                b->buf = sdscatprintf(b->buf, "%.0f", v);
+            else if (fabs(v) < 1.0e-6 || fabs(v) > 1.0e9)
+                b->buf = sdscatprintf(b->buf, "%e", v);
+            else
+                b->buf = sdscatprintf(b->buf, "%.17g", v);
+        } break;
+        case N_STRING:
+            _Legacy_StringValue(n, b);
+            break;
+        case N_KEYVAL:
+            b->buf = sdscatfmt(b->buf, "\"%s\":%s", n->value.kvval.key, b->spacestr);
+            break;
+        case N_DICT:
+            b->buf = sdscatlen(b->buf, "{", 1);
+            b->depth++;
+            if (n->value.dictval.len) {
+                b->buf = sdscatsds(b->buf, b->newlinestr);
+                _Legacy_Indent(b);
+            }
+            break;
+        case N_ARRAY:
+            b->buf = sdscatlen(b->buf, "[", 1);
+            b->depth++;
+            if (n->value.arrval.len) {
+                b->buf = sdscatsds(b->buf, b->newlinestr);
+                _Legacy_Indent(b);
+            }
+            break;
+        case N_NULL:
+            break;
+    }
+}
+
+static void _Legacy_EndValue(Node *n, void *ctx) {
+    _LegacyContext *b = (_LegacyContext *)ctx;
+    if (!n) return;
+    if (N_DICT == n->type || N_ARRAY == n->type) {
+        int len = N_DICT == n->type ? n->value.dictval.len : n->value.arrval.len;
+        if (len) b->buf = sdscatsds(b->buf, b->newlinestr);
+        b->depth--;
+        _Legacy_Indent(b);
+        b->buf = sdscatlen(b->buf, N_DICT == n->type ? "}" : "]", 1);
+    }
+}
+
+static void _Legacy_ContainerDelimiter(void *ctx) {
+    _LegacyContext *b = (_LegacyContext *)ctx;
+    b->buf = sdscat(b->buf, b->delimstr);
+    _Legacy_Indent(b);
+}
+
+static void LegacySerializeNodeToJSON(const Node *node, const JSONSerializeOpt *opt, sds *json) {
+    _LegacyContext *b = calloc(1, sizeof(_LegacyContext));
+    b->indentstr = opt->indentstr ? sdsnew(opt->indentstr) : sdsempty();
+    b->newlinestr = opt->newlinestr ? sdsnew(opt->newlinestr) : sdsempty();
+    b->spacestr = opt->spacestr ? sdsnew(opt->spacestr) : sdsempty();
+    b->indent = sdslen(b->indentstr);
+    b->delimstr = sdsnewlen(",", 1);
+    b->delimstr = sdscat(b->delimstr, b->newlinestr);
+
+    NodeSerializerOpt nso = {.fBegin = _Legacy_BeginValue,
+                             .xBegin = 0xffff,
+                             .fEnd = _Legacy_EndValue,
+                             .xEnd = (N_DICT | N_ARRAY),
+                             .fDelim = _Legacy_ContainerDelimiter,
+                             .xDelim = (N_DICT | N_ARRAY)};
+    b->buf = *json;
+    Node_Serializer(node, &nso, b);
+    *json = b->buf;
+
+    sdsfree(b->indentstr);
+    sdsfree(b->newlinestr);
+    sdsfree(b->spacestr);
+    sdsfree(b->delimstr);
+    free(b);
+}
+
+/* === The benchmark === */
+
+typedef void (*SerializeFunc)(const Node *, const JSONSerializeOpt *, sds *);
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A document of records that mixes strings (some in need of escaping), integers and doubles */
+static Node *generateDocument(int records) {
+    Node *root = NewArrayNode(records);
+    for (int i = 0; i < records; i++) {
+        char name[64];
+        int len = snprintf(name, sizeof(name), i % 8 ? "user number %d living at http://x.io/%d"
+                                                     : "\"quoted\"\tuser %d\nat C:\\%d",
+                           i, i * 7);
+        Node *rec = NewDictNode(6);
+        Node_DictSet(rec, "id", NewIntNode(1000000 + i));
+        Node_DictSet(rec, "name", NewStringNode(name, len));
+        Node_DictSet(rec, "score", NewDoubleNode(i * 1.37 + 0.001));
+        Node_DictSet(rec, "ratio", NewDoubleNode(1.0 / (i + 3)));
+        Node_DictSet(rec, "active", NewBoolNode(i % 3));
+        Node *tags = NewArrayNode(3);
+        Node_ArrayAppend(tags, NewCStringNode("alpha"));
+        Node_ArrayAppend(tags, NewCStringNode("beta"));
+        Node_ArrayAppend(tags, NewIntNode(i % 100));
+        Node_DictSet(rec, "tags", tags);
+        Node_ArrayAppend(root, rec);
+    }
+    return root;
+}
+
+static void run(const char *name, const Node *doc, SerializeFunc f, const JSONSerializeOpt *opt,
+                int iterations) {
+    size_t bytes = 0;
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        sds json = sdsempty();
+        f(doc, opt, &json);
+        bytes += sdslen(json);
+        sdsfree(json);
+    }
+    double elapsed = now() - start;
+    printf("  %-10s %10.2f ms/op %10.2f MB/s\n", name, elapsed * 1000 / iterations,
+           bytes / elapsed / (1024 * 1024));
+}
+
+static void bench(const char *title, const Node *doc, int iterations) {
+    JSONSerializeOpt compact = {"", "", ""};
+    JSONSerializeOpt pretty = {"  ", "\n", " "};
+
+    printf("%s\n", title);
+    run("legacy", doc, LegacySerializeNodeToJSON, &compact, iterations);
+    run("current", doc, SerializeNodeToJSON, &compact, iterations);
+    run("legacy/i", doc, LegacySerializeNodeToJSON, &pretty, iterations);
+    run("current/i", doc, SerializeNodeToJSON, &pretty, iterations);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 50;
+    int i = 1;
+
+    if (argc > 2 && !strcmp("-n", argv[1])) {
+        iterations = atoi(argv[2]);
+        i = 3;
+    }
+
+    if (i == argc) {
+        Node *doc = generateDocument(20000);
+        bench("generated (20000 records)", doc, iterations);
+        Node_Free(doc);
+    }
+
+    for (; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            fprintf(stderr, "can't open %s\n", argv[i]);
+            return 1;
+        }
+        sds json = sdsempty();
+        char chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f))) json = sdscatlen(json, chunk, n);
+        fclose(f);
+
+        Node *doc;
+        char *err = NULL;
+        if (JSONOBJECT_OK != CreateNodeFromJSON(json, sdslen(json), &doc, &err)) {
+            fprintf(stderr, "can't parse %s: %s\n", argv[i], err);
+            return 1;
+        }
+        bench(argv[i], doc, iterations);
+        Node_Free(doc);
+        sdsfree(json);
+    }
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* A benchmark of string handling: it times the parsing of a JSON document and its serialization
+* with every string scanning kernel that the CPU supports. It runs on a generated document of long
+* strings (HTML snippets and base64 blobs) or on the JSON files given as arguments, such as the ones
+* in deps/jsonsl/json_samples.tgz (see the `bench_samples` target). It also times appends to many
+* strings in turn, like JSON.STRAPPEND to log fields does.
+*
+* Usage: bench_strings [-n iterations] [file.json ...]
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "../../src/json_object.h"
+#include "../../src/json_scan.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A document of long strings, the HTML snippets are serialized with escapes and the blobs without */
+static sds generateDocument(int records) {
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    sds json = sdsnew("[");
+
+    for (int i = 0; i < records; i++) {
+        if (i) json = sdscat(json, ",");
+        json = sdscatprintf(json,
+                            "{\"id\":%d,\"html\":\"<div class=\\\"item\\\"><a href=\\\"https:"
+                            "\\/\\/example.com\\/items\\/%d\\\">Item number %d<\\/a> with a "
+                            "description that goes on for a while<\\/div>\\n\",\"blob\":\"",
+                            i, i, i);
+        for (int j = 0; j < 512; j++) json = sdscatlen(json, &b64[(i + j * 7) % 64], 1);
+        json = sdscat(json, "\"}");
+    }
+    return sdscat(json, "]");
+}
+
+static void bench(const char *title, const sds json, int iterations) {
+    const char *kernels[] = {"avx2", "sse2", "neon", "scalar"};
+    const char *kernel = JSON_ScanKernel();
+    JSONSerializeOpt opt = {"", "", ""};
+    Node *doc;
+    char *err = NULL;
+
+    printf("%s (%zu bytes)\n", title, sdslen(json));
+
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        if (JSONOBJECT_OK != CreateNodeFromJSON(json, sdslen(json), &doc, &err)) {
+            printf("  can't parse: %s\n", err);
+            free(err);
+            return;
+        }
+        if (i < iterations - 1) Node_Free(doc);
+    }
+    double elapsed = now() - start;
+    printf("  %-16s %10.3f ms/op %10.2f MB/s\n", "parse", elapsed * 1000 / iterations,
+           sdslen(json) * iterations / elapsed / (1024 * 1024));
+
+    for (int k = 0; k < sizeof(kernels) / sizeof(char *); k++) {
+        if (!JSON_ScanUseKernel(kernels[k])) continue;
+        size_t bytes = 0;
+        start = now();
+        for (int i = 0; i < iterations; i++) {
+            sds out = sdsempty();
+            SerializeNodeToJSON(doc, &opt, &out);
+            bytes += sdslen(out);
+            sdsfree(out);
+        }
+        elapsed = now() - start;
+        char name[32];
+        snprintf(name, sizeof(name), "serialize/%s", kernels[k]);
+        printf("  %-16s %10.3f ms/op %10.2f MB/s\n", name, elapsed * 1000 / iterations,
+               bytes / elapsed / (1024 * 1024));
+    }
+    JSON_ScanUseKernel(kernel);
+    Node_Free(doc);
+}
+
+/* Appends lines to a number of strings in turn, so that no string's data can grow where it is */
+static void benchAppend(int strings, int appends) {
+    Node **strs = malloc(strings * sizeof(Node *));
+    Node *line = NewCStringNode("2024-01-01T00:00:00Z INFO a line that is appended to the log\n");
+    for (int i = 0; i < strings; i++) strs[i] = NewCStringNode("");
+
+    double start = now();
+    for (int j = 0; j < appends; j++) {
+        for (int i = 0; i < strings; i++) Node_StringAppend(strs[i], line);
+    }
+    double elapsed = now() - start;
+
+    size_t memory = 0;
+    for (int i = 0; i < strings; i++) {
+        memory += Node_StringMemory(strs[i]);
+        Node_Free(strs[i]);
+    }
+    char title[64];
+    snprintf(title, sizeof(title), "append (%dx%d)", strings, appends);
+    printf("%s\n  %-16s %10.1f ns/op %10.2f MB held for %.2f MB\n", title, "append",
+           elapsed * 1e9 / ((double)strings * appends), memory / (1024.0 * 1024),
+           (double)strings * appends * line->value.strval.len / (1024 * 1024));
+    Node_Free(line);
+    free(strs);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 50;
+    int i = 1;
+
+    if (argc > 2 && !strcmp("-n", argv[1])) {
+        iterations = atoi(argv[2]);
+        i = 3;
+    }
+
+    if (i == argc) {
+        sds json = generateDocument(5000);
+        bench("generated (5000 records)", json, iterations);
+        sdsfree(json);
+        benchAppend(1000, 2000);
+        benchAppend(1, 200000);
+    }
+
+    for (; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            fprintf(stderr, "can't open %s\n", argv[i]);
+            return 1;
+        }
+        sds json = sdsempty();
+        char chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f))) json = sdscatlen(json, chunk, n);
+        fclose(f);
+        bench(argv[i], json, iterations);
+        sdsfree(json);
+    }
+
+    return 0;
+}
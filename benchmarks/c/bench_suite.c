@@ -0,0 +1,391 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* The benchmark suite of the module's layers, whose results are meant to be compared between builds.
+* For each of the JSON files it measures parsing, serializing, and saving and loading the document
+* with the RDB callbacks of the JSON type, on a mocked RedisModuleIO that keeps the stream in
+* memory. It then measures parsing and resolving paths, and getting keys of dictionaries of
+* different sizes, where an operation is a single lookup. Every benchmark runs in batches that
+* double until it has taken the minimum time, and its results are printed as a line of tab
+* separated fields:
+*
+*   benchmark  input  ops  ns/op  MB/s
+*
+* where MB/s is the throughput over the input's JSON, or 0 when there's no such thing. Lines that
+* start with '#' are comments. `cmake --build build --target bench` runs the suite over the passing
+* files of test/files and the jsonsl samples.
+*
+* Usage: bench_suite [-t seconds] [file.json ...]
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include "../../src/json_object.h"
+#include "../../src/json_path.h"
+#include "../../src/json_type.h"
+#include "../../src/object_type.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The RDB stream in memory, that the mocked RedisModuleIO points to */
+typedef struct {
+    sds buf;
+    size_t pos;
+} MockIO;
+
+static void mockSave(RedisModuleIO *io, const void *p, size_t len) {
+    MockIO *m = (MockIO *)io;
+    m->buf = sdscatlen(m->buf, p, len);
+}
+
+static void mockLoad(RedisModuleIO *io, void *p, size_t len) {
+    MockIO *m = (MockIO *)io;
+    if (m->pos + len > sdslen(m->buf)) {
+        fprintf(stderr, "bench_suite: read past the end of the RDB stream\n");
+        exit(1);
+    }
+    memcpy(p, m->buf + m->pos, len);
+    m->pos += len;
+}
+
+static void mockSaveUnsigned(RedisModuleIO *io, uint64_t value) {
+    mockSave(io, &value, sizeof(value));
+}
+
+static uint64_t mockLoadUnsigned(RedisModuleIO *io) {
+    uint64_t value;
+    mockLoad(io, &value, sizeof(value));
+    return value;
+}
+
+static void mockSaveSigned(RedisModuleIO *io, int64_t value) {
+    mockSave(io, &value, sizeof(value));
+}
+
+static int64_t mockLoadSigned(RedisModuleIO *io) {
+    int64_t value;
+    mockLoad(io, &value, sizeof(value));
+    return value;
+}
+
+static void mockSaveDouble(RedisModuleIO *io, double value) {
+    mockSave(io, &value, sizeof(value));
+}
+
+static double mockLoadDouble(RedisModuleIO *io) {
+    double value;
+    mockLoad(io, &value, sizeof(value));
+    return value;
+}
+
+static void mockSaveStringBuffer(RedisModuleIO *io, const char *str, size_t len) {
+    mockSaveUnsigned(io, len);
+    mockSave(io, str, len);
+}
+
+static char *mockLoadStringBuffer(RedisModuleIO *io, size_t *lenptr) {
+    size_t len = mockLoadUnsigned(io);
+    char *str = malloc(len + 1);
+    mockLoad(io, str, len);
+    str[len] = '\0';
+    if (lenptr) *lenptr = len;
+    return str;
+}
+
+static void mockLogIOError(RedisModuleIO *io, const char *levelstr, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "bench_suite: %s: ", levelstr);
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+}
+
+static long long mockMilliseconds(void) {
+    return (long long)(now() * 1000);
+}
+
+/* Points the module API that the RDB callbacks use to the mocks, and its allocator to libc's */
+static void mockModuleAPI(void) {
+    RedisModule_Alloc = malloc;
+    RedisModule_Calloc = calloc;
+    RedisModule_Realloc = realloc;
+    RedisModule_Free = free;
+    RedisModule_Strdup = strdup;
+    RedisModule_SaveUnsigned = mockSaveUnsigned;
+    RedisModule_LoadUnsigned = mockLoadUnsigned;
+    RedisModule_SaveSigned = mockSaveSigned;
+    RedisModule_LoadSigned = mockLoadSigned;
+    RedisModule_SaveDouble = mockSaveDouble;
+    RedisModule_LoadDouble = mockLoadDouble;
+    RedisModule_SaveStringBuffer = mockSaveStringBuffer;
+    RedisModule_LoadStringBuffer = mockLoadStringBuffer;
+    RedisModule_LogIOError = mockLogIOError;
+    RedisModule_Milliseconds = mockMilliseconds;
+}
+
+static double _mintime = 0.5;
+
+/* The threads of the parse_parallel benchmark */
+#define BENCH_PARSE_THREADS 4
+
+/* What a benchmark works on, the fields that its operation doesn't use are unset */
+typedef struct {
+    const char *json;
+    size_t len;
+    Node *root;
+    JSONType_t *jt;
+    MockIO io;
+    SearchPath *paths;
+    const char **pathstrs;
+    int npaths;
+    char **keys;
+    int nkeys;
+    int batch;  // the operations that one run does, when it's more than 1
+} Bench;
+
+typedef void (*BenchOp)(Bench *b);
+
+/* Runs the operation in doubling batches for at least the minimum time and prints its results */
+static void measure(const char *name, const char *input, BenchOp op, Bench *b, size_t bytes) {
+    uint64_t ops = 0, batch = 1;
+    double start = now(), elapsed = 0;
+    while (elapsed < _mintime) {
+        for (uint64_t i = 0; i < batch; i++) op(b);
+        ops += batch * (b->batch ? b->batch : 1);
+        batch *= 2;
+        elapsed = now() - start;
+    }
+    printf("%s\t%s\t%llu\t%.1f\t%.2f\n", name, input, (unsigned long long)ops, elapsed * 1e9 / ops,
+           bytes * ops / elapsed / 1e6);
+    fflush(stdout);
+}
+
+static void opParse(Bench *b) {
+    Node *n;
+    CreateNodeFromJSON(b->json, b->len, &n, NULL);
+    Node_Free(n);
+}
+
+static void opParseParallel(Bench *b) {
+    Node *n;
+    CreateNodeFromJSONParallel(b->json, b->len, BENCH_PARSE_THREADS, &n, NULL);
+    Node_Free(n);
+}
+
+static void opSerialize(Bench *b) {
+    JSONSerializeOpt opt = {.indentstr = "", .newlinestr = "", .spacestr = ""};
+    sds json = sdsempty();
+    SerializeNodeToJSON(b->root, &opt, &json);
+    sdsfree(json);
+}
+
+static void opRdbSave(Bench *b) {
+    sdsclear(b->io.buf);
+    JSONTypeRdbSave((RedisModuleIO *)&b->io, b->jt);
+}
+
+static void opRdbLoad(Bench *b) {
+    b->io.pos = 0;
+    JSONTypeFree(JSONTypeRdbLoad((RedisModuleIO *)&b->io, JSONTYPE_ENCODING_VERSION));
+}
+
+static void opRdbSaveV0(Bench *b) {
+    sdsclear(b->io.buf);
+    ObjectTypeRdbSave((RedisModuleIO *)&b->io, b->root);
+}
+
+static void opRdbLoadV0(Bench *b) {
+    b->io.pos = 0;
+    JSONTypeFree(JSONTypeRdbLoad((RedisModuleIO *)&b->io, 0));
+}
+
+static void opPathParse(Bench *b) {
+    for (int i = 0; i < b->npaths; i++) {
+        SearchPath sp = NewSearchPath(0);
+        ParseJSONPath(b->pathstrs[i], strlen(b->pathstrs[i]), &sp, NULL);
+        SearchPath_Free(&sp);
+    }
+}
+
+static void opPathFind(Bench *b) {
+    Node tmp, *n;
+    for (int i = 0; i < b->npaths; i++) SearchPath_Find(&b->paths[i], b->root, &tmp, &n);
+}
+
+static void opDictGet(Bench *b) {
+    Node *n;
+    for (int i = 0; i < b->nkeys; i++) Node_DictGet(b->root, b->keys[i], &n);
+}
+
+static int countKey(Node *kv, void *ctx) {
+    (*(int *)ctx)++;
+    return 0;
+}
+
+static void opDictPrefix(Bench *b) {
+    int count = 0;
+    for (int i = 0; i < b->nkeys; i++)
+        Node_DictPrefixScan(b->root, b->keys[i], strlen(b->keys[i]), countKey, &count);
+}
+
+static sds readFile(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    sds buf = sdsempty();
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) buf = sdscatlen(buf, chunk, n);
+    fclose(f);
+    return buf;
+}
+
+static void benchFile(const char *path) {
+    const char *input = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    sds json = readFile(path);
+    if (!json) {
+        printf("# %s: can't read the file\n", input);
+        return;
+    }
+
+    Bench b = {.json = json, .len = sdslen(json), .io = {.buf = sdsempty()}};
+    b.jt = NewJSONType();
+    NodeArena *prev = Node_SetArena(b.jt->arena);
+    int rc = CreateNodeFromJSON(json, b.len, &b.jt->root, NULL);
+    Node_SetArena(prev);
+    if (JSONOBJECT_OK != rc) {
+        printf("# %s: not a valid JSON\n", input);
+        JSONTypeFree(b.jt);
+        sdsfree(b.io.buf);
+        sdsfree(json);
+        return;
+    }
+    b.root = b.jt->root;
+
+    measure("parse", input, opParse, &b, b.len);
+    measure("parse_parallel", input, opParseParallel, &b, b.len);
+    measure("serialize", input, opSerialize, &b, b.len);
+    measure("rdb_save", input, opRdbSave, &b, b.len);
+    measure("rdb_load", input, opRdbLoad, &b, b.len);
+    measure("rdb_save_v0", input, opRdbSaveV0, &b, b.len);
+    measure("rdb_load_v0", input, opRdbLoadV0, &b, b.len);
+
+    JSONTypeFree(b.jt);
+    sdsfree(b.io.buf);
+    sdsfree(json);
+}
+
+static void benchPaths(void) {
+    const char *json =
+        "{\"user\":{\"name\":\"x\",\"address\":{\"city\":\"y\",\"zip\":\"z\"},\"tags\":[1,2,3]},"
+        "\"orders\":[{\"id\":1,\"items\":[{\"sku\":\"a\",\"qty\":2}]}],\"stats\":{\"visits\":7}}";
+    const char *paths[] = {".",
+                           ".user.name",
+                           ".user.address.city",
+                           ".user.tags[2]",
+                           ".orders[0].items[0].sku",
+                           "['orders'][0]['items'][0][\"qty\"]"};
+    Bench b = {.pathstrs = paths, .npaths = sizeof(paths) / sizeof(char *)};
+    b.batch = b.npaths;
+
+    CreateNodeFromJSON(json, strlen(json), &b.root, NULL);
+    b.paths = calloc(b.npaths, sizeof(SearchPath));
+    for (int i = 0; i < b.npaths; i++) {
+        b.paths[i] = NewSearchPath(0);
+        ParseJSONPath(paths[i], strlen(paths[i]), &b.paths[i], NULL);
+    }
+
+    measure("path_parse", "6 paths", opPathParse, &b, 0);
+    measure("path_find", "6 paths", opPathFind, &b, 0);
+
+    for (int i = 0; i < b.npaths; i++) SearchPath_Free(&b.paths[i]);
+    free(b.paths);
+    Node_Free(b.root);
+}
+
+static void benchDicts(void) {
+    const int sizes[] = {4, 16, 64, 256, 4096};
+    char key[32], input[32];
+
+    for (int s = 0; s < sizeof(sizes) / sizeof(int); s++) {
+        Bench b = {.root = NewDictNode(sizes[s]), .nkeys = sizes[s], .batch = sizes[s]};
+        b.keys = calloc(b.nkeys, sizeof(char *));
+        for (int i = 0; i < b.nkeys; i++) {
+            snprintf(key, sizeof(key), "key%d", i);
+            Node_DictSet(b.root, key, NewIntNode(i));
+            b.keys[i] = strdup(key);
+        }
+
+        snprintf(input, sizeof(input), "%d keys", sizes[s]);
+        measure("dict_get", input, opDictGet, &b, 0);
+
+        for (int i = 0; i < b.nkeys; i++) free(b.keys[i]);
+        free(b.keys);
+        Node_Free(b.root);
+    }
+}
+
+/* Lists the keys of a prefix of a big dictionary with long shared prefixes, by tree and by scan */
+static void benchDictPrefix(void) {
+    const int size = 100000, nprefixes = 16;
+    char key[64];
+    Bench b = {.root = NewDictNode(size), .nkeys = nprefixes, .batch = nprefixes};
+
+    for (int i = 0; i < size; i++) {
+        snprintf(key, sizeof(key), "user:region%d:%d", i % 10, i);
+        Node_DictSet(b.root, key, NewIntNode(i));
+    }
+    b.keys = calloc(nprefixes, sizeof(char *));
+    for (int i = 0; i < nprefixes; i++) {
+        snprintf(key, sizeof(key), "user:region%d:%d", i % 10, 100 + i);
+        b.keys[i] = strdup(key);
+    }
+
+    uint32_t threshold = NodeDictTrieThreshold;
+    NodeDictTrieThreshold = 0;
+    measure("dict_prefix", "100000 keys, scan", opDictPrefix, &b, 0);
+    NodeDictTrieThreshold = 1;
+    measure("dict_prefix", "100000 keys, trie", opDictPrefix, &b, 0);
+    NodeDictTrieThreshold = threshold;
+
+    for (int i = 0; i < nprefixes; i++) free(b.keys[i]);
+    free(b.keys);
+    Node_Free(b.root);
+}
+
+int main(int argc, char *argv[]) {
+    int i = 1;
+
+    if (argc > 2 && !strcmp("-t", argv[1])) {
+        _mintime = atof(argv[2]);
+        i = 3;
+    }
+    mockModuleAPI();
+
+    printf("# benchmark\tinput\tops\tns/op\tMB/s\n");
+    for (; i < argc; i++) benchFile(argv[i]);
+    benchPaths();
+    benchDicts();
+    benchDictPrefix();
+    return 0;
+}
@@ -0,0 +1,214 @@
+# Compares JSON.SET and JSON.GET with the Lua scripts in benchmarks/lua and charts the results
+from __future__ import print_function
+import multiprocessing
+import subprocess
+import time
+import redis
+import sys
+import os
+import re
+import csv
+import math
+import argparse
+try:
+    from urlparse import urlparse
+except ImportError:
+    from urllib.parse import urlparse
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.join(HERE, '..')
+sys.path.insert(0, os.path.join(ROOT, 'util'))
+from disposableredis import DisposableRedis
+
+clock = getattr(time, 'perf_counter', time.time)
+
+# the documents in test/files, the path to a scalar in each as the Lua scripts' tokens, and a value
+# that's set there
+DOCUMENTS = [
+    ('pass-100.json', ['sclr'], '1'),
+    ('pass-jsonsl-1.json', [8, 'zero'], '1'),
+    ('pass-json-parser-0000.json', ['web-app', 'servlet', 0, 'servlet-name'], '"bar"'),
+    ('pass-jsonsl-yahoo2.json', ['ResultSet', 'totalResultsAvailable'], '1'),
+    ('pass-jsonsl-yelp.json', ['message', 'code'], '1'),
+]
+DOCUMENT_NAMES = [name for name, _, _ in DOCUMENTS]
+
+# the engines, ReJSON and the scripts of each storage format, and the operations of every document
+ENGINES = ['rejson', 'json', 'msgpack']
+OPERATIONS = ['set_root', 'get_root', 'set_path', 'get_path']
+
+PERCENTILES = [50, 90, 95, 99, 99.5, 100]
+FIELDS = ['engine', 'file', 'size', 'operation', 'concurrency', 'rate', 'avgLatency'] + \
+         ['{}%'.format(p) for p in PERCENTILES]
+
+def JSONPath(tokens):
+    """The ReJSON path of the Lua scripts' tokens, e.g. ["web-app"].servlet[0] """
+    path = ''
+    for t in tokens:
+        if isinstance(t, int):
+            path += '[{}]'.format(t)
+        elif re.match(r'^[A-Za-z_$][A-Za-z0-9_$]*$', t):
+            path += '.' + t
+        else:
+            path += '["{}"]'.format(t)
+    return path or '.'
+
+def Command(ctx, op):
+    """The command of an engine's operation on a worker's key"""
+    key, doc, tokens, value = ctx['key'], ctx['doc'], ctx['tokens'], ctx['value']
+    if ctx['engine'] == 'rejson':
+        path = JSONPath(tokens)
+        return {
+            'set_root': ('JSON.SET', key, '.', doc),
+            'get_root': ('JSON.GET', key, '.'),
+            'set_path': ('JSON.SET', key, path, value),
+            'get_path': ('JSON.GET', key, path),
+        }[op]
+    sha = ctx['scripts']['{}-{}.lua'.format(ctx['engine'], op.replace('_', '-'))]
+    args = {
+        'set_root': [doc],
+        'get_root': [],
+        'set_path': tokens + [value],
+        'get_path': tokens,
+    }[op]
+    return ('EVALSHA', sha, 1, key) + tuple(args)
+
+def runWorker(ctx):
+    """Runs an operation and returns its latencies in seconds and the elapsed time"""
+    ctx = dict(ctx, key='bench:{}:{}'.format(ctx['engine'], os.getpid()))
+    r = redis.StrictRedis(host=ctx['host'], port=ctx['port'])
+    r.delete(ctx['key'])
+    r.execute_command(*Command(ctx, 'set_root'))
+
+    cmd = Command(ctx, ctx['operation'])
+    latencies = []
+    for _ in range(ctx['count']):
+        s0 = clock()
+        r.execute_command(*cmd)
+        latencies.append(clock() - s0)
+
+    r.delete(ctx['key'])
+    return latencies, sum(latencies)
+
+def Percentile(latencies, p):
+    """The p-th percentile of sorted latencies, in milliseconds"""
+    if not latencies:
+        return 0
+    i = min(len(latencies) - 1, max(0, int(math.ceil(p / 100.0 * len(latencies))) - 1))
+    return round(latencies[i] * 1000, 4)
+
+def RunOperation(pool, ctx, workers):
+    results = pool.map(runWorker, (ctx, ) * workers)
+    latencies = sorted(l for res in results for l in res[0])
+    row = {
+        'engine': ctx['engine'],
+        'file': ctx['file'],
+        'size': len(ctx['doc']),
+        'operation': ctx['operation'],
+        'concurrency': workers,
+        'rate': round(sum(len(res[0]) / res[1] for res in results if res[1]), 2),
+        'avgLatency': round(1000.0 * sum(latencies) / len(latencies), 4) if latencies else 0,
+    }
+    for p in PERCENTILES:
+        row['{}%'.format(p)] = Percentile(latencies, p)
+    return row
+
+def LoadScripts(host, port):
+    """Loads the Lua scripts with load-scripts.sh, returns their SHA1 digests by their names"""
+    out = subprocess.check_output([os.path.join(HERE, 'lua', 'load-scripts.sh'), '-h', host,
+                                   '-p', str(port)])
+    scripts = {}
+    for line in out.decode().splitlines():
+        name, _, sha = line.partition(': ')
+        if name and sha:
+            scripts[name] = sha.strip()
+    return scripts
+
+def Run(args, host, port):
+    scripts = LoadScripts(host, port)
+    pool = multiprocessing.Pool(args.workers)
+    rows = []
+    for name, tokens, value in DOCUMENTS:
+        if name not in args.files:
+            continue
+        with open(os.path.join(ROOT, 'test', 'files', name)) as f:
+            doc = f.read().strip()
+        for engine in args.engines:
+            for op in OPERATIONS:
+                ctx = {
+                    'engine': engine,
+                    'operation': op,
+                    'file': name,
+                    'doc': doc,
+                    'tokens': tokens,
+                    'value': value,
+                    'scripts': scripts,
+                    'count': args.count // args.workers,
+                    'host': host,
+                    'port': port,
+                }
+                row = RunOperation(pool, ctx, args.workers)
+                rows.append(row)
+                print('{:<28} {:>7} {:<8} {:<9} {:>10.2f} op/s {:>8.4f} ms avg {:>8.4f} ms p99'
+                      .format(name, row['size'], engine, op, row['rate'], row['avgLatency'],
+                              row['99%']))
+                sys.stdout.flush()
+    pool.close()
+    return rows
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='ReJSON vs. Lua Benchmark',
+                                     formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument('-c', '--count', type=int, default=100000,
+                        help='number of operations of each run')
+    parser.add_argument('-w', '--workers', type=int, default=16, help='number of worker processes')
+    parser.add_argument('-u', '--uri', type=str,
+                        help='URI of a running server with the module, instead of a disposable one')
+    parser.add_argument('--redis-server', type=str, default='redis-server',
+                        help='path to the disposable server\'s executable')
+    parser.add_argument('--module', type=str, default=os.path.join(ROOT, 'lib', 'rejson.so'),
+                        help='path to the module that the disposable server loads')
+    parser.add_argument('-f', '--files', type=str, default=','.join(DOCUMENT_NAMES),
+                        help='comma separated documents to run on')
+    parser.add_argument('-e', '--engines', type=str, default=','.join(ENGINES),
+                        help='comma separated engines to run')
+    parser.add_argument('-o', '--output', type=str,
+                        default=os.path.join(HERE, 'graphs', 'compare.csv'),
+                        help='file to write the results to')
+    parser.add_argument('--charts', type=str, default=os.path.join(ROOT, 'docs', 'images'),
+                        help='directory to write the charts to, none to skip them')
+    args = parser.parse_args()
+
+    args.files = [name for name in args.files.split(',') if name]
+    for name in args.files:
+        if name not in DOCUMENT_NAMES:
+            parser.error('unknown document {}, expecting one of {}'.format(
+                name, ', '.join(DOCUMENT_NAMES)))
+    args.engines = [name for name in args.engines.split(',') if name]
+    for name in args.engines:
+        if name not in ENGINES:
+            parser.error('unknown engine {}, expecting one of {}'.format(name, ', '.join(ENGINES)))
+
+    print('Count: {}, Workers: {}'.format(args.count, args.workers))
+    print('Using hiredis: {}'.format(redis.utils.HIREDIS_AVAILABLE))
+    print()
+    sys.stdout.flush()
+
+    if args.uri:
+        uri = urlparse(args.uri)
+        rows = Run(args, uri.hostname, uri.port)
+    else:
+        server = DisposableRedis(path=args.redis_server, loadmodule=os.path.abspath(args.module))
+        with server:
+            rows = Run(args, 'localhost', server.port)
+
+    with open(args.output, 'w') as f:
+        w = csv.DictWriter(f, fieldnames=FIELDS, lineterminator='\n')
+        w.writeheader()
+        w.writerows(rows)
+
+    if args.charts != 'none':
+        sys.path.insert(0, os.path.join(HERE, 'graphs'))
+        import make
+        print()
+        make.MakeCharts(args.output, args.charts)
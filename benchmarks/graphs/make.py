@@ -1,53 +1,102 @@
 """
-Make charts from ReJSONBenchmark's output
-"""
-
-import matplotlib.pyplot as plt
-import numpy as np
+Make charts from the results of benchmarks/compare.py
 
-data = np.genfromtxt('benchmark.csv', delimiter=',', names=True, dtype=None)
+    python make.py [results.csv] [-o output directory]
 
-# Each JSON value has 4 operations: set root, get root, set path, get path
-NOP = 4
-
-# The number of JSON values
-N = int(len(data) / NOP)
+Writes the rate and average latency charts of every operation over the documents' sizes, and of
+every document, as the docs/images/bench_lua_*.png files that docs/performance.md shows.
+"""
+from __future__ import print_function
+import os
+import csv
+import argparse
+import matplotlib
+matplotlib.use('Agg')
+import matplotlib.pyplot as plt
 
-# The x locations
-ind = np.arange(N)
+HERE = os.path.dirname(os.path.abspath(__file__))
 
-# The bars' width
-width = (1 - .3) / NOP
+# the operations and engines in the order that they're charted, with their labels
+OPERATIONS = [('set_root', 'set root'), ('get_root', 'get root'), ('set_path', 'set path'),
+              ('get_path', 'get path')]
+ENGINES = [('rejson', 'ReJSON'), ('json', 'Lua cjson'), ('msgpack', 'Lua cmsgpack')]
+COLORS = ['r', 'g', 'b']
 
-colors = ['r','g','b','y']
+# the measures that are charted, with their labels and the suffixes of their charts' names
+MEASURES = [('rate', 'Rate (op/s)', ''), ('avgLatency', 'Average latency (msec)', '_l')]
 
-fig, ax = plt.subplots()
+def Load(filename):
+    """The rows of a results file, with their numbers parsed"""
+    with open(filename) as f:
+        rows = list(csv.DictReader(f))
+    for row in rows:
+        for name, val in row.items():
+            if name not in ('engine', 'file', 'operation'):
+                row[name] = float(val)
+    return rows
 
-# Iterate each operation
-for oidx in range(NOP):
-    d = data[oidx::NOP]
-    # ax1 = ax[oidx]
+def Name(filename):
+    """A chart's name for a document, e.g. pass_jsonsl_1 for pass-jsonsl-1.json"""
+    return os.path.splitext(filename)[0].replace('-', '_').replace('.', '_')
 
-    # plt.subplot(NOP,1,oidx+1)
+def Save(fig, outdir, name):
+    path = os.path.join(outdir, 'bench_lua_{}.png'.format(name))
+    fig.savefig(path, bbox_inches='tight')
+    plt.close(fig)
+    print(path)
 
-    # Plot the rate as bars
-    plt.bar(ind+oidx*width, d['rate'], width, align='center', color=colors[oidx])
+def ChartOperation(rows, outdir, op, label):
+    """An operation's measures on documents of growing sizes, a line for every engine"""
+    for measure, ylabel, suffix in MEASURES:
+        fig, ax = plt.subplots()
+        for (engine, name), color in zip(ENGINES, COLORS):
+            d = sorted((r['size'], r[measure]) for r in rows
+                       if r['engine'] == engine and r['operation'] == op)
+            if d:
+                ax.plot([s for s, _ in d], [m for _, m in d], 'o-', color=color, label=name)
+        ax.set_xscale('log')
+        ax.set_title('{} {}'.format(label, ylabel.split(' (')[0].lower()))
+        ax.set_xlabel('Document size (bytes)')
+        ax.set_ylabel(ylabel)
+        ax.grid(True)
+        ax.legend(loc='best')
+        Save(fig, outdir, op + suffix)
 
-    # Plot the latency as line
-    # tax = plt.twinx()
-    # tax.set_yscale('log')
-    # tax.plot(ind, d['avgLatency'], color='r')
+def ChartDocument(rows, outdir, filename):
+    """A document's measures of every operation, a bar for every engine"""
+    width = (1 - .3) / len(ENGINES)
+    for measure, ylabel, suffix in MEASURES:
+        fig, ax = plt.subplots()
+        for eidx, ((engine, name), color) in enumerate(zip(ENGINES, COLORS)):
+            vals = {r['operation']: r[measure] for r in rows
+                    if r['engine'] == engine and r['file'] == filename}
+            ax.bar([i + eidx * width for i in range(len(OPERATIONS))],
+                   [vals.get(op, 0) for op, _ in OPERATIONS], width, align='center', color=color,
+                   label=name)
+        ax.set_xticks([i + width for i in range(len(OPERATIONS))])
+        ax.set_xticklabels([label for _, label in OPERATIONS])
+        ax.set_title('{} {}'.format(filename, ylabel.split(' (')[0].lower()))
+        ax.set_ylabel(ylabel)
+        ax.grid(True, axis='y')
+        ax.legend(loc='best')
+        Save(fig, outdir, Name(filename) + suffix)
 
-    # plt.title('{} rate and average latency'.format(d['title'][0]))
-    # ax1.set_ylabel('Rate (op/s)', color='b')
-    # ax1.set_xlabel('Object size (bytes)')
-    # for t in ax1.get_yticklabels():
-    #     t.set_color('b')
-    # ax2.set_ylabel('Average latency (msec)', color='r')
-    # for t in ax2.get_yticklabels():
-    #     t.set_color('r')
-    # plt.xticks(ind, d['size']) 
+def MakeCharts(filename, outdir):
+    rows = Load(filename)
+    for op, label in OPERATIONS:
+        ChartOperation(rows, outdir, op, label)
+    files = sorted(set(r['file'] for r in rows), key=lambda f: min(r['size'] for r in rows
+                                                                   if r['file'] == f))
+    for f in files:
+        ChartDocument(rows, outdir, f)
 
-plt.grid(True)
-plt.xticks(ind + width, d['size'])
-plt.show()
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='ReJSON vs. Lua charts',
+                                     formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument('results', nargs='?', default=os.path.join(HERE, 'compare.csv'),
+                        help='results file of benchmarks/compare.py')
+    parser.add_argument('-o', '--output', type=str,
+                        default=os.path.join(HERE, '..', '..', 'docs', 'images'),
+                        help='directory to write the charts to')
+    args = parser.parse_args()
+    MakeCharts(args.results, args.output)
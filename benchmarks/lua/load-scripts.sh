@@ -1,6 +1,8 @@
 #!/bin/bash
+# Loads the scripts and prints their SHA1 digests, any arguments are passed to redis-cli
 
+cd "$(dirname "$0")"
 for i in `ls *.lua`; do 
     echo -n "$i: "; 
-    redis-cli SCRIPT LOAD "`cat $i`"; 
+    redis-cli "$@" SCRIPT LOAD "`cat $i`"; 
 done
@@ -0,0 +1,286 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include "array_index.h"
+
+/* The smallest number of slots of an index */
+#define ARRAY_INDEX_MIN_CAP 16
+
+/* The positions + 1 of the first and last items with a value, 0 for empty slots */
+typedef struct {
+    uint32_t head;
+    uint32_t tail;
+} ArrayIndexSlot;
+
+/**
+* An array's index, a hash table of its distinct values with linear probing that's kept at most
+* half full. The items with the same value are chained in the order of their positions, so finding
+* the first one and counting them doesn't depend on how many other values the array has.
+*/
+typedef struct _ArrayIndex {
+    const Node *arr;
+    ArrayIndexSlot *slots;
+    uint32_t cap;      // a power of 2, or 0 until the index is built
+    uint32_t nvalues;  // the number of distinct values
+    uint32_t *chain;   // the position + 1 of the next item with the same value, 0 for the last
+    uint32_t chaincap;
+    uint32_t len;      // the number of indexed items, i.e. the first ones of the array
+    int stale;         // set when the index must be built again
+    struct _ArrayIndex *next;
+} ArrayIndex;
+
+/* The indexes by their arrays, a chained hash table */
+static struct {
+    ArrayIndex **buckets;
+    uint32_t cap;    // a power of 2, or 0 before the first index
+    uint32_t count;  // the number of indexes
+} _indexes = {0};
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint32_t __aix_mix(uint64_t v) {
+    v ^= v >> 33;
+    v *= 0xff51afd7ed558ccdULL;
+    v ^= v >> 33;
+    return (uint32_t)v;
+}
+
+/* Returns the place of an array's index in its bucket. Must be called locked. */
+static ArrayIndex **__aix_find(const Node *arr) {
+    if (!_indexes.cap) return NULL;
+    ArrayIndex **p = &_indexes.buckets[__aix_mix((uintptr_t)arr) & (_indexes.cap - 1)];
+    while (*p && (*p)->arr != arr) p = &(*p)->next;
+    return p;
+}
+
+/* The index of an array, which is only ever changed by the thread that owns the array */
+static ArrayIndex *__aix_get(const Node *arr) {
+    pthread_mutex_lock(&_lock);
+    ArrayIndex **p = __aix_find(arr);
+    ArrayIndex *ix = p ? *p : NULL;
+    pthread_mutex_unlock(&_lock);
+    return ix;
+}
+
+void ArrayIndex_Create(const Node *arr) {
+    pthread_mutex_lock(&_lock);
+    ArrayIndex **p = __aix_find(arr);
+    if (p && *p) {
+        pthread_mutex_unlock(&_lock);
+        return;
+    }
+
+    // the table grows to have as many buckets as indexes
+    if (_indexes.count >= _indexes.cap) {
+        uint32_t cap = _indexes.cap ? _indexes.cap * 2 : 64;
+        ArrayIndex **buckets = calloc(cap, sizeof(ArrayIndex *));
+        for (uint32_t i = 0; i < _indexes.cap; i++) {
+            ArrayIndex *ix = _indexes.buckets[i];
+            while (ix) {
+                ArrayIndex *next = ix->next;
+                uint32_t b = __aix_mix((uintptr_t)ix->arr) & (cap - 1);
+                ix->next = buckets[b];
+                buckets[b] = ix;
+                ix = next;
+            }
+        }
+        free(_indexes.buckets);
+        _indexes.buckets = buckets;
+        _indexes.cap = cap;
+        p = __aix_find(arr);
+    }
+
+    ArrayIndex *ix = calloc(1, sizeof(ArrayIndex));
+    ix->arr = arr;
+    ix->stale = 1;
+    *p = ix;
+    _indexes.count++;
+    pthread_mutex_unlock(&_lock);
+}
+
+void ArrayIndex_Drop(const Node *arr) {
+    pthread_mutex_lock(&_lock);
+    ArrayIndex **p = __aix_find(arr);
+    ArrayIndex *ix = p ? *p : NULL;
+    if (ix) {
+        *p = ix->next;
+        _indexes.count--;
+    }
+    pthread_mutex_unlock(&_lock);
+    if (ix) {
+        free(ix->slots);
+        free(ix->chain);
+        free(ix);
+    }
+}
+
+/* The hash of a scalar, numbers that are equal have the same hash whatever their sign */
+static uint32_t __aix_hash(const Node *n) {
+    uint64_t v;
+    char *tmp;
+
+    if (!n) return 0x9e3779b9;
+    switch (n->type) {
+        case N_STRING: {
+            uint32_t h = Intern_HashString(Node_StringData(n, &tmp), n->value.strval.len);
+            free(tmp);
+            return h;
+        }
+        case N_INTEGER:
+            v = (uint64_t)n->value.intval;
+            break;
+        case N_NUMBER: {
+            double d = Node_Number(n);
+            if (d == 0) d = 0;  // -0.0 hashes as 0.0, as they are equal
+            memcpy(&v, &d, sizeof(v));
+            break;
+        }
+        case N_BOOLEAN:
+            v = n->value.boolval ? 0x7f4a7c15 : 0x6a09e667;
+            break;
+        default:
+            v = 0;
+            break;
+    }
+    return __aix_mix(v);
+}
+
+/* Checks whether an item equals the scalar n, like Node_ArrayIndex does */
+static int __aix_eq(const Node *e, const Node *n) {
+    char *ta, *tb;
+
+    if (!n || !e) return !n && !e;
+    if (e->type != n->type) return 0;
+    switch (n->type) {
+        case N_STRING: {
+            if (e->value.strval.len != n->value.strval.len) return 0;
+            int eq = !memcmp(Node_StringData(e, &ta), Node_StringData(n, &tb), n->value.strval.len);
+            free(ta);
+            free(tb);
+            return eq;
+        }
+        case N_NUMBER:
+            return Node_Number(e) == Node_Number(n);
+        case N_INTEGER:
+            return e->value.intval == n->value.intval;
+        case N_BOOLEAN:
+            return e->value.boolval == n->value.boolval;
+        default:
+            return 0;
+    }
+}
+
+/* Packed items are viewed without unpacking the array */
+static inline Node *__aix_item(const Node *arr, uint32_t i, Node *tmp) {
+    Node *e;
+    Node_ArrayItemView((Node *)arr, i, tmp, &e);
+    return e;
+}
+
+/* Returns the slot of the value n, or the empty slot where it belongs */
+static uint32_t __aix_slot(const ArrayIndex *ix, const Node *n, uint32_t hash) {
+    Node tmp;
+    uint32_t mask = ix->cap - 1, s = hash & mask;
+    while (ix->slots[s].head && !__aix_eq(__aix_item(ix->arr, ix->slots[s].head - 1, &tmp), n))
+        s = (s + 1) & mask;
+    return s;
+}
+
+static void __aix_insert(ArrayIndex *ix, uint32_t pos) {
+    Node tmp, *n = __aix_item(ix->arr, pos, &tmp);
+    ArrayIndexSlot *slot = &ix->slots[__aix_slot(ix, n, __aix_hash(n))];
+
+    ix->chain[pos] = 0;
+    if (slot->head) {
+        ix->chain[slot->tail - 1] = pos + 1;
+    } else {
+        slot->head = pos + 1;
+        ix->nvalues++;
+    }
+    slot->tail = pos + 1;
+}
+
+/* Indexes the array's items from scratch, in a table that fits them */
+static void __aix_build(ArrayIndex *ix) {
+    uint32_t len = ix->arr->value.arrval.len;
+    uint32_t cap = ARRAY_INDEX_MIN_CAP;
+    while (cap < 2 * len) cap *= 2;
+
+    if (cap != ix->cap) {
+        free(ix->slots);
+        ix->slots = malloc(cap * sizeof(ArrayIndexSlot));
+        ix->cap = cap;
+    }
+    if (len > ix->chaincap || len < ix->chaincap / 4) {
+        ix->chaincap = MAX(len, ARRAY_INDEX_MIN_CAP);
+        ix->chain = realloc(ix->chain, ix->chaincap * sizeof(uint32_t));
+    }
+    memset(ix->slots, 0, cap * sizeof(ArrayIndexSlot));
+    ix->nvalues = 0;
+    for (uint32_t i = 0; i < len; i++) __aix_insert(ix, i);
+    ix->len = len;
+    ix->stale = 0;
+}
+
+void ArrayIndex_Appended(const Node *arr) {
+    ArrayIndex *ix = __aix_get(arr);
+    if (!ix || ix->stale) return;
+
+    uint32_t len = arr->value.arrval.len;
+    if (len > ix->chaincap) {
+        ix->chaincap = MAX(len, ix->chaincap * 2);
+        ix->chain = realloc(ix->chain, ix->chaincap * sizeof(uint32_t));
+    }
+    for (uint32_t i = ix->len; i < len; i++) {
+        // the table grows with the distinct values
+        if (2 * (ix->nvalues + 1) > ix->cap) {
+            __aix_build(ix);
+            return;
+        }
+        __aix_insert(ix, i);
+    }
+    ix->len = len;
+}
+
+void ArrayIndex_Invalidate(const Node *arr) {
+    ArrayIndex *ix = __aix_get(arr);
+    if (ix) ix->stale = 1;
+}
+
+int ArrayIndex_Search(const Node *arr, const Node *n, int start, int stop, int count) {
+    ArrayIndex *ix = __aix_get(arr);
+    if (!ix) return count ? 0 : -1;
+    if (ix->stale) __aix_build(ix);
+
+    // the items with the value are chained in the order of their positions
+    uint32_t pos = ix->slots[__aix_slot(ix, n, __aix_hash(n))].head;
+    int found = 0;
+    for (; pos && (int)pos <= start; pos = ix->chain[pos - 1]) {}
+    for (; pos && (int)pos <= stop; pos = ix->chain[pos - 1]) {
+        if (!count) return (int)pos - 1;
+        found++;
+    }
+    return count ? found : -1;
+}
+
+size_t ArrayIndex_Size(const Node *arr) {
+    ArrayIndex *ix = __aix_get(arr);
+    return ix ? sizeof(ArrayIndex) + ix->cap * sizeof(ArrayIndexSlot) +
+                    ix->chaincap * sizeof(uint32_t)
+              : 0;
+}
@@ -0,0 +1,56 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ARRAY_INDEX_H__
+#define __ARRAY_INDEX_H__
+
+#include "object.h"
+
+/**
+* Hash indexes of the items of arrays, for the membership queries of big arrays that are used as
+* sets (see Node_ArraySetIndexed). An array's index is an open-addressing table of its distinct
+* values, each with the chain of the positions of its items. It's kept apart from the array in a
+* process-wide table of the indexes by their arrays, so that arrays stay the same size.
+* Appended items are added to the index, and any other change of the items makes it stale: it is
+* built again by the next search. These are the object functions' business, the indexes are only
+* used through the flagged arrays (see NODE_F_ARRAY_INDEXED). All functions are thread safe as far
+* as the table of indexes is concerned, so indexed arrays can be freed on any thread.
+*/
+
+/** Adds an empty, stale index for an array, if it doesn't have one */
+void ArrayIndex_Create(const Node *arr);
+
+/** Frees the index of an array, if it has one */
+void ArrayIndex_Drop(const Node *arr);
+
+/** Adds the items that were appended to an array to its index, unless it's stale */
+void ArrayIndex_Appended(const Node *arr);
+
+/** Makes the index of an array stale, after its items were changed other than by appending */
+void ArrayIndex_Invalidate(const Node *arr);
+
+/**
+* Searches the indexed array for the scalar n between the start and stop indices, which are already
+* in the array's range, building the index if it's stale. Returns the position of the first item
+* that equals n or -1 if none does, or with count set the number of the items that equal n.
+*/
+int ArrayIndex_Search(const Node *arr, const Node *n, int start, int stop, int count);
+
+/** The size in bytes of an array's index, or 0 if it has none */
+size_t ArrayIndex_Size(const Node *arr);
+
+#endif
@@ -0,0 +1,161 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "compress.h"
+
+#define _HASH_BITS 13
+#define _MAX_LITERAL 32
+#define _MAX_REF (7 + 255 + 2)
+
+static char _dict[COMPRESS_WINDOW];
+static size_t _dictlen = 0;
+
+void Compress_SetDictionary(const char *dict, size_t len) {
+    if (len > COMPRESS_WINDOW) {
+        dict += len - COMPRESS_WINDOW;
+        len = COMPRESS_WINDOW;
+    }
+    if (len) memcpy(_dict, dict, len);
+    _dictlen = len;
+}
+
+size_t Compress_DictionarySize(void) { return _dictlen; }
+
+static inline uint32_t __hash(const unsigned char *p) {
+    uint32_t v = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+    return (v * 2654435761u) >> (32 - _HASH_BITS);
+}
+
+/**
+* Compresses the base[start, end) part of a buffer, referencing the bytes before start too. The
+* table holds the positions of the last occurrences of each hash, plus 1.
+*/
+static size_t __compress(const unsigned char *base, size_t start, size_t end, uint32_t *table,
+                         unsigned char *out, size_t cap) {
+    // the control byte of the current literal run is reserved before its bytes, and it's taken
+    // back if the run ends up empty; the first one is at 0
+    size_t ip = start, op = 1, lit = 0;
+
+    while (ip + 2 < end) {
+        uint32_t h = __hash(base + ip);
+        size_t ref = table[h];
+        table[h] = ip + 1;
+        size_t off = ip - ref;  // the distance to the match, minus 1
+        if (!ref || off >= COMPRESS_WINDOW || memcmp(base + ref - 1, base + ip, 3)) {
+            if (op >= cap) return 0;
+            out[op++] = base[ip++];
+            if (++lit == _MAX_LITERAL) {
+                out[op - lit - 1] = lit - 1;
+                lit = 0;
+                op++;
+            }
+            continue;
+        }
+
+        size_t len = 3, max = end - ip < _MAX_REF ? end - ip : _MAX_REF;
+        while (len < max && base[ref - 1 + len] == base[ip + len]) len++;
+
+        // end the current literal run, or take back its control byte when it is empty
+        if (lit) {
+            out[op - lit - 1] = lit - 1;
+            lit = 0;
+        } else {
+            op--;
+        }
+        if (op + 3 > cap) return 0;
+        size_t l = len - 2;
+        if (l < 7) {
+            out[op++] = (l << 5) | (off >> 8);
+        } else {
+            out[op++] = (7 << 5) | (off >> 8);
+            out[op++] = l - 7;
+        }
+        out[op++] = off & 0xff;
+        op++;  // the next literal run's control byte
+
+        // the positions inside the match are hashed too, for the matches that follow
+        for (size_t i = ip + 1; i < ip + len && i + 2 < end; i++) table[__hash(base + i)] = i + 1;
+        ip += len;
+    }
+    for (; ip < end; ip++) {
+        if (op >= cap) return 0;
+        out[op++] = base[ip];
+        if (++lit == _MAX_LITERAL) {
+            out[op - lit - 1] = lit - 1;
+            lit = 0;
+            op++;
+        }
+    }
+    if (lit) {
+        out[op - lit - 1] = lit - 1;
+    } else {
+        op--;  // the control byte of an empty run
+    }
+    return op;
+}
+
+size_t Compress(const char *in, size_t len, char *out, size_t cap) {
+    uint32_t *table = calloc(1 << _HASH_BITS, sizeof(uint32_t));
+    size_t ret;
+
+    if (!_dictlen) {
+        ret = __compress((const unsigned char *)in, 0, len, table, (unsigned char *)out, cap);
+    } else {
+        // the dictionary is laid out before the input, and its positions are hashed upfront
+        unsigned char *base = malloc(_dictlen + len);
+        memcpy(base, _dict, _dictlen);
+        memcpy(base + _dictlen, in, len);
+        for (size_t i = 0; i + 2 < _dictlen; i++) table[__hash(base + i)] = i + 1;
+        ret = __compress(base, _dictlen, _dictlen + len, table, (unsigned char *)out, cap);
+        free(base);
+    }
+    free(table);
+    return ret;
+}
+
+int Decompress(const char *in, size_t inlen, char *out, size_t len) {
+    const unsigned char *ip = (const unsigned char *)in, *end = ip + inlen;
+    size_t op = 0;
+
+    while (ip < end) {
+        unsigned c = *ip++;
+        if (c < _MAX_LITERAL) {
+            size_t n = c + 1;
+            if ((size_t)(end - ip) < n || len - op < n) return 0;
+            memcpy(out + op, ip, n);
+            ip += n;
+            op += n;
+            continue;
+        }
+
+        size_t n = c >> 5;
+        if (7 == n) {
+            if (ip == end) return 0;
+            n += *ip++;
+        }
+        n += 2;
+        if (ip == end) return 0;
+        size_t off = ((size_t)(c & 0x1f) << 8 | *ip++) + 1;
+        if (off > op + _dictlen || len - op < n) return 0;
+        // byte by byte, since a reference may overlap the bytes it produces
+        for (size_t i = 0; i < n; i++, op++) {
+            out[op] = off > op ? _dict[_dictlen - (off - op)] : out[op - off];
+        }
+    }
+    return op == len;
+}
@@ -0,0 +1,66 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef REDIS_MODULE_TARGET
+#include <alloc.h>
+#endif
+
+/**
+* A small LZ77 compressor in the spirit of LZF, for the values that are kept compressed in memory.
+* It trades ratio for speed: input is split into literal runs and back references to the 8KB window
+* that precedes them, which are found with a hash of the next 3 bytes.
+*
+* The compressed stream is a sequence of control bytes:
+*   000LLLLL                     a run of L+1 literal bytes that follow
+*   LLLOOOOO OOOOOOOO            a reference to L+2 bytes starting O+1 bytes back, L < 7
+*   111OOOOO LLLLLLLL OOOOOOOO   a reference to L+9 bytes starting O+1 bytes back
+*
+* A dictionary, e.g. a sample of typical values, primes the window: references may reach back into
+* it as if it preceded the input, which helps with values that are too short to repeat themselves.
+* Data is decompressed with the same dictionary it was compressed with.
+*/
+
+/* The size of the window, and so the most of a dictionary that's used */
+#define COMPRESS_WINDOW (1 << 13)
+
+/**
+* Sets the process-wide dictionary to the last COMPRESS_WINDOW bytes of dict, or unsets it with a
+* len of 0. It must be set before any data is compressed, and not change while compressed data
+* exists.
+*/
+void Compress_SetDictionary(const char *dict, size_t len);
+
+/** The size of the dictionary that's set */
+size_t Compress_DictionarySize(void);
+
+/**
+* Compresses len bytes into out, which has room for cap bytes. Returns the compressed size, or 0 if
+* it doesn't fit, so passing a cap under len only compresses data that shrinks.
+*/
+size_t Compress(const char *in, size_t len, char *out, size_t cap);
+
+/* Decompresses a stream into exactly len bytes. Returns 1 on success and 0 for a corrupt stream */
+int Decompress(const char *in, size_t inlen, char *out, size_t len);
+
+#endif
@@ -0,0 +1,279 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include "dict_trie.h"
+
+/* The smallest number of nodes of a tree */
+#define DICT_TRIE_MIN_CAP 64
+
+/**
+* A node of a tree. Its label is the part of a key that follows its parent's, and its children are
+* chained in the order of their labels' first bytes, which no two siblings share. Nodes are
+* referenced by their positions, the root is the first one and has an empty label.
+*/
+typedef struct {
+    const char *label;  // points into one of the keys that go through the node
+    uint32_t len;
+    uint32_t pos;    // the position + 1 of the entry whose key ends at the node, 0 for none
+    uint32_t child;  // the first child, 0 for none
+    uint32_t next;   // the next sibling, 0 for none
+} DictTrieNode;
+
+typedef struct _DictTrie {
+    const Node *obj;
+    DictTrieNode *nodes;
+    uint32_t nnodes;
+    uint32_t cap;
+    uint32_t len;  // the number of keys in the tree, i.e. of the first entries of the dictionary
+    int stale;     // set when the tree must be built again
+    struct _DictTrie *next;
+} DictTrie;
+
+/* The trees by their dictionaries, a chained hash table */
+static struct {
+    DictTrie **buckets;
+    uint32_t cap;    // a power of 2, or 0 before the first tree
+    uint32_t count;  // the number of trees
+} _tries = {0};
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint32_t __trie_mix(uint64_t v) {
+    v ^= v >> 33;
+    v *= 0xff51afd7ed558ccdULL;
+    v ^= v >> 33;
+    return (uint32_t)v;
+}
+
+/* Returns the place of a dictionary's tree in its bucket. Must be called locked. */
+static DictTrie **__trie_find(const Node *obj) {
+    if (!_tries.cap) return NULL;
+    DictTrie **p = &_tries.buckets[__trie_mix((uintptr_t)obj) & (_tries.cap - 1)];
+    while (*p && (*p)->obj != obj) p = &(*p)->next;
+    return p;
+}
+
+/* The tree of a dictionary, which is only ever changed by the thread that owns the dictionary */
+static DictTrie *__trie_get(const Node *obj) {
+    pthread_mutex_lock(&_lock);
+    DictTrie **p = __trie_find(obj);
+    DictTrie *t = p ? *p : NULL;
+    pthread_mutex_unlock(&_lock);
+    return t;
+}
+
+void DictTrie_Create(const Node *obj) {
+    pthread_mutex_lock(&_lock);
+    DictTrie **p = __trie_find(obj);
+    if (p && *p) {
+        pthread_mutex_unlock(&_lock);
+        return;
+    }
+
+    // the table grows to have as many buckets as trees
+    if (_tries.count >= _tries.cap) {
+        uint32_t cap = _tries.cap ? _tries.cap * 2 : 64;
+        DictTrie **buckets = calloc(cap, sizeof(DictTrie *));
+        for (uint32_t i = 0; i < _tries.cap; i++) {
+            DictTrie *t = _tries.buckets[i];
+            while (t) {
+                DictTrie *next = t->next;
+                uint32_t b = __trie_mix((uintptr_t)t->obj) & (cap - 1);
+                t->next = buckets[b];
+                buckets[b] = t;
+                t = next;
+            }
+        }
+        free(_tries.buckets);
+        _tries.buckets = buckets;
+        _tries.cap = cap;
+        p = __trie_find(obj);
+    }
+
+    DictTrie *t = calloc(1, sizeof(DictTrie));
+    t->obj = obj;
+    t->stale = 1;
+    *p = t;
+    _tries.count++;
+    pthread_mutex_unlock(&_lock);
+}
+
+void DictTrie_Drop(const Node *obj) {
+    pthread_mutex_lock(&_lock);
+    DictTrie **p = __trie_find(obj);
+    DictTrie *t = p ? *p : NULL;
+    if (t) {
+        *p = t->next;
+        _tries.count--;
+    }
+    pthread_mutex_unlock(&_lock);
+    if (t) {
+        free(t->nodes);
+        free(t);
+    }
+}
+
+static inline const char *__trie_key(const DictTrie *t, uint32_t pos) {
+    return t->obj->value.dictval.entries[pos]->value.kvval.key;
+}
+
+static uint32_t __trie_newnode(DictTrie *t, const char *label, uint32_t len, uint32_t pos) {
+    if (t->nnodes == t->cap) {
+        t->cap = t->cap ? t->cap * 2 : DICT_TRIE_MIN_CAP;
+        t->nodes = realloc(t->nodes, t->cap * sizeof(DictTrieNode));
+    }
+    t->nodes[t->nnodes] = (DictTrieNode){label, len, pos, 0, 0};
+    return t->nnodes++;
+}
+
+/* Finds the child of node n whose label starts with c, or sets prev to the sibling it would follow */
+static uint32_t __trie_child(const DictTrie *t, uint32_t n, unsigned char c, uint32_t *prev) {
+    uint32_t ch = t->nodes[n].child;
+    *prev = 0;
+    while (ch && (unsigned char)t->nodes[ch].label[0] < c) {
+        *prev = ch;
+        ch = t->nodes[ch].next;
+    }
+    return ch && (unsigned char)t->nodes[ch].label[0] == c ? ch : 0;
+}
+
+static inline uint32_t __trie_common(const char *a, const char *b, uint32_t len) {
+    uint32_t i = 0;
+    while (i < len && a[i] == b[i]) i++;
+    return i;
+}
+
+/* Adds the key of the entry at position pos */
+static void __trie_insert(DictTrie *t, uint32_t pos) {
+    const char *key = __trie_key(t, pos);
+    uint32_t len = strlen(key), n = 0;
+
+    while (len) {
+        uint32_t prev;
+        uint32_t ch = __trie_child(t, n, key[0], &prev);
+        if (!ch) {
+            // a new leaf, in its place among its siblings
+            uint32_t leaf = __trie_newnode(t, key, len, pos + 1);
+            if (prev) {
+                t->nodes[leaf].next = t->nodes[prev].next;
+                t->nodes[prev].next = leaf;
+            } else {
+                t->nodes[leaf].next = t->nodes[n].child;
+                t->nodes[n].child = leaf;
+            }
+            return;
+        }
+
+        uint32_t common = __trie_common(t->nodes[ch].label, key, MIN(t->nodes[ch].len, len));
+        if (common < t->nodes[ch].len) {
+            // the child is split where the key leaves its label, the split off part keeps its
+            // entry and children
+            DictTrieNode *c = &t->nodes[ch];
+            uint32_t rest = __trie_newnode(t, c->label + common, c->len - common, c->pos);
+            c = &t->nodes[ch];
+            t->nodes[rest].child = c->child;
+            c->len = common;
+            c->pos = 0;
+            c->child = rest;
+        }
+        n = ch;
+        key += common;
+        len -= common;
+    }
+    t->nodes[n].pos = pos + 1;
+}
+
+/* Builds the tree from scratch, from the dictionary's keys */
+static void __trie_build(DictTrie *t) {
+    uint32_t len = t->obj->value.dictval.len;
+
+    // a tree has at most a node per key and a node per split, which is at least one more key
+    if (t->cap < 2 * len || t->cap > 8 * MAX(len, DICT_TRIE_MIN_CAP)) {
+        t->cap = MAX(2 * len, DICT_TRIE_MIN_CAP);
+        t->nodes = realloc(t->nodes, t->cap * sizeof(DictTrieNode));
+    }
+    t->nnodes = 0;
+    __trie_newnode(t, "", 0, 0);
+    for (uint32_t i = 0; i < len; i++) __trie_insert(t, i);
+    t->len = len;
+    t->stale = 0;
+}
+
+void DictTrie_Added(const Node *obj) {
+    DictTrie *t = __trie_get(obj);
+    if (!t || t->stale) return;
+
+    uint32_t len = obj->value.dictval.len;
+    for (uint32_t i = t->len; i < len; i++) __trie_insert(t, i);
+    t->len = len;
+}
+
+void DictTrie_Invalidate(const Node *obj) {
+    DictTrie *t = __trie_get(obj);
+    if (t) t->stale = 1;
+}
+
+uint32_t DictTrie_Scan(const Node *obj, const char *prefix, uint32_t len, NodeDictKeyVisitor f,
+                       void *ctx) {
+    DictTrie *t = __trie_get(obj);
+    if (!t) return 0;
+    if (t->stale) __trie_build(t);
+
+    // the prefix leads to the node whose keys all start with it
+    uint32_t n = 0;
+    while (len) {
+        uint32_t prev;
+        uint32_t ch = __trie_child(t, n, prefix[0], &prev);
+        if (!ch) return 0;
+        uint32_t common = MIN(t->nodes[ch].len, len);
+        if (__trie_common(t->nodes[ch].label, prefix, common) < common) return 0;
+        n = ch;
+        prefix += common;
+        len -= common;
+    }
+
+    // visits the subtree depth first, a node's key comes before its children's longer ones
+    uint32_t count = 0, depth = 0, capstack = 32;
+    uint32_t *stack = malloc(capstack * sizeof(uint32_t));
+    int stop = 0;
+    if (t->nodes[n].pos) {
+        count++;
+        stop = f(obj->value.dictval.entries[t->nodes[n].pos - 1], ctx);
+    }
+    if (t->nodes[n].child) stack[depth++] = t->nodes[n].child;
+    while (depth && !stop) {
+        const DictTrieNode *c = &t->nodes[stack[--depth]];
+        if (depth + 2 > capstack) {
+            capstack *= 2;
+            stack = realloc(stack, capstack * sizeof(uint32_t));
+        }
+        if (c->next) stack[depth++] = c->next;
+        if (c->child) stack[depth++] = c->child;
+        if (c->pos) {
+            count++;
+            stop = f(obj->value.dictval.entries[c->pos - 1], ctx);
+        }
+    }
+    free(stack);
+    return count;
+}
+
+size_t DictTrie_Size(const Node *obj) {
+    DictTrie *t = __trie_get(obj);
+    return t ? sizeof(DictTrie) + t->cap * sizeof(DictTrieNode) : 0;
+}
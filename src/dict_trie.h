@@ -0,0 +1,57 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __DICT_TRIE_H__
+#define __DICT_TRIE_H__
+
+#include "object.h"
+
+/**
+* Radix trees of the keys of big dictionaries, for visiting their keys by prefix in key order (see
+* Node_DictPrefixScan). A tree's nodes are labeled with the parts of the keys that they don't share
+* with their siblings, and the labels point into the dictionary's interned keys, so the tree stores
+* no key bytes of its own and a key's shared prefix is only walked once. Looking a key or a prefix
+* up costs its length, whatever the number of keys.
+* Like array indexes (see array_index.h), the trees are kept apart from their dictionaries in a
+* process-wide table. Keys that are added to a dictionary are added to its tree, and deleting one
+* makes the tree stale, as its labels may point into the key: it's built again by the next scan.
+*/
+
+/** Adds an empty, stale tree for a dictionary, if it doesn't have one */
+void DictTrie_Create(const Node *obj);
+
+/** Frees the tree of a dictionary, if it has one */
+void DictTrie_Drop(const Node *obj);
+
+/** Adds the keys that were added to a dictionary to its tree, unless it's stale */
+void DictTrie_Added(const Node *obj);
+
+/** Makes the tree of a dictionary stale, after its keys were deleted or moved */
+void DictTrie_Invalidate(const Node *obj);
+
+/**
+* Calls f with the keyvals of the dictionary whose keys start with the len bytes of prefix, in the
+* bytewise order of their keys, building the tree if it's stale. The scan stops when f returns
+* non-zero. Returns the number of keyvals that f was called with.
+*/
+uint32_t DictTrie_Scan(const Node *obj, const char *prefix, uint32_t len, NodeDictKeyVisitor f,
+                       void *ctx);
+
+/** The size in bytes of a dictionary's tree, or 0 if it has none */
+size_t DictTrie_Size(const Node *obj);
+
+#endif
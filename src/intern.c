@@ -0,0 +1,181 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include "intern.h"
+
+/* The header that precedes every interned string */
+typedef struct {
+    uint32_t refcnt;
+    uint32_t hash;
+    uint32_t len;
+    char data[];
+} InternString;
+
+#define __intern_header(s) ((InternString *)((s) - offsetof(InternString, data)))
+
+/* The table is an open-addressing hash table with linear probing, that's kept at most half full */
+static struct {
+    InternString **slots;
+    uint32_t cap;    // a power of 2, or 0 before the first string is interned
+    uint32_t count;  // the number of interned strings
+    size_t memory;   // the memory of the interned strings
+} _table = {0};
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Returns the slot of the string, or the empty slot where it belongs. Must be called locked. */
+static uint32_t __intern_slot(const char *s, uint32_t len, uint32_t hash) {
+    uint32_t mask = _table.cap - 1;
+    uint32_t i = hash & mask;
+    InternString *is;
+    while ((is = _table.slots[i])) {
+        if (is->hash == hash && is->len == len && !memcmp(is->data, s, len)) break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/* Doubles the capacity of the table. Must be called locked. */
+static void __intern_grow(void) {
+    InternString **old = _table.slots;
+    uint32_t oldcap = _table.cap;
+
+    _table.cap = oldcap ? oldcap * 2 : 1024;
+    _table.slots = calloc(_table.cap, sizeof(InternString *));
+    for (uint32_t i = 0; i < oldcap; i++) {
+        if (!old[i]) continue;
+        uint32_t j = old[i]->hash & (_table.cap - 1);
+        while (_table.slots[j]) j = (j + 1) & (_table.cap - 1);
+        _table.slots[j] = old[i];
+    }
+    free(old);
+}
+
+/* Removes the slot's string from the table with backward shifting. Must be called locked. */
+static void __intern_remove(uint32_t s) {
+    uint32_t mask = _table.cap - 1;
+    uint32_t j = s;
+
+    _table.memory -= sizeof(InternString) + _table.slots[s]->len + 1;
+    _table.count--;
+    free(_table.slots[s]);
+    _table.slots[s] = NULL;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!_table.slots[j]) return;
+        uint32_t k = _table.slots[j]->hash & mask;  // the string's home slot
+        // move the string to the hole unless its home lies cyclically in (s, j]
+        if ((s <= j) ? (s < k && k <= j) : (s < k || k <= j)) continue;
+        _table.slots[s] = _table.slots[j];
+        _table.slots[j] = NULL;
+        s = j;
+    }
+}
+
+/* Drops a reference to the string. Must be called locked. */
+static void __intern_release(const char *s) {
+    InternString *is = __intern_header(s);
+    if (--is->refcnt) return;
+    __intern_remove(__intern_slot(is->data, is->len, is->hash));
+}
+
+const char *Intern_Acquire(const char *s, uint32_t len) {
+    uint32_t hash = Intern_HashString(s, len);
+
+    pthread_mutex_lock(&_lock);
+    if ((_table.count + 1) * 2 > _table.cap) __intern_grow();
+    uint32_t i = __intern_slot(s, len, hash);
+    InternString *is = _table.slots[i];
+    if (!is) {
+        is = malloc(sizeof(InternString) + len + 1);
+        is->refcnt = 0;
+        is->hash = hash;
+        is->len = len;
+        memcpy(is->data, s, len);
+        is->data[len] = '\0';
+        _table.slots[i] = is;
+        _table.count++;
+        _table.memory += sizeof(InternString) + len + 1;
+    }
+    is->refcnt++;
+    pthread_mutex_unlock(&_lock);
+
+    return is->data;
+}
+
+const char *Intern_Retain(const char *s) {
+    pthread_mutex_lock(&_lock);
+    __intern_header(s)->refcnt++;
+    pthread_mutex_unlock(&_lock);
+    return s;
+}
+
+const char *Intern_Find(const char *s, uint32_t len) {
+    uint32_t hash = Intern_HashString(s, len);
+    const char *ret = NULL;
+
+    pthread_mutex_lock(&_lock);
+    if (_table.count) {
+        InternString *is = _table.slots[__intern_slot(s, len, hash)];
+        if (is) ret = is->data;
+    }
+    pthread_mutex_unlock(&_lock);
+
+    return ret;
+}
+
+void Intern_Release(const char *s) {
+    pthread_mutex_lock(&_lock);
+    __intern_release(s);
+    pthread_mutex_unlock(&_lock);
+}
+
+void Intern_ReleaseN(const char **s, size_t n) {
+    pthread_mutex_lock(&_lock);
+    for (size_t i = 0; i < n; i++) __intern_release(s[i]);
+    pthread_mutex_unlock(&_lock);
+}
+
+uint32_t Intern_Hash(const char *s) { return __intern_header(s)->hash; }
+
+uint32_t Intern_Len(const char *s) { return __intern_header(s)->len; }
+
+size_t Intern_MemoryShare(const char *s) {
+    InternString *is = __intern_header(s);
+    pthread_mutex_lock(&_lock);
+    size_t ret = (sizeof(InternString) + is->len + 1) / is->refcnt;
+    pthread_mutex_unlock(&_lock);
+    return ret;
+}
+
+size_t Intern_AllocatedShare(const char *s, size_t (*alloc)(const void *ptr, size_t size)) {
+    InternString *is = __intern_header(s);
+    pthread_mutex_lock(&_lock);
+    size_t ret = alloc(is, sizeof(InternString) + is->len + 1) / is->refcnt;
+    pthread_mutex_unlock(&_lock);
+    return ret;
+}
+
+void Intern_Stats(size_t *count, size_t *memory) {
+    pthread_mutex_lock(&_lock);
+    if (count) *count = _table.count;
+    if (memory) *memory = _table.memory + _table.cap * sizeof(InternString *);
+    pthread_mutex_unlock(&_lock);
+}
@@ -0,0 +1,79 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __INTERN_H__
+#define __INTERN_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef REDIS_MODULE_TARGET
+#include <alloc.h>
+#endif
+
+/**
+* A process-wide table of reference counted, immutable strings, used for dictionary keys. Every
+* distinct key is stored once no matter how many keyval nodes (and documents) use it, so two interned
+* strings are equal if and only if their pointers are.
+* Interned strings are NULL terminated C-strings, that are prefixed by a header with their reference
+* count, hash and length. All functions are thread safe.
+*/
+
+/** Returns the interned copy of a string with a new reference to it, interning it if needed */
+const char *Intern_Acquire(const char *s, uint32_t len);
+
+/** Adds a reference to an interned string and returns it, which saves looking it up */
+const char *Intern_Retain(const char *s);
+
+/** Returns the interned copy of a string without referencing it, or NULL if it isn't interned */
+const char *Intern_Find(const char *s, uint32_t len);
+
+/** Releases a reference to an interned string, it is freed with its last reference */
+void Intern_Release(const char *s);
+
+/** Releases a reference to each of the n interned strings at once */
+void Intern_ReleaseN(const char **s, size_t n);
+
+/** The (FNV-1a) hash of an interned string */
+uint32_t Intern_Hash(const char *s);
+
+/** The length of an interned string */
+uint32_t Intern_Len(const char *s);
+
+/** The memory that an interned string takes, divided by its number of references */
+size_t Intern_MemoryShare(const char *s);
+
+/**
+* Like Intern_MemoryShare, but the string's allocation takes what alloc gives for it, which is given
+* a pointer to the allocation and its size
+*/
+size_t Intern_AllocatedShare(const char *s, size_t (*alloc)(const void *ptr, size_t size));
+
+/** Reports the number of interned strings and of the bytes they take (including the table) */
+void Intern_Stats(size_t *count, size_t *memory);
+
+/** The FNV-1a hash of a string of a given length */
+static inline uint32_t Intern_HashString(const char *s, uint32_t len) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+#endif
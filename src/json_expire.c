@@ -0,0 +1,265 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "json_expire.h"
+
+typedef struct JSONExpireDoc JSONExpireDoc;
+
+/* The documents with expiring paths that the scheduler knows the keys of, a min-heap by the time
+ * that their first path expires */
+static struct {
+    JSONExpireDoc **docs;
+    size_t len, cap;
+} _heap = {0};
+
+static inline long long __ex_first(const JSONExpireDoc *d) {
+    return d->paths[0].when;
+}
+
+static inline void __ex_place(size_t i, JSONExpireDoc *d) {
+    _heap.docs[i] = d;
+    d->heappos = i + 1;
+}
+
+/* Moves the document at position i up or down the heap to where its first time belongs */
+static void __ex_fix(size_t i) {
+    JSONExpireDoc *d = _heap.docs[i];
+    while (i && __ex_first(_heap.docs[(i - 1) / 2]) > __ex_first(d)) {
+        __ex_place(i, _heap.docs[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    for (;;) {
+        size_t c = 2 * i + 1;
+        if (c >= _heap.len) break;
+        if (c + 1 < _heap.len && __ex_first(_heap.docs[c + 1]) < __ex_first(_heap.docs[c])) c++;
+        if (__ex_first(_heap.docs[c]) >= __ex_first(d)) break;
+        __ex_place(i, _heap.docs[c]);
+        i = c;
+    }
+    __ex_place(i, d);
+}
+
+static void __ex_push(JSONExpireDoc *d) {
+    if (d->heappos) return;
+    if (_heap.len == _heap.cap) {
+        _heap.cap = _heap.cap ? _heap.cap * 2 : 16;
+        _heap.docs = realloc(_heap.docs, _heap.cap * sizeof(JSONExpireDoc *));
+    }
+    __ex_place(_heap.len++, d);
+    __ex_fix(_heap.len - 1);
+}
+
+static void __ex_unlink(JSONExpireDoc *d) {
+    if (!d->heappos) return;
+    size_t i = d->heappos - 1;
+    d->heappos = 0;
+    if (i == --_heap.len) return;
+    __ex_place(i, _heap.docs[_heap.len]);
+    __ex_fix(i);
+}
+
+/* The same min-heap by time for the paths of a document */
+static void __ex_fixpath(JSONExpireDoc *d, size_t i) {
+    JSONExpirePath p = d->paths[i];
+    while (i && d->paths[(i - 1) / 2].when > p.when) {
+        d->paths[i] = d->paths[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    for (;;) {
+        size_t c = 2 * i + 1;
+        if (c >= d->len) break;
+        if (c + 1 < d->len && d->paths[c + 1].when < d->paths[c].when) c++;
+        if (d->paths[c].when >= p.when) break;
+        d->paths[i] = d->paths[c];
+        i = c;
+    }
+    d->paths[i] = p;
+}
+
+/* Removes the path at position i, and frees it unless it's taken */
+static sds __ex_delpath(JSONExpireDoc *d, size_t i) {
+    sds path = d->paths[i].path;
+    d->paths[i] = d->paths[--d->len];
+    if (i < d->len) __ex_fixpath(d, i);
+    return path;
+}
+
+static void __ex_free(JSONType_t *jt) {
+    JSONExpireDoc *d = jt->expires;
+    __ex_unlink(d);
+    for (size_t i = 0; i < d->len; i++) sdsfree(d->paths[i].path);
+    free(d->paths);
+    sdsfree(d->key);
+    free(d);
+    jt->expires = NULL;
+}
+
+/* After the document's paths changed, it moves in the heap, or leaves it with its last path */
+static void __ex_changed(JSONType_t *jt) {
+    JSONExpireDoc *d = jt->expires;
+    if (!d->len) {
+        __ex_free(jt);
+    } else if (d->heappos) {
+        __ex_fix(d->heappos - 1);
+    }
+}
+
+static void __ex_setkey(RedisModuleCtx *ctx, JSONExpireDoc *d, RedisModuleString *key) {
+    size_t len;
+    const char *s = RedisModule_StringPtrLen(key, &len);
+    d->db = RedisModule_GetSelectedDb(ctx);
+    if (d->key && sdslen(d->key) == len && !memcmp(d->key, s, len)) return;
+    sdsfree(d->key);
+    d->key = sdsnewlen(s, len);
+}
+
+sds JSONExpire_PathString(const SearchPath *sp) {
+    sds path = sdsnew(OBJECT_ROOT_PATH);
+    for (size_t i = 0; i < sp->len; i++) {
+        const PathNode *pn = &sp->nodes[i];
+        if (NT_ROOT == pn->type) continue;
+        // an index would expire whichever item the array's changes shift into it
+        sds next = NT_KEY == pn->type ? JSONTypeKeyPath(path, pn->value.key) : NULL;
+        sdsfree(path);
+        if (!next) return NULL;
+        path = next;
+    }
+    return path;
+}
+
+void JSONExpire_Set(RedisModuleCtx *ctx, JSONType_t *jt, RedisModuleString *key, const char *path,
+                    long long when) {
+    JSONExpireDoc *d = jt->expires;
+    if (!d) {
+        d = jt->expires = calloc(1, sizeof(JSONExpireDoc));
+        d->jt = jt;
+    }
+    __ex_setkey(ctx, d, key);
+
+    size_t i = 0;
+    while (i < d->len && strcmp(d->paths[i].path, path)) i++;
+    if (i == d->len) {
+        if (d->len == d->cap) {
+            d->cap = d->cap ? d->cap * 2 : 4;
+            d->paths = realloc(d->paths, d->cap * sizeof(JSONExpirePath));
+        }
+        d->paths[d->len++].path = sdsnew(path);
+    }
+    d->paths[i].when = when;
+    __ex_fixpath(d, i);
+    if (d->heappos) {
+        __ex_fix(d->heappos - 1);
+    } else {
+        __ex_push(d);
+    }
+}
+
+long long JSONExpire_Get(JSONType_t *jt, const char *path) {
+    JSONExpireDoc *d = jt->expires;
+    for (size_t i = 0; d && i < d->len; i++) {
+        if (!strcmp(d->paths[i].path, path)) return d->paths[i].when;
+    }
+    return -1;
+}
+
+int JSONExpire_Remove(JSONType_t *jt, const char *path) {
+    JSONExpireDoc *d = jt->expires;
+    for (size_t i = 0; d && i < d->len; i++) {
+        if (!strcmp(d->paths[i].path, path)) {
+            sdsfree(__ex_delpath(d, i));
+            __ex_changed(jt);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void JSONExpire_Track(RedisModuleCtx *ctx, JSONType_t *jt, RedisModuleString *key) {
+    if (!jt->expires) return;
+    __ex_setkey(ctx, jt->expires, key);
+    __ex_push(jt->expires);
+}
+
+sds JSONExpire_TakeDue(JSONType_t *jt, long long now) {
+    JSONExpireDoc *d = jt->expires;
+    if (!d || d->paths[0].when > now) return NULL;
+    sds path = __ex_delpath(d, 0);
+    __ex_changed(jt);
+    return path;
+}
+
+JSONExpireDoc *JSONExpire_NextDue(long long now) {
+    return _heap.len && __ex_first(_heap.docs[0]) <= now ? _heap.docs[0] : NULL;
+}
+
+void JSONExpire_Park(JSONType_t *jt) {
+    if (jt->expires) __ex_unlink(jt->expires);
+}
+
+void JSONExpire_Untrack(JSONType_t *jt) {
+    if (jt->expires) __ex_free(jt);
+}
+
+size_t JSONExpire_MemoryUsage(const JSONType_t *jt) {
+    const JSONExpireDoc *d = jt->expires;
+    if (!d) return 0;
+    size_t memory = sizeof(JSONExpireDoc) + d->cap * sizeof(JSONExpirePath) + sdsAllocSize(d->key);
+    for (size_t i = 0; i < d->len; i++) memory += sdsAllocSize(d->paths[i].path);
+    return memory;
+}
+
+void JSONExpire_RdbSave(RedisModuleIO *rdb, JSONType_t *jt) {
+    JSONExpireDoc *d = jt->expires;
+    RedisModule_SaveUnsigned(rdb, d ? d->len : 0);
+    if (!d) return;
+    RedisModule_SaveStringBuffer(rdb, d->key, sdslen(d->key));
+    RedisModule_SaveUnsigned(rdb, d->db);
+    for (size_t i = 0; i < d->len; i++) {
+        RedisModule_SaveStringBuffer(rdb, d->paths[i].path, sdslen(d->paths[i].path));
+        RedisModule_SaveSigned(rdb, d->paths[i].when);
+    }
+}
+
+void JSONExpire_RdbLoad(RedisModuleIO *rdb, JSONType_t *jt) {
+    size_t len, count = RedisModule_LoadUnsigned(rdb);
+    if (!count) return;
+
+    // the document is scheduled at the key that it was saved from, which is checked when it's due
+    JSONExpireDoc *d = jt->expires = calloc(1, sizeof(JSONExpireDoc));
+    d->jt = jt;
+    char *buf = RedisModule_LoadStringBuffer(rdb, &len);
+    d->key = sdsnewlen(buf, len);
+    RedisModule_Free(buf);
+    d->db = (int)RedisModule_LoadUnsigned(rdb);
+    d->cap = count;
+    d->paths = malloc(count * sizeof(JSONExpirePath));
+    for (size_t i = 0; i < count; i++) {
+        buf = RedisModule_LoadStringBuffer(rdb, &len);
+        d->paths[d->len].path = sdsnewlen(buf, len);
+        RedisModule_Free(buf);
+        d->paths[d->len].when = RedisModule_LoadSigned(rdb);
+        __ex_fixpath(d, d->len++);
+    }
+    __ex_push(d);
+}
+
+void JSONExpire_AofRewrite(RedisModuleIO *aof, RedisModuleString *key, JSONType_t *jt) {
+    JSONExpireDoc *d = jt->expires;
+    for (size_t i = 0; d && i < d->len; i++) {
+        RedisModule_EmitAOF(aof, "JSON.PEXPIREAT", "scl", key, d->paths[i].path, d->paths[i].when);
+    }
+}
@@ -0,0 +1,112 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __JSON_EXPIRE_H__
+#define __JSON_EXPIRE_H__
+
+#include "json_type.h"
+#include "path.h"
+
+/**
+* The expiry of values at paths of documents, see JSON.EXPIRE. A document's expiring paths are kept
+* with it, with the key and the database that it was last seen at. The documents with expiring
+* paths are in a min-heap by the time that their first path expires, which the module's timer pops
+* a bounded number of paths from on every tick. Commands expire the due paths of the documents that
+* they access too, so a path is never read after it expired.
+*
+* The scheduler doesn't follow keys that are renamed or moved: the key of a document that's due is
+* checked to still hold it, and a document that's elsewhere leaves the heap until it's accessed
+* again. Expiries aren't thread safe, they are meant for Redis' main thread.
+*/
+
+/* The period of the module's expiry timer in milliseconds */
+#define JSONEXPIRE_CYCLE_MS 100
+
+/* The most paths that a tick of the timer expires, so that a tick blocks the server briefly */
+#define JSONEXPIRE_CYCLE_PATHS 256
+
+/* A path of a document and the time it expires at, in milliseconds since the epoch */
+typedef struct {
+    sds path;
+    long long when;
+} JSONExpirePath;
+
+struct JSONExpireDoc {
+    JSONType_t *jt;
+    sds key;  // the key and the database that the document was last seen at
+    int db;
+    JSONExpirePath *paths;  // kept as a min-heap by time
+    size_t len, cap;
+    size_t heappos;  // the document's position in the scheduler's heap + 1, 0 when it's out of it
+};
+
+/**
+* Returns the canonical form of a path of a single value, which expiries are keyed by, or NULL if
+* the path has multiple values, an array index or a key that paths can't express. Expiries are
+* keyed by paths rather than values: a path expires whatever value it holds by then, and paths
+* through arrays aren't allowed, as inserting or removing items shifts others to their indexes.
+*/
+sds JSONExpire_PathString(const SearchPath *sp);
+
+/**
+* Sets the time that a path of a document expires at, replacing the path's expiry if it has one,
+* and tracks the document at a key in the selected database.
+*/
+void JSONExpire_Set(RedisModuleCtx *ctx, JSONType_t *jt, RedisModuleString *key, const char *path,
+                    long long when);
+
+/** The time that a path of a document expires at, or -1 if it doesn't expire */
+long long JSONExpire_Get(JSONType_t *jt, const char *path);
+
+/** Removes the expiry of a path of a document. Returns 1 if it had one, 0 otherwise */
+int JSONExpire_Remove(JSONType_t *jt, const char *path);
+
+/**
+* Records the key in the selected database that a document with expiring paths is at, putting it
+* back in the scheduler's heap if it left it. Called by the commands that access the document.
+*/
+void JSONExpire_Track(RedisModuleCtx *ctx, JSONType_t *jt, RedisModuleString *key);
+
+/**
+* Takes the earliest path of the document that's due by now, removing its expiry, or returns NULL
+* if none is. The caller deletes the path and frees the string.
+*/
+sds JSONExpire_TakeDue(JSONType_t *jt, long long now);
+
+/**
+* Returns the document that is due the earliest by now, or NULL if none is. The document stays in
+* the heap until its due paths are taken or it's parked.
+*/
+struct JSONExpireDoc *JSONExpire_NextDue(long long now);
+
+/** Takes a document out of the scheduler's heap until it's tracked again, see JSONExpire_Track */
+void JSONExpire_Park(JSONType_t *jt);
+
+/** Drops a document's expiries, called by JSONTypeFree */
+void JSONExpire_Untrack(JSONType_t *jt);
+
+/** The memory that a document's expiries take */
+size_t JSONExpire_MemoryUsage(const JSONType_t *jt);
+
+/** Saves a document's expiries after its value, and loads them */
+void JSONExpire_RdbSave(RedisModuleIO *rdb, JSONType_t *jt);
+void JSONExpire_RdbLoad(RedisModuleIO *rdb, JSONType_t *jt);
+
+/** Rewrites a document's expiries as JSON.PEXPIREAT commands, after the document */
+void JSONExpire_AofRewrite(RedisModuleIO *aof, RedisModuleString *key, JSONType_t *jt);
+
+#endif
@@ -0,0 +1,600 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include "json_index.h"
+#include "intern.h"
+
+/* The initial size of a hash index's table */
+#define JSONINDEX_INITIAL_BUCKETS 64
+
+#define JSONINDEX_SKIPLIST_MAXLEVEL 32
+
+/* A document's entry in an index */
+typedef struct {
+    void *entry;  // the document's bucket in a hash index or its node in a sorted one, if indexed
+    size_t pos;   // the document's position in its bucket
+} _JSONIndexSlot;
+
+/* The indexing state of a tracked document */
+struct JSONIndexDoc {
+    JSONType_t *jt;
+    sds key;                              // the document's key
+    int db;                               // the database of the key
+    int dirty;                            // set while the document is in the dirty list
+    JSONIndexDoc *prevdirty, *nextdirty;  // the neighbours in the dirty list
+    _JSONIndexSlot *slots;                // the document's entries, by the indexes' ids
+    size_t nslots;
+};
+
+/* The documents of a hash index that have the same value */
+typedef struct _JSONIndexBucket {
+    struct _JSONIndexBucket *next;  // the next bucket in the table's chain
+    uint32_t hash;
+    sds value;  // the value's encoding, see __ix_hashValue
+    JSONIndexDoc **docs;
+    size_t len;
+    size_t cap;
+} _JSONIndexBucket;
+
+/* A document in a sorted index's skiplist, which is ordered by value and then by address */
+typedef struct _JSONIndexNode {
+    double score;
+    JSONIndexDoc *doc;
+    struct _JSONIndexNode *forward[];
+} _JSONIndexNode;
+
+static struct {
+    JSONIndex **indexes;  // by id, NULL for the ids of freed indexes
+    size_t len;
+    JSONIndexDoc *dirty;  // the head of the list of dirty documents
+    uint32_t seed;        // the state of the skiplists' level generator
+    int followkeys;       // set when restored, renamed and moved keys are tracked
+} _ix = {.seed = 2463534242U};
+
+/* The value that a document has at an index's path */
+typedef struct {
+    JSONIndex *ix;
+    int found;
+    sds value;     // the encoding of a hash index's value
+    double score;  // a sorted index's value
+} _JSONIndexValue;
+
+#define __ix_type(n) ((n) ? (n)->type : N_NULL)
+#define __ix_isNumber(n) (N_INTEGER == __ix_type(n) || N_NUMBER == __ix_type(n))
+#define __ix_number(n) (N_INTEGER == (n)->type ? (double)(n)->value.intval : Node_Number(n))
+
+/* === Documents === */
+
+static void __ix_unlinkDirty(JSONIndexDoc *d) {
+    if (d->prevdirty) d->prevdirty->nextdirty = d->nextdirty;
+    else _ix.dirty = d->nextdirty;
+    if (d->nextdirty) d->nextdirty->prevdirty = d->prevdirty;
+    d->prevdirty = d->nextdirty = NULL;
+    d->dirty = 0;
+}
+
+static void __ix_markDirty(JSONIndexDoc *d) {
+    if (d->dirty) return;
+    d->dirty = 1;
+    d->prevdirty = NULL;
+    d->nextdirty = _ix.dirty;
+    if (_ix.dirty) _ix.dirty->prevdirty = d;
+    _ix.dirty = d;
+}
+
+/* Returns the indexing state of a document, which is created or renamed as needed */
+static JSONIndexDoc *__ix_doc(JSONType_t *jt, const char *key, size_t len, int db) {
+    JSONIndexDoc *d = jt->indexed;
+    if (!d) {
+        d = calloc(1, sizeof(JSONIndexDoc));
+        d->jt = jt;
+        jt->indexed = d;
+    }
+    if (!d->key || sdslen(d->key) != len || memcmp(d->key, key, len)) {
+        sdsfree(d->key);
+        d->key = sdsnewlen(key, len);
+    }
+    d->db = db;
+    return d;
+}
+
+static _JSONIndexSlot *__ix_slot(JSONIndexDoc *d, size_t id) {
+    if (id >= d->nslots) {
+        d->slots = realloc(d->slots, _ix.len * sizeof(_JSONIndexSlot));
+        memset(&d->slots[d->nslots], 0, (_ix.len - d->nslots) * sizeof(_JSONIndexSlot));
+        d->nslots = _ix.len;
+    }
+    return &d->slots[id];
+}
+
+/* === Hash indexes === */
+
+/* Encodes a scalar as a string of its type and its value, numbers as doubles so 1 and 1.0 are the
+ * same value. Returns NULL for containers, which aren't indexed */
+static sds __ix_hashValue(const Node *n) {
+    switch (__ix_type(n)) {
+        case N_NULL:
+            return sdsnewlen("z", 1);
+        case N_BOOLEAN:
+            return sdsnewlen(n->value.boolval ? "t" : "f", 1);
+        case N_INTEGER:
+        case N_NUMBER: {
+            double d = __ix_number(n);
+            if (0 == d) d = 0;  // -0 and 0 are the same
+            sds s = sdsnewlen("n", 1);
+            return sdscatlen(s, &d, sizeof(double));
+        }
+        case N_STRING: {
+            char *tmp;
+            sds s = sdsnewlen("s", 1);
+            s = sdscatlen(s, Node_StringData(n, &tmp), n->value.strval.len);
+            free(tmp);
+            return s;
+        }
+        default:
+            return NULL;
+    }
+}
+
+static _JSONIndexBucket **__ix_hashFind(JSONIndex *ix, const sds value, uint32_t hash) {
+    _JSONIndexBucket **bp = &ix->buckets[hash & (ix->nbuckets - 1)];
+    while (*bp && ((*bp)->hash != hash || sdslen((*bp)->value) != sdslen(value) ||
+                   memcmp((*bp)->value, value, sdslen(value))))
+        bp = &(*bp)->next;
+    return bp;
+}
+
+static void __ix_hashGrow(JSONIndex *ix) {
+    size_t nbuckets = ix->nbuckets ? ix->nbuckets * 2 : JSONINDEX_INITIAL_BUCKETS;
+    _JSONIndexBucket **buckets = calloc(nbuckets, sizeof(_JSONIndexBucket *));
+    for (size_t i = 0; i < ix->nbuckets; i++) {
+        _JSONIndexBucket *b = ix->buckets[i];
+        while (b) {
+            _JSONIndexBucket *next = b->next;
+            b->next = buckets[b->hash & (nbuckets - 1)];
+            buckets[b->hash & (nbuckets - 1)] = b;
+            b = next;
+        }
+    }
+    free(ix->buckets);
+    ix->buckets = buckets;
+    ix->nbuckets = nbuckets;
+}
+
+/* Adds a document with its value's encoding to a hash index, which takes the encoding */
+static void __ix_hashAdd(JSONIndex *ix, JSONIndexDoc *d, _JSONIndexSlot *slot, sds value) {
+    uint32_t hash = Intern_HashString(value, sdslen(value));
+    if (ix->nvalues >= ix->nbuckets) __ix_hashGrow(ix);
+    _JSONIndexBucket **bp = __ix_hashFind(ix, value, hash);
+    _JSONIndexBucket *b = *bp;
+    if (b) {
+        sdsfree(value);
+    } else {
+        b = calloc(1, sizeof(_JSONIndexBucket));
+        b->hash = hash;
+        b->value = value;
+        *bp = b;
+        ix->nvalues++;
+    }
+
+    if (b->len == b->cap) {
+        b->cap = b->cap ? b->cap * 2 : 1;
+        b->docs = realloc(b->docs, b->cap * sizeof(JSONIndexDoc *));
+    }
+    slot->entry = b;
+    slot->pos = b->len;
+    b->docs[b->len++] = d;
+    ix->ndocs++;
+}
+
+static void __ix_hashRemove(JSONIndex *ix, _JSONIndexSlot *slot) {
+    _JSONIndexBucket *b = slot->entry;
+
+    // the last document of the bucket takes the removed one's place
+    JSONIndexDoc *last = b->docs[--b->len];
+    if (slot->pos != b->len) {
+        b->docs[slot->pos] = last;
+        last->slots[ix->id].pos = slot->pos;
+    }
+    slot->entry = NULL;
+    ix->ndocs--;
+
+    if (!b->len) {
+        _JSONIndexBucket **bp = &ix->buckets[b->hash & (ix->nbuckets - 1)];
+        while (*bp != b) bp = &(*bp)->next;
+        *bp = b->next;
+        sdsfree(b->value);
+        free(b->docs);
+        free(b);
+        ix->nvalues--;
+    }
+}
+
+/* === Sorted indexes === */
+
+/* Checks whether a skiplist node is before a value and document */
+static inline int __ix_before(const _JSONIndexNode *n, double score, const JSONIndexDoc *doc) {
+    return n->score < score || (n->score == score && (uintptr_t)n->doc < (uintptr_t)doc);
+}
+
+/* A level for a new node, every level has a quarter of the nodes of the one below it */
+static int __ix_randomLevel(void) {
+    int level = 1;
+    for (;;) {
+        _ix.seed ^= _ix.seed << 13;
+        _ix.seed ^= _ix.seed >> 17;
+        _ix.seed ^= _ix.seed << 5;
+        if ((_ix.seed & 3) || level == JSONINDEX_SKIPLIST_MAXLEVEL) return level;
+        level++;
+    }
+}
+
+/* Sets update to the last nodes at every level that are before the value and document */
+static void __ix_sortedSeek(JSONIndex *ix, double score, const JSONIndexDoc *doc,
+                            _JSONIndexNode **update) {
+    _JSONIndexNode *x = ix->head;
+    for (int i = ix->level - 1; i >= 0; i--) {
+        while (x->forward[i] && __ix_before(x->forward[i], score, doc)) x = x->forward[i];
+        update[i] = x;
+    }
+}
+
+static void __ix_sortedAdd(JSONIndex *ix, JSONIndexDoc *d, _JSONIndexSlot *slot, double score) {
+    _JSONIndexNode *update[JSONINDEX_SKIPLIST_MAXLEVEL];
+
+    if (!ix->head) {
+        ix->head = calloc(1, sizeof(_JSONIndexNode) +
+                                 JSONINDEX_SKIPLIST_MAXLEVEL * sizeof(_JSONIndexNode *));
+        ix->level = 1;
+    }
+    __ix_sortedSeek(ix, score, d, update);
+    int level = __ix_randomLevel();
+    for (; ix->level < level; ix->level++) update[ix->level] = ix->head;
+
+    _JSONIndexNode *n = malloc(sizeof(_JSONIndexNode) + level * sizeof(_JSONIndexNode *));
+    n->score = score;
+    n->doc = d;
+    for (int i = 0; i < level; i++) {
+        n->forward[i] = update[i]->forward[i];
+        update[i]->forward[i] = n;
+    }
+    slot->entry = n;
+    ix->ndocs++;
+}
+
+static void __ix_sortedRemove(JSONIndex *ix, _JSONIndexSlot *slot) {
+    _JSONIndexNode *update[JSONINDEX_SKIPLIST_MAXLEVEL];
+    _JSONIndexNode *n = slot->entry;
+
+    __ix_sortedSeek(ix, n->score, n->doc, update);
+    for (int i = 0; i < ix->level; i++) {
+        if (update[i]->forward[i] == n) update[i]->forward[i] = n->forward[i];
+    }
+    while (ix->level > 1 && !ix->head->forward[ix->level - 1]) ix->level--;
+    free(n);
+    slot->entry = NULL;
+    ix->ndocs--;
+}
+
+/* === Maintenance === */
+
+static void __ix_valueVisitor(Node *n, Node *p, const char *key, int index, void *ctx) {
+    _JSONIndexValue *v = ctx;
+    if (JSONINDEX_HASH == v->ix->kind) {
+        v->value = __ix_hashValue(n);
+        v->found = NULL != v->value;
+    } else if (__ix_isNumber(n)) {
+        v->score = __ix_number(n);
+        v->found = 1;
+    }
+}
+
+static void __ix_remove(JSONIndex *ix, _JSONIndexSlot *slot) {
+    if (JSONINDEX_HASH == ix->kind)
+        __ix_hashRemove(ix, slot);
+    else
+        __ix_sortedRemove(ix, slot);
+}
+
+/* Brings a document's entry in an index up to date with the document */
+static void __ix_update(JSONIndex *ix, JSONIndexDoc *d) {
+    _JSONIndexValue v = {ix};
+    if (d->db == ix->db) {
+        JSONTypeAccess(d->jt, 0);
+        SearchPath_FindEach(&ix->path->sp, d->jt->root, __ix_valueVisitor, &v);
+    }
+
+    _JSONIndexSlot *slot = __ix_slot(d, ix->id);
+    if (slot->entry) {
+        if (v.found && JSONINDEX_HASH == ix->kind) {
+            sds value = ((_JSONIndexBucket *)slot->entry)->value;
+            if (sdslen(value) == sdslen(v.value) && !memcmp(value, v.value, sdslen(value))) {
+                sdsfree(v.value);
+                return;
+            }
+        } else if (v.found && ((_JSONIndexNode *)slot->entry)->score == v.score) {
+            return;
+        }
+        __ix_remove(ix, slot);
+    }
+
+    if (!v.found) return;
+    if (JSONINDEX_HASH == ix->kind)
+        __ix_hashAdd(ix, d, slot, v.value);
+    else
+        __ix_sortedAdd(ix, d, slot, v.score);
+}
+
+/* Removes all the documents from an index */
+static void __ix_clear(JSONIndex *ix) {
+    for (size_t i = 0; i < ix->nbuckets; i++) {
+        _JSONIndexBucket *b = ix->buckets[i];
+        while (b) {
+            _JSONIndexBucket *next = b->next;
+            for (size_t j = 0; j < b->len; j++) b->docs[j]->slots[ix->id].entry = NULL;
+            sdsfree(b->value);
+            free(b->docs);
+            free(b);
+            b = next;
+        }
+    }
+    free(ix->buckets);
+    ix->buckets = NULL;
+    ix->nbuckets = 0;
+
+    if (ix->head) {
+        _JSONIndexNode *n = ix->head->forward[0];
+        while (n) {
+            _JSONIndexNode *next = n->forward[0];
+            n->doc->slots[ix->id].entry = NULL;
+            free(n);
+            n = next;
+        }
+        free(ix->head);
+        ix->head = NULL;
+        ix->level = 0;
+    }
+    ix->ndocs = 0;
+    ix->nvalues = 0;
+}
+
+/* Updates the built indexes with the dirty documents */
+static void __ix_flush(void) {
+    while (_ix.dirty) {
+        JSONIndexDoc *d = _ix.dirty;
+        __ix_unlinkDirty(d);
+        for (size_t i = 0; i < _ix.len; i++) {
+            if (_ix.indexes[i] && _ix.indexes[i]->built) __ix_update(_ix.indexes[i], d);
+        }
+    }
+}
+
+/* Adds all the documents of the selected database to an index */
+static void __ix_scan(RedisModuleCtx *ctx, JSONIndex *ix, RedisModuleType *doctype) {
+    char cursor[32] = "0";
+    do {
+        RedisModuleCallReply *r =
+            RedisModule_Call(ctx, "SCAN", "ccl", cursor, "COUNT", (long long)JSONINDEX_SCAN_COUNT);
+        if (!r || REDISMODULE_REPLY_ARRAY != RedisModule_CallReplyType(r) ||
+            2 != RedisModule_CallReplyLength(r)) {
+            if (r) RedisModule_FreeCallReply(r);
+            return;
+        }
+
+        size_t len;
+        const char *next = RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(r, 0), &len);
+        if (len >= sizeof(cursor)) len = 0;
+        memcpy(cursor, next, len);
+        cursor[len] = '\0';
+
+        RedisModuleCallReply *keys = RedisModule_CallReplyArrayElement(r, 1);
+        for (size_t i = 0; i < RedisModule_CallReplyLength(keys); i++) {
+            RedisModuleString *name =
+                RedisModule_CreateStringFromCallReply(RedisModule_CallReplyArrayElement(keys, i));
+            RedisModuleKey *key = RedisModule_OpenKey(ctx, name, REDISMODULE_READ);
+            if (RedisModule_ModuleTypeGetType(key) == doctype) {
+                const char *s = RedisModule_StringPtrLen(name, &len);
+                __ix_update(ix, __ix_doc(RedisModule_ModuleTypeGetValue(key), s, len, ix->db));
+            }
+            RedisModule_CloseKey(key);
+            RedisModule_FreeString(ctx, name);
+        }
+        RedisModule_FreeCallReply(r);
+    } while (strcmp(cursor, "0"));
+}
+
+/* === API === */
+
+JSONIndex *NewJSONIndex(const char *path, size_t len, JSONIndexKind kind) {
+    CompiledPath *cp = PathCache_Get(path, len, NULL);
+    if (!cp) return NULL;
+    if (SearchPath_IsMulti(&cp->sp)) {
+        PathCache_Release(cp);
+        return NULL;
+    }
+
+    JSONIndex *ix = calloc(1, sizeof(JSONIndex));
+    ix->path = cp;
+    ix->kind = kind;
+    ix->db = -1;
+
+    // take the first free id
+    while (ix->id < _ix.len && _ix.indexes[ix->id]) ix->id++;
+    if (ix->id == _ix.len) _ix.indexes = realloc(_ix.indexes, ++_ix.len * sizeof(JSONIndex *));
+    _ix.indexes[ix->id] = ix;
+    return ix;
+}
+
+void JSONIndex_Build(RedisModuleCtx *ctx, JSONIndex *ix, RedisModuleType *doctype) {
+    int db = RedisModule_GetSelectedDb(ctx);
+    if (!ix->built || ix->db != db) {
+        __ix_clear(ix);
+        ix->db = db;
+        ix->built = 1;
+        __ix_scan(ctx, ix, doctype);
+    }
+    __ix_flush();
+}
+
+size_t JSONIndex_Lookup(JSONIndex *ix, const Node *value, size_t offset, long long count,
+                        JSONIndexVisitor f, void *ctx) {
+    if (JSONINDEX_SORTED == ix->kind) {
+        if (!__ix_isNumber(value)) return 0;
+        double score = __ix_number(value);
+        return JSONIndex_Range(ix, score, 0, score, 0, offset, count, f, ctx);
+    }
+
+    sds encoded = __ix_hashValue(value);
+    if (!encoded || !ix->nbuckets) {
+        sdsfree(encoded);
+        return 0;
+    }
+    _JSONIndexBucket *b = *__ix_hashFind(ix, encoded, Intern_HashString(encoded, sdslen(encoded)));
+    sdsfree(encoded);
+
+    size_t visited = 0;
+    for (size_t i = offset; b && i < b->len && (count < 0 || visited < count); i++, visited++) {
+        f(b->docs[i]->jt, b->docs[i]->key, sdslen(b->docs[i]->key), ctx);
+    }
+    return visited;
+}
+
+size_t JSONIndex_Range(JSONIndex *ix, double min, int minex, double max, int maxex, size_t offset,
+                       long long count, JSONIndexVisitor f, void *ctx) {
+    if (JSONINDEX_SORTED != ix->kind || !ix->head) return 0;
+
+    // find the first node that's in the range
+    _JSONIndexNode *x = ix->head;
+    for (int i = ix->level - 1; i >= 0; i--) {
+        while (x->forward[i] &&
+               (x->forward[i]->score < min || (minex && x->forward[i]->score == min)))
+            x = x->forward[i];
+    }
+
+    size_t visited = 0;
+    for (x = x->forward[0]; x && (x->score < max || (!maxex && x->score == max)); x = x->forward[0]) {
+        if (count >= 0 && visited == count) break;
+        if (offset) {
+            offset--;
+            continue;
+        }
+        f(x->doc->jt, x->doc->key, sdslen(x->doc->key), ctx);
+        visited++;
+    }
+    return visited;
+}
+
+void JSONIndex_Track(RedisModuleCtx *ctx, JSONType_t *jt, RedisModuleString *key) {
+    int db = RedisModule_GetSelectedDb(ctx);
+    // a document that's tracked already is updated, which drops it from another database's indexes
+    int track = NULL != jt->indexed;
+    for (size_t i = 0; !track && i < _ix.len; i++) {
+        track = _ix.indexes[i] && _ix.indexes[i]->built && db == _ix.indexes[i]->db;
+    }
+    if (track) {
+        size_t len;
+        const char *s = RedisModule_StringPtrLen(key, &len);
+        __ix_markDirty(__ix_doc(jt, s, len, db));
+    }
+}
+
+void JSONIndex_Touch(JSONType_t *jt) {
+    if (jt->indexed) __ix_markDirty(jt->indexed);
+}
+
+void JSONIndex_Untrack(JSONType_t *jt) {
+    JSONIndexDoc *d = jt->indexed;
+    if (!d) return;
+
+    for (size_t i = 0; i < d->nslots; i++) {
+        if (d->slots[i].entry) __ix_remove(_ix.indexes[i], &d->slots[i]);
+    }
+    if (d->dirty) __ix_unlinkDirty(d);
+    sdsfree(d->key);
+    free(d->slots);
+    free(d);
+    jt->indexed = NULL;
+}
+
+void JSONIndex_FollowKeys(void) { _ix.followkeys = 1; }
+
+void JSONIndex_Loaded(void) {
+    if (_ix.followkeys) return;
+    for (size_t i = 0; i < _ix.len; i++) {
+        if (_ix.indexes[i]) _ix.indexes[i]->built = 0;
+    }
+}
+
+const char *JSONIndex_KindName(JSONIndexKind kind) {
+    return JSONINDEX_HASH == kind ? "hash" : "sorted";
+}
+
+void *JSONIndexRdbLoad(RedisModuleIO *rdb, int encver) {
+    if (encver < 0 || encver > JSONINDEX_ENCODING_VERSION) {
+        RedisModule_LogIOError(
+            rdb, RM_LOGLEVEL_WARNING,
+            "Can't load JSON index from RDB due to unknown encoding version %d, expecting %d at most",
+            encver, JSONINDEX_ENCODING_VERSION);
+        return NULL;
+    }
+
+    size_t len;
+    char *path = RedisModule_LoadStringBuffer(rdb, &len);
+    uint64_t kind = RedisModule_LoadUnsigned(rdb);
+    JSONIndex *ix = kind <= JSONINDEX_SORTED ? NewJSONIndex(path, len, kind) : NULL;
+    RedisModule_Free(path);
+    if (!ix) {
+        RedisModule_LogIOError(rdb, RM_LOGLEVEL_WARNING,
+                               "Can't load JSON index from RDB due to an invalid definition");
+    }
+    return ix;
+}
+
+void JSONIndexRdbSave(RedisModuleIO *rdb, void *value) {
+    JSONIndex *ix = value;
+    RedisModule_SaveStringBuffer(rdb, ix->path->str, ix->path->len);
+    RedisModule_SaveUnsigned(rdb, ix->kind);
+}
+
+void JSONIndexAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
+    JSONIndex *ix = value;
+    RedisModule_EmitAOF(aof, "JSON.INDEX", "csbc", "CREATE", key, ix->path->str, ix->path->len,
+                        JSONIndex_KindName(ix->kind));
+}
+
+void JSONIndexFree(void *value) {
+    JSONIndex *ix = value;
+    __ix_clear(ix);
+    _ix.indexes[ix->id] = NULL;
+    PathCache_Release(ix->path);
+    free(ix);
+}
+
+size_t JSONIndexMemoryUsage(const void *value) {
+    const JSONIndex *ix = value;
+    size_t memory = sizeof(JSONIndex) + ix->nbuckets * sizeof(_JSONIndexBucket *);
+    if (JSONINDEX_HASH == ix->kind) {
+        memory += ix->nvalues * sizeof(_JSONIndexBucket) + ix->ndocs * sizeof(JSONIndexDoc *);
+    } else {
+        // the nodes have 4/3 forward pointers on average
+        memory += ix->ndocs * (sizeof(_JSONIndexNode) + 4 * sizeof(_JSONIndexNode *) / 3);
+        if (ix->head)
+            memory += sizeof(_JSONIndexNode) + JSONINDEX_SKIPLIST_MAXLEVEL * sizeof(_JSONIndexNode *);
+    }
+    return memory;
+}
@@ -0,0 +1,129 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __JSON_INDEX_H__
+#define __JSON_INDEX_H__
+
+#include "json_type.h"
+#include "path_cache.h"
+
+/**
+* Secondary indexes of the documents of a database by the value at a path. An index is stored as a
+* key of its own type, so it is persisted and replicated with its definition only: its entries are
+* built by scanning the database when it is created, and again when it is first used after being
+* loaded.
+*
+* The documents in a built index are tracked: writes mark them as dirty, and the indexes are brought
+* up to date with the dirty documents before they are queried. Keys that RESTORE, RENAME and MOVE
+* set are tracked from keyspace events, see JSONIndex_FollowKeys. The keys an index finds are always
+* checked to still hold their documents.
+* The indexes aren't thread safe, they are meant for Redis' main thread.
+*/
+
+#define JSONINDEX_TYPE_NAME "ReJSON-IX"
+#define JSONINDEX_ENCODING_VERSION 0
+
+/* The number of keys that are asked for by every SCAN when an index is built */
+#define JSONINDEX_SCAN_COUNT 1000
+
+typedef enum {
+    JSONINDEX_HASH,   // exact matches of strings, numbers, booleans and nulls
+    JSONINDEX_SORTED  // ranges of numbers
+} JSONIndexKind;
+
+typedef struct JSONIndexDoc JSONIndexDoc;
+
+typedef struct {
+    CompiledPath *path;  // the path of the indexed values
+    JSONIndexKind kind;
+    size_t id;           // the index's position in the list of all indexes
+    int db;              // the database of the indexed documents, valid once built
+    int built;           // cleared when the index needs to be built from the database
+    size_t ndocs;        // the number of indexed documents, i.e. that have a value at the path
+    size_t nvalues;      // the number of distinct values in a hash index
+    size_t nbuckets;     // the size of a hash index's table
+    struct _JSONIndexBucket **buckets;
+    struct _JSONIndexNode *head;  // the head of a sorted index's skiplist
+    int level;                    // the number of levels in the skiplist
+} JSONIndex;
+
+/* A visitor of the documents that an index query finds and their keys, it mustn't open keys */
+typedef void (*JSONIndexVisitor)(JSONType_t *jt, const char *key, size_t len, void *ctx);
+
+/**
+* Creates an index of the values at a path, which must be a path of a single value. Returns NULL
+* if the path is invalid.
+*/
+JSONIndex *NewJSONIndex(const char *path, size_t len, JSONIndexKind kind);
+
+/**
+* Brings an index up to date, building it from the documents of doctype in the selected database if
+* it isn't built or was built for another database.
+*/
+void JSONIndex_Build(RedisModuleCtx *ctx, JSONIndex *ix, RedisModuleType *doctype);
+
+/**
+* Visits the documents whose indexed value equals the value, after skipping offset of them and up
+* to count of them (-1 for all). Returns the number of visited documents.
+*/
+size_t JSONIndex_Lookup(JSONIndex *ix, const Node *value, size_t offset, long long count,
+                        JSONIndexVisitor f, void *ctx);
+
+/**
+* Visits the documents of a sorted index whose value is in a range in ascending order, after
+* skipping offset of them and up to count of them (-1 for all). minex and maxex exclude the range's
+* ends. Returns the number of visited documents.
+*/
+size_t JSONIndex_Range(JSONIndex *ix, double min, int minex, double max, int maxex, size_t offset,
+                       long long count, JSONIndexVisitor f, void *ctx);
+
+/**
+* Tracks a document that's set at a key in the selected database, for the indexes that are built
+* for the database. Must be called whenever a document is stored at a key, and a tracked document
+* that's renamed or moved to another database is tracked at its new key.
+*/
+void JSONIndex_Track(RedisModuleCtx *ctx, JSONType_t *jt, RedisModuleString *key);
+
+/** Marks a tracked document as dirty, called by JSONTypeTouch */
+void JSONIndex_Touch(JSONType_t *jt);
+
+/** Removes a document from all the indexes, called by JSONTypeFree */
+void JSONIndex_Untrack(JSONType_t *jt);
+
+/**
+* Marks that the keys that RESTORE, RENAME and MOVE set are tracked with JSONIndex_Track from their
+* keyspace events, on servers that can subscribe to them.
+*/
+void JSONIndex_FollowKeys(void);
+
+/**
+* Called for every document that's loaded. Unless keys are followed (see JSONIndex_FollowKeys), it
+* may be restored at a key that isn't tracked, so the indexes are built again before they're
+* queried.
+*/
+void JSONIndex_Loaded(void);
+
+/** The name of an index kind */
+const char *JSONIndex_KindName(JSONIndexKind kind);
+
+void *JSONIndexRdbLoad(RedisModuleIO *rdb, int encver);
+void JSONIndexRdbSave(RedisModuleIO *rdb, void *value);
+void JSONIndexAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value);
+void JSONIndexFree(void *value);
+size_t JSONIndexMemoryUsage(const void *value);
+
+#endif
@@ -0,0 +1,285 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "json_keyref.h"
+
+/* A referenced key */
+typedef struct {
+    char *key;
+    size_t len;
+    const Node *root;  // the key's document, NULL if it has none or isn't fetched
+    int depth;         // the fewest references that lead to the key
+    int fetched;
+    int queued;  // set while the key waits in the queue to be fetched or scanned
+} KeyRefEntry;
+
+struct KeyRefResolver {
+    KeyRefFetch fetch;
+    void *ctx;
+    int depth;  // the deepest that references are resolved
+
+    // the keys, and a hash table of their positions + 1 whose size is a power of 2
+    KeyRefEntry *keys;
+    size_t len, cap;
+    uint32_t *slots;
+    size_t nslots;
+
+    // the containers that hold references, a hash set whose size is a power of 2
+    const Node **marks;
+    size_t nmarks, capmarks;
+
+    // the positions of the keys to fetch and scan, in the order of their depths
+    size_t *queue;
+    size_t qlen, qcap;
+
+    // the keys whose documents are being written, the origin first
+    size_t stack[KEYREF_MAX_DEPTH + 1];
+    int nstack;
+
+    size_t fetched;
+};
+
+static inline uint64_t __kr_hash(const char *s, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+    return h;
+}
+
+static inline uint64_t __kr_mix(const void *p) {
+    uint64_t v = (uintptr_t)p;
+    v ^= v >> 33;
+    v *= 0xff51afd7ed558ccdULL;
+    return v ^ (v >> 33);
+}
+
+/* Returns the position of a key, adding it when it's new */
+static size_t __kr_key(KeyRefResolver *r, const char *key, size_t len) {
+    if (2 * (r->len + 1) > r->nslots) {
+        free(r->slots);
+        r->nslots = r->nslots ? 2 * r->nslots : 16;
+        r->slots = calloc(r->nslots, sizeof(uint32_t));
+        for (size_t i = 0; i < r->len; i++) {
+            size_t s = __kr_hash(r->keys[i].key, r->keys[i].len) & (r->nslots - 1);
+            while (r->slots[s]) s = (s + 1) & (r->nslots - 1);
+            r->slots[s] = i + 1;
+        }
+    }
+
+    size_t s = __kr_hash(key, len) & (r->nslots - 1);
+    for (; r->slots[s]; s = (s + 1) & (r->nslots - 1)) {
+        const KeyRefEntry *e = &r->keys[r->slots[s] - 1];
+        if (e->len == len && !memcmp(e->key, key, len)) return r->slots[s] - 1;
+    }
+    if (r->len == r->cap) {
+        r->cap = r->cap ? 2 * r->cap : 16;
+        r->keys = realloc(r->keys, r->cap * sizeof(KeyRefEntry));
+    }
+    KeyRefEntry *e = &r->keys[r->len];
+    *e = (KeyRefEntry){.key = malloc(len + 1), .len = len, .depth = KEYREF_MAX_DEPTH + 1};
+    memcpy(e->key, key, len);
+    e->key[len] = '\0';
+    r->slots[s] = ++r->len;
+    return r->len - 1;
+}
+
+static void __kr_mark(KeyRefResolver *r, const Node *n) {
+    if (2 * (r->nmarks + 1) > r->capmarks) {
+        const Node **old = r->marks;
+        size_t cap = r->capmarks;
+        r->capmarks = cap ? 2 * cap : 64;
+        r->marks = calloc(r->capmarks, sizeof(Node *));
+        r->nmarks = 0;
+        for (size_t i = 0; i < cap; i++) {
+            if (old[i]) __kr_mark(r, old[i]);
+        }
+        free(old);
+    }
+    size_t s = __kr_mix(n) & (r->capmarks - 1);
+    for (; r->marks[s]; s = (s + 1) & (r->capmarks - 1)) {
+        if (r->marks[s] == n) return;
+    }
+    r->marks[s] = n;
+    r->nmarks++;
+}
+
+static int __kr_marked(const KeyRefResolver *r, const Node *n) {
+    if (!r->capmarks) return 0;
+    for (size_t s = __kr_mix(n) & (r->capmarks - 1); r->marks[s]; s = (s + 1) & (r->capmarks - 1)) {
+        if (r->marks[s] == n) return 1;
+    }
+    return 0;
+}
+
+const Node *KeyRef_Target(const Node *n) {
+    if (!n || N_DICT != n->type || 1 != n->value.dictval.len) return NULL;
+    const Node *kv = n->value.dictval.entries[0];
+    const Node *val = kv->value.kvval.val;
+    if (strcmp(KEYREF_MEMBER, kv->value.kvval.key) || !val || N_STRING != val->type) return NULL;
+    return val;
+}
+
+/* Records a reference that's depth references deep, queueing its key if it's to be resolved */
+static void __kr_reference(KeyRefResolver *r, const Node *target, int depth) {
+    char *tmp;
+    const char *key = Node_StringData(target, &tmp);
+    size_t pos = __kr_key(r, key, target->value.strval.len);
+    if (tmp) free(tmp);
+
+    // a key that's reached by fewer references is scanned again, as its own go deeper
+    KeyRefEntry *e = &r->keys[pos];
+    if (depth > r->depth || depth >= e->depth) return;
+    e->depth = depth;
+    if (e->queued) return;
+    e->queued = 1;
+    if (r->qlen == r->qcap) {
+        r->qcap = r->qcap ? 2 * r->qcap : 16;
+        r->queue = realloc(r->queue, r->qcap * sizeof(size_t));
+    }
+    r->queue[r->qlen++] = pos;
+}
+
+/**
+* Finds the references of a value of a document that's depth references deep, marking the
+* containers that hold them. Returns 1 if the value is or holds a reference.
+*/
+static int __kr_scan(KeyRefResolver *r, const Node *n, int depth) {
+    int refs = 0;
+    if (!n) return 0;
+    if (N_DICT == n->type) {
+        const Node *target = KeyRef_Target(n);
+        if (target) {
+            __kr_reference(r, target, depth + 1);
+            return 1;
+        }
+        for (uint32_t i = 0; i < n->value.dictval.len; i++)
+            refs |= __kr_scan(r, n->value.dictval.entries[i]->value.kvval.val, depth);
+    } else if (N_ARRAY == n->type && !(n->flags & NODE_F_PACKED)) {
+        Node tmp, *item;
+        for (uint32_t i = 0; i < n->value.arrval.len; i++) {
+            Node_ArrayItemView((Node *)n, i, &tmp, &item);
+            refs |= __kr_scan(r, item, depth);
+        }
+    }
+    if (refs) __kr_mark(r, n);
+    return refs;
+}
+
+/* Fetches the queued keys and scans their documents, which queues the keys that they reference */
+static void __kr_fetch(KeyRefResolver *r) {
+    for (size_t i = 0; i < r->qlen; i++) {
+        KeyRefEntry *e = &r->keys[r->queue[i]];
+        e->queued = 0;
+        if (!e->fetched) {
+            e->root = r->fetch(e->key, e->len, r->ctx);
+            e->fetched = 1;
+            r->fetched++;
+        }
+        if (e->root) __kr_scan(r, e->root, r->keys[r->queue[i]].depth);
+    }
+    r->qlen = 0;
+}
+
+static void __kr_write(KeyRefResolver *r, JSONSerializer *s, const Node *n);
+
+/* Writes a reference as the document of its key, or as it is if it's too deep or a cycle */
+static void __kr_resolve(KeyRefResolver *r, JSONSerializer *s, const Node *ref,
+                         const Node *target) {
+    char *tmp;
+    const char *key = Node_StringData(target, &tmp);
+    size_t pos = __kr_key(r, key, target->value.strval.len);
+    if (tmp) free(tmp);
+
+    int cycle = 0;
+    for (int i = 0; i < r->nstack; i++) cycle |= r->stack[i] == pos;
+    const KeyRefEntry *e = &r->keys[pos];
+    if (cycle || r->nstack > r->depth || !e->fetched) {
+        JSONSerializer_Node(s, ref);
+    } else if (!e->root) {
+        JSONSerializer_Node(s, NULL);
+    } else {
+        r->stack[r->nstack++] = pos;
+        __kr_write(r, s, e->root);
+        r->nstack--;
+    }
+}
+
+/* Writes a value, going into the containers that hold references and the others as they are */
+static void __kr_write(KeyRefResolver *r, JSONSerializer *s, const Node *n) {
+    const Node *target = KeyRef_Target(n);
+    if (target) {
+        __kr_resolve(r, s, n, target);
+        return;
+    }
+    if (!__kr_marked(r, n) || JSONSerializer_Level(s) >= JSONSERIALIZER_MAX_LEVELS) {
+        JSONSerializer_Node(s, n);
+        return;
+    }
+
+    if (N_DICT == n->type) {
+        JSONSerializer_BeginDict(s);
+        for (uint32_t i = 0; i < n->value.dictval.len; i++) {
+            const Node *kv = n->value.dictval.entries[i];
+            JSONSerializer_Key(s, kv->value.kvval.key, Intern_Len(kv->value.kvval.key));
+            __kr_write(r, s, kv->value.kvval.val);
+        }
+    } else {
+        Node tmp, *item;
+        JSONSerializer_BeginArray(s);
+        for (uint32_t i = 0; i < n->value.arrval.len; i++) {
+            Node_ArrayItemView((Node *)n, i, &tmp, &item);
+            __kr_write(r, s, item);
+        }
+    }
+    JSONSerializer_End(s);
+}
+
+KeyRefResolver *NewKeyRefResolver(const char *origin, size_t len, int depth, KeyRefFetch fetch,
+                                  void *ctx) {
+    KeyRefResolver *r = calloc(1, sizeof(KeyRefResolver));
+    r->fetch = fetch;
+    r->ctx = ctx;
+    r->depth = MAX(0, MIN(depth, KEYREF_MAX_DEPTH));
+
+    // the origin is never fetched, so references to it are written as they are
+    size_t pos = __kr_key(r, origin, len);
+    r->keys[pos].depth = 0;
+    r->stack[r->nstack++] = pos;
+    return r;
+}
+
+void KeyRefResolver_Write(JSONSerializer *s, const Node *n, void *ctx) {
+    KeyRefResolver *r = (KeyRefResolver *)ctx;
+    if (!__kr_scan(r, n, 0)) {
+        JSONSerializer_Node(s, n);
+        return;
+    }
+    __kr_fetch(r);
+    __kr_write(r, s, n);
+}
+
+size_t KeyRefResolver_Fetched(const KeyRefResolver *r) {
+    return r->fetched;
+}
+
+void KeyRefResolver_Free(KeyRefResolver *r) {
+    for (size_t i = 0; i < r->len; i++) free(r->keys[i].key);
+    free(r->keys);
+    free(r->slots);
+    free(r->marks);
+    free(r->queue);
+    free(r);
+}
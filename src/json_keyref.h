@@ -0,0 +1,64 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __JSON_KEYREF_H__
+#define __JSON_KEYREF_H__
+
+#include "object.h"
+#include "json_object.h"
+
+/**
+* References from values to the documents of other keys, which are objects whose only member is
+* "$ref" with the key's name, e.g. {"$ref":"user:1"}. They are stored as any other object, and are
+* replaced by the referenced documents when serialized with a resolver, as JSON.GET's RESOLVE does.
+*
+* A resolver fetches every key that's referenced before anything is written, a level of references
+* at a time, so each key is fetched once however often it's referenced. References that go deeper
+* than the resolver's depth, or that refer to a document that is being resolved (a cycle), are
+* written as they are. Referenced keys that don't hold documents are written as null.
+*/
+
+/* The member of the objects that are references */
+#define KEYREF_MEMBER "$ref"
+
+/* The deepest that references can be resolved */
+#define KEYREF_MAX_DEPTH 32
+
+/** Returns the string node of the key that a node references, or NULL if it isn't a reference */
+const Node *KeyRef_Target(const Node *n);
+
+/** Fetches the root of the document of a key, or returns NULL if the key doesn't hold one */
+typedef const Node *(*KeyRefFetch)(const char *key, size_t len, void *ctx);
+
+typedef struct KeyRefResolver KeyRefResolver;
+
+/**
+* Creates a resolver of references up to depth levels deep, from values of the document of the key
+* named origin (which references don't resolve to). Keys are fetched with fetch.
+*/
+KeyRefResolver *NewKeyRefResolver(const char *origin, size_t len, int depth, KeyRefFetch fetch,
+                                  void *ctx);
+
+/** The writer of a serializer that resolves references, with a resolver as ctx */
+void KeyRefResolver_Write(JSONSerializer *s, const Node *n, void *ctx);
+
+/** The number of keys that the resolver fetched */
+size_t KeyRefResolver_Fetched(const KeyRefResolver *r);
+
+void KeyRefResolver_Free(KeyRefResolver *r);
+
+#endif
@@ -0,0 +1,350 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json_number.h"
+
+/* The two digits of every number in [0, 100) */
+static const char _digits2[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* Writes the digits of u right-aligned before end, returns the first one */
+static char *__num_utoa(uint64_t u, char *end) {
+    char *p = end;
+    while (u >= 100) {
+        const char *d = _digits2 + (u % 100) * 2;
+        u /= 100;
+        *--p = d[1];
+        *--p = d[0];
+    }
+    if (u >= 10) {
+        const char *d = _digits2 + u * 2;
+        *--p = d[1];
+        *--p = d[0];
+    } else {
+        *--p = (char)('0' + u);
+    }
+    return p;
+}
+
+size_t JSON_FormatInt64(int64_t v, char *buf) {
+    char tmp[20];
+    size_t len = 0;
+    uint64_t u = (uint64_t)v;
+
+    if (v < 0) {
+        buf[len++] = '-';
+        u = 0 - u;
+    }
+    char *p = __num_utoa(u, tmp + sizeof(tmp));
+    memcpy(buf + len, p, tmp + sizeof(tmp) - p);
+    return len + (tmp + sizeof(tmp) - p);
+}
+
+/* === Grisu2 ===
+* The double is converted to a "do-it-yourself" floating point number (a 64-bit significand and a
+* binary exponent), and scaled by a cached power of ten into a range where its digits, as well as
+* the boundaries of the interval of numbers that round to it, can be generated with integer math.
+* See Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers", 2010.
+*/
+
+typedef struct {
+    uint64_t f;  // significand
+    int e;       // binary exponent
+} _DiyFp;
+
+#define DP_SIGNIFICAND_BITS 52
+#define DP_EXPONENT_BIAS (0x3FF + DP_SIGNIFICAND_BITS)
+#define DP_HIDDEN_BIT (1ULL << DP_SIGNIFICAND_BITS)
+
+// clang-format off
+/* Normalized significands and binary exponents of 10^-348, 10^-340, ..., 10^340 */
+static const uint64_t _cachedPowersF[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+    0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+    0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+    0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+    0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+    0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+    0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+    0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+    0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+    0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+    0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+    0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+    0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+    0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+    0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+static const int16_t _cachedPowersE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066,
+};
+
+static const uint64_t _pow10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL,
+};
+// clang-format on
+
+static inline _DiyFp __diyfp_mul(_DiyFp x, _DiyFp y) {
+    const uint64_t m32 = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32) + (1ULL << 31);  // rounded
+    _DiyFp r = {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+    return r;
+}
+
+static inline _DiyFp __diyfp_normalize(_DiyFp x) {
+    int s = __builtin_clzll(x.f);
+    x.f <<= s;
+    x.e -= s;
+    return x;
+}
+
+/* Sets the normalized boundaries m- and m+ of the double's rounding interval */
+static void __diyfp_boundaries(_DiyFp v, _DiyFp *mi, _DiyFp *pl) {
+    _DiyFp p = {(v.f << 1) + 1, v.e - 1};
+    p = __diyfp_normalize(p);
+    _DiyFp m;
+    if (v.f == DP_HIDDEN_BIT) {  // the lower boundary is closer for powers of 2
+        m.f = (v.f << 2) - 1;
+        m.e = v.e - 2;
+    } else {
+        m.f = (v.f << 1) - 1;
+        m.e = v.e - 1;
+    }
+    m.f <<= m.e - p.e;
+    m.e = p.e;
+    *mi = m;
+    *pl = p;
+}
+
+/* Returns the cached power of ten 10^-k that brings the binary exponent e into [-60, -32] */
+static _DiyFp __grisu_cachedpower(int e, int *k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;  // positive, so the cast truncates
+    int ik = (int)dk;
+    if (dk - ik > 0.0) ik++;
+    unsigned idx = (unsigned)((ik >> 3) + 1);
+    *k = -(-348 + (int)(idx << 3));
+    _DiyFp c = {_cachedPowersF[idx], _cachedPowersE[idx]};
+    return c;
+}
+
+static inline int __grisu_countdigits(uint32_t n) {
+    int d = 1;
+    while (d < 10 && n >= _pow10[d]) d++;
+    return d;
+}
+
+/* Moves the last digit down while that brings the result closer to the exact value */
+static inline void __grisu_round(char *buf, int len, uint64_t delta, uint64_t rest, uint64_t tenk,
+                                 uint64_t wpw) {
+    while (rest < wpw && delta - rest >= tenk &&
+           (rest + tenk < wpw || wpw - rest > rest + tenk - wpw)) {
+        buf[len - 1]--;
+        rest += tenk;
+    }
+}
+
+/* Generates the digits of W within (Mp - delta, Mp], and adjusts the decimal exponent. They're the
+ * fewest that Grisu2 finds there, which can be one more than the shortest that round trips. */
+static void __grisu_digits(_DiyFp W, _DiyFp Mp, uint64_t delta, char *buf, int *len, int *k) {
+    const int shift = -Mp.e;
+    const uint64_t one = 1ULL << shift;
+    const uint64_t wpw = Mp.f - W.f;
+    uint32_t p1 = (uint32_t)(Mp.f >> shift);
+    uint64_t p2 = Mp.f & (one - 1);
+    int kappa = __grisu_countdigits(p1);
+
+    *len = 0;
+    while (kappa > 0) {  // the integral part
+        uint32_t d = p1 / (uint32_t)_pow10[kappa - 1];
+        p1 %= (uint32_t)_pow10[kappa - 1];
+        if (d || *len) buf[(*len)++] = (char)('0' + d);
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << shift) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            __grisu_round(buf, *len, delta, rest, _pow10[kappa] << shift, wpw);
+            return;
+        }
+    }
+
+    for (;;) {  // the fractional part
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> shift);
+        if (d || *len) buf[(*len)++] = (char)('0' + d);
+        p2 &= one - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            __grisu_round(buf, *len, delta, p2, one, -kappa < 20 ? wpw * _pow10[-kappa] : 0);
+            return;
+        }
+    }
+}
+
+/* Sets the digits of a positive double such that it is digits * 10^k, and returns their count */
+static int __grisu2(double value, char *buf, int *k) {
+    union {
+        double d;
+        uint64_t u;
+    } bits = {.d = value};
+    int be = (int)((bits.u >> DP_SIGNIFICAND_BITS) & 0x7FF);
+    uint64_t sig = bits.u & (DP_HIDDEN_BIT - 1);
+    _DiyFp v;
+    if (be) {
+        v.f = sig + DP_HIDDEN_BIT;
+        v.e = be - DP_EXPONENT_BIAS;
+    } else {  // subnormal
+        v.f = sig;
+        v.e = 1 - DP_EXPONENT_BIAS;
+    }
+
+    _DiyFp mi, pl;
+    __diyfp_boundaries(v, &mi, &pl);
+    _DiyFp c = __grisu_cachedpower(pl.e, k);
+    _DiyFp W = __diyfp_mul(__diyfp_normalize(v), c);
+    _DiyFp Wp = __diyfp_mul(pl, c);
+    _DiyFp Wm = __diyfp_mul(mi, c);
+    Wm.f++;
+    Wp.f--;
+
+    int len;
+    __grisu_digits(W, Wp, Wp.f - Wm.f, buf, &len, k);
+    return len;
+}
+
+/* Writes the exponent part of the exponential notation */
+static size_t __num_exponent(int e, char *buf) {
+    char tmp[4];
+    buf[0] = 'e';
+    buf[1] = e < 0 ? '-' : '+';
+    char *p = __num_utoa((uint64_t)(e < 0 ? -e : e), tmp + sizeof(tmp));
+    memcpy(buf + 2, p, tmp + sizeof(tmp) - p);
+    return 2 + (tmp + sizeof(tmp) - p);
+}
+
+size_t JSON_FormatDouble(double v, char *buf) {
+    size_t len = 0;
+
+    if (v == 0) {
+        if (signbit(v)) buf[len++] = '-';
+        buf[len++] = '0';
+        return len;
+    }
+    if (v < 0) {
+        buf[len++] = '-';
+        v = -v;
+    }
+    if (v < 9007199254740992.0 && v == floor(v))  // below 2^53 every integer is exact
+        return len + JSON_FormatInt64((int64_t)v, buf + len);
+
+    char *d = buf + len;
+    int k;
+    int n = __grisu2(v, d, &k);
+    int kk = n + k;  // the position of the decimal point, 10^(kk-1) <= v < 10^kk
+
+    if (k >= 0 && kk <= 60) {  // an integer, 1234e7 -> 12340000000
+        memset(d + n, '0', k);
+        return len + kk;
+    } else if (kk > 0 && kk <= 21) {  // 1234e-2 -> 12.34
+        memmove(d + kk + 1, d + kk, n - kk);
+        d[kk] = '.';
+        return len + n + 1;
+    } else if (kk > -6 && kk <= 0) {  // 1234e-6 -> 0.001234
+        int offset = 2 - kk;
+        memmove(d + offset, d, n);
+        d[0] = '0';
+        d[1] = '.';
+        memset(d + 2, '0', offset - 2);
+        return len + n + offset;
+    } else if (n == 1) {  // 1e30 -> 1e+30
+        return len + 1 + __num_exponent(kk - 1, d + 1);
+    } else {  // 1234e30 -> 1.234e+33
+        memmove(d + 2, d + 1, n - 1);
+        d[1] = '.';
+        return len + n + 1 + __num_exponent(kk - 1, d + n + 1);
+    }
+}
+
+int JSON_IsNumber(const char *s, size_t len) {
+    const char *q = s, *end = s + len;
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    if (q < end && '-' == *q) q++;
+    if (q == end || !isdigit(*q)) return 0;
+    if ('0' == *q) {
+        q++;
+    } else {
+        while (q < end && isdigit(*q)) q++;
+    }
+    if (q < end && '.' == *q) {
+        if (++q == end || !isdigit(*q)) return 0;
+        while (q < end && isdigit(*q)) q++;
+    }
+    if (q < end && ('e' == *q || 'E' == *q)) {
+        if (++q < end && ('+' == *q || '-' == *q)) q++;
+        if (q == end || !isdigit(*q)) return 0;
+        while (q < end && isdigit(*q)) q++;
+    }
+    return q == end;
+}
+
+/* The longest numbers without an exponent that are in range however they're written */
+#define JSON_NUMBER_SAFE_LEN 300
+
+int JSON_NumberInRange(const char *s, size_t len) {
+    if (len <= JSON_NUMBER_SAFE_LEN && !memchr(s, 'e', len) && !memchr(s, 'E', len)) return 1;
+
+    // the input isn't necessarily NULL terminated
+    char tmp[JSON_NUMBER_SAFE_LEN + 1];
+    char *num = len < sizeof(tmp) ? tmp : malloc(len + 1);
+    memcpy(num, s, len);
+    num[len] = '\0';
+    errno = 0;
+    double value = strtod(num, NULL);
+    if (num != tmp) free(num);
+    // in lieu of "ERR value is not a double or out of range"
+    return !((errno == ERANGE && (value == HUGE_VAL || value == -HUGE_VAL)) ||
+             (errno != 0 && value == 0) || isnan(value));
+}
@@ -0,0 +1,54 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __JSON_NUMBER_H__
+#define __JSON_NUMBER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The size of a buffer that is large enough for any formatted number */
+#define JSON_NUMBER_MAX_LEN 64
+
+/**
+* Formats a 64-bit integer into `buf` (that's at least JSON_NUMBER_MAX_LEN long) and returns the
+* length of the result. The result isn't NULL terminated.
+*/
+size_t JSON_FormatInt64(int64_t v, char *buf);
+
+/**
+* Formats a finite double into `buf` (that's at least JSON_NUMBER_MAX_LEN long) and returns the
+* length of the result. The result isn't NULL terminated.
+* Integral values print as integers, while all others print with a sequence of at most 17 digits
+* that parses back to the same double, in fixed notation when the decimal exponent is between -6 and
+* 21 and in exponential notation otherwise. The digits are those of a Grisu2 conversion, which
+* guarantees the round trip but not the shortest sequence, so a digit more than needed is rarely
+* printed.
+*/
+size_t JSON_FormatDouble(double v, char *buf);
+
+/** Returns 1 if the len bytes at s are exactly a JSON number, 0 otherwise */
+int JSON_IsNumber(const char *s, size_t len);
+
+/**
+* Returns 1 if a valid JSON number converts to a finite double that isn't an underflow to 0, as
+* strtod does, 0 otherwise. Numbers without an exponent are checked without converting them when
+* they are too short to be out of range.
+*/
+int JSON_NumberInRange(const char *s, size_t len);
+
+#endif
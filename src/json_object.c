@@ -15,7 +15,15 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <pthread.h>
 #include "json_object.h"
+#include "json_number.h"
+#include "json_scan.h"
+#include "object_binary.h"
+#include "stats.h"
+
+int JSONObjectMaxLevels = JSONSL_MAX_LEVELS;
+int JSONObjectNumberText = 1;
 
 /* === Parser === */
 /* A custom context for the JSON lexer. */
@@ -24,6 +32,15 @@ typedef struct {
     size_t errpos;       // error position
     Node **nodes;        // stack of created nodes
     int nlen;            // size of node stack
+    const char *buf;     // the input, where the lexer's positions start from bufpos
+    size_t bufpos;
+    const JSONSchema *schema;  // the schema that the value is validated against, if any
+    int *rules;                // the schema's rule of the value at every level of the lexer
+    int cap;                   // the levels that the lexer, nodes and rules have room for
+    int wrapped;               // set when the value is a scalar in a wrapper list
+    Node *scalar;              // the wrapped scalar, which is kept out of the list
+    int hasscalar;             // set once the scalar is parsed
+    const char *why;           // the reason that the value doesn't match the schema
 } JsonObjectContext;
 
 #define _pushNode(ctx, n) ctx->nodes[ctx->nlen++] = n
@@ -42,67 +59,218 @@ inline static int errorCallback(jsonsl_t jsn, jsonsl_error_t err, struct jsonsl_
     return 0;
 }
 
+/* Stops the lexer at a value that doesn't match the schema */
+static void _schemaError(jsonsl_t jsn, struct jsonsl_state_st *state, const char *why) {
+    JsonObjectContext *joctx = (JsonObjectContext *)jsn->data;
+    joctx->why = why;
+    errorCallback(jsn, JSONSL_ERROR_GENERIC, state, NULL);
+}
+
+/**
+* Finds the schema's rule of a value that's pushed: the root's, or the rule of a member or an item of
+* its container's. A member's key is at the top of the node stack by then. Returns 0 and stops the
+* lexer if the container can't have the member.
+*/
+static int _schemaPush(jsonsl_t jsn, JsonObjectContext *joctx, struct jsonsl_state_st *state) {
+    int rule, level = state->level;
+    const char *why;
+
+    if (1 == level) {
+        rule = joctx->wrapped ? JSONSCHEMA_ANY : JSONSCHEMA_ROOT;
+    } else if (2 == level && joctx->wrapped) {
+        rule = JSONSCHEMA_ROOT;
+    } else if (JSONSL_T_OBJECT == jsn->stack[level - 1].type) {
+        const char *key = joctx->nodes[joctx->nlen - 1]->value.kvval.key;
+        if (OBJ_OK != JSONSchema_Member(joctx->schema, joctx->rules[level - 1], key, &rule, &why)) {
+            _schemaError(jsn, state, why);
+            return 0;
+        }
+    } else {
+        rule = JSONSchema_Items(joctx->schema, joctx->rules[level - 1]);
+    }
+    joctx->rules[level] = rule;
+
+    if ((JSONSL_T_OBJECT == state->type || JSONSL_T_LIST == state->type) &&
+        OBJ_OK != JSONSchema_CheckOpen(joctx->schema, rule,
+                                       JSONSL_T_OBJECT == state->type ? N_DICT : N_ARRAY, &why)) {
+        _schemaError(jsn, state, why);
+        return 0;
+    }
+    return 1;
+}
+
+/* The schema's rule of the value that's popped, JSONSCHEMA_ANY when there's no schema */
+#define _schemaRule(joctx, state) \
+    ((joctx)->schema ? (joctx)->rules[(state)->level] : JSONSCHEMA_ANY)
+
 inline static void pushCallback(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *state,
                   const jsonsl_char_t *at) {
     JsonObjectContext *joctx = (JsonObjectContext *)jsn->data;
+    uint32_t cap = 1;
+
+    // with a schema, containers are created with room for the entries that it guarantees
+    if (joctx->schema && JSONSL_T_HKEY != state->type) {
+        if (!_schemaPush(jsn, joctx, state)) return;
+        cap = MAX(cap, JSONSchema_Hint(joctx->schema, joctx->rules[state->level]));
+    }
 
     // only objects (dictionaries) and lists (arrays) create a container on push
     switch (state->type) {
         case JSONSL_T_OBJECT:
-            _pushNode(joctx, NewDictNode(1));
+            _pushNode(joctx, NewDictNode(cap));
             break;
         case JSONSL_T_LIST:
-            _pushNode(joctx, NewArrayNode(1));
+            _pushNode(joctx, NewArrayNode(cap));
             break;
         default:
             break;
     }
 }
 
+/**
+* Unescapes a string like jsonsl_util_unescape does, and returns the unescaped length or 0 on error.
+* Instead of going over every character, the runs between the escapes are found with memchr and
+* copied at once, and jsonsl only decodes the escape sequences. Consecutive unicode escapes are
+* decoded together so surrogate pairs are kept intact.
+*/
+static size_t _unescapeString(const char *in, char *out, size_t len, jsonsl_error_t *err) {
+    const char *p = in, *end = in + len;
+    char *o = out;
+
+    while (p < end) {
+        const char *esc = memchr(p, '\\', end - p);
+        if (!esc) esc = end;
+        memcpy(o, p, esc - p);
+        o += esc - p;
+        if (esc == end) break;
+
+        // the length of the sequence, where only unicode escapes are longer than two characters
+        size_t seqlen = 2;
+        if (esc + 1 < end && 'u' == esc[1]) {
+            seqlen = 0;
+            do {
+                seqlen += 6;
+            } while (esc + seqlen + 1 < end && '\\' == esc[seqlen] && 'u' == esc[seqlen + 1]);
+        }
+        if (esc + seqlen > end) seqlen = end - esc;  // let jsonsl report the short sequence
+
+        size_t n = jsonsl_util_unescape(esc, o, seqlen, _AllowedEscapes, err);
+        if (!n) return 0;
+        o += n;
+        p = esc + seqlen;
+    }
+
+    *err = JSONSL_ERROR_SUCCESS;
+    return o - out;
+}
+
+/* Strings with escapes up to this length are unescaped on the stack, longer ones into their node */
+#define JSONOBJECT_UNESCAPE_STACK 256
+
+/**
+* Creates the node of a string with escapes, or the keyval node of a key. Long strings that won't be
+* compressed are unescaped right into their node's data, which is at most the escaped length, and
+* the others are unescaped on the stack or into a temporary buffer first. Returns NULL with err set
+* if an escape is invalid.
+*/
+static Node *_newUnescapedNode(const char *s, size_t len, int key, jsonsl_error_t *err) {
+    char stackbuf[JSONOBJECT_UNESCAPE_STACK], *buf = stackbuf;
+    size_t newlen;
+    Node *n;
+
+    if (!key && len > JSONOBJECT_UNESCAPE_STACK &&
+        (!NodeStringCompressSize || len < NodeStringCompressSize)) {
+        n = NewStringNodeBuffer(len, &buf);
+        newlen = _unescapeString(s, buf, len, err);
+        if (!newlen) {
+            Node_Free(n);
+            return NULL;
+        }
+        Node_StringSetLength(n, newlen);
+        return n;
+    }
+
+    if (len > sizeof(stackbuf)) buf = malloc(len);
+    newlen = _unescapeString(s, buf, len, err);
+    if (!newlen) n = NULL;
+    else if (key) n = NewKeyValNode(buf, newlen, NULL);  // NULL is a placeholder for now
+    else n = NewStringNode(buf, newlen);
+    if (buf != stackbuf) free(buf);
+    return n;
+}
+
 inline static void popCallback(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *state,
                  const jsonsl_char_t *at) {
     JsonObjectContext *joctx = (JsonObjectContext *)jsn->data;
-    const char *pos = jsn->base + state->pos_begin;  // element starting position
+    const char *pos = joctx->buf + (state->pos_begin - joctx->bufpos);  // element starting position
     size_t len = state->pos_cur - state->pos_begin;  // element length
+    int rule = _schemaRule(joctx, state);
+    const char *why;
 
     // popping string and key values means addingg them to the node stack
     if (JSONSL_T_STRING == state->type || JSONSL_T_HKEY == state->type) {
-        char *buffer = NULL;  // a temporary buffer for unescaped strings
-
         // ignore the quote marks
         pos++;
         len--;
 
-        // deal with escapes
+        // push it, strings with escapes are unescaped as their nodes are created
+        Node *n;
+        int string = JSONSL_T_STRING == state->type;
+        if (string && JSONSCHEMA_ANY != rule && !state->nescapes &&
+            OBJ_OK != JSONSchema_CheckString(joctx->schema, rule, pos, len, &why)) {
+            _schemaError(jsn, state, why);
+            return;
+        }
         if (state->nescapes) {
             jsonsl_error_t err;
-            size_t newlen;
-
-            buffer = calloc(len, sizeof(char));
-            newlen = jsonsl_util_unescape(pos, buffer, len, _AllowedEscapes, &err);
-            if (!newlen) {
-                free(buffer);
+            n = _newUnescapedNode(pos, len, !string, &err);
+            if (!n) {
                 errorCallback(jsn, err, state, NULL);
                 return;
             }
-
-            pos = buffer;
-            len = newlen;
+        } else if (string) {
+            n = NewStringNode(pos, len);
+        } else {
+            n = NewKeyValNode(pos, len, NULL);  // NULL is a placeholder for now
         }
-
-        // push it
-        Node *n;
-        if (JSONSL_T_STRING == state->type) n = NewStringNode(pos, len);
-        else n = NewKeyValNode(pos, len, NULL);  // NULL is a placeholder for now
         _pushNode(joctx, n);
 
-        if (buffer) free(buffer);
+        // unescaped strings are checked once they are, the node is freed with the stack
+        if (string && JSONSCHEMA_ANY != rule && state->nescapes) {
+            char *tmp;
+            const char *data = Node_StringData(n, &tmp);
+            int ret = JSONSchema_CheckString(joctx->schema, rule, data, n->value.strval.len, &why);
+            if (tmp) free(tmp);
+            if (OBJ_OK != ret) {
+                _schemaError(jsn, state, why);
+                return;
+            }
+        }
     }
 
     // popped special values are also added to the node stack
     if (JSONSL_T_SPECIAL == state->type) {
         if (state->special_flags & JSONSL_SPECIALf_NUMERIC) {
-            if (state->special_flags & (JSONSL_SPECIALf_FLOAT | JSONSL_SPECIALf_EXPONENT)) {
+            // a wrapped scalar is a root rather than an array's item
+            int real = state->special_flags & (JSONSL_SPECIALf_FLOAT | JSONSL_SPECIALf_EXPONENT);
+            int parray = joctx->nlen && N_ARRAY == joctx->nodes[joctx->nlen - 1]->type &&
+                         !(joctx->wrapped && 1 == joctx->nlen);
+
+            // members and roots keep their text, converting it only when a schema checks it
+            if (real && JSONObjectNumberText && !parray && JSON_IsNumber(pos, len)) {
+                if (!JSON_NumberInRange(pos, len)) {
+                    errorCallback(jsn, JSONSL_ERROR_INVALID_NUMBER, state, NULL);
+                    return;
+                }
+                Node *n = NewNumberTextNode(pos, len);
+                if (JSONSCHEMA_ANY != rule &&
+                    OBJ_OK != JSONSchema_CheckDouble(joctx->schema, rule, Node_Number(n), &why)) {
+                    Node_Free(n);
+                    _schemaError(jsn, state, why);
+                    return;
+                }
+                _pushNode(joctx, n);
+            } else if (real) {
                 // convert to double
                 double value;
                 char *eptr;
@@ -117,6 +285,16 @@ inline static void popCallback(jsonsl_t jsn, jsonsl_action_t action, struct json
                         errorCallback(jsn, JSONSL_ERROR_INVALID_NUMBER, state, NULL);
                         return;
                 }
+                if (JSONSCHEMA_ANY != rule &&
+                    OBJ_OK != JSONSchema_CheckDouble(joctx->schema, rule, value, &why)) {
+                    _schemaError(jsn, state, why);
+                    return;
+                }
+                // numbers in arrays are appended as values, that's what packed arrays are made of
+                if (parray) {
+                    Node_ArrayAppendDouble(joctx->nodes[joctx->nlen - 1], value);
+                    return;
+                }
                 _pushNode(joctx, NewDoubleNode(value));
             } else {
                 // convert long long (int64_t)
@@ -132,39 +310,239 @@ inline static void popCallback(jsonsl_t jsn, jsonsl_action_t action, struct json
                         errorCallback(jsn, JSONSL_ERROR_INVALID_NUMBER, state, NULL);
                         return;
                 }
+                if (JSONSCHEMA_ANY != rule &&
+                    OBJ_OK != JSONSchema_CheckInt(joctx->schema, rule, value, &why)) {
+                    _schemaError(jsn, state, why);
+                    return;
+                }
 
+                if (parray) {
+                    Node_ArrayAppendInt(joctx->nodes[joctx->nlen - 1], (int64_t)value);
+                    return;
+                }
                 _pushNode(joctx, NewIntNode((int64_t)value));
             }
         } else if (state->special_flags & JSONSL_SPECIALf_BOOLEAN) {
-            _pushNode(joctx, NewBoolNode(state->special_flags & JSONSL_SPECIALf_TRUE));
+            int value = !!(state->special_flags & JSONSL_SPECIALf_TRUE);
+            if (JSONSCHEMA_ANY != rule &&
+                OBJ_OK != JSONSchema_CheckBool(joctx->schema, rule, value, &why)) {
+                _schemaError(jsn, state, why);
+                return;
+            }
+            _pushNode(joctx, NewBoolNode(value));
         } else if (state->special_flags & JSONSL_SPECIALf_NULL) {
+            if (JSONSCHEMA_ANY != rule && OBJ_OK != JSONSchema_CheckNull(joctx->schema, rule, &why)) {
+                _schemaError(jsn, state, why);
+                return;
+            }
             _pushNode(joctx, NULL);
         }
     }
 
+    // containers are checked for their entries as they close
+    if ((JSONSL_T_OBJECT == state->type || JSONSL_T_LIST == state->type) &&
+        JSONSCHEMA_ANY != rule &&
+        OBJ_OK != JSONSchema_CheckClose(joctx->schema, rule, joctx->nodes[joctx->nlen - 1], &why)) {
+        _schemaError(jsn, state, why);
+        return;
+    }
+
     // anything that pops needs to be set in its parent, except the root element and keys
     if (joctx->nlen > 1 && state->type != JSONSL_T_HKEY) {
         NodeType p = joctx->nodes[joctx->nlen - 2]->type;
+        // pop before indexing the stack, the evaluation order of operands is unspecified
+        Node *n = _popNode(joctx);
         switch (p) {
             case N_DICT:
-                Node_DictSetKeyVal(joctx->nodes[joctx->nlen - 1], _popNode(joctx));
+                Node_DictSetKeyVal(joctx->nodes[joctx->nlen - 1], n);
                 break;
             case N_ARRAY:
-                Node_ArrayAppend(joctx->nodes[joctx->nlen - 1], _popNode(joctx));
-                break;
-            case N_KEYVAL:
-                joctx->nodes[joctx->nlen - 2]->value.kvval.val = _popNode(joctx);
-                Node_DictSetKeyVal(joctx->nodes[joctx->nlen - 1], _popNode(joctx));
+                // a wrapped scalar is kept aside, so that its list doesn't pack a number's text
+                if (joctx->wrapped && 1 == joctx->nlen && !joctx->hasscalar) {
+                    joctx->scalar = n;
+                    joctx->hasscalar = 1;
+                    break;
+                }
+                Node_ArrayAppend(joctx->nodes[joctx->nlen - 1], n);
                 break;
+            case N_KEYVAL: {
+                Node *kv = _popNode(joctx);
+                kv->value.kvval.val = n;
+                Node_DictSetKeyVal(joctx->nodes[joctx->nlen - 1], kv);
+            } break;
             default:
                 break;
         }
     }
 }
 
-int CreateNodeFromJSON(const char *buf, size_t len, Node **node, char **err) {
-    int levels = JSONSL_MAX_LEVELS;  // TODO: heur levels from len since we're not really streaming?
+/* === Lexer pool ===
+* The lexers are kept between parses, a few for every thread, with their node and rule stacks. A
+* lexer is taken for as many levels as its input can reach: every level starts at a byte of its own,
+* so a value of len bytes takes at most len + 2 levels, and small values take a pooled lexer without
+* allocating. A lexer that's too small for an input is grown, and it's reset when it's taken.
+*/
+
+/* The lexers that a thread keeps */
+#define JSONOBJECT_POOL_SIZE 4
+
+/* The fewest levels that a lexer is allocated with */
+#define JSONOBJECT_POOL_MIN_LEVELS 32
+
+typedef struct {
+    jsonsl_t jsn;
+    Node **nodes;
+    int *rules;
+    int cap;
+} _PooledLexer;
+
+typedef struct {
+    _PooledLexer lexers[JSONOBJECT_POOL_SIZE];
+    int len;
+} _LexerPool;
+
+static pthread_key_t _poolKey;
+static pthread_once_t _poolOnce = PTHREAD_ONCE_INIT;
+static __thread _LexerPool *_pool = NULL;
+
+static void _poolFree(void *ptr) {
+    _LexerPool *pool = ptr;
+    for (int i = 0; i < pool->len; i++) {
+        jsonsl_destroy(pool->lexers[i].jsn);
+        free(pool->lexers[i].nodes);
+        free(pool->lexers[i].rules);
+    }
+    free(pool);
+}
+
+static void _poolInit(void) {
+    pthread_key_create(&_poolKey, _poolFree);
+}
+
+/* The thread's pool, which is freed when the thread exits */
+static _LexerPool *_threadPool(void) {
+    if (!_pool) {
+        pthread_once(&_poolOnce, _poolInit);
+        _pool = calloc(1, sizeof(_LexerPool));
+        pthread_setspecific(_poolKey, _pool);
+    }
+    return _pool;
+}
+
+/* Sets up a lexer that builds the nodes of a value of len bytes, SIZE_MAX if unknown, in a context */
+static jsonsl_t _jsonslNew(JsonObjectContext *joctx, size_t len) {
+    int levels = MAX(MIN(JSONObjectMaxLevels, JSONSL_MAX_LEVELS), 1);
+    if (len < (size_t)levels - 2) levels = len + 2;
+
+    /* Take the smallest pooled lexer that's big enough, or else the biggest one, which is grown. */
+    _LexerPool *pool = _threadPool();
+    _PooledLexer pl = {0};
+    int best = -1;
+    for (int i = 0; i < pool->len; i++) {
+        int cap = pool->lexers[i].cap, bestcap = best < 0 ? 0 : pool->lexers[best].cap;
+        if (best < 0 || (cap >= levels ? bestcap < levels || cap < bestcap : cap > bestcap))
+            best = i;
+    }
+    if (best >= 0) {
+        pl = pool->lexers[best];
+        pool->lexers[best] = pool->lexers[--pool->len];
+    }
+    if (pl.cap < levels) {
+        jsonsl_destroy(pl.jsn);
+        pl.cap = MIN(MAX(levels, JSONOBJECT_POOL_MIN_LEVELS), JSONSL_MAX_LEVELS);
+        pl.jsn = jsonsl_new(pl.cap);
+        pl.jsn->error_callback = errorCallback;
+        pl.jsn->action_callback_POP = popCallback;
+        pl.jsn->action_callback_PUSH = pushCallback;
+        jsonsl_enable_all_callbacks(pl.jsn);
+        pl.nodes = realloc(pl.nodes, pl.cap * sizeof(Node *));
+        pl.rules = realloc(pl.rules, pl.cap * sizeof(int));
+    }
+
+    /* Reset the lexer, whose root state keeps the last value's count, to the input's levels. */
+    jsonsl_t jsn = pl.jsn;
+    jsonsl_reset(jsn);
+    memset(&jsn->stack[0], 0, sizeof(jsn->stack[0]));
+    jsn->levels_max = levels;
+
+    /* Set up our custom context. */
+    joctx->nodes = pl.nodes;
+    joctx->rules = pl.rules;
+    joctx->cap = pl.cap;
+    jsn->data = joctx;
+    return jsn;
+}
+
+/* Checks that the lexer has found a complete value, and returns the error string if it hasn't */
+static sds _jsonslCheck(jsonsl_t jsn, JsonObjectContext *joctx) {
+    /* Check for schema violations, and then for lexer errors. */
+    if (joctx->why) {
+        return sdscatprintf(sdsempty(), "ERR JSON value doesn't match the schema at position %zd: %s",
+                            joctx->errpos + 1, joctx->why);
+    }
+    if (JSONSL_ERROR_SUCCESS != joctx->err) {
+        return sdscatprintf(sdsempty(), "ERR JSON lexer error %s at position %zd",
+                            jsonsl_strerror(joctx->err), joctx->errpos + 1);
+    }
+
+    /* Verify that parsing had ended at level 0. */
+    if (jsn->level) {
+        return sdscatprintf(sdsempty(), "ERR JSON value incomplete - %u containers unterminated",
+                            jsn->level);
+    }
+
+    /* Verify that an element. */
+    if (!jsn->stack[0].nelem) return sdsnew("ERR JSON value not found");
+    return NULL;
+}
+
+/* Takes the parsed value, which is a scalar in a wrapper array if is_scalar is set */
+static Node *_jsonslTake(JsonObjectContext *joctx, int is_scalar) {
+    Node *node;
+    if (is_scalar) {
+        // take the scalar and discard the wrapper array
+        node = joctx->scalar;
+        joctx->scalar = NULL;
+        Node_Free(_popNode(joctx));
+    } else {
+        node = _popNode(joctx);
+    }
+    return node;
+}
 
+/* Frees the nodes that are in the context's stack, and puts the lexer back in the thread's pool */
+static void _jsonslFree(jsonsl_t jsn, JsonObjectContext *joctx) {
+    while (joctx->nlen) Node_Free(_popNode(joctx));
+    Node_Free(joctx->scalar);
+
+    // a lexer that stopped inside a value keeps the states of its levels, which are cleared
+    if (jsn->level || JSONSL_ERROR_SUCCESS != joctx->err) {
+        memset(jsn->stack, 0, joctx->cap * sizeof(jsn->stack[0]));
+        for (int i = 0; i < joctx->cap; i++) jsn->stack[i].level = i;
+    }
+
+    _LexerPool *pool = _threadPool();
+    if (pool->len < JSONOBJECT_POOL_SIZE) {
+        pool->lexers[pool->len++] = (_PooledLexer){
+            .jsn = jsn, .nodes = joctx->nodes, .rules = joctx->rules, .cap = joctx->cap};
+    } else {
+        free(joctx->nodes);
+        free(joctx->rules);
+        jsonsl_destroy(jsn);
+    }
+}
+
+/* Sets the optional error string, and frees it */
+static void _jsonslSetError(sds serr, char **err) {
+    if (err) *err = strdup(serr);
+    sdsfree(serr);
+}
+
+/* The longest scalars, with their wrapper list, that are copied on the stack rather than the heap */
+#define JSONOBJECT_SMALL_SCALAR 256
+
+static int _jsonslCreateNode(const char *buf, size_t len, const JSONSchema *schema, Node **node,
+                             char **err) {
     size_t _off = 0, _len = len;
     char *_buf = (char *)buf;
     int is_scalar = 0;
@@ -176,190 +554,939 @@ int CreateNodeFromJSON(const char *buf, size_t len, Node **node, char **err) {
      * Copying is necc. evil to avoid messing w/ non-standard string implementations (e.g. sds), but
      * forgivable because most scalars are supposed to be short-ish.
     */
+    char small[JSONOBJECT_SMALL_SCALAR];
     if ((is_scalar = ('{' != _buf[_off]) && ('[' != _buf[_off]) && _off < _len)) {
         _len = _len - _off + 2;
-        _buf = malloc(_len * sizeof(char));
+        _buf = _len <= sizeof(small) ? small : malloc(_len * sizeof(char));
         _buf[0] = '[';
         _buf[_len - 1] = ']';
         memcpy(&_buf[1], &buf[_off], len - _off);
     }
 
-    /* The lexer. */
-    jsonsl_t jsn = jsonsl_new(levels);
-    jsn->error_callback = errorCallback;
-    jsn->action_callback_POP = popCallback;
-    jsn->action_callback_PUSH = pushCallback;
-    jsonsl_enable_all_callbacks(jsn);
-
-    /* Set up our custom context. */
-    JsonObjectContext *joctx = calloc(1, sizeof(JsonObjectContext));
-    joctx->nodes = calloc(levels, sizeof(Node *));
-    jsn->data = joctx;
+    JsonObjectContext joctx = {.buf = _buf, .schema = schema, .wrapped = is_scalar};
+    jsonsl_t jsn = _jsonslNew(&joctx, _len);
 
     /* Feed the lexer. */
     jsonsl_feed(jsn, _buf, _len);
 
-    /* Check for lexer errors. */
-    sds serr = sdsempty();
-    if (JSONSL_ERROR_SUCCESS != joctx->err) {
-        serr = sdscatprintf(serr, "ERR JSON lexer error %s at position %zd",
-                            jsonsl_strerror(joctx->err), joctx->errpos + 1);
-        goto error;
+    sds serr = _jsonslCheck(jsn, &joctx);
+    if (serr) {
+        _jsonslSetError(serr, err);
+        _jsonslFree(jsn, &joctx);
+        if (_buf != buf && _buf != small) free(_buf);
+        return JSONOBJECT_ERROR;
     }
 
-    /* Verify that parsing had ended at level 0. */
-    if (jsn->level) {
-        serr = sdscatprintf(serr, "ERR JSON value incomplete - %u containers unterminated",
-                            jsn->level);
-        goto error;
+    /* Finalize. */
+    *node = _jsonslTake(&joctx, is_scalar);
+    _jsonslFree(jsn, &joctx);
+    if (_buf != buf && _buf != small) free(_buf);
+    return JSONOBJECT_OK;
+}
+
+/* === Chunked parser ===
+* The chunks are fed to a jsonsl lexer that is kept between them, and its positions are relative to
+* the start of the value. Only the bytes of a string or number that hasn't ended are kept from one
+* chunk to the next, as the nodes are made when the lexer pops their values.
+*/
+
+struct JSONChunkParser {
+    jsonsl_t jsn;
+    JsonObjectContext ctx;
+    sds pending;    // the bytes from ctx.bufpos on
+    int started;    // set once the value's first character was seen
+    int is_scalar;  // set when the value is a scalar that's embedded in a list
+    int failed;
+    size_t fed;     // the number of bytes that were fed
+};
+
+JSONChunkParser *NewJSONChunkParser(void) {
+    JSONChunkParser *p = calloc(1, sizeof(JSONChunkParser));
+    p->jsn = _jsonslNew(&p->ctx, SIZE_MAX);
+    p->pending = sdsempty();
+    return p;
+}
+
+/* Feeds bytes to the lexer, and drops the pending bytes that no value needs anymore */
+static int _chunkFeed(JSONChunkParser *p, const char *buf, size_t len, char **err) {
+    jsonsl_t jsn = p->jsn;
+    size_t from = jsn->pos - p->ctx.bufpos;
+
+    p->pending = sdscatlen(p->pending, buf, len);
+    p->ctx.buf = p->pending;
+    jsonsl_feed(jsn, p->pending + from, sdslen(p->pending) - from);
+    if (JSONSL_ERROR_SUCCESS != p->ctx.err) {
+        _jsonslSetError(_jsonslCheck(jsn, &p->ctx), err);
+        p->failed = 1;
+        return JSONOBJECT_ERROR;
     }
 
-    /* Verify that an element. */
-    if (!jsn->stack[0].nelem) {
-        serr = sdscatprintf(serr, "ERR JSON value not found");
-        goto error;
+    struct jsonsl_state_st *state = jsn->stack + jsn->level;
+    size_t keep = JSONSL_T_STRING == state->type || JSONSL_T_HKEY == state->type ||
+                          JSONSL_T_SPECIAL == state->type
+                      ? state->pos_begin
+                      : jsn->pos;
+    sdsrange(p->pending, keep - p->ctx.bufpos, -1);
+    p->ctx.bufpos = keep;
+    return JSONOBJECT_OK;
+}
+
+int JSONChunkParser_Feed(JSONChunkParser *p, const char *buf, size_t len, char **err) {
+    if (p->failed) return JSONOBJECT_ERROR;
+    p->fed += len;
+
+    // munch any leading whitespaces, and embed a scalar in a list like CreateNodeFromJSON
+    if (!p->started) {
+        while (len && _IsAllowedWhitespace(*buf)) {
+            buf++;
+            len--;
+        }
+        if (!len) return JSONOBJECT_OK;
+        p->started = 1;
+        p->is_scalar = p->ctx.wrapped = '{' != *buf && '[' != *buf;
+        if (p->is_scalar && JSONOBJECT_OK != _chunkFeed(p, "[", 1, err)) return JSONOBJECT_ERROR;
     }
+    return _chunkFeed(p, buf, len, err);
+}
 
-    /* Finalize. */
-    if (is_scalar) {
-        // extract the scalar and discard the wrapper array
-        Node_ArrayItem(joctx->nodes[0], 0, node);
-        Node_ArraySet(joctx->nodes[0], 0, NULL);
-        Node_Free(_popNode(joctx));
-        free(_buf);
+int JSONChunkParser_Finish(JSONChunkParser *p, Node **node, char **err) {
+    if (p->failed) return JSONOBJECT_ERROR;
+    p->failed = 1;  // the value is taken once
+    if (p->is_scalar && JSONOBJECT_OK != _chunkFeed(p, "]", 1, err)) return JSONOBJECT_ERROR;
+
+    sds serr = _jsonslCheck(p->jsn, &p->ctx);
+    if (serr) {
+        _jsonslSetError(serr, err);
+        return JSONOBJECT_ERROR;
+    }
+    *node = _jsonslTake(&p->ctx, p->is_scalar);
+    return JSONOBJECT_OK;
+}
+
+size_t JSONChunkParser_Length(const JSONChunkParser *p) { return p->fed; }
+
+void JSONChunkParser_Free(JSONChunkParser *p) {
+    _jsonslFree(p->jsn, &p->ctx);
+    sdsfree(p->pending);
+    free(p);
+}
+
+/* === Direct parser ===
+* The direct parser builds the tree in a single pass without jsonsl. The values of the containers
+* that are being parsed wait on stacks, and every container is created when it ends. So arrays get
+* their exact capacity, numbers are stored raw in packed arrays, and dictionaries are created with
+* NewDictNodeFromKeyVals instead of looking up every key as it is added.
+*/
+
+/* The kinds of values on the array stack, numbers are kept raw until their array is created */
+#define _DP_NODE 0
+#define _DP_INT 1
+#define _DP_DOUBLE 2
+
+typedef struct {
+    union {
+        Node *node;
+        int64_t intval;
+        double numval;
+    } v;
+    int kind;
+} _DPValue;
+
+typedef struct {
+    uint32_t start;  // the position of the container's first value on its stack
+    int isdict;      // dictionaries keep keyval nodes on the keyval stack, arrays use the value stack
+    int kinds;       // a bit for every kind of value in an array
+} _DPFrame;
+
+typedef struct {
+    const char *buf, *p, *end;      // the input and the current position in it
+    jsonsl_error_t err;             // the error, reported with jsonsl's codes
+    const char *errat;              // the error's position
+    int incomplete;                 // set when the input ended too early, to 2 if in a string
+    _DPValue *vals;                 // the stack of values of open arrays
+    uint32_t nvals, capvals;
+    Node **kvs;                     // the stack of keyval nodes of open dictionaries
+    uint32_t nkvs, capkvs;
+    _DPFrame frames[JSONSL_MAX_LEVELS];  // the open containers
+    int depth;
+    char *scratch;                  // a buffer for unescaping strings and copying numbers
+    size_t capscratch;
+    int scan;                       // set to only check the input, without building nodes
+    sds *compact;                   // the input without its whitespace, when scanning with it
+    const char *mark;               // the beginning of the input that's not in compact yet
+} _DirectParser;
+
+#define _DP_FAIL(dp, e, at)           \
+    {                                 \
+        (dp)->err = JSONSL_ERROR_##e; \
+        (dp)->errat = (at);           \
+        return 0;                     \
+    }
+
+static inline void __dp_skipws(_DirectParser *dp) {
+    const char *start = dp->p;
+    while (dp->p < dp->end &&
+           (' ' == *dp->p || '\n' == *dp->p || '\r' == *dp->p || '\t' == *dp->p))
+        dp->p++;
+    if (dp->compact && dp->p != start) {
+        *dp->compact = sdscatlen(*dp->compact, dp->mark, start - dp->mark);
+        dp->mark = dp->p;
+    }
+}
+
+static char *__dp_scratch(_DirectParser *dp, size_t len) {
+    if (dp->capscratch < len) {
+        dp->capscratch = len > dp->capscratch * 2 ? len : dp->capscratch * 2;
+        dp->scratch = realloc(dp->scratch, dp->capscratch);
+    }
+    return dp->scratch;
+}
+
+/* Returns the node of a value, creating it for a raw number */
+static inline Node *__dp_node(const _DPValue *v) {
+    switch (v->kind) {
+        case _DP_INT:
+            return NewIntNode(v->v.intval);
+        case _DP_DOUBLE:
+            return NewDoubleNode(v->v.numval);
+        default:
+            return v->v.node;
+    }
+}
+
+/**
+* Parses the string at the current position and sets its unescaped contents, returns 0 on error. With
+* node set, a string with escapes gets its node instead, which it's unescaped into.
+*/
+static int __dp_string(_DirectParser *dp, const char **s, uint32_t *len, Node **node) {
+    const char *start = dp->p + 1, *q = start;
+    int escaped = 0;
+
+    for (;;) {
+        q = JSON_ScanString(q, dp->end);
+        if (q == dp->end) {
+            dp->incomplete = 2;
+            return 0;
+        }
+        if ('"' == *q) break;
+        if ('\\' != *q) _DP_FAIL(dp, WEIRD_WHITESPACE, q);  // a raw control character
+        escaped = 1;
+        q = dp->end - q > 2 ? q + 2 : dp->end;  // skip the escaped character, that may be a quote
+    }
+    dp->p = q + 1;
+
+    if (!escaped) {
+        *s = start;
+        *len = q - start;
+        return 1;
+    }
+    if (node) {
+        *node = _newUnescapedNode(start, q - start, 0, &dp->err);
+        if (!*node) dp->errat = start;
+        return *node != NULL;
+    }
+    char *buf = __dp_scratch(dp, q - start);
+    size_t n = _unescapeString(start, buf, q - start, &dp->err);
+    if (!n) {
+        dp->errat = start;
+        return 0;
+    }
+    *s = buf;
+    *len = n;
+    return 1;
+}
+
+/**
+* Parses the number at s into a raw value, returns the number's end or NULL if it's invalid. With
+* astext, a number with a fraction or an exponent is a node that keeps its text instead.
+*/
+static const char *__json_number(const char *s, const char *end, _DPValue *v, int astext) {
+    const char *q = s;
+    int isfloat = 0;
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    if ('-' == *q) q++;
+    if (q == end || !isdigit(*q)) return NULL;
+    if ('0' == *q) {
+        q++;
     } else {
-        *node = _popNode(joctx);
+        while (q < end && isdigit(*q)) q++;
+    }
+    if (q < end && '.' == *q) {
+        isfloat = 1;
+        if (++q == end || !isdigit(*q)) return NULL;
+        while (q < end && isdigit(*q)) q++;
     }
+    if (q < end && ('e' == *q || 'E' == *q)) {
+        isfloat = 1;
+        if (++q < end && ('+' == *q || '-' == *q)) q++;
+        if (q == end || !isdigit(*q)) return NULL;
+        while (q < end && isdigit(*q)) q++;
+    }
+    // e.g. leading zeros, hex or a second fraction
+    if (q < end && (isalnum(*q) || '.' == *q || '-' == *q || '+' == *q)) return NULL;
 
-    sdsfree(serr);
-    free(joctx->nodes);
-    free(joctx);
-    jsonsl_destroy(jsn);
+    size_t len = q - s;
+    if (!isfloat && len <= 18) {  // that many characters can't overflow
+        int64_t val = 0;
+        for (const char *d = '-' == *s ? s + 1 : s; d < q; d++) val = val * 10 + (*d - '0');
+        v->kind = _DP_INT;
+        v->v.intval = '-' == *s ? -val : val;
+        return q;
+    }
+    if (isfloat && astext) {
+        if (!JSON_NumberInRange(s, len)) return NULL;
+        v->kind = _DP_NODE;
+        v->v.node = NewNumberTextNode(s, len);
+        return q;
+    }
 
-    return JSONOBJECT_OK;
+    // the input isn't necessarily NULL terminated
+    char tmp[64];
+    char *num = len < sizeof(tmp) ? tmp : malloc(len + 1);
+    char *eptr;
+    int valid;
+    memcpy(num, s, len);
+    num[len] = '\0';
+    errno = 0;
+    if (isfloat) {
+        double value = strtod(num, &eptr);
+        // in lieu of "ERR value is not a double or out of range"
+        valid = !((errno == ERANGE && (value == HUGE_VAL || value == -HUGE_VAL)) ||
+                  (errno != 0 && value == 0) || isnan(value) || (eptr != num + len));
+        v->kind = _DP_DOUBLE;
+        v->v.numval = value;
+    } else {
+        long long value = strtoll(num, &eptr, 10);
+        // in lieu of "ERR value is not an integer or out of range"
+        valid = !((errno == ERANGE && (value == LLONG_MAX || value == LLONG_MIN)) ||
+                  (errno != 0 && value == 0) || (eptr != num + len));
+        v->kind = _DP_INT;
+        v->v.intval = (int64_t)value;
+    }
+    if (num != tmp) free(num);
+    return valid ? q : NULL;
+}
 
-error:
-    // set error string, if one has been passed
-    if (err) {
-        *err = strdup(serr);
+/* Parses the number at the current position into a raw value, returns 0 on error */
+static int __dp_number(_DirectParser *dp, _DPValue *v) {
+    // only members and roots keep their text, the numbers of arrays are packed
+    int astext = JSONObjectNumberText && !dp->scan &&
+                 (!dp->depth || dp->frames[dp->depth - 1].isdict);
+    const char *q = __json_number(dp->p, dp->end, v, astext);
+    if (!q) _DP_FAIL(dp, INVALID_NUMBER, dp->p);
+    dp->p = q;
+    return 1;
+}
+
+/* Parses the literal at the current position, returns 0 on error */
+static int __dp_literal(_DirectParser *dp, const char *lit, size_t len) {
+    if ((size_t)(dp->end - dp->p) < len) {
+        if (memcmp(dp->p, lit, dp->end - dp->p)) _DP_FAIL(dp, SPECIAL_EXPECTED, dp->p);
+        _DP_FAIL(dp, SPECIAL_INCOMPLETE, dp->p);
     }
+    if (memcmp(dp->p, lit, len) || (dp->p + len < dp->end && isalnum(dp->p[len])))
+        _DP_FAIL(dp, SPECIAL_EXPECTED, dp->p);
+    dp->p += len;
+    return 1;
+}
 
-    // free any nodes that are in the stack
-    while (joctx->nlen) Node_Free(_popNode(joctx));
+/* Adds a value to the container that's being parsed, or makes it the root */
+static void __dp_put(_DirectParser *dp, const _DPValue *v, Node **root) {
+    if (dp->scan) return;
+    if (!dp->depth) {
+        *root = __dp_node(v);
+        return;
+    }
 
-    sdsfree(serr);
-    free(joctx->nodes);
-    free(joctx);
-    jsonsl_destroy(jsn);
+    _DPFrame *f = &dp->frames[dp->depth - 1];
+    if (f->isdict) {  // the value of the last key
+        dp->kvs[dp->nkvs - 1]->value.kvval.val = __dp_node(v);
+        return;
+    }
+    if (dp->nvals == dp->capvals) {
+        dp->capvals = dp->capvals ? dp->capvals * 2 : 64;
+        dp->vals = realloc(dp->vals, dp->capvals * sizeof(_DPValue));
+    }
+    dp->vals[dp->nvals++] = *v;
+    f->kinds |= 1 << v->kind;
+}
 
-    return JSONOBJECT_ERROR;
+static void __dp_putkey(_DirectParser *dp, Node *kv) {
+    if (dp->nkvs == dp->capkvs) {
+        dp->capkvs = dp->capkvs ? dp->capkvs * 2 : 64;
+        dp->kvs = realloc(dp->kvs, dp->capkvs * sizeof(Node *));
+    }
+    dp->kvs[dp->nkvs++] = kv;
 }
 
-/* === JSON serializer === */
+/* Creates the container that ends, from its values on the stack */
+static void __dp_close(_DirectParser *dp, _DPValue *v) {
+    _DPFrame *f = &dp->frames[--dp->depth];
 
-typedef struct {
-    sds buf;         // serialization buffer
-    int depth;       // current tree depth
-    int indent;      // indentation string length
-    sds indentstr;   // indentaion string
-    sds newlinestr;  // newline string
-    sds spacestr;    // space string
-    sds delimstr;    // delimiter string
-} _JSONBuilderContext;
+    v->kind = _DP_NODE;
+    if (dp->scan) {
+        v->v.node = NULL;
+        return;
+    }
+    if (f->isdict) {
+        v->v.node = NewDictNodeFromKeyVals(dp->kvs + f->start, dp->nkvs - f->start);
+        dp->nkvs = f->start;
+        return;
+    }
 
-#define _JSONSerialize_Indent(b) \
-    if (b->indent)               \
-        for (int i = 0; i < b->depth; i++) b->buf = sdscatsds(b->buf, b->indentstr);
+    uint32_t len = dp->nvals - f->start;
+    _DPValue *vals = dp->vals + f->start;
+    Node *arr = NewArrayNode(len);
+    if ((1 << _DP_INT) == f->kinds) {
+        for (uint32_t i = 0; i < len; i++) Node_ArrayAppendInt(arr, vals[i].v.intval);
+    } else if ((1 << _DP_DOUBLE) == f->kinds) {
+        for (uint32_t i = 0; i < len; i++) Node_ArrayAppendDouble(arr, vals[i].v.numval);
+    } else {
+        for (uint32_t i = 0; i < len; i++) Node_ArrayAppend(arr, __dp_node(&vals[i]));
+    }
+    dp->nvals = f->start;
+    v->v.node = arr;
+}
 
-inline static void _JSONSerialize_StringValue(Node *n, void *ctx) {
-    _JSONBuilderContext *b = (_JSONBuilderContext *)ctx;
-    size_t len = n->value.strval.len;
-    const char *p = n->value.strval.data;
-
-    b->buf = sdsMakeRoomFor(b->buf, len + 2);  // we'll need at least as much room as the original
-    b->buf = sdscatlen(b->buf, "\"", 1);
-    while (len--) {
-        switch (*p) {
-            case '"':   // quotation mark
-            case '\\':  // reverse solidus
-                b->buf = sdscatprintf(b->buf, "\\%c", *p);
-                break;
-            case '/':  // the standard is clear wrt solidus so we're zealous
-                b->buf = sdscatlen(b->buf, "\\/", 2);
-                break;
-            case '\b':  // backspace
-                b->buf = sdscatlen(b->buf, "\\b", 2);
-                break;
-            case '\f':  // formfeed
-                b->buf = sdscatlen(b->buf, "\\f", 2);
-                break;
-            case '\n':  // newline
-                b->buf = sdscatlen(b->buf, "\\n", 2);
+static int __dp_open(_DirectParser *dp, int isdict) {
+    // as deep as jsonsl goes, its levels include the root
+    if (dp->depth >= MIN(JSONObjectMaxLevels, JSONSL_MAX_LEVELS) - 1)
+        _DP_FAIL(dp, LEVELS_EXCEEDED, dp->p);
+    _DPFrame *f = &dp->frames[dp->depth++];
+    f->start = isdict ? dp->nkvs : dp->nvals;
+    f->isdict = isdict;
+    f->kinds = 0;
+    dp->p++;
+    return 1;
+}
+
+/* Parses a key and its colon */
+static int __dp_key(_DirectParser *dp) {
+    const char *s;
+    uint32_t len;
+
+    if (dp->p == dp->end) {
+        dp->incomplete = 1;
+        return 0;
+    }
+    if ('"' != *dp->p) _DP_FAIL(dp, HKEY_EXPECTED, dp->p);
+    if (!__dp_string(dp, &s, &len, NULL)) return 0;
+    if (!dp->scan) __dp_putkey(dp, NewKeyValNode(s, len, NULL));  // the value is set when parsed
+    __dp_skipws(dp);
+    if (dp->p == dp->end) {
+        dp->incomplete = 1;
+        return 0;
+    }
+    if (':' != *dp->p) _DP_FAIL(dp, MISSING_TOKEN, dp->p);
+    dp->p++;
+    __dp_skipws(dp);
+    return 1;
+}
+
+/* Parses the whole input into root, returns 0 on error */
+static int __dp_parse(_DirectParser *dp, Node **root) {
+    _DPValue v;
+
+    __dp_skipws(dp);
+    if (dp->p == dp->end) return 0;  // no value at all
+
+    for (;;) {
+        // a value, or the beginning of a container up to its first value
+        if (dp->p == dp->end) {
+            dp->incomplete = 1;
+            return 0;
+        }
+        switch (*dp->p) {
+            case '{':
+                if (!__dp_open(dp, 1)) return 0;
+                __dp_skipws(dp);
+                if (dp->p < dp->end && '}' == *dp->p) {
+                    dp->p++;
+                    __dp_close(dp, &v);
+                    break;
+                }
+                if (!__dp_key(dp)) return 0;
+                continue;
+            case '[':
+                if (!__dp_open(dp, 0)) return 0;
+                __dp_skipws(dp);
+                if (dp->p < dp->end && ']' == *dp->p) {
+                    dp->p++;
+                    __dp_close(dp, &v);
+                    break;
+                }
+                continue;
+            case '"': {
+                const char *s;
+                uint32_t len;
+                Node *n = NULL;
+                if (!__dp_string(dp, &s, &len, dp->scan ? NULL : &n)) return 0;
+                v.kind = _DP_NODE;
+                v.v.node = n || dp->scan ? n : NewStringNode(s, len);
+            } break;
+            case 't':
+                if (!__dp_literal(dp, "true", 4)) return 0;
+                v.kind = _DP_NODE;
+                v.v.node = dp->scan ? NULL : NewBoolNode(1);
                 break;
-            case '\r':  // carriage return
-                b->buf = sdscatlen(b->buf, "\\r", 2);
+            case 'f':
+                if (!__dp_literal(dp, "false", 5)) return 0;
+                v.kind = _DP_NODE;
+                v.v.node = dp->scan ? NULL : NewBoolNode(0);
                 break;
-            case '\t':  // horizontal tab
-                b->buf = sdscatlen(b->buf, "\\t", 2);
+            case 'n':
+                if (!__dp_literal(dp, "null", 4)) return 0;
+                v.kind = _DP_NODE;
+                v.v.node = NULL;
                 break;
             default:
-                if ((unsigned char)*p > 31 && isprint(*p))
-                    b->buf = sdscatprintf(b->buf, "%c", *p);
-                else
-                    b->buf = sdscatprintf(b->buf, "\\u%04x", (unsigned char)*p);
+                if ('-' != *dp->p && !isdigit(*dp->p)) _DP_FAIL(dp, SPECIAL_EXPECTED, dp->p);
+                if (!__dp_number(dp, &v)) return 0;
                 break;
         }
-        p++;
+
+        // the value is put in its container, and any containers that end after it are closed
+        for (;;) {
+            __dp_put(dp, &v, root);
+            __dp_skipws(dp);
+            if (!dp->depth) {
+                if (dp->p < dp->end) _DP_FAIL(dp, GARBAGE_TRAILING, dp->p);
+                return 1;
+            }
+            if (dp->p == dp->end) {
+                dp->incomplete = 1;
+                return 0;
+            }
+
+            _DPFrame *f = &dp->frames[dp->depth - 1];
+            char c = *dp->p;
+            if (',' == c) {
+                dp->p++;
+                __dp_skipws(dp);
+                if (dp->p < dp->end && ('}' == *dp->p || ']' == *dp->p))
+                    _DP_FAIL(dp, TRAILING_COMMA, dp->p);
+                if (f->isdict && !__dp_key(dp)) return 0;
+                break;
+            }
+            if (c != (f->isdict ? '}' : ']')) {
+                if ('}' == c || ']' == c) _DP_FAIL(dp, BRACKET_MISMATCH, dp->p);
+                _DP_FAIL(dp, MISSING_TOKEN, dp->p);
+            }
+            dp->p++;
+            __dp_close(dp, &v);
+        }
+    }
+}
+
+/* Parses the input into node, or only checks it when node is NULL */
+static int _directParse(const char *buf, size_t len, Node **node, sds *compact, char **err) {
+    _DirectParser *dp = calloc(1, sizeof(_DirectParser));
+    Node *root = NULL;
+    int ret = JSONOBJECT_OK;
+
+    dp->buf = dp->p = dp->mark = buf;
+    dp->end = buf + len;
+    dp->scan = !node;
+    dp->compact = compact;
+    size_t compactlen = compact ? sdslen(*compact) : 0;
+    if (__dp_parse(dp, &root)) {
+        if (node) *node = root;
+        if (compact) *compact = sdscatlen(*compact, dp->mark, dp->end - dp->mark);
+    } else {
+        if (compact) {
+            sdssetlen(*compact, compactlen);
+            (*compact)[compactlen] = '\0';
+        }
+        ret = JSONOBJECT_ERROR;
+        if (err) {
+            sds serr = sdsempty();
+            if (dp->incomplete) {  // jsonsl counts an unterminated string as a container
+                serr = sdscatprintf(serr, "ERR JSON value incomplete - %u containers unterminated",
+                                    dp->depth + dp->incomplete - 1);
+            } else if (JSONSL_ERROR_SUCCESS == dp->err) {
+                serr = sdscatprintf(serr, "ERR JSON value not found");
+            } else {
+                serr = sdscatprintf(serr, "ERR JSON lexer error %s at position %zd",
+                                    jsonsl_strerror(dp->err), dp->errat - buf + 1);
+            }
+            *err = strdup(serr);
+            sdsfree(serr);
+        }
+        // free the values on the stacks, the containers' values are all there
+        for (uint32_t i = 0; i < dp->nvals; i++)
+            if (_DP_NODE == dp->vals[i].kind) Node_Free(dp->vals[i].v.node);
+        for (uint32_t i = 0; i < dp->nkvs; i++) Node_Free(dp->kvs[i]);
+        if (root) Node_Free(root);  // with trailing garbage
     }
 
-    b->buf = sdscatlen(b->buf, "\"", 1);
+    free(dp->vals);
+    free(dp->kvs);
+    free(dp->scratch);
+    free(dp);
+    return ret;
 }
 
-inline static void _JSONSerialize_BeginValue(Node *n, void *ctx) {
-    _JSONBuilderContext *b = (_JSONBuilderContext *)ctx;
+static int _directCreateNode(const char *buf, size_t len, Node **node, char **err) {
+    return _directParse(buf, len, node, NULL, err);
+}
+
+int ValidateJSON(const char *buf, size_t len, sds *compact, char **err) {
+    return _directParse(buf, len, NULL, compact, err);
+}
+
+int CreateNodeFromJSONWith(JSONParser parser, const char *buf, size_t len, Node **node,
+                           char **err) {
+    if (JSONPARSER_DIRECT == parser) return _directCreateNode(buf, len, node, err);
+    return _jsonslCreateNode(buf, len, NULL, node, err);
+}
+
+int CreateScalarNodeFromJSON(const char *buf, size_t len, Node **node) {
+    const char *p = buf, *end = buf + len, *q;
+    Node *n = NULL;
+    _DPValue v;
+
+    while (p < end && (' ' == *p || '\n' == *p || '\r' == *p || '\t' == *p)) p++;
+    while (end > p && (' ' == end[-1] || '\n' == end[-1] || '\r' == end[-1] || '\t' == end[-1]))
+        end--;
+    if (p == end) return JSONOBJECT_ERROR;
+
+    switch (*p) {
+        case '"':
+            // only a string without escapes, whose only quote is its closing one
+            q = JSON_ScanString(p + 1, end);
+            if (q != end - 1 || '"' != *q) return JSONOBJECT_ERROR;
+            n = NewStringNode(p + 1, q - p - 1);
+            break;
+        case 't':
+            if (4 != end - p || memcmp(p, "true", 4)) return JSONOBJECT_ERROR;
+            n = NewBoolNode(1);
+            break;
+        case 'f':
+            if (5 != end - p || memcmp(p, "false", 5)) return JSONOBJECT_ERROR;
+            n = NewBoolNode(0);
+            break;
+        case 'n':
+            if (4 != end - p || memcmp(p, "null", 4)) return JSONOBJECT_ERROR;
+            break;
+        default:
+            if (__json_number(p, end, &v, JSONObjectNumberText) != end) return JSONOBJECT_ERROR;
+            n = __dp_node(&v);
+    }
+    *node = n;
+    return JSONOBJECT_OK;
+}
+
+/* Parses with the default backend */
+static int _createNode(const char *buf, size_t len, Node **node, char **err) {
+#ifdef JSONOBJECT_DIRECT_PARSER
+    return _directCreateNode(buf, len, node, err);
+#else
+    return _jsonslCreateNode(buf, len, NULL, node, err);
+#endif
+}
+
+int CreateNodeFromJSON(const char *buf, size_t len, Node **node, char **err) {
+    uint64_t begin = Stats_Begin(), nodes = Node_CreatedCount();
+    if (JSONOBJECT_OK == CreateScalarNodeFromJSON(buf, len, node)) {
+        Stats_End(STATS_PARSE, begin, len, Node_CreatedCount() - nodes, 0);
+        return JSONOBJECT_OK;
+    }
+    int ret = _createNode(buf, len, node, err);
+    Stats_End(STATS_PARSE, begin, len, Node_CreatedCount() - nodes, JSONOBJECT_OK != ret);
+    return ret;
+}
+
+int CreateNodeFromJSONSchema(const char *buf, size_t len, const JSONSchema *schema, Node **node,
+                             char **err) {
+    uint64_t begin = Stats_Begin(), nodes = Node_CreatedCount();
+    int ret = _jsonslCreateNode(buf, len, schema, node, err);
+    Stats_End(STATS_PARSE, begin, len, Node_CreatedCount() - nodes, JSONOBJECT_OK != ret);
+    return ret;
+}
+
+/* The ranges of a container's elements that the threads of a parallel parse take in turn */
+typedef struct {
+    const char *buf;
+    const size_t *cuts;  // see JSON_ScanSplit
+    int nranges;
+    int next;            // the next range to parse
+    int failed;          // set when a range is invalid, which stops the threads
+    Node **parts;        // the containers of the elements of every range
+} _ParallelParse;
+
+/* A thread of a parallel parse */
+typedef struct {
+    _ParallelParse *pp;
+    NodeArena *arena;  // the thread's arena, NULL for the heap
+    pthread_t tid;
+    int started;
+    uint64_t nodes;    // the number of nodes that the thread created
+} _ParallelWorker;
+
+static void *_parallelParseMain(void *arg) {
+    _ParallelWorker *w = arg;
+    _ParallelParse *pp = w->pp;
+    NodeArena *prev = Node_SetArena(w->arena);
+    uint64_t nodes = Node_CreatedCount();
+    char open = pp->buf[pp->cuts[0]], close = pp->buf[pp->cuts[pp->nranges]];
+    sds text = sdsempty();
+    int i;
+
+    while (!__atomic_load_n(&pp->failed, __ATOMIC_RELAXED) &&
+           (i = __atomic_fetch_add(&pp->next, 1, __ATOMIC_RELAXED)) < pp->nranges) {
+        // the range's elements are parsed in a container of the root's kind, and a range without
+        // any, i.e. a blank one between commas, is as invalid as the whole
+        size_t start = pp->cuts[i] + 1, end = pp->cuts[i + 1];
+        sdsclear(text);
+        text = sdscatlen(text, &open, 1);
+        text = sdscatlen(text, pp->buf + start, end - start);
+        text = sdscatlen(text, &close, 1);
+        if (JSONOBJECT_OK != _createNode(text, sdslen(text), &pp->parts[i], NULL) ||
+            !Node_Length(pp->parts[i])) {
+            __atomic_store_n(&pp->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    sdsfree(text);
+    w->nodes = Node_CreatedCount() - nodes;
+    Node_SetArena(prev);
+    return NULL;
+}
+
+int CreateNodeFromJSONParallel(const char *buf, size_t len, int threads, Node **node, char **err) {
+    if (threads < 2) return CreateNodeFromJSON(buf, len, node, err);
+
+    uint64_t begin = Stats_Begin(), nodes = Node_CreatedCount();
+    size_t *cuts = malloc((threads * JSONOBJECT_PARALLEL_RANGES + 1) * sizeof(size_t)), count;
+    int nranges = JSON_ScanSplit(buf, len, threads * JSONOBJECT_PARALLEL_RANGES, cuts, &count);
+    if (nranges < 2) {
+        free(cuts);
+        return CreateNodeFromJSON(buf, len, node, err);
+    }
+
+    // the calling thread is the first worker, and builds in its own arena
+    _ParallelParse pp = {.buf = buf, .cuts = cuts, .nranges = nranges};
+    pp.parts = calloc(nranges, sizeof(Node *));
+    threads = MIN(threads, nranges);
+    _ParallelWorker *workers = calloc(threads, sizeof(_ParallelWorker));
+    NodeArena *arena = Node_SetArena(NULL);
+    Node_SetArena(arena);
+    JSON_ScanKernel();  // the scan kernel is picked before the threads use it
+    for (int t = 0; t < threads; t++) {
+        workers[t].pp = &pp;
+        workers[t].arena = t && arena ? NewNodeArena() : arena;
+        if (t) {
+            workers[t].started =
+                !pthread_create(&workers[t].tid, NULL, _parallelParseMain, &workers[t]);
+        }
+    }
+    _parallelParseMain(&workers[0]);
+    for (int t = 1; t < threads; t++) {
+        if (workers[t].started) pthread_join(workers[t].tid, NULL);
+        nodes -= workers[t].nodes;
+        if (workers[t].arena) NodeArena_Merge(arena, workers[t].arena);
+    }
+    free(workers);
+    free(cuts);
+
+    // an invalid JSON is parsed again for the error that it gives
+    if (pp.failed) {
+        for (int i = 0; i < nranges; i++) Node_Free(pp.parts[i]);
+        free(pp.parts);
+        return CreateNodeFromJSON(buf, len, node, err);
+    }
+
+    // the root takes the elements of the ranges in order, the last value of a key wins like it does
+    // in a single parse
+    if (N_ARRAY == pp.parts[0]->type) {
+        *node = NewArrayNode((uint32_t)count);
+        for (int i = 0; i < nranges; i++) {
+            Node_ArrayInsert(*node, (*node)->value.arrval.len, pp.parts[i]);
+        }
+    } else {
+        Node **kvs = malloc(count * sizeof(Node *));
+        uint32_t nkvs = 0;
+        for (int i = 0; i < nranges; i++) {
+            t_dict *d = &pp.parts[i]->value.dictval;
+            memcpy(kvs + nkvs, d->entries, d->len * sizeof(Node *));
+            nkvs += d->len;
+            d->len = 0;
+            Node_Free(pp.parts[i]);
+        }
+        *node = NewDictNodeFromKeyVals(kvs, nkvs);
+        free(kvs);
+    }
+    free(pp.parts);
+    Stats_End(STATS_PARSE, begin, len, Node_CreatedCount() - nodes, 0);
+    return JSONOBJECT_OK;
+}
+
+/* === JSON serializer === */
+
+typedef struct {
+    sds buf;                 // serialization buffer
+    int depth;               // current tree depth
+    const char *indentstr;   // indentaion string
+    size_t indentlen;        // indentation string length
+    const char *newlinestr;  // newline string
+    size_t newlinelen;       // newline string length
+    const char *spacestr;    // space string
+    size_t spacelen;         // space string length
+    size_t chunk;            // the size from which the buffer is flushed, 0 if it never is
+    JSONSerializeFlush flush;
+    void *flushctx;
+} _JSONBuilderContext;
+
+// clang-format off
+/**
+* The escape of every byte in a string value: 0 means it is copied as is, 'u' that it is written as
+* \u00XX and any other character that it is written after a reverse solidus.
+*/
+static const char _JSONEscapes[0x100] = {
+    /* 0x00 */ 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    /* 0x10 */ 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    /* 0x20 */ 0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '/',  // the standard is clear wrt solidus so we're zealous
+    /* 0x30 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x40 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x50 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+    /* 0x60 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x70 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 'u',
+    /* 0x80 */ 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    /* 0x90 */ 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    /* 0xa0 */ 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    /* 0xb0 */ 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    /* 0xc0 */ 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    /* 0xd0 */ 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    /* 0xe0 */ 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    /* 0xf0 */ 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+};
+// clang-format on
+
+static const char _JSONHexDigits[] = "0123456789abcdef";
+
+/* Makes room for at least len more bytes, at least doubling the buffer when it grows. The buffer
+* is only NULL terminated when serialization is done. */
+static inline void _JSONSerialize_Reserve(_JSONBuilderContext *b, size_t len) {
+    if (sdsavail(b->buf) >= len) return;
+    size_t cur = sdslen(b->buf);
+    b->buf = sdsMakeRoomFor(b->buf, len > cur ? len : cur);
+}
+
+static inline void _JSONSerialize_Write(_JSONBuilderContext *b, const char *s, size_t len) {
+    _JSONSerialize_Reserve(b, len);
+    memcpy(b->buf + sdslen(b->buf), s, len);
+    sdsinclen(b->buf, len);
+}
 
+static inline void _JSONSerialize_Char(_JSONBuilderContext *b, char c) {
+    _JSONSerialize_Reserve(b, 1);
+    b->buf[sdslen(b->buf)] = c;
+    sdsinclen(b->buf, 1);
+}
+
+static inline void _JSONSerialize_Indent(_JSONBuilderContext *b) {
+    if (b->indentlen)
+        for (int i = 0; i < b->depth; i++) _JSONSerialize_Write(b, b->indentstr, b->indentlen);
+}
+
+/* Writes a quoted and escaped string, copying the runs of characters that need no escaping at once.
+* The runs are found with JSON_ScanEscape, which stops at the same characters that _JSONEscapes
+* escapes. */
+static void _JSONSerialize_String(_JSONBuilderContext *b, const char *s, size_t len) {
+    const unsigned char *p = (const unsigned char *)s;
+    const unsigned char *end = p + len;
+
+    _JSONSerialize_Reserve(b, len + 2);  // we'll need at least as much room as the original
+    _JSONSerialize_Char(b, '"');
+    while (p < end) {
+        const unsigned char *run = p;
+        p = (const unsigned char *)JSON_ScanEscape((const char *)p, (const char *)end);
+        if (p > run) _JSONSerialize_Write(b, (const char *)run, p - run);
+        if (p == end) break;
+
+        char esc[6] = {'\\', _JSONEscapes[*p]};
+        if ('u' == esc[1]) {
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = _JSONHexDigits[*p >> 4];
+            esc[5] = _JSONHexDigits[*p & 0xf];
+            _JSONSerialize_Write(b, esc, 6);
+        } else {
+            _JSONSerialize_Write(b, esc, 2);
+        }
+        p++;
+    }
+    _JSONSerialize_Char(b, '"');
+}
+
+/* Writes a value that isn't a container or a keyval */
+static inline void _JSONSerialize_Scalar(_JSONBuilderContext *b, const Node *n) {
     if (!n) {  // NULL nodes are literal nulls
-        b->buf = sdscatlen(b->buf, "null", 4);
+        _JSONSerialize_Write(b, "null", 4);
     } else {
         switch (n->type) {
             case N_BOOLEAN:
                 if (n->value.boolval) {
-                    b->buf = sdscatlen(b->buf, "true", 4);
+                    _JSONSerialize_Write(b, "true", 4);
                 } else {
-                    b->buf = sdscatlen(b->buf, "false", 5);
+                    _JSONSerialize_Write(b, "false", 5);
                 }
                 break;
             case N_INTEGER:
-                b->buf = sdscatfmt(b->buf, "%I", n->value.intval);
+                _JSONSerialize_Reserve(b, JSON_NUMBER_MAX_LEN);
+                sdsinclen(b->buf, JSON_FormatInt64(n->value.intval, b->buf + sdslen(b->buf)));
                 break;
             case N_NUMBER:
-                if (fabs(floor(n->value.numval) - n->value.numval) <= DBL_EPSILON &&
-                    fabs(n->value.numval) < 1.0e60)
-                    b->buf = sdscatprintf(b->buf, "%.0f", n->value.numval);
-                else if (fabs(n->value.numval) < 1.0e-6 || fabs(n->value.numval) > 1.0e9)
-                    b->buf = sdscatprintf(b->buf, "%e", n->value.numval);
-                else
-                    b->buf = sdscatprintf(b->buf, "%.17g", n->value.numval);
+                if (n->flags & NODE_F_NUMBER_TEXT) {  // written as it was parsed
+                    _JSONSerialize_Write(b, n->value.strval.data, n->value.strval.len);
+                    break;
+                }
+                _JSONSerialize_Reserve(b, JSON_NUMBER_MAX_LEN);
+                sdsinclen(b->buf, JSON_FormatDouble(n->value.numval, b->buf + sdslen(b->buf)));
+                break;
+            case N_STRING: {
+                char *tmp;
+                _JSONSerialize_String(b, Node_StringData(n, &tmp), n->value.strval.len);
+                free(tmp);
+            } break;
+            default:  // keeps the compiler from complaining
                 break;
+        }
+    }
+}
+
+inline static void _JSONSerialize_BeginValue(Node *n, void *ctx) {
+    _JSONBuilderContext *b = (_JSONBuilderContext *)ctx;
+
+    if (!n) {
+        _JSONSerialize_Scalar(b, n);
+    } else {
+        switch (n->type) {
+            case N_BOOLEAN:
+            case N_INTEGER:
+            case N_NUMBER:
             case N_STRING:
-                _JSONSerialize_StringValue(n, b);
+                _JSONSerialize_Scalar(b, n);
                 break;
             case N_KEYVAL:
-                b->buf = sdscatfmt(b->buf, "\"%s\":%s", n->value.kvval.key, b->spacestr);
+                _JSONSerialize_String(b, n->value.kvval.key, Intern_Len(n->value.kvval.key));
+                _JSONSerialize_Char(b, ':');
+                _JSONSerialize_Write(b, b->spacestr, b->spacelen);
                 break;
             case N_DICT:
-                b->buf = sdscatlen(b->buf, "{", 1);
+                _JSONSerialize_Char(b, '{');
                 b->depth++;
                 if (n->value.dictval.len) {
-                    b->buf = sdscatsds(b->buf, b->newlinestr);
+                    _JSONSerialize_Write(b, b->newlinestr, b->newlinelen);
                     _JSONSerialize_Indent(b);
                 }
                 break;
             case N_ARRAY:
-                b->buf = sdscatlen(b->buf, "[", 1);
+                _JSONSerialize_Char(b, '[');
                 b->depth++;
                 if (n->value.arrval.len) {
-                    b->buf = sdscatsds(b->buf, b->newlinestr);
+                    _JSONSerialize_Write(b, b->newlinestr, b->newlinelen);
                     _JSONSerialize_Indent(b);
                 }
                 break;
@@ -375,19 +1502,19 @@ inline static void _JSONSerialize_EndValue(Node *n, void *ctx) {
         switch (n->type) {
             case N_DICT:
                 if (n->value.dictval.len) {
-                    b->buf = sdscatsds(b->buf, b->newlinestr);
+                    _JSONSerialize_Write(b, b->newlinestr, b->newlinelen);
                 }
                 b->depth--;
                 _JSONSerialize_Indent(b);
-                b->buf = sdscatlen(b->buf, "}", 1);
+                _JSONSerialize_Char(b, '}');
                 break;
             case N_ARRAY:
                 if (n->value.arrval.len) {
-                    b->buf = sdscatsds(b->buf, b->newlinestr);
+                    _JSONSerialize_Write(b, b->newlinestr, b->newlinelen);
                 }
                 b->depth--;
                 _JSONSerialize_Indent(b);
-                b->buf = sdscatlen(b->buf, "]", 1);
+                _JSONSerialize_Char(b, ']');
                 break;
             default:  // keeps the compiler from complaining
                 break;
@@ -395,41 +1522,310 @@ inline static void _JSONSerialize_EndValue(Node *n, void *ctx) {
     }
 }
 
+/* Gives the buffer to the flush callback once it has a chunk */
+static inline void _JSONSerialize_Flush(_JSONBuilderContext *b, size_t min) {
+    if (sdslen(b->buf) >= min && sdslen(b->buf)) {
+        b->flush(b->buf, sdslen(b->buf), b->flushctx);
+        sdsclear(b->buf);
+    }
+}
+
 inline static void _JSONSerialize_ContainerDelimiter(void *ctx) {
     _JSONBuilderContext *b = (_JSONBuilderContext *)ctx;
-    b->buf = sdscat(b->buf, b->delimstr);
+    // the buffer is flushed between items, so it holds no more than a chunk and an item's scalar
+    if (b->chunk) _JSONSerialize_Flush(b, b->chunk);
+    _JSONSerialize_Char(b, ',');
+    _JSONSerialize_Write(b, b->newlinestr, b->newlinelen);
     _JSONSerialize_Indent(b);
 }
 
+/* The number of open containers that a walk keeps on the C stack, deeper ones are on the heap */
+#define JSON_SERIALIZE_INLINE_DEPTH 32
+
+/* An open container of a walk, and the index of its next member or item */
+typedef struct {
+    const Node *node;
+    uint32_t index;
+} _JSONNodeFrame;
+
+/**
+* Writes a node tree without callbacks, like the begin, end and delimiter writers above would if
+* Node_Serializer called them. It's inlined with pretty being a constant, so the compact output has
+* no indentation, newline or space writes at all.
+*/
+static inline void _JSONSerialize_Walk(_JSONBuilderContext *b, const Node *n, const int pretty) {
+    _JSONNodeFrame inlined[JSON_SERIALIZE_INLINE_DEPTH], *frames = inlined;
+    uint32_t nframes = 0, capframes = JSON_SERIALIZE_INLINE_DEPTH;
+    Node tmp;  // holds the current item of a packed array, which is always a scalar
+
+    for (;;) {
+        if (n && N_KEYVAL == n->type) {  // the members of dictionaries, or the tree's root
+            _JSONSerialize_String(b, n->value.kvval.key, Intern_Len(n->value.kvval.key));
+            _JSONSerialize_Char(b, ':');
+            if (pretty) _JSONSerialize_Write(b, b->spacestr, b->spacelen);
+            n = n->value.kvval.val;
+            continue;
+        }
+        if (n && (N_DICT == n->type || N_ARRAY == n->type)) {
+            if (nframes == capframes) {
+                size_t size = capframes * sizeof(_JSONNodeFrame);
+                frames = frames == inlined ? memcpy(malloc(2 * size), inlined, size)
+                                           : realloc(frames, 2 * size);
+                capframes *= 2;
+            }
+            frames[nframes++] = (_JSONNodeFrame){n, 0};
+            _JSONSerialize_Char(b, N_DICT == n->type ? '{' : '[');
+            b->depth++;
+        } else {
+            _JSONSerialize_Scalar(b, n);
+        }
+
+        // close the complete containers, and find the next member or item of the current one
+        _JSONNodeFrame *f = NULL;
+        while (nframes) {
+            f = &frames[nframes - 1];
+            uint32_t len = N_DICT == f->node->type ? f->node->value.dictval.len
+                                                   : f->node->value.arrval.len;
+            if (f->index < len) break;
+            if (pretty && len) _JSONSerialize_Write(b, b->newlinestr, b->newlinelen);
+            b->depth--;
+            if (pretty) _JSONSerialize_Indent(b);
+            _JSONSerialize_Char(b, N_DICT == f->node->type ? '}' : ']');
+            nframes--;
+        }
+        if (!nframes) break;
+
+        if (f->index) {
+            if (b->chunk) _JSONSerialize_Flush(b, b->chunk);
+            _JSONSerialize_Char(b, ',');
+        }
+        if (pretty) {
+            _JSONSerialize_Write(b, b->newlinestr, b->newlinelen);
+            _JSONSerialize_Indent(b);
+        }
+        uint32_t i = f->index++;
+        if (N_DICT == f->node->type) {
+            n = f->node->value.dictval.entries[i];
+        } else if (f->node->flags & NODE_F_PACKED) {
+            Node *item;
+            Node_ArrayItemView((Node *)f->node, i, &tmp, &item);
+            n = item;
+        } else {
+            n = f->node->value.arrval.entries[i];
+        }
+    }
+    if (frames != inlined) free(frames);
+}
+
+/* Writes a node tree, with the walk that's specialized for the options */
+static void _JSONSerialize_Node(_JSONBuilderContext *b, const Node *n) {
+    if (b->indentlen || b->newlinelen || b->spacelen) {
+        _JSONSerialize_Walk(b, n, 1);
+    } else {
+        _JSONSerialize_Walk(b, n, 0);
+    }
+}
+
+/* Sets up the builder, the option strings are used as is */
+static void _JSONSerialize_Init(_JSONBuilderContext *b, const JSONSerializeOpt *opt, sds buf) {
+    *b = (_JSONBuilderContext){.buf = buf,
+                               .indentstr = opt->indentstr ? opt->indentstr : "",
+                               .newlinestr = opt->newlinestr ? opt->newlinestr : "",
+                               .spacestr = opt->spacestr ? opt->spacestr : ""};
+    b->indentlen = strlen(b->indentstr);
+    b->newlinelen = strlen(b->newlinestr);
+    b->spacelen = strlen(b->spacestr);
+}
+
 void SerializeNodeToJSON(const Node *node, const JSONSerializeOpt *opt, sds *json) {
-    int levels = JSONSL_MAX_LEVELS;
-
-    // set up the builder
-    _JSONBuilderContext *b = calloc(1, sizeof(_JSONBuilderContext));
-    b->indentstr = opt->indentstr ? sdsnew(opt->indentstr) : sdsempty();
-    b->newlinestr = opt->newlinestr ? sdsnew(opt->newlinestr) : sdsempty();
-    b->spacestr = opt->spacestr ? sdsnew(opt->spacestr) : sdsempty();
-    b->indent = sdslen(b->indentstr);
-    b->delimstr = sdsnewlen(",", 1);
-    b->delimstr = sdscat(b->delimstr, b->newlinestr);
-
-    NodeSerializerOpt nso = {.fBegin = _JSONSerialize_BeginValue,
-                             .xBegin = 0xffff,
-                             .fEnd = _JSONSerialize_EndValue,
-                             .xEnd = (N_DICT | N_ARRAY),
-                             .fDelim = _JSONSerialize_ContainerDelimiter,
-                             .xDelim = (N_DICT | N_ARRAY)};
-
-    // the real work
-    b->buf = *json;
-    Node_Serializer(node, &nso, b);
-    *json = b->buf;
-
-    sdsfree(b->indentstr);
-    sdsfree(b->newlinestr);
-    sdsfree(b->spacestr);
-    sdsfree(b->delimstr);
-    free(b);
+    uint64_t begin = Stats_Begin();
+    size_t len = sdslen(*json);
+    _JSONBuilderContext b;
+    _JSONSerialize_Init(&b, opt, *json);
+
+    // the real work, the writes don't terminate the buffer so that's done once at the end
+    _JSONSerialize_Node(&b, node);
+    b.buf[sdslen(b.buf)] = '\0';
+    *json = b.buf;
+    Stats_End(STATS_SERIALIZE, begin, sdslen(b.buf) - len, 0, 0);
+}
+
+/* An open container of a binary encoding, and the number of its members or items that were read */
+typedef struct {
+    Node node;
+    uint32_t index;
+} _JSONBinaryFrame;
+
+int SerializeBinaryToJSON(const char *buf, size_t len, const JSONSerializeOpt *opt, sds *json) {
+    _JSONBuilderContext b;
+    _JSONSerialize_Init(&b, opt, *json);
+    size_t start = sdslen(b.buf);
+    BinaryReader r;
+    BinaryReader_Init(&r, buf, len);
+    _JSONBinaryFrame *frames = NULL;
+    uint32_t nframes = 0, capframes = 0;
+    Node v;
+
+    // the values are written with the callbacks of Node_Serializer, in the order it calls them
+    if (OBJ_OK != BinaryReader_Read(&r, &v)) goto error;
+    for (;;) {
+        _JSONSerialize_BeginValue(N_NULL == v.type ? NULL : &v, &b);
+        if (N_DICT == v.type || N_ARRAY == v.type) {
+            if (nframes == capframes) {
+                capframes = capframes ? capframes * 2 : 16;
+                frames = realloc(frames, capframes * sizeof(_JSONBinaryFrame));
+            }
+            frames[nframes++] = (_JSONBinaryFrame){v, 0};
+        }
+
+        // close the complete containers, and read the next member or item of the current one
+        _JSONBinaryFrame *f = NULL;
+        while (nframes) {
+            f = &frames[nframes - 1];
+            if (f->index < (N_DICT == f->node.type ? f->node.value.dictval.len
+                                                   : f->node.value.arrval.len))
+                break;
+            _JSONSerialize_EndValue(&f->node, &b);
+            nframes--;
+        }
+        if (!nframes) break;
+
+        if (f->index++) _JSONSerialize_ContainerDelimiter(&b);
+        if (N_DICT == f->node.type) {
+            const char *key;
+            uint32_t keylen;
+            if (OBJ_OK != BinaryReader_ReadKey(&r, &key, &keylen)) goto error;
+            _JSONSerialize_String(&b, key, keylen);
+            _JSONSerialize_Char(&b, ':');
+            _JSONSerialize_Write(&b, b.spacestr, b.spacelen);
+        }
+        if (OBJ_OK != BinaryReader_Read(&r, &v)) goto error;
+    }
+    if (r.p != r.end) goto error;
+
+    free(frames);
+    b.buf[sdslen(b.buf)] = '\0';
+    *json = b.buf;
+    return JSONOBJECT_OK;
+
+error:
+    free(frames);
+    sdssetlen(b.buf, start);
+    b.buf[start] = '\0';
+    *json = b.buf;
+    return JSONOBJECT_ERROR;
+}
+
+struct JSONSerializer {
+    _JSONBuilderContext b;
+    int level;          // the number of open containers
+    uint64_t dicts;     // bit i is set if the container at level i + 1 is a dictionary
+    uint64_t nonempty;  // bit i is set if the container at level i + 1 has items
+    JSONSerializeWriter write;  // writes the values instead of JSONSerializer_Node, if set
+    void *writectx;
+};
+
+/* Writes what comes before an item of the current container, a key's in the case of dictionaries */
+static void _JSONSerializer_Item(JSONSerializer *s) {
+    uint64_t bit = 1ULL << (s->level - 1);
+    if (s->nonempty & bit) {
+        _JSONSerialize_ContainerDelimiter(&s->b);
+    } else {
+        _JSONSerialize_Write(&s->b, s->b.newlinestr, s->b.newlinelen);
+        _JSONSerialize_Indent(&s->b);
+        s->nonempty |= bit;
+    }
+}
+
+/* Writes what comes before a value, which in a dictionary is its key */
+static inline void _JSONSerializer_Value(JSONSerializer *s) {
+    if (s->level && !(s->dicts & (1ULL << (s->level - 1)))) _JSONSerializer_Item(s);
+}
+
+static void _JSONSerializer_Begin(JSONSerializer *s, int isdict) {
+    _JSONSerializer_Value(s);
+    _JSONSerialize_Char(&s->b, isdict ? '{' : '[');
+    s->b.depth++;
+    uint64_t bit = 1ULL << s->level++;
+    s->nonempty &= ~bit;
+    s->dicts = isdict ? s->dicts | bit : s->dicts & ~bit;
+}
+
+JSONSerializer *NewJSONSerializer(const JSONSerializeOpt *opt, sds json) {
+    JSONSerializer *s = calloc(1, sizeof(JSONSerializer));
+    _JSONSerialize_Init(&s->b, opt, json);
+    return s;
+}
+
+void JSONSerializer_BeginArray(JSONSerializer *s) { _JSONSerializer_Begin(s, 0); }
+
+void JSONSerializer_BeginDict(JSONSerializer *s) { _JSONSerializer_Begin(s, 1); }
+
+void JSONSerializer_Key(JSONSerializer *s, const char *key, size_t len) {
+    _JSONSerializer_Item(s);
+    _JSONSerialize_String(&s->b, key, len);
+    _JSONSerialize_Char(&s->b, ':');
+    _JSONSerialize_Write(&s->b, s->b.spacestr, s->b.spacelen);
+}
+
+void JSONSerializer_Value(JSONSerializer *s, const Node *n) {
+    if (s->write) {
+        s->write(s, n, s->writectx);
+    } else {
+        JSONSerializer_Node(s, n);
+    }
+}
+
+void JSONSerializer_Node(JSONSerializer *s, const Node *n) {
+    _JSONSerializer_Value(s);
+    _JSONSerialize_Node(&s->b, n);
+}
+
+void JSONSerializer_SetWriter(JSONSerializer *s, JSONSerializeWriter write, void *ctx) {
+    s->write = write;
+    s->writectx = ctx;
+}
+
+int JSONSerializer_Level(const JSONSerializer *s) {
+    return s->level;
+}
+
+void JSONSerializer_End(JSONSerializer *s) {
+    uint64_t bit = 1ULL << --s->level;
+    if (s->nonempty & bit) _JSONSerialize_Write(&s->b, s->b.newlinestr, s->b.newlinelen);
+    s->b.depth--;
+    _JSONSerialize_Indent(&s->b);
+    _JSONSerialize_Char(&s->b, s->dicts & bit ? '}' : ']');
+}
+
+void JSONSerializer_SetFlush(JSONSerializer *s, size_t chunk, JSONSerializeFlush flush,
+                             void *ctx) {
+    s->b.chunk = chunk;
+    s->b.flush = flush;
+    s->b.flushctx = ctx;
+}
+
+sds JSONSerializer_Free(JSONSerializer *s) {
+    if (s->b.chunk) _JSONSerialize_Flush(&s->b, 0);
+    sds json = s->b.buf;
+    json[sdslen(json)] = '\0';
+    free(s);
+    return json;
+}
+
+void SerializeKeyValuesToJSON(const char **keys, const size_t *keylens, Node **vals, int n,
+                              const JSONSerializeOpt *opt, sds *json) {
+    JSONSerializer s = {0};
+    _JSONSerialize_Init(&s.b, opt, *json);
+
+    JSONSerializer_BeginDict(&s);
+    for (int i = 0; i < n; i++) {
+        JSONSerializer_Key(&s, keys[i], keylens[i]);
+        JSONSerializer_Value(&s, vals[i]);
+    }
+    JSONSerializer_End(&s);
+    s.b.buf[sdslen(s.b.buf)] = '\0';
+    *json = s.b.buf;
 }
 
 // clang-format off
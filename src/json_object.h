@@ -26,6 +26,7 @@
 #include <sds.h>
 #include <stdlib.h>
 #include "object.h"
+#include "json_schema.h"
 
 #ifdef REDIS_MODULE_TARGET
 #include <alloc.h>
@@ -36,6 +37,23 @@
 
 #define JSONOBJECT_MAX_ERROR_STRING_LENGTH 256
 
+/**
+* The levels of the jsonsl lexer, which limit how deep the values that are parsed may nest: the root
+* takes a level, every container one, and the values in the innermost one another, so a value of n
+* nested containers takes n + 2 levels. The direct parser stops at the same depth. It's at most
+* JSONSL_MAX_LEVELS, the default. Lexers are kept in a pool by every thread and taken for the levels
+* that their input can reach, so small values don't pay for the limit.
+*/
+extern int JSONObjectMaxLevels;
+
+/**
+* When set, the default, the numbers with a fraction or an exponent that are members or roots keep
+* the text that they're parsed from, and are serialized as it. Their doubles are computed when
+* they're needed, e.g. by arithmetic, so formatting never changes them. Numbers in arrays are packed
+* as doubles either way.
+*/
+extern int JSONObjectNumberText;
+
 /**
 * Parses a JSON stored in `buf` of size `len` and creates an object.
 * The resulting object tree is stored in `node` and in case of error the optional `err` is set with
@@ -46,6 +64,85 @@
 */
 int CreateNodeFromJSON(const char *buf, size_t len, Node **node, char **err);
 
+/**
+* Like CreateNodeFromJSON, but the value is validated against a compiled schema as its nodes are
+* built, by jsonsl's callbacks. A value that doesn't match fails like an invalid JSON does, with an
+* error that gives the position and the reason, and containers are created with room for the entries
+* that the schema guarantees, see JSONSchema_Hint.
+*/
+int CreateNodeFromJSONSchema(const char *buf, size_t len, const JSONSchema *schema, Node **node,
+                             char **err);
+
+/**
+* Parses a JSON scalar without setting up a parser, for the single values that are the arguments of
+* most commands: a number, a boolean, a null or a string without escapes, with optional whitespace
+* around it. Returns JSONOBJECT_OK with `node` set, or JSONOBJECT_ERROR if the value isn't such a
+* scalar, and must be parsed by CreateNodeFromJSON then. CreateNodeFromJSON tries it first.
+*/
+int CreateScalarNodeFromJSON(const char *buf, size_t len, Node **node);
+
+/**
+* The JSON parser backends:
+* - JSONSL: builds the tree from the callbacks of the jsonsl lexer
+* - DIRECT: parses and builds the tree in a single pass, with containers created at their full size
+* CreateNodeFromJSON uses JSONSL, unless the project is built with the JSON_PARSER=direct option.
+*/
+typedef enum { JSONPARSER_JSONSL, JSONPARSER_DIRECT } JSONParser;
+
+/** Like CreateNodeFromJSON, but with the given parser backend */
+int CreateNodeFromJSONWith(JSONParser parser, const char *buf, size_t len, Node **node,
+                           char **err);
+
+/* The number of ranges of elements that every thread of CreateNodeFromJSONParallel parses */
+#define JSONOBJECT_PARALLEL_RANGES 4
+
+/**
+* Like CreateNodeFromJSON, but the elements of a top-level array or object are parsed by `threads`
+* threads, the calling one included. The elements are split into ranges of about the same size by
+* JSON_ScanSplit, and the threads take the ranges in turn and parse each in a container of its own,
+* whose elements are then moved to the root container in order. When the calling thread has an arena
+* (see Node_SetArena) every other thread builds in an arena of its own that is merged into it.
+* The result is the same as CreateNodeFromJSON's, which parses the JSON instead if there's a single
+* thread or range, and which parses it again for the error if it's invalid.
+*/
+int CreateNodeFromJSONParallel(const char *buf, size_t len, int threads, Node **node, char **err);
+
+/**
+* Checks that `buf` holds a valid JSON, like CreateNodeFromJSON does but without building the nodes,
+* in a single pass of the DIRECT parser. When `compact` is given the JSON is appended to it without
+* its insignificant whitespace. Returns JSONOBJECT_OK if the JSON is valid, otherwise the optional
+* `err` is set and `compact` is left as it was.
+*/
+int ValidateJSON(const char *buf, size_t len, sds *compact, char **err);
+
+/**
+* A parser of a JSON value that's given in chunks, e.g. that come in separate commands. It parses
+* with jsonsl like CreateNodeFromJSON and builds the value's nodes as their chunks are fed, keeping
+* only the bytes of a string or a number that continues in the next chunk.
+*/
+typedef struct JSONChunkParser JSONChunkParser;
+
+/** Creates a parser of a value */
+JSONChunkParser *NewJSONChunkParser(void);
+
+/**
+* Parses the next chunk of the value. On errors JSONOBJECT_ERROR is returned, the optional err is set
+* with the message that CreateNodeFromJSON would give, and the parser can only be freed.
+*/
+int JSONChunkParser_Feed(JSONChunkParser *p, const char *buf, size_t len, char **err);
+
+/**
+* Ends the value and stores it in node, which the caller owns. Returns JSONOBJECT_OK, or
+* JSONOBJECT_ERROR with the optional err set if the value is invalid or incomplete.
+*/
+int JSONChunkParser_Finish(JSONChunkParser *p, Node **node, char **err);
+
+/** The number of bytes that were fed to the parser */
+size_t JSONChunkParser_Length(const JSONChunkParser *p);
+
+/** Frees the parser, and the value's nodes unless it was finished */
+void JSONChunkParser_Free(JSONChunkParser *p);
+
 typedef struct {
     char *indentstr;   // indentation string
     char *newlinestr;  // linebreak string
@@ -57,4 +154,79 @@ typedef struct {
 */
 void SerializeNodeToJSON(const Node *node, const JSONSerializeOpt *opt, sds *json);
 
+/**
+* Produces the JSON serialization of an object from its binary encoding (see object_binary.h), as
+* SerializeNodeToJSON would of the object, without creating it. As it allocates no nodes it can run
+* on another thread than the one that owns the object's tree, once JSON_ScanKernel has been called.
+* Returns JSONOBJECT_OK, or JSONOBJECT_ERROR if the encoding is invalid and then json is unchanged.
+*/
+int SerializeBinaryToJSON(const char *buf, size_t len, const JSONSerializeOpt *opt, sds *json);
+
+/**
+* Produces the JSON serialization of an object from its n keys and values, as SerializeNodeToJSON
+* would of a dictionary of them, without building one.
+*/
+void SerializeKeyValuesToJSON(const char **keys, const size_t *keylens, Node **vals, int n,
+                              const JSONSerializeOpt *opt, sds *json);
+
+/**
+* A serializer of containers that are given a value at a time, e.g. the matches of a path. It
+* produces what SerializeNodeToJSON would of the container, without the container being built.
+* A container is opened with JSONSerializer_BeginArray or JSONSerializer_BeginDict, where every value
+* must follow its key, and is closed with JSONSerializer_End. Containers can nest up to
+* JSONSERIALIZER_MAX_LEVELS levels.
+*/
+typedef struct JSONSerializer JSONSerializer;
+
+/** Create a new serializer that appends to json */
+JSONSerializer *NewJSONSerializer(const JSONSerializeOpt *opt, sds json);
+
+/** Open an array in the current container */
+void JSONSerializer_BeginArray(JSONSerializer *s);
+
+/** Open a dictionary in the current container */
+void JSONSerializer_BeginDict(JSONSerializer *s);
+
+/** Add a key to the current dictionary, its value is the next one to be serialized */
+void JSONSerializer_Key(JSONSerializer *s, const char *key, size_t len);
+
+/** Add the serialization of a node to the current container, see JSONSerializer_SetWriter */
+void JSONSerializer_Value(JSONSerializer *s, const Node *n);
+
+/** Add the serialization of a node to the current container as it is, whatever the writer */
+void JSONSerializer_Node(JSONSerializer *s, const Node *n);
+
+/** Close the current container */
+void JSONSerializer_End(JSONSerializer *s);
+
+/* A consumer of a serializer's output, see JSONSerializer_SetFlush */
+typedef void (*JSONSerializeFlush)(const char *buf, size_t len, void *ctx);
+
+/**
+* Makes the serializer give its output to flush as it goes, in fragments that hold at least chunk
+* bytes (except for the last one, which JSONSerializer_Free gives) and about as many more as a
+* scalar takes, so that the serialization doesn't need to be held in full.
+*/
+void JSONSerializer_SetFlush(JSONSerializer *s, size_t chunk, JSONSerializeFlush flush,
+                             void *ctx);
+
+/* The most containers that a serializer can have open */
+#define JSONSERIALIZER_MAX_LEVELS 64
+
+/** The number of containers that are open */
+int JSONSerializer_Level(const JSONSerializer *s);
+
+/**
+* A writer of the values that a serializer is given, which JSONSerializer_Value calls instead of
+* serializing them as they are, e.g. to replace some of their nodes (see json_keyref.h). It writes
+* with the functions above, and with JSONSerializer_Node for the nodes that it keeps.
+*/
+typedef void (*JSONSerializeWriter)(JSONSerializer *s, const Node *n, void *ctx);
+
+/** Makes the serializer write the values it's given with a writer */
+void JSONSerializer_SetWriter(JSONSerializer *s, JSONSerializeWriter write, void *ctx);
+
+/** Free the serializer, and return the buffer it had appended to */
+sds JSONSerializer_Free(JSONSerializer *s);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,398 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sds.h>
+#include "json_patch.h"
+
+#define __jp_type(n) ((n) ? (n)->type : N_NULL)
+
+Node *JSONPatch_Merge(Node *target, Node *patch) {
+    if (N_DICT != __jp_type(patch)) return patch;
+
+    // a target that isn't a dictionary is replaced by one, that gets the patch's members in order
+    t_dict *o = &patch->value.dictval;
+    if (N_DICT != __jp_type(target)) target = NewDictNode(o->len);
+    for (uint32_t i = 0; i < o->len; i++) {
+        Node *kv = o->entries[i], *v = kv->value.kvval.val, *tv = NULL;
+        const char *key = kv->value.kvval.key;
+        if (!v) {
+            Node_DictDel(target, key);
+            continue;
+        }
+        int found = OBJ_OK == Node_DictGetInterned(target, key, &tv);
+        kv->value.kvval.val = NULL;  // taken by the target
+        Node *m = JSONPatch_Merge(tv, v);
+        if (!found || m != tv) Node_DictSet(target, key, m);
+    }
+    Node_Free(patch);
+    return target;
+}
+
+typedef enum { JP_ADD, JP_REMOVE, JP_REPLACE, JP_MOVE, JP_COPY, JP_TEST } _JPOpType;
+
+static const char *__jp_opnames[] = {"add", "remove", "replace", "move", "copy", "test"};
+
+/* An operation of a patch, the value of which is its keyval, so that add and replace can take it */
+typedef struct {
+    _JPOpType type;
+    sds path;
+    sds from;
+    Node *value;
+} _JPOp;
+
+/* A location that a pointer references: its container and its last token, or no container for the
+ * root. index is the token's index in an array, the array's length for "-", and -1 otherwise. */
+typedef struct {
+    Node *parent;
+    sds token;
+    int index;
+} _JPRef;
+
+/* Parses an array index, which has no leading zeros. Returns -1 if the token isn't one. */
+static int __jp_index(const sds tok) {
+    size_t len = sdslen(tok);
+    long long v = 0;
+    if (!len || len > 10 || ('0' == tok[0] && len > 1)) return -1;
+    for (size_t i = 0; i < len; i++) {
+        if (tok[i] < '0' || tok[i] > '9') return -1;
+        v = v * 10 + tok[i] - '0';
+    }
+    return v > INT_MAX ? -1 : (int)v;
+}
+
+/* Unescapes the token of a pointer in tok. Returns 0 if it has an invalid escape. */
+static int __jp_token(const char *s, size_t len, sds *tok) {
+    sdsclear(*tok);
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        if ('~' == c) {
+            if (++i == len || ('0' != s[i] && '1' != s[i])) return 0;
+            c = '0' == s[i] ? '~' : '/';
+        }
+        *tok = sdscatlen(*tok, &c, 1);
+    }
+    return 1;
+}
+
+/**
+* Resolves a pointer up to its last token. Returns OBJ_ERR if the pointer is invalid, or if the
+* value that the token is of doesn't exist or isn't a container. Items of packed arrays are only
+* viewed, they're scalars.
+*/
+static int __jp_resolve(Node *root, const sds ptr, _JPRef *ref) {
+    Node *n = root, tmp;
+    const char *p = ptr, *end = ptr + sdslen(ptr);
+
+    ref->parent = NULL;
+    if (p == end) return OBJ_OK;
+    if ('/' != *p++) return OBJ_ERR;
+    for (;;) {
+        const char *slash = memchr(p, '/', end - p);
+        if (!__jp_token(p, (slash ? slash : end) - p, &ref->token)) return OBJ_ERR;
+        if (!slash) break;
+        if (N_DICT == __jp_type(n)) {
+            if (OBJ_OK != Node_DictGet(n, ref->token, &n)) return OBJ_ERR;
+        } else if (N_ARRAY == __jp_type(n)) {
+            if (OBJ_OK != Node_ArrayItemView(n, __jp_index(ref->token), &tmp, &n)) return OBJ_ERR;
+        } else {
+            return OBJ_ERR;
+        }
+        p = slash + 1;
+    }
+
+    if (N_DICT == __jp_type(n)) {
+        ref->index = -1;
+    } else if (N_ARRAY == __jp_type(n)) {
+        ref->index = strcmp(ref->token, "-") ? __jp_index(ref->token) : Node_Length(n);
+    } else {
+        return OBJ_ERR;
+    }
+    ref->parent = n;
+    return OBJ_OK;
+}
+
+/* Gets the value at a resolved location into v, an item of a packed array as a view in tmp */
+static int __jp_get(Node *root, const _JPRef *ref, Node *tmp, Node **v) {
+    if (!ref->parent) {
+        *v = root;
+        return OBJ_OK;
+    }
+    if (N_DICT == ref->parent->type) return Node_DictGet(ref->parent, ref->token, v);
+    return Node_ArrayItemView(ref->parent, ref->index, tmp, v);
+}
+
+/* Adds a value at a resolved location, the root and a dictionary's member are replaced and an array
+ * item is inserted. The value is taken unless OBJ_ERR is returned. */
+static int __jp_add(Node **root, const _JPRef *ref, Node *v) {
+    Node *p = ref->parent;
+    if (!p) {
+        Node_Free(*root);
+        *root = v;
+        return OBJ_OK;
+    }
+    if (N_DICT == p->type) return Node_DictSet(p, ref->token, v);
+
+    int len = Node_Length(p);
+    if (ref->index < 0 || ref->index > len) return OBJ_ERR;
+    if (ref->index == len) return Node_ArrayAppend(p, v);
+    Node *sub = NewArrayNode(1);
+    Node_ArrayAppend(sub, v);
+    return Node_ArrayInsert(p, ref->index, sub);
+}
+
+/* Removes the value at a resolved location, which can't be the root. The value is put into the
+ * optional v, or freed. */
+static int __jp_remove(const _JPRef *ref, Node **v) {
+    Node *p = ref->parent;
+    if (!p) return OBJ_ERR;
+    if (N_DICT == p->type) return v ? Node_DictTake(p, ref->token, v) : Node_DictDel(p, ref->token);
+    if (ref->index < 0 || ref->index >= Node_Length(p)) return OBJ_ERR;
+    if (v) {
+        Node_ArrayItem(p, ref->index, v);
+        Node_ArraySet(p, ref->index, NULL);
+    }
+    return Node_ArrayDelRange(p, ref->index, 1);
+}
+
+/* Replaces the existing value at a resolved location. The value is taken unless OBJ_ERR is
+ * returned. */
+static int __jp_replace(Node **root, const _JPRef *ref, Node *v) {
+    Node *p = ref->parent, *old;
+    if (p && N_DICT == p->type) {
+        if (OBJ_OK != Node_DictGet(p, ref->token, &old)) return OBJ_ERR;
+        return Node_DictSet(p, ref->token, v);
+    }
+    if (p) {
+        if (OBJ_OK != Node_ArrayItem(p, ref->index, &old)) return OBJ_ERR;
+        Node_ArraySet(p, ref->index, v);
+        Node_Free(old);
+        return OBJ_OK;
+    }
+    return __jp_add(root, ref, v);
+}
+
+/* Copies a value, or the view of a packed array's item, which Node_Clone would return as it is */
+static Node *__jp_clone(const Node *n) {
+    if (n && (n->flags & NODE_F_STATIC)) {
+        if (N_INTEGER == n->type) return NewIntNode(n->value.intval);
+        if (N_NUMBER == n->type) return NewDoubleNode(n->value.numval);
+    }
+    return Node_Clone(n);
+}
+
+/* Checks whether two values are equal, numbers are compared by their values whatever their types */
+static int __jp_equal(Node *a, Node *b) {
+    NodeType ta = __jp_type(a), tb = __jp_type(b);
+
+    if ((ta & (N_INTEGER | N_NUMBER)) && (tb & (N_INTEGER | N_NUMBER))) {
+        if (N_INTEGER == ta && N_INTEGER == tb) return a->value.intval == b->value.intval;
+        return (N_INTEGER == ta ? (double)a->value.intval : Node_Number(a)) ==
+               (N_INTEGER == tb ? (double)b->value.intval : Node_Number(b));
+    }
+    if (ta != tb) return 0;
+    switch (ta) {
+        case N_NULL:
+            return 1;
+        case N_BOOLEAN:
+            return !a->value.boolval == !b->value.boolval;
+        case N_STRING: {
+            char *tmpa, *tmpb;
+            if (a->value.strval.len != b->value.strval.len) return 0;
+            int eq = !memcmp(Node_StringData(a, &tmpa), Node_StringData(b, &tmpb),
+                             a->value.strval.len);
+            free(tmpa);
+            free(tmpb);
+            return eq;
+        }
+        case N_ARRAY: {
+            int len = Node_Length(a);
+            if (len != Node_Length(b)) return 0;
+            for (int i = 0; i < len; i++) {
+                Node tmpa, tmpb, *ia, *ib;
+                Node_ArrayItemView(a, i, &tmpa, &ia);
+                Node_ArrayItemView(b, i, &tmpb, &ib);
+                if (!__jp_equal(ia, ib)) return 0;
+            }
+            return 1;
+        }
+        case N_DICT: {
+            const t_dict *o = &a->value.dictval;
+            if (o->len != b->value.dictval.len) return 0;
+            for (uint32_t i = 0; i < o->len; i++) {
+                Node *vb;
+                if (OBJ_OK != Node_DictGetInterned(b, o->entries[i]->value.kvval.key, &vb) ||
+                    !__jp_equal(o->entries[i]->value.kvval.val, vb))
+                    return 0;
+            }
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+/* Applies an operation to the document at root. Returns the reason it failed, or NULL. */
+static const char *__jp_apply(Node **root, _JPOp *op, _JPRef *path, _JPRef *from) {
+    Node tmp, *v;
+
+    // a moved value is taken from its location before the path is resolved
+    if (JP_MOVE == op->type || JP_COPY == op->type) {
+        if (OBJ_OK != __jp_resolve(*root, op->from, from) ||
+            OBJ_OK != __jp_get(*root, from, &tmp, &v))
+            return "the from location doesn't exist";
+        if (JP_MOVE == op->type) {
+            if (!strcmp(op->from, op->path)) return NULL;
+            size_t len = sdslen(op->from);
+            if (!strncmp(op->from, op->path, len) && '/' == op->path[len])
+                return "a value can't be moved into itself";
+            if (OBJ_OK != __jp_remove(from, &v)) return "the root can't be moved";
+        } else {
+            v = __jp_clone(v);
+        }
+        if (OBJ_OK != __jp_resolve(*root, op->path, path) || OBJ_OK != __jp_add(root, path, v)) {
+            Node_Free(v);
+            return "the path's parent doesn't exist";
+        }
+        return NULL;
+    }
+
+    if (OBJ_OK != __jp_resolve(*root, op->path, path)) return "the path's parent doesn't exist";
+    switch (op->type) {
+        case JP_ADD:
+            if (OBJ_OK != __jp_add(root, path, op->value->value.kvval.val))
+                return "the index is out of range";
+            op->value->value.kvval.val = NULL;  // taken by the document
+            return NULL;
+        case JP_REMOVE:
+            if (!path->parent) return "the root can't be removed";
+            return OBJ_OK == __jp_remove(path, NULL) ? NULL : "the path doesn't exist";
+        case JP_REPLACE:
+            if (OBJ_OK != __jp_replace(root, path, op->value->value.kvval.val))
+                return "the path doesn't exist";
+            op->value->value.kvval.val = NULL;
+            return NULL;
+        default:  // JP_TEST
+            if (OBJ_OK != __jp_get(*root, path, &tmp, &v)) return "the path doesn't exist";
+            return __jp_equal(v, op->value->value.kvval.val) ? NULL : "the test failed";
+    }
+}
+
+/* Gets an operation's members from its dictionary. Returns the reason it's invalid, or NULL. */
+static const char *__jp_parse(Node *n, _JPOp *op) {
+    Node *type = NULL, *path = NULL, *from = NULL;
+
+    if (N_DICT != __jp_type(n)) return "not an object";
+    for (uint32_t i = 0; i < n->value.dictval.len; i++) {
+        Node *kv = n->value.dictval.entries[i];
+        const char *key = kv->value.kvval.key;
+        if (!strcmp("op", key)) type = kv->value.kvval.val;
+        else if (!strcmp("path", key)) path = kv->value.kvval.val;
+        else if (!strcmp("from", key)) from = kv->value.kvval.val;
+        else if (!strcmp("value", key)) op->value = kv;
+    }
+
+    if (N_STRING != __jp_type(type)) return "the op must be a string";
+    for (op->type = JP_ADD; op->type <= JP_TEST; op->type++) {
+        if (type->value.strval.len == strlen(__jp_opnames[op->type]) &&
+            !memcmp(type->value.strval.data, __jp_opnames[op->type], type->value.strval.len))
+            break;
+    }
+    if (op->type > JP_TEST) return "unknown op";
+    if (N_STRING != __jp_type(path)) return "the path must be a string";
+    if ((JP_MOVE == op->type || JP_COPY == op->type) && N_STRING != __jp_type(from))
+        return "the from location must be a string";
+    if ((JP_ADD == op->type || JP_REPLACE == op->type || JP_TEST == op->type) && !op->value)
+        return "missing value";
+
+    char *tmp;
+    const char *s = Node_StringData(path, &tmp);
+    op->path = sdsnewlen(s, path->value.strval.len);
+    free(tmp);
+    if (from) {
+        s = Node_StringData(from, &tmp);
+        op->from = sdsnewlen(s, from->value.strval.len);
+        free(tmp);
+    }
+    return NULL;
+}
+
+int JSONPatch_Apply(Node **root, Node *patch, char **err) {
+    char msg[256];
+    const char *reason = NULL;
+    int failed = -1;  // the failed operation
+    int ret = OBJ_ERR;
+
+    if (N_ARRAY != __jp_type(patch)) {
+        if (err) *err = strdup("ERR a JSON Patch must be an array of operations");
+        Node_Free(patch);
+        return OBJ_ERR;
+    }
+
+    // all the operations are valid before any is applied
+    int nops = Node_Length(patch);
+    _JPOp *ops = calloc(nops ? nops : 1, sizeof(_JPOp));
+    for (int i = 0; i < nops && !reason; i++) {
+        Node tmp, *n;
+        Node_ArrayItemView(patch, i, &tmp, &n);
+        if ((reason = __jp_parse(n, &ops[i]))) failed = i;
+    }
+    if (reason) {
+        snprintf(msg, sizeof(msg), "ERR JSON Patch operation %d is invalid - %s", failed, reason);
+        goto done;
+    }
+
+    /* The document is changed in place if its operations are tests but for the last one, which
+     * fails before changing it. Otherwise they are applied to a copy, that's discarded if one of
+     * them fails. */
+    int copy = 0;
+    for (int i = 0; i < nops; i++) {
+        if (JP_TEST != ops[i].type) {
+            copy = JP_MOVE == ops[i].type || i < nops - 1;
+            break;
+        }
+    }
+    Node *doc = copy ? Node_Clone(*root) : *root;
+    _JPRef path = {NULL, sdsempty(), -1}, from = {NULL, sdsempty(), -1};
+    for (int i = 0; i < nops && !reason; i++) {
+        if ((reason = __jp_apply(&doc, &ops[i], &path, &from))) failed = i;
+    }
+    sdsfree(path.token);
+    sdsfree(from.token);
+    if (reason) {
+        if (copy) Node_Free(doc);
+        snprintf(msg, sizeof(msg), "ERR JSON Patch operation %d (%s) failed - %s", failed,
+                 __jp_opnames[ops[failed].type], reason);
+        goto done;
+    }
+    if (copy) Node_Free(*root);
+    *root = doc;
+    ret = OBJ_OK;
+
+done:
+    if (OBJ_OK != ret && err) *err = strdup(msg);
+    for (int i = 0; i < nops; i++) {
+        sdsfree(ops[i].path);
+        sdsfree(ops[i].from);
+    }
+    free(ops);
+    Node_Free(patch);
+    return ret;
+}
@@ -0,0 +1,50 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __JSON_PATCH_H__
+#define __JSON_PATCH_H__
+
+#include "object.h"
+
+/**
+* JSON Merge Patch (RFC 7386) and JSON Patch (RFC 6902) of node trees. Patches are parsed like any
+* other value, and their values are moved into the document instead of being copied, so applying a
+* patch consumes it.
+*
+* The paths of JSON Patch operations are JSON Pointers (RFC 6901): "" is the root, and every
+* "/token" is a dictionary's key or an array's index, with "~1" for '/' and "~0" for '~' in keys.
+* The index "-" is past an array's last item, where "add" appends.
+*/
+
+/**
+* Merges a patch into a target: a dictionary patch sets its members in the target, deleting those
+* that are null and merging those that are dictionaries, and any other patch replaces the target.
+* Returns the merged value, which is the target unless it's replaced. A target that's replaced
+* isn't freed.
+*/
+Node *JSONPatch_Merge(Node *target, Node *patch);
+
+/**
+* Applies the operations of a JSON Patch, an array of them, to the document at root. Either all of
+* them are applied, or none is: returns OBJ_OK, or OBJ_ERR with root unchanged if a validation or an
+* operation fails, and then sets the optional err with a message that the caller frees.
+* A patch whose operations after the tests are more than a single add, remove, replace or copy is
+* applied to a copy of the document, that replaces it on success.
+*/
+int JSONPatch_Apply(Node **root, Node *patch, char **err);
+
+#endif
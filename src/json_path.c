@@ -16,6 +16,35 @@
 */
 
 #include "json_path.h"
+#include "path_filter.h"
+
+/* Parses the start, end and step of a slice, each of which can be omitted, into vals */
+static char *__parseSlice(const char *s, size_t len, int vals[3]) {
+    int n = 0;
+    size_t i = 0;
+    vals[0] = 0;
+    vals[1] = SEARCHPATH_SLICE_END;
+    vals[2] = 1;
+    while (i <= len) {
+        if (n == 3) return JSON_PATH_SLICE_ERR;
+        int neg = i < len && '-' == s[i];
+        size_t start = i += neg;
+        int64_t num = 0;
+        for (; i < len && isdigit(s[i]); i++) {
+            // big numbers are out of any array's bounds anyway
+            if (num <= INT_MAX) num = num * 10 + s[i] - '0';
+        }
+        if (i < len && ':' != s[i]) return JSON_PATH_SLICE_ERR;
+        if (i > start) {
+            vals[n] = (int)MIN(num, INT_MAX) * (neg ? -1 : 1);
+        } else if (neg) {
+            return JSON_PATH_NEGATIVE_NUMBER_ERR;
+        }
+        n++;
+        i++;  // skip the colon
+    }
+    return vals[2] > 0 ? NULL : JSON_PATH_SLICE_STEP_ERR;
+}
 
 int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPathError_t *err) {
     tokenizerState st = S_NULL;
@@ -25,6 +54,7 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
     tok.s = pos;
     tok.len = 0;
     char *jsperr = NULL;
+    PathFilter *filter = NULL;
     while (offset < len) {
         char c = *pos;
         switch (st) {
@@ -41,6 +71,13 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
                         tok.s++;
                         st = S_BRACKET;
                         break;
+                    // a wildcard at the beginning means all of the root's children
+                    case '*':
+                        tok.type = T_WILDCARD;
+                        st = S_STAR;
+                        pos++;
+                        offset++;
+                        goto tokenend;
                     default:
                         // only letters, dollar signs and underscores are allowed at the beginning
                         if (isalpha(c) || '$' == c || '_' == c) {
@@ -73,6 +110,33 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
                     // this could be the beginning of a negative index
                     tok.len++;
                     st = S_MINUS;
+                } else if (':' == c) {
+                    // a slice from the beginning
+                    tok.len++;
+                    st = S_SLICE;
+                } else if ('*' == c) {
+                    st = S_BSTAR;
+                } else if ('?' == c) {
+                    // a filter, that's compiled as a whole
+                    size_t consumed, erroffset;
+                    filter = PathFilter_Parse(pos + 1, len - offset - 1, &consumed, &jsperr,
+                                              &erroffset);
+                    if (!filter) {
+                        offset += 1 + erroffset;
+                        goto syntaxerror;
+                    }
+                    pos += 1 + consumed;
+                    offset += 1 + consumed;
+                    if (offset == len || ']' != *pos) {
+                        PathFilter_Free(filter);
+                        jsperr = JSON_PATH_FILTER_BRACKET_ERR;
+                        goto syntaxerror;
+                    }
+                    st = S_NULL;
+                    tok.type = T_FILTER;
+                    pos++;
+                    offset++;
+                    goto tokenend;
                 } else {
                     jsperr = JSON_PATH_BRACKET_FIRST_CHAR_ERR;
                     goto syntaxerror;
@@ -82,10 +146,28 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
             // we're after a dot
             case S_ROOT:
             case S_DOT:
+            case S_DESCENT:
                 // start of ident token, can only be a letter, dollar sign or underscore
                 if (isalpha(c) || '$' == c || '_' == c) {
                     tok.len++;
                     st = S_IDENT;
+                } else if ('*' == c) {
+                    tok.type = T_WILDCARD;
+                    st = S_STAR;
+                    pos++;
+                    offset++;
+                    goto tokenend;
+                } else if ('.' == c && S_DESCENT != st) {
+                    // a second dot is recursive descent
+                    tok.type = T_DESCENT;
+                    st = S_DESCENT;
+                    pos++;
+                    offset++;
+                    goto tokenend;
+                } else if ('[' == c && S_DESCENT == st) {
+                    // recursive descent to a subscript
+                    tok.s++;
+                    st = S_BRACKET;
                 } else {
                     jsperr = JSON_PATH_IDENT_FIRST_CHAR_ERR;
                     goto syntaxerror;
@@ -105,9 +187,51 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
                     offset++;
                     goto tokenend;
                 }
+                if (c == ':') {
+                    tok.len++;
+                    st = S_SLICE;
+                    break;
+                }
                 jsperr = JSON_PATH_NUMBER_ERR;
                 goto syntaxerror;
 
+            // we're within a slice, its integers are parsed at its end
+            case S_SLICE:
+                if (isdigit(c) || '-' == c || ':' == c) {
+                    tok.len++;
+                    break;
+                }
+                if (c == ']') {
+                    st = S_NULL;
+                    tok.type = T_SLICE;
+                    pos++;
+                    offset++;
+                    goto tokenend;
+                }
+                jsperr = JSON_PATH_SLICE_ERR;
+                goto syntaxerror;
+
+            // we're after a wildcard, which must be the end of a token
+            case S_STAR:
+                if (c == '.' || c == '[') {
+                    tok.s++;
+                    st = c == '.' ? S_DOT : S_BRACKET;
+                    break;
+                }
+                jsperr = JSON_PATH_WILDCARD_ERR;
+                goto syntaxerror;
+
+            case S_BSTAR:
+                if (c == ']') {
+                    st = S_NULL;
+                    tok.type = T_WILDCARD;
+                    pos++;
+                    offset++;
+                    goto tokenend;
+                }
+                jsperr = JSON_PATH_BRACKET_WILDCARD_ERR;
+                goto syntaxerror;
+
             // we're within an ident string
             case S_IDENT:
                 // end of ident
@@ -194,6 +318,20 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
             }
             if ('-' == tok.s[0]) num = -num;
             SearchPath_AppendIndex(path, num);
+        } else if (T_SLICE == tok.type) {
+            int vals[3];
+            if ((jsperr = __parseSlice(tok.s, tok.len, vals))) {
+                offset--;  // at the closing bracket
+                goto syntaxerror;
+            }
+            SearchPath_AppendSlice(path, vals[0], vals[1], vals[2]);
+        } else if (T_WILDCARD == tok.type) {
+            SearchPath_AppendWildcard(path);
+        } else if (T_DESCENT == tok.type) {
+            SearchPath_AppendDescent(path);
+        } else if (T_FILTER == tok.type) {
+            SearchPath_AppendFilter(path, filter);
+            filter = NULL;
         } else if (T_KEY == tok.type) {
             if (1 == offset == len && '.' == c) {  // check for root
                 SearchPath_AppendRoot(path);
@@ -207,9 +345,10 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
     }  // while (offset < len)
 
     // these are the only legal states at the end of consuming the string
-    if (st == S_NULL || st == S_IDENT || st == S_ROOT) {
+    if (st == S_NULL || st == S_IDENT || st == S_ROOT || st == S_STAR) {
         return PARSE_OK;
     }
+    jsperr = JSON_PATH_INCOMPLETE_ERR;
 
 syntaxerror:
     if (err) {
@@ -36,11 +36,21 @@
 #define JSON_PATH_NUMBER_ERR "expecting a digit - that's what integers are made of - or a closing bracket"
 #define JSON_PATH_NEGATIVE_NUMBER_ERR "expecting a digit - a negative integer must have at least one"
 #define JSON_PATH_MISSING_BRACKET_ERR "expecting a right square bracket after a string identifier"
+#define JSON_PATH_INCOMPLETE_ERR "the path ends in the middle of a token"
+#define JSON_PATH_WILDCARD_ERR "expecting a dot, a left square bracket or the end of the path after a wildcard"
+#define JSON_PATH_BRACKET_WILDCARD_ERR "expecting a right square bracket after a wildcard"
+#define JSON_PATH_SLICE_ERR "a slice can only contain up to three integers separated by colons"
+#define JSON_PATH_SLICE_STEP_ERR "the step of a slice must be a positive integer"
+#define JSON_PATH_FILTER_BRACKET_ERR "expecting a right square bracket after a filter"
 
 // token type identifier
 typedef enum {
     T_KEY,
     T_INDEX,
+    T_SLICE,
+    T_WILDCARD,
+    T_DESCENT,
+    T_FILTER,
 } tokenType;
 
 // tokenizer state
@@ -54,6 +64,10 @@ typedef enum {
     S_BRACKET, // subscript (could be a key or an index)
     S_DOT,     // child separator
     S_MINUS,   // a negative index
+    S_SLICE,   // a slice, after its first colon
+    S_STAR,    // a wildcard after a dot
+    S_BSTAR,   // a wildcard in square brackets
+    S_DESCENT, // recursive descent, i.e. a second dot
 } tokenizerState;
 
 // the token we're now on
@@ -78,6 +92,15 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
 *   foo.bar.baz[3]
 *   foo["bar"]["baz"][3]
 *   foo[3]
+* that can also select multiple values with array slices, wildcards and recursive descent, e.g.:
+*   items[0:100].price
+*   items[-2:]
+*   items[::2]
+*   foo.*.bar
+*   foo[*]
+*   ..price
+* and filter arrays' items and dictionaries' values with predicates (see path_filter.h), e.g.:
+*   orders[?(@.status == "open" && @.total > 100)].id
 *
 * `json` is the path and `len` is its length. `path` is a pointer to the resulting search path, and
 * `err` is an optional error container.
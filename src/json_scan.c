@@ -0,0 +1,296 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "json_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+typedef const char *(*ScanFunc)(const char *p, const char *end);
+
+#define __scan_escaped(c) ((c) < 0x20 || (c) > 0x7e || '"' == (c) || '\\' == (c) || '/' == (c))
+
+#define __scan_stringend(c) ((c) < 0x20 || '"' == (c) || '\\' == (c))
+
+static const char *__scan_scalar(const char *p, const char *end) {
+    while (p < end && !__scan_escaped((unsigned char)*p)) p++;
+    return p;
+}
+
+static const char *__scanstr_scalar(const char *p, const char *end) {
+    while (p < end && !__scan_stringend((unsigned char)*p)) p++;
+    return p;
+}
+
+#if defined(SCAN_X86) && defined(__SSE2__)
+static const char *__scan_sse2(const char *p, const char *end) {
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i rsolidus = _mm_set1_epi8('\\');
+    const __m128i solidus = _mm_set1_epi8('/');
+
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        // the signed comparison catches the control characters and the non-ASCII bytes at once
+        __m128i m = _mm_cmplt_epi8(v, space);
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, del));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, quote));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, rsolidus));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, solidus));
+        int mask = _mm_movemask_epi8(m);
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return __scan_scalar(p, end);
+}
+
+static const char *__scanstr_sse2(const char *p, const char *end) {
+    const __m128i ctl = _mm_set1_epi8(0x1f);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i rsolidus = _mm_set1_epi8('\\');
+
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i m = _mm_cmpeq_epi8(_mm_min_epu8(v, ctl), v);  // unsigned v <= 0x1f
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, quote));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, rsolidus));
+        int mask = _mm_movemask_epi8(m);
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return __scanstr_scalar(p, end);
+}
+#endif
+
+#if defined(SCAN_X86) && defined(__SSE2__)
+__attribute__((target("avx2"))) static const char *__scan_avx2(const char *p, const char *end) {
+    const __m256i space = _mm256_set1_epi8(0x20);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i rsolidus = _mm256_set1_epi8('\\');
+    const __m256i solidus = _mm256_set1_epi8('/');
+
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i m = _mm256_cmpgt_epi8(space, v);
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, del));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, quote));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, rsolidus));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, solidus));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return __scan_sse2(p, end);  // for the remaining 16 bytes, if there are as many
+}
+
+__attribute__((target("avx2"))) static const char *__scanstr_avx2(const char *p, const char *end) {
+    const __m256i ctl = _mm256_set1_epi8(0x1f);
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i rsolidus = _mm256_set1_epi8('\\');
+
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i m = _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctl), v);
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, quote));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, rsolidus));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return __scanstr_sse2(p, end);
+}
+#endif
+
+#if defined(SCAN_NEON)
+static const char *__scan_neon(const char *p, const char *end) {
+    const uint8x16_t space = vdupq_n_u8(0x20);
+    const uint8x16_t del = vdupq_n_u8(0x7f);
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t rsolidus = vdupq_n_u8('\\');
+    const uint8x16_t solidus = vdupq_n_u8('/');
+
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)p);
+        uint8x16_t m = vorrq_u8(vcltq_u8(v, space), vcgeq_u8(v, del));
+        m = vorrq_u8(m, vceqq_u8(v, quote));
+        m = vorrq_u8(m, vceqq_u8(v, rsolidus));
+        m = vorrq_u8(m, vceqq_u8(v, solidus));
+        if (vmaxvq_u8(m)) return __scan_scalar(p, p + 16);
+        p += 16;
+    }
+    return __scan_scalar(p, end);
+}
+
+static const char *__scanstr_neon(const char *p, const char *end) {
+    const uint8x16_t space = vdupq_n_u8(0x20);
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t rsolidus = vdupq_n_u8('\\');
+
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)p);
+        uint8x16_t m = vorrq_u8(vcltq_u8(v, space), vceqq_u8(v, quote));
+        m = vorrq_u8(m, vceqq_u8(v, rsolidus));
+        if (vmaxvq_u8(m)) return __scanstr_scalar(p, p + 16);
+        p += 16;
+    }
+    return __scanstr_scalar(p, end);
+}
+#endif
+
+static const struct {
+    const char *name;
+    ScanFunc escape;  // JSON_ScanEscape
+    ScanFunc string;  // JSON_ScanString
+} _kernels[] = {
+#if defined(SCAN_X86) && defined(__SSE2__)
+    {"avx2", __scan_avx2, __scanstr_avx2},
+    {"sse2", __scan_sse2, __scanstr_sse2},
+#endif
+#if defined(SCAN_NEON)
+    {"neon", __scan_neon, __scanstr_neon},
+#endif
+    {"scalar", __scan_scalar, __scanstr_scalar},
+};
+
+#define SCAN_NKERNELS (sizeof(_kernels) / sizeof(_kernels[0]))
+
+static int __scan_supported(const char *name) {
+#if defined(SCAN_X86)
+    __builtin_cpu_init();
+    if (!strcmp("avx2", name)) return __builtin_cpu_supports("avx2");
+#endif
+    (void)name;
+    return 1;
+}
+
+static const char *__scan_resolveescape(const char *p, const char *end);
+static const char *__scan_resolvestring(const char *p, const char *end);
+
+static ScanFunc _scanEscape = __scan_resolveescape;
+static ScanFunc _scanString = __scan_resolvestring;
+static const char *_scanName = NULL;
+
+static void __scan_use(size_t i) {
+    _scanName = _kernels[i].name;
+    _scanEscape = _kernels[i].escape;
+    _scanString = _kernels[i].string;
+}
+
+/* Picks the first supported kernel, the kernels are ordered by preference */
+static void __scan_resolve(void) {
+    for (size_t i = 0; i < SCAN_NKERNELS; i++) {
+        if (__scan_supported(_kernels[i].name)) {
+            __scan_use(i);
+            return;
+        }
+    }
+}
+
+static const char *__scan_resolveescape(const char *p, const char *end) {
+    __scan_resolve();
+    return _scanEscape(p, end);
+}
+
+static const char *__scan_resolvestring(const char *p, const char *end) {
+    __scan_resolve();
+    return _scanString(p, end);
+}
+
+const char *JSON_ScanEscape(const char *p, const char *end) { return _scanEscape(p, end); }
+
+const char *JSON_ScanString(const char *p, const char *end) { return _scanString(p, end); }
+
+const char *JSON_ScanKernel(void) {
+    if (!_scanName) __scan_resolve();
+    return _scanName;
+}
+
+int JSON_ScanUseKernel(const char *name) {
+    for (size_t i = 0; i < SCAN_NKERNELS; i++) {
+        if (!strcmp(_kernels[i].name, name) && __scan_supported(name)) {
+            __scan_use(i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* The characters that the structure of a JSON is made of */
+static const char _scanStructural[0x100] = {
+    ['"'] = 1, [','] = 1, ['['] = 1, [']'] = 1, ['{'] = 1, ['}'] = 1,
+};
+
+#define __scan_space(c) (' ' == (c) || '\n' == (c) || '\r' == (c) || '\t' == (c))
+
+int JSON_ScanSplit(const char *buf, size_t len, int parts, size_t *cuts, size_t *count) {
+    const char *p = buf, *end = buf + len;
+    size_t depth = 0, commas = 0, size = parts > 0 ? len / parts : len;
+    int n = 0;
+
+    while (p < end && __scan_space(*p)) p++;
+    if (p == end || parts < 1 || ('[' != *p && '{' != *p)) return 0;
+    cuts[0] = p - buf;
+    for (; p < end; p++) {
+        if (!_scanStructural[(unsigned char)*p]) continue;
+        switch (*p) {
+            case '"':
+                // to the closing quote, past escapes and anything else that interrupts the scan
+                for (p++;; p++) {
+                    p = JSON_ScanString(p, end);
+                    if (p == end) return 0;
+                    if ('"' == *p) break;
+                    if ('\\' == *p && ++p == end) return 0;
+                }
+                break;
+            case '[':
+            case '{':
+                depth++;
+                break;
+            case ',':
+                // a range ends at the first comma of the top level past its share of the input
+                if (1 != depth) break;
+                commas++;
+                if (n + 1 < parts && (size_t)(p - buf) >= size * (n + 1)) cuts[++n] = p - buf;
+                break;
+            default:
+                if (--depth) break;
+                if ((']' == *p) != ('[' == buf[cuts[0]])) return 0;
+                cuts[++n] = p - buf;
+                for (p++; p < end; p++) {
+                    if (!__scan_space(*p)) return 0;
+                }
+
+                // an empty container has nothing to split
+                if (!commas) {
+                    p = buf + cuts[0] + 1;
+                    while (p < buf + cuts[1] && __scan_space(*p)) p++;
+                    if (p == buf + cuts[1]) return 0;
+                }
+                *count = commas + 1;
+                return n;
+        }
+    }
+    return 0;
+}
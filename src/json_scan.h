@@ -0,0 +1,59 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __JSON_SCAN_H__
+#define __JSON_SCAN_H__
+
+/**
+* Returns the first character in [p, end) that needs escaping in a JSON string value, or end if
+* there's none. These are the quotation mark, the reverse solidus, the solidus and the characters
+* that aren't printable ASCII.
+* The scan is done by the best kernel that the CPU supports (AVX2, SSE2, NEON or scalar), which is
+* picked on the first call.
+*/
+const char *JSON_ScanEscape(const char *p, const char *end);
+
+/**
+* Returns the first character in [p, end) that ends or interrupts the raw contents of a JSON string,
+* or end if there's none. These are the quotation mark, the reverse solidus and control characters.
+* It uses the same kernel as JSON_ScanEscape.
+*/
+const char *JSON_ScanString(const char *p, const char *end);
+
+/** The name of the kernel that the scans use */
+const char *JSON_ScanKernel(void);
+
+/**
+* Makes the scans use the named kernel, for testing and benchmarking.
+* Returns 1 on success or 0 if the kernel isn't available.
+*/
+int JSON_ScanUseKernel(const char *name);
+
+/**
+* Splits the elements of the top-level array or object of the JSON in [buf, buf + len) into at most
+* `parts` ranges of consecutive elements of about the same size, so they can be parsed apart. Sets
+* cuts[0] to the offset of the container's opening bracket, cuts[i] to the offset of the comma that
+* ends range i - 1 and cuts[n] to the offset of the closing bracket, where n is the number of ranges
+* that is returned: range i lies between cuts[i] and cuts[i + 1]. cuts must have room for parts + 1
+* offsets. count is set to the number of the container's elements.
+* Only the structure is scanned, skipping strings with JSON_ScanString: 0 is returned if the JSON
+* isn't a container with elements whose brackets match and that only whitespace follows, but the
+* ranges themselves aren't validated.
+*/
+int JSON_ScanSplit(const char *buf, size_t len, int parts, size_t *cuts, size_t *count);
+
+#endif
@@ -0,0 +1,622 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "json_schema.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+/* The types of values that a rule allows, where integers are also the numbers without fractions */
+#define SCHEMA_T_NULL 0x1
+#define SCHEMA_T_BOOLEAN 0x2
+#define SCHEMA_T_INTEGER 0x4
+#define SCHEMA_T_FRACTION 0x8
+#define SCHEMA_T_STRING 0x10
+#define SCHEMA_T_ARRAY 0x20
+#define SCHEMA_T_OBJECT 0x40
+#define SCHEMA_T_ALL 0x7f
+
+/* The bounds of numbers that a rule has */
+#define SCHEMA_F_MIN 0x1
+#define SCHEMA_F_XMIN 0x2
+#define SCHEMA_F_MAX 0x4
+#define SCHEMA_F_XMAX 0x8
+#define SCHEMA_F_MULTIPLE 0x10
+
+/* The rule of a subschema, whose members and constants are ranges of the schema's tables */
+typedef struct {
+    uint32_t types;
+    uint32_t flags;
+    double min, xmin, max, xmax, multiple;
+    uint32_t minlen, maxlen;  // the length of strings in characters
+    uint32_t minitems, maxitems;
+    uint32_t minprops, maxprops;
+    int items;                // the rule of arrays' items
+    int additional;           // the rule of objects' members that aren't properties
+    uint32_t props, nprops;   // sorted by key
+    uint32_t required, nrequired;
+    uint32_t enums, nenums;   // the values of enum or const, when nenums isn't 0
+} JSONSchemaRule;
+
+typedef struct {
+    char *key;
+    int rule;
+} JSONSchemaProp;
+
+/* A scalar of enum or const, numbers of both types are compared by value */
+typedef struct {
+    NodeType type;
+    int64_t intval;
+    double numval;
+    char *str;
+    uint32_t len;
+} JSONSchemaConst;
+
+struct JSONSchema {
+    JSONSchemaRule *rules;
+    size_t len, cap;
+    JSONSchemaProp *props;
+    size_t nprops, capprops;
+    char **required;
+    size_t nrequired, caprequired;
+    JSONSchemaConst *enums;
+    size_t nenums, capenums;
+};
+
+/* The rule of the schema false, which no value matches */
+#define SCHEMA_NONE -2
+
+/* Sets the optional error of a compilation */
+static void __sc_error(char **err, const char *fmt, ...) {
+    if (!err) return;
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    *err = strdup(buf);
+}
+
+/* Grows a table of a schema to fit n more entries */
+#define __sc_reserve(items, len, cap, n)                              \
+    do {                                                              \
+        if ((len) + (n) > (cap)) {                                    \
+            (cap) = MAX((len) + (n), (cap) ? 2 * (cap) : 8);          \
+            (items) = realloc((items), (cap) * sizeof(*(items)));     \
+        }                                                             \
+    } while (0)
+
+static int __sc_isnumber(const Node *n) {
+    return n && (N_INTEGER == n->type || N_NUMBER == n->type);
+}
+
+static double __sc_number(const Node *n) {
+    return N_INTEGER == n->type ? (double)n->value.intval : Node_Number(n);
+}
+
+/* Reads the non-negative integer of a keyword of sizes */
+static int __sc_size(const Node *n, const char *keyword, uint32_t *size, char **err) {
+    if (!n || N_INTEGER != n->type || n->value.intval < 0) {
+        __sc_error(err, "ERR the schema's %s must be a non-negative integer", keyword);
+        return OBJ_ERR;
+    }
+    *size = n->value.intval > UINT32_MAX ? UINT32_MAX : (uint32_t)n->value.intval;
+    return OBJ_OK;
+}
+
+static int __sc_type(const Node *n, uint32_t *types, char **err) {
+    static const struct {
+        const char *name;
+        uint32_t types;
+    } names[] = {{"null", SCHEMA_T_NULL},
+                 {"boolean", SCHEMA_T_BOOLEAN},
+                 {"integer", SCHEMA_T_INTEGER},
+                 {"number", SCHEMA_T_INTEGER | SCHEMA_T_FRACTION},
+                 {"string", SCHEMA_T_STRING},
+                 {"array", SCHEMA_T_ARRAY},
+                 {"object", SCHEMA_T_OBJECT}};
+    if (n && N_STRING == n->type) {
+        char *tmp;
+        const char *name = Node_StringData(n, &tmp);
+        int found = 0;
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+            if (strlen(names[i].name) == n->value.strval.len &&
+                !memcmp(names[i].name, name, n->value.strval.len)) {
+                *types |= names[i].types;
+                found = 1;
+            }
+        }
+        if (tmp) free(tmp);
+        if (found) return OBJ_OK;
+    } else if (n && N_ARRAY == n->type) {
+        Node tmp, *item;
+        for (uint32_t i = 0; i < n->value.arrval.len; i++) {
+            Node_ArrayItemView((Node *)n, i, &tmp, &item);
+            if (!item || N_STRING != item->type || OBJ_OK != __sc_type(item, types, err))
+                goto error;
+        }
+        return OBJ_OK;
+    }
+
+error:
+    __sc_error(err, "ERR the schema's type must be a type's name or an array of them");
+    return OBJ_ERR;
+}
+
+/* Appends the scalars of enum or const to the schema's table */
+static int __sc_enum(JSONSchema *s, JSONSchemaRule *r, const Node *n, int isconst, char **err) {
+    Node tmp, *item;
+    uint32_t len = isconst ? 1 : n && N_ARRAY == n->type ? n->value.arrval.len : 0;
+    if (r->nenums || (!isconst && (!n || N_ARRAY != n->type))) {
+        __sc_error(err, "ERR the schema's enum must be an array, and can't be given with const");
+        return OBJ_ERR;
+    }
+
+    __sc_reserve(s->enums, s->nenums, s->capenums, len);
+    r->enums = s->nenums;
+    for (uint32_t i = 0; i < len; i++) {
+        if (isconst) {
+            item = (Node *)n;
+        } else {
+            Node_ArrayItemView((Node *)n, i, &tmp, &item);
+        }
+        JSONSchemaConst *c = &s->enums[s->nenums];
+        *c = (JSONSchemaConst){.type = item ? item->type : N_NULL};
+        if (item && (N_DICT == item->type || N_ARRAY == item->type)) {
+            __sc_error(err, "ERR the schema's enum and const can only hold scalars");
+            return OBJ_ERR;
+        } else if (c->type == N_STRING) {
+            char *data;
+            const char *str = Node_StringData(item, &data);
+            c->len = item->value.strval.len;
+            c->str = malloc(c->len + 1);
+            memcpy(c->str, str, c->len);
+            if (data) free(data);
+        } else if (c->type == N_INTEGER) {
+            c->intval = item->value.intval;
+        } else if (c->type == N_BOOLEAN) {
+            c->intval = item->value.boolval;
+        } else if (c->type == N_NUMBER) {
+            c->numval = Node_Number(item);
+        }
+        s->nenums++;
+        r->nenums++;
+    }
+    return OBJ_OK;
+}
+
+static int __sc_required(JSONSchema *s, JSONSchemaRule *r, const Node *n, char **err) {
+    if (!n || N_ARRAY != n->type) goto error;
+    __sc_reserve(s->required, s->nrequired, s->caprequired, n->value.arrval.len);
+    r->required = s->nrequired;
+    for (uint32_t i = 0; i < n->value.arrval.len; i++) {
+        Node tmp, *item;
+        Node_ArrayItemView((Node *)n, i, &tmp, &item);
+        if (!item || N_STRING != item->type) goto error;
+        char *data;
+        const char *key = Node_StringData(item, &data);
+        s->required[s->nrequired++] = strndup(key, item->value.strval.len);
+        r->nrequired++;
+        if (data) free(data);
+    }
+    return OBJ_OK;
+
+error:
+    __sc_error(err, "ERR the schema's required must be an array of strings");
+    return OBJ_ERR;
+}
+
+static int __sc_propcmp(const void *a, const void *b) {
+    return strcmp(((const JSONSchemaProp *)a)->key, ((const JSONSchemaProp *)b)->key);
+}
+
+/* The keywords that don't validate, and are ignored */
+static const char *_annotations[] = {
+    "$schema",  "$id",      "id",       "$comment",        "title",           "description",
+    "default",  "examples", "format",   "contentEncoding", "contentMediaType", "readOnly",
+    "writeOnly", "deprecated", "definitions", "$defs", NULL};
+
+static int __sc_compile(JSONSchema *s, const Node *n, char **err);
+
+/* Compiles the keywords of a schema object into the rule at position pos */
+static int __sc_keywords(JSONSchema *s, int pos, const Node *n, char **err) {
+    JSONSchemaProp *props = NULL;
+    size_t nprops = 0, capprops = 0;
+
+    for (uint32_t i = 0; i < n->value.dictval.len; i++) {
+        const char *key = n->value.dictval.entries[i]->value.kvval.key;
+        const Node *val = n->value.dictval.entries[i]->value.kvval.val;
+        JSONSchemaRule *r = &s->rules[pos];  // compiling subschemas moves the rules
+        int ret = OBJ_OK;
+
+        if (!strcmp("type", key)) {
+            r->types = 0;
+            ret = __sc_type(val, &r->types, err);
+        } else if (!strcmp("enum", key) || !strcmp("const", key)) {
+            ret = __sc_enum(s, r, val, 'c' == key[0], err);
+        } else if (!strcmp("minimum", key) || !strcmp("maximum", key) ||
+                   !strcmp("exclusiveMinimum", key) || !strcmp("exclusiveMaximum", key) ||
+                   !strcmp("multipleOf", key)) {
+            int multiple = !strcmp("multipleOf", key);
+            double v = __sc_isnumber(val) ? __sc_number(val) : NAN;
+            if (isnan(v) || (multiple && v <= 0)) {
+                __sc_error(err, "ERR the schema's %s must be a%s number", key,
+                           multiple ? " positive" : "");
+                ret = OBJ_ERR;
+            } else if (!strcmp("minimum", key)) {
+                r->flags |= SCHEMA_F_MIN;
+                r->min = v;
+            } else if (!strcmp("maximum", key)) {
+                r->flags |= SCHEMA_F_MAX;
+                r->max = v;
+            } else if (!strcmp("exclusiveMinimum", key)) {
+                r->flags |= SCHEMA_F_XMIN;
+                r->xmin = v;
+            } else if (!strcmp("exclusiveMaximum", key)) {
+                r->flags |= SCHEMA_F_XMAX;
+                r->xmax = v;
+            } else {
+                r->flags |= SCHEMA_F_MULTIPLE;
+                r->multiple = v;
+            }
+        } else if (!strcmp("minLength", key)) {
+            ret = __sc_size(val, key, &r->minlen, err);
+        } else if (!strcmp("maxLength", key)) {
+            ret = __sc_size(val, key, &r->maxlen, err);
+        } else if (!strcmp("minItems", key)) {
+            ret = __sc_size(val, key, &r->minitems, err);
+        } else if (!strcmp("maxItems", key)) {
+            ret = __sc_size(val, key, &r->maxitems, err);
+        } else if (!strcmp("minProperties", key)) {
+            ret = __sc_size(val, key, &r->minprops, err);
+        } else if (!strcmp("maxProperties", key)) {
+            ret = __sc_size(val, key, &r->maxprops, err);
+        } else if (!strcmp("required", key)) {
+            ret = __sc_required(s, r, val, err);
+        } else if (!strcmp("items", key) || !strcmp("additionalProperties", key)) {
+            if (val && N_ARRAY == val->type) {
+                __sc_error(err, "ERR the schema's items must be a single schema");
+                ret = OBJ_ERR;
+            } else {
+                int rule = __sc_compile(s, val, err);
+                if (SCHEMA_NONE - 1 == rule) {
+                    ret = OBJ_ERR;
+                } else if ('i' == key[0]) {
+                    s->rules[pos].items = rule;
+                } else {
+                    s->rules[pos].additional = rule;
+                }
+            }
+        } else if (!strcmp("properties", key)) {
+            if (!val || N_DICT != val->type) {
+                __sc_error(err, "ERR the schema's properties must be an object");
+                ret = OBJ_ERR;
+            }
+            for (uint32_t j = 0; OBJ_OK == ret && j < val->value.dictval.len; j++) {
+                const Node *kv = val->value.dictval.entries[j];
+                int rule = __sc_compile(s, kv->value.kvval.val, err);
+                if (SCHEMA_NONE - 1 == rule) {
+                    ret = OBJ_ERR;
+                    break;
+                }
+                __sc_reserve(props, nprops, capprops, 1);
+                props[nprops++] = (JSONSchemaProp){strdup(kv->value.kvval.key), rule};
+            }
+        } else {
+            int annotation = 0;
+            for (int j = 0; _annotations[j] && !annotation; j++)
+                annotation = !strcmp(_annotations[j], key);
+            if (!annotation) {
+                __sc_error(err, "ERR the schema keyword '%s' isn't supported", key);
+                ret = OBJ_ERR;
+            }
+        }
+
+        if (OBJ_OK != ret) {
+            for (size_t j = 0; j < nprops; j++) free(props[j].key);
+            free(props);
+            return OBJ_ERR;
+        }
+    }
+
+    // the properties are added at once, after those of their own subschemas
+    if (nprops) {
+        qsort(props, nprops, sizeof(JSONSchemaProp), __sc_propcmp);
+        __sc_reserve(s->props, s->nprops, s->capprops, nprops);
+        memcpy(&s->props[s->nprops], props, nprops * sizeof(JSONSchemaProp));
+        s->rules[pos].props = s->nprops;
+        s->rules[pos].nprops = nprops;
+        s->nprops += nprops;
+    }
+    free(props);
+    return OBJ_OK;
+}
+
+/**
+* Compiles a schema and returns its rule: JSONSCHEMA_ANY for true, SCHEMA_NONE for false, a position
+* in the table for an object, or SCHEMA_NONE - 1 on errors.
+*/
+static int __sc_compile(JSONSchema *s, const Node *n, char **err) {
+    if (n && N_BOOLEAN == n->type) return n->value.boolval ? JSONSCHEMA_ANY : SCHEMA_NONE;
+    if (!n || N_DICT != n->type) {
+        __sc_error(err, "ERR a schema must be an object or a boolean");
+        return SCHEMA_NONE - 1;
+    }
+
+    __sc_reserve(s->rules, s->len, s->cap, 1);
+    int pos = s->len++;
+    s->rules[pos] = (JSONSchemaRule){.types = SCHEMA_T_ALL,
+                                     .maxlen = UINT32_MAX,
+                                     .maxitems = UINT32_MAX,
+                                     .maxprops = UINT32_MAX,
+                                     .items = JSONSCHEMA_ANY,
+                                     .additional = JSONSCHEMA_ANY};
+    return OBJ_OK == __sc_keywords(s, pos, n, err) ? pos : SCHEMA_NONE - 1;
+}
+
+JSONSchema *NewJSONSchema(const Node *root, char **err) {
+    JSONSchema *s = calloc(1, sizeof(JSONSchema));
+    int rule = __sc_compile(s, root, err);
+    if (SCHEMA_NONE - 1 == rule) {
+        JSONSchema_Free(s);
+        return NULL;
+    }
+
+    // the root of true or false is a rule of its own, as it's at JSONSCHEMA_ROOT
+    if (rule < 0) {
+        __sc_reserve(s->rules, s->len, s->cap, 1);
+        s->rules[s->len++] = (JSONSchemaRule){.types = JSONSCHEMA_ANY == rule ? SCHEMA_T_ALL : 0,
+                                              .maxlen = UINT32_MAX,
+                                              .maxitems = UINT32_MAX,
+                                              .maxprops = UINT32_MAX,
+                                              .items = JSONSCHEMA_ANY,
+                                              .additional = JSONSCHEMA_ANY};
+    }
+    return s;
+}
+
+void JSONSchema_Free(JSONSchema *s) {
+    for (size_t i = 0; i < s->nprops; i++) free(s->props[i].key);
+    for (size_t i = 0; i < s->nrequired; i++) free(s->required[i]);
+    for (size_t i = 0; i < s->nenums; i++) free(s->enums[i].str);
+    free(s->rules);
+    free(s->props);
+    free(s->required);
+    free(s->enums);
+    free(s);
+}
+
+size_t JSONSchema_MemoryUsage(const JSONSchema *s) {
+    size_t memory = sizeof(JSONSchema) + s->cap * sizeof(JSONSchemaRule) +
+                    s->capprops * sizeof(JSONSchemaProp) + s->caprequired * sizeof(char *) +
+                    s->capenums * sizeof(JSONSchemaConst);
+    for (size_t i = 0; i < s->nprops; i++) memory += strlen(s->props[i].key) + 1;
+    for (size_t i = 0; i < s->nrequired; i++) memory += strlen(s->required[i]) + 1;
+    for (size_t i = 0; i < s->nenums; i++) memory += s->enums[i].str ? s->enums[i].len + 1 : 0;
+    return memory;
+}
+
+int JSONSchema_Member(const JSONSchema *s, int rule, const char *key, int *member,
+                      const char **why) {
+    *member = JSONSCHEMA_ANY;
+    if (rule < 0) return OBJ_OK;
+    const JSONSchemaRule *r = &s->rules[rule];
+    const JSONSchemaProp *props = &s->props[r->props];
+    size_t lo = 0, hi = r->nprops;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = strcmp(key, props[mid].key);
+        if (!cmp) {
+            *member = props[mid].rule;
+            return OBJ_OK;
+        }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    if (SCHEMA_NONE == r->additional) {
+        *why = "the object has a member that isn't a property";
+        return OBJ_ERR;
+    }
+    *member = r->additional;
+    return OBJ_OK;
+}
+
+int JSONSchema_Items(const JSONSchema *s, int rule) {
+    return rule < 0 ? JSONSCHEMA_ANY : s->rules[rule].items;
+}
+
+/* Checks the type of a value, which is all that the schema false checks */
+static inline int __sc_checktype(const JSONSchema *s, int rule, uint32_t type, const char **why) {
+    if (JSONSCHEMA_ANY == rule) return OBJ_OK;
+    if (SCHEMA_NONE != rule && (s->rules[rule].types & type)) return OBJ_OK;
+    *why = SCHEMA_NONE == rule ? "the schema allows no value" : "the value's type isn't allowed";
+    return OBJ_ERR;
+}
+
+/* Checks a scalar against the constants of enum or const */
+static int __sc_checkenum(const JSONSchema *s, const JSONSchemaRule *r, NodeType type,
+                          int64_t intval, double numval, const char *str, size_t len,
+                          const char **why) {
+    if (!r->nenums) return OBJ_OK;
+    int number = N_INTEGER == type || N_NUMBER == type;
+    double v = N_INTEGER == type ? (double)intval : numval;
+    for (uint32_t i = r->enums; i < r->enums + r->nenums; i++) {
+        const JSONSchemaConst *c = &s->enums[i];
+        if (number && (N_INTEGER == c->type || N_NUMBER == c->type)) {
+            if (N_INTEGER == type && N_INTEGER == c->type ? intval == c->intval
+                                                          : v == (N_INTEGER == c->type
+                                                                      ? (double)c->intval
+                                                                      : c->numval))
+                return OBJ_OK;
+        } else if (type != c->type) {
+            continue;
+        } else if (N_NULL == type || (N_BOOLEAN == type && !intval == !c->intval) ||
+                   (N_STRING == type && len == c->len && !memcmp(str, c->str, len))) {
+            return OBJ_OK;
+        }
+    }
+    *why = "the value isn't one of the schema's constants";
+    return OBJ_ERR;
+}
+
+int JSONSchema_CheckOpen(const JSONSchema *s, int rule, NodeType type, const char **why) {
+    return __sc_checktype(s, rule, N_DICT == type ? SCHEMA_T_OBJECT : SCHEMA_T_ARRAY, why);
+}
+
+int JSONSchema_CheckClose(const JSONSchema *s, int rule, const Node *n, const char **why) {
+    if (rule < 0) return OBJ_OK;
+    const JSONSchemaRule *r = &s->rules[rule];
+    uint32_t len = Node_Length(n);
+    if (N_ARRAY == n->type) {
+        if (len < r->minitems || len > r->maxitems) {
+            *why = "the array's number of items is out of range";
+            return OBJ_ERR;
+        }
+    } else {
+        if (len < r->minprops || len > r->maxprops) {
+            *why = "the object's number of members is out of range";
+            return OBJ_ERR;
+        }
+        for (uint32_t i = r->required; i < r->required + r->nrequired; i++) {
+            Node *val;
+            if (OBJ_OK != Node_DictGet((Node *)n, s->required[i], &val)) {
+                *why = "the object misses a required member";
+                return OBJ_ERR;
+            }
+        }
+    }
+    return OBJ_OK;
+}
+
+int JSONSchema_CheckNull(const JSONSchema *s, int rule, const char **why) {
+    if (OBJ_OK != __sc_checktype(s, rule, SCHEMA_T_NULL, why)) return OBJ_ERR;
+    return rule < 0 ? OBJ_OK : __sc_checkenum(s, &s->rules[rule], N_NULL, 0, 0, NULL, 0, why);
+}
+
+int JSONSchema_CheckBool(const JSONSchema *s, int rule, int val, const char **why) {
+    if (OBJ_OK != __sc_checktype(s, rule, SCHEMA_T_BOOLEAN, why)) return OBJ_ERR;
+    return rule < 0 ? OBJ_OK : __sc_checkenum(s, &s->rules[rule], N_BOOLEAN, val, 0, NULL, 0, why);
+}
+
+/* Checks a number's bounds, given as a double whatever its type */
+static int __sc_checkbounds(const JSONSchemaRule *r, double v, const char **why) {
+    if (((r->flags & SCHEMA_F_MIN) && v < r->min) || ((r->flags & SCHEMA_F_XMIN) && v <= r->xmin) ||
+        ((r->flags & SCHEMA_F_MAX) && v > r->max) || ((r->flags & SCHEMA_F_XMAX) && v >= r->xmax)) {
+        *why = "the number is out of range";
+        return OBJ_ERR;
+    }
+    if (r->flags & SCHEMA_F_MULTIPLE) {
+        double q = v / r->multiple;
+        if (!isfinite(q) || q != floor(q)) {
+            *why = "the number isn't a multiple of the schema's multipleOf";
+            return OBJ_ERR;
+        }
+    }
+    return OBJ_OK;
+}
+
+int JSONSchema_CheckInt(const JSONSchema *s, int rule, int64_t val, const char **why) {
+    if (OBJ_OK != __sc_checktype(s, rule, SCHEMA_T_INTEGER, why)) return OBJ_ERR;
+    if (rule < 0) return OBJ_OK;
+    const JSONSchemaRule *r = &s->rules[rule];
+    if (r->flags && OBJ_OK != __sc_checkbounds(r, (double)val, why)) return OBJ_ERR;
+    return __sc_checkenum(s, r, N_INTEGER, val, 0, NULL, 0, why);
+}
+
+int JSONSchema_CheckDouble(const JSONSchema *s, int rule, double val, const char **why) {
+    uint32_t type = val == floor(val) ? SCHEMA_T_INTEGER : SCHEMA_T_FRACTION;
+    if (OBJ_OK != __sc_checktype(s, rule, type, why)) return OBJ_ERR;
+    if (rule < 0) return OBJ_OK;
+    const JSONSchemaRule *r = &s->rules[rule];
+    if (r->flags && OBJ_OK != __sc_checkbounds(r, val, why)) return OBJ_ERR;
+    return __sc_checkenum(s, r, N_NUMBER, 0, val, NULL, 0, why);
+}
+
+int JSONSchema_CheckString(const JSONSchema *s, int rule, const char *str, size_t len,
+                           const char **why) {
+    if (OBJ_OK != __sc_checktype(s, rule, SCHEMA_T_STRING, why)) return OBJ_ERR;
+    if (rule < 0) return OBJ_OK;
+    const JSONSchemaRule *r = &s->rules[rule];
+
+    // lengths are in characters, the bytes that don't continue a UTF-8 sequence, which are counted
+    // unless the bytes decide, as every character takes 1 to 4 of them
+    if ((len + 3) / 4 < r->minlen || len > r->maxlen) {
+        size_t chars = 0;
+        for (size_t i = 0; i < len; i++) chars += 0x80 != ((unsigned char)str[i] & 0xc0);
+        if (chars < r->minlen || chars > r->maxlen) {
+            *why = "the string's length is out of range";
+            return OBJ_ERR;
+        }
+    }
+    return __sc_checkenum(s, r, N_STRING, 0, 0, str, len, why);
+}
+
+uint32_t JSONSchema_Hint(const JSONSchema *s, int rule) {
+    if (rule < 0) return 0;
+    const JSONSchemaRule *r = &s->rules[rule];
+    return MIN(MAX(r->minitems, MAX(r->minprops, r->nrequired)), JSONSCHEMA_MAX_HINT);
+}
+
+static int __sc_validate(const JSONSchema *s, int rule, const Node *n, const char **why) {
+    if (JSONSCHEMA_ANY == rule) return OBJ_OK;
+    if (!n) return JSONSchema_CheckNull(s, rule, why);
+
+    switch (n->type) {
+        case N_BOOLEAN:
+            return JSONSchema_CheckBool(s, rule, n->value.boolval, why);
+        case N_INTEGER:
+            return JSONSchema_CheckInt(s, rule, n->value.intval, why);
+        case N_NUMBER:
+            return JSONSchema_CheckDouble(s, rule, Node_Number(n), why);
+        case N_STRING: {
+            char *tmp;
+            const char *str = Node_StringData(n, &tmp);
+            int ret = JSONSchema_CheckString(s, rule, str, n->value.strval.len, why);
+            if (tmp) free(tmp);
+            return ret;
+        }
+        case N_DICT:
+            if (OBJ_OK != JSONSchema_CheckOpen(s, rule, N_DICT, why)) return OBJ_ERR;
+            for (uint32_t i = 0; i < n->value.dictval.len; i++) {
+                const Node *kv = n->value.dictval.entries[i];
+                int member;
+                if (OBJ_OK != JSONSchema_Member(s, rule, kv->value.kvval.key, &member, why) ||
+                    OBJ_OK != __sc_validate(s, member, kv->value.kvval.val, why))
+                    return OBJ_ERR;
+            }
+            return JSONSchema_CheckClose(s, rule, n, why);
+        case N_ARRAY: {
+            if (OBJ_OK != JSONSchema_CheckOpen(s, rule, N_ARRAY, why)) return OBJ_ERR;
+            int items = JSONSchema_Items(s, rule);
+            Node tmp, *item;
+            for (uint32_t i = 0; JSONSCHEMA_ANY != items && i < n->value.arrval.len; i++) {
+                Node_ArrayItemView((Node *)n, i, &tmp, &item);
+                if (OBJ_OK != __sc_validate(s, items, item, why)) return OBJ_ERR;
+            }
+            return JSONSchema_CheckClose(s, rule, n, why);
+        }
+        default:
+            return OBJ_OK;
+    }
+}
+
+int JSONSchema_Validate(const JSONSchema *s, const Node *n, const char **why) {
+    return __sc_validate(s, JSONSCHEMA_ROOT, n, why);
+}
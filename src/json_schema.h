@@ -0,0 +1,92 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __JSON_SCHEMA_H__
+#define __JSON_SCHEMA_H__
+
+#include "object.h"
+
+/**
+* Validators of JSON Schema (https://json-schema.org) documents. A schema is compiled once into a
+* table of rules, one per subschema, that refer to each other by their positions: the rule of a
+* member or an item is found from its container's rule, so a value is checked as it's built, see
+* CreateNodeFromJSONSchema, without a pass of its own.
+*
+* The keywords that are supported are type, enum and const of scalars, minimum, maximum,
+* exclusiveMinimum, exclusiveMaximum, multipleOf, minLength, maxLength, items with a single schema,
+* minItems, maxItems, properties, required, additionalProperties, minProperties and maxProperties.
+* Schemas can also be true and false. Annotations such as title or format are ignored, and the other
+* keywords fail the compilation rather than being ignored, so a schema never accepts what it meant to
+* reject.
+*
+* The sizes that a schema guarantees are hints for the values' containers, which are created with
+* room for them: an array with its minItems, and an object with as many members as it requires, which
+* is hash indexed from the start when those are many (see NodeDictHashThreshold).
+*/
+
+typedef struct JSONSchema JSONSchema;
+
+/* The rule of the values that anything is valid for, e.g. those of a schema's unlisted members */
+#define JSONSCHEMA_ANY -1
+
+/* The root's rule */
+#define JSONSCHEMA_ROOT 0
+
+/* The most entries that a container is created with room for, whatever its schema guarantees */
+#define JSONSCHEMA_MAX_HINT 4096
+
+/**
+* Compiles the schema at root. Returns NULL if it isn't a schema or has unsupported keywords, and sets
+* the optional err with a message that the caller frees.
+*/
+JSONSchema *NewJSONSchema(const Node *root, char **err);
+
+void JSONSchema_Free(JSONSchema *s);
+
+/** The memory that a compiled schema takes */
+size_t JSONSchema_MemoryUsage(const JSONSchema *s);
+
+/**
+* The rule of a member of an object whose rule is given. Returns OBJ_ERR with why set if the object
+* can't have the member.
+*/
+int JSONSchema_Member(const JSONSchema *s, int rule, const char *key, int *member, const char **why);
+
+/** The rule of the items of an array whose rule is given */
+int JSONSchema_Items(const JSONSchema *s, int rule);
+
+/**
+* The checks of values: OBJ_OK if the value is valid, otherwise OBJ_ERR with why set to the reason.
+* Containers are checked twice, for their type when they open and for their entries when they close,
+* and numbers are checked as values, as those of packed arrays have no nodes.
+*/
+int JSONSchema_CheckOpen(const JSONSchema *s, int rule, NodeType type, const char **why);
+int JSONSchema_CheckClose(const JSONSchema *s, int rule, const Node *n, const char **why);
+int JSONSchema_CheckNull(const JSONSchema *s, int rule, const char **why);
+int JSONSchema_CheckBool(const JSONSchema *s, int rule, int val, const char **why);
+int JSONSchema_CheckInt(const JSONSchema *s, int rule, int64_t val, const char **why);
+int JSONSchema_CheckDouble(const JSONSchema *s, int rule, double val, const char **why);
+int JSONSchema_CheckString(const JSONSchema *s, int rule, const char *str, size_t len,
+                           const char **why);
+
+/** The number of entries that a container with the rule is created with room for, 0 if unknown */
+uint32_t JSONSchema_Hint(const JSONSchema *s, int rule);
+
+/** Checks a value that's already built, e.g. one that's decoded from MessagePack */
+int JSONSchema_Validate(const JSONSchema *s, const Node *n, const char **why);
+
+#endif
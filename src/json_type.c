@@ -15,7 +15,11 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <ctype.h>
+#include <pthread.h>
 #include "json_type.h"
+#include "json_index.h"
+#include "json_expire.h"
 
 void *JSONTypeRdbLoad(RedisModuleIO *rdb, int encver) {
     if (encver < 0 || encver > JSONTYPE_ENCODING_VERSION) {
@@ -26,44 +30,780 @@ void *JSONTypeRdbLoad(RedisModuleIO *rdb, int encver) {
         return NULL;
     }
 
-    JSONType_t *jt = calloc(1, sizeof(JSONType_t));
-    jt->root = ObjectTypeRdbLoad(rdb);
+    uint64_t begin = Stats_Begin(), nodes = Node_CreatedCount();
+    size_t len = 0;
+    JSONType_t *jt = NewJSONType();
+    NodeArena *prev = Node_SetArena(jt->arena);
+    if (0 == encver) {
+        jt->root = ObjectTypeRdbLoad(rdb);
+    } else {
+        uint64_t kind = encver > 1 ? RedisModule_LoadUnsigned(rdb) : JSONTYPE_RDB_BINARY;
+        char *buf = RedisModule_LoadStringBuffer(rdb, &len);
+        int ok;
+        if (JSONTYPE_RDB_TEXT == kind) {
+            ok = JSONTypeSetLazy(jt, buf, len);
+        } else if (JSONTypeLazyLoad) {
+            // the encoding is copied, since Redis allocated the buffer and cold ones are malloc'd
+            ok = JSONTYPE_RDB_BINARY == kind && OBJ_OK == ValidateBinary(buf, len);
+            if (ok) {
+                NodeArena_Free(jt->arena);
+                jt->arena = NULL;
+                jt->cold = malloc(len);
+                memcpy(jt->cold, buf, len);
+                jt->coldlen = jt->coldsize = len;
+            }
+        } else {
+            ok = JSONTYPE_RDB_BINARY == kind && OBJ_OK == CreateNodeFromBinary(buf, len, &jt->root);
+        }
+        RedisModule_Free(buf);
+        if (!ok) {
+            Node_SetArena(prev);
+            JSONTypeFree(jt);
+            RedisModule_LogIOError(rdb, RM_LOGLEVEL_WARNING,
+                                   "Can't load JSON from RDB due to an invalid encoding");
+            Stats_End(STATS_RDB_LOAD, begin, len, Node_CreatedCount() - nodes, 1);
+            return NULL;
+        }
+    }
+    Node_SetArena(prev);
+    JSONTypeDedup(jt);
+    if (encver > 2) JSONExpire_RdbLoad(rdb, jt);
+    Stats_End(STATS_RDB_LOAD, begin, len, Node_CreatedCount() - nodes, 0);
+
+    // the document isn't tracked by the indexes yet, e.g. if it's loaded by RESTORE
+    JSONIndex_Loaded();
     return jt;
 }
 
 void JSONTypeRdbSave(RedisModuleIO *rdb, void *value) {
     JSONType_t *jt = (JSONType_t *)value;
-    ObjectTypeRdbSave(rdb, jt->root);    
+    uint64_t begin = Stats_Begin();
+    size_t len;
+    if (jt->raw) {
+        len = sdslen(jt->raw);
+        RedisModule_SaveUnsigned(rdb, JSONTYPE_RDB_TEXT);
+        RedisModule_SaveStringBuffer(rdb, jt->raw, len);
+    } else if (jt->cold && jt->coldlen == jt->coldsize) {
+        // a cold document keeps the binary encoding, so it doesn't need to be materialized
+        len = jt->coldsize;
+        RedisModule_SaveUnsigned(rdb, JSONTYPE_RDB_BINARY);
+        RedisModule_SaveStringBuffer(rdb, jt->cold, len);
+    } else if (jt->cold) {
+        char *buf = malloc(jt->coldsize);
+        len = jt->coldsize;
+        Decompress(jt->cold, jt->coldlen, buf, len);
+        RedisModule_SaveUnsigned(rdb, JSONTYPE_RDB_BINARY);
+        RedisModule_SaveStringBuffer(rdb, buf, len);
+        free(buf);
+    } else {
+        sds buf = sdsempty();
+        SerializeNodeToBinary(jt->root, &buf);
+        len = sdslen(buf);
+        RedisModule_SaveUnsigned(rdb, JSONTYPE_RDB_BINARY);
+        RedisModule_SaveStringBuffer(rdb, buf, len);
+        sdsfree(buf);
+    }
+    JSONExpire_RdbSave(rdb, jt);
+    Stats_End(STATS_RDB_SAVE, begin, len, 0, 0);
+}
+
+size_t JSONTypeAofChunkSize = JSONTYPE_AOF_CHUNK_SIZE;
+size_t JSONTypeLazySize = 0;
+uint32_t JSONTypeColdSeconds = 0;
+int JSONTypeLazyLoad = 0;
+
+/* The state of a chunked AOF rewrite */
+typedef struct {
+    RedisModuleIO *aof;
+    RedisModuleCtx *ctx;
+    RedisModuleString *key;
+    JSONSerializeOpt opt;
+    size_t chunk;
+} _AofRewrite;
+
+/**
+* An estimate of a value's serialized size (strings are counted without escapes), that stops
+* counting once it is over the limit.
+*/
+static size_t _aofEstimate(const Node *n, size_t limit) {
+    size_t size;
+
+    if (!n) return 4;
+    switch (n->type) {
+        case N_NULL:
+        case N_BOOLEAN:
+            return 5;
+        case N_INTEGER:
+            return 20;
+        case N_NUMBER:
+            return n->flags & NODE_F_NUMBER_TEXT ? n->value.strval.len : 20;
+        case N_STRING:
+            return n->value.strval.len + 2;
+        case N_KEYVAL:
+            return Intern_Len(n->value.kvval.key) + 3 +
+                   _aofEstimate(n->value.kvval.val, limit);
+        case N_DICT:
+            size = 2;
+            for (uint32_t i = 0; i < n->value.dictval.len && size <= limit; i++)
+                size += _aofEstimate(n->value.dictval.entries[i], limit - size) + 1;
+            return size;
+        case N_ARRAY:
+            if (n->flags & NODE_F_PACKED) return 2 + (size_t)n->value.arrval.len * 21;
+            size = 2;
+            for (uint32_t i = 0; i < n->value.arrval.len && size <= limit; i++)
+                size += _aofEstimate(n->value.arrval.entries[i], limit - size) + 1;
+            return size;
+    }
+    return 0;
+}
+
+static inline int _aofIsContainer(const Node *n) {
+    return n && (N_DICT == n->type || N_ARRAY == n->type);
+}
+
+sds JSONTypeKeyPath(const sds path, const char *key) {
+    const char *base = strcmp(OBJECT_ROOT_PATH, path) ? path : "";
+    int ident = isalpha((unsigned char)key[0]) || '$' == key[0] || '_' == key[0];
+    for (const char *c = key; ident && *c; c++)
+        ident = isalnum((unsigned char)*c) || '$' == *c || '_' == *c;
+
+    // a bracketed key ends at its first quote, as paths have no escapes
+    if (ident) return sdscatprintf(sdsempty(), "%s.%s", base, key);
+    if (!*key) return NULL;
+    if (!strchr(key, '"')) return sdscatprintf(sdsempty(), "%s[\"%s\"]", base, key);
+    if (!strchr(key, '\'')) return sdscatprintf(sdsempty(), "%s['%s']", base, key);
+    return NULL;
+}
+
+static void _aofEmitSet(_AofRewrite *rw, const char *path, const Node *n) {
+    sds json = sdsempty();
+    SerializeNodeToJSON(n, &rw->opt, &json);
+    RedisModule_EmitAOF(rw->aof, "JSON.SET", "scb", rw->key, path, json, sdslen(json));
+    sdsfree(json);
+}
+
+/* Returns the item of an array or the keyval of a dictionary */
+static inline Node *_aofEntry(const Node *n, uint32_t i, Node *tmp) {
+    Node *sub;
+    if (N_DICT == n->type) return n->value.dictval.entries[i];
+    Node_ArrayItemView((Node *)n, i, tmp, &sub);
+    return sub;
+}
+
+/**
+* Emits a container that's too big for a single command. The container is set with the values that
+* fit in a chunk, and the rest are added with commands of about a chunk each: values that are too
+* big themselves are emitted with this same function after an empty container takes their place.
+*/
+static void _aofEmitContainer(_AofRewrite *rw, const Node *n, const sds path) {
+    int isdict = N_DICT == n->type;
+    uint32_t len = isdict ? n->value.dictval.len : n->value.arrval.len;
+    Node tmp, *sub;
+    uint32_t i;
+
+    // members are set by their paths, so a dictionary with a key that paths can't express is whole
+    for (i = 0; isdict && i < len; i++) {
+        sds kpath = JSONTypeKeyPath(path, n->value.dictval.entries[i]->value.kvval.key);
+        if (!kpath) {
+            _aofEmitSet(rw, path, n);
+            return;
+        }
+        sdsfree(kpath);
+    }
+
+    // the container with the leading values that fit
+    sds json = sdsnewlen(isdict ? "{" : "[", 1);
+    for (i = 0; i < len; i++) {
+        sub = _aofEntry(n, i, &tmp);
+        if (sdslen(json) + _aofEstimate(sub, rw->chunk) > rw->chunk) break;
+        if (i) json = sdscatlen(json, ",", 1);
+        SerializeNodeToJSON(sub, &rw->opt, &json);
+    }
+    json = sdscatlen(json, isdict ? "}" : "]", 1);
+    RedisModule_EmitAOF(rw->aof, "JSON.SET", "scb", rw->key, path, json, sdslen(json));
+    sdsfree(json);
+
+    // the rest of the members are set one by one
+    for (; isdict && i < len; i++) {
+        Node *kv = n->value.dictval.entries[i];
+        sds kpath = JSONTypeKeyPath(path, kv->value.kvval.key);
+        sub = kv->value.kvval.val;
+        if (_aofIsContainer(sub) && _aofEstimate(sub, rw->chunk) > rw->chunk) {
+            _aofEmitContainer(rw, sub, kpath);
+        } else {
+            _aofEmitSet(rw, kpath, sub);
+        }
+        sdsfree(kpath);
+    }
+    if (isdict) return;
+
+    // and the rest of the items are appended in batches
+    RedisModuleString **batch = NULL;
+    size_t nbatch = 0, capbatch = 0, batchsize = 0;
+    for (; i <= len; i++) {
+        int big = 0;
+        if (i < len) {
+            sub = _aofEntry(n, i, &tmp);
+            big = _aofIsContainer(sub) && _aofEstimate(sub, rw->chunk) > rw->chunk;
+        }
+        if (nbatch && (i == len || big || batchsize >= rw->chunk)) {
+            RedisModule_EmitAOF(rw->aof, "JSON.ARRAPPEND", "scv", rw->key, path, batch, nbatch);
+            for (size_t j = 0; j < nbatch; j++) RedisModule_FreeString(rw->ctx, batch[j]);
+            nbatch = batchsize = 0;
+        }
+        if (i == len) break;
+
+        if (big) {
+            sds ipath = sdscatprintf(sdsempty(), "%s[%u]",
+                                     strcmp(OBJECT_ROOT_PATH, path) ? path : "", i);
+            RedisModule_EmitAOF(rw->aof, "JSON.ARRAPPEND", "scc", rw->key, path,
+                                N_DICT == sub->type ? "{}" : "[]");
+            _aofEmitContainer(rw, sub, ipath);
+            sdsfree(ipath);
+            continue;
+        }
+        if (nbatch == capbatch) {
+            capbatch = capbatch ? capbatch * 2 : 64;
+            batch = realloc(batch, capbatch * sizeof(RedisModuleString *));
+        }
+        sds item = sdsempty();
+        SerializeNodeToJSON(sub, &rw->opt, &item);
+        batch[nbatch++] = RedisModule_CreateString(rw->ctx, item, sdslen(item));
+        batchsize += sdslen(item);
+        sdsfree(item);
+    }
+    free(batch);
+}
+
+/* Rewrites a document's value */
+static void _aofRewriteValue(RedisModuleIO *aof, RedisModuleString *key, JSONType_t *jt) {
+    // Documents are rewritten with a single JSON.SET, unless they are bigger than the chunk size.
+    // Big documents are rewritten in chunks, to keep the commands well within the 0.5GB limit of
+    // bulk strings and to not serialize the whole document at once.
+    _AofRewrite rw = {.aof = aof,
+                      .ctx = RedisModule_GetContextFromIO(aof),
+                      .key = key,
+                      .opt = {.indentstr = "", .newlinestr = "", .spacestr = ""},
+                      .chunk = JSONTypeAofChunkSize};
+
+    if (jt->raw && (!rw.chunk || sdslen(jt->raw) <= rw.chunk)) {
+        RedisModule_EmitAOF(aof, "JSON.SET", "scb", key, OBJECT_ROOT_PATH, jt->raw,
+                            sdslen(jt->raw));
+        return;
+    }
+    JSONTypeMaterialize(jt);
+    if (!rw.chunk || !_aofIsContainer(jt->root) || _aofEstimate(jt->root, rw.chunk) <= rw.chunk) {
+        _aofEmitSet(&rw, OBJECT_ROOT_PATH, jt->root);
+        return;
+    }
+    sds path = sdsnew(OBJECT_ROOT_PATH);
+    _aofEmitContainer(&rw, jt->root, path);
+    sdsfree(path);
 }
 
 void JSONTypeAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
-    // two approaches:
-    // 1. For small documents it makes more sense to serialze the entire document in one go
-    // 2. Large documents need to be broken to smaller pieces in order to stay within 0.5GB, but
-    // we'll need some meta data to make sane-sized chunks so this gets lower priority atm
     JSONType_t *jt = (JSONType_t *)value;
+    _aofRewriteValue(aof, key, jt);
+    JSONExpire_AofRewrite(aof, key, jt);
+}
 
-    // serialize it
-    JSONSerializeOpt jsopt = {.indentstr = "", .newlinestr = "", .spacestr = ""};
-    sds json = sdsnewlen("\"", 1);
-    SerializeNodeToJSON(jt->root, &jsopt, &json);
-    json = sdscatlen(json, "\"", 1);
-    RedisModule_EmitAOF(aof, "JSON.SET", "scb", key, OBJECT_ROOT_PATH, json, sdslen(json));
-    sdsfree(json);
+/* Frees the nodes of a document, an unmodified one is entirely in its arena so it isn't traversed */
+static void _freeNodesNow(Node *root, NodeArena *arena, int modified) {
+    if (!arena || modified) Node_Free(root);
+    NodeArena_Free(arena);
+}
+
+/* The documents that wait for the lazy free thread, in the order that they were freed */
+typedef struct _LazyFree {
+    Node *root;
+    NodeArena *arena;
+    int modified;
+    struct _LazyFree *next;
+} _LazyFree;
+
+static pthread_mutex_t _lazyfreeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _lazyfreeCond = PTHREAD_COND_INITIALIZER;
+static _LazyFree *_lazyfreeHead = NULL, **_lazyfreeTail = &_lazyfreeHead;
+static int _lazyfreeThread = 0;  // set once the thread runs, or to -1 if it can't be started
+
+static void *_lazyfreeMain(void *arg) {
+    for (;;) {
+        pthread_mutex_lock(&_lazyfreeLock);
+        while (!_lazyfreeHead) pthread_cond_wait(&_lazyfreeCond, &_lazyfreeLock);
+        _LazyFree *lf = _lazyfreeHead;
+        _lazyfreeHead = lf->next;
+        if (!_lazyfreeHead) _lazyfreeTail = &_lazyfreeHead;
+        pthread_mutex_unlock(&_lazyfreeLock);
+
+        _freeNodesNow(lf->root, lf->arena, lf->modified);
+        free(lf);
+    }
+    return NULL;
+}
+
+size_t JSONTypeLazyFreeNodes = 0;
+
+/* Frees the nodes of a document, on the lazy free thread if it's big */
+static void _freeNodes(Node *root, NodeArena *arena, int modified) {
+    if (!JSONTypeLazyFreeNodes || !root || _lazyfreeThread < 0 ||
+        Node_Count(root, JSONTypeLazyFreeNodes) < JSONTypeLazyFreeNodes) {
+        _freeNodesNow(root, arena, modified);
+        return;
+    }
+
+    // the thread is started on first use, the nodes are freed here if it can't be
+    if (!_lazyfreeThread) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, _lazyfreeMain, NULL)) {
+            _lazyfreeThread = -1;
+            _freeNodesNow(root, arena, modified);
+            return;
+        }
+        pthread_detach(tid);
+        _lazyfreeThread = 1;
+    }
+    _LazyFree *lf = malloc(sizeof(_LazyFree));
+    *lf = (_LazyFree){root, arena, modified, NULL};
+    pthread_mutex_lock(&_lazyfreeLock);
+    *_lazyfreeTail = lf;
+    _lazyfreeTail = &lf->next;
+    pthread_cond_signal(&_lazyfreeCond);
+    pthread_mutex_unlock(&_lazyfreeLock);
+}
+
+/**
+* Releases a document's or a snapshot's hold of a shared arena and of the nodes from root. The nodes
+* that others hold too are released on the main thread, where their counts are changed, so the ones
+* that aren't the last holder's are released now. The last holder's nodes are freed like any other
+* document's, with the arena.
+*/
+static void _releaseShare(JSONTypeShare *s, Node *root, int modified) {
+    if (--s->refs) {
+        Node_Free(root);
+        return;
+    }
+    _freeNodes(root, s->arena, modified);
+    free(s);
+}
+
+/* Frees a document's nodes, or releases them if the arena is shared, see _releaseShare */
+static void _dropNodes(JSONType_t *jt) {
+    if (jt->shared) {
+        _releaseShare(jt->shared, jt->root, jt->modified);
+        jt->shared = NULL;
+    } else {
+        _freeNodes(jt->root, jt->arena, jt->modified);
+    }
+}
+
+/* The documents that may go cold, from the least recently accessed, see JSONTypeColdSeconds */
+static JSONType_t *_lruhead = NULL, *_lrutail = NULL;
+
+static void _lruRemove(JSONType_t *jt) {
+    if (!jt->lruprev && _lruhead != jt) return;
+    if (jt->lruprev) {
+        jt->lruprev->lrunext = jt->lrunext;
+    } else {
+        _lruhead = jt->lrunext;
+    }
+    if (jt->lrunext) {
+        jt->lrunext->lruprev = jt->lruprev;
+    } else {
+        _lrutail = jt->lruprev;
+    }
+    jt->lruprev = jt->lrunext = NULL;
+}
+
+/* Marks a document as accessed now, which makes it the most recently accessed one */
+static void _lruTouch(JSONType_t *jt) {
+    if (!JSONTypeColdSeconds) return;
+    _lruRemove(jt);
+    jt->atime = RedisModule_Milliseconds();
+    jt->lruprev = _lrutail;
+    if (_lrutail) {
+        _lrutail->lrunext = jt;
+    } else {
+        _lruhead = jt;
+    }
+    _lrutail = jt;
 }
 
 void JSONTypeFree(void *value) {
     JSONType_t *jt = (JSONType_t *)value;
     if (jt) {
-        Node_Free(jt->root);
+        JSONIndex_Untrack(jt);
+        JSONExpire_Untrack(jt);
+        if (jt->schema) JSONSchema_Free(jt->schema);
+        _lruRemove(jt);
+        SerialCache_Drop(&jt->serialized);
+        if (jt->raw) sdsfree(jt->raw);
+        free(jt->cold);
+        _dropNodes(jt);
+        if (jt->defrag) {
+            NodeDefragCursor_Free(jt->defrag);
+            free(jt->defrag);
+            Stats_DefragPending(-1);
+        }
         free(jt);
     }
 }
 
+size_t JSONTypeDefragSliceUsecs = JSONTYPE_DEFRAG_SLICE_USEC;
+
+/* The server's defragmentation API, looked up by JSONTypeDefragInit */
+static void *(*_defragAlloc)(RedisModuleDefragCtx *ctx, void *ptr) = NULL;
+static int (*_defragShouldStop)(RedisModuleDefragCtx *ctx) = NULL;
+
+int JSONTypeDefragInit(void) {
+    if (REDISMODULE_OK != RedisModule_GetApi("RedisModule_DefragAlloc", (void **)&_defragAlloc) ||
+        REDISMODULE_OK !=
+            RedisModule_GetApi("RedisModule_DefragShouldStop", (void **)&_defragShouldStop)) {
+        _defragAlloc = NULL;
+        _defragShouldStop = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* The context of a document's defragmentation */
+typedef struct {
+    RedisModuleDefragCtx *ctx;
+    uint64_t deadline;  // the time that the slice ends at in nanoseconds, see Stats_Begin, or 0
+} _DefragSlice;
+
+static void *_defragMove(void *ptr, void *ctx) {
+    return _defragAlloc(((_DefragSlice *)ctx)->ctx, ptr);
+}
+
+static int _defragStop(void *ctx) {
+    _DefragSlice *slice = (_DefragSlice *)ctx;
+    return (slice->deadline && Stats_Begin() >= slice->deadline) || _defragShouldStop(slice->ctx);
+}
+
+int JSONTypeDefrag(RedisModuleDefragCtx *ctx, RedisModuleString *key, void **value) {
+    JSONType_t *jt = (JSONType_t *)*value;
+    uint64_t begin = Stats_Begin();
+    uint64_t nsecs = JSONTypeDefragSliceUsecs * 1000;
+    _DefragSlice slice = {ctx, nsecs ? begin + nsecs : 0};
+    NodeDefragOpt o = {.alloc = _defragMove, .stop = _defragStop, .ctx = &slice};
+
+    // the document itself stays, as the expiry scheduler and the lists of documents point at it
+    if (jt->cold) {
+        char *cold = _defragMove(jt->cold, &slice);
+        if (cold) {
+            jt->cold = cold;
+            o.moved++;
+            o.bytes += jt->coldlen;
+        }
+    }
+
+    // snapshots may be read by threads, and an unmodified document's nodes are all in its arena
+    NodeDefragCursor cursor = {0}, *c = jt->defrag ? jt->defrag : &cursor;
+    int done = 1;
+    if (jt->root && !jt->shared && !jt->raw && (!jt->arena || jt->modified))
+        done = Node_Defrag(&jt->root, c, &o);
+    if (!done && !jt->defrag) {
+        jt->defrag = malloc(sizeof(NodeDefragCursor));
+        *jt->defrag = cursor;
+        Stats_DefragPending(1);
+    } else if (done) {
+        NodeDefragCursor_Free(c);
+        if (jt->defrag) {
+            free(jt->defrag);
+            jt->defrag = NULL;
+            Stats_DefragPending(-1);
+        }
+    }
+    Stats_End(STATS_DEFRAG, begin, o.bytes, o.nodes, 0);
+    return !done;
+}
+
 size_t JSONTypeMemoryUsage(const void *value) {
-    const JSONType_t *jt = (JSONType_t *)value;
-    size_t memory = sizeof(JSONType_t);
+    // Redis calls this for MEMORY USAGE and for sampling keys to evict, so it mustn't walk the tree
+    JSONType_t *jt = (JSONType_t *)value;
+    size_t memory = sizeof(JSONType_t) + JSONExpire_MemoryUsage(jt);
+    if (jt->schema) memory += JSONSchema_MemoryUsage(jt->schema);
 
-    memory += ObjectTypeMemoryUsage(jt->root);
+    if (jt->raw) {
+        memory += sdsAllocSize(jt->raw);
+    } else if (jt->cold) {
+        memory += jt->coldlen;
+    } else if (jt->arena && !jt->modified) {
+        memory += sizeof(NodeArena) + jt->arena->size;
+    } else {
+        memory += JSONTypeRootMemoryUsage(jt);
+    }
     return memory;
 }
+
+size_t JSONTypeRootMemoryUsage(JSONType_t *jt) {
+    JSONTypeMaterialize(jt);
+    if (jt->rootmemoryversion != jt->version + 1) {
+        jt->rootmemory = ObjectTypeMemoryUsage(jt->root);
+        jt->rootmemoryversion = jt->version + 1;
+    }
+    return jt->rootmemory;
+}
+
+JSONSchema *JSONTypeSchema(JSONType_t *jt, char **err) {
+    if (jt->schema && jt->schemaversion == jt->version + 1) return jt->schema;
+    if (jt->schema) JSONSchema_Free(jt->schema);
+    JSONTypeMaterialize(jt);
+    jt->schema = NewJSONSchema(jt->root, err);
+    jt->schemaversion = jt->version + 1;
+    return jt->schema;
+}
+
+size_t JSONTypeAllocatedMemory(JSONType_t *jt) {
+    JSONTypeMaterialize(jt);
+    size_t memory = ObjectTypeAllocSize(jt, sizeof(JSONType_t));
+    if (jt->shared) memory += ObjectTypeAllocSize(jt->shared, sizeof(JSONTypeShare));
+    if (jt->arena) memory += NodeArena_AllocatedSize(jt->arena, ObjectTypeAllocSize);
+    return memory + ObjectTypeAllocatedMemory(jt->root, 0);
+}
+
+JSONType_t *NewJSONType(void) {
+    JSONType_t *jt = calloc(1, sizeof(JSONType_t));
+    jt->arena = NewNodeArena();
+    _lruTouch(jt);
+    return jt;
+}
+
+int JSONTypeSetLazy(JSONType_t *jt, const char *json, size_t len) {
+    sds raw = sdsempty();
+    if (JSONOBJECT_OK != ValidateJSON(json, len, &raw, NULL)) {
+        sdsfree(raw);
+        return 0;
+    }
+    jt->raw = sdsRemoveFreeSpace(raw);
+    return 1;
+}
+
+/**
+* Makes a document cold, unless it's lazy, its nodes are shared or their encoding doesn't compress
+* to under 7/8 of its size. Returns 1 if it does.
+*/
+static int _freeze(JSONType_t *jt) {
+    if (jt->raw || jt->shared || jt->cold) return 0;
+
+    sds buf = sdsempty();
+    SerializeNodeToBinary(jt->root, &buf);
+    size_t len = sdslen(buf), cap = len - len / 8;
+    char *cold = malloc(cap);
+    size_t clen = Compress(buf, len, cold, cap);
+    sdsfree(buf);
+    if (!clen) {
+        free(cold);
+        return 0;
+    }
+
+    jt->cold = realloc(cold, clen);
+    jt->coldlen = clen;
+    jt->coldsize = len;
+    SerialCache_Drop(&jt->serialized);
+    _dropNodes(jt);
+    jt->root = NULL;
+    jt->arena = NULL;
+    jt->modified = 0;
+    jt->sharing = 0;
+    return 1;
+}
+
+/* The number of the least recently accessed documents that every access checks */
+#define JSONTYPE_COLD_CHECKS 2
+
+/**
+* Makes the documents that weren't accessed for JSONTypeColdSeconds cold. They're removed from the
+* list either way, and the ones that stay as they are return to it when they're accessed again.
+*/
+static void _coldCheck(void) {
+    long long now = RedisModule_Milliseconds(), idle = (long long)JSONTypeColdSeconds * 1000;
+    for (int i = 0; i < JSONTYPE_COLD_CHECKS && _lruhead && now - _lruhead->atime >= idle; i++) {
+        JSONType_t *jt = _lruhead;
+        _lruRemove(jt);
+        _freeze(jt);
+    }
+}
+
+void JSONTypeMaterialize(JSONType_t *jt) {
+    if (jt->cold) {
+        // the encoding of nodes always loads, and a loaded document's is validated
+        char *buf = jt->cold;
+        if (jt->coldlen != jt->coldsize) {
+            buf = malloc(jt->coldsize);
+            Decompress(jt->cold, jt->coldlen, buf, jt->coldsize);
+        }
+        jt->arena = NewNodeArena();
+        NodeArena *prev = Node_SetArena(jt->arena);
+        CreateNodeFromBinary(buf, jt->coldsize, &jt->root);
+        Node_SetArena(prev);
+        if (buf != jt->cold) free(buf);
+        free(jt->cold);
+        jt->cold = NULL;
+        JSONTypeDedup(jt);
+        return;
+    }
+    if (!jt->raw) return;
+
+    // the text was validated when the document was made lazy, so it parses
+    NodeArena *prev = Node_SetArena(jt->arena);
+    CreateNodeFromJSON(jt->raw, sdslen(jt->raw), &jt->root, NULL);
+    Node_SetArena(prev);
+    sdsfree(jt->raw);
+    jt->raw = NULL;
+    JSONTypeDedup(jt);
+}
+
+int JSONTypeDedupValues = 0;
+
+void JSONTypeDedup(JSONType_t *jt) {
+    if (!JSONTypeDedupValues || !jt->root || jt->raw || jt->cold) return;
+    size_t shared = 0;
+    NodeArena *arena = NewNodeArena();
+    NodeArena *prev = Node_SetArena(arena);
+    Node *root = Node_Dedup(jt->root, &shared);
+    Node_SetArena(prev);
+    _dropNodes(jt);
+    jt->root = root;
+    jt->arena = arena;
+    jt->modified = 0;
+    jt->sharing = shared > 0;
+    jt->rootmemoryversion = 0;
+}
+
+/* Makes the arena of a document shareable */
+static JSONTypeShare *_share(JSONType_t *jt) {
+    if (!jt->shared) {
+        jt->shared = malloc(sizeof(JSONTypeShare));
+        *jt->shared = (JSONTypeShare){jt->arena, 1};
+    }
+    jt->sharing = 1;
+    return jt->shared;
+}
+
+/* Copies the shared nodes that a write to the values at sp needs, or all of them without sp */
+static void _own(JSONType_t *jt, SearchPath *sp, int deep) {
+    uint64_t begin = Stats_Begin(), nodes = Node_CreatedCount();
+    NodeArena *prev = Node_SetArena(NULL);
+    if (sp) {
+        SearchPath_Own(sp, &jt->root, deep);
+    } else {
+        Node_OwnAll(&jt->root);
+        jt->sharing = 0;
+    }
+    Node_SetArena(prev);
+
+    // the copies are on the heap
+    nodes = Node_CreatedCount() - nodes;
+    if (nodes) {
+        jt->modified = 1;
+        jt->rootmemoryversion = 0;
+    }
+    Stats_End(STATS_COPY, begin, 0, nodes, 0);
+}
+
+long long JSONTypeCompact(JSONType_t *jt) {
+    JSONTypeAccess(jt, 0);
+    long long before = (long long)JSONTypeMemoryUsage(jt);
+
+    // deduplicating rebuilds the nodes too
+    if (JSONTypeDedupValues && jt->root) {
+        JSONTypeDedup(jt);
+        return before - (long long)JSONTypeMemoryUsage(jt);
+    }
+
+    // the round trip of the encoding lays the nodes out in walk order at their exact capacity
+    sds buf = sdsempty();
+    SerializeNodeToBinary(jt->root, &buf);
+    NodeArena *arena = NewNodeArena();
+    NodeArena *prev = Node_SetArena(arena);
+    Node *root;
+    CreateNodeFromBinary(buf, sdslen(buf), &root);  // the encoding of nodes always loads
+    Node_SetArena(prev);
+    sdsfree(buf);
+    _dropNodes(jt);
+    jt->root = root;
+    jt->arena = arena;
+    jt->modified = 0;
+    jt->sharing = 0;
+    jt->rootmemoryversion = 0;
+
+    return before - (long long)JSONTypeMemoryUsage(jt);
+}
+
+void JSONTypeAccess(JSONType_t *jt, int write) {
+    if (JSONTypeColdSeconds) {
+        _lruTouch(jt);
+        _coldCheck();
+    }
+    JSONTypeMaterialize(jt);
+
+    // the arena is the document's again once its copies and snapshots are released
+    if (jt->shared && 1 == jt->shared->refs) {
+        free(jt->shared);
+        jt->shared = NULL;
+    }
+    if (write && jt->sharing) _own(jt, NULL, 0);
+}
+
+void JSONTypeAccessPath(JSONType_t *jt, SearchPath *sp, int deep) {
+    JSONTypeAccess(jt, 0);
+    if (jt->sharing) _own(jt, sp, deep);
+}
+
+JSONType_t *JSONTypeGet(RedisModuleKey *key) {
+    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONTypeAccess(jt, 0);
+    return jt;
+}
+
+JSONType_t *JSONTypeGetMutable(RedisModuleKey *key) {
+    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONTypeAccess(jt, 1);
+    return jt;
+}
+
+JSONType_t *JSONTypeCopy(JSONType_t *jt) {
+    JSONType_t *copy = calloc(1, sizeof(JSONType_t));
+    _lruTouch(copy);
+    if (jt->raw) {
+        copy->arena = NewNodeArena();
+        copy->raw = sdsdup(jt->raw);
+        return copy;
+    }
+    if (jt->cold) {
+        copy->cold = malloc(jt->coldlen);
+        memcpy(copy->cold, jt->cold, jt->coldlen);
+        copy->coldlen = jt->coldlen;
+        copy->coldsize = jt->coldsize;
+        return copy;
+    }
+
+    JSONTypeShare *s = _share(jt);
+    s->refs++;
+    copy->root = Node_Share(jt->root);
+    copy->arena = s->arena;
+    copy->modified = jt->modified || copy->root != jt->root;
+    copy->sharing = 1;
+    copy->shared = s;
+    return copy;
+}
+
+JSONTypeSnapshot_t *JSONTypeSnapshot(JSONType_t *jt) {
+    JSONTypeSnapshot_t *snap = malloc(sizeof(JSONTypeSnapshot_t));
+    JSONTypeShare *s = _share(jt);
+    s->refs++;
+    *snap = (JSONTypeSnapshot_t){Node_Share(jt->root), jt->modified, s};
+    return snap;
+}
+
+void JSONTypeReleaseSnapshot(JSONTypeSnapshot_t *s) {
+    _releaseShare(s->shared, s->root, s->modified);
+    free(s);
+}
+
+void JSONTypeTouch(JSONType_t *jt) {
+    jt->modified = 1;
+    jt->version++;
+    JSONIndex_Touch(jt);
+}
@@ -19,24 +19,260 @@
 #define __JSON_TYPE_H__
 
 #include "object.h"
+#include "path.h"
 #include "object_type.h"
 #include "json_object.h"
+#include "object_binary.h"
+#include "serial_cache.h"
+#include "stats.h"
 #include "redismodule.h"
 
-#define JSONTYPE_ENCODING_VERSION 0
+/* Version 0 saves every node with its own RDB calls, version 1 saves one binary encoded buffer,
+ * version 2 saves the kind of the buffer before it, which is the text of lazy documents, version 3
+ * saves the expiring paths after it, and version 4 encodes the numbers that keep their text with it
+ */
+#define JSONTYPE_ENCODING_VERSION 4
+#define JSONTYPE_RDB_BINARY 0
+#define JSONTYPE_RDB_TEXT 1
 #define JSONTYPE_NAME "ReJSON-RL"
 
+/* The default size of AOF rewrite chunks, see JSONTypeAofChunkSize */
+#define JSONTYPE_AOF_CHUNK_SIZE (1 << 20)
+
 #define RM_LOGLEVEL_WARNING "warning"
 
 #define OBJECT_ROOT_PATH "."
 
+/**
+* The arena of a document whose nodes are shared by its copies and by snapshots, which threads read,
+* see JSONTypeCopy and JSONTypeSnapshot. Each of them holds the root that it shares (see Node_Share)
+* and the arena, which the last one frees. Shared nodes aren't modified: a write copies the nodes on
+* its way from the root first, see JSONTypeAccessPath. The counts of the arena's holders and of the
+* nodes' holders are only changed on the main thread, as the nodes that others hold are released
+* there rather than on the lazy free thread.
+*/
+typedef struct JSONTypeShare {
+    NodeArena *arena;
+    int refs;  // the documents and the snapshots that hold the arena
+} JSONTypeShare;
+
+/* The nodes of a document at the time of a snapshot, see JSONTypeSnapshot */
+typedef struct JSONTypeSnapshot_t {
+    Node *root;
+    int modified;
+    JSONTypeShare *shared;
+} JSONTypeSnapshot_t;
+
 /* A wrapper for a JSON value. */
-typedef struct {
+typedef struct JSONType_t {
     Node *root;
+    NodeArena *arena;  // the arena that the document was built in, if any
+    int modified;      // set once the document is modified in place, see JSONTypeTouch
+    uint64_t version;  // bumped by every modification, see JSONTypeTouch
+    SerialCacheEntry *serialized;  // the cached serializations of the document's values
+    size_t rootmemory;             // the memory of the root's nodes, see JSONTypeRootMemoryUsage
+    uint64_t rootmemoryversion;    // the version that rootmemory was measured at, plus 1
+    struct JSONIndexDoc *indexed;  // the document's indexing state if it's tracked, see json_index.h
+    sds raw;  // the JSON text of a lazy document until it's materialized, see JSONTypeSetLazy
+    JSONTypeShare *shared;  // set while the arena is shared with copies and snapshots
+    char *cold;       // the binary encoding of a cold document, see JSONTypeColdSeconds
+    size_t coldlen;   // the size of the compressed encoding, or coldsize if it's uncompressed
+    size_t coldsize;  // the size of the encoding
+    long long atime;  // the time the document was last accessed at, in milliseconds
+    struct JSONType_t *lruprev, *lrunext;  // the documents that were accessed before and after
+    struct JSONExpireDoc *expires;  // the document's expiring paths, see json_expire.h
+    JSONSchema *schema;             // the document compiled as a schema, see JSONTypeSchema
+    uint64_t schemaversion;         // the version that schema was compiled at, plus 1
+    NodeDefragCursor *defrag;  // where the document's defragmentation resumes, see JSONTypeDefrag
+    int sharing;  // set while nodes may be shared, by copies and snapshots or by equal values
 } JSONType_t;
 
+/* Creates a new container with an empty arena for building the document in. */
+JSONType_t *NewJSONType(void);
+
+/* Must be called by commands that modify the document in place, i.e. not by replacing its root.
+ * Modified documents may reference heap memory, so they need to be freed node by node. It also
+ * bumps the document's version, so the serializations that are cached for it become stale. */
+void JSONTypeTouch(JSONType_t *jt);
+
+/**
+* Makes a new document lazy: instead of its nodes, it keeps its JSON text without insignificant
+* whitespace, which is checked in a single pass that doesn't build them (see ValidateJSON). The
+* nodes are built in the document's arena when they're first needed, see JSONTypeMaterialize.
+* Returns 1 if the JSON is valid and the document is lazy, and 0 otherwise.
+*/
+int JSONTypeSetLazy(JSONType_t *jt, const char *json, size_t len);
+
+/**
+* Builds the nodes of a lazy document from its text, or of a cold document from its compressed
+* encoding, which is then dropped, and deduplicates them, see JSONTypeDedup. Does nothing for a
+* document that's neither.
+*/
+void JSONTypeMaterialize(JSONType_t *jt);
+
+/**
+* Prepares a document for a command: a lazy or cold document is materialized, and a document that
+* will be written to anywhere gets all its nodes of its own if it may share them (see Node_OwnAll),
+* which copies every node that's shared. Reads don't modify nodes, so they use shared nodes as they
+* are, even while a snapshot's thread reads them. It also marks the document as accessed, see
+* JSONTypeColdSeconds.
+*/
+void JSONTypeAccess(JSONType_t *jt, int write);
+
+/**
+* Prepares a document for a command that writes to the values that a path matches, like
+* JSONTypeAccess, but a document that may share nodes only gets the nodes on the path's way of its
+* own, see SearchPath_Own, and with deep set the descendants of its value too. Writing to a value in
+* a document that a copy or a snapshot shares then copies the nodes from the root to the value and
+* holds their siblings, rather than copying the whole document. The copies are counted in the
+* statistics of STATS_COPY.
+*/
+void JSONTypeAccessPath(JSONType_t *jt, SearchPath *sp, int deep);
+
+/**
+* Rebuilds a document's nodes in a new arena, in the order that they're walked and with containers
+* at their exact capacity, which drops the slack that writes leave and the heap allocations they
+* make. Returns the bytes that it reclaims according to JSONTypeMemoryUsage, which can be negative
+* for a document that was already compact, as the arena's last block is partly unused. The nodes are
+* deduplicated too if JSONTypeDedupValues is set, see JSONTypeDedup.
+*/
+long long JSONTypeCompact(JSONType_t *jt);
+
+/**
+* Rebuilds a document's nodes in a new arena with its equal values sharing nodes, see Node_Dedup,
+* if JSONTypeDedupValues is set. The document's shared nodes aren't written to: a write copies the
+* shared nodes on its way (see JSONTypeAccessPath), and the rest stay shared until the document is
+* deduplicated again, e.g. when it's loaded or compacted. Does nothing for a document that's lazy or
+* cold, and a document with no equal values keeps nodes of its own. The nodes that a document shares
+* with copies and snapshots are released, so it doesn't share them anymore.
+*/
+void JSONTypeDedup(JSONType_t *jt);
+
+/**
+* Gets the document that a key of the JSON type holds for reading, see JSONTypeAccess. Commands that
+* only need the text of the whole document can take it with RedisModule_ModuleTypeGetValue instead.
+*/
+JSONType_t *JSONTypeGet(RedisModuleKey *key);
+
+/** Gets the document that a key of the JSON type holds for writing, see JSONTypeAccess */
+JSONType_t *JSONTypeGetMutable(RedisModuleKey *key);
+
+/**
+* Creates a copy of a document in O(1), that shares its nodes with it. Either one that's written to
+* copies the nodes that the write changes, see JSONTypeAccessPath, and they share the rest.
+* A lazy document's text and a cold document's encoding are copied, since they have no nodes.
+*/
+JSONType_t *JSONTypeCopy(JSONType_t *jt);
+
+/**
+* Takes a snapshot of a materialized document's nodes in O(1), for a thread to read its values on
+* until the snapshot is released on the main thread with JSONTypeReleaseSnapshot.
+*/
+JSONTypeSnapshot_t *JSONTypeSnapshot(JSONType_t *jt);
+
+void JSONTypeReleaseSnapshot(JSONTypeSnapshot_t *s);
+
 void *JSONTypeRdbLoad(RedisModuleIO *rdb, int encver);
 void JSONTypeRdbSave(RedisModuleIO *rdb, void *value);
+/**
+* The approximate size of the commands that rewrite big documents in the AOF, set with the
+* AOF_CHUNK_SIZE module argument. Documents that are bigger are rewritten with a JSON.SET of their
+* root that holds as much as fits, and then JSON.SET and JSON.ARRAPPEND commands that add the rest.
+* 0 disables chunking, so every document is rewritten with a single JSON.SET.
+*/
+extern size_t JSONTypeAofChunkSize;
+
+/**
+* The size of the JSON of root values that JSON.SET keeps lazy documents for, see JSONTypeSetLazy.
+* It's set with the LAZY_DOCUMENT_SIZE module argument, and 0 (the default) disables lazy documents.
+*/
+extern size_t JSONTypeLazySize;
+
+/**
+* Documents of at least this many nodes are freed on a thread, so deleting or overwriting them
+* doesn't block Redis, like its lazy freeing of big values of its own types. The thread frees them
+* in the order that they were deleted. Counting the nodes stops at this number, so small documents
+* only pay for a walk of their nodes.
+* It's set with the LAZYFREE_NODES module argument, 0 (the default) frees every document at once.
+*/
+extern size_t JSONTypeLazyFreeNodes;
+
+/**
+* The seconds after which documents that aren't accessed go cold: their nodes are replaced by their
+* binary encoding compressed, until they're accessed again and materialized. Lazy documents and ones
+* whose nodes are shared stay as they are. There are no timers, so accesses check the least recently
+* accessed documents, a few at a time.
+* It's set with the COLD_DOCUMENT_SECONDS module argument, 0 (the default) disables cold documents.
+*/
+extern uint32_t JSONTypeColdSeconds;
+
+/**
+* Documents that are loaded from the RDB in the binary encoding keep it, only validated, as the
+* uncompressed encoding of a cold document until they're first accessed. Loading then takes a read
+* and a pass over every value's buffer, and the nodes are built by the commands that need them.
+* It's set with the LAZY_RDB_LOAD module argument, 0 (the default) builds the nodes when loading.
+*/
+extern int JSONTypeLazyLoad;
+
+/**
+* Deduplicates documents when they're set at the root by JSON.SET, loaded from the RDB,
+* materialized or compacted, see JSONTypeDedup. It suits documents that repeat big values and
+* are mostly read, as their first write copies every node.
+* It's set with the DEDUP module argument, 0 (the default) disables deduplication.
+*/
+extern int JSONTypeDedupValues;
+
+/**
+* The most microseconds that JSONTypeDefrag spends on a document per call, after which the
+* document's defragmentation stops and resumes from there the next time the server gets to the
+* document. It's set with the DEFRAG_SLICE_USEC module argument, 1000 by default, and 0 defragments
+* documents at once.
+*/
+extern size_t JSONTypeDefragSliceUsecs;
+
+/* The default of JSONTypeDefragSliceUsecs */
+#define JSONTYPE_DEFRAG_SLICE_USEC 1000
+
+/** Looks up the server's active defragmentation API. Returns 1 if it has one, 0 otherwise. */
+int JSONTypeDefragInit(void);
+
+/**
+* The server's active defragmentation of a document: its nodes' allocations, and its cold encoding,
+* are moved where the allocator wants them (see Node_Defrag), in slices of JSONTypeDefragSliceUsecs
+* or of the time that the server gives, whichever is shorter. A document whose walk stops keeps its
+* cursor, and the walk resumes from it. The nodes of documents that share them with snapshots, and
+* of documents that are entirely in their arena, aren't moved. Returns 1 if the walk stopped, 0 when
+* it's done.
+*/
+int JSONTypeDefrag(RedisModuleDefragCtx *ctx, RedisModuleString *key, void **value);
+
+/**
+* The memory usage of the document's nodes, as reported by ObjectTypeMemoryUsage. It is measured once
+* per version of the document, so repeated calls on a document that isn't modified take O(1).
+*/
+size_t JSONTypeRootMemoryUsage(JSONType_t *jt);
+
+/**
+* The bytes that the allocator holds for the document, see ObjectTypeAllocatedMemory: the document,
+* its arena's blocks as a whole, and its nodes' heap memory. It walks the tree every time.
+*/
+size_t JSONTypeAllocatedMemory(JSONType_t *jt);
+
+/**
+* The validator that a document compiles to as a JSON Schema, for validating values against it, see
+* json_schema.h. It's compiled once per version of the document and kept with it, and isn't saved.
+* Returns NULL and sets the optional err, which the caller frees, if the document isn't a schema.
+*/
+JSONSchema *JSONTypeSchema(JSONType_t *jt, char **err);
+
+/**
+* Returns the path of a dictionary's member at path, or NULL if the key can't be written in a path.
+* Keys are written as identifiers when they are ones, and in brackets otherwise, quoted with double
+* quotes or else single quotes that the key doesn't contain. Empty keys and keys with both quotes
+* can't be written.
+*/
+sds JSONTypeKeyPath(const sds path, const char *key);
+
 void JSONTypeAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value);
 void JSONTypeFree(void *value);
 size_t JSONTypeMemoryUsage(const void *value);
@@ -0,0 +1,140 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "module_config.h"
+
+#ifdef REDIS_MODULE_TARGET
+#include <alloc.h>
+#endif
+
+/* Compares names case insensitively */
+static int __config_eq(const char *a, const char *b) {
+    while (*a && tolower((unsigned char)*a) == tolower((unsigned char)*b)) a++, b++;
+    return !*a && !*b;
+}
+
+ModuleConfigParam *ModuleConfig_Find(ModuleConfigParam *params, const char *name) {
+    for (ModuleConfigParam *p = params; p->name; p++) {
+        if (__config_eq(p->name, name)) return p;
+    }
+    return NULL;
+}
+
+/* Parses a whole decimal number */
+static int __config_number(const char *value, size_t len, long long *n) {
+    char buf[32], *end;
+    if (!len || len >= sizeof(buf)) return 0;
+    memcpy(buf, value, len);
+    buf[len] = '\0';
+    errno = 0;
+    *n = strtoll(buf, &end, 10);
+    return !errno && end == buf + len && !isspace((unsigned char)buf[0]);
+}
+
+const char *ModuleConfig_Set(ModuleConfigParam *p, const char *value, size_t len, int loading) {
+    if (!loading && (p->flags & MODULECONFIG_F_LOAD_ONLY)) return MODULECONFIG_ERROR_LOAD_ONLY;
+
+    // the previous value is restored if the new one can't be applied
+    long long n = 0;
+    union {
+        size_t size;
+        uint32_t u32;
+        int i;
+        sds s;
+    } prev;
+    if (MODULECONFIG_STRING != p->type) {
+        if (!__config_number(value, len, &n) || n < p->min || n > p->max)
+            return MODULECONFIG_ERROR_VALUE;
+    }
+    switch (p->type) {
+        case MODULECONFIG_SIZE:
+            prev.size = *(size_t *)p->var;
+            *(size_t *)p->var = (size_t)n;
+            break;
+        case MODULECONFIG_UINT32:
+            prev.u32 = *(uint32_t *)p->var;
+            *(uint32_t *)p->var = (uint32_t)n;
+            break;
+        case MODULECONFIG_INT:
+            prev.i = *(int *)p->var;
+            *(int *)p->var = (int)n;
+            break;
+        case MODULECONFIG_STRING:
+            prev.s = *(sds *)p->var;
+            *(sds *)p->var = sdsnewlen(value, len);
+            break;
+    }
+    if (!p->apply || p->apply(p)) {
+        if (MODULECONFIG_STRING == p->type) sdsfree(prev.s);
+        return NULL;
+    }
+
+    switch (p->type) {
+        case MODULECONFIG_SIZE:
+            *(size_t *)p->var = prev.size;
+            break;
+        case MODULECONFIG_UINT32:
+            *(uint32_t *)p->var = prev.u32;
+            break;
+        case MODULECONFIG_INT:
+            *(int *)p->var = prev.i;
+            break;
+        case MODULECONFIG_STRING:
+            sdsfree(*(sds *)p->var);
+            *(sds *)p->var = prev.s;
+            break;
+    }
+    return MODULECONFIG_ERROR_APPLY;
+}
+
+sds ModuleConfig_Get(const ModuleConfigParam *p, sds buf) {
+    switch (p->type) {
+        case MODULECONFIG_SIZE:
+            return sdscatprintf(buf, "%zu", *(size_t *)p->var);
+        case MODULECONFIG_UINT32:
+            return sdscatprintf(buf, "%u", *(uint32_t *)p->var);
+        case MODULECONFIG_INT:
+            return sdscatprintf(buf, "%d", *(int *)p->var);
+        case MODULECONFIG_STRING: {
+            sds s = *(sds *)p->var;
+            return s ? sdscatsds(buf, s) : buf;
+        }
+    }
+    return buf;
+}
+
+int ModuleConfig_Match(const char *pattern, const char *name) {
+    for (; *pattern; pattern++, name++) {
+        if ('*' == *pattern) {
+            while ('*' == pattern[1]) pattern++;
+            if (!pattern[1]) return 1;
+            for (; *name; name++) {
+                if (ModuleConfig_Match(pattern + 1, name)) return 1;
+            }
+            return 0;
+        }
+        if (!*name) return 0;
+        if ('?' != *pattern && tolower((unsigned char)*pattern) != tolower((unsigned char)*name))
+            return 0;
+    }
+    return !*name;
+}
@@ -0,0 +1,73 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MODULE_CONFIG_H__
+#define __MODULE_CONFIG_H__
+
+#include <sds.h>
+#include <stddef.h>
+
+/**
+* The module's settings, which are given as module arguments when it's loaded and can be changed
+* at runtime with JSON.CONFIG SET. A setting is a variable that the code reads whenever it uses it,
+* so a change applies to what is done from then on. Settings that take more than that, e.g. a cache
+* that must be resized, have a function that applies the new value.
+* The table of the settings is the module's, these are the functions that parse and print them.
+*/
+
+/* The types of the settings' variables, strings are sds */
+typedef enum {
+    MODULECONFIG_SIZE,    // size_t
+    MODULECONFIG_UINT32,  // uint32_t
+    MODULECONFIG_INT,     // int
+    MODULECONFIG_STRING,  // sds, NULL when unset
+} ModuleConfigType;
+
+/* The setting can only be given as a module argument, e.g. because existing values depend on it */
+#define MODULECONFIG_F_LOAD_ONLY 0x1
+
+typedef struct ModuleConfigParam {
+    const char *name;
+    ModuleConfigType type;
+    void *var;
+    long long min, max;  // the range of numbers
+    int flags;
+    int (*apply)(const struct ModuleConfigParam *p);  // returns 0 if the new value can't be applied
+} ModuleConfigParam;
+
+#define MODULECONFIG_ERROR_UNKNOWN "ERR unknown setting"
+#define MODULECONFIG_ERROR_VALUE "ERR invalid value for setting"
+#define MODULECONFIG_ERROR_LOAD_ONLY "ERR setting can only be given as a module argument"
+#define MODULECONFIG_ERROR_APPLY "ERR setting can't be applied"
+
+/** Finds a setting by its name, case insensitively, in a table that ends with a NULL name */
+ModuleConfigParam *ModuleConfig_Find(ModuleConfigParam *params, const char *name);
+
+/**
+* Sets a setting from the text of its value, and applies it. loading is set for module arguments.
+* Returns NULL on success, or one of the MODULECONFIG_ERROR messages, in which case the setting
+* keeps its value.
+*/
+const char *ModuleConfig_Set(ModuleConfigParam *p, const char *value, size_t len, int loading);
+
+/** Appends the text of a setting's value to buf */
+sds ModuleConfig_Get(const ModuleConfigParam *p, sds buf);
+
+/** Checks whether a name matches a glob-style pattern of '*' and '?', case insensitively */
+int ModuleConfig_Match(const char *pattern, const char *name);
+
+#endif
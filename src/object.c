@@ -16,43 +16,340 @@
 */
 
 #include "object.h"
+#include "array_index.h"
+#include "dict_trie.h"
+#include "object_search.h"
+
+uint32_t NodeDictHashThreshold = OBJECT_DICT_HASH_THRESHOLD;
+uint32_t NodeArrayGrowthChunk = OBJECT_ARRAY_GROWTH_CHUNK;
+uint32_t NodeDictTrieThreshold = OBJECT_DICT_TRIE_THRESHOLD;
+uint32_t NodeStringCompressSize = 0;
+
+/* A block of arena memory, blocks are chained from the newest to the oldest */
+typedef struct t_arena_block {
+    struct t_arena_block *next;
+    size_t size;  // the size of the data
+    size_t used;  // the number of used data bytes
+    char data[];
+} NodeArenaBlock;
+
+/* The arena that new nodes are allocated in by the thread, NULL for the heap */
+static __thread NodeArena *_arena = NULL;
+
+/* The slot that the thread's next node is created in, see Node_SetSlot */
+static __thread Node *_slot = NULL;
+
+/* The number of nodes that the thread has created, see Node_CreatedCount */
+static __thread uint64_t _created = 0;
+
+NodeArena *NewNodeArena(void) { return calloc(1, sizeof(NodeArena)); }
+
+void NodeArena_Free(NodeArena *a) {
+    if (!a) return;
+    if (a->nkeys) Intern_ReleaseN(a->keys, a->nkeys);
+    free(a->keys);
+    for (uint32_t i = 0; i < a->nindexed; i++) {
+        if (N_ARRAY == a->indexed[i]->type) ArrayIndex_Drop(a->indexed[i]);
+        else DictTrie_Drop(a->indexed[i]);
+    }
+    free(a->indexed);
+    NodeArenaBlock *b = a->head;
+    while (b) {
+        NodeArenaBlock *next = b->next;
+        free(b);
+        b = next;
+    }
+    free(a);
+}
 
-Node *__newNode(NodeType t) {
-    Node *ret = malloc(sizeof(Node));
-    ret->type = t;
+size_t NodeArena_AllocatedSize(const NodeArena *a, NodeAllocSizeFunc alloc) {
+    size_t size = alloc(a, sizeof(NodeArena));
+    for (const NodeArenaBlock *b = a->head; b; b = b->next)
+        size += alloc(b, sizeof(NodeArenaBlock) + b->size);
+    if (a->keys) size += alloc(a->keys, a->capkeys * sizeof(char *));
+    if (a->indexed) size += alloc(a->indexed, a->capindexed * sizeof(Node *));
+    return size;
+}
+
+void *NodeArena_Alloc(NodeArena *a, size_t size) {
+    NodeArenaBlock *b = a->head;
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    if (!b || b->size - b->used < size) {
+        // blocks grow with the arena, and big allocations get a block of their own. Blocks take a
+        // power of 2 with their header, which is an exact size class of the allocator.
+        size_t bsize = OBJECT_ARENA_MIN_BLOCK;
+        if (a->head) bsize = MIN((sizeof(NodeArenaBlock) + a->head->size) * 2, OBJECT_ARENA_MAX_BLOCK);
+        bsize -= sizeof(NodeArenaBlock);
+        if (bsize < size) bsize = size;
+        b = malloc(sizeof(NodeArenaBlock) + bsize);
+        b->size = bsize;
+        b->used = 0;
+        // keep filling the current block if the new one is a dedicated one
+        if (bsize == size && a->head) {
+            b->next = a->head->next;
+            a->head->next = b;
+        } else {
+            b->next = a->head;
+            a->head = b;
+        }
+        a->size += sizeof(NodeArenaBlock) + bsize;
+    }
+
+    void *ret = &b->data[b->used];
+    b->used += size;
+    return ret;
+}
+
+/* Hands a reference to an interned key over to the arena. */
+static void __arena_addkey(NodeArena *a, const char *key) {
+    if (a->nkeys == a->capkeys) {
+        a->capkeys = a->capkeys ? a->capkeys * 2 : 16;
+        a->keys = realloc(a->keys, a->capkeys * sizeof(char *));
+    }
+    a->keys[a->nkeys++] = key;
+}
+
+/* Hands an indexed array or dictionary over to the arena, that frees its index */
+static void __arena_addindexed(NodeArena *a, const Node *arr) {
+    if (a->nindexed == a->capindexed) {
+        a->capindexed = a->capindexed ? a->capindexed * 2 : 4;
+        a->indexed = realloc(a->indexed, a->capindexed * sizeof(Node *));
+    }
+    a->indexed[a->nindexed++] = arr;
+}
+
+void NodeArena_Merge(NodeArena *a, NodeArena *from) {
+    // the blocks go after the current one, which is still filled first
+    if (from->head) {
+        NodeArenaBlock *last = from->head;
+        while (last->next) last = last->next;
+        if (a->head) {
+            last->next = a->head->next;
+            a->head->next = from->head;
+        } else {
+            a->head = from->head;
+        }
+        a->size += from->size;
+    }
+    for (uint32_t i = 0; i < from->nkeys; i++) __arena_addkey(a, from->keys[i]);
+    for (uint32_t i = 0; i < from->nindexed; i++) __arena_addindexed(a, from->indexed[i]);
+    free(from->keys);
+    free(from->indexed);
+    free(from);
+}
+
+NodeArena *Node_SetArena(NodeArena *a) {
+    NodeArena *prev = _arena;
+    _arena = a;
+    return prev;
+}
+
+Node *NodeArena_AllocSlots(uint32_t count) {
+    return _arena && count ? NodeArena_Alloc(_arena, count * sizeof(Node)) : NULL;
+}
+
+Node *Node_SetSlot(Node *slot) {
+    Node *prev = _slot;
+    _slot = slot;
+    return prev;
+}
+
+/* Allocates a node's string, key or entries, in the current arena when there is one. */
+static void *__node_alloc(Node *n, size_t size) {
+    if (!_arena) return malloc(size);
+    n->flags |= NODE_F_ARENA_DATA;
+    return NodeArena_Alloc(_arena, size);
+}
+
+/* Reallocates a node's data. Data in an arena is never freed, so unless the node is being built in
+ * the current arena, i.e. by the parser, the data has to move to the heap. So does inlined data. */
+static void *__node_realloc(Node *n, void *ptr, size_t oldsize, size_t size) {
+    int heap = !(n->flags & (NODE_F_ARENA_DATA | NODE_F_INLINE_DATA));
+    void *ret;
+    if (_arena && (n->flags & NODE_F_ARENA)) {
+        ret = NodeArena_Alloc(_arena, size);
+        n->flags |= NODE_F_ARENA_DATA;
+    } else if (heap) {
+        return realloc(ptr, size);
+    } else {
+        ret = malloc(size);
+        n->flags &= ~NODE_F_ARENA_DATA;
+    }
+    n->flags &= ~NODE_F_INLINE_DATA;
+    if (ptr) memcpy(ret, ptr, MIN(oldsize, size));
+    if (heap) free(ptr);
+    return ret;
+}
+
+/* Frees a node's data unless it is in an arena or inlined. */
+static inline void __node_freedata(Node *n, void *ptr) {
+    if (!(n->flags & (NODE_F_ARENA_DATA | NODE_F_INLINE_DATA))) free(ptr);
+}
+
+/* Copies a string to a NULL terminated one that the node owns. */
+static char *__node_strdup(Node *n, const char *s, uint32_t len) {
+    char *ret = __node_alloc(n, len + 1);
+    memcpy(ret, s, len);
+    ret[len] = '\0';
     return ret;
 }
 
-Node *NewBoolNode(int val) {
-    Node *ret = __newNode(N_BOOLEAN);
-    ret->value.boolval = val != 0;
+/* Allocates a node with size - sizeof(Node) extra bytes after it. */
+static Node *__newNodeSize(NodeType t, size_t size) {
+    Node *ret;
+    if (_slot && _arena && sizeof(Node) == size) {
+        ret = _slot;
+        _slot = NULL;
+    } else {
+        ret = _arena ? NodeArena_Alloc(_arena, size) : malloc(size);
+    }
+    _created++;
+    ret->type = t;
+    ret->flags = _arena ? NODE_F_ARENA : 0;
+    ret->refs = 0;
     return ret;
 }
 
+Node *__newNode(NodeType t) { return __newNodeSize(t, sizeof(Node)); }
+
+uint64_t Node_CreatedCount(void) { return _created; }
+
+/* Frees the node's struct unless it is in an arena. */
+static inline void __node_freenode(Node *n) {
+    if (!(n->flags & NODE_F_ARENA)) free(n);
+}
+
+/* The shared boolean and small integer nodes */
+static Node _false = {.value.boolval = 0, .type = N_BOOLEAN, .flags = NODE_F_STATIC};
+static Node _true = {.value.boolval = 1, .type = N_BOOLEAN, .flags = NODE_F_STATIC};
+static Node _sharedints[OBJECT_SHARED_INT_MAX - OBJECT_SHARED_INT_MIN + 1];
+
+Node *NewBoolNode(int val) { return val ? &_true : &_false; }
+
 Node *NewDoubleNode(double val) {
     Node *ret = __newNode(N_NUMBER);
     ret->value.numval = val;
     return ret;
 }
 
+Node *NewNumberTextNode(const char *s, uint32_t len) {
+    Node *ret;
+    if (len <= OBJECT_INLINE_STRING_MAX && !(_slot && _arena)) {
+        ret = __newNodeSize(N_NUMBER, sizeof(Node) + len + 1);
+        char *data = (char *)(ret + 1);
+        memcpy(data, s, len);
+        data[len] = '\0';
+        ret->value.strval.data = data;
+        ret->flags |= NODE_F_INLINE_DATA;
+    } else {
+        ret = __newNode(N_NUMBER);
+        ret->value.strval.data = __node_strdup(ret, s, len);
+    }
+    ret->value.strval.len = len;
+    ret->flags |= NODE_F_NUMBER_TEXT;
+    return ret;
+}
+
+double Node_Number(const Node *n) {
+    if (!(n->flags & NODE_F_NUMBER_TEXT)) return n->value.numval;
+
+    // the text that a node views, e.g. in a binary encoding, isn't NULL terminated
+    char tmp[64];
+    uint32_t len = n->value.strval.len;
+    char *num = len < sizeof(tmp) ? tmp : malloc(len + 1);
+    memcpy(num, n->value.strval.data, len);
+    num[len] = '\0';
+    double val = strtod(num, NULL);
+    if (num != tmp) free(num);
+    return val;
+}
+
 Node *NewIntNode(int64_t val) {
-    Node *ret = __newNode(N_INTEGER);
+    Node *ret;
+    if (val >= OBJECT_SHARED_INT_MIN && val <= OBJECT_SHARED_INT_MAX) {
+        // shared nodes are set up on first use, the type is set last as it marks them as ready for
+        // the other threads that parse
+        ret = &_sharedints[val - OBJECT_SHARED_INT_MIN];
+        if (N_INTEGER != __atomic_load_n(&ret->type, __ATOMIC_ACQUIRE)) {
+            ret->value.intval = val;
+            ret->flags = NODE_F_STATIC;
+            __atomic_store_n(&ret->type, N_INTEGER, __ATOMIC_RELEASE);
+        }
+        return ret;
+    }
+    ret = __newNode(N_INTEGER);
     ret->value.intval = val;
     return ret;
 }
 
+/* Stores a node's string compressed, unless that saves under an eighth. Returns 1 if it does. */
+static int __node_strcompress(Node *n, const char *s, uint32_t len) {
+    size_t cap = len - len / 8;
+    char *buf = malloc(cap);
+    uint32_t clen = Compress(s, len, buf, cap);
+    if (clen) {
+        char *data = __node_alloc(n, sizeof(uint32_t) + clen);
+        memcpy(data, &clen, sizeof(uint32_t));
+        memcpy(data + sizeof(uint32_t), buf, clen);
+        n->value.strval.data = data;
+        n->flags |= NODE_F_COMPRESSED;
+    }
+    free(buf);
+    return clen != 0;
+}
+
 Node *NewStringNode(const char *s, uint32_t len) {
-    Node *ret = __newNode(N_STRING);
-    ret->value.strval.data = strndup(s, len);
+    Node *ret;
+    if (len <= OBJECT_INLINE_STRING_MAX && !(_slot && _arena)) {
+        ret = __newNodeSize(N_STRING, sizeof(Node) + len + 1);
+        char *data = (char *)(ret + 1);
+        memcpy(data, s, len);
+        data[len] = '\0';
+        ret->value.strval.data = data;
+        ret->flags |= NODE_F_INLINE_DATA;
+    } else {
+        ret = __newNode(N_STRING);
+        if (!NodeStringCompressSize || len < NodeStringCompressSize ||
+            !__node_strcompress(ret, s, len)) {
+            ret->value.strval.data = __node_strdup(ret, s, len);
+        }
+    }
+    ret->value.strval.len = len;
+    return ret;
+}
+
+Node *NewStringNodeBuffer(uint32_t len, char **data) {
+    Node *ret;
+    if (len <= OBJECT_INLINE_STRING_MAX && !(_slot && _arena)) {
+        ret = __newNodeSize(N_STRING, sizeof(Node) + len + 1);
+        *data = (char *)(ret + 1);
+        ret->flags |= NODE_F_INLINE_DATA;
+    } else {
+        ret = __newNode(N_STRING);
+        *data = __node_alloc(ret, len + 1);
+    }
+    (*data)[len] = '\0';
+    ret->value.strval.data = *data;
     ret->value.strval.len = len;
     return ret;
 }
 
+void Node_StringSetLength(Node *n, uint32_t len) {
+    ((char *)n->value.strval.data)[len] = '\0';
+    n->value.strval.len = len;
+}
+
 Node *NewCStringNode(const char *s) { return NewStringNode(s, strlen(s)); }
 
 Node *NewKeyValNode(const char *key, uint32_t len, Node *n) {
     Node *ret = __newNode(N_KEYVAL);
-    ret->value.kvval.key = strndup(key, len);
+    ret->value.kvval.key = Intern_Acquire(key, len);
+    // the arena releases the keys of its nodes all at once
+    if (_arena) {
+        __arena_addkey(_arena, ret->value.kvval.key);
+        ret->flags |= NODE_F_ARENA_DATA;
+    }
     ret->value.kvval.val = n;
     return ret;
 }
@@ -61,65 +358,229 @@ Node *NewArrayNode(uint32_t cap) {
     Node *ret = __newNode(N_ARRAY);
     ret->value.arrval.cap = cap;
     ret->value.arrval.len = 0;
-    ret->value.arrval.entries = calloc(cap, sizeof(Node *));
+    ret->value.arrval.entries = cap ? __node_alloc(ret, cap * sizeof(Node *)) : NULL;
     return ret;
 }
 
+/* The capacity of a dictionary's hash index is the power of 2 that's at least twice its own. */
+static inline uint32_t __obj_indexcap(uint32_t cap) {
+    uint32_t icap = 8;
+    while (icap < cap * 2) icap <<= 1;
+    return icap;
+}
+
+/* The size of the allocation that holds the dictionary's entries, and its index if needed. */
+static inline size_t __obj_blocksize(uint32_t cap, int indexed) {
+    size_t size = cap * sizeof(Node *);
+    if (indexed) size += __obj_indexcap(cap) * sizeof(uint32_t);
+    return size;
+}
+
+/* The index slots come right after the entries, each slot is an entry's position + 1 or 0 if empty */
+#define __obj_index(o) ((uint32_t *)&(o)->entries[(o)->cap])
+#define __obj_key(o, i) ((o)->entries[i]->value.kvval.key)
+
 Node *NewDictNode(uint32_t cap) {
     Node *ret = __newNode(N_DICT);
+    int indexed = NodeDictHashThreshold && cap >= NodeDictHashThreshold;
     ret->value.dictval.cap = cap;
     ret->value.dictval.len = 0;
-    ret->value.dictval.entries = calloc(cap, sizeof(Node *));
+    ret->value.dictval.entries = NULL;
+    if (indexed) ret->flags |= NODE_F_DICT_INDEXED;
+    if (cap) {
+        size_t size = __obj_blocksize(cap, indexed);
+        ret->value.dictval.entries = memset(__node_alloc(ret, size), 0, size);
+    }
     return ret;
 }
 
-void __node_FreeKV(Node *n) {
-    Node_Free(n->value.kvval.val);
-    free((char *)n->value.kvval.key);
-    free(n);
+/* Releases the node's key unless the arena holds the reference. */
+static inline void __node_releasekey(Node *n) {
+    if (!(n->flags & NODE_F_ARENA_DATA)) Intern_Release(n->value.kvval.key);
+}
+
+/* The head gap of an array's entries, the slot before them holds its size */
+#define __arr_gap(arr) \
+    ((arr)->flags & NODE_F_ARRAY_GAP ? (uint32_t)((uintptr_t *)(arr)->value.arrval.entries)[-1] : 0)
+
+static inline void __arr_setgap(Node *arr, uint32_t gap) {
+    if (gap) {
+        arr->flags |= NODE_F_ARRAY_GAP;
+        ((uintptr_t *)arr->value.arrval.entries)[-1] = gap;
+    } else {
+        arr->flags &= ~NODE_F_ARRAY_GAP;
+    }
+}
+
+uint32_t Node_ArrayGap(const Node *arr) { return __arr_gap(arr); }
+
+/* === Walks ===
+* Walks of trees keep the containers that they are in on an explicit stack instead of recursing, so
+* that any depth costs no more than a frame per level. The first levels' frames are on the C stack.
+*/
+
+typedef struct {
+    Node *node;
+    uint32_t index;  // the position of the container's next child
+} NodeStackFrame;
+
+#define NODE_STACK_INLINE 32
+
+typedef struct {
+    NodeStackFrame *frames;
+    uint32_t len, cap;
+    NodeStackFrame inlined[NODE_STACK_INLINE];
+} NodeStack;
+
+static inline void __stack_init(NodeStack *s) {
+    s->frames = s->inlined;
+    s->len = 0;
+    s->cap = NODE_STACK_INLINE;
 }
 
-void __node_FreeObj(Node *n) {
-    for (int i = 0; i < n->value.dictval.len; i++) {
-        Node_Free(n->value.dictval.entries[i]);
+static inline void __stack_push(NodeStack *s, const Node *n) {
+    if (s->len == s->cap) {
+        size_t size = s->cap * sizeof(NodeStackFrame);
+        s->frames = s->frames == s->inlined ? memcpy(malloc(2 * size), s->inlined, size)
+                                            : realloc(s->frames, 2 * size);
+        s->cap *= 2;
     }
-    if (n->value.dictval.entries) free(n->value.dictval.entries);
-    free(n);
+    s->frames[s->len++] = (NodeStackFrame){(Node *)n, 0};
+}
+
+static inline NodeStackFrame *__stack_top(NodeStack *s) { return &s->frames[s->len - 1]; }
+
+static inline void __stack_free(NodeStack *s) {
+    if (s->frames != s->inlined) free(s->frames);
 }
 
-void __node_FreeArr(Node *n) {
-    for (int i = 0; i < n->value.arrval.len; i++) {
-        Node_Free(n->value.arrval.entries[i]);
+/* The number of children that a walk visits: a container's items or a keyval's value */
+static inline uint32_t __node_nchildren(const Node *n) {
+    if (!n) return 0;
+    switch (n->type) {
+        case N_ARRAY:
+            return n->value.arrval.len;
+        case N_DICT:
+            return n->value.dictval.len;
+        case N_KEYVAL:
+            return 1;
+        default:
+            return 0;
     }
-    free(n->value.arrval.entries);
-    free(n);
 }
 
-void __node_FreeString(Node *n) {
-    free((char *)n->value.strval.data);
-    free(n);
+/* The child of a dictionary or a keyval, or of a generic array */
+static inline Node *__node_child(const Node *n, uint32_t i) {
+    if (N_KEYVAL == n->type) return n->value.kvval.val;
+    return N_DICT == n->type ? n->value.dictval.entries[i] : n->value.arrval.entries[i];
 }
 
-void Node_Free(Node *n) {
-    // ignore NULL nodes
-    if (!n) return;
+/* Where a dictionary, a keyval or a generic array holds its child, see __node_child */
+static inline Node **__node_childref(Node *n, uint32_t i) {
+    if (N_KEYVAL == n->type) return &n->value.kvval.val;
+    return N_DICT == n->type ? &n->value.dictval.entries[i] : &n->value.arrval.entries[i];
+}
+
+/* The number of child nodes that are freed with a node, packed arrays have none */
+static inline uint32_t __node_nowned(const Node *n) {
+    return N_ARRAY == n->type && (n->flags & NODE_F_PACKED) ? 0 : __node_nchildren(n);
+}
 
+/* Frees a node's own memory, after its children */
+static void __node_freeself(Node *n) {
     switch (n->type) {
         case N_ARRAY:
-            __node_FreeArr(n);
+            __node_freedata(n, n->value.arrval.entries - __arr_gap(n));
+            if (n->flags & NODE_F_ARRAY_INDEXED) ArrayIndex_Drop(n);
             break;
         case N_DICT:
-            __node_FreeObj(n);
+            if (n->value.dictval.entries) __node_freedata(n, n->value.dictval.entries);
+            if (n->flags & NODE_F_DICT_TRIE) DictTrie_Drop(n);
             break;
         case N_STRING:
-            __node_FreeString(n);
+            __node_freedata(n, (char *)n->value.strval.data);
+            break;
+        case N_NUMBER:
+            if (n->flags & NODE_F_NUMBER_TEXT) __node_freedata(n, (char *)n->value.strval.data);
             break;
         case N_KEYVAL:
-            __node_FreeKV(n);
+            __node_releasekey(n);
             break;
         default:
-            free(n);
+            break;
+    }
+    __node_freenode(n);
+}
+
+/* Releases a holder of a shared node. Returns 0 if the node isn't shared, i.e. it's to be freed */
+static inline int __node_release(Node *n) {
+    if (!n->refs) return 0;
+    n->refs--;
+    return 1;
+}
+
+/* Adds a holder to a node, returns 0 if it has as many as it can count */
+static inline int __node_hold(Node *n) {
+    if (UINT16_MAX == n->refs) return 0;
+    n->refs++;
+    return 1;
+}
+
+void Node_Free(Node *n) {
+    // ignore NULL and static nodes, and nodes that other containers still hold
+    if (!n || (n->flags & NODE_F_STATIC) || __node_release(n)) return;
+    if (!__node_nowned(n)) {
+        __node_freeself(n);
+        return;
+    }
+
+    // containers are freed after their children
+    NodeStack s;
+    __stack_init(&s);
+    __stack_push(&s, n);
+    while (s.len) {
+        NodeStackFrame *f = __stack_top(&s);
+        if (f->index == __node_nowned(f->node)) {
+            __node_freeself(f->node);
+            s.len--;
+            continue;
+        }
+        Node *c = __node_child(f->node, f->index++);
+        if (!c || (c->flags & NODE_F_STATIC) || __node_release(c)) continue;
+        if (__node_nowned(c)) {
+            __stack_push(&s, c);
+        } else {
+            __node_freeself(c);
+        }
+    }
+    __stack_free(&s);
+}
+
+size_t Node_Count(const Node *n, size_t limit) {
+    size_t count = 1;
+    NodeStack s;
+
+    if (!__node_nchildren(n)) return count;
+    __stack_init(&s);
+    __stack_push(&s, n);
+    while (s.len && (!limit || count < limit)) {
+        NodeStackFrame *f = __stack_top(&s);
+        if (N_ARRAY == f->node->type && (f->node->flags & NODE_F_PACKED)) {
+            // the items of a packed array aren't nodes, nor containers
+            count += f->node->value.arrval.len;
+            s.len--;
+            continue;
+        }
+        if (f->index == __node_nchildren(f->node)) {
+            s.len--;
+            continue;
+        }
+        const Node *c = __node_child(f->node, f->index++);
+        count++;
+        if (__node_nchildren(c)) __stack_push(&s, c);
     }
+    __stack_free(&s);
+    return limit ? MIN(count, limit) : count;
 }
 
 int Node_Length(const Node *n) {
@@ -143,38 +604,121 @@ int Node_Length(const Node *n) {
     return -1;
 }
 
+const char *Node_StringData(const Node *n, char **tmp) {
+    const t_string *s = &n->value.strval;
+    uint32_t clen;
+
+    *tmp = NULL;
+    if (!(n->flags & NODE_F_COMPRESSED)) return s->data;
+    memcpy(&clen, s->data, sizeof(uint32_t));
+    *tmp = malloc(s->len + 1);
+    Decompress(s->data + sizeof(uint32_t), clen, *tmp, s->len);  // it's what Compress made
+    (*tmp)[s->len] = '\0';
+    return *tmp;
+}
+
+size_t Node_StringMemory(const Node *n) {
+    uint32_t clen;
+
+    if (n->flags & NODE_F_STRING_ROOM) return n->value.strval.cap - 1;
+    if (!(n->flags & NODE_F_COMPRESSED)) return n->value.strval.len;
+    memcpy(&clen, n->value.strval.data, sizeof(uint32_t));
+    return sizeof(uint32_t) + clen;
+}
+
+/* Checks whether two string nodes are equal */
+static int __node_streq(const Node *a, const Node *b) {
+    char *ta, *tb;
+    if (a->value.strval.len != b->value.strval.len) return 0;
+    int eq = !memcmp(Node_StringData(a, &ta), Node_StringData(b, &tb), a->value.strval.len);
+    free(ta);
+    free(tb);
+    return eq;
+}
+
 int Node_StringAppend(Node *dst, Node *src) {
     t_string *d = &dst->value.strval;
-    t_string *s = &src->value.strval;
+    char *tmp;
+
+    // the compressed data is replaced by a decompressed copy on the heap
+    if (dst->flags & NODE_F_COMPRESSED) {
+        Node_StringData(dst, &tmp);
+        __node_freedata(dst, (char *)d->data);
+        dst->flags &= ~(NODE_F_COMPRESSED | NODE_F_ARENA_DATA);
+        d->data = tmp;
+    }
 
-    char *newval = calloc(d->len + s->len, sizeof(char));
-    strncpy(newval, d->data, d->len);
-    strncpy(&newval[d->len], s->data, s->len);
+    uint32_t len = src->value.strval.len;
+    const char *data = Node_StringData(src, &tmp);
+    size_t size = (size_t)d->len + len + 1;
+    char *newval = (char *)d->data;
+    if (!(dst->flags & NODE_F_STRING_ROOM) || d->cap < size) {
+        size_t cap = size < OBJECT_STRING_GROWTH_CHUNK ? 2 * size
+                                                       : size + OBJECT_STRING_GROWTH_CHUNK;
+        if (cap > UINT32_MAX) cap = size;
+        newval = __node_realloc(dst, newval, d->len + 1, cap);
+        dst->flags |= NODE_F_STRING_ROOM;
+        d->cap = cap;
+    }
+    memcpy(&newval[d->len], data, len);
+    newval[d->len + len] = '\0';
+    free(tmp);
 
-    free((char *)d->data);
     d->data = newval;
-    d->len += s->len;
+    d->len += len;
 
     return OBJ_OK;
 }
 
+/* Shrinks the heap allocated entries of an array that's mostly free slots, see OBJECT_SHRINK_MIN_CAP.
+ * The gap goes too, since the items are moved anyway. */
+static void __arr_shrink(Node *arr) {
+    t_array *a = &arr->value.arrval;
+    uint32_t gap = __arr_gap(arr), slots = gap + a->cap;
+
+    if ((arr->flags & (NODE_F_ARENA_DATA | NODE_F_INLINE_DATA)) || slots < OBJECT_SHRINK_MIN_CAP ||
+        a->len >= slots / 4)
+        return;
+    uint32_t newcap = MAX(a->len * 2, OBJECT_SHRINK_MIN_CAP / 4);
+    Node **orig = a->entries - gap;
+    if (gap) memmove(orig, a->entries, a->len * sizeof(Node *));
+    a->entries = realloc(orig, newcap * sizeof(Node *));
+    a->cap = newcap;
+    __arr_setgap(arr, 0);
+}
+
 int Node_ArrayDelRange(Node *arr, const int index, const int count) {
     t_array *a = &arr->value.arrval;
 
     if (count <= 0 || !a->len) return OBJ_OK;
+    if (arr->flags & NODE_F_ARRAY_INDEXED) ArrayIndex_Invalidate(arr);
 
     int start = index < 0 ? MAX(a->len + index, 0) : MIN(index, a->len - 1);
     int stop = MIN(start + count, a->len);  // stop is exclusive
 
     // free range
-    for (int i = start; i < stop; i++) Node_Free(a->entries[i]);
-
-    // move whatever remains on the left side
-    if (stop < a->len)
+    for (int i = start; !(arr->flags & NODE_F_PACKED) && i < stop; i++) Node_Free(a->entries[i]);
+
+    uint32_t gap = __arr_gap(arr), n = stop - start;
+    if (n == a->len) {
+        // an emptied array gets its gap back
+        a->entries -= gap;
+        a->cap += gap;
+        __arr_setgap(arr, 0);
+    } else if (start < a->len - stop) {
+        // move whatever remains on the right side, leaving a gap at the head
+        if (start) memmove(&a->entries[n], a->entries, start * sizeof(Node *));
+        a->entries += n;
+        a->cap -= n;
+        __arr_setgap(arr, gap + n);
+    } else if (stop < a->len) {
+        // move whatever remains on the left side
         memmove(&a->entries[start], &a->entries[stop], (a->len - stop) * sizeof(Node *));
+    }
 
     // adjust length
-    a->len -= stop - start;
+    a->len -= n;
+    __arr_shrink(arr);
 
     return OBJ_OK;
 }
@@ -187,6 +731,16 @@ void __node_ArrayMakeRoomFor(Node *arr, uint32_t addlen) {
     // Nothing to do if enough capacity is already available
     if (a->cap >= newcap) return;
 
+    // a gap that's as big as the items, e.g. of a queue, is taken back by moving them to the head
+    uint32_t gap = __arr_gap(arr);
+    if (gap && gap >= a->len && a->cap + gap >= newcap) {
+        memmove(a->entries - gap, a->entries, a->len * sizeof(Node *));
+        a->entries -= gap;
+        a->cap += gap;
+        __arr_setgap(arr, 0);
+        return;
+    }
+
     /* Find a reasonable next capacity.
     * For small numbers we grow to the next power of 2:
     * http://graphics.stanford.edu/~seander/bithacks.html#RoundUpPowerOf2
@@ -200,45 +754,180 @@ void __node_ArrayMakeRoomFor(Node *arr, uint32_t addlen) {
     nextcap |= nextcap >> 16;
     nextcap++;
 
-    // For larger capacities, e.g. 1MB, we chunk it.
-    const uint32_t CHUNK_SIZE = 1 << 20;
-    if (nextcap > CHUNK_SIZE) {
-        nextcap = ((newcap / CHUNK_SIZE) + 1) * CHUNK_SIZE;
+    // For larger capacities, e.g. 1M entries, we chunk it.
+    uint32_t chunk = NodeArrayGrowthChunk;
+    if (chunk && nextcap > chunk) {
+        nextcap = ((newcap / chunk) + 1) * chunk;
     }
 
+    a->entries = (Node **)__node_realloc(arr, a->entries - gap, (gap + a->cap) * sizeof(Node *),
+                                         (gap + nextcap) * sizeof(Node *)) +
+                 gap;
     a->cap = nextcap;
-    a->entries = realloc(a->entries, a->cap * sizeof(Node *));
+}
+
+/* Makes a gap of at least addlen free slots before the entries of an array. A new gap is a quarter
+ * of the items, so that moving them is amortized over the insertions that fill it. */
+static void __arr_makeheadroom(Node *arr, uint32_t addlen) {
+    t_array *a = &arr->value.arrval;
+    uint32_t gap = __arr_gap(arr);
+
+    if (gap >= addlen) return;
+    uint32_t newgap = MAX(addlen, MAX(a->len / 4, 4));
+    int oldflags = arr->flags;
+    Node **orig = a->entries - gap;
+    Node **buf = __node_realloc(arr, NULL, 0, (newgap + a->cap) * sizeof(Node *));
+    memcpy(buf + newgap, a->entries, a->len * sizeof(Node *));
+    if (!(oldflags & (NODE_F_ARENA_DATA | NODE_F_INLINE_DATA))) free(orig);
+    a->entries = buf + newgap;
+    __arr_setgap(arr, newgap);
+}
+
+/* The packed entries of an array */
+#define __arr_ints(a) ((int64_t *)(a)->entries)
+#define __arr_nums(a) ((double *)(a)->entries)
+
+/* Returns the packed flag that fits a node, or 0 if it can only be in a generic array. */
+static inline int __arr_packflag(const Node *n) {
+    if (!n) return 0;
+    if (N_INTEGER == n->type) return NODE_F_PACKED_INT;
+    if (N_NUMBER == n->type) return NODE_F_PACKED_NUM;
+    return 0;
+}
+
+/* Converts a packed array to the generic form in place, entries and nodes are the same size. */
+static void __arr_unpack(Node *arr) {
+    t_array *a = &arr->value.arrval;
+    int flag = arr->flags & NODE_F_PACKED;
+
+    if (!flag) return;
+    for (uint32_t i = 0; i < a->len; i++) {
+        a->entries[i] = NODE_F_PACKED_INT == flag ? NewIntNode(__arr_ints(a)[i])
+                                                  : NewDoubleNode(__arr_nums(a)[i]);
+    }
+    arr->flags &= ~NODE_F_PACKED;
+}
+
+/* Checks whether the packed array (or an empty one) can take all the nodes of the generic one. */
+static int __arr_canpack(const Node *arr, const Node *sub) {
+    const t_array *s = &sub->value.arrval;
+    int flag = arr->flags & NODE_F_PACKED;
+
+    if (!flag && arr->value.arrval.len) return 0;
+    if (sub->flags & NODE_F_PACKED) return !flag || flag == (sub->flags & NODE_F_PACKED);
+    if (!s->len) return 1;
+    if (!flag) flag = __arr_packflag(s->entries[0]);
+    for (uint32_t i = 0; flag && i < s->len; i++) {
+        if (__arr_packflag(s->entries[i]) != flag) return 0;
+    }
+    return flag ? 1 : 0;
+}
+
+/* Stores the value of a packable node in the packed array's entry, and frees the node. */
+static inline void __arr_packset(Node *arr, uint32_t i, Node *n) {
+    t_array *a = &arr->value.arrval;
+    if (N_INTEGER == n->type) __arr_ints(a)[i] = n->value.intval;
+    else __arr_nums(a)[i] = Node_Number(n);
+    Node_Free(n);
 }
 
 int Node_ArrayInsert(Node *arr, int index, Node *sub) {
     t_array *a = &arr->value.arrval;
     t_array *s = &sub->value.arrval;
+    int packed = __arr_canpack(arr, sub);
+    int indexed = 0;
+
+    // otherwise both arrays are made generic
+    if (packed && !a->len && !(sub->flags & NODE_F_PACKED) && s->len) {
+        arr->flags |= __arr_packflag(s->entries[0]);
+    } else if (packed && !a->len) {
+        arr->flags |= sub->flags & NODE_F_PACKED;
+    } else if (!packed) {
+        __arr_unpack(arr);
+        __arr_unpack(sub);
+    }
 
     if (index < 0) index = (int)a->len + index;     // translate negative index value
     if (index < 0) index = 0;                       // not in range always start at the beginning
     if (index > (int)a->len) index = (int)a->len;   // or appended at the end
+    if (arr->flags & NODE_F_ARRAY_INDEXED) {
+        // items that are appended are indexed when they're in
+        if (index < (int)a->len) ArrayIndex_Invalidate(arr);
+        indexed = index == (int)a->len;
+    }
 
-    __node_ArrayMakeRoomFor(arr, s->len);
-    if (index < (int) a->len) {                     //  shift contents to the right
-        memmove(&a->entries[index + s->len], &a->entries[index], (a->len - index) * sizeof(Node *));
+    // inserting at the head makes a gap before the entries, that the items that are inserted closer
+    // to the head than to the tail go into
+    if (s->len && a->len && (!index || (__arr_gap(arr) >= s->len && index < (int)a->len / 2))) {
+        __arr_makeheadroom(arr, s->len);
+        uint32_t gap = __arr_gap(arr);
+        memmove(a->entries - s->len, a->entries, index * sizeof(Node *));
+        a->entries -= s->len;
+        a->cap += s->len;
+        __arr_setgap(arr, gap - s->len);
+    } else {
+        __node_ArrayMakeRoomFor(arr, s->len);
+        if (index < (int)a->len) {  //  shift contents to the right
+            memmove(&a->entries[index + s->len], &a->entries[index],
+                    (a->len - index) * sizeof(Node *));
+        }
     }
 
-    // copy the references
-    memcpy(&a->entries[index], s->entries, s->len * sizeof(Node *));
+    // copy the references, or the values
+    if (packed && !(sub->flags & NODE_F_PACKED)) {
+        for (uint32_t i = 0; i < s->len; i++) __arr_packset(arr, index + i, s->entries[i]);
+    } else {
+        memcpy(&a->entries[index], s->entries, s->len * sizeof(Node *));
+    }
     a->len += s->len;
 
     // destroy all traces
     s->len = 0;
     Node_Free(sub);
 
+    if (indexed) ArrayIndex_Appended(arr);
     return OBJ_OK;
 }
 
 int Node_ArrayAppend(Node *arr, Node *n) {
     t_array *a = &arr->value.arrval;
+    int flag = __arr_packflag(n);
+
+    // an empty array is packed by its first value, other types make it generic
+    if (!a->len) arr->flags = (arr->flags & ~NODE_F_PACKED) | flag;
+    if (flag != (arr->flags & NODE_F_PACKED)) __arr_unpack(arr);
+
+    __node_ArrayMakeRoomFor(arr, 1);
+    if (arr->flags & NODE_F_PACKED) __arr_packset(arr, a->len++, n);
+    else a->entries[a->len++] = n;
+
+    if (arr->flags & NODE_F_ARRAY_INDEXED) ArrayIndex_Appended(arr);
+    return OBJ_OK;
+}
+
+int Node_ArrayAppendInt(Node *arr, int64_t val) {
+    t_array *a = &arr->value.arrval;
+    if (a->len && NODE_F_PACKED_INT != (arr->flags & NODE_F_PACKED)) {
+        return Node_ArrayAppend(arr, NewIntNode(val));
+    }
+
+    arr->flags = (arr->flags & ~NODE_F_PACKED) | NODE_F_PACKED_INT;
     __node_ArrayMakeRoomFor(arr, 1);
-    a->entries[a->len++] = n;
+    __arr_ints(a)[a->len++] = val;
+    if (arr->flags & NODE_F_ARRAY_INDEXED) ArrayIndex_Appended(arr);
+    return OBJ_OK;
+}
 
+int Node_ArrayAppendDouble(Node *arr, double val) {
+    t_array *a = &arr->value.arrval;
+    if (a->len && NODE_F_PACKED_NUM != (arr->flags & NODE_F_PACKED)) {
+        return Node_ArrayAppend(arr, NewDoubleNode(val));
+    }
+
+    arr->flags = (arr->flags & ~NODE_F_PACKED) | NODE_F_PACKED_NUM;
+    __node_ArrayMakeRoomFor(arr, 1);
+    __arr_nums(a)[a->len++] = val;
+    if (arr->flags & NODE_F_ARRAY_INDEXED) ArrayIndex_Appended(arr);
     return OBJ_OK;
 }
 
@@ -255,7 +944,9 @@ int Node_ArraySet(Node *arr, int index, Node *n) {
     if (index < 0 || index >= a->len) {
         return OBJ_ERR;
     }
+    __arr_unpack(arr);
     a->entries[index] = n;
+    if (arr->flags & NODE_F_ARRAY_INDEXED) ArrayIndex_Invalidate(arr);
 
     return OBJ_OK;
 }
@@ -268,109 +959,397 @@ int Node_ArrayItem(Node *arr, int index, Node **n) {
         *n = NULL;
         return OBJ_ERR;
     }
+    // the caller gets a node that is owned by the array
+    __arr_unpack(arr);
     *n = a->entries[index];
     return OBJ_OK;
 }
 
-int Node_ArrayIndex(Node *arr, Node *n, int start, int stop) {
+int Node_ArrayReplace(Node *arr, int index, Node *n) {
+    Node *old;
+    if (OBJ_OK != Node_ArrayItem(arr, index, &old)) return OBJ_ERR;
+    Node_ArraySet(arr, index, n);
+    Node_Free(old);
+    return OBJ_OK;
+}
+
+int Node_ArrayItemView(Node *arr, int index, Node *tmp, Node **n) {
     t_array *a = &arr->value.arrval;
 
-    // Break early for empty arrays or non scalar nodes
-    if (!a->len || !NODE_IS_SCALAR(n)) {
-        return -1;
+    if (!(arr->flags & NODE_F_PACKED)) return Node_ArrayItem(arr, index, n);
+    if (index < 0 || index >= a->len) {
+        *n = NULL;
+        return OBJ_ERR;
+    }
+
+    // the copy is flagged as shared so it is never freed or counted
+    tmp->flags = NODE_F_STATIC;
+    tmp->refs = 0;
+    if (arr->flags & NODE_F_PACKED_INT) {
+        tmp->type = N_INTEGER;
+        tmp->value.intval = __arr_ints(a)[index];
+    } else {
+        tmp->type = N_NUMBER;
+        tmp->value.numval = __arr_nums(a)[index];
     }
+    *n = tmp;
+    return OBJ_OK;
+}
 
+/* Normalizes the search range of Node_ArrayIndex and Node_ArrayCount to [start, stop) */
+static void __arr_range(const t_array *a, int *start, int *stop) {
     // convert negative indices
-    if (start < 0) start = a->len + start;
-    if (stop < 0) stop = a->len + stop;
+    if (*start < 0) *start = a->len + *start;
+    if (*stop < 0) *stop = a->len + *stop;
 
     // check and adjust for out of range indices
-    if (start < 0) start = 0;                               // start at the beginning
-    if (start >= (int) a->len) start = MAX(0, a->len - 1);  // but don't overdo it
-    if (stop >= (int) a->len) stop = 0;                     // get including the end
-    if (stop == 0) stop = a->len;                           // stop after the end
-    if (stop < start) stop = start;                         // don't search at all
+    if (*start < 0) *start = 0;                                // start at the beginning
+    if (*start >= (int)a->len) *start = MAX(0, a->len - 1);   // but don't overdo it
+    if (*stop >= (int)a->len) *stop = 0;                       // get including the end
+    if (*stop == 0) *stop = a->len;                            // stop after the end
+    if (*stop < *start) *stop = *start;                        // don't search at all
+}
 
-    // search for the value
-    for (int i = start; i < stop; i++) {
-        if (!n && !a->entries[i]) return i;             // both are nulls
-        if (!n || !a->entries[i]) continue;             // just one null
-        if (a->entries[i]->type != n->type) continue;   // types not the same
+/**
+* Checks whether an item of a generic array equals the scalar n. A string's length is compared
+* first and its data is compared directly unless the item is compressed, data is n's uncompressed
+* data.
+*/
+static inline int __arr_itemeq(const Node *e, const Node *n, const char *data) {
+    if (!n || !e) return !n && !e;
+    if (e->type != n->type) return 0;
 
-        // Check equality per scalar type
-        switch (n->type) {
-            case N_STRING:
-                if ((n->value.strval.len == a->entries[i]->value.strval.len) &&
-                    !strncmp(n->value.strval.data, a->entries[i]->value.strval.data,
-                             n->value.strval.len)) {
-                    return i;
-                }
-                break;
-            case N_NUMBER:
-                if (n->value.numval == a->entries[i]->value.numval) return i;
-                break;
-            case N_INTEGER:
-                if (n->value.intval == a->entries[i]->value.intval) return i;
-                break;
-            case N_BOOLEAN:
-                if (n->value.boolval == a->entries[i]->value.boolval) return i;
-                break;
-            default:
-                break;
-        }  // switch (n->type)
-    }      // for
-    
-    return -1;  // unfound
+    switch (n->type) {
+        case N_STRING:
+            if (e->value.strval.len != n->value.strval.len) return 0;
+            if (!(e->flags & NODE_F_COMPRESSED))
+                return !memcmp(e->value.strval.data, data, n->value.strval.len);
+            return __node_streq(e, n);
+        case N_NUMBER:
+            return Node_Number(e) == Node_Number(n);
+        case N_INTEGER:
+            return e->value.intval == n->value.intval;
+        case N_BOOLEAN:
+            return e->value.boolval == n->value.boolval;
+        default:
+            return 0;
+    }
 }
 
-Node *__obj_find(t_dict *o, const char *key, int *idx) {
-    for (int i = 0; i < o->len; i++) {
-        if (!strcmp(key, o->entries[i]->value.kvval.key)) {
-            if (idx) *idx = i;
+int Node_ArrayIndex(Node *arr, Node *n, int start, int stop) {
+    t_array *a = &arr->value.arrval;
 
-            return o->entries[i];
+    // Break early for empty arrays or non scalar nodes
+    if (!a->len || !NODE_IS_SCALAR(n)) {
+        return -1;
+    }
+    __arr_range(a, &start, &stop);
+    if (arr->flags & NODE_F_ARRAY_INDEXED) return ArrayIndex_Search(arr, n, start, stop, 0);
+
+    // packed arrays are searched by value, and only hold values of a single type
+    if (arr->flags & NODE_F_PACKED) {
+        if (__arr_packflag(n) != (arr->flags & NODE_F_PACKED)) return -1;
+        uint32_t len = stop - start, i;
+        if (N_INTEGER == n->type) {
+            i = ObjectSearch_FindInt(__arr_ints(a) + start, len, n->value.intval);
+        } else {
+            i = ObjectSearch_FindDouble(__arr_nums(a) + start, len, Node_Number(n));
         }
+        return i < len ? start + (int)i : -1;
     }
 
-    return NULL;
-}
+    // search for the value, a string needle is decompressed once
+    char *tmp = NULL;
+    const char *data = n && N_STRING == n->type ? Node_StringData(n, &tmp) : NULL;
+    int found = -1;
+    for (int i = start; i < stop; i++) {
+        if (__arr_itemeq(a->entries[i], n, data)) {
+            found = i;
+            break;
+        }
+    }
+    free(tmp);
 
-#define __obj_insert(o, n)                                             \
-    if (o->len >= o->cap) {                                            \
-        o->cap += o->cap ? MIN(o->cap, 1024 * 1024) : 1;               \
-        o->entries = realloc(o->entries, o->cap * sizeof(t_keyval *)); \
-    }                                                                  \
-    o->entries[o->len++] = n;
+    return found;
+}
 
-int Node_DictSet(Node *obj, const char *key, Node *n) {
-    t_dict *o = &obj->value.dictval;
+int Node_ArrayCount(Node *arr, Node *n, int start, int stop) {
+    t_array *a = &arr->value.arrval;
 
-    if (key == NULL) return OBJ_ERR;
+    if (!a->len || !NODE_IS_SCALAR(n)) {
+        return 0;
+    }
+    __arr_range(a, &start, &stop);
+    if (arr->flags & NODE_F_ARRAY_INDEXED) return ArrayIndex_Search(arr, n, start, stop, 1);
 
-    int idx;
-    Node *kv = __obj_find(o, key, &idx);
-    // first find a replacement possiblity
-    if (kv) {
-        if (kv->value.kvval.val) {
-            Node_Free(kv->value.kvval.val);
+    if (arr->flags & NODE_F_PACKED) {
+        if (__arr_packflag(n) != (arr->flags & NODE_F_PACKED)) return 0;
+        if (N_INTEGER == n->type) {
+            return ObjectSearch_CountInt(__arr_ints(a) + start, stop - start, n->value.intval);
         }
-        kv->value.kvval.val = n;
-        return OBJ_OK;
+        return ObjectSearch_CountDouble(__arr_nums(a) + start, stop - start, Node_Number(n));
     }
 
-    // append another entry
-    __obj_insert(o, NewKeyValNode(key, strlen(key), n));
+    char *tmp = NULL;
+    const char *data = n && N_STRING == n->type ? Node_StringData(n, &tmp) : NULL;
+    int count = 0;
+    for (int i = start; i < stop; i++) {
+        count += __arr_itemeq(a->entries[i], n, data);
+    }
+    free(tmp);
 
-    return OBJ_OK;
+    return count;
 }
 
-int Node_DictSetKeyVal(Node *obj, Node *kv) {
-    t_dict *o = &obj->value.dictval;
-
-    if (kv->value.kvval.key == NULL) return OBJ_ERR;
+/* The rank of a value's type in the order of Node_Compare, integers and doubles alike */
+static inline int __node_rank(const Node *n) {
+    if (!n) return 0;
+    switch (n->type) {
+        case N_BOOLEAN:
+            return 1;
+        case N_INTEGER:
+        case N_NUMBER:
+            return 2;
+        case N_STRING:
+            return 3;
+        case N_ARRAY:
+            return 4;
+        default:
+            return 5;
+    }
+}
+
+#define __cmp(a, b) (((a) > (b)) - ((a) < (b)))
+
+int Node_Compare(const Node *a, const Node *b) {
+    int rank = __node_rank(a);
+    if (rank != __node_rank(b)) return __cmp(rank, __node_rank(b));
+
+    switch (rank) {
+        case 0:
+            return 0;
+        case 1:
+            return __cmp(!!a->value.boolval, !!b->value.boolval);
+        case 2:
+            if (N_INTEGER == a->type && N_INTEGER == b->type)
+                return __cmp(a->value.intval, b->value.intval);
+            return __cmp(N_INTEGER == a->type ? (double)a->value.intval : Node_Number(a),
+                         N_INTEGER == b->type ? (double)b->value.intval : Node_Number(b));
+        case 3: {
+            char *tmpa, *tmpb;
+            const char *da = Node_StringData(a, &tmpa), *db = Node_StringData(b, &tmpb);
+            uint32_t la = a->value.strval.len, lb = b->value.strval.len;
+            int c = memcmp(da, db, MIN(la, lb));
+            free(tmpa);
+            free(tmpb);
+            return c ? __cmp(c, 0) : __cmp(la, lb);
+        }
+        case 4: {
+            // item by item, where a packed array's items are viewed without unpacking it
+            uint32_t la = a->value.arrval.len, lb = b->value.arrval.len;
+            for (uint32_t i = 0; i < MIN(la, lb); i++) {
+                Node tmpa, tmpb, *ia, *ib;
+                Node_ArrayItemView((Node *)a, i, &tmpa, &ia);
+                Node_ArrayItemView((Node *)b, i, &tmpb, &ib);
+                int c = Node_Compare(ia, ib);
+                if (c) return c;
+            }
+            return __cmp(la, lb);
+        }
+        default: {
+            // member by member in their order, the key before the value
+            uint32_t la = a->value.dictval.len, lb = b->value.dictval.len;
+            for (uint32_t i = 0; i < MIN(la, lb); i++) {
+                const t_keyval *ka = &a->value.dictval.entries[i]->value.kvval;
+                const t_keyval *kb = &b->value.dictval.entries[i]->value.kvval;
+                int c = strcmp(ka->key, kb->key);
+                if (c) return __cmp(c, 0);
+                if ((c = Node_Compare(ka->val, kb->val))) return c;
+            }
+            return __cmp(la, lb);
+        }
+    }
+}
+
+int Node_ArrayBisect(Node *arr, const Node *n, int right) {
+    t_array *a = &arr->value.arrval;
+    int packed = n ? __arr_packflag(n) & arr->flags : 0;
+    uint32_t lo = 0, hi = a->len;
+
+    // a packed array's values are compared directly with a needle of their type
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int c;
+        if (NODE_F_PACKED_INT == packed) {
+            c = __cmp(__arr_ints(a)[mid], n->value.intval);
+        } else if (NODE_F_PACKED_NUM == packed) {
+            c = __cmp(__arr_nums(a)[mid], Node_Number(n));
+        } else {
+            Node tmp, *item;
+            Node_ArrayItemView(arr, mid, &tmp, &item);
+            c = Node_Compare(item, n);
+        }
+        if (c < 0 || (right && !c)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (int)lo;
+}
+
+int Node_ArraySetIndexed(Node *arr, int indexed) {
+    if (!arr || N_ARRAY != arr->type) return OBJ_ERR;
+    if (!indexed) {
+        if (arr->flags & NODE_F_ARRAY_INDEXED) ArrayIndex_Drop(arr);
+        arr->flags &= ~NODE_F_ARRAY_INDEXED;
+        return OBJ_OK;
+    }
+    if (arr->flags & NODE_F_ARRAY_INDEXED) return OBJ_OK;
+
+    // the nodes of an arena aren't necessarily freed one by one
+    if (arr->flags & NODE_F_ARENA) {
+        if (!_arena) return OBJ_ERR;
+        __arena_addindexed(_arena, arr);
+    }
+    ArrayIndex_Create(arr);
+    arr->flags |= NODE_F_ARRAY_INDEXED;
+    return OBJ_OK;
+}
+
+void Node_ArrayChanged(Node *arr) {
+    if (arr && N_ARRAY == arr->type && (arr->flags & NODE_F_ARRAY_INDEXED))
+        ArrayIndex_Invalidate(arr);
+}
+
+size_t Node_ArrayIndexSize(const Node *arr) {
+    return arr->flags & NODE_F_ARRAY_INDEXED ? ArrayIndex_Size(arr) : 0;
+}
+
+/* Adds the entry at position i to the index. */
+static inline void __obj_indexadd(t_dict *o, uint32_t i) {
+    uint32_t *index = __obj_index(o);
+    uint32_t mask = __obj_indexcap(o->cap) - 1;
+    uint32_t s = Intern_Hash(__obj_key(o, i)) & mask;
+    while (index[s]) s = (s + 1) & mask;
+    index[s] = i + 1;
+}
+
+/* Rebuilds the index from the entries, called whenever the dictionary is reallocated. */
+static void __obj_reindex(t_dict *o) {
+    memset(__obj_index(o), 0, __obj_indexcap(o->cap) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < o->len; i++) __obj_indexadd(o, i);
+}
+
+/* Returns the index slot that holds the interned `key`, or that of the entry at position `pos` if key
+ * is NULL. */
+static inline uint32_t __obj_indexslot(t_dict *o, const char *key, uint32_t pos) {
+    uint32_t *index = __obj_index(o);
+    uint32_t mask = __obj_indexcap(o->cap) - 1;
+    uint32_t s = Intern_Hash(key ? key : __obj_key(o, pos)) & mask;
+    while (index[s]) {
+        if (key ? key == __obj_key(o, index[s] - 1) : index[s] == pos + 1) return s;
+        s = (s + 1) & mask;
+    }
+    return s;  // an empty slot
+}
+
+/* Removes a slot from the index with backward shifting (linear probing has no tombstones). */
+static void __obj_indexdel(t_dict *o, uint32_t s) {
+    uint32_t *index = __obj_index(o);
+    uint32_t mask = __obj_indexcap(o->cap) - 1;
+    uint32_t j = s;
+    index[s] = 0;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!index[j]) return;
+        uint32_t k = Intern_Hash(__obj_key(o, index[j] - 1)) & mask;  // the entry's home slot
+        // move the entry to the hole unless its home lies cyclically in (s, j]
+        if ((s <= j) ? (s < k && k <= j) : (s < k || k <= j)) continue;
+        index[s] = index[j];
+        index[j] = 0;
+        s = j;
+    }
+}
+
+/* Finds a dictionary's keyval node by key, `interned` tells whether the key is already interned. */
+static Node *__obj_find(Node *obj, const char *key, int interned, int *idx) {
+    t_dict *o = &obj->value.dictval;
+
+    // all keys are interned, so a key that isn't can't be in any dictionary
+    if (!interned && !(key = Intern_Find(key, strlen(key)))) return NULL;
+
+    if (obj->flags & NODE_F_DICT_INDEXED) {
+        uint32_t s = __obj_indexslot(o, key, 0);
+        uint32_t pos = __obj_index(o)[s];
+        if (!pos) return NULL;
+        if (idx) *idx = pos - 1;
+        return o->entries[pos - 1];
+    }
+
+    for (int i = 0; i < o->len; i++) {
+        if (key == o->entries[i]->value.kvval.key) {
+            if (idx) *idx = i;
+
+            return o->entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Appends a keyval node to the dictionary, growing it and switching to a hash index when needed. */
+static void __obj_insert(Node *obj, Node *n) {
+    t_dict *o = &obj->value.dictval;
+    int indexed = obj->flags & NODE_F_DICT_INDEXED;
+    int resize = 0;
+    size_t oldsize = __obj_blocksize(o->cap, indexed);
+
+    if (!indexed && NodeDictHashThreshold && o->len + 1 >= NodeDictHashThreshold) {
+        indexed = resize = 1;
+        obj->flags |= NODE_F_DICT_INDEXED;
+    }
+    if (o->len >= o->cap) {
+        o->cap += o->cap ? MIN(o->cap, 1024 * 1024) : 1;
+        resize = 1;
+    }
+    // the index's position and size depend on the capacity, so it is rebuilt after resizing
+    if (resize) o->entries = __node_realloc(obj, o->entries, oldsize, __obj_blocksize(o->cap, indexed));
+
+    o->entries[o->len++] = n;
+    if (obj->flags & NODE_F_DICT_TRIE) DictTrie_Added(obj);
+    if (!indexed) return;
+    if (resize) __obj_reindex(o);
+    else __obj_indexadd(o, o->len - 1);
+}
+
+int Node_DictSet(Node *obj, const char *key, Node *n) {
+    if (key == NULL) return OBJ_ERR;
+
+    int idx;
+    Node *kv = __obj_find(obj, key, 0, &idx);
+    // first find a replacement possiblity
+    if (kv) {
+        if (kv->value.kvval.val) {
+            Node_Free(kv->value.kvval.val);
+        }
+        kv->value.kvval.val = n;
+        return OBJ_OK;
+    }
+
+    // append another entry
+    __obj_insert(obj, NewKeyValNode(key, strlen(key), n));
+
+    return OBJ_OK;
+}
+
+int Node_DictSetKeyVal(Node *obj, Node *kv) {
+    t_dict *o = &obj->value.dictval;
+
+    if (kv->value.kvval.key == NULL) return OBJ_ERR;
 
     int idx;
-    Node *_kv = __obj_find(o, kv->value.kvval.key, &idx);
+    Node *_kv = __obj_find(obj, kv->value.kvval.key, 1, &idx);
     // first find a replacement possiblity
     if (_kv) {
         o->entries[idx] = kv;
@@ -379,27 +1358,407 @@ int Node_DictSetKeyVal(Node *obj, Node *kv) {
     }
 
     // append another entry
-    __obj_insert(o, kv);
+    __obj_insert(obj, kv);
 
     return OBJ_OK;
 }
 
-int Node_DictDel(Node *obj, const char *key) {
+Node *NewDictNodeFromKeyVals(Node **kvs, uint32_t len) {
+    Node *ret = NewDictNode(len);
+    t_dict *o = &ret->value.dictval;
+    int indexed = ret->flags & NODE_F_DICT_INDEXED;
+    uint64_t seen = 0;  // a bit per key hash modulo 64, so most keys of small dictionaries skip search
+
+    for (uint32_t i = 0; i < len; i++) {
+        Node *kv = kvs[i];
+        const char *key = kv->value.kvval.key;
+        int dup = -1;
+
+        // a duplicate is found by the index, or by comparing the (interned) keys that came before
+        if (indexed) {
+            uint32_t s = __obj_indexslot(o, key, 0);
+            if (__obj_index(o)[s]) {
+                dup = __obj_index(o)[s] - 1;
+            } else {
+                o->entries[o->len++] = kv;
+                __obj_index(o)[s] = o->len;
+                continue;
+            }
+        } else {
+            uint64_t bit = 1ULL << (Intern_Hash(key) & 63);
+            for (uint32_t j = 0; (seen & bit) && j < o->len; j++) {
+                if (key == __obj_key(o, j)) {
+                    dup = j;
+                    break;
+                }
+            }
+            seen |= bit;
+        }
+
+        // the last value of a key wins, at the position of its first occurrence
+        if (dup >= 0) {
+            Node_Free(o->entries[dup]);
+            o->entries[dup] = kv;
+        } else {
+            o->entries[o->len++] = kv;
+        }
+    }
+
+    return ret;
+}
+
+/* Creates a keyval node of an interned key that another keyval references */
+static Node *__node_copykv(const char *key, Node *val) {
+    Node *ret = __newNode(N_KEYVAL);
+    ret->value.kvval.key = Intern_Retain(key);
+    if (_arena) {
+        __arena_addkey(_arena, key);
+        ret->flags |= NODE_F_ARENA_DATA;
+    }
+    ret->value.kvval.val = val;
+    return ret;
+}
+
+Node *Node_Clone(const Node *n) {
+    Node *ret;
+
+    if (!n || (n->flags & NODE_F_STATIC)) return (Node *)n;
+    switch (n->type) {
+        case N_STRING:
+            if (!(n->flags & NODE_F_COMPRESSED))
+                return NewStringNode(n->value.strval.data, n->value.strval.len);
+            // the compressed data is copied as it is
+            ret = __newNode(N_STRING);
+            size_t size = Node_StringMemory(n);
+            char *data = __node_alloc(ret, size);
+            memcpy(data, n->value.strval.data, size);
+            ret->value.strval = (t_string){data, n->value.strval.len};
+            ret->flags |= NODE_F_COMPRESSED;
+            return ret;
+        case N_INTEGER:
+            return NewIntNode(n->value.intval);
+        case N_NUMBER:
+            if (n->flags & NODE_F_NUMBER_TEXT)
+                return NewNumberTextNode(n->value.strval.data, n->value.strval.len);
+            return NewDoubleNode(n->value.numval);
+        case N_KEYVAL:
+            return __node_copykv(n->value.kvval.key, Node_Clone(n->value.kvval.val));
+        case N_ARRAY: {
+            const t_array *a = &n->value.arrval;
+            ret = NewArrayNode(a->len);
+            ret->flags |= n->flags & NODE_F_PACKED;
+            if (n->flags & NODE_F_PACKED) {
+                memcpy(ret->value.arrval.entries, a->entries, a->len * sizeof(Node *));
+            } else {
+                for (uint32_t i = 0; i < a->len; i++)
+                    ret->value.arrval.entries[i] = Node_Clone(a->entries[i]);
+            }
+            ret->value.arrval.len = a->len;
+            return ret;
+        }
+        case N_DICT: {
+            const t_dict *o = &n->value.dictval;
+            ret = NewDictNode(o->len);
+            t_dict *c = &ret->value.dictval;
+            for (uint32_t i = 0; i < o->len; i++) c->entries[i] = Node_Clone(o->entries[i]);
+            c->len = o->len;
+            if (ret->flags & NODE_F_DICT_INDEXED) __obj_reindex(c);
+            return ret;
+        }
+        default:  // booleans and nulls that aren't shared
+            ret = __newNode(n->type);
+            ret->value = n->value;
+            return ret;
+    }
+}
+
+/* The canonical nodes of a tree that Node_Dedup copies, a hash table whose size is a power of 2 */
+typedef struct {
+    uint64_t hash;
+    Node *node;
+} NodeDedupSlot;
+
+typedef struct {
+    NodeDedupSlot *slots;
+    size_t len, cap;
+    size_t shared;
+} NodeDedupTable;
+
+/* Hashes bytes into h with FNV-1a */
+static inline uint64_t __dedup_bytes(uint64_t h, const void *p, size_t len) {
+    const unsigned char *s = (const unsigned char *)p;
+    for (size_t i = 0; i < len; i++) h = (h ^ s[i]) * 1099511628211ULL;
+    return h;
+}
+
+static inline uint64_t __dedup_word(uint64_t h, uint64_t v) {
+    return __dedup_bytes(h, &v, sizeof(v));
+}
+
+/* The flags that make values of the same type differ in their representation */
+#define __DEDUP_FLAGS (NODE_F_COMPRESSED | NODE_F_NUMBER_TEXT | NODE_F_PACKED)
+
+/* The size of a string's data, or of a number's text, that's compared */
+static inline size_t __dedup_strsize(const Node *n) {
+    return n->flags & NODE_F_COMPRESSED ? Node_StringMemory(n) : n->value.strval.len;
+}
+
+/**
+* Hashes a value, whose children are the canonical items, i.e. the copies of its items, or values
+* of its keyvals. Children are hashed by their addresses, and keys too since they're interned.
+*/
+static uint64_t __dedup_hash(const Node *n, Node **items) {
+    uint64_t h = __dedup_word(14695981039346656037ULL, n->type | (n->flags & __DEDUP_FLAGS) << 8);
+    switch (n->type) {
+        case N_STRING:
+            h = __dedup_word(h, n->value.strval.len);
+            return __dedup_bytes(h, n->value.strval.data, __dedup_strsize(n));
+        case N_NUMBER:
+            if (n->flags & NODE_F_NUMBER_TEXT)
+                return __dedup_bytes(h, n->value.strval.data, n->value.strval.len);
+            return __dedup_bytes(h, &n->value.numval, sizeof(double));
+        case N_INTEGER:
+            return __dedup_word(h, n->value.intval);
+        case N_BOOLEAN:
+            return __dedup_word(h, n->value.boolval);
+        case N_ARRAY:
+            h = __dedup_word(h, n->value.arrval.len);
+            if (n->flags & NODE_F_PACKED)
+                return __dedup_bytes(h, n->value.arrval.entries,
+                                     n->value.arrval.len * sizeof(Node *));
+            for (uint32_t i = 0; i < n->value.arrval.len; i++)
+                h = __dedup_word(h, (uintptr_t)items[i]);
+            return h;
+        case N_DICT:
+            h = __dedup_word(h, n->value.dictval.len);
+            for (uint32_t i = 0; i < n->value.dictval.len; i++) {
+                h = __dedup_word(h, (uintptr_t)n->value.dictval.entries[i]->value.kvval.key);
+                h = __dedup_word(h, (uintptr_t)items[i]);
+            }
+            return h;
+        default:
+            return h;
+    }
+}
+
+/* Checks if a canonical node c is equal to a value n with the canonical children items */
+static int __dedup_equal(const Node *c, const Node *n, Node **items) {
+    if (c->type != n->type || (c->flags & __DEDUP_FLAGS) != (n->flags & __DEDUP_FLAGS)) return 0;
+    switch (n->type) {
+        case N_STRING:
+            return c->value.strval.len == n->value.strval.len &&
+                   !memcmp(c->value.strval.data, n->value.strval.data, __dedup_strsize(n));
+        case N_NUMBER:
+            if (n->flags & NODE_F_NUMBER_TEXT)
+                return c->value.strval.len == n->value.strval.len &&
+                       !memcmp(c->value.strval.data, n->value.strval.data, n->value.strval.len);
+            return !memcmp(&c->value.numval, &n->value.numval, sizeof(double));
+        case N_INTEGER:
+            return c->value.intval == n->value.intval;
+        case N_BOOLEAN:
+            return c->value.boolval == n->value.boolval;
+        case N_ARRAY:
+            if (c->value.arrval.len != n->value.arrval.len) return 0;
+            if (n->flags & NODE_F_PACKED)
+                return !memcmp(c->value.arrval.entries, n->value.arrval.entries,
+                               n->value.arrval.len * sizeof(Node *));
+            for (uint32_t i = 0; i < n->value.arrval.len; i++) {
+                if (c->value.arrval.entries[i] != items[i]) return 0;
+            }
+            return 1;
+        case N_DICT:
+            if (c->value.dictval.len != n->value.dictval.len) return 0;
+            for (uint32_t i = 0; i < n->value.dictval.len; i++) {
+                const t_keyval *a = &c->value.dictval.entries[i]->value.kvval;
+                const t_keyval *b = &n->value.dictval.entries[i]->value.kvval;
+                if (a->key != b->key || a->val != items[i]) return 0;
+            }
+            return 1;
+        default:
+            return 1;
+    }
+}
+
+/* Makes a canonical copy of a value whose children are the canonical items */
+static Node *__dedup_copy(const Node *n, Node **items) {
+    Node *ret;
+    if (N_DICT == n->type) {
+        uint32_t len = n->value.dictval.len;
+        ret = NewDictNode(len);
+        t_dict *c = &ret->value.dictval;
+        for (uint32_t i = 0; i < len; i++)
+            c->entries[i] = __node_copykv(n->value.dictval.entries[i]->value.kvval.key, items[i]);
+        c->len = len;
+        if (ret->flags & NODE_F_DICT_INDEXED) __obj_reindex(c);
+        return ret;
+    }
+    if (N_ARRAY != n->type || (n->flags & NODE_F_PACKED)) return Node_Clone(n);
+    uint32_t len = n->value.arrval.len;
+    ret = NewArrayNode(len);
+    if (len) memcpy(ret->value.arrval.entries, items, len * sizeof(Node *));
+    ret->value.arrval.len = len;
+    return ret;
+}
+
+/* Returns the slot of a canonical node that's equal to the value, or the empty slot for it */
+static size_t __dedup_slot(NodeDedupTable *t, const Node *n, Node **items, uint64_t h) {
+    if (2 * (t->len + 1) > t->cap) {
+        size_t cap = t->cap;
+        NodeDedupSlot *old = t->slots;
+        t->cap = cap ? 2 * cap : 256;
+        t->slots = calloc(t->cap, sizeof(NodeDedupSlot));
+        for (size_t i = 0; i < cap; i++) {
+            if (!old[i].node) continue;
+            size_t s = old[i].hash & (t->cap - 1);
+            while (t->slots[s].node) s = (s + 1) & (t->cap - 1);
+            t->slots[s] = old[i];
+        }
+        free(old);
+    }
+
+    size_t s = h & (t->cap - 1);
+    for (; t->slots[s].node; s = (s + 1) & (t->cap - 1)) {
+        if (t->slots[s].hash == h && __dedup_equal(t->slots[s].node, n, items)) break;
+    }
+    return s;
+}
+
+static Node *__dedup(NodeDedupTable *t, const Node *n) {
+    if (!n || (n->flags & NODE_F_STATIC)) return (Node *)n;
+    if (N_KEYVAL == n->type)
+        return __node_copykv(n->value.kvval.key, __dedup(t, n->value.kvval.val));
+
+    // the children are shared first, so containers compare them as pointers
+    Node **items = NULL;
+    uint32_t len = 0;
+    if (N_DICT == n->type || (N_ARRAY == n->type && !(n->flags & NODE_F_PACKED))) {
+        len = N_DICT == n->type ? n->value.dictval.len : n->value.arrval.len;
+        items = len ? malloc(len * sizeof(Node *)) : NULL;
+        for (uint32_t i = 0; i < len; i++) {
+            items[i] = __dedup(t, N_DICT == n->type ? n->value.dictval.entries[i]->value.kvval.val
+                                                    : n->value.arrval.entries[i]);
+        }
+    }
+
+    uint64_t h = __dedup_hash(n, items);
+    size_t s = __dedup_slot(t, n, items, h);
+    Node *c = t->slots[s].node;
+    if (c && __node_hold(c)) {
+        // the copy's children that the canonical node holds already are released
+        for (uint32_t i = 0; i < len; i++) Node_Free(items[i]);
+        free(items);
+        t->shared++;
+        return c;
+    }
+
+    // a node that's held by as many containers as it can count is succeeded by a new one
+    Node *ret = __dedup_copy(n, items);
+    free(items);
+    if (!c) t->len++;
+    t->slots[s].hash = h;
+    t->slots[s].node = ret;
+    return ret;
+}
+
+Node *Node_Dedup(const Node *n, size_t *shared) {
+    NodeDedupTable t = {0};
+    Node *ret = __dedup(&t, n);
+    free(t.slots);
+    if (shared) *shared += t.shared;
+    return ret;
+}
+
+Node *Node_Share(Node *n) {
+    if (!n || (n->flags & NODE_F_STATIC) || __node_hold(n)) return n;
+    return Node_Clone(n);
+}
+
+/* Copies a node without its children, which the copy shares, but for a dictionary's keyvals */
+static Node *__node_copyself(const Node *n) {
+    Node *ret;
+    switch (n->type) {
+        case N_KEYVAL:
+            return __node_copykv(n->value.kvval.key, Node_Share(n->value.kvval.val));
+        case N_ARRAY: {
+            // a packed array's items are values, so it's copied whole
+            if (n->flags & NODE_F_PACKED) return Node_Clone(n);
+            const t_array *a = &n->value.arrval;
+            ret = NewArrayNode(a->len);
+            for (uint32_t i = 0; i < a->len; i++)
+                ret->value.arrval.entries[i] = Node_Share(a->entries[i]);
+            ret->value.arrval.len = a->len;
+            return ret;
+        }
+        case N_DICT: {
+            const t_dict *o = &n->value.dictval;
+            ret = NewDictNode(o->len);
+            t_dict *c = &ret->value.dictval;
+            for (uint32_t i = 0; i < o->len; i++) c->entries[i] = __node_copyself(o->entries[i]);
+            c->len = o->len;
+            if (ret->flags & NODE_F_DICT_INDEXED) __obj_reindex(c);
+            return ret;
+        }
+        default:
+            return Node_Clone(n);
+    }
+}
+
+Node *Node_Own(Node **ref) {
+    Node *n = *ref;
+    if (!n || !n->refs) return n;
+    *ref = __node_copyself(n);
+    __node_release(n);
+    return *ref;
+}
+
+void Node_OwnAll(Node **ref) {
+    Node *n = Node_Own(ref);
+    if (!n || !__node_nowned(n)) return;
+
+    NodeStack s;
+    __stack_init(&s);
+    __stack_push(&s, n);
+    while (s.len) {
+        NodeStackFrame *f = __stack_top(&s);
+        if (f->index == __node_nowned(f->node)) {
+            s.len--;
+            continue;
+        }
+        Node *c = Node_Own(__node_childref(f->node, f->index++));
+        if (c && __node_nowned(c)) __stack_push(&s, c);
+    }
+    __stack_free(&s);
+}
+
+/* Deletes an item from the dictionary by key, its value is put into val or freed if val is NULL */
+static int __obj_del(Node *obj, const char *key, Node **val) {
     if (key == NULL) return OBJ_ERR;
 
     t_dict *o = &obj->value.dictval;
 
     int idx = -1;
-    Node *kv = __obj_find(o, key, &idx);
+    Node *kv = __obj_find(obj, key, 0, &idx);
 
     // tried to delete a non existing node
     if (!kv) return OBJ_ERR;
 
-    // let's delete the node's memory
-    if (kv->value.kvval.val) {
+    // unindex the entry, and re-point the top entry's slot to the hole it is about to fill
+    if (obj->flags & NODE_F_DICT_INDEXED) {
+        __obj_indexdel(o, __obj_indexslot(o, kv->value.kvval.key, idx));
+        if (idx < o->len - 1) __obj_index(o)[__obj_indexslot(o, NULL, o->len - 1)] = idx + 1;
+    }
+
+    // let's delete the node's memory, but for the value that the caller takes
+    if (val) {
+        *val = kv->value.kvval.val;
+    } else if (kv->value.kvval.val) {
         Node_Free(kv->value.kvval.val);
     }
-    free((char *)kv->value.kvval.key);
+    __node_releasekey(kv);
+    __node_freenode(kv);
+
+    // the tree's labels may point into the key
+    if (obj->flags & NODE_F_DICT_TRIE) DictTrie_Invalidate(obj);
 
     // replace the deleted entry and the top entry to avoid holes
     if (idx < o->len - 1) {
@@ -407,16 +1766,31 @@ int Node_DictDel(Node *obj, const char *key) {
     }
     o->len--;
 
+    // shrink the heap allocated entries of a dictionary that's mostly free slots, and its index
+    if (!(obj->flags & (NODE_F_ARENA_DATA | NODE_F_INLINE_DATA)) &&
+        o->cap >= OBJECT_SHRINK_MIN_CAP && o->len < o->cap / 4) {
+        int indexed = obj->flags & NODE_F_DICT_INDEXED;
+        o->cap = MAX(o->len * 2, OBJECT_SHRINK_MIN_CAP / 4);
+        o->entries = realloc(o->entries, __obj_blocksize(o->cap, indexed));
+        if (indexed) __obj_reindex(o);
+    }
+
     return OBJ_OK;
 }
 
+int Node_DictDel(Node *obj, const char *key) {
+    return __obj_del(obj, key, NULL);
+}
+
+int Node_DictTake(Node *obj, const char *key, Node **val) {
+    return __obj_del(obj, key, val);
+}
+
 int Node_DictGet(Node *obj, const char *key, Node **val) {
     if (key == NULL) return OBJ_ERR;
 
-    t_dict *o = &obj->value.dictval;
-
     int idx = -1;
-    Node *kv = __obj_find(o, key, &idx);
+    Node *kv = __obj_find(obj, key, 0, &idx);
 
     // not found!
     if (!kv) return OBJ_ERR;
@@ -425,40 +1799,347 @@ int Node_DictGet(Node *obj, const char *key, Node **val) {
     return OBJ_OK;
 }
 
-void __objTraverse(Node *n, NodeVisitor f, void *ctx) {
-    t_dict *o = &n->value.dictval;
+int Node_DictGetInterned(Node *obj, const char *key, Node **val) {
+    Node *kv = __obj_find(obj, key, 1, NULL);
+    if (!kv) return OBJ_ERR;
 
-    f(n, ctx);
-    for (int i = 0; i < o->len; i++) {
-        Node_Traverse(o->entries[i], f, ctx);
+    *val = kv->value.kvval.val;
+    return OBJ_OK;
+}
+
+Node **Node_DictGetRef(Node *obj, const char *key, int interned) {
+    Node *kv = key ? __obj_find(obj, key, interned, NULL) : NULL;
+    return kv ? &kv->value.kvval.val : NULL;
+}
+
+size_t Node_DictIndexSize(const Node *obj) {
+    size_t size = obj->flags & NODE_F_DICT_TRIE ? DictTrie_Size(obj) : 0;
+    if (!(obj->flags & NODE_F_DICT_INDEXED)) return size;
+    return size + __obj_indexcap(obj->value.dictval.cap) * sizeof(uint32_t);
+}
+
+/* Orders keyvals by their keys */
+static int __obj_keycmp(const void *a, const void *b) {
+    return strcmp((*(const Node **)a)->value.kvval.key, (*(const Node **)b)->value.kvval.key);
+}
+
+uint32_t Node_DictPrefixScan(Node *obj, const char *prefix, uint32_t len, NodeDictKeyVisitor f,
+                             void *ctx) {
+    t_dict *o = &obj->value.dictval;
+
+    if (!(obj->flags & NODE_F_DICT_TRIE) && NodeDictTrieThreshold &&
+        o->len >= NodeDictTrieThreshold && (_arena || !(obj->flags & NODE_F_ARENA))) {
+        // the nodes of an arena aren't necessarily freed one by one
+        if (obj->flags & NODE_F_ARENA) __arena_addindexed(_arena, obj);
+        DictTrie_Create(obj);
+        obj->flags |= NODE_F_DICT_TRIE;
+    }
+    if (obj->flags & NODE_F_DICT_TRIE) return DictTrie_Scan(obj, prefix, len, f, ctx);
+
+    // the matching entries are sorted by their keys
+    Node **kvs = malloc(MAX(o->len, 1) * sizeof(Node *));
+    uint32_t n = 0, count = 0;
+    for (uint32_t i = 0; i < o->len; i++) {
+        if (strlen(__obj_key(o, i)) >= len && !memcmp(__obj_key(o, i), prefix, len))
+            kvs[n++] = o->entries[i];
     }
+    qsort(kvs, n, sizeof(Node *), __obj_keycmp);
+    while (count < n && !f(kvs[count++], ctx)) {}
+    free(kvs);
+    return count;
 }
-void __arrTraverse(Node *n, NodeVisitor f, void *ctx) {
-    t_array *a = &n->value.arrval;
-    f(n, ctx);
 
-    for (int i = 0; i < a->len; i++) {
-        Node_Traverse(a->entries[i], f, ctx);
+size_t Node_AllocatedSize(const Node *n, NodeAllocSizeFunc alloc, int arena) {
+    size_t nodesize = sizeof(Node), datasize = 0, size = 0;
+    const void *data = NULL;
+
+    if (!n || (n->flags & NODE_F_STATIC)) return 0;
+    switch (n->type) {
+        case N_STRING:
+            if (n->flags & NODE_F_INLINE_DATA) {
+                nodesize += n->value.strval.len + 1;
+            } else {
+                data = n->value.strval.data;
+                datasize = Node_StringMemory(n) + !(n->flags & NODE_F_COMPRESSED);
+            }
+            break;
+        case N_NUMBER:
+            if (!(n->flags & NODE_F_NUMBER_TEXT)) {
+                break;
+            } else if (n->flags & NODE_F_INLINE_DATA) {
+                nodesize += n->value.strval.len + 1;
+            } else {
+                data = n->value.strval.data;
+                datasize = n->value.strval.len + 1;
+            }
+            break;
+        case N_KEYVAL:
+            size += Intern_AllocatedShare(n->value.kvval.key, alloc);
+            break;
+        case N_DICT:
+            if (n->value.dictval.cap) {
+                data = n->value.dictval.entries;
+                datasize = __obj_blocksize(n->value.dictval.cap, n->flags & NODE_F_DICT_INDEXED);
+            }
+            if (n->flags & NODE_F_DICT_TRIE) size += alloc(NULL, DictTrie_Size(n));
+            break;
+        case N_ARRAY:
+            if (n->value.arrval.cap || __arr_gap(n)) {
+                data = n->value.arrval.entries - __arr_gap(n);
+                datasize = (n->value.arrval.cap + __arr_gap(n)) * sizeof(Node *);
+            }
+            if (n->flags & NODE_F_ARRAY_INDEXED) size += alloc(NULL, ArrayIndex_Size(n));
+            break;
+        default:
+            break;
+    }
+
+    // arena allocations are rounded to a pointer's size
+    if (n->flags & NODE_F_ARENA) {
+        size += arena ? (nodesize + sizeof(void *) - 1) & ~(sizeof(void *) - 1) : 0;
+    } else {
+        size += alloc(n, nodesize);
+    }
+    if (!datasize) return size;
+    if (n->flags & NODE_F_ARENA_DATA) {
+        size += arena ? (datasize + sizeof(void *) - 1) & ~(sizeof(void *) - 1) : 0;
+    } else {
+        size += alloc(data, datasize);
     }
+    return size;
 }
 
-void Node_Traverse(Node *n, NodeVisitor f, void *ctx) {
-    // for null node - just call the callback
-    if (!n) {
-        f(n, ctx);
-        return;
+/* Hands an allocation of size bytes to a defragmentation, returning where it is now */
+static inline void *__defrag_move(NodeDefragOpt *o, void *ptr, size_t size) {
+    void *moved = o->alloc(ptr, o->ctx);
+    if (!moved) return ptr;
+    o->moved++;
+    o->bytes += size;
+    return moved;
+}
+
+/**
+* Defragments a node's own allocations, the node that ref points at, which is updated if the node
+* moves. Returns the node.
+*/
+static Node *__defrag_node(Node **ref, NodeDefragOpt *o) {
+    Node *n = *ref;
+    if (!n || (n->flags & NODE_F_STATIC)) return n;
+    o->nodes++;
+
+    // the tables of array indexes and dictionary trees are keyed by their containers' addresses,
+    // and a shared node's other holders point at it too
+    int inlined = (n->flags & NODE_F_INLINE_DATA) != 0;
+    if (!(n->flags & (NODE_F_ARENA | NODE_F_ARRAY_INDEXED | NODE_F_DICT_TRIE)) && !n->refs) {
+        size_t size = sizeof(Node) + (inlined ? n->value.strval.len + 1 : 0);
+        *ref = n = __defrag_move(o, n, size);
+        if (inlined) n->value.strval.data = (const char *)(n + 1);
     }
+    if (inlined || (n->flags & NODE_F_ARENA_DATA)) return n;
+
     switch (n->type) {
-        case N_ARRAY:
-            __arrTraverse(n, f, ctx);
+        case N_STRING:
+            n->value.strval.data = __defrag_move(o, (void *)n->value.strval.data,
+                                                 Node_StringMemory(n) +
+                                                     !(n->flags & NODE_F_COMPRESSED));
+            break;
+        case N_NUMBER:
+            if (n->flags & NODE_F_NUMBER_TEXT)
+                n->value.strval.data = __defrag_move(o, (void *)n->value.strval.data,
+                                                     n->value.strval.len + 1);
             break;
         case N_DICT:
-            __objTraverse(n, f, ctx);
+            if (n->value.dictval.cap)
+                n->value.dictval.entries =
+                    __defrag_move(o, n->value.dictval.entries,
+                                  __obj_blocksize(n->value.dictval.cap,
+                                                  n->flags & NODE_F_DICT_INDEXED));
             break;
-        // for all other types - just call the callback
+        case N_ARRAY: {
+            uint32_t gap = __arr_gap(n);
+            if (n->value.arrval.cap || gap)
+                n->value.arrval.entries =
+                    (Node **)__defrag_move(o, n->value.arrval.entries - gap,
+                                           (n->value.arrval.cap + gap) * sizeof(Node *)) +
+                    gap;
+            break;
+        }
         default:
-            f(n, ctx);
+            break;
+    }
+    return n;
+}
+
+/* Whether a defragmentation walks into a node, i.e. it's a container with nodes in it */
+static inline int __defrag_container(const Node *n) {
+    if (!n) return 0;
+    if (N_DICT == n->type) return n->value.dictval.len > 0;
+    return N_ARRAY == n->type && !(n->flags & NODE_F_PACKED) && n->value.arrval.len > 0;
+}
+
+/* The place of a container's child at a position, a dictionary's being its keyval's value */
+static inline Node **__defrag_child(Node *n, uint32_t pos) {
+    if (N_DICT == n->type) {
+        if (pos >= n->value.dictval.len) return NULL;
+        return &n->value.dictval.entries[pos]->value.kvval.val;
+    }
+    return pos < n->value.arrval.len ? &n->value.arrval.entries[pos] : NULL;
+}
+
+static void __defrag_push(NodeDefragCursor *c, Node *n) {
+    if (c->depth == c->cap) {
+        c->cap = c->cap ? 2 * c->cap : 16;
+        c->frames = realloc(c->frames, c->cap * sizeof(*c->frames));
+    }
+    c->frames[c->depth].node = n;
+    c->frames[c->depth++].pos = 0;
+}
+
+int Node_Defrag(Node **root, NodeDefragCursor *c, NodeDefragOpt *o) {
+    if (!c->started) {
+        c->started = 1;
+        c->depth = 0;
+        Node *n = __defrag_node(root, o);
+        if (__defrag_container(n)) __defrag_push(c, n);
+    } else if (c->depth) {
+        // the containers are found again by their positions, going on with the next entry of the
+        // innermost one that's still there
+        c->frames[0].node = *root;
+        if (!__defrag_container(*root)) c->depth = 0;
+        for (uint32_t d = 0; d + 1 < c->depth; d++) {
+            Node **ref = __defrag_child(c->frames[d].node, c->frames[d].pos);
+            if (!ref || !__defrag_container(*ref)) {
+                c->depth = d + 1;
+                c->frames[d].pos++;
+                break;
+            }
+            c->frames[d + 1].node = *ref;
+        }
+    }
+
+    size_t check = o->nodes + OBJECT_DEFRAG_STOP_INTERVAL;
+    while (c->depth) {
+        Node *n = c->frames[c->depth - 1].node;
+        uint32_t pos = c->frames[c->depth - 1].pos;
+        uint32_t len = N_DICT == n->type ? n->value.dictval.len : n->value.arrval.len;
+        if (pos >= len) {
+            if (--c->depth) c->frames[c->depth - 1].pos++;
+            continue;
+        }
+        if (o->stop && o->nodes >= check) {
+            check = o->nodes + OBJECT_DEFRAG_STOP_INTERVAL;
+            if (o->stop(o->ctx)) return 0;
+        }
+
+        Node **ref;
+        if (N_DICT == n->type) {
+            ref = &__defrag_node(&n->value.dictval.entries[pos], o)->value.kvval.val;
+        } else {
+            ref = &n->value.arrval.entries[pos];
+        }
+        Node *child = __defrag_node(ref, o);
+        if (__defrag_container(child)) {
+            __defrag_push(c, child);
+        } else {
+            c->frames[c->depth - 1].pos++;
+        }
+    }
+    c->started = 0;
+    return 1;
+}
+
+void NodeDefragCursor_Free(NodeDefragCursor *c) {
+    free(c->frames);
+    c->frames = NULL;
+    c->depth = c->cap = 0;
+    c->started = 0;
+}
+
+void Node_Traverse(Node *n, NodeVisitor f, void *ctx) {
+    Node tmp, *item;  // tmp holds the current item of a packed array, which is always a scalar
+    NodeStack s;
+
+    f(n, ctx);
+    if (!__node_nchildren(n)) return;
+    __stack_init(&s);
+    __stack_push(&s, n);
+    while (s.len) {
+        NodeStackFrame *fr = __stack_top(&s);
+        if (fr->index == __node_nchildren(fr->node)) {
+            s.len--;
+            continue;
+        }
+        if (N_ARRAY == fr->node->type) {
+            Node_ArrayItemView(fr->node, fr->index++, &tmp, &item);
+        } else {
+            item = __node_child(fr->node, fr->index++);
+        }
+        f(item, ctx);
+        if (__node_nchildren(item)) __stack_push(&s, item);
     }
+    __stack_free(&s);
+}
+
+/* A set of nodes, a hash table of their addresses whose size is a power of 2 */
+typedef struct {
+    const Node **slots;
+    size_t len, cap;
+} NodeSet;
+
+static inline size_t __nodeset_home(const NodeSet *set, const Node *n) {
+    return ((uintptr_t)n >> 3) * 0x9e3779b97f4a7c15ULL & (set->cap - 1);
+}
+
+/* Adds a node to the set. Returns 0 if it's in the set already */
+static int __nodeset_add(NodeSet *set, const Node *n) {
+    if (2 * (set->len + 1) > set->cap) {
+        const Node **old = set->slots;
+        size_t cap = set->cap;
+        set->cap = cap ? 2 * cap : 64;
+        set->slots = calloc(set->cap, sizeof(Node *));
+        for (size_t i = 0; i < cap; i++) {
+            if (!old[i]) continue;
+            size_t s = __nodeset_home(set, old[i]);
+            while (set->slots[s]) s = (s + 1) & (set->cap - 1);
+            set->slots[s] = old[i];
+        }
+        free(old);
+    }
+    size_t s = __nodeset_home(set, n);
+    for (; set->slots[s]; s = (s + 1) & (set->cap - 1)) {
+        if (set->slots[s] == n) return 0;
+    }
+    set->slots[s] = n;
+    set->len++;
+    return 1;
+}
+
+void Node_TraverseUnique(Node *n, NodeVisitor f, void *ctx) {
+    Node tmp, *item;
+    NodeStack s;
+    NodeSet visited = {0};  // the shared nodes that were visited
+
+    f(n, ctx);
+    if (!__node_nchildren(n)) return;
+    __stack_init(&s);
+    __stack_push(&s, n);
+    while (s.len) {
+        NodeStackFrame *fr = __stack_top(&s);
+        if (fr->index == __node_nchildren(fr->node)) {
+            s.len--;
+            continue;
+        }
+        if (N_ARRAY == fr->node->type) {
+            Node_ArrayItemView(fr->node, fr->index++, &tmp, &item);
+        } else {
+            item = __node_child(fr->node, fr->index++);
+        }
+        if (item && item->refs && !__nodeset_add(&visited, item)) continue;
+        f(item, ctx);
+        if (__node_nchildren(item)) __stack_push(&s, item);
+    }
+    __stack_free(&s);
+    free(visited.slots);
 }
 
 #define __node_indent(depth)          \
@@ -466,77 +2147,69 @@ void Node_Traverse(Node *n, NodeVisitor f, void *ctx) {
         printf("  ");                 \
     }
 
-/** Pretty print a JSON-like (but not compatible!) version of a node */
-void Node_Print(Node *n, int depth) {
-    if (n == NULL) {
+/* The state of Node_Print: the depth of the current value, and whether it follows its key */
+typedef struct {
+    int depth;
+    int nokey;
+} NodePrinter;
+
+static void __print_begin(Node *n, void *ctx) {
+    NodePrinter *p = ctx;
+    if (!p->nokey) __node_indent(p->depth);
+    p->nokey = 0;
+    if (!n) {
         printf("null");
         return;
     }
     switch (n->type) {
-        case N_NULL:    // stop the compiler from complaining
+        case N_ARRAY:
+        case N_DICT:
+            printf(N_ARRAY == n->type ? "[\n" : "{\n");
+            p->depth++;
             break;
-        case N_ARRAY: {
-            printf("[\n");
-            for (int i = 0; i < n->value.arrval.len; i++) {
-                __node_indent(depth + 1);
-                Node_Print(n->value.arrval.entries[i], depth + 1);
-                if (i < n->value.arrval.len - 1) printf(",");
-                printf("\n");
-            }
-            __node_indent(depth);
-            printf("]");
-        } break;
-
-        case N_DICT: {
-            printf("{\n");
-            for (int i = 0; i < n->value.dictval.len; i++) {
-                __node_indent(depth + 1);
-                Node_Print(n->value.dictval.entries[i], depth + 1);
-                if (i < n->value.dictval.len - 1) printf(",");
-                printf("\n");
-            }
-            __node_indent(depth);
-            printf("}");
-        } break;
         case N_BOOLEAN:
             printf("%s", n->value.boolval ? "true" : "false");
             break;
         case N_NUMBER:
-            printf("%f", n->value.numval);
+            printf("%f", Node_Number(n));
             break;
         case N_INTEGER:
             printf("%ld", n->value.intval);
             break;
-        case N_KEYVAL: {
+        case N_KEYVAL:
             printf("\"%s\": ", n->value.kvval.key);
-            Node_Print(n->value.kvval.val, depth);
+            p->nokey = 1;
+            break;
+        case N_STRING: {
+            char *tmp;
+            printf("\"%.*s\"", n->value.strval.len, Node_StringData(n, &tmp));
+            free(tmp);
         } break;
-        case N_STRING:
-            printf("\"%.*s\"", n->value.strval.len, n->value.strval.data);
+        default:
+            break;
     }
 }
 
-// serializer stack
-typedef struct {
-    int level;  // current level
-    int pos;    // 0-based level
-    Vector *nodes;
-    Vector *indices;
-
-} NodeSerializerStack;
-
-// serializer stack push
-static inline void _serializerPush(NodeSerializerStack *s, const Node *n) {
-    s->level++;
-    Vector_Push(s->nodes, n);
-    Vector_Push(s->indices, 0);
+static void __print_end(Node *n, void *ctx) {
+    NodePrinter *p = ctx;
+    if (Node_Length(n)) printf("\n");
+    p->depth--;
+    __node_indent(p->depth);
+    printf(N_ARRAY == n->type ? "]" : "}");
 }
 
-// serializer stack push
-static inline void _serializerPop(NodeSerializerStack *s) {
-    s->level--;
-    Vector_Pop(s->nodes, NULL);
-    Vector_Pop(s->indices, NULL);
+static void __print_delim(void *ctx) { printf(",\n"); }
+
+/** Pretty print a JSON-like (but not compatible!) version of a node */
+void Node_Print(Node *n, int depth) {
+    NodePrinter p = {depth, 1};
+    NodeSerializerOpt opt = {.fBegin = __print_begin,
+                             .fEnd = __print_end,
+                             .fDelim = __print_delim,
+                             .xBegin = 0xff,
+                             .xEnd = N_ARRAY | N_DICT,
+                             .xDelim = N_ARRAY | N_DICT};
+    Node_Serializer(n, &opt, &p);
 }
 
 #define _maskenabled(n, x) ((int)(n ? n->type : N_NULL) & x)
@@ -556,20 +2229,20 @@ void Node_Serializer(const Node *n, const NodeSerializerOpt *o, void *ctx) {
     int curr_len;
     int curr_index;
     Node **curr_entries;
-    NodeSerializerStack stack = {0};
+    Node tmp;  // holds the current item of a packed array, which is always a scalar
+    NodeStack stack;
     NodeSerializerState state = S_INIT;
 
     // ===
     while (S_END != state) {
         switch (state) {
             case S_INIT:  // initial state
-                stack.nodes = NewVector(Node *, 1);
-                stack.indices = NewVector(int, 1);
-                _serializerPush(&stack, n);
+                __stack_init(&stack);
+                __stack_push(&stack, n);
                 state = S_BEGIN_VALUE;
                 break;
             case S_BEGIN_VALUE:  // begining of a new value
-                Vector_Get(stack.nodes, stack.level - 1, &curr_node);
+                curr_node = __stack_top(&stack)->node;
                 if (_maskenabled(curr_node, o->xBegin)) o->fBegin(curr_node, ctx);
                 // NULL nodes have no type so they need special care
                 state = curr_node ? S_CONT_VALUE : S_END_VALUE;
@@ -592,11 +2265,17 @@ void Node_Serializer(const Node *n, const NodeSerializerOpt *o, void *ctx) {
                 }
                 break;
             case S_CONTAINER:  // go over container's contents
-                Vector_Get(stack.indices, stack.level - 1, &curr_index);
+                curr_index = __stack_top(&stack)->index;
                 if (curr_index < curr_len) {
                     if (curr_index && _maskenabled(curr_node, o->xDelim)) o->fDelim(ctx);
-                    Vector_Put(stack.indices, stack.level - 1, curr_index + 1);
-                    _serializerPush(&stack, curr_entries[curr_index]);
+                    __stack_top(&stack)->index++;
+                    if (curr_node->flags & NODE_F_PACKED) {
+                        Node *item;
+                        Node_ArrayItemView(curr_node, curr_index, &tmp, &item);
+                        __stack_push(&stack, item);
+                    } else {
+                        __stack_push(&stack, curr_entries[curr_index]);
+                    }
                     state = S_BEGIN_VALUE;
                 } else {
                     state = S_END_VALUE;
@@ -604,9 +2283,9 @@ void Node_Serializer(const Node *n, const NodeSerializerOpt *o, void *ctx) {
                 break;
             case S_END_VALUE:  // finished with the current value
                 if (_maskenabled(curr_node, o->xEnd)) o->fEnd(curr_node, ctx);
-                _serializerPop(&stack);
-                if (stack.level) {  // if the value belongs to a container, go back to the container
-                    Vector_Get(stack.nodes, stack.level - 1, &curr_node);
+                stack.len--;
+                if (stack.len) {  // if the value belongs to a container, go back to the container
+                    curr_node = __stack_top(&stack)->node;
                     state = S_CONT_VALUE;
                 } else {
                     state = S_END;  // otherwise we're done serializing
@@ -616,6 +2295,5 @@ void Node_Serializer(const Node *n, const NodeSerializerOpt *o, void *ctx) {
                 break;
         }  // switch(state)
     }
-    Vector_Free(stack.nodes);
-    Vector_Free(stack.indices);
+    __stack_free(&stack);
 }
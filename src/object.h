@@ -24,6 +24,8 @@
 #include <string.h>
 #include <sys/param.h>
 #include <vector.h>
+#include "intern.h"
+#include "compress.h"
 
 #ifdef REDIS_MODULE_TARGET
 #include <alloc.h>
@@ -60,10 +62,17 @@ struct t_node;
 typedef struct {
     const char *data;
     uint32_t len;
+    uint32_t cap;  // the bytes allocated for the data, only set with NODE_F_STRING_ROOM
 } t_string;
 
 /*
-* Internal representation of an array, that has a length and capacity
+* Internal representation of an array, that has a length and capacity.
+* Arrays that hold only integers or only (double) numbers are packed, i.e. their entries hold the
+* values themselves instead of pointers to nodes (see NODE_F_PACKED). Appending a value of another
+* type, or accessing an item with Node_ArrayItem, converts the array to the generic form.
+* Arrays that items are inserted at or deleted from the head of keep free slots before their entries
+* (see NODE_F_ARRAY_GAP), so that adding and removing items at either end is amortized O(1). The
+* entries always point at the first item, and the capacity counts the slots from there.
 */
 typedef struct {
     struct t_node **entries;
@@ -73,7 +82,7 @@ typedef struct {
 
 /*
 * Internal representation of a key-value pair in an object.
-* The key is a NULL terminated C-string, the value is another node
+* The key is an interned NULL terminated C-string (see intern.h), the value is another node
 */
 typedef struct {
     const char *key;
@@ -82,8 +91,9 @@ typedef struct {
 
 /*
 * Internal representation of a dictionary node.
-* Currently implemented as a list of key-value pairs, will be converted
-* to a hash-table on big objects in the future
+* Implemented as a list of key-value pairs that preserves the insertion order. Big dictionaries (see
+* NodeDictHashThreshold) are also indexed with an open-addressing hash table that is allocated right
+* after the entries, so the list itself remains the same.
 */
 typedef struct {
     struct t_node **entries;
@@ -91,6 +101,56 @@ typedef struct {
     uint32_t cap;
 } t_dict;
 
+/**
+* Containers whose heap allocated entries are at least this many shrink when their length falls
+* under a quarter of them, to twice their length (or OBJECT_SHRINK_MIN_CAP / 4), so that deleting
+* most of a big container gives its memory back. Entries in an arena are left as they are.
+*/
+#define OBJECT_SHRINK_MIN_CAP 32
+
+/* The default number of entries from which a dictionary is indexed by a hash table */
+#define OBJECT_DICT_HASH_THRESHOLD 32
+
+/**
+* Dictionaries that grow to this number of entries are indexed by a hash table, smaller ones use
+* linear search. 0 disables hash indexing of new dictionaries.
+*/
+extern uint32_t NodeDictHashThreshold;
+
+/* The default number of entries from which a dictionary's keys are scanned by prefix with a tree */
+#define OBJECT_DICT_TRIE_THRESHOLD 1024
+
+/**
+* Dictionaries of at least this many entries get a radix tree of their keys the first time they're
+* scanned by prefix, see Node_DictPrefixScan, smaller ones are scanned entry by entry. 0 disables
+* the trees.
+*/
+extern uint32_t NodeDictTrieThreshold;
+
+/* The default number of entries from which arrays grow by a fixed number of entries */
+#define OBJECT_ARRAY_GROWTH_CHUNK (1 << 20)
+
+/**
+* Arrays grow to the next power of 2 of the entries that they need up to this many entries, and by
+* this many entries at a time from there, so that big arrays don't take twice their size. 0 makes
+* arrays always grow to a power of 2.
+*/
+extern uint32_t NodeArrayGrowthChunk;
+
+/**
+* Strings that are appended to get room to grow into: their data doubles until it's this many bytes,
+* and then grows by this many bytes at a time, so that appends are amortized O(1) without big strings
+* taking twice their size.
+*/
+#define OBJECT_STRING_GROWTH_CHUNK (1 << 20)
+
+/**
+* New strings of at least this length are stored compressed when that saves an eighth of their size,
+* see compress.h. Their length is still the string's, and Node_StringData decompresses them. 0 (the
+* default) disables compression.
+*/
+extern uint32_t NodeStringCompressSize;
+
 /*
 * A node in an object can be any one of the types we support.
 * Basically an object is just a treee of nodes that can have children
@@ -110,25 +170,173 @@ typedef struct t_node {
 
     // type specifier
     NodeType type;
+
+    // internal representation flags, see NODE_F_*
+    uint16_t flags;
+
+    // the holders of a shared node besides its first, see Node_Share
+    uint16_t refs;
 } Node;
 
+/* The dictionary's entries are followed by a hash index */
+#define NODE_F_DICT_INDEXED 0x1
+/* The node itself is allocated in an arena */
+#define NODE_F_ARENA 0x2
+/* The node's string or entries are allocated in an arena, or its key is referenced by it */
+#define NODE_F_ARENA_DATA 0x4
+/* The node is a shared immutable scalar that is never freed, see NewBoolNode and NewIntNode */
+#define NODE_F_STATIC 0x8
+/* The node's string is stored right after it, in the same allocation */
+#define NODE_F_INLINE_DATA 0x10
+/* The array's entries are int64_t values rather than nodes */
+#define NODE_F_PACKED_INT 0x20
+/* The array's entries are double values rather than nodes */
+#define NODE_F_PACKED_NUM 0x40
+#define NODE_F_PACKED (NODE_F_PACKED_INT | NODE_F_PACKED_NUM)
+/* The string is compressed, its data is the uint32_t compressed size followed by the stream */
+#define NODE_F_COMPRESSED 0x80
+/* The array's entries are preceded by free slots, whose number is stored in the slot right before
+ * the entries */
+#define NODE_F_ARRAY_GAP 0x100
+/* The array's items are indexed by a hash table of their values, see Node_ArraySetIndexed */
+#define NODE_F_ARRAY_INDEXED 0x200
+/* The dictionary's keys are indexed by a radix tree, see Node_DictPrefixScan */
+#define NODE_F_DICT_TRIE 0x400
+/* The number is kept as its JSON text in its string rather than as a double, see
+ * NewNumberTextNode */
+#define NODE_F_NUMBER_TEXT 0x800
+/* The string's data has room to be appended to, its allocated size is the string's cap */
+#define NODE_F_STRING_ROOM 0x1000
+
+/* Integers in this range are shared nodes, so containers store nothing but a pointer for them */
+#define OBJECT_SHARED_INT_MIN -128
+#define OBJECT_SHARED_INT_MAX 1023
+
+/* Strings up to this length are stored in the same allocation as their node */
+#define OBJECT_INLINE_STRING_MAX 32
+
 typedef Node Object;
 
-/** Create a new boolean node, with 0 as false 1 as true */
+/* The initial size of an arena's block with its header, blocks double up to OBJECT_ARENA_MAX_BLOCK */
+#define OBJECT_ARENA_MIN_BLOCK (4 * 1024)
+#define OBJECT_ARENA_MAX_BLOCK (1024 * 1024)
+
+struct t_arena_block;
+
+/**
+* A bump allocator for building entire trees, e.g. a document that's parsed or loaded.
+* Nodes that are created while an arena is set with Node_SetArena are allocated in it, and their
+* memory is released all at once with NodeArena_Free. Nodes in an arena can still be modified, freed
+* or have new children, the fallback for any allocation made when the arena isn't set is the heap.
+*/
+typedef struct {
+    struct t_arena_block *head;  // the current block
+    size_t size;                 // the total size of the arena's blocks
+    const char **keys;           // the interned keys that are referenced by the arena's nodes
+    uint32_t nkeys, capkeys;
+    const Node **indexed;        // the arena's containers with indexes that are kept apart
+    uint32_t nindexed, capindexed;
+} NodeArena;
+
+/** Create a new empty arena */
+NodeArena *NewNodeArena(void);
+
+/**
+* Release all of the arena's memory at once. The nodes allocated in it must not be used afterwards,
+* and any heap memory that they reference should be freed beforehand with Node_Free.
+*/
+void NodeArena_Free(NodeArena *a);
+
+/**
+* Gives the bytes that the allocator holds for an allocation of size bytes at ptr, for accounting
+* memory as the allocator does rather than by the sizes that were asked for. ptr is NULL when the
+* size is of several allocations or of a share of one.
+*/
+typedef size_t (*NodeAllocSizeFunc)(const void *ptr, size_t size);
+
+/** The bytes that the allocator holds for the arena's blocks and the arena itself */
+size_t NodeArena_AllocatedSize(const NodeArena *a, NodeAllocSizeFunc alloc);
+
+/** Allocate size bytes aligned to a pointer's size from the arena */
+void *NodeArena_Alloc(NodeArena *a, size_t size);
+
+/**
+* Moves the blocks of another arena, and the keys and indexes that its nodes reference, into the
+* arena, and frees the other one. Its nodes then belong to the arena, e.g. after trees that were
+* built in arenas of their own on several threads are joined.
+*/
+void NodeArena_Merge(NodeArena *a, NodeArena *from);
+
+/**
+* Set the arena that new nodes are allocated in, NULL for the heap. Returns the previous one. The
+* arena, like the slot of Node_SetSlot, is the calling thread's own, so threads can build trees at
+* the same time in different arenas.
+*/
+NodeArena *Node_SetArena(NodeArena *a);
+
+/**
+* Allocates room for count nodes in a row in the current arena, for Node_SetSlot, or returns NULL if
+* no arena is set.
+*/
+Node *NodeArena_AllocSlots(uint32_t count);
+
+/**
+* Sets the slot that the next node is created in instead of being allocated, so that the children
+* of a container can be laid out one after the other in a block of NodeArena_AllocSlots. That makes
+* walks and scans of their items read memory in order. The shared nodes don't take the slot, and the
+* strings that do keep their data apart. Nodes in slots are arena nodes, so containers with them can
+* be modified like any other. Returns the previous slot, which is NULL if a node took it.
+*/
+Node *Node_SetSlot(Node *slot);
+
+/**
+* The number of nodes that the calling thread has created so far, not counting the shared ones. The
+* difference between two calls is the number of nodes that were created in between.
+*/
+uint64_t Node_CreatedCount(void);
+
+/**
+* Create a new boolean node, with 0 as false 1 as true.
+* NOTE: booleans are shared nodes that must not be modified, freeing them is a no-op
+*/
 Node *NewBoolNode(int val);
 
 /** Create a new double node with the given value */
 Node *NewDoubleNode(double val);
 
-/** Create a new integer node with the given value */
+/**
+* Create a new number node that keeps the text of a JSON number, which must be valid and in a
+* double's range, instead of its value: the text is serialized as it is, and Node_Number converts it
+* when the value is needed. It is stored like a string's.
+*/
+Node *NewNumberTextNode(const char *s, uint32_t len);
+
+/** The value of a number node, which is converted from its text if it has one */
+double Node_Number(const Node *n);
+
+/**
+* Create a new integer node with the given value.
+* NOTE: small integers are shared nodes that must not be modified, freeing them is a no-op
+*/
 Node *NewIntNode(int64_t val);
 
 /**
 * Create a new string node with the given c-string and its length.
-* NOTE: The string's value will be copied to a newly allocated string
+* NOTE: The string's value will be copied to a newly allocated string, or after the node itself if
+* it is short
 */
 Node *NewStringNode(const char *s, uint32_t len);
 
+/**
+* Create a new string node of len bytes that the caller writes to the returned data, which is NULL
+* terminated, e.g. to unescape a string right into its node. The string isn't compressed. Once it's
+* written its length can be cut down with Node_StringSetLength.
+*/
+Node *NewStringNodeBuffer(uint32_t len, char **data);
+
+/** Cuts down the length of a string that was written to the data of NewStringNodeBuffer */
+void Node_StringSetLength(Node *n, uint32_t len);
+
 /**
 * Create a new string node from a NULL terminated c-string. #ifdef 0
 * NOTE: The string's value will be copied to a newly allocated string
@@ -138,7 +346,7 @@ Node *NewCStringNode(const char *su);
 /**
 * Create a new keyval node from a C-string and its length as key and a pointer
 * to a Node as value.
-* NOTE: The string's value will be copied to a newly allocated string
+* NOTE: The key is interned, and shared with all other keyval nodes that have the same key
 */
 Node *NewKeyValNode(const char *key, uint32_t len, Node *n);
 
@@ -148,7 +356,50 @@ Node *NewArrayNode(uint32_t cap);
 /** Create a new dict node with the given capacity */
 Node *NewDictNode(uint32_t cap);
 
-/** Free a node, and if needed free its allocated data and its children recursively */
+/**
+* Create a deep copy of a node, in the current arena if one is set. Containers are allocated at
+* their exact size, packed arrays are copied as they are and the copies of keyval nodes reference
+* the same interned keys. Shared immutable nodes are returned as they are.
+*/
+Node *Node_Clone(const Node *n);
+
+/**
+* Create a copy of a node like Node_Clone, in which equal values are a single node that's shared by
+* the containers that hold them (hash-consing), so repeated values take memory once. Scalars are
+* equal by their values and containers by their children, which are compared as pointers once they
+* are shared themselves. Keyvals aren't shared, but the values of equal keys are. The count of the
+* nodes that are shared, i.e. that the copy didn't allocate, is added to the optional shared.
+*
+* Shared nodes count their holders (see Node_Share), which Node_Free releases, but modifying one
+* changes it for all its holders: the nodes that are written to are made their holder's own first,
+* see Node_Own.
+*/
+Node *Node_Dedup(const Node *n, size_t *shared);
+
+/**
+* Adds a holder to a node, which is then shared by the containers and trees that hold it until all
+* but one of them release it with Node_Free. Returns the node, or a copy of it (see Node_Clone) if
+* it's held by as many as it can count. Keyvals aren't shared, only the values that they hold.
+* Shared nodes mustn't be modified, their holders take them with Node_Own before writing to them.
+*/
+Node *Node_Share(Node *n);
+
+/**
+* Makes the node that ref points to its holder's own: a node that's shared is replaced in ref with
+* a copy whose children are shared instead, and is released. Only the node is copied, so making the
+* nodes on the way to a descendant one's own copies as many nodes as that way and their siblings.
+* The copies are made in the current arena, if one is set. Returns the node that ref points to.
+*/
+Node *Node_Own(Node **ref);
+
+/* Makes the node that ref points to and all its descendants their holders' own, see Node_Own */
+void Node_OwnAll(Node **ref);
+
+/**
+* Free a node, and if needed free its allocated data and its children recursively.
+* Memory that is allocated in an arena isn't freed, only the heap memory that its nodes reference.
+* A shared node is only released by one of its holders until the last one frees it.
+*/
 void Node_Free(Node *n);
 
 /** Reports the length of the node's value if defined. Return a positive integer, and -1 otherwise.
@@ -158,7 +409,23 @@ int Node_Length(const Node *n);
 /** Pretty-print a node. Not JSON compliant but will produce something almost JSON-ish */
 void Node_Print(Node *n, int depth);
 
-/** Concatenates the src string node to the dst string node. */
+/**
+* Returns a string node's data. The data of a compressed string is decompressed to a NULL terminated
+* copy that's returned in tmp too, for the caller to free. tmp is set to NULL otherwise.
+*/
+const char *Node_StringData(const Node *n, char **tmp);
+
+/**
+* The memory that a string node's data takes, which is less than its length when compressed, and
+* more when it has room to be appended to
+*/
+size_t Node_StringMemory(const Node *n);
+
+/**
+* Concatenates the src string node to the dst string node. A compressed dst is decompressed first,
+* and stays so as it's likely to be appended to again. The data grows with room for more appends,
+* see OBJECT_STRING_GROWTH_CHUNK.
+*/
 int Node_StringAppend(Node *dst, Node *src);
 
 /** Deletes (and frees) the count of nodes from an array starting at index. */
@@ -173,9 +440,18 @@ int Node_ArrayInsert(Node *arr, int index, Node *sub);
 /** Append a node to an array node. */
 int Node_ArrayAppend(Node *arr, Node *n);
 
+/** Append an integer to an array node, without creating a node for it if the array can be packed */
+int Node_ArrayAppendInt(Node *arr, int64_t val);
+
+/** Append a double to an array node, without creating a node for it if the array can be packed */
+int Node_ArrayAppendDouble(Node *arr, double val);
+
 /** Prepend a node to an array node. */
 int Node_ArrayPrepend(Node *arr, Node *n);
 
+/** The number of free slots before an array's entries, see t_array */
+uint32_t Node_ArrayGap(const Node *arr);
+
 /**
 * Set an array's member at a given index to a new node.
 * If the index is out of range, we will return an error
@@ -188,6 +464,20 @@ int Node_ArraySet(Node *arr, int index, Node *n);
 */
 int Node_ArrayItem(Node *arr, int index, Node **n);
 
+/**
+* Sets an array item by index and frees the item that it replaces, unlike Node_ArraySet. This is how
+* writes replace the values that path lookups find, which for packed arrays are only copies.
+* Returns OBJ_ERR if the index is out of range
+*/
+int Node_ArrayReplace(Node *arr, int index, Node *n);
+
+/**
+* Like Node_ArrayItem, but an item of a packed array is copied to the caller's tmp node instead of
+* the array being converted to the generic form. The item must be treated as read-only, and be used
+* only as long as tmp and the array are unchanged.
+*/
+int Node_ArrayItemView(Node *arr, int index, Node *tmp, Node **n);
+
 /** Searches for the scalar n in arr between indices the inclusive start index and the exclusive
 * stop index. Index values can be negative. Out of range errors are treated by rounding the index to
 * the arrays start/end. An inverse index range will return unfound.
@@ -195,6 +485,44 @@ int Node_ArrayItem(Node *arr, int index, Node **n);
 */
 int Node_ArrayIndex(Node *arr, Node *n, int start, int stop);
 
+/**
+* Counts the items of arr that equal the scalar n between the indices start and stop, which are
+* treated like Node_ArrayIndex does. Returns 0 if n is not a scalar.
+*/
+int Node_ArrayCount(Node *arr, Node *n, int start, int stop);
+
+/**
+* Compares two values in the order of sorted arrays, returning a negative number, 0 or a positive
+* number like strcmp: null < false < true < numbers < strings < arrays < objects. Numbers compare by
+* their values, so 1 equals 1.0, and strings by their bytes. Arrays compare by their items in turn
+* and objects by their members in their order, the key first, and a prefix of the other comes first.
+*/
+int Node_Compare(const Node *a, const Node *b);
+
+/**
+* Finds where the value n goes in arr, whose items must be sorted in the order of Node_Compare, by a
+* binary search: the index of the first item that's not less than n, or with right set the index
+* after the last item that's not greater than n. Packed arrays are searched without being unpacked.
+*/
+int Node_ArrayBisect(Node *arr, const Node *n, int right);
+
+/**
+* Indexes an array's items by a hash table of their values (see array_index.h), or stops indexing
+* it, so that Node_ArrayIndex and Node_ArrayCount look a scalar up in O(1) instead of scanning the
+* array. The index costs a few bytes per item, and is kept up to date by the array functions:
+* appending adds to it and other changes make the next search build it again. An item that's
+* changed in place, e.g. by Node_StringAppend, must be reported with Node_ArrayChanged.
+* The index of an array in an arena is freed with the arena, which must be set.
+* Returns OBJ_ERR if arr isn't an array, or is in an arena and none is set.
+*/
+int Node_ArraySetIndexed(Node *arr, int indexed);
+
+/** Reports that the items of an indexed array were changed in place */
+void Node_ArrayChanged(Node *arr);
+
+/** Reports the size in bytes of an array's hash index, or 0 if it is not indexed */
+size_t Node_ArrayIndexSize(const Node *arr);
+
 /**
 * Set an item in a dictionary for a given key.
 * If an existing item is at the key, we replace it and free the old value
@@ -207,12 +535,25 @@ int Node_DictSet(Node *obj, const char *key, Node *n);
 */
 int Node_DictSetKeyVal(Node *obj, Node *kv);
 
+/**
+* Create a dict node from an array of keyval nodes, sized to hold them. That's the same as setting
+* them one by one with Node_DictSetKeyVal, only the duplicate keys are found without searching the
+* dictionary for every key.
+*/
+Node *NewDictNodeFromKeyVals(Node **kvs, uint32_t len);
+
 /**
 * Delete an item from the dict node by key. Returns OBJ_ERR if the key was
 * not found
 */
 int Node_DictDel(Node *objm, const char *key);
 
+/**
+* Delete an item from the dict node by key like Node_DictDel, but put its value into val for the
+* caller to own instead of freeing it. Returns OBJ_ERR if the key was not found
+*/
+int Node_DictTake(Node *obj, const char *key, Node **val);
+
 /**
 * Get a dict node item by key, and put it Node val's pointer.
 * Return OBJ_ERR if the key was not found. Can put NULL into val
@@ -220,17 +561,106 @@ int Node_DictDel(Node *objm, const char *key);
 */
 int Node_DictGet(Node *obj, const char *key, Node **val);
 
+/** Like Node_DictGet, but the key must be interned (see intern.h), which saves looking it up */
+int Node_DictGetInterned(Node *obj, const char *key, Node **val);
+
+/**
+* Finds the value of a key like Node_DictGet, or like Node_DictGetInterned if interned is set, but
+* returns where its keyval holds it, e.g. for Node_Own, or NULL if the dictionary doesn't have it
+*/
+Node **Node_DictGetRef(Node *obj, const char *key, int interned);
+
+/**
+* Reports the size in bytes of a dictionary's indexes, its hash index and its radix tree, or 0 if it
+* is not indexed
+*/
+size_t Node_DictIndexSize(const Node *obj);
+
+/* The type signature of callbacks that visit a dictionary's keyvals, which stop it with non-zero */
+typedef int (*NodeDictKeyVisitor)(Node *kv, void *ctx);
+
+/**
+* Calls f with the keyvals of a dictionary whose keys start with the len bytes of prefix, in the
+* bytewise order of their keys, until it returns non-zero. Dictionaries of at least
+* NodeDictTrieThreshold entries are given a radix tree of their keys for this (see dict_trie.h),
+* which is kept up to date from then on, so the scan costs the prefix's length and the keys that
+* match it rather than the dictionary's size. Smaller ones, and ones in an arena when none is set,
+* are scanned entry by entry. Returns the number of keyvals that f was called with.
+*/
+uint32_t Node_DictPrefixScan(Node *obj, const char *prefix, uint32_t len, NodeDictKeyVisitor f,
+                             void *ctx);
+
+/**
+* The bytes that the allocator holds for a node, without its children: its struct, with an inlined
+* string, and its string's, entries' or index's heap allocations each count as alloc sizes them, and
+* a key counts as its share of the interned string. Unlike the sizes that the memory usage is made
+* of, this includes the strings' NULL terminators and the allocator's rounding. What's in an arena
+* counts as its exact size when arena is set, or as nothing otherwise, for when the arena's blocks
+* are counted as a whole. Shared nodes take nothing.
+*/
+size_t Node_AllocatedSize(const Node *n, NodeAllocSizeFunc alloc, int arena);
+
+/* The number of nodes that a defragmentation walks between checks of whether it must stop */
+#define OBJECT_DEFRAG_STOP_INTERVAL 64
+
+/* The options and the counters of a defragmentation, see Node_Defrag */
+typedef struct {
+    void *(*alloc)(void *ptr, void *ctx);  // moves an allocation, or returns NULL if it stays put
+    int (*stop)(void *ctx);                // returns non-zero when the walk must stop for now
+    void *ctx;
+    size_t nodes;  // the nodes that were walked
+    size_t moved;  // the allocations that were moved, and their bytes
+    size_t bytes;
+} NodeDefragOpt;
+
+/* The place in a tree that a defragmentation stopped at, zeroed before the walk starts */
+typedef struct {
+    struct {
+        Node *node;    // the container, which is found again from the root when the walk resumes
+        uint32_t pos;  // the entry that the walk is in, or the next one for the innermost container
+    } *frames;
+    uint32_t depth, cap;
+    int started;  // set once the root was walked
+} NodeDefragCursor;
+
+/**
+* Defragments a tree for the allocator's active defragmentation, by handing the heap allocations of
+* its nodes to the options' alloc, which may move them elsewhere: the nodes' structs, strings and
+* entries, in pre-order. Pointers to the moved allocations are updated, root's included. What's in
+* an arena, static nodes, interned keys and the structs of containers with indexes that are kept
+* apart, or of nodes that several containers hold (see Node_Dedup), stay where they are.
+* The walk checks the options' stop every OBJECT_DEFRAG_STOP_INTERVAL nodes, and stops when it
+* returns non-zero, leaving the cursor at the next node. It resumes from there when called again
+* with the same cursor, even if the tree was changed meanwhile: the cursor only holds positions,
+* and those that changed at worst make the walk skip or revisit a few nodes.
+* Returns 1 when the walk is done, which resets the cursor, 0 when it stopped.
+*/
+int Node_Defrag(Node **root, NodeDefragCursor *c, NodeDefragOpt *o);
+
+/** Frees the memory of a cursor, e.g. of a tree that's freed before its walk is done */
+void NodeDefragCursor_Free(NodeDefragCursor *c);
+
 /* The type signature of visitor callbacks for node trees */
 typedef void (*NodeVisitor)(Node *, void *);
-void __objTraverse(Node *n, NodeVisitor f, void *ctx);
-void __arrTraverse(Node *n, NodeVisitor f, void *ctx);
-
 /**
-* Traverse a node recursively with a visitor callback.
+* Traverse a node with a visitor callback, in pre-order: a container before its children, which are
+* the items of arrays, the keyvals of dictionaries and the values of keyvals.
 * We will pass the provided ctx to the callback
 */
 void Node_Traverse(Node *n, NodeVisitor f, void *ctx);
 
+/**
+* Traverse a node like Node_Traverse, but visit the nodes that are shared (see Node_Dedup) and
+* their children once, rather than once for every holder, e.g. to count the memory of a tree.
+*/
+void Node_TraverseUnique(Node *n, NodeVisitor f, void *ctx);
+
+/**
+* Counts the nodes of a tree, including its nulls and the items of its packed arrays. Counting stops
+* at limit, unless it's 0, so knowing that a tree is big costs no more than that.
+*/
+size_t Node_Count(const Node *n, size_t limit);
+
 /* The type signature of serializer callbacks for node trees */
 typedef void (*NodeSerializerValue)(Node *, void *);
 typedef void (*NodeSerializerContainer)(void *);
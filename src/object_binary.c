@@ -0,0 +1,545 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "object_binary.h"
+#include "json_number.h"
+
+#define _BIN_NULL 0x00
+#define _BIN_FALSE 0x01
+#define _BIN_TRUE 0x02
+#define _BIN_INT 0x03
+#define _BIN_DOUBLE 0x04
+#define _BIN_STRING 0x05
+#define _BIN_DICT 0x06
+#define _BIN_ARRAY 0x07
+#define _BIN_INTS 0x08
+#define _BIN_DOUBLES 0x09
+#define _BIN_NUMTEXT 0x0a
+#define _BIN_SHORTSTR 0x20
+#define _BIN_SHORTSTR_MAX 0x1f
+#define _BIN_SMALLINT 0x80
+
+/* === Encoding === */
+
+/* Makes room for at least len more bytes, and returns where they go */
+static inline char *__bin_reserve(sds *buf, size_t len) {
+    if (sdsavail(*buf) < len) *buf = sdsMakeRoomFor(*buf, len > sdslen(*buf) ? len : sdslen(*buf));
+    return *buf + sdslen(*buf);
+}
+
+static inline void __bin_tag(sds *buf, unsigned char tag) {
+    *__bin_reserve(buf, 1) = tag;
+    sdsIncrLen(*buf, 1);
+}
+
+static inline void __bin_varint(sds *buf, uint64_t v) {
+    unsigned char *p = (unsigned char *)__bin_reserve(buf, 10), *start = p;
+    while (v >= 0x80) {
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    sdsIncrLen(*buf, p - start);
+}
+
+static inline void __bin_int(sds *buf, int64_t v) {
+    __bin_varint(buf, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));  // zigzag
+}
+
+static inline void __bin_double(sds *buf, double v) {
+    unsigned char *p = (unsigned char *)__bin_reserve(buf, 8);
+    uint64_t bits;
+    memcpy(&bits, &v, 8);
+    for (int i = 0; i < 8; i++) p[i] = bits >> (i * 8);
+    sdsIncrLen(*buf, 8);
+}
+
+static inline void __bin_bytes(sds *buf, const char *s, size_t len) {
+    memcpy(__bin_reserve(buf, len), s, len);
+    sdsIncrLen(*buf, len);
+}
+
+/* Encodes a value, containers only get their tag and count */
+static void __bin_value(sds *buf, const Node *n) {
+    if (!n) {
+        __bin_tag(buf, _BIN_NULL);
+        return;
+    }
+    switch (n->type) {
+        case N_NULL:
+            __bin_tag(buf, _BIN_NULL);
+            break;
+        case N_BOOLEAN:
+            __bin_tag(buf, n->value.boolval ? _BIN_TRUE : _BIN_FALSE);
+            break;
+        case N_INTEGER:
+            if (n->value.intval >= OBJECT_BINARY_SMALLINT_MIN &&
+                n->value.intval <= OBJECT_BINARY_SMALLINT_MAX) {
+                __bin_tag(buf, _BIN_SMALLINT + (n->value.intval - OBJECT_BINARY_SMALLINT_MIN));
+            } else {
+                __bin_tag(buf, _BIN_INT);
+                __bin_int(buf, n->value.intval);
+            }
+            break;
+        case N_NUMBER:
+            if (n->flags & NODE_F_NUMBER_TEXT) {
+                __bin_tag(buf, _BIN_NUMTEXT);
+                __bin_varint(buf, n->value.strval.len);
+                __bin_bytes(buf, n->value.strval.data, n->value.strval.len);
+            } else {
+                __bin_tag(buf, _BIN_DOUBLE);
+                __bin_double(buf, n->value.numval);
+            }
+            break;
+        case N_STRING: {
+            char *tmp;
+            if (n->value.strval.len <= _BIN_SHORTSTR_MAX) {
+                __bin_tag(buf, _BIN_SHORTSTR + n->value.strval.len);
+            } else {
+                __bin_tag(buf, _BIN_STRING);
+                __bin_varint(buf, n->value.strval.len);
+            }
+            __bin_bytes(buf, Node_StringData(n, &tmp), n->value.strval.len);
+            free(tmp);
+        } break;
+        case N_DICT:
+            __bin_tag(buf, _BIN_DICT);
+            __bin_varint(buf, n->value.dictval.len);
+            break;
+        case N_ARRAY:
+            __bin_tag(buf, n->flags & NODE_F_PACKED_INT
+                               ? _BIN_INTS
+                               : n->flags & NODE_F_PACKED_NUM ? _BIN_DOUBLES : _BIN_ARRAY);
+            __bin_varint(buf, n->value.arrval.len);
+            break;
+        case N_KEYVAL:  // keys are encoded by their dictionaries
+            break;
+    }
+}
+
+/* The containers that are being encoded or decoded */
+typedef struct {
+    Node *node;      // a dictionary is created when it is decoded in full, so it's NULL until then
+    uint32_t index;  // the next member or item
+    uint32_t count;  // the number of members or items
+    uint32_t start;  // the position of a decoded dictionary's first keyval on the keyval stack
+    Node *slots;     // the nodes of a decoded container's items or keyvals, see Node_SetSlot
+    uint32_t used;   // the slots that are taken
+} _BinFrame;
+
+typedef struct {
+    _BinFrame *frames;
+    uint32_t len, cap;
+} _BinStack;
+
+static inline _BinFrame *__bin_push(_BinStack *s, Node *n, uint32_t count, uint32_t start) {
+    if (s->len == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 16;
+        s->frames = realloc(s->frames, s->cap * sizeof(_BinFrame));
+    }
+    _BinFrame *f = &s->frames[s->len++];
+    f->node = n;
+    f->index = 0;
+    f->count = count;
+    f->start = start;
+    f->slots = NULL;
+    f->used = 0;
+    return f;
+}
+
+void SerializeNodeToBinary(const Node *node, sds *buf) {
+    _BinStack stack = {0};
+
+    __bin_value(buf, node);
+    if (node && (N_DICT == node->type || N_ARRAY == node->type))
+        __bin_push(&stack, (Node *)node, 0, 0);
+
+    while (stack.len) {
+        _BinFrame *f = &stack.frames[stack.len - 1];
+        Node *n = f->node, *sub;
+
+        if (N_DICT == n->type) {
+            if (f->index == n->value.dictval.len) {
+                stack.len--;
+                continue;
+            }
+            Node *kv = n->value.dictval.entries[f->index++];
+            const char *key = kv->value.kvval.key;
+            uint32_t keylen = Intern_Len(key);
+            __bin_varint(buf, keylen);
+            __bin_bytes(buf, key, keylen);
+            sub = kv->value.kvval.val;
+        } else if (n->flags & NODE_F_PACKED) {  // the items are encoded without tags
+            Node tmp, *item;
+            for (uint32_t i = 0; i < n->value.arrval.len; i++) {
+                Node_ArrayItemView(n, i, &tmp, &item);
+                if (N_INTEGER == item->type) __bin_int(buf, item->value.intval);
+                else __bin_double(buf, item->value.numval);
+            }
+            stack.len--;
+            continue;
+        } else {
+            if (f->index == n->value.arrval.len) {
+                stack.len--;
+                continue;
+            }
+            sub = n->value.arrval.entries[f->index++];
+        }
+
+        __bin_value(buf, sub);
+        if (sub && (N_DICT == sub->type || N_ARRAY == sub->type)) __bin_push(&stack, sub, 0, 0);
+    }
+    free(stack.frames);
+}
+
+/* === Decoding === */
+
+static inline int __bin_readvarint(BinaryReader *r, uint64_t *v) {
+    uint64_t val = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (r->p == r->end) return 0;
+        unsigned char c = *r->p++;
+        val |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *v = val;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static inline int __bin_readint(BinaryReader *r, int64_t *v) {
+    uint64_t u;
+    if (!__bin_readvarint(r, &u)) return 0;
+    *v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+    return 1;
+}
+
+static inline int __bin_readdouble(BinaryReader *r, double *v) {
+    uint64_t bits = 0;
+    if (r->end - r->p < 8) return 0;
+    for (int i = 0; i < 8; i++) bits |= (uint64_t)r->p[i] << (i * 8);
+    memcpy(v, &bits, 8);
+    r->p += 8;
+    return 1;
+}
+
+/* Reads a length that must fit in a node, and leave that many bytes (at least) in the buffer */
+static inline int __bin_readlen(BinaryReader *r, uint32_t *len) {
+    uint64_t v;
+    if (!__bin_readvarint(r, &v) || v > UINT32_MAX || v > (uint64_t)(r->end - r->p)) return 0;
+    *len = v;
+    return 1;
+}
+
+void BinaryReader_Init(BinaryReader *r, const char *buf, size_t len) {
+    r->p = (const unsigned char *)buf;
+    r->end = r->p + len;
+    r->packed = 0;
+    r->packedtag = 0;
+}
+
+int BinaryReader_Read(BinaryReader *r, Node *n) {
+    uint32_t len;
+
+    n->flags = 0;
+    if (r->packed) {  // the items of packed arrays have no tags
+        r->packed--;
+        if (_BIN_INTS == r->packedtag) {
+            n->type = N_INTEGER;
+            return __bin_readint(r, &n->value.intval) ? OBJ_OK : OBJ_ERR;
+        }
+        n->type = N_NUMBER;
+        return __bin_readdouble(r, &n->value.numval) ? OBJ_OK : OBJ_ERR;
+    }
+
+    if (r->p == r->end) return OBJ_ERR;
+    unsigned char tag = *r->p++;
+    if (tag >= _BIN_SMALLINT) {
+        n->type = N_INTEGER;
+        n->value.intval = (int64_t)(tag - _BIN_SMALLINT) + OBJECT_BINARY_SMALLINT_MIN;
+        return OBJ_OK;
+    }
+    if (tag >= _BIN_SHORTSTR && tag <= _BIN_SHORTSTR + _BIN_SHORTSTR_MAX) {
+        len = tag - _BIN_SHORTSTR;
+        if ((size_t)(r->end - r->p) < len) return OBJ_ERR;
+        n->type = N_STRING;
+        n->value.strval.data = (const char *)r->p;
+        n->value.strval.len = len;
+        r->p += len;
+        return OBJ_OK;
+    }
+    switch (tag) {
+        case _BIN_NULL:
+            n->type = N_NULL;
+            return OBJ_OK;
+        case _BIN_FALSE:
+        case _BIN_TRUE:
+            n->type = N_BOOLEAN;
+            n->value.boolval = _BIN_TRUE == tag;
+            return OBJ_OK;
+        case _BIN_INT:
+            n->type = N_INTEGER;
+            return __bin_readint(r, &n->value.intval) ? OBJ_OK : OBJ_ERR;
+        case _BIN_DOUBLE:
+            n->type = N_NUMBER;
+            return __bin_readdouble(r, &n->value.numval) ? OBJ_OK : OBJ_ERR;
+        case _BIN_NUMTEXT:
+            // the text is written as it is, so it must be a number
+            if (!__bin_readlen(r, &len) || !JSON_IsNumber((const char *)r->p, len) ||
+                !JSON_NumberInRange((const char *)r->p, len))
+                return OBJ_ERR;
+            n->type = N_NUMBER;
+            n->flags = NODE_F_NUMBER_TEXT;
+            n->value.strval.data = (const char *)r->p;
+            n->value.strval.len = len;
+            r->p += len;
+            return OBJ_OK;
+        case _BIN_STRING:
+            if (!__bin_readlen(r, &len)) return OBJ_ERR;
+            n->type = N_STRING;
+            n->value.strval.data = (const char *)r->p;
+            n->value.strval.len = len;
+            r->p += len;
+            return OBJ_OK;
+        case _BIN_DICT:
+            // every member takes at least two bytes, which bounds the count
+            if (!__bin_readlen(r, &len)) return OBJ_ERR;
+            n->type = N_DICT;
+            n->value.dictval = (t_dict){NULL, len, 0};
+            return OBJ_OK;
+        case _BIN_ARRAY:
+        case _BIN_INTS:
+        case _BIN_DOUBLES:
+            if (!__bin_readlen(r, &len)) return OBJ_ERR;
+            n->type = N_ARRAY;
+            n->value.arrval = (t_array){NULL, len, 0};
+            if (_BIN_ARRAY != tag) {
+                n->flags = _BIN_INTS == tag ? NODE_F_PACKED_INT : NODE_F_PACKED_NUM;
+                r->packed = len;
+                r->packedtag = tag;
+            }
+            return OBJ_OK;
+        default:
+            return OBJ_ERR;
+    }
+}
+
+int BinaryReader_ReadKey(BinaryReader *r, const char **key, uint32_t *len) {
+    if (!__bin_readlen(r, len)) return OBJ_ERR;
+    *key = (const char *)r->p;
+    r->p += *len;
+    return OBJ_OK;
+}
+
+/* The depth of containers that ValidateBinary tracks without allocating */
+#define _BIN_VALIDATE_INLINE_DEPTH 32
+
+int ValidateBinary(const char *buf, size_t len) {
+    BinaryReader r;
+    // the members or items left in every open container, shifted left by one for a dictionary flag
+    uint64_t inlined[_BIN_VALIDATE_INLINE_DEPTH], *stack = inlined;
+    uint32_t depth = 0, cap = _BIN_VALIDATE_INLINE_DEPTH;
+    int ret = OBJ_ERR;
+
+    BinaryReader_Init(&r, buf, len);
+    do {
+        if (depth) {
+            uint64_t *f = &stack[depth - 1];
+            if (*f < 2) {  // the container is complete
+                depth--;
+                continue;
+            }
+            *f -= 2;
+            const char *key;
+            uint32_t keylen;
+            if ((*f & 1) && OBJ_OK != BinaryReader_ReadKey(&r, &key, &keylen)) goto done;
+        }
+
+        // the items of packed arrays are read like any other, without tags
+        Node v;
+        if (OBJ_OK != BinaryReader_Read(&r, &v)) goto done;
+        uint32_t count = N_DICT == v.type ? v.value.dictval.len
+                                          : N_ARRAY == v.type ? v.value.arrval.len : 0;
+        if (!count) continue;
+        if (depth == cap) {
+            cap *= 2;
+            if (stack == inlined) {
+                stack = malloc(cap * sizeof(uint64_t));
+                memcpy(stack, inlined, sizeof(inlined));
+            } else {
+                stack = realloc(stack, cap * sizeof(uint64_t));
+            }
+        }
+        stack[depth++] = (uint64_t)count << 1 | (N_DICT == v.type);
+    } while (depth);
+    if (r.p == r.end) ret = OBJ_OK;
+
+done:
+    if (stack != inlined) free(stack);
+    return ret;
+}
+
+/**
+* Reads a value. A dictionary or array with members or items sets their count, and only arrays are
+* created right away. Packed arrays are read in full. The value's node takes the slot that's set,
+* unless it's a dictionary with members.
+*/
+static int __bin_readvalue(BinaryReader *r, Node **n, uint32_t *count, int *isdict) {
+    Node v;
+
+    *count = 0;
+    *isdict = 0;
+    if (OBJ_OK != BinaryReader_Read(r, &v)) return 0;
+    switch (v.type) {
+        case N_NULL:
+            *n = NULL;
+            return 1;
+        case N_BOOLEAN:
+            *n = NewBoolNode(v.value.boolval);
+            return 1;
+        case N_INTEGER:
+            *n = NewIntNode(v.value.intval);
+            return 1;
+        case N_NUMBER:
+            *n = v.flags & NODE_F_NUMBER_TEXT
+                     ? NewNumberTextNode(v.value.strval.data, v.value.strval.len)
+                     : NewDoubleNode(v.value.numval);
+            return 1;
+        case N_STRING:
+            *n = NewStringNode(v.value.strval.data, v.value.strval.len);
+            return 1;
+        case N_DICT:
+            *count = v.value.dictval.len;
+            *isdict = 1;
+            *n = *count ? NULL : NewDictNode(0);
+            return 1;
+        case N_ARRAY:
+            *n = NewArrayNode(v.value.arrval.len);
+            if (!(v.flags & NODE_F_PACKED)) {
+                *count = v.value.arrval.len;
+                return 1;
+            }
+            for (uint32_t j = 0; j < v.value.arrval.len; j++) {
+                Node item;
+                if (OBJ_OK != BinaryReader_Read(r, &item)) {
+                    Node_Free(*n);
+                    return 0;
+                }
+                if (N_INTEGER == item.type) Node_ArrayAppendInt(*n, item.value.intval);
+                else Node_ArrayAppendDouble(*n, item.value.numval);
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int CreateNodeFromBinary(const char *buf, size_t len, Node **node) {
+    BinaryReader r;
+    _BinStack stack = {0};
+    Node **kvs = NULL;  // the members of the dictionaries that are being decoded
+    uint32_t nkvs = 0, capkvs = 0;
+    Node *root = NULL, *n;
+    uint32_t count;
+    int isdict;
+
+    BinaryReader_Init(&r, buf, len);
+    if (!__bin_readvalue(&r, &n, &count, &isdict)) return OBJ_ERR;
+    // a container's items or keyvals are laid out in a block, see Node_SetSlot
+    if (count) {
+        __bin_push(&stack, n, count, 0)->slots = NodeArena_AllocSlots(count);
+    } else {
+        root = n;
+    }
+
+    while (stack.len) {
+        _BinFrame *f = &stack.frames[stack.len - 1];
+
+        if (f->index == f->count) {  // the container is complete
+            n = f->node;
+            stack.len--;
+            _BinFrame *parent = stack.len ? &stack.frames[stack.len - 1] : NULL;
+            if (!n) {
+                // a dictionary that's an array's item takes its slot now
+                Node *slot = NULL;
+                if (parent && parent->node && parent->slots) slot = &parent->slots[parent->used];
+                Node_SetSlot(slot);
+                n = NewDictNodeFromKeyVals(kvs + f->start, nkvs - f->start);
+                if (slot && !Node_SetSlot(NULL)) parent->used++;
+                nkvs = f->start;
+            }
+            if (!parent) {
+                root = n;
+            } else if (parent->node) {
+                Node_ArrayAppend(parent->node, n);
+            } else {
+                kvs[nkvs - 1]->value.kvval.val = n;
+            }
+            continue;
+        }
+        f->index++;
+
+        Node *slot = f->slots ? &f->slots[f->used] : NULL;
+
+        Node *kv = NULL;
+        if (!f->node) {  // a dictionary member's key
+            const char *key;
+            uint32_t keylen;
+            if (OBJ_OK != BinaryReader_ReadKey(&r, &key, &keylen)) goto error;
+            Node_SetSlot(slot);
+            kv = NewKeyValNode(key, keylen, NULL);
+            if (slot && !Node_SetSlot(NULL)) f->used++;
+            slot = NULL;
+            if (nkvs == capkvs) {
+                capkvs = capkvs ? capkvs * 2 : 64;
+                kvs = realloc(kvs, capkvs * sizeof(Node *));
+            }
+            kvs[nkvs++] = kv;
+        }
+        // f isn't valid from here on, as pushing may move the frames
+        Node *c = f->node;
+        Node_SetSlot(slot);
+        int ok = __bin_readvalue(&r, &n, &count, &isdict);
+        if (slot && !Node_SetSlot(NULL)) stack.frames[stack.len - 1].used++;
+        if (!ok) goto error;
+        if (count) {
+            __bin_push(&stack, n, count, nkvs)->slots = NodeArena_AllocSlots(count);
+        } else if (kv) {
+            kv->value.kvval.val = n;
+        } else {
+            Node_ArrayAppend(c, n);
+        }
+    }
+    if (r.p != r.end) goto error;
+
+    free(stack.frames);
+    free(kvs);
+    *node = root;
+    return OBJ_OK;
+
+error:
+    // the open arrays are in the frames and the open dictionaries' members on the keyval stack,
+    // and neither holds anything but complete values
+    for (uint32_t i = 0; i < stack.len; i++) Node_Free(stack.frames[i].node);
+    for (uint32_t i = 0; i < nkvs; i++) Node_Free(kvs[i]);
+    Node_Free(root);
+    free(stack.frames);
+    free(kvs);
+    return OBJ_ERR;
+}
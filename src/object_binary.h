@@ -0,0 +1,85 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __OBJECT_BINARY_H__
+#define __OBJECT_BINARY_H__
+
+#include <sds.h>
+#include "object.h"
+
+/**
+* A compact binary encoding of node trees, which is what the RDB stores since encoding version 1.
+* Every value starts with a 1-byte tag, and lengths, counts and integers are varints (integers are
+* zigzag encoded), so small values take a byte or two:
+*
+*   0x00 null, 0x01 false, 0x02 true
+*   0x03 integer: varint
+*   0x04 double: 8 bytes, little endian
+*   0x05 string: varint length, bytes
+*   0x06 dictionary: varint count, then a varint key length, the key and the value per member
+*   0x07 array: varint count, values
+*   0x08 packed integer array: varint count, varints
+*   0x09 packed double array: varint count, 8 bytes per double
+*   0x0a number kept as its JSON text (since encoding version 4): varint length, bytes
+*   0x20 - 0x3f string of length (tag - 0x20), bytes
+*   0x80 - 0xff integer (tag - 0x80 + OBJECT_BINARY_SMALLINT_MIN)
+*/
+
+#define OBJECT_BINARY_SMALLINT_MIN -16
+#define OBJECT_BINARY_SMALLINT_MAX 111
+
+/** Appends the binary encoding of a node and its children to buf */
+void SerializeNodeToBinary(const Node *node, sds *buf);
+
+/**
+* Creates a node from its binary encoding, that must take up exactly len bytes.
+* Returns OBJ_OK, or OBJ_ERR if the encoding is invalid.
+*/
+int CreateNodeFromBinary(const char *buf, size_t len, Node **node);
+
+/**
+* Checks that len bytes of buf are exactly a binary encoding that CreateNodeFromBinary loads,
+* without creating its nodes. Returns OBJ_OK, or OBJ_ERR if the encoding is invalid.
+*/
+int ValidateBinary(const char *buf, size_t len);
+
+/**
+* A reader of the values of a binary encoding in the order they're encoded, that creates no nodes,
+* so unlike CreateNodeFromBinary it can be used on another thread than the one that owns the nodes.
+*/
+typedef struct {
+    const unsigned char *p, *end;
+    uint32_t packed;          // the number of items left to read in a packed array
+    unsigned char packedtag;  // the tag of that array
+} BinaryReader;
+
+/** Sets up a reader of the len bytes of buf */
+void BinaryReader_Init(BinaryReader *r, const char *buf, size_t len);
+
+/**
+* Reads the next value into n, a null as an N_NULL node, and a string or a number's text (see
+* NODE_F_NUMBER_TEXT) that points into the buffer.
+* A dictionary or an array has the number of its members or items as its length and no entries, and
+* they are read next, with every dictionary member's key read by BinaryReader_ReadKey before its
+* value. Returns OBJ_OK, or OBJ_ERR if the encoding is invalid.
+*/
+int BinaryReader_Read(BinaryReader *r, Node *n);
+
+/** Reads a dictionary member's key, that points into the buffer and isn't NULL terminated */
+int BinaryReader_ReadKey(BinaryReader *r, const char **key, uint32_t *len);
+
+#endif
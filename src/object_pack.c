@@ -0,0 +1,560 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "object_pack.h"
+
+/* MessagePack's types, and the first byte of those that hold their value or length in it */
+#define _MP_FIXMAP 0x80
+#define _MP_FIXARRAY 0x90
+#define _MP_FIXSTR 0xa0
+#define _MP_NIL 0xc0
+#define _MP_FALSE 0xc2
+#define _MP_TRUE 0xc3
+#define _MP_BIN8 0xc4
+#define _MP_BIN16 0xc5
+#define _MP_BIN32 0xc6
+#define _MP_FLOAT32 0xca
+#define _MP_FLOAT64 0xcb
+#define _MP_UINT8 0xcc
+#define _MP_UINT16 0xcd
+#define _MP_UINT32 0xce
+#define _MP_UINT64 0xcf
+#define _MP_INT8 0xd0
+#define _MP_INT16 0xd1
+#define _MP_INT32 0xd2
+#define _MP_INT64 0xd3
+#define _MP_STR8 0xd9
+#define _MP_STR16 0xda
+#define _MP_STR32 0xdb
+#define _MP_ARRAY16 0xdc
+#define _MP_ARRAY32 0xdd
+#define _MP_MAP16 0xde
+#define _MP_MAP32 0xdf
+#define _MP_NEGFIXINT 0xe0
+
+/* CBOR's major types, and the simple values and floats of major type 7 */
+#define _CBOR_UINT 0
+#define _CBOR_NEGINT 1
+#define _CBOR_BYTES 2
+#define _CBOR_TEXT 3
+#define _CBOR_ARRAY 4
+#define _CBOR_MAP 5
+#define _CBOR_TAG 6
+#define _CBOR_SIMPLE 7
+#define _CBOR_INDEFINITE 31
+#define _CBOR_FALSE 0xf4
+#define _CBOR_TRUE 0xf5
+#define _CBOR_NULL 0xf6
+#define _CBOR_HALF 0xf9
+#define _CBOR_FLOAT 0xfa
+#define _CBOR_DOUBLE 0xfb
+#define _CBOR_BREAK 0xff
+
+const char *Pack_FormatName(PackFormat format) {
+    return PACK_CBOR == format ? "CBOR" : "MessagePack";
+}
+
+/* === Encoding === */
+
+/* Makes room for at least len more bytes, and returns where they go */
+static inline char *__pack_reserve(sds *buf, size_t len) {
+    if (sdsavail(*buf) < len) *buf = sdsMakeRoomFor(*buf, len > sdslen(*buf) ? len : sdslen(*buf));
+    return *buf + sdslen(*buf);
+}
+
+/* Appends a byte followed by the size lowest bytes of v in big endian order */
+static inline void __pack_head(sds *buf, unsigned char c, uint64_t v, int size) {
+    unsigned char *p = (unsigned char *)__pack_reserve(buf, 9);
+    *p++ = c;
+    for (int i = size - 1; i >= 0; i--) *p++ = v >> (i * 8);
+    sdsIncrLen(*buf, size + 1);
+}
+
+static inline void __pack_bytes(sds *buf, const char *s, size_t len) {
+    memcpy(__pack_reserve(buf, len), s, len);
+    sdsIncrLen(*buf, len);
+}
+
+static inline uint64_t __pack_doublebits(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, 8);
+    return bits;
+}
+
+static void __mp_int(sds *buf, int64_t v) {
+    if (v >= 0) {
+        if (v < 0x80) __pack_head(buf, v, 0, 0);
+        else if (v <= UINT8_MAX) __pack_head(buf, _MP_UINT8, v, 1);
+        else if (v <= UINT16_MAX) __pack_head(buf, _MP_UINT16, v, 2);
+        else if (v <= UINT32_MAX) __pack_head(buf, _MP_UINT32, v, 4);
+        else __pack_head(buf, _MP_UINT64, v, 8);
+    } else {
+        if (v >= -32) __pack_head(buf, (unsigned char)v, 0, 0);
+        else if (v >= INT8_MIN) __pack_head(buf, _MP_INT8, (uint64_t)v, 1);
+        else if (v >= INT16_MIN) __pack_head(buf, _MP_INT16, (uint64_t)v, 2);
+        else if (v >= INT32_MIN) __pack_head(buf, _MP_INT32, (uint64_t)v, 4);
+        else __pack_head(buf, _MP_INT64, (uint64_t)v, 8);
+    }
+}
+
+/* Appends a length, in the first byte up to fixmax, or after the type of its size. Arrays and maps
+ * have no 1-byte lengths, that t8 is 0 for. */
+static void __mp_len(sds *buf, uint32_t len, unsigned char fix, uint32_t fixmax, unsigned char t8,
+                     unsigned char t16, unsigned char t32) {
+    if (len <= fixmax) __pack_head(buf, fix | len, 0, 0);
+    else if (t8 && len <= UINT8_MAX) __pack_head(buf, t8, len, 1);
+    else if (len <= UINT16_MAX) __pack_head(buf, t16, len, 2);
+    else __pack_head(buf, t32, len, 4);
+}
+
+/* Appends a CBOR head, the major type and its argument */
+static void __cbor_head(sds *buf, int major, uint64_t v) {
+    unsigned char m = major << 5;
+    if (v < 24) __pack_head(buf, m | v, 0, 0);
+    else if (v <= UINT8_MAX) __pack_head(buf, m | 24, v, 1);
+    else if (v <= UINT16_MAX) __pack_head(buf, m | 25, v, 2);
+    else if (v <= UINT32_MAX) __pack_head(buf, m | 26, v, 4);
+    else __pack_head(buf, m | 27, v, 8);
+}
+
+void Pack_BeginDict(PackFormat format, uint32_t len, sds *buf) {
+    if (PACK_CBOR == format) __cbor_head(buf, _CBOR_MAP, len);
+    else __mp_len(buf, len, _MP_FIXMAP, 15, 0, _MP_MAP16, _MP_MAP32);
+}
+
+void Pack_BeginArray(PackFormat format, uint32_t len, sds *buf) {
+    if (PACK_CBOR == format) __cbor_head(buf, _CBOR_ARRAY, len);
+    else __mp_len(buf, len, _MP_FIXARRAY, 15, 0, _MP_ARRAY16, _MP_ARRAY32);
+}
+
+void Pack_String(PackFormat format, const char *s, size_t len, sds *buf) {
+    if (PACK_CBOR == format) __cbor_head(buf, _CBOR_TEXT, len);
+    else __mp_len(buf, len, _MP_FIXSTR, 31, _MP_STR8, _MP_STR16, _MP_STR32);
+    __pack_bytes(buf, s, len);
+}
+
+typedef struct {
+    sds *buf;
+    PackFormat format;
+} _PackEncoder;
+
+/* Encodes a value, containers only get their lengths as their items follow */
+static void _Pack_Begin(Node *n, void *ctx) {
+    _PackEncoder *e = ctx;
+    int cbor = PACK_CBOR == e->format;
+
+    if (!n) {
+        __pack_head(e->buf, cbor ? _CBOR_NULL : _MP_NIL, 0, 0);
+        return;
+    }
+    switch (n->type) {
+        case N_NULL:
+            __pack_head(e->buf, cbor ? _CBOR_NULL : _MP_NIL, 0, 0);
+            break;
+        case N_BOOLEAN:
+            if (cbor) __pack_head(e->buf, n->value.boolval ? _CBOR_TRUE : _CBOR_FALSE, 0, 0);
+            else __pack_head(e->buf, n->value.boolval ? _MP_TRUE : _MP_FALSE, 0, 0);
+            break;
+        case N_INTEGER:
+            if (!cbor) __mp_int(e->buf, n->value.intval);
+            else if (n->value.intval >= 0) __cbor_head(e->buf, _CBOR_UINT, n->value.intval);
+            else __cbor_head(e->buf, _CBOR_NEGINT, ~(uint64_t)n->value.intval);  // -1 - intval
+            break;
+        case N_NUMBER:
+            __pack_head(e->buf, cbor ? _CBOR_DOUBLE : _MP_FLOAT64,
+                        __pack_doublebits(Node_Number(n)), 8);
+            break;
+        case N_STRING: {
+            char *tmp;
+            Pack_String(e->format, Node_StringData(n, &tmp), n->value.strval.len, e->buf);
+            free(tmp);
+        } break;
+        case N_KEYVAL:
+            Pack_String(e->format, n->value.kvval.key, Intern_Len(n->value.kvval.key), e->buf);
+            break;
+        case N_DICT:
+            Pack_BeginDict(e->format, n->value.dictval.len, e->buf);
+            break;
+        case N_ARRAY:
+            Pack_BeginArray(e->format, n->value.arrval.len, e->buf);
+            break;
+    }
+}
+
+void SerializeNodeToPack(const Node *node, PackFormat format, sds *buf) {
+    _PackEncoder e = {buf, format};
+    NodeSerializerOpt nso = {0};
+
+    nso.fBegin = _Pack_Begin;
+    nso.xBegin = 0xff;  // mask for all basic types
+    Node_Serializer(node, &nso, &e);
+}
+
+/* === Decoding === */
+
+typedef struct {
+    const unsigned char *start, *p, *end;
+    const unsigned char *mark;  // the beginning of the value that's read
+    PackFormat format;
+    const char *err;  // what's wrong with the value at the mark
+} _PackReader;
+
+/* The length of CBOR's arrays and maps that end with a break */
+#define _PACK_INDEFINITE UINT32_MAX
+
+#define _PACK_FAIL(r, msg) \
+    do {                   \
+        (r)->err = (msg);  \
+        return 0;          \
+    } while (0)
+
+static inline int __pack_readbe(_PackReader *r, int size, uint64_t *v) {
+    if (r->end - r->p < size) _PACK_FAIL(r, "unexpected end");
+    uint64_t val = 0;
+    for (int i = 0; i < size; i++) val = (val << 8) | *r->p++;
+    *v = val;
+    return 1;
+}
+
+static inline int __pack_setint(Node *n, int64_t v) {
+    n->type = N_INTEGER;
+    n->value.intval = v;
+    return 1;
+}
+
+static inline int __pack_setnum(_PackReader *r, Node *n, double v) {
+    if (!isfinite(v)) _PACK_FAIL(r, "numbers must be finite");
+    n->type = N_NUMBER;
+    n->value.numval = v;
+    return 1;
+}
+
+static inline int __pack_setstr(_PackReader *r, Node *n, uint64_t len) {
+    if (len > (uint64_t)(r->end - r->p) || len > UINT32_MAX) _PACK_FAIL(r, "unexpected end");
+    n->type = N_STRING;
+    n->value.strval.data = (const char *)r->p;
+    n->value.strval.len = len;
+    r->p += len;
+    return 1;
+}
+
+/* Sets a dictionary's or an array's length, which every member or item taking at least a byte
+ * bounds */
+static inline int __pack_setcontainer(_PackReader *r, Node *n, NodeType type, uint64_t len) {
+    if (_PACK_INDEFINITE != len && len > (uint64_t)(r->end - r->p)) _PACK_FAIL(r, "unexpected end");
+    n->type = type;
+    if (N_DICT == type) n->value.dictval = (t_dict){NULL, len, 0};
+    else n->value.arrval = (t_array){NULL, len, 0};
+    return 1;
+}
+
+static inline double __pack_float(uint64_t bits) {
+    uint32_t b = bits;
+    float f;
+    memcpy(&f, &b, 4);
+    return f;
+}
+
+static inline double __pack_double(uint64_t bits) {
+    double d;
+    memcpy(&d, &bits, 8);
+    return d;
+}
+
+static double __cbor_half(uint64_t h) {
+    int exp = (h >> 10) & 0x1f, mant = h & 0x3ff;
+    double val = !exp ? ldexp(mant, -24) : 31 != exp ? ldexp(mant + 1024, exp - 25) : INFINITY;
+    return h & 0x8000 ? -val : val;
+}
+
+static int __mp_read(_PackReader *r, Node *n) {
+    uint64_t v;
+    unsigned char tag = *r->p++;
+
+    if (tag < _MP_FIXMAP) return __pack_setint(n, tag);
+    if (tag >= _MP_NEGFIXINT) return __pack_setint(n, (int8_t)tag);
+    if (tag < _MP_FIXARRAY) return __pack_setcontainer(r, n, N_DICT, tag & 0x0f);
+    if (tag < _MP_FIXSTR) return __pack_setcontainer(r, n, N_ARRAY, tag & 0x0f);
+    if (tag < _MP_NIL) return __pack_setstr(r, n, tag & 0x1f);
+    switch (tag) {
+        case _MP_NIL:
+            n->type = N_NULL;
+            return 1;
+        case _MP_FALSE:
+        case _MP_TRUE:
+            n->type = N_BOOLEAN;
+            n->value.boolval = _MP_TRUE == tag;
+            return 1;
+        case _MP_FLOAT32:
+            return __pack_readbe(r, 4, &v) && __pack_setnum(r, n, __pack_float(v));
+        case _MP_FLOAT64:
+            return __pack_readbe(r, 8, &v) && __pack_setnum(r, n, __pack_double(v));
+        case _MP_UINT8:
+        case _MP_UINT16:
+        case _MP_UINT32:
+        case _MP_UINT64:
+            if (!__pack_readbe(r, 1 << (tag - _MP_UINT8), &v)) return 0;
+            if (v > INT64_MAX) _PACK_FAIL(r, "integer out of range");
+            return __pack_setint(n, v);
+        case _MP_INT8:
+            return __pack_readbe(r, 1, &v) && __pack_setint(n, (int8_t)v);
+        case _MP_INT16:
+            return __pack_readbe(r, 2, &v) && __pack_setint(n, (int16_t)v);
+        case _MP_INT32:
+            return __pack_readbe(r, 4, &v) && __pack_setint(n, (int32_t)v);
+        case _MP_INT64:
+            return __pack_readbe(r, 8, &v) && __pack_setint(n, (int64_t)v);
+        case _MP_STR8:
+        case _MP_BIN8:
+            return __pack_readbe(r, 1, &v) && __pack_setstr(r, n, v);
+        case _MP_STR16:
+        case _MP_BIN16:
+            return __pack_readbe(r, 2, &v) && __pack_setstr(r, n, v);
+        case _MP_STR32:
+        case _MP_BIN32:
+            return __pack_readbe(r, 4, &v) && __pack_setstr(r, n, v);
+        case _MP_ARRAY16:
+        case _MP_ARRAY32:
+        case _MP_MAP16:
+        case _MP_MAP32:
+            if (!__pack_readbe(r, _MP_ARRAY16 == tag || _MP_MAP16 == tag ? 2 : 4, &v)) return 0;
+            if (v >= _PACK_INDEFINITE) _PACK_FAIL(r, "unexpected end");
+            return __pack_setcontainer(r, n, tag < _MP_MAP16 ? N_ARRAY : N_DICT, v);
+        default:  // extension types, and the type that's never used
+            _PACK_FAIL(r, "unsupported type");
+    }
+}
+
+static int __cbor_read(_PackReader *r, Node *n) {
+    for (;;) {  // tags only describe the value that follows them
+        unsigned char ib = *r->p++, major = ib >> 5, info = ib & 0x1f;
+        uint64_t v = info;
+
+        if (_CBOR_SIMPLE == major) {
+            switch (ib) {
+                case _CBOR_NULL:
+                    n->type = N_NULL;
+                    return 1;
+                case _CBOR_FALSE:
+                case _CBOR_TRUE:
+                    n->type = N_BOOLEAN;
+                    n->value.boolval = _CBOR_TRUE == ib;
+                    return 1;
+                case _CBOR_HALF:
+                    return __pack_readbe(r, 2, &v) && __pack_setnum(r, n, __cbor_half(v));
+                case _CBOR_FLOAT:
+                    return __pack_readbe(r, 4, &v) && __pack_setnum(r, n, __pack_float(v));
+                case _CBOR_DOUBLE:
+                    return __pack_readbe(r, 8, &v) && __pack_setnum(r, n, __pack_double(v));
+                case _CBOR_BREAK:
+                    _PACK_FAIL(r, "unexpected break");
+                default:  // undefined and the other simple values
+                    _PACK_FAIL(r, "unsupported type");
+            }
+        }
+        if (_CBOR_INDEFINITE == info) {
+            if (_CBOR_ARRAY == major) return __pack_setcontainer(r, n, N_ARRAY, _PACK_INDEFINITE);
+            if (_CBOR_MAP == major) return __pack_setcontainer(r, n, N_DICT, _PACK_INDEFINITE);
+            _PACK_FAIL(r, "unsupported indefinite length");
+        }
+        if (info > 27) _PACK_FAIL(r, "invalid length");
+        if (info >= 24 && !__pack_readbe(r, 1 << (info - 24), &v)) return 0;
+
+        switch (major) {
+            case _CBOR_UINT:
+                if (v > INT64_MAX) _PACK_FAIL(r, "integer out of range");
+                return __pack_setint(n, v);
+            case _CBOR_NEGINT:
+                if (v > INT64_MAX) _PACK_FAIL(r, "integer out of range");
+                return __pack_setint(n, -1 - (int64_t)v);
+            case _CBOR_BYTES:
+            case _CBOR_TEXT:
+                return __pack_setstr(r, n, v);
+            case _CBOR_ARRAY:
+                if (v >= _PACK_INDEFINITE) _PACK_FAIL(r, "unexpected end");
+                return __pack_setcontainer(r, n, N_ARRAY, v);
+            case _CBOR_MAP:
+                if (v >= _PACK_INDEFINITE) _PACK_FAIL(r, "unexpected end");
+                return __pack_setcontainer(r, n, N_DICT, v);
+            default:  // a tag
+                if (r->p == r->end) _PACK_FAIL(r, "unexpected end");
+        }
+    }
+}
+
+/* Reads the next value into n like BinaryReader_Read: a string points into the buffer, and a
+ * dictionary or an array has the number of its members or items as its length */
+static int __pack_read(_PackReader *r, Node *n) {
+    r->mark = r->p;
+    n->flags = 0;
+    if (r->p == r->end) _PACK_FAIL(r, "unexpected end");
+    return PACK_CBOR == r->format ? __cbor_read(r, n) : __mp_read(r, n);
+}
+
+/* The containers that are being decoded, like the binary encoding's */
+typedef struct {
+    Node *node;      // a dictionary is created when it is decoded in full, so it's NULL until then
+    uint32_t index;  // the next member or item
+    uint32_t count;  // the number of members or items, or _PACK_INDEFINITE
+    uint32_t start;  // the position of a dictionary's first keyval on the keyval stack
+} _PackFrame;
+
+typedef struct {
+    _PackFrame *frames;
+    uint32_t len, cap;
+} _PackStack;
+
+static inline void __pack_push(_PackStack *s, Node *n, uint32_t count, uint32_t start) {
+    if (s->len == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 16;
+        s->frames = realloc(s->frames, s->cap * sizeof(_PackFrame));
+    }
+    _PackFrame *f = &s->frames[s->len++];
+    f->node = n;
+    f->index = 0;
+    f->count = count;
+    f->start = start;
+}
+
+int CreateNodeFromPack(const char *buf, size_t len, PackFormat format, Node **node, char **err) {
+    _PackReader r = {(const unsigned char *)buf, (const unsigned char *)buf,
+                     (const unsigned char *)buf + len, (const unsigned char *)buf, format, NULL};
+    _PackStack stack = {0};
+    Node **kvs = NULL;  // the members of the dictionaries that are being decoded
+    uint32_t nkvs = 0, capkvs = 0;
+    Node *root = NULL, *n, v;
+    int done = 0;
+
+    while (!done) {
+        _PackFrame *f = stack.len ? &stack.frames[stack.len - 1] : NULL;
+        Node *kv = NULL, *c = NULL;
+
+        if (f) {
+            // an indefinite length ends with a break where the next member or item would be
+            int complete = f->index == f->count;
+            if (_PACK_INDEFINITE == f->count && r.p < r.end && _CBOR_BREAK == *r.p) {
+                r.p++;
+                complete = 1;
+            }
+            if (complete) {
+                n = f->node;
+                if (!n) {
+                    n = NewDictNodeFromKeyVals(kvs + f->start, nkvs - f->start);
+                    nkvs = f->start;
+                }
+                if (--stack.len) {
+                    _PackFrame *parent = &stack.frames[stack.len - 1];
+                    if (parent->node) Node_ArrayAppend(parent->node, n);
+                    else kvs[nkvs - 1]->value.kvval.val = n;
+                } else {
+                    root = n;
+                    done = 1;
+                }
+                continue;
+            }
+            f->index++;
+
+            if (!f->node) {  // a dictionary member's key
+                if (!__pack_read(&r, &v)) goto error;
+                if (N_STRING != v.type) {
+                    r.err = "map keys must be strings";
+                    goto error;
+                }
+                kv = NewKeyValNode(v.value.strval.data, v.value.strval.len, NULL);
+                if (nkvs == capkvs) {
+                    capkvs = capkvs ? capkvs * 2 : 64;
+                    kvs = realloc(kvs, capkvs * sizeof(Node *));
+                }
+                kvs[nkvs++] = kv;
+            }
+            // f isn't valid from here on, as pushing may move the frames
+            c = f->node;
+        }
+
+        if (!__pack_read(&r, &v)) goto error;
+        uint32_t count = 0;
+        switch (v.type) {
+            case N_BOOLEAN:
+                n = NewBoolNode(v.value.boolval);
+                break;
+            case N_INTEGER:
+                n = NewIntNode(v.value.intval);
+                break;
+            case N_NUMBER:
+                n = NewDoubleNode(v.value.numval);
+                break;
+            case N_STRING:
+                n = NewStringNode(v.value.strval.data, v.value.strval.len);
+                break;
+            case N_DICT:
+                count = v.value.dictval.len;
+                n = count ? NULL : NewDictNode(0);
+                break;
+            case N_ARRAY:
+                count = v.value.arrval.len;
+                n = NewArrayNode(_PACK_INDEFINITE == count ? 0 : count);
+                break;
+            default:
+                n = NULL;
+        }
+        if (count) {
+            // as deep as JSON goes, its levels include the root
+            if (stack.len + 1 >= PACK_MAX_DEPTH) {
+                Node_Free(n);
+                r.err = "nesting too deep";
+                goto error;
+            }
+            __pack_push(&stack, n, count, nkvs);
+        } else if (kv) {
+            kv->value.kvval.val = n;
+        } else if (c) {
+            Node_ArrayAppend(c, n);
+        } else {
+            root = n;
+            done = 1;
+        }
+    }
+    if (r.p != r.end) {
+        r.mark = r.p;
+        r.err = "unexpected data after the value";
+        goto error;
+    }
+
+    free(stack.frames);
+    free(kvs);
+    *node = root;
+    return OBJ_OK;
+
+error:
+    if (err) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "ERR invalid %s: %s at offset %zu", Pack_FormatName(format),
+                 r.err, (size_t)(r.mark - r.start));
+        *err = strdup(msg);
+    }
+    // the open arrays are in the frames and the open dictionaries' members on the keyval stack,
+    // and neither holds anything but complete values
+    for (uint32_t i = 0; i < stack.len; i++) Node_Free(stack.frames[i].node);
+    for (uint32_t i = 0; i < nkvs; i++) Node_Free(kvs[i]);
+    Node_Free(root);
+    free(stack.frames);
+    free(kvs);
+    return OBJ_ERR;
+}
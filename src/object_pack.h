@@ -0,0 +1,67 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __OBJECT_PACK_H__
+#define __OBJECT_PACK_H__
+
+#include <sds.h>
+#include "object.h"
+
+/**
+* The MessagePack and CBOR encodings of node trees, which JSON.SET and JSON.GET accept and reply
+* with instead of JSON. Values are encoded in their smallest form, with doubles always taking 8
+* bytes, and dictionaries and arrays have definite lengths.
+*
+* Decoding creates the nodes directly from the encoding. Both formats' binary strings are taken as
+* strings, and CBOR's tags are skipped, so are its indefinite lengths of arrays and maps but not of
+* strings. Map keys must be strings, and values that JSON can't hold, i.e. extension types,
+* undefined or simple values, integers that an int64 can't hold, infinities and NaNs, are invalid.
+*/
+
+typedef enum {
+    PACK_MSGPACK,
+    PACK_CBOR,
+} PackFormat;
+
+/* As deep as JSON values go */
+#define PACK_MAX_DEPTH 512
+
+/** The name of a format */
+const char *Pack_FormatName(PackFormat format);
+
+/** Appends the encoding of a node and its children to buf */
+void SerializeNodeToPack(const Node *node, PackFormat format, sds *buf);
+
+/**
+* Appends the beginning of a dictionary or an array of len members or items to buf, that need to be
+* appended next, so values that aren't in a single node can be encoded. A dictionary member is its
+* key, appended with Pack_String, and its value.
+*/
+void Pack_BeginDict(PackFormat format, uint32_t len, sds *buf);
+void Pack_BeginArray(PackFormat format, uint32_t len, sds *buf);
+
+/** Appends the encoding of a string to buf */
+void Pack_String(PackFormat format, const char *s, size_t len, sds *buf);
+
+/**
+* Creates a node from its encoding, that must take up exactly len bytes.
+* Returns OBJ_OK, or OBJ_ERR if the encoding is invalid and then sets the optional err with a
+* message that the caller frees.
+*/
+int CreateNodeFromPack(const char *buf, size_t len, PackFormat format, Node **node, char **err);
+
+#endif
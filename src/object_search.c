@@ -0,0 +1,287 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "object_search.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SEARCH_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define SEARCH_NEON
+#include <arm_neon.h>
+#endif
+
+typedef uint32_t (*FindIntFunc)(const int64_t *v, uint32_t n, int64_t x);
+typedef uint32_t (*FindDoubleFunc)(const double *v, uint32_t n, double x);
+
+static uint32_t __findint_scalar(const int64_t *v, uint32_t n, int64_t x) {
+    uint32_t i = 0;
+    while (i < n && v[i] != x) i++;
+    return i;
+}
+
+static uint32_t __finddouble_scalar(const double *v, uint32_t n, double x) {
+    uint32_t i = 0;
+    while (i < n && v[i] != x) i++;
+    return i;
+}
+
+static uint32_t __countint_scalar(const int64_t *v, uint32_t n, int64_t x) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n; i++) count += v[i] == x;
+    return count;
+}
+
+static uint32_t __countdouble_scalar(const double *v, uint32_t n, double x) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n; i++) count += v[i] == x;
+    return count;
+}
+
+#if defined(SEARCH_X86) && defined(__SSE2__)
+/* SSE2 has no 64-bit comparison, so both halves of a value must be equal */
+static inline __m128i __search_cmpeq64(__m128i a, __m128i b) {
+    __m128i m = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+static inline int __search_mask64(__m128i m) { return _mm_movemask_pd(_mm_castsi128_pd(m)); }
+
+static uint32_t __findint_sse2(const int64_t *v, uint32_t n, int64_t x) {
+    const __m128i k = _mm_set1_epi64x(x);
+    uint32_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = __search_cmpeq64(_mm_loadu_si128((const __m128i *)&v[i]), k);
+        __m128i b = __search_cmpeq64(_mm_loadu_si128((const __m128i *)&v[i + 2]), k);
+        int mask = __search_mask64(a) | __search_mask64(b) << 2;
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + __findint_scalar(v + i, n - i, x);
+}
+
+static uint32_t __finddouble_sse2(const double *v, uint32_t n, double x) {
+    const __m128d k = _mm_set1_pd(x);
+    uint32_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        int mask = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(&v[i]), k)) |
+                   _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(&v[i + 2]), k)) << 2;
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + __finddouble_scalar(v + i, n - i, x);
+}
+
+/* The counts are kept per lane, a match's mask is -1 so it's subtracted */
+static uint32_t __countint_sse2(const int64_t *v, uint32_t n, int64_t x) {
+    const __m128i k = _mm_set1_epi64x(x);
+    __m128i acc = _mm_setzero_si128();
+    uint64_t lanes[2];
+    uint32_t i = 0;
+
+    for (; i + 2 <= n; i += 2)
+        acc = _mm_sub_epi64(acc, __search_cmpeq64(_mm_loadu_si128((const __m128i *)&v[i]), k));
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    return (uint32_t)(lanes[0] + lanes[1]) + __countint_scalar(v + i, n - i, x);
+}
+
+static uint32_t __countdouble_sse2(const double *v, uint32_t n, double x) {
+    const __m128d k = _mm_set1_pd(x);
+    __m128i acc = _mm_setzero_si128();
+    uint64_t lanes[2];
+    uint32_t i = 0;
+
+    for (; i + 2 <= n; i += 2)
+        acc = _mm_sub_epi64(acc, _mm_castpd_si128(_mm_cmpeq_pd(_mm_loadu_pd(&v[i]), k)));
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    return (uint32_t)(lanes[0] + lanes[1]) + __countdouble_scalar(v + i, n - i, x);
+}
+
+__attribute__((target("avx2"))) static uint32_t __findint_avx2(const int64_t *v, uint32_t n,
+                                                               int64_t x) {
+    const __m256i k = _mm256_set1_epi64x(x);
+    uint32_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)&v[i]), k);
+        __m256i b = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)&v[i + 4]), k);
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(a)) |
+                   _mm256_movemask_pd(_mm256_castsi256_pd(b)) << 4;
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + __findint_sse2(v + i, n - i, x);
+}
+
+__attribute__((target("avx2"))) static uint32_t __finddouble_avx2(const double *v, uint32_t n,
+                                                                  double x) {
+    const __m256d k = _mm256_set1_pd(x);
+    uint32_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(&v[i]), k, _CMP_EQ_OQ)) |
+                   _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(&v[i + 4]), k, _CMP_EQ_OQ))
+                       << 4;
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + __finddouble_sse2(v + i, n - i, x);
+}
+
+__attribute__((target("avx2"))) static uint32_t __countint_avx2(const int64_t *v, uint32_t n,
+                                                                int64_t x) {
+    const __m256i k = _mm256_set1_epi64x(x);
+    __m256i acc = _mm256_setzero_si256();
+    uint64_t lanes[4];
+    uint32_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+        acc = _mm256_sub_epi64(acc, _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)&v[i]), k));
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    return (uint32_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]) +
+           __countint_scalar(v + i, n - i, x);
+}
+
+__attribute__((target("avx2"))) static uint32_t __countdouble_avx2(const double *v, uint32_t n,
+                                                                   double x) {
+    const __m256d k = _mm256_set1_pd(x);
+    __m256i acc = _mm256_setzero_si256();
+    uint64_t lanes[4];
+    uint32_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+        acc = _mm256_sub_epi64(
+            acc, _mm256_castpd_si256(_mm256_cmp_pd(_mm256_loadu_pd(&v[i]), k, _CMP_EQ_OQ)));
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    return (uint32_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]) +
+           __countdouble_scalar(v + i, n - i, x);
+}
+#endif
+
+#if defined(SEARCH_NEON)
+static uint32_t __findint_neon(const int64_t *v, uint32_t n, int64_t x) {
+    const int64x2_t k = vdupq_n_s64(x);
+    uint32_t i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        uint64x2_t m = vceqq_s64(vld1q_s64(&v[i]), k);
+        if (vmaxvq_u32(vreinterpretq_u32_u64(m))) return i + !vgetq_lane_u64(m, 0);
+    }
+    return i + __findint_scalar(v + i, n - i, x);
+}
+
+static uint32_t __finddouble_neon(const double *v, uint32_t n, double x) {
+    const float64x2_t k = vdupq_n_f64(x);
+    uint32_t i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        uint64x2_t m = vceqq_f64(vld1q_f64(&v[i]), k);
+        if (vmaxvq_u32(vreinterpretq_u32_u64(m))) return i + !vgetq_lane_u64(m, 0);
+    }
+    return i + __finddouble_scalar(v + i, n - i, x);
+}
+
+static uint32_t __countint_neon(const int64_t *v, uint32_t n, int64_t x) {
+    const int64x2_t k = vdupq_n_s64(x);
+    uint64x2_t acc = vdupq_n_u64(0);
+    uint32_t i = 0;
+
+    for (; i + 2 <= n; i += 2) acc = vsubq_u64(acc, vceqq_s64(vld1q_s64(&v[i]), k));
+    return (uint32_t)vaddvq_u64(acc) + __countint_scalar(v + i, n - i, x);
+}
+
+static uint32_t __countdouble_neon(const double *v, uint32_t n, double x) {
+    const float64x2_t k = vdupq_n_f64(x);
+    uint64x2_t acc = vdupq_n_u64(0);
+    uint32_t i = 0;
+
+    for (; i + 2 <= n; i += 2) acc = vsubq_u64(acc, vceqq_f64(vld1q_f64(&v[i]), k));
+    return (uint32_t)vaddvq_u64(acc) + __countdouble_scalar(v + i, n - i, x);
+}
+#endif
+
+typedef struct {
+    const char *name;
+    FindIntFunc findint;
+    FindDoubleFunc finddouble;
+    FindIntFunc countint;
+    FindDoubleFunc countdouble;
+} SearchKernel;
+
+static const SearchKernel _kernels[] = {
+#if defined(SEARCH_X86) && defined(__SSE2__)
+    {"avx2", __findint_avx2, __finddouble_avx2, __countint_avx2, __countdouble_avx2},
+    {"sse2", __findint_sse2, __finddouble_sse2, __countint_sse2, __countdouble_sse2},
+#endif
+#if defined(SEARCH_NEON)
+    {"neon", __findint_neon, __finddouble_neon, __countint_neon, __countdouble_neon},
+#endif
+    {"scalar", __findint_scalar, __finddouble_scalar, __countint_scalar, __countdouble_scalar},
+};
+
+#define SEARCH_NKERNELS (sizeof(_kernels) / sizeof(_kernels[0]))
+
+static int __search_supported(const char *name) {
+#if defined(SEARCH_X86)
+    __builtin_cpu_init();
+    if (!strcmp("avx2", name)) return __builtin_cpu_supports("avx2");
+#endif
+    (void)name;
+    return 1;
+}
+
+/* The kernel in use, picked on the first search */
+static const SearchKernel *_kernel = NULL;
+
+/* Picks the first supported kernel, the kernels are ordered by preference */
+static const SearchKernel *__search_kernel(void) {
+    if (_kernel) return _kernel;
+    for (size_t i = 0; i < SEARCH_NKERNELS; i++) {
+        if (__search_supported(_kernels[i].name)) {
+            _kernel = &_kernels[i];
+            break;
+        }
+    }
+    return _kernel;
+}
+
+uint32_t ObjectSearch_FindInt(const int64_t *v, uint32_t n, int64_t x) {
+    return __search_kernel()->findint(v, n, x);
+}
+
+uint32_t ObjectSearch_FindDouble(const double *v, uint32_t n, double x) {
+    return __search_kernel()->finddouble(v, n, x);
+}
+
+uint32_t ObjectSearch_CountInt(const int64_t *v, uint32_t n, int64_t x) {
+    return __search_kernel()->countint(v, n, x);
+}
+
+uint32_t ObjectSearch_CountDouble(const double *v, uint32_t n, double x) {
+    return __search_kernel()->countdouble(v, n, x);
+}
+
+const char *ObjectSearch_Kernel(void) { return __search_kernel()->name; }
+
+int ObjectSearch_UseKernel(const char *name) {
+    for (size_t i = 0; i < SEARCH_NKERNELS; i++) {
+        if (!strcmp(_kernels[i].name, name) && __search_supported(name)) {
+            _kernel = &_kernels[i];
+            return 1;
+        }
+    }
+    return 0;
+}
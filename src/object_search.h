@@ -0,0 +1,47 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __OBJECT_SEARCH_H__
+#define __OBJECT_SEARCH_H__
+
+#include <stdint.h>
+
+/**
+* Searches of the values of packed arrays (see t_array), which compare several values at a time.
+* Doubles are compared like C does, so 0 and -0 are equal.
+* The searches are done by the best kernel that the CPU supports (AVX2, SSE2, NEON or scalar), which
+* is picked on the first call.
+*/
+
+/** Returns the position of the first of the n values that equals x, or n if none does */
+uint32_t ObjectSearch_FindInt(const int64_t *v, uint32_t n, int64_t x);
+uint32_t ObjectSearch_FindDouble(const double *v, uint32_t n, double x);
+
+/** Returns the number of the n values that equal x */
+uint32_t ObjectSearch_CountInt(const int64_t *v, uint32_t n, int64_t x);
+uint32_t ObjectSearch_CountDouble(const double *v, uint32_t n, double x);
+
+/** The name of the kernel that the searches use */
+const char *ObjectSearch_Kernel(void);
+
+/**
+* Makes the searches use the named kernel, for testing and benchmarking.
+* Returns 1 on success or 0 if the kernel isn't available.
+*/
+int ObjectSearch_UseKernel(const char *name);
+
+#endif
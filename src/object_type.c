@@ -51,24 +51,39 @@ void *ObjectTypeRdbLoad(RedisModuleIO *rdb) {
                     case N_BOOLEAN:
                         str = RedisModule_LoadStringBuffer(rdb, &strlen);
                         node = NewBoolNode('1' == str[0]);
+                        RedisModule_Free(str);
                         state = S_END_VALUE;
                         break;
                     case N_INTEGER:
-                        node = NewIntNode(RedisModule_LoadSigned(rdb));
-                        state = S_END_VALUE;
-                        break;
                     case N_NUMBER:
-                        node = NewDoubleNode(RedisModule_LoadDouble(rdb));
+                        // numbers in arrays are appended as values, so they can be packed
+                        if (Vector_Size(nodes)) {
+                            Node *container;
+                            Vector_Get(nodes, Vector_Last(nodes), &container);
+                            if (N_ARRAY == container->type) {
+                                if (N_INTEGER == type) {
+                                    Node_ArrayAppendInt(container, RedisModule_LoadSigned(rdb));
+                                } else {
+                                    Node_ArrayAppendDouble(container, RedisModule_LoadDouble(rdb));
+                                }
+                                state = S_CONTAINER;
+                                break;
+                            }
+                        }
+                        node = N_INTEGER == type ? NewIntNode(RedisModule_LoadSigned(rdb))
+                                                 : NewDoubleNode(RedisModule_LoadDouble(rdb));
                         state = S_END_VALUE;
                         break;
                     case N_STRING:
                         str = RedisModule_LoadStringBuffer(rdb, &strlen);
                         node = NewStringNode(str, strlen);
+                        RedisModule_Free(str);
                         state = S_END_VALUE;
                         break;
                     case N_KEYVAL:
                         str = RedisModule_LoadStringBuffer(rdb, &strlen);
                         Vector_Push(nodes, NewKeyValNode(str, strlen, NULL));
+                        RedisModule_Free(str);
                         Vector_Push(indices, (uint64_t)1);
                         state = S_CONTAINER;
                         break;
@@ -145,11 +160,13 @@ void _ObjectTypeSave_Begin(Node *n, void *ctx) {
                 RedisModule_SaveSigned(rdb, n->value.intval);
                 break;
             case N_NUMBER:
-                RedisModule_SaveDouble(rdb, n->value.numval);
-                break;
-            case N_STRING:
-                RedisModule_SaveStringBuffer(rdb, n->value.strval.data, n->value.strval.len);
+                RedisModule_SaveDouble(rdb, Node_Number(n));
                 break;
+            case N_STRING: {
+                char *tmp;
+                RedisModule_SaveStringBuffer(rdb, Node_StringData(n, &tmp), n->value.strval.len);
+                free(tmp);
+            } break;
             case N_KEYVAL:
                 RedisModule_SaveStringBuffer(rdb, n->value.kvval.key, strlen(n->value.kvval.key));
                 break;
@@ -178,91 +195,297 @@ void ObjectTypeFree(void *value) {
     if (value) Node_Free(value);
 }
 
-void _ObjectTypeToResp_Begin(Node *n, void *ctx) {
-    RedisModuleCtx *rctx = (RedisModuleCtx *)ctx;
+/* RESP3's replies, when the server has them, which are looked up on first use */
+static int (*_replyWithMap)(RedisModuleCtx *ctx, long len) = NULL;
+static int (*_replyWithBool)(RedisModuleCtx *ctx, int b) = NULL;
+static int _resp3Resolved = 0;
 
-    if (!n) {
-        RedisModule_ReplyWithNull(ctx);
-    } else {
-        switch (n->type) {
-            case N_BOOLEAN:
-                RedisModule_ReplyWithSimpleString(ctx, n->value.boolval ? "true" : "false");
-                break;
-            case N_INTEGER:
-                RedisModule_ReplyWithLongLong(ctx, n->value.intval);
-                break;
-            case N_NUMBER:
-                RedisModule_ReplyWithDouble(ctx, n->value.numval);
-                break;
-            case N_STRING:
-                RedisModule_ReplyWithStringBuffer(ctx, n->value.strval.data, n->value.strval.len);
-                break;
-            case N_KEYVAL:
-                RedisModule_ReplyWithArray(ctx, 2);
-                RedisModule_ReplyWithStringBuffer(ctx, n->value.kvval.key, strlen(n->value.kvval.key));
-                break;
-            case N_DICT:
-                RedisModule_ReplyWithArray(ctx, n->value.dictval.len + 1);
-                RedisModule_ReplyWithSimpleString(ctx, "{");
-                break;
-            case N_ARRAY:
-                RedisModule_ReplyWithArray(ctx, n->value.arrval.len + 1);
-                RedisModule_ReplyWithSimpleString(ctx, "[");
-                break;
-            case N_NULL:  // keeps the compiler from complaining
-                break;
+int ObjectTypeHasResp3(void) {
+    if (!_resp3Resolved) {
+        if (REDISMODULE_OK !=
+                RedisModule_GetApi("RedisModule_ReplyWithMap", (void **)&_replyWithMap) ||
+            REDISMODULE_OK !=
+                RedisModule_GetApi("RedisModule_ReplyWithBool", (void **)&_replyWithBool)) {
+            _replyWithMap = NULL;
+            _replyWithBool = NULL;
         }
+        _resp3Resolved = 1;
     }
+    return _replyWithMap && _replyWithBool;
 }
 
-void ObjectTypeToRespReply(RedisModuleCtx *ctx, const Node *node) {
-    NodeSerializerOpt nso = {0};
+static void _replyArray(void *ctx, long len) {
+    RedisModule_ReplyWithArray(ctx, len);
+}
 
-    nso.fBegin = _ObjectTypeToResp_Begin;
-    nso.xBegin = 0xff;  // mask for all basic types
-    Node_Serializer(node, &nso, ctx);
+static void _replyMap(void *ctx, long len) {
+    _replyWithMap(ctx, len);
 }
 
-void _ObjectTypeMemoryUsage(Node *n, void *ctx) {
-    size_t *memory = (size_t *)ctx;
+static void _replyNull(void *ctx) {
+    RedisModule_ReplyWithNull(ctx);
+}
+
+static void _replyBool(void *ctx, int val) {
+    _replyWithBool(ctx, val);
+}
+
+static void _replyInteger(void *ctx, long long val) {
+    RedisModule_ReplyWithLongLong(ctx, val);
+}
+
+static void _replyNumber(void *ctx, double val) {
+    RedisModule_ReplyWithDouble(ctx, val);
+}
 
+static void _replyString(void *ctx, const char *str, size_t len) {
+    RedisModule_ReplyWithStringBuffer(ctx, str, len);
+}
+
+static void _replySimple(void *ctx, const char *str) {
+    RedisModule_ReplyWithSimpleString(ctx, str);
+}
+
+static const ObjectRespWriter _replyWriter = {
+    _replyArray, _replyMap, _replyNull, _replyBool, _replyInteger, _replyNumber, _replyString,
+    _replySimple};
+
+void ObjectTypeWriteResp(const Node *n, ObjectRespFormat format, const ObjectRespWriter *w,
+                         void *ctx) {
     if (!n) {
-        // the null node takes no memory
+        w->null(ctx);
+        return;
+    }
+    switch (n->type) {
+        case N_BOOLEAN:
+            if (OBJECT_RESP_LEGACY == format) {
+                w->simple(ctx, n->value.boolval ? "true" : "false");
+            } else if (OBJECT_RESP_COMPACT == format) {
+                // what Redis downgrades RESP3's booleans to for RESP2 clients
+                w->integer(ctx, n->value.boolval ? 1 : 0);
+            } else {
+                w->boolean(ctx, n->value.boolval);
+            }
+            break;
+        case N_INTEGER:
+            w->integer(ctx, n->value.intval);
+            break;
+        case N_NUMBER:
+            w->number(ctx, Node_Number(n));
+            break;
+        case N_STRING: {
+            char *tmp;
+            w->string(ctx, Node_StringData(n, &tmp), n->value.strval.len);
+            free(tmp);
+        } break;
+        case N_DICT: {
+            uint32_t len = n->value.dictval.len;
+            if (OBJECT_RESP_LEGACY == format) {
+                w->array(ctx, len + 1);
+                w->simple(ctx, "{");
+            } else if (OBJECT_RESP_COMPACT == format) {
+                w->array(ctx, 2 * (long)len);
+            } else {
+                w->map(ctx, len);
+            }
+            for (uint32_t i = 0; i < len; i++) {
+                const Node *kv = n->value.dictval.entries[i];
+                if (OBJECT_RESP_LEGACY == format) w->array(ctx, 2);
+                w->string(ctx, kv->value.kvval.key, Intern_Len(kv->value.kvval.key));
+                ObjectTypeWriteResp(kv->value.kvval.val, format, w, ctx);
+            }
+        } break;
+        case N_ARRAY: {
+            Node tmp, *item;
+            uint32_t len = n->value.arrval.len;
+            if (OBJECT_RESP_LEGACY == format) {
+                w->array(ctx, len + 1);
+                w->simple(ctx, "[");
+            } else {
+                w->array(ctx, len);
+            }
+            for (uint32_t i = 0; i < len; i++) {
+                Node_ArrayItemView((Node *)n, i, &tmp, &item);
+                ObjectTypeWriteResp(item, format, w, ctx);
+            }
+        } break;
+        case N_KEYVAL:
+        case N_NULL:  // keeps the compiler from complaining
+            break;
+    }
+}
+
+void ObjectTypeToRespReply(RedisModuleCtx *ctx, const Node *node, ObjectRespFormat format) {
+    if (OBJECT_RESP_3 == format && !ObjectTypeHasResp3()) format = OBJECT_RESP_COMPACT;
+    ObjectTypeWriteResp(node, format, &_replyWriter, ctx);
+}
+
+void _ObjectTypeMemoryUsage(Node *n, void *ctx) {
+    ObjectTypeMemory *stats = (ObjectTypeMemory *)ctx;
+    size_t memory = 0;
+
+    if (!n || (n->flags & NODE_F_STATIC)) {
+        // the null node and shared nodes take no memory
         return;
     } else {
         // account for the struct's size
-        *memory += sizeof(Node);
+        memory += sizeof(Node);
         switch (n->type) {
+            case N_NUMBER:
+                // a number's text is stored like a string's
+                if (n->flags & NODE_F_NUMBER_TEXT) memory += n->value.strval.len + 1;
+                break;
             case N_BOOLEAN:
             case N_INTEGER:
-            case N_NUMBER:
             case N_NULL:  // keeps the compiler from complaining
                 // these are stored in the node itself
-                return;
+                break;
             case N_STRING:
-                *memory += n->value.strval.len;
+                // a compressed string is counted with its length in the logical size
+                stats->memory += memory + Node_StringMemory(n);
+                stats->logical += memory + n->value.strval.len;
+                stats->compressed += !!(n->flags & NODE_F_COMPRESSED);
                 return;
             case N_KEYVAL:
-                *memory += strlen(n->value.kvval.key);
-                return;
+                // keys are interned, so each keyval node accounts for its share of the key
+                memory += Intern_MemoryShare(n->value.kvval.key);
+                break;
             case N_DICT:
-                *memory += n->value.dictval.cap * sizeof(Node *);
-                return;
+                memory += n->value.dictval.cap * sizeof(Node *) + Node_DictIndexSize(n);
+                break;
             case N_ARRAY:
-                *memory += n->value.arrval.cap * sizeof(Node *);
-                return;
+                memory += (n->value.arrval.cap + Node_ArrayGap(n)) * sizeof(Node *) +
+                          Node_ArrayIndexSize(n);
+                break;
         }
     }
+    stats->memory += memory;
+    stats->logical += memory;
+}
+
+/* RedisModule_MallocSize, when the server has it, which is looked up on first use */
+static size_t (*_mallocSize)(void *ptr) = NULL;
+static int _mallocSizeResolved = 0;
+
+size_t ObjectTypeAllocSize(const void *ptr, size_t size) {
+    if (!_mallocSizeResolved) {
+        if (REDISMODULE_OK != RedisModule_GetApi("RedisModule_MallocSize", (void **)&_mallocSize))
+            _mallocSize = NULL;
+        _mallocSizeResolved = 1;
+    }
+    if (ptr && _mallocSize) return _mallocSize((void *)ptr);
+
+    // jemalloc's size classes: multiples of 16 up to 128, then 4 classes for every doubling
+    if (size <= 8) return 8;
+    if (size <= 128) return (size + 15) & ~(size_t)15;
+    size_t step = ((size_t)1 << (63 - __builtin_clzll(size - 1))) / 4;
+    return (size + step - 1) & ~(step - 1);
+}
+
+/* The context of the walk of ObjectTypeAllocatedMemory */
+typedef struct {
+    size_t memory;
+    int arena;
+} _ObjectTypeAllocated;
+
+static void _ObjectTypeAllocatedMemory(Node *n, void *ctx) {
+    _ObjectTypeAllocated *a = (_ObjectTypeAllocated *)ctx;
+    a->memory += Node_AllocatedSize(n, ObjectTypeAllocSize, a->arena);
+}
+
+size_t ObjectTypeAllocatedMemory(const Node *node, int arena) {
+    _ObjectTypeAllocated a = {.arena = arena};
+
+    // the nodes that are shared by several containers are counted once
+    Node_TraverseUnique((Node *)node, _ObjectTypeAllocatedMemory, &a);
+    return a.memory;
+}
+
+void ObjectTypeMemoryStats(const Node *node, ObjectTypeMemory *stats) {
+    *stats = (ObjectTypeMemory){0};
+    Node_TraverseUnique((Node *)node, _ObjectTypeMemoryUsage, stats);
 }
 
 size_t ObjectTypeMemoryUsage(const void *value) {
-    const Node *node = value;
+    ObjectTypeMemory stats;
+    ObjectTypeMemoryStats(value, &stats);
+    return stats.memory;
+}
+/* The profile of a tree while it is traversed, with the containers that the current value is in */
+typedef struct {
+    ObjectTypeProfile *profile;
+    uint64_t depth;
+} _ObjectTypeProfileCtx;
+
+static inline int _ObjectTypeProfileBucket(uint64_t len) {
+    int i = 0;
+    while (len && i < OBJECT_PROFILE_BUCKETS - 1) {
+        len >>= 1;
+        i++;
+    }
+    return i;
+}
+
+void _ObjectTypeProfile_Begin(Node *n, void *ctx) {
+    _ObjectTypeProfileCtx *pctx = (_ObjectTypeProfileCtx *)ctx;
+    ObjectTypeProfile *p = pctx->profile;
+
+    // keyvals are the members of dictionaries rather than values
+    if (n && N_KEYVAL == n->type) return;
+    p->depths[MIN(pctx->depth, OBJECT_PROFILE_BUCKETS - 1)]++;
+    p->maxdepth = MAX(p->maxdepth, pctx->depth);
+    if (!n) {
+        p->nulls++;
+        return;
+    }
+    switch (n->type) {
+        case N_BOOLEAN:
+            p->booleans++;
+            break;
+        case N_INTEGER:
+            p->integers++;
+            break;
+        case N_NUMBER:
+            p->numbers++;
+            break;
+        case N_STRING:
+            p->strings++;
+            p->strlens[_ObjectTypeProfileBucket(n->value.strval.len)]++;
+            p->compressed += !!(n->flags & NODE_F_COMPRESSED);
+            break;
+        case N_DICT:
+            p->dicts++;
+            p->dictsizes[_ObjectTypeProfileBucket(n->value.dictval.len)]++;
+            p->dictslack += (n->value.dictval.cap - n->value.dictval.len) * sizeof(Node *);
+            p->indexed += !!(n->flags & NODE_F_DICT_INDEXED);
+            pctx->depth++;
+            break;
+        case N_ARRAY:
+            p->arrays++;
+            p->arraylens[_ObjectTypeProfileBucket(n->value.arrval.len)]++;
+            p->arrayslack +=
+                (n->value.arrval.cap - n->value.arrval.len + Node_ArrayGap(n)) * sizeof(Node *);
+            p->packed += !!(n->flags & NODE_F_PACKED);
+            pctx->depth++;
+            break;
+        case N_NULL:  // keeps the compiler from complaining
+        case N_KEYVAL:
+            break;
+    }
+}
+
+void _ObjectTypeProfile_End(Node *n, void *ctx) {
+    ((_ObjectTypeProfileCtx *)ctx)->depth--;
+}
+
+void ObjectTypeProfileStats(const Node *node, ObjectTypeProfile *profile) {
     NodeSerializerOpt nso = {0};
-    size_t memory = 0;
+    _ObjectTypeProfileCtx ctx = {.profile = profile, .depth = 0};
 
-    nso.fBegin = _ObjectTypeMemoryUsage;
+    *profile = (ObjectTypeProfile){0};
+    nso.fBegin = _ObjectTypeProfile_Begin;
     nso.xBegin = 0xff;  // mask for all basic types
-    Node_Serializer(node, &nso, &memory);
-
-    return memory;
-}
\ No newline at end of file
+    nso.fEnd = _ObjectTypeProfile_End;
+    nso.xEnd = N_DICT | N_ARRAY;
+    Node_Serializer(node, &nso, &ctx);
+}
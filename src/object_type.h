@@ -28,10 +28,89 @@ void *ObjectTypeRdbLoad(RedisModuleIO *rdb);
 void ObjectTypeRdbSave(RedisModuleIO *rdb, void *value);
 void ObjectTypeFree(void *value);
 
+/* The layouts of a node's RESP representation, see JSON.RESP */
+typedef enum {
+    OBJECT_RESP_LEGACY,   // containers lead with a "[" or "{" and members are [key, value] arrays
+    OBJECT_RESP_COMPACT,  // objects are flat arrays of keys and values, booleans are 1 or 0
+    OBJECT_RESP_3,        // objects are maps, booleans and numbers are RESP3's own
+} ObjectRespFormat;
+
+/**
+* The replies that a RESP representation is made of, so that it can be written elsewhere than to a
+* client, e.g. to a buffer by the benchmarks. map is only called for OBJECT_RESP_3 and takes the
+* number of members.
+*/
+typedef struct {
+    void (*array)(void *ctx, long len);
+    void (*map)(void *ctx, long len);
+    void (*null)(void *ctx);
+    void (*boolean)(void *ctx, int val);
+    void (*integer)(void *ctx, long long val);
+    void (*number)(void *ctx, double val);
+    void (*string)(void *ctx, const char *str, size_t len);
+    void (*simple)(void *ctx, const char *str);
+} ObjectRespWriter;
+
+/* Writes the RESP representation of the node in a format */
+void ObjectTypeWriteResp(const Node *node, ObjectRespFormat format, const ObjectRespWriter *w,
+                         void *ctx);
+
 /* Replies with a RESP representation of the node. */
-void ObjectTypeToRespReply(RedisModuleCtx *ctx, const Node *node);
+void ObjectTypeToRespReply(RedisModuleCtx *ctx, const Node *node, ObjectRespFormat format);
 
-/* Reports the memory usage (in bytes) of the node. */
+/**
+* Returns 1 if the server replies with RESP3's maps and booleans, which are looked up on first use,
+* or 0 if OBJECT_RESP_3 can't be replied.
+*/
+int ObjectTypeHasResp3(void);
+
+/* Reports the memory usage (in bytes) of the node. Shared nodes, see Node_Dedup, count once. */
 size_t ObjectTypeMemoryUsage(const void *value);
 
+/* The memory usage of a node, and what it would be if none of its strings were compressed */
+typedef struct {
+    size_t memory;
+    size_t logical;
+    size_t compressed;  // the number of compressed strings
+} ObjectTypeMemory;
+
+void ObjectTypeMemoryStats(const Node *node, ObjectTypeMemory *stats);
+
+/**
+* The bytes that the allocator holds for an allocation of size bytes at ptr (see NodeAllocSizeFunc):
+* what RedisModule_MallocSize reports if the server has it, or else the size rounded up to its
+* jemalloc size class, which is Redis' default allocator.
+*/
+size_t ObjectTypeAllocSize(const void *ptr, size_t size);
+
+/**
+* The bytes that the allocator holds for a node's tree, see Node_AllocatedSize. The nodes' memory in
+* arenas counts as its exact size when arena is set, or as nothing otherwise.
+*/
+size_t ObjectTypeAllocatedMemory(const Node *node, int arena);
+
+/**
+* Length bucket 0 of a profile counts the empty values, bucket i the values of lengths in
+* [2^(i-1), 2^i) and the last one the rest. Depth bucket i counts the values in i containers, the
+* last one the values in that many or more.
+*/
+#define OBJECT_PROFILE_BUCKETS 24
+
+/* The shape of a node's tree */
+typedef struct {
+    uint64_t nulls, booleans, integers, numbers, strings, dicts, arrays;
+    uint64_t packed;      // the number of packed arrays
+    uint64_t indexed;     // the number of dictionaries indexed by a hash table
+    uint64_t compressed;  // the number of compressed strings
+    uint64_t dictslack;   // the bytes of unused dictionary entries
+    uint64_t arrayslack;  // the bytes of unused array entries, including the gaps before them
+    uint64_t maxdepth;    // the most containers that a value is in
+    uint64_t dictsizes[OBJECT_PROFILE_BUCKETS];
+    uint64_t arraylens[OBJECT_PROFILE_BUCKETS];
+    uint64_t strlens[OBJECT_PROFILE_BUCKETS];
+    uint64_t depths[OBJECT_PROFILE_BUCKETS];
+} ObjectTypeProfile;
+
+void ObjectTypeProfileStats(const Node *node, ObjectTypeProfile *profile);
+
 #endif
\ No newline at end of file
@@ -16,9 +16,16 @@
 */
 
 #include "path.h"
+#include "intern.h"
+#include "path_filter.h"
 
-Node *__pathNode_eval(PathNode *pn, Node *n, PathError *err) {
+/* Evaluates a path node in n, copying an item of a packed array to tmp, see Node_ArrayItemView */
+static Node *__pathNode_evalEx(PathNode *pn, Node *n, int interned, Node *tmp, PathError *err) {
     *err = E_OK;
+    if (pn->type >= NT_SLICE) {
+        *err = E_MULTI;
+        return NULL;
+    }
     if (!n) {
         goto badtype;
     }
@@ -28,8 +35,8 @@ Node *__pathNode_eval(PathNode *pn, Node *n, PathError *err) {
         if (NT_INDEX == pn->type) {
             int index = pn->value.index;
             // translate negative values
-            if (index < 0) index = n->value.arrval.len + index;            
-            int rc = Node_ArrayItem(n, index, &rn);
+            if (index < 0) index = n->value.arrval.len + index;
+            int rc = Node_ArrayItemView(n, index, tmp, &rn);
             if (rc != OBJ_OK) {
                 *err = E_NOINDEX;
             }
@@ -44,7 +51,8 @@ Node *__pathNode_eval(PathNode *pn, Node *n, PathError *err) {
             goto badtype;
         }
         Node *rn = NULL;
-        int rc = Node_DictGet(n, pn->value.key, &rn);
+        int rc = interned ? Node_DictGetInterned(n, pn->value.key, &rn)
+                          : Node_DictGet(n, pn->value.key, &rn);
         if (rc != OBJ_OK) {
             *err = E_NOKEY;
         }
@@ -56,11 +64,15 @@ badtype:
     return NULL;
 }
 
-PathError SearchPath_Find(SearchPath *path, Node *root, Node **n) {
+Node *__pathNode_eval(PathNode *pn, Node *n, Node *tmp, PathError *err) {
+    return __pathNode_evalEx(pn, n, 0, tmp, err);
+}
+
+PathError SearchPath_Find(SearchPath *path, Node *root, Node *tmp, Node **n) {
     Node *current = root;
     PathError ret;
     for (int i = 0; i < path->len; i++) {
-        current = __pathNode_eval(&path->nodes[i], current, &ret);
+        current = __pathNode_evalEx(&path->nodes[i], current, path->interned, tmp, &ret);
         if (ret != E_OK) {
             *n = NULL;
             return ret;
@@ -70,7 +82,8 @@ PathError SearchPath_Find(SearchPath *path, Node *root, Node **n) {
     return E_OK;
 }
 
-PathError SearchPath_FindEx(SearchPath *path, Node *root, Node **n, Node **p, int *errnode) {
+PathError SearchPath_FindEx(SearchPath *path, Node *root, Node *tmp, Node **n, Node **p,
+                            int *errnode) {
     Node *current = root;
     Node *prev = NULL;
     Node *next;
@@ -78,7 +91,7 @@ PathError SearchPath_FindEx(SearchPath *path, Node *root, Node **n, Node **p, in
 
     for (int i = 0; i < path->len; i++) {
         prev = current;
-        current = __pathNode_eval(&path->nodes[i], current, &ret);
+        current = __pathNode_evalEx(&path->nodes[i], current, path->interned, tmp, &ret);
         if (ret != E_OK) {
             *errnode = i;
             *p = prev;
@@ -91,7 +104,181 @@ PathError SearchPath_FindEx(SearchPath *path, Node *root, Node **n, Node **p, in
     return E_OK;
 }
 
-SearchPath NewSearchPath(size_t cap) { return (SearchPath){calloc(cap, sizeof(PathNode)), 0, cap}; }
+/* Checks whether two path nodes are equal, interned keys are compared by pointer */
+static int __pathNode_equal(const PathNode *a, const PathNode *b, int interned) {
+    if (a->type != b->type) return 0;
+    if (NT_INDEX == a->type) return a->value.index == b->value.index;
+    if (NT_SLICE == a->type)
+        return a->value.slice.start == b->value.slice.start &&
+               a->value.slice.end == b->value.slice.end && a->value.slice.step == b->value.slice.step;
+    if (NT_FILTER == a->type) return a->value.filter == b->value.filter;
+    if (NT_KEY != a->type || a->value.key == b->value.key) return 1;
+    return !interned && !strcmp(a->value.key, b->value.key);
+}
+
+void SearchPath_FindAll(SearchPathMatch *matches, int n, Node *root) {
+    Node *stackchain[16];
+    size_t maxlen = 0;
+    for (int i = 0; i < n; i++) maxlen = MAX(maxlen, matches[i].path->len);
+
+    // chain[i] is the node at level i of the previous path, for the first valid levels of it
+    Node **chain = maxlen < 16 ? stackchain : malloc((maxlen + 1) * sizeof(Node *));
+    size_t valid = 0;
+    chain[0] = root;
+    for (int i = 0; i < n; i++) {
+        SearchPathMatch *m = &matches[i];
+        SearchPath *sp = m->path;
+        size_t len = (sp->len && NT_ROOT == sp->nodes[0].type) ? 0 : sp->len;
+        size_t level = 0;
+        PathError err = E_OK;
+
+        // skip the levels that were evaluated for the previous path
+        if (i) {
+            SearchPath *prev = matches[i - 1].path;
+            int interned = sp->interned && prev->interned;
+            size_t common = MIN(valid, MIN(len, prev->len));
+            while (level < common && __pathNode_equal(&sp->nodes[level], &prev->nodes[level], interned))
+                level++;
+        }
+        for (; level < len; level++) {
+            chain[level + 1] =
+                __pathNode_evalEx(&sp->nodes[level], chain[level], sp->interned, &m->tmp, &err);
+            if (E_OK != err) break;
+        }
+        valid = level;
+        m->err = err;
+        if (E_OK != err) {
+            m->errnode = level;
+            m->p = chain[level];
+            m->n = NULL;
+        } else {
+            m->p = len ? chain[len - 1] : NULL;
+            m->n = chain[len];
+        }
+    }
+
+    if (chain != stackchain) free(chain);
+}
+
+/* Translates a slice's negative index and clamps it to the array's bounds */
+static int __pathSlice_bound(int index, int len) {
+    if (index < 0) index += len;
+    return index < 0 ? 0 : MIN(index, len);
+}
+
+/* Calls f with the matches of the path's nodes from level on in n, that is in p at key or index,
+ * and counts them */
+static void __searchPath_each(SearchPath *path, size_t level, Node *n, Node *p, const char *key,
+                              int index, SearchPathVisitor f, void *ctx, size_t *count) {
+    Node tmp;  // the copy of a packed array's item
+    PathError err;
+
+    for (; level < path->len; level++) {
+        PathNode *pn = &path->nodes[level];
+        switch (pn->type) {
+            case NT_ROOT:
+                break;
+            case NT_KEY:
+                p = n;
+                key = pn->value.key;
+                n = __pathNode_evalEx(pn, n, path->interned, &tmp, &err);
+                if (E_OK != err) return;
+                break;
+            case NT_INDEX:
+                if (!n || N_ARRAY != n->type) return;
+                p = n;
+                key = NULL;
+                index = pn->value.index;
+                if (index < 0) index += n->value.arrval.len;
+                if (OBJ_OK != Node_ArrayItemView(p, index, &tmp, &n)) return;
+                break;
+            case NT_SLICE: {
+                if (!n || N_ARRAY != n->type) return;
+                int len = n->value.arrval.len;
+                int end = __pathSlice_bound(pn->value.slice.end, len);
+                for (int64_t i = __pathSlice_bound(pn->value.slice.start, len); i < end;
+                     i += pn->value.slice.step) {
+                    Node *item;
+                    Node_ArrayItemView(n, (int)i, &tmp, &item);
+                    __searchPath_each(path, level + 1, item, n, NULL, (int)i, f, ctx, count);
+                }
+            }
+                return;
+            case NT_WILDCARD:
+            case NT_DESCENT:
+            case NT_FILTER:
+                // a descent is the node itself, and then every one of its children with the descent
+                if (NT_DESCENT == pn->type)
+                    __searchPath_each(path, level + 1, n, p, key, index, f, ctx, count);
+                size_t next = NT_DESCENT == pn->type ? level : level + 1;
+                if (n && N_ARRAY == n->type) {
+                    for (int i = 0; i < n->value.arrval.len; i++) {
+                        Node *item;
+                        Node_ArrayItemView(n, i, &tmp, &item);
+                        if (NT_FILTER == pn->type && !PathFilter_Match(pn->value.filter, item))
+                            continue;
+                        __searchPath_each(path, next, item, n, NULL, i, f, ctx, count);
+                    }
+                } else if (n && N_DICT == n->type) {
+                    for (int i = 0; i < n->value.dictval.len; i++) {
+                        Node *kv = n->value.dictval.entries[i];
+                        Node *val = kv->value.kvval.val;
+                        if (NT_FILTER == pn->type && !PathFilter_Match(pn->value.filter, val))
+                            continue;
+                        __searchPath_each(path, next, val, n, kv->value.kvval.key, 0, f, ctx,
+                                          count);
+                    }
+                }
+                return;
+        }
+    }
+
+    (*count)++;
+    f(n, p, key, index, ctx);
+}
+
+size_t SearchPath_FindEach(SearchPath *path, Node *root, SearchPathVisitor f, void *ctx) {
+    size_t count = 0;
+    __searchPath_each(path, 0, root, NULL, NULL, 0, f, ctx, &count);
+    return count;
+}
+
+void SearchPath_Own(SearchPath *path, Node **root, int deep) {
+    Node **ref = root;
+    for (size_t level = 0; level < path->len; level++) {
+        PathNode *pn = &path->nodes[level];
+        if (NT_ROOT == pn->type) continue;
+
+        // the values that a path node of multiple values matches are all owned
+        if (pn->type >= NT_SLICE) {
+            Node_OwnAll(ref);
+            return;
+        }
+        Node *n = Node_Own(ref);
+        if (!n) return;
+        if (NT_KEY == pn->type && N_DICT == n->type) {
+            ref = Node_DictGetRef(n, pn->value.key, path->interned);
+        } else if (NT_INDEX == pn->type && N_ARRAY == n->type && !(n->flags & NODE_F_PACKED)) {
+            int index = pn->value.index;
+            if (index < 0) index += n->value.arrval.len;
+            ref = index >= 0 && index < n->value.arrval.len ? &n->value.arrval.entries[index]
+                                                              : NULL;
+        } else {
+            // the items of a packed array are values of the array itself
+            return;
+        }
+        if (!ref) return;
+    }
+    if (deep) {
+        Node_OwnAll(ref);
+    } else {
+        Node_Own(ref);
+    }
+}
+
+SearchPath NewSearchPath(size_t cap) {
+    return (SearchPath){calloc(cap, sizeof(PathNode)), 0, cap, 0};
+}
 
 void __searchPath_append(SearchPath *p, PathNode pn) {
     if (p->len >= p->cap) {
@@ -122,11 +309,69 @@ void SearchPath_AppendRoot(SearchPath *p) {
     __searchPath_append(p, pn);
 }
 
+void SearchPath_AppendSlice(SearchPath *p, int start, int end, int step) {
+    PathNode pn;
+    pn.type = NT_SLICE;
+    pn.value.slice = (PathSlice){start, end, step};
+    __searchPath_append(p, pn);
+}
+
+void SearchPath_AppendWildcard(SearchPath *p) {
+    PathNode pn;
+    pn.type = NT_WILDCARD;
+    __searchPath_append(p, pn);
+}
+
+void SearchPath_AppendDescent(SearchPath *p) {
+    PathNode pn;
+    pn.type = NT_DESCENT;
+    __searchPath_append(p, pn);
+}
+
+void SearchPath_AppendFilter(SearchPath *p, struct PathFilter *filter) {
+    PathNode pn;
+    pn.type = NT_FILTER;
+    pn.value.filter = filter;
+    __searchPath_append(p, pn);
+}
+
+int SearchPath_HasDescent(const SearchPath *p) {
+    for (int i = 0; i < p->len; i++) {
+        if (p->nodes[i].type == NT_DESCENT) return 1;
+    }
+    return 0;
+}
+
+int SearchPath_IsMulti(const SearchPath *p) {
+    for (int i = 0; i < p->len; i++) {
+        if (p->nodes[i].type >= NT_SLICE) return 1;
+    }
+    return 0;
+}
+
+void SearchPath_Intern(SearchPath *p) {
+    if (p->interned) return;
+    for (int i = 0; i < p->len; i++) {
+        if (p->nodes[i].type == NT_KEY) {
+            char *key = (char *)p->nodes[i].value.key;
+            p->nodes[i].value.key = Intern_Acquire(key, strlen(key));
+            free(key);
+        }
+    }
+    p->interned = 1;
+}
+
 void SearchPath_Free(SearchPath *p) {
     if (p->nodes) {
         for (int i = 0; i < p->len; i++) {
             if (p->nodes[i].type == NT_KEY) {
-                free((char *)p->nodes[i].value.key);
+                if (p->interned) {
+                    Intern_Release(p->nodes[i].value.key);
+                } else {
+                    free((char *)p->nodes[i].value.key);
+                }
+            } else if (p->nodes[i].type == NT_FILTER) {
+                PathFilter_Free(p->nodes[i].value.filter);
             }
         }
     }
@@ -18,6 +18,7 @@
 #ifndef __PATH_H__
 #define __PATH_H__
 
+#include <limits.h>
 #include <string.h>
 #include <sys/param.h>
 #include "object.h"
@@ -31,6 +32,11 @@ typedef enum {
     NT_ROOT,
     NT_KEY,
     NT_INDEX,
+    // the nodes from here on can match multiple values, see SearchPath_FindEach
+    NT_SLICE,     // a range of array items
+    NT_WILDCARD,  // all the items of an array or all the values of a dictionary
+    NT_DESCENT,   // a node and all of its descendants, to which the next path node is applied
+    NT_FILTER,    // the items of an array or the values of a dictionary that satisfy a filter
 } PathNodeType;
 
 /* Error codes returned from path lookups */
@@ -45,19 +51,35 @@ typedef enum {
 
     // the path predicate does not match the node type
     E_BADTYPE,
+
+    // the path node matches multiple values, which a single value lookup can't return
+    E_MULTI,
 } PathError;
 
+/* A slice of an array: the items from start up to, not including, end, every step items */
+typedef struct {
+    int start;  // negative values count from the end of the array
+    int end;    // ditto, SEARCHPATH_SLICE_END for the end of the array
+    int step;   // always positive
+} PathSlice;
+
+#define SEARCHPATH_SLICE_END INT_MAX
+
+struct PathFilter;
+
 /* A single lookup node in a lookup path. A lookup path is just a list of nodes */
 typedef struct {
     PathNodeType type;
     union {
         int index;
         const char *key;
+        PathSlice slice;
+        struct PathFilter *filter;  // see path_filter.h
     } value;
 } PathNode;
 
-/** Evaluate a single path node against an object node */
-Node *__pathNode_eval(PathNode *pn, Node *n, PathError *err);
+/** Evaluate a single path node against an object node, see SearchPath_Find for tmp */
+Node *__pathNode_eval(PathNode *pn, Node *n, Node *tmp, PathError *err);
 
 /**
 * A search path parsed from JSON or other formats, representing
@@ -67,6 +89,7 @@ typedef struct {
     PathNode *nodes;
     size_t len;
     size_t cap;
+    int interned;  // the keys are interned strings, see SearchPath_Intern
 } SearchPath;
 
 /* Create a new search path. cap can be 0 if you don't know it */
@@ -81,6 +104,28 @@ void SearchPath_AppendKey(SearchPath *p, const char *key, const size_t len);
 /* Appends a root node to the search path (makes sense only as the first append)  */
 void SearchPath_AppendRoot(SearchPath *p);
 
+/* Append an array slice node to the path */
+void SearchPath_AppendSlice(SearchPath *p, int start, int end, int step);
+
+/* Append a wildcard node to the path */
+void SearchPath_AppendWildcard(SearchPath *p);
+
+/* Append a recursive descent node to the path */
+void SearchPath_AppendDescent(SearchPath *p);
+
+/* Append a filter node to the path, the path takes ownership of the filter */
+void SearchPath_AppendFilter(SearchPath *p, struct PathFilter *filter);
+
+/* Checks whether the path can match multiple values, i.e. has slices, wildcards, descents or
+ * filters */
+int SearchPath_IsMulti(const SearchPath *p);
+
+/**
+* Replaces the path's keys with their interned copies, so dictionaries are searched by pointer
+* without the keys being looked up in the intern table first
+*/
+void SearchPath_Intern(SearchPath *p);
+
 /* Free a search path and all its nodes */
 void SearchPath_Free(SearchPath *p);
 
@@ -90,13 +135,65 @@ void SearchPath_Free(SearchPath *p);
 * Find a node in an object tree based on a parsed path.
 * An error code is returned, and if a node matches the path, its value
 * is put into n's pointer. This can be NULL if the lookup matches a NULL node.
+* Paths that can match multiple values fail with E_MULTI, these are searched with SearchPath_FindEach.
+* Lookups don't change the tree: an item of a packed array is copied to tmp, as Node_ArrayItemView
+* does, so n is then a read-only copy that lives as long as tmp and the array are unchanged. Writes
+* replace such items in their arrays, see Node_ArrayReplace.
 */
-PathError SearchPath_Find(SearchPath *path, Node *root, Node **n);
+PathError SearchPath_Find(SearchPath *path, Node *root, Node *tmp, Node **n);
 
 /**
 * Like SearchPath_Find, but sets p to the parent container of n. In case of E_NOKEY, E_NOINDEX,
 * and E_INFINDEX returns the path level of the error in errnode.
 */
-PathError SearchPath_FindEx(SearchPath *path, Node *root, Node **n, Node **p, int *errnode);
+PathError SearchPath_FindEx(SearchPath *path, Node *root, Node *tmp, Node **n, Node **p,
+                            int *errnode);
+
+/* A path to search with SearchPath_FindAll, and the results that SearchPath_FindEx would set */
+typedef struct {
+    SearchPath *path;
+    Node tmp;  // the copy of an item of a packed array, that n or the next matches' n point to
+    Node *n;
+    Node *p;
+    PathError err;
+    int errnode;
+} SearchPathMatch;
 
-#endif
\ No newline at end of file
+/**
+* Searches for several paths at once, setting each match as SearchPath_FindEx would. The levels
+* that a path has in common with the previous one aren't evaluated again, so paths that are grouped
+* by their prefixes are walked as a trie would be. A root path matches the root, with no parent.
+*/
+void SearchPath_FindAll(SearchPathMatch *matches, int n, Node *root);
+
+/**
+* The type signature of the callbacks that SearchPath_FindEach calls with every match n. p is the
+* match's container, and key or index is its place in a dictionary or an array container. p is NULL
+* if the match is the root.
+*/
+typedef void (*SearchPathVisitor)(Node *n, Node *p, const char *key, int index, void *ctx);
+
+/* Checks whether the path has recursive descents, that can match a node and its descendants, or
+ * the same node more than once */
+int SearchPath_HasDescent(const SearchPath *p);
+
+/**
+* Finds all the nodes that match a path, calling f with each of them and ctx in document order.
+* Every path node is applied to each of the values that the previous one matched, and those that
+* mismatch (e.g. a missing key or an index out of range) are skipped rather than errors. The matches
+* are the document's own nodes, but for items of packed arrays that are read-only copies that only
+* live during the callback. Returns the number of matches.
+*/
+size_t SearchPath_FindEach(SearchPath *path, Node *root, SearchPathVisitor f, void *ctx);
+
+/**
+* Makes the nodes that a path walks through in a tree their holder's own, see Node_Own, so the value
+* that it matches can be written to while other trees share the rest of the nodes. These are the
+* nodes from the root to the value, or to the container of its missing key or index, and with deep
+* set the value's descendants too. The values that a path of multiple values matches are owned with
+* all their descendants, from the first path node that can match multiple values on. root is updated
+* if the root is copied.
+*/
+void SearchPath_Own(SearchPath *path, Node **root, int deep);
+
+#endif
@@ -0,0 +1,144 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "path_cache.h"
+#include "intern.h"
+
+/* The cache is a chained hash table with a doubly linked list of its paths from the least to the
+* most recently used one */
+static struct {
+    CompiledPath **buckets;
+    uint32_t nbuckets;     // a power of 2, at least twice the capacity
+    size_t cap;            // the maximal number of paths
+    size_t count;          // the number of paths
+    CompiledPath *oldest;  // the LRU list's ends
+    CompiledPath *newest;
+    uint64_t hits;
+    uint64_t misses;
+} _cache = {.cap = PATH_CACHE_CAPACITY};
+
+static void __pathcache_free(CompiledPath *cp) {
+    SearchPath_Free(&cp->sp);
+    free(cp);
+}
+
+static void __pathcache_unlink(CompiledPath *cp) {
+    if (cp->prev) cp->prev->newer = cp->newer;
+    else _cache.oldest = cp->newer;
+    if (cp->newer) cp->newer->prev = cp->prev;
+    else _cache.newest = cp->prev;
+    cp->prev = cp->newer = NULL;
+}
+
+static void __pathcache_pushnewest(CompiledPath *cp) {
+    cp->prev = _cache.newest;
+    cp->newer = NULL;
+    if (_cache.newest) _cache.newest->newer = cp;
+    else _cache.oldest = cp;
+    _cache.newest = cp;
+}
+
+/* Removes a path from the cache, and drops the cache's reference to it */
+static void __pathcache_evict(CompiledPath *cp) {
+    CompiledPath **pp = &_cache.buckets[cp->hash & (_cache.nbuckets - 1)];
+    while (*pp != cp) pp = &(*pp)->next;
+    *pp = cp->next;
+    __pathcache_unlink(cp);
+    _cache.count--;
+    PathCache_Release(cp);
+}
+
+/* Compiles a path, returns NULL if it is invalid */
+static CompiledPath *__pathcache_compile(const char *path, size_t len, uint32_t hash,
+                                         JSONSearchPathError_t *err) {
+    SearchPath sp = NewSearchPath(0);
+    if (PARSE_ERR == ParseJSONPath(path, len, &sp, err)) {
+        SearchPath_Free(&sp);
+        return NULL;
+    }
+    SearchPath_Intern(&sp);
+
+    CompiledPath *cp = calloc(1, sizeof(CompiledPath) + len + 1);
+    cp->sp = sp;
+    cp->hash = hash;
+    cp->len = len;
+    memcpy(cp->str, path, len);
+    cp->str[len] = '\0';
+    return cp;
+}
+
+CompiledPath *PathCache_Get(const char *path, size_t len, JSONSearchPathError_t *err) {
+    uint32_t hash = Intern_HashString(path, len);
+    CompiledPath *cp;
+
+    if (_cache.count) {
+        for (cp = _cache.buckets[hash & (_cache.nbuckets - 1)]; cp; cp = cp->next) {
+            if (cp->hash == hash && cp->len == len && !memcmp(cp->str, path, len)) {
+                _cache.hits++;
+                if (cp != _cache.newest) {
+                    __pathcache_unlink(cp);
+                    __pathcache_pushnewest(cp);
+                }
+                cp->refcnt++;
+                return cp;
+            }
+        }
+    }
+
+    _cache.misses++;
+    if (!(cp = __pathcache_compile(path, len, hash, err))) return NULL;
+    cp->refcnt = 1;
+    if (!_cache.cap) return cp;
+
+    if (!_cache.buckets) PathCache_SetCapacity(_cache.cap);
+    if (_cache.count == _cache.cap) __pathcache_evict(_cache.oldest);
+    uint32_t b = hash & (_cache.nbuckets - 1);
+    cp->next = _cache.buckets[b];
+    _cache.buckets[b] = cp;
+    __pathcache_pushnewest(cp);
+    cp->refcnt++;
+    _cache.count++;
+    return cp;
+}
+
+void PathCache_Release(CompiledPath *cp) {
+    if (!--cp->refcnt) __pathcache_free(cp);
+}
+
+void PathCache_SetCapacity(size_t cap) {
+    while (_cache.count > cap) __pathcache_evict(_cache.oldest);
+    _cache.cap = cap;
+
+    // rehash into a table that's at least twice the capacity
+    uint32_t nbuckets = 16;
+    while (nbuckets < cap * 2 && nbuckets < (1u << 30)) nbuckets *= 2;
+    if (nbuckets == _cache.nbuckets) return;
+    CompiledPath **buckets = calloc(nbuckets, sizeof(CompiledPath *));
+    for (CompiledPath *cp = _cache.oldest; cp; cp = cp->newer) {
+        cp->next = buckets[cp->hash & (nbuckets - 1)];
+        buckets[cp->hash & (nbuckets - 1)] = cp;
+    }
+    free(_cache.buckets);
+    _cache.buckets = buckets;
+    _cache.nbuckets = nbuckets;
+}
+
+void PathCache_Stats(size_t *count, uint64_t *hits, uint64_t *misses) {
+    if (count) *count = _cache.count;
+    if (hits) *hits = _cache.hits;
+    if (misses) *misses = _cache.misses;
+}
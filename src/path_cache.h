@@ -0,0 +1,62 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PATH_CACHE_H__
+#define __PATH_CACHE_H__
+
+#include <stdint.h>
+#include "json_path.h"
+
+/**
+* A bounded LRU cache of compiled JSON paths, keyed by the path's string. A compiled path is an
+* immutable search path with interned keys that's shared by all its users, so looking up a cached
+* path allocates nothing.
+* The cache isn't thread safe, it is meant for Redis' main thread.
+*/
+
+/* The default number of paths in the cache */
+#define PATH_CACHE_CAPACITY 256
+
+typedef struct CompiledPath {
+    SearchPath sp;                     // the search path, with interned keys
+    uint32_t refcnt;                   // a reference for the cache, and one for every user
+    uint32_t hash;                     // the hash of the path's string
+    struct CompiledPath *next;         // the next path in the cache's bucket
+    struct CompiledPath *prev, *newer; // the neighbours in the cache's LRU list
+    size_t len;                        // the length of the path's string
+    char str[];                        // the path's string
+} CompiledPath;
+
+/**
+* Returns the compiled path of a path's string with a new reference to it, compiling and caching it
+* if needed. Returns NULL and sets the optional err if the path is invalid.
+*/
+CompiledPath *PathCache_Get(const char *path, size_t len, JSONSearchPathError_t *err);
+
+/** Releases a reference to a compiled path, an evicted path is freed with its last reference */
+void PathCache_Release(CompiledPath *cp);
+
+/**
+* Sets the number of paths that are kept in the cache, evicting the least recently used as needed.
+* 0 disables the cache, so paths are compiled for every use.
+*/
+void PathCache_SetCapacity(size_t cap);
+
+/** Reports the number of cached paths, and the number of hits and misses so far */
+void PathCache_Stats(size_t *count, uint64_t *hits, uint64_t *misses);
+
+#endif
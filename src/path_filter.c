@@ -0,0 +1,430 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include "json_path.h"
+#include "path_filter.h"
+
+typedef enum {
+    PF_OR,      // any of the subexpressions
+    PF_AND,     // all of the subexpressions
+    PF_NOT,     // the negation of the single subexpression
+    PF_EXISTS,  // the first operand exists
+    PF_EQ,
+    PF_NE,
+    PF_LT,
+    PF_LE,
+    PF_GT,
+    PF_GE,
+} PathFilterOp;
+
+/* An operand of a comparison, either a value relative to the filtered node or a literal */
+typedef struct {
+    int relative;
+    SearchPath path;  // the relative path, that's empty for the node itself
+    Node *literal;    // the literal, NULL for a null
+} PathFilterOperand;
+
+struct PathFilter {
+    PathFilterOp op;
+    struct PathFilter **subs;  // the subexpressions of logical operators
+    int nsubs;
+    PathFilterOperand a, b;  // the operands of comparisons, existence checks only have a
+};
+
+/* === Parsing === */
+
+typedef struct {
+    const char *s;
+    size_t len;
+    size_t pos;
+    int depth;
+    char *err;
+    size_t erroffset;
+} _PathFilterParser;
+
+static PathFilter *__pf_parseOr(_PathFilterParser *p);
+
+static inline void __pf_skipws(_PathFilterParser *p) {
+    while (p->pos < p->len && isspace(p->s[p->pos])) p->pos++;
+}
+
+/* Checks whether the next characters are tok, and consumes them if they are */
+static int __pf_accept(_PathFilterParser *p, const char *tok) {
+    size_t len = strlen(tok);
+    if (p->len - p->pos < len || memcmp(p->s + p->pos, tok, len)) return 0;
+    p->pos += len;
+    return 1;
+}
+
+static void *__pf_error(_PathFilterParser *p, char *err, size_t offset) {
+    if (!p->err) {
+        p->err = err;
+        p->erroffset = offset;
+    }
+    return NULL;
+}
+
+static PathFilter *__pf_new(PathFilterOp op) {
+    PathFilter *f = calloc(1, sizeof(PathFilter));
+    f->op = op;
+    return f;
+}
+
+static void __pf_freeOperand(PathFilterOperand *o) {
+    if (o->relative) {
+        SearchPath_Free(&o->path);
+    } else {
+        Node_Free(o->literal);
+    }
+}
+
+/* The characters of a relative path, the brackets' quoted strings are skipped as a whole */
+static size_t __pf_pathLen(const char *s, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        char c = s[i];
+        if ('"' == c || '\'' == c) {
+            for (i++; i < len && s[i] != c; i++)
+                ;
+            if (i < len) i++;
+        } else if (isalnum(c) || (c && strchr("_$.[]-", c))) {
+            i++;
+        } else {
+            break;
+        }
+    }
+    return i;
+}
+
+static int __pf_parseString(_PathFilterParser *p, PathFilterOperand *o) {
+    char quote = p->s[p->pos];
+    size_t start = p->pos++;
+    char *buf = malloc(p->len - p->pos + 1);
+    size_t len = 0;
+    while (p->pos < p->len && p->s[p->pos] != quote) {
+        if ('\\' == p->s[p->pos] && ++p->pos == p->len) break;
+        buf[len++] = p->s[p->pos++];
+    }
+    if (p->pos == p->len) {
+        free(buf);
+        __pf_error(p, PATH_FILTER_STRING_ERR, start);
+        return 0;
+    }
+    p->pos++;  // the closing quote
+    o->literal = NewStringNode(buf, len);
+    free(buf);
+    return 1;
+}
+
+static int __pf_parseNumber(_PathFilterParser *p, PathFilterOperand *o) {
+    char buf[64];
+    size_t start = p->pos;
+    int isdouble = 0;
+    while (p->pos < p->len && p->s[p->pos] && strchr("0123456789+-.eE", p->s[p->pos])) {
+        isdouble |= NULL != strchr(".eE", p->s[p->pos]);
+        p->pos++;
+    }
+    size_t len = p->pos - start;
+    if (!len || len >= sizeof(buf)) {
+        __pf_error(p, PATH_FILTER_OPERAND_ERR, start);
+        return 0;
+    }
+    memcpy(buf, p->s + start, len);
+    buf[len] = '\0';
+
+    // integers are kept as such unless they overflow
+    char *end;
+    errno = 0;
+    if (!isdouble) {
+        long long ll = strtoll(buf, &end, 10);
+        if (!*end && !errno) {
+            o->literal = NewIntNode(ll);
+            return 1;
+        }
+    }
+    errno = 0;
+    double d = strtod(buf, &end);
+    if (*end || errno) {
+        __pf_error(p, PATH_FILTER_OPERAND_ERR, start);
+        return 0;
+    }
+    o->literal = NewDoubleNode(d);
+    return 1;
+}
+
+/* Checks whether the next characters are the keyword kw, that isn't the beginning of a word */
+static int __pf_acceptKeyword(_PathFilterParser *p, const char *kw) {
+    size_t len = strlen(kw);
+    if (p->len - p->pos < len || memcmp(p->s + p->pos, kw, len)) return 0;
+    if (p->pos + len < p->len && (isalnum(p->s[p->pos + len]) || '_' == p->s[p->pos + len]))
+        return 0;
+    p->pos += len;
+    return 1;
+}
+
+static int __pf_parseOperand(_PathFilterParser *p, PathFilterOperand *o) {
+    __pf_skipws(p);
+    *o = (PathFilterOperand){0};
+    if (p->pos == p->len) {
+        __pf_error(p, PATH_FILTER_OPERAND_ERR, p->pos);
+        return 0;
+    }
+
+    char c = p->s[p->pos];
+    if ('@' == c) {
+        size_t start = ++p->pos;
+        size_t len = __pf_pathLen(p->s + start, p->len - start);
+        o->relative = 1;
+        o->path = NewSearchPath(0);
+        p->pos += len;
+        if (len && (PARSE_OK != ParseJSONPath(p->s + start, len, &o->path, NULL) ||
+                    SearchPath_IsMulti(&o->path))) {
+            __pf_error(p, PATH_FILTER_PATH_ERR, start);
+            return 0;
+        }
+        return 1;
+    }
+    if ('"' == c || '\'' == c) return __pf_parseString(p, o);
+    if ('-' == c || isdigit(c)) return __pf_parseNumber(p, o);
+    if (__pf_acceptKeyword(p, "true")) {
+        o->literal = NewBoolNode(1);
+    } else if (__pf_acceptKeyword(p, "false")) {
+        o->literal = NewBoolNode(0);
+    } else if (!__pf_acceptKeyword(p, "null")) {
+        __pf_error(p, PATH_FILTER_OPERAND_ERR, p->pos);
+        return 0;
+    }
+    return 1;
+}
+
+static PathFilter *__pf_parseComparison(_PathFilterParser *p) {
+    static const struct {
+        const char *tok;
+        PathFilterOp op;
+    } ops[] = {{"==", PF_EQ}, {"!=", PF_NE}, {"<=", PF_LE}, {">=", PF_GE}, {"<", PF_LT}, {">", PF_GT}};
+    PathFilter *f = __pf_new(PF_EXISTS);
+
+    size_t start = p->pos;
+    if (!__pf_parseOperand(p, &f->a)) goto error;
+    __pf_skipws(p);
+    for (int i = 0; i < sizeof(ops) / sizeof(ops[0]) && PF_EXISTS == f->op; i++) {
+        if (__pf_accept(p, ops[i].tok)) f->op = ops[i].op;
+    }
+    if (PF_EXISTS != f->op && !__pf_parseOperand(p, &f->b)) goto error;
+    if (!f->a.relative && !f->b.relative) {
+        __pf_error(p, PF_EXISTS == f->op ? PATH_FILTER_OPERATOR_ERR : PATH_FILTER_LITERALS_ERR,
+                   start);
+        goto error;
+    }
+    return f;
+
+error:
+    PathFilter_Free(f);
+    return NULL;
+}
+
+static PathFilter *__pf_parseUnary(_PathFilterParser *p) {
+    __pf_skipws(p);
+    int nested = p->pos < p->len && ('(' == p->s[p->pos] || '!' == p->s[p->pos]);
+    if (!nested) return __pf_parseComparison(p);
+    if (++p->depth > PATH_FILTER_MAX_DEPTH) return __pf_error(p, PATH_FILTER_DEPTH_ERR, p->pos);
+
+    PathFilter *f;
+    if (__pf_accept(p, "!")) {
+        PathFilter *sub = __pf_parseUnary(p);
+        if (!sub) return NULL;
+        f = __pf_new(PF_NOT);
+        f->subs = malloc(sizeof(PathFilter *));
+        f->subs[f->nsubs++] = sub;
+    } else {
+        p->pos++;
+        if (!(f = __pf_parseOr(p))) return NULL;
+        __pf_skipws(p);
+        if (!__pf_accept(p, ")")) {
+            PathFilter_Free(f);
+            return __pf_error(p, PATH_FILTER_CLOSE_ERR, p->pos);
+        }
+    }
+    p->depth--;
+    return f;
+}
+
+/* Parses a list of the subexpressions that are joined by the operator's token */
+static PathFilter *__pf_parseList(_PathFilterParser *p, PathFilterOp op, const char *tok,
+                                  PathFilter *(*parse)(_PathFilterParser *)) {
+    PathFilter *sub = parse(p);
+    if (!sub) return NULL;
+    __pf_skipws(p);
+    if (p->len - p->pos < 2 || memcmp(p->s + p->pos, tok, 2)) return sub;
+
+    PathFilter *f = __pf_new(op);
+    int cap = 2;
+    f->subs = malloc(cap * sizeof(PathFilter *));
+    f->subs[f->nsubs++] = sub;
+    while (__pf_accept(p, tok)) {
+        if (!(sub = parse(p))) {
+            PathFilter_Free(f);
+            return NULL;
+        }
+        if (f->nsubs == cap) f->subs = realloc(f->subs, (cap *= 2) * sizeof(PathFilter *));
+        f->subs[f->nsubs++] = sub;
+        __pf_skipws(p);
+    }
+    return f;
+}
+
+static PathFilter *__pf_parseAnd(_PathFilterParser *p) {
+    return __pf_parseList(p, PF_AND, "&&", __pf_parseUnary);
+}
+
+static PathFilter *__pf_parseOr(_PathFilterParser *p) {
+    return __pf_parseList(p, PF_OR, "||", __pf_parseAnd);
+}
+
+PathFilter *PathFilter_Parse(const char *s, size_t len, size_t *consumed, char **errmsg,
+                             size_t *erroffset) {
+    _PathFilterParser p = {.s = s, .len = len};
+
+    // the filter's parentheses are these of its expression
+    PathFilter *f = NULL;
+    if (!len || '(' != *s) {
+        __pf_error(&p, PATH_FILTER_OPEN_ERR, 0);
+    } else {
+        f = __pf_parseUnary(&p);
+    }
+    if (!f) {
+        *errmsg = p.err;
+        *erroffset = p.erroffset;
+        return NULL;
+    }
+    *consumed = p.pos;
+    return f;
+}
+
+void PathFilter_Free(PathFilter *f) {
+    if (!f) return;
+    for (int i = 0; i < f->nsubs; i++) PathFilter_Free(f->subs[i]);
+    free(f->subs);
+    __pf_freeOperand(&f->a);
+    __pf_freeOperand(&f->b);
+    free(f);
+}
+
+/* === Evaluation === */
+
+/* Sets v to the operand's value for the node n, returns 0 if there's no such value. The items of
+ * packed arrays are copied to tmp. */
+static int __pf_value(const PathFilterOperand *o, Node *n, Node *tmp, Node **v) {
+    if (!o->relative) {
+        *v = o->literal;
+        return 1;
+    }
+    for (int i = 0; i < o->path.len; i++) {
+        PathNode *pn = &o->path.nodes[i];
+        if (NT_KEY == pn->type) {
+            if (!n || N_DICT != n->type || OBJ_OK != Node_DictGet(n, pn->value.key, &n)) return 0;
+        } else if (NT_INDEX == pn->type) {
+            if (!n || N_ARRAY != n->type) return 0;
+            int index = pn->value.index;
+            if (index < 0) index += n->value.arrval.len;
+            if (OBJ_OK != Node_ArrayItemView(n, index, tmp, &n)) return 0;
+        }
+    }
+    *v = n;
+    return 1;
+}
+
+/* Compares two values into cmp. Returns 2 if they are ordered, 1 if they only compare for
+ * equality and 0 if they don't compare at all. */
+static int __pf_compare(const Node *a, const Node *b, int *cmp) {
+    NodeType ta = a ? a->type : N_NULL;
+    NodeType tb = b ? b->type : N_NULL;
+
+    if ((ta & (N_INTEGER | N_NUMBER)) && (tb & (N_INTEGER | N_NUMBER))) {
+        if (N_INTEGER == ta && N_INTEGER == tb) {
+            *cmp = (a->value.intval > b->value.intval) - (a->value.intval < b->value.intval);
+        } else {
+            double x = N_INTEGER == ta ? (double)a->value.intval : Node_Number(a);
+            double y = N_INTEGER == tb ? (double)b->value.intval : Node_Number(b);
+            *cmp = (x > y) - (x < y);
+        }
+        return 2;
+    }
+    if (ta != tb) return 0;
+    switch (ta) {
+        case N_STRING: {
+            uint32_t la = a->value.strval.len, lb = b->value.strval.len;
+            char *tmpa, *tmpb;
+            int c = memcmp(Node_StringData(a, &tmpa), Node_StringData(b, &tmpb), MIN(la, lb));
+            *cmp = c ? c : (la > lb) - (la < lb);
+            free(tmpa);
+            free(tmpb);
+            return 2;
+        }
+        case N_BOOLEAN:
+            *cmp = !a->value.boolval != !b->value.boolval;
+            return 1;
+        case N_NULL:
+            *cmp = 0;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int PathFilter_Match(const PathFilter *f, Node *n) {
+    switch (f->op) {
+        case PF_OR:
+            for (int i = 0; i < f->nsubs; i++)
+                if (PathFilter_Match(f->subs[i], n)) return 1;
+            return 0;
+        case PF_AND:
+            for (int i = 0; i < f->nsubs; i++)
+                if (!PathFilter_Match(f->subs[i], n)) return 0;
+            return 1;
+        case PF_NOT:
+            return !PathFilter_Match(f->subs[0], n);
+        default:
+            break;
+    }
+
+    Node tmpa, tmpb, *a, *b;
+    if (!__pf_value(&f->a, n, &tmpa, &a)) return 0;
+    if (PF_EXISTS == f->op) return 1;
+    if (!__pf_value(&f->b, n, &tmpb, &b)) return 0;
+
+    int cmp;
+    int c = __pf_compare(a, b, &cmp);
+    switch (f->op) {
+        case PF_EQ:
+            return c && !cmp;
+        case PF_NE:
+            return !c || cmp;
+        case PF_LT:
+            return 2 == c && cmp < 0;
+        case PF_LE:
+            return 2 == c && cmp <= 0;
+        case PF_GT:
+            return 2 == c && cmp > 0;
+        case PF_GE:
+            return 2 == c && cmp >= 0;
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,65 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PATH_FILTER_H__
+#define __PATH_FILTER_H__
+
+#include "path.h"
+
+#ifdef REDIS_MODULE_TARGET
+#include <alloc.h>
+#endif
+
+#define PATH_FILTER_OPEN_ERR "expecting a left parenthesis to begin the filter"
+#define PATH_FILTER_CLOSE_ERR "expecting a right parenthesis"
+#define PATH_FILTER_OPERAND_ERR "expecting a relative path (@), a string, a number, true, false or null"
+#define PATH_FILTER_OPERATOR_ERR "expecting a comparison (==, !=, <, <=, > or >=), && or ||"
+#define PATH_FILTER_STRING_ERR "the string ends in the middle of an escape or without a closing quote"
+#define PATH_FILTER_PATH_ERR "a relative path in a filter must be a valid path of a single value"
+#define PATH_FILTER_LITERALS_ERR "a comparison must have at least one relative path (@)"
+#define PATH_FILTER_DEPTH_ERR "the filter's parentheses are nested too deeply"
+
+/* The maximal nesting of parentheses and negations in a filter */
+#define PATH_FILTER_MAX_DEPTH 32
+
+/**
+* A compiled filter expression of a path, e.g. `?(@.status == "open" && @.price < 10)`.
+* It is made of comparisons (==, !=, <, <=, > and >=) between a value that a path relative to the
+* filtered node (@) selects and a scalar literal, or another relative value, that are combined with
+* && and || and negated with ! in the usual precedence. A relative path on its own checks that its
+* value exists.
+* Numbers compare with numbers and strings compare with strings, booleans and nulls only compare
+* for equality, and != is true for any two values that aren't equal. Other comparisons of values of
+* different types are false, as are all comparisons with a value that doesn't exist.
+* Strings are quoted with single or double quotes, in which a backslash escapes the next character.
+*/
+typedef struct PathFilter PathFilter;
+
+/**
+* Compiles the parenthesized filter expression at the beginning of s, that's len long, and sets
+* consumed to its length. On errors NULL is returned, and errmsg and erroffset are set.
+*/
+PathFilter *PathFilter_Parse(const char *s, size_t len, size_t *consumed, char **errmsg,
+                             size_t *erroffset);
+
+/** Checks whether a node satisfies the filter */
+int PathFilter_Match(const PathFilter *f, Node *n);
+
+/** Frees a filter */
+void PathFilter_Free(PathFilter *f);
+
+#endif
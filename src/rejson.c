@@ -19,7 +19,7 @@
 #include "rejson.h"
 
 // == Helpers ==
-#define NODEVALUE_AS_DOUBLE(n) (N_INTEGER == n->type ? (double)n->value.intval : n->value.numval)
+#define NODEVALUE_AS_DOUBLE(n) (N_INTEGER == n->type ? (double)n->value.intval : Node_Number(n))
 #define NODETYPE(n) (n ? n->type : N_NULL)
 
 /* Returns the string representation of a the node's type. */
@@ -55,7 +55,9 @@ typedef struct {
     size_t spathlen;    // the path's string length
     Node *n;            // the referenced node
     Node *p;            // its parent
+    Node item;          // the copy that n points to when it's an item of a packed array
     SearchPath sp;      // the search path
+    CompiledPath *cp;   // the compiled path that the search path belongs to
     char *sperrmsg;     // the search path error message
     size_t sperroffset; // the search path error offset
     PathError err;      // set in case of path error
@@ -63,40 +65,225 @@ typedef struct {
 } JSONPathNode_t;
 
 /* Call this to free the struct's contents. */
-void JSONPathNode_Free(JSONPathNode_t *jpn) { SearchPath_Free(&jpn->sp); }
+void JSONPathNode_Free(JSONPathNode_t *jpn) {
+    if (jpn->cp) PathCache_Release(jpn->cp);
+    jpn->cp = NULL;
+}
 
-/* Sets n to the target node by path.
- * p is n's parent, errors are set into err and level is the error's depth
- * Returns PARSE_OK if parsing successful
-*/
-int NodeFromJSONPath(Node *root, const RedisModuleString *path, JSONPathNode_t *jpn) {
-    // initialize everything
-    *jpn = (JSONPathNode_t){ 0 };
-    jpn->errlevel = -1;
+/* Compiles the path into jpn with the shared path cache, returns PARSE_OK if parsing successful */
+static int JSONPathNode_Compile(const RedisModuleString *path, JSONPathNode_t *jpn) {
     JSONSearchPathError_t jsperr = { 0 };
 
-    // path must be valid from the root or it's an error
-    jpn->sp = NewSearchPath(0);
+    *jpn = (JSONPathNode_t){ 0 };
+    jpn->errlevel = -1;
     jpn->spath = RedisModule_StringPtrLen(path, &jpn->spathlen);
-    if (PARSE_ERR == ParseJSONPath(jpn->spath, jpn->spathlen, &jpn->sp, &jsperr)) {
-        SearchPath_Free(&jpn->sp);
-        jpn->sp.nodes = NULL;   // in case someone tries to free it later
+    jpn->cp = PathCache_Get(jpn->spath, jpn->spathlen, &jsperr);
+    if (!jpn->cp) {
         jpn->sperrmsg = jsperr.errmsg;
         jpn->sperroffset = jsperr.offset;
         return PARSE_ERR;
     }
+    jpn->sp = jpn->cp->sp;
+    return PARSE_OK;
+}
 
-    // if there are any errors return them
+/* Reads that index a container for the lookups after them (see Node_ArraySetIndexed and
+ * Node_DictPrefixScan) are put between these, as the document's arena frees the indexes of its
+ * nodes. Path lookups themselves don't change the document, but indexing sets the container's
+ * flags, so its path is resolved with NodeFromJSONPathMutable first, as a snapshot's thread may
+ * read the container if it's shared. */
+#define JSONTYPE_INDEXING_BEGIN(jt) NodeArena *_prevarena = Node_SetArena((jt)->arena)
+#define JSONTYPE_INDEXING_END() Node_SetArena(_prevarena)
+
+/* Copies the target node of a resolved path, which can be a copy of an item of a packed array */
+static Node *JSONPathNode_Clone(const JSONPathNode_t *jpn) {
+    if (jpn->n != &jpn->item) return Node_Clone(jpn->n);
+    return N_INTEGER == jpn->item.type ? NewIntNode(jpn->item.value.intval)
+                                       : NewDoubleNode(jpn->item.value.numval);
+}
+
+/* Sets jpn's target node from its compiled path, errors are set into err */
+static void JSONPathNode_Resolve(JSONType_t *jt, JSONPathNode_t *jpn) {
     if (!SearchPath_IsRootPath(&jpn->sp)) {
-        jpn->err = SearchPath_FindEx(&jpn->sp, root, &jpn->n, &jpn->p, &jpn->errlevel);
+        jpn->err =
+            SearchPath_FindEx(&jpn->sp, jt->root, &jpn->item, &jpn->n, &jpn->p, &jpn->errlevel);
     } else {
         // deal with edge case of setting root's parent
-        jpn->n = root;
+        jpn->err = E_OK;
+        jpn->n = jt->root;
+    }
+}
+
+/* Resolves several compiled paths at once, walking the prefixes that they share once */
+static void JSONPathNode_ResolveAll(JSONType_t *jt, JSONPathNode_t *jpns, int len) {
+    if (1 == len) {
+        JSONPathNode_Resolve(jt, &jpns[0]);
+        return;
+    }
+    SearchPathMatch matches[len];
+    for (int i = 0; i < len; i++) matches[i].path = &jpns[i].sp;
+    SearchPath_FindAll(matches, len, jt->root);
+    for (int i = 0; i < len; i++) {
+        jpns[i].n = matches[i].n;
+        const Node *p = matches[i].p;
+        if (E_OK == matches[i].err && p && N_ARRAY == p->type && (p->flags & NODE_F_PACKED)) {
+            // the copies of packed items outlive the matches
+            jpns[i].item = *matches[i].n;
+            jpns[i].n = &jpns[i].item;
+        }
+        jpns[i].p = matches[i].p;
+        jpns[i].err = matches[i].err;
+        if (E_OK != matches[i].err) jpns[i].errlevel = matches[i].errnode;
+    }
+}
+
+/* Sets n to the target node by path in the document.
+ * p is n's parent, errors are set into err and level is the error's depth
+ * Returns PARSE_OK if parsing successful
+*/
+int NodeFromJSONPath(JSONType_t *jt, const RedisModuleString *path, JSONPathNode_t *jpn) {
+    uint64_t begin = Stats_Begin();
+
+    // path must be valid from the root or it's an error
+    if (PARSE_OK != JSONPathNode_Compile(path, jpn)) {
+        Stats_End(STATS_PATH, begin, jpn->spathlen, 0, 1);
+        return PARSE_ERR;
+    }
+
+    // if there are any errors return them
+    JSONPathNode_Resolve(jt, jpn);
+    Stats_End(STATS_PATH, begin, jpn->spathlen, 0, E_OK != jpn->err);
+    Stats_PathDepth(jpn->sp.len);
+    return PARSE_OK;
+}
+
+/**
+* Like NodeFromJSONPath, for a command that writes to the values at the path: the document gets the
+* nodes on the path's way of its own before they're looked up, and with deep set the descendants of
+* its value too, see JSONTypeAccessPath.
+*/
+static int NodeFromJSONPathMutable(JSONType_t *jt, const RedisModuleString *path,
+                                   JSONPathNode_t *jpn, int deep) {
+    uint64_t begin = Stats_Begin();
+    if (PARSE_OK != JSONPathNode_Compile(path, jpn)) {
+        Stats_End(STATS_PATH, begin, jpn->spathlen, 0, 1);
+        return PARSE_ERR;
     }
 
+    // the time of the copies is counted apart from the lookup's
+    uint64_t compiled = Stats_Begin();
+    JSONTypeAccessPath(jt, &jpn->sp, deep);
+    begin += Stats_Begin() - compiled;
+    JSONPathNode_Resolve(jt, jpn);
+    Stats_End(STATS_PATH, begin, jpn->spathlen, 0, E_OK != jpn->err);
+    Stats_PathDepth(jpn->sp.len);
     return PARSE_OK;
 }
 
+static void JSONPath_SerializeMatch(Node *n, Node *p, const char *key, int index, void *ctx) {
+    JSONSerializer_Value(ctx, n);
+}
+
+/* The values that a path matches in MessagePack or CBOR, counted before they are encoded */
+typedef struct {
+    PackFormat format;
+    sds *buf;
+    uint32_t count;
+} JSONPackMatches;
+
+static void JSONPath_CountMatch(Node *n, Node *p, const char *key, int index, void *ctx) {
+    ((JSONPackMatches *)ctx)->count++;
+}
+
+static void JSONPath_PackMatch(Node *n, Node *p, const char *key, int index, void *ctx) {
+    JSONPackMatches *m = ctx;
+    SerializeNodeToPack(n, m->format, m->buf);
+}
+
+/* Serializes the array of the values that jpn's path matches in the document, for paths that can
+ * match multiple values */
+static void JSONPathNode_SerializeMatches(JSONType_t *jt, JSONPathNode_t *jpn, JSONSerializer *s) {
+    JSONSerializer_BeginArray(s);
+    SearchPath_FindEach(&jpn->sp, jt->root, JSONPath_SerializeMatch, s);
+    JSONSerializer_End(s);
+}
+
+/* Like JSONPathNode_SerializeMatches, but appends the array of the matches to buf in a format */
+static void JSONPathNode_PackMatches(JSONType_t *jt, JSONPathNode_t *jpn, PackFormat format,
+                                     sds *buf) {
+    JSONPackMatches m = {format, buf, 0};
+    SearchPath_FindEach(&jpn->sp, jt->root, JSONPath_CountMatch, &m);
+    Pack_BeginArray(format, m.count, buf);
+    SearchPath_FindEach(&jpn->sp, jt->root, JSONPath_PackMatch, &m);
+}
+
+/**
+* Parses the name of a format of values, MSGPACK or CBOR, which sets packed and format, or JSON,
+* which clears packed. Returns REDISMODULE_ERR for other names.
+*/
+static int JSONFormat_Parse(RedisModuleString *name, int *packed, PackFormat *format) {
+    const char *s = RedisModule_StringPtrLen(name, NULL);
+    *packed = 1;
+    if (!strcasecmp("msgpack", s)) {
+        *format = PACK_MSGPACK;
+    } else if (!strcasecmp("cbor", s)) {
+        *format = PACK_CBOR;
+    } else if (!strcasecmp("json", s)) {
+        *packed = 0;
+    } else {
+        return REDISMODULE_ERR;
+    }
+    return REDISMODULE_OK;
+}
+
+/* A value that a path matches, by its container and its key or index in it */
+typedef struct {
+    Node *p;
+    const char *key;
+    int index;
+} JSONPathMatch_t;
+
+typedef struct {
+    JSONPathMatch_t *items;
+    size_t len;
+    size_t cap;
+} JSONPathMatches_t;
+
+static void JSONPath_CollectMatch(Node *n, Node *p, const char *key, int index, void *ctx) {
+    JSONPathMatches_t *m = ctx;
+    if (!p) return;  // the root can't be changed in place
+    if (m->len == m->cap) {
+        m->cap = m->cap ? m->cap * 2 : 16;
+        m->items = realloc(m->items, m->cap * sizeof(JSONPathMatch_t));
+    }
+    m->items[m->len++] = (JSONPathMatch_t){p, key, index};
+}
+
+/* Collects the places of the values that jpn's path matches in the document, in document order.
+ * Paths with a recursive descent aren't accepted, as their matches can be nested in each other. */
+static int JSONPathNode_CollectMatches(JSONType_t *jt, JSONPathNode_t *jpn, JSONPathMatches_t *m) {
+    if (SearchPath_HasDescent(&jpn->sp)) return 0;
+    *m = (JSONPathMatches_t){0};
+    SearchPath_FindEach(&jpn->sp, jt->root, JSONPath_CollectMatch, m);
+    return 1;
+}
+
+/* Sets n to the current value of a match, an item of a packed array is copied to tmp */
+static void JSONPath_MatchValue(const JSONPathMatch_t *m, Node *tmp, Node **n) {
+    if (m->key)
+        Node_DictGet(m->p, m->key, n);
+    else
+        Node_ArrayItemView(m->p, m->index, tmp, n);
+}
+
+/* Checks whether a path is the root path without resolving it. */
+static int JSONPath_IsRootPath(const RedisModuleString *path) {
+    JSONPathNode_t jpn;
+    int ret = PARSE_OK == JSONPathNode_Compile(path, &jpn) && SearchPath_IsRootPath(&jpn.sp);
+    JSONPathNode_Free(&jpn);
+    return ret;
+}
+
 /* Replies with an error about a search path */
 void ReplyWithSearchPathError(RedisModuleCtx *ctx, JSONPathNode_t *jpn) {
     sds err = sdscatfmt(sdsempty(), "ERR Search path error at offset %I: %s",
@@ -139,6 +326,10 @@ void ReplyWithPathError(RedisModuleCtx *ctx, const JSONPathNode_t *jpn) {
             err = sdscatfmt(err, "ERR key '%s' does not exist at level %i in path", epn->value.key,
                             jpn->errlevel);
             break;
+        case E_MULTI:
+            err = sdscatfmt(err, "ERR path matches multiple values at level %i in path",
+                            jpn->errlevel);
+            break;
         default:
             err = sdscatfmt(err, "ERR unknown path error at level %i in path", jpn->errlevel);
             break;
@@ -147,17 +338,298 @@ void ReplyWithPathError(RedisModuleCtx *ctx, const JSONPathNode_t *jpn) {
     sdsfree(err);
 }
 
-/* The custom Redis data type. */
+// == Effects replication ==
+
+/**
+* Write commands replicate their effects instead of themselves when this is set, with the
+* REPLICATE_EFFECTS module argument. An effect is a JSON._APPLY of a resolved path and of values in
+* the binary encoding, so replicas and the AOF neither parse JSON nor compute results or look up the
+* commands' paths. JSON.DEL, JSON.STRAPPEND, JSON.MERGE, JSON.PATCH and writes to paths of multiple
+* values are replicated as they are.
+*/
+static int JSONReplicateEffects = 0;
+
+/**
+* Encodes the resolved path of a single value for JSON._APPLY, as an array of its keys and of its
+* indexes, made non-negative. The path must exist in the document up to the value's parent.
+*/
+static sds JSONEffect_Path(JSONType_t *jt, const SearchPath *sp) {
+    Node *path = NewArrayNode(sp->len), *n = jt->root, tmp;
+    for (int i = 0; i < sp->len; i++) {
+        const PathNode *pn = &sp->nodes[i];
+        if (NT_KEY == pn->type) {
+            Node_ArrayAppend(path, NewStringNode(pn->value.key, strlen(pn->value.key)));
+            if (i < sp->len - 1) {
+                if (sp->interned) {
+                    Node_DictGetInterned(n, pn->value.key, &n);
+                } else {
+                    Node_DictGet(n, pn->value.key, &n);
+                }
+            }
+        } else if (NT_INDEX == pn->type) {
+            int index = pn->value.index < 0 ? Node_Length(n) + pn->value.index : pn->value.index;
+            Node_ArrayAppend(path, NewIntNode(index));
+            if (i < sp->len - 1) Node_ArrayItemView(n, index, &tmp, &n);
+        }
+    }
+    sds buf = sdsempty();
+    SerializeNodeToBinary(path, &buf);
+    Node_Free(path);
+    return buf;
+}
+
+/**
+* Replicates the effect of setting a value at a path of a single value. The root of a lazy document
+* is replicated as a JSON.SET of its text instead, which keeps it lazy on replicas.
+*/
+static void JSONEffect_Set(RedisModuleCtx *ctx, RedisModuleString *key, JSONType_t *jt,
+                           const SearchPath *sp, const Node *value) {
+    if (SearchPath_IsRootPath(sp) && jt->raw) {
+        RedisModule_Replicate(ctx, "JSON.SET", "scb", key, OBJECT_ROOT_PATH, jt->raw,
+                              sdslen(jt->raw));
+        return;
+    }
+    sds path = JSONEffect_Path(jt, sp), buf = sdsempty();
+    SerializeNodeToBinary(value, &buf);
+    RedisModule_Replicate(ctx, "JSON._APPLY", "sbcb", key, path, sdslen(path), "SET", buf,
+                          sdslen(buf));
+    sdsfree(path);
+    sdsfree(buf);
+}
+
+/* Replicates the effect of inserting values, the encoding of an array of them, at an index of the
+ * array at a path */
+static void JSONEffect_Insert(RedisModuleCtx *ctx, RedisModuleString *key, JSONType_t *jt,
+                              const SearchPath *sp, long long index, sds values) {
+    sds path = JSONEffect_Path(jt, sp);
+    RedisModule_Replicate(ctx, "JSON._APPLY", "sbclb", key, path, sdslen(path), "INSERT", index,
+                          values, sdslen(values));
+    sdsfree(path);
+}
+
+/* Replicates the effect of deleting count items from an index of the array at a path */
+static void JSONEffect_DelRange(RedisModuleCtx *ctx, RedisModuleString *key, JSONType_t *jt,
+                                const SearchPath *sp, long long index, long long count) {
+    sds path = JSONEffect_Path(jt, sp);
+    RedisModule_Replicate(ctx, "JSON._APPLY", "sbcll", key, path, sdslen(path), "DELRANGE", index,
+                          count);
+    sdsfree(path);
+}
+
+// == Change notifications ==
+
+/**
+* Write commands publish the paths that they change when this is set, with the NOTIFY_PATHS module
+* argument, on a channel of their key: `__jsonpath@<db>__:<key>`. A message is the command's event,
+* e.g. `json.numincrby`, a space and the canonical path of the values that changed, see
+* JSONNotify_PathString. Clients that cache the values of documents subscribe to the channels of
+* their keys, and drop the cached values at, in or around the path rather than whole documents.
+* Every change is also a keyspace event of the generic class with the same name, whether or not
+* this is set, on servers that have keyspace notifications.
+*/
+static int JSONNotifyPaths = 0;
+
+/* The server's notification APIs, looked up when the module is loaded */
+static int (*_notifyKeyspaceEvent)(RedisModuleCtx *ctx, int type, const char *event,
+                                   RedisModuleString *key) = NULL;
+static int (*_publishMessage)(RedisModuleCtx *ctx, RedisModuleString *channel,
+                              RedisModuleString *message) = NULL;
+
+/* The class of keyspace events of generic commands, which redismodule.h predates */
+#define JSON_NOTIFY_GENERIC (1 << 2)
+
+/**
+* The canonical path of the values that a write at a path changed: the path up to its first node
+* that can match multiple values, with keys written as JSONTypeKeyPath does and negative indices
+* resolved in the document as it is. A key that paths can't express, or an index that doesn't
+* resolve, ends the path there too, so the path always holds all the values that changed.
+*/
+static sds JSONNotify_PathString(JSONType_t *jt, const SearchPath *sp) {
+    sds path = sdsnew(OBJECT_ROOT_PATH);
+    Node tmp, *n = jt->root;  // tmp holds an item of a packed array, which has no children
+    for (int i = 0; i < sp->len; i++) {
+        const PathNode *pn = &sp->nodes[i];
+        if (NT_INDEX == pn->type) {
+            int index = pn->value.index;
+            if (index < 0 && N_ARRAY == NODETYPE(n)) index += Node_Length(n);
+            if (index < 0) break;
+            if (!strcmp(OBJECT_ROOT_PATH, path)) sdsclear(path);
+            path = sdscatprintf(path, "[%d]", index);
+            if (N_ARRAY != NODETYPE(n) || OBJ_OK != Node_ArrayItemView(n, index, &tmp, &n)) {
+                n = NULL;
+            }
+        } else if (NT_KEY == pn->type) {
+            sds next = JSONTypeKeyPath(path, pn->value.key);
+            if (!next) break;
+            sdsfree(path);
+            path = next;
+            int found = N_DICT == NODETYPE(n) &&
+                        OBJ_OK == (sp->interned ? Node_DictGetInterned(n, pn->value.key, &n)
+                                                : Node_DictGet(n, pn->value.key, &n));
+            if (!found) n = NULL;
+        } else if (NT_ROOT != pn->type) {
+            break;
+        }
+    }
+    return path;
+}
+
+/**
+* Notifies a change of the values at a path of a key's document, or of the whole document if sp is
+* NULL, e.g. when it's deleted or replaced.
+*/
+static void JSONNotify(RedisModuleCtx *ctx, RedisModuleString *key, const char *event,
+                       JSONType_t *jt, const SearchPath *sp) {
+    if (_notifyKeyspaceEvent) _notifyKeyspaceEvent(ctx, JSON_NOTIFY_GENERIC, event, key);
+    if (!JSONNotifyPaths || !_publishMessage) return;
+
+    sds path = jt && sp ? JSONNotify_PathString(jt, sp) : sdsnew(OBJECT_ROOT_PATH);
+    size_t len;
+    const char *k = RedisModule_StringPtrLen(key, &len);
+    sds channel = sdscatprintf(sdsempty(), "__jsonpath@%d__:", RedisModule_GetSelectedDb(ctx));
+    channel = sdscatlen(channel, k, len);
+    sds message = sdscatprintf(sdsempty(), "%s %s", event, path);
+    RedisModuleString *c = RedisModule_CreateString(ctx, channel, sdslen(channel));
+    RedisModuleString *m = RedisModule_CreateString(ctx, message, sdslen(message));
+    _publishMessage(ctx, c, m);
+    RedisModule_FreeString(ctx, c);
+    RedisModule_FreeString(ctx, m);
+    sdsfree(channel);
+    sdsfree(message);
+    sdsfree(path);
+}
+
+/* The custom Redis data types. */
 static RedisModuleType *JSONType;
+static RedisModuleType *JSONIndexType;
+
+// == Context flags ==
+
+/* The context flags of Redis 6 that the module checks, which redismodule.h predates */
+#define JSON_CTX_FLAGS_LUA (1 << 0)
+#define JSON_CTX_FLAGS_MULTI (1 << 1)
+#define JSON_CTX_FLAGS_SLAVE (1 << 7)
+#define JSON_CTX_FLAGS_REPLICATED (1 << 12)
+#define JSON_CTX_FLAGS_LOADING (1 << 13)
+#define JSON_CTX_FLAGS_RESP3 (1 << 22)
+
+static int (*_getContextFlags)(RedisModuleCtx *ctx) = NULL;
+static int _getContextFlagsResolved = 0;
+
+/* Returns the flags of a context, or 0 on servers that can't report them */
+static int JSON_GetContextFlags(RedisModuleCtx *ctx) {
+    if (!_getContextFlagsResolved) {
+        if (REDISMODULE_OK !=
+            RedisModule_GetApi("RedisModule_GetContextFlags", (void **)&_getContextFlags))
+            _getContextFlags = NULL;
+        _getContextFlagsResolved = 1;
+    }
+    return _getContextFlags ? _getContextFlags(ctx) : 0;
+}
+
+// == Path expiry ==
+
+/* RedisModule_CreateTimer, which redismodule.h predates, resolved by RedisModule_OnLoad */
+typedef void (*JSONExpire_TimerProc)(RedisModuleCtx *ctx, void *data);
+static uint64_t (*_createTimer)(RedisModuleCtx *ctx, long long period,
+                                JSONExpire_TimerProc callback, void *data) = NULL;
+
+/* Expiries are only applied by masters, replicas and loads get the deletions as JSON.DEL */
+static inline int JSONExpire_CanDelete(RedisModuleCtx *ctx) {
+    return !(JSON_GetContextFlags(ctx) & (JSON_CTX_FLAGS_SLAVE | JSON_CTX_FLAGS_LOADING));
+}
+
+/* Deletes the value at an expired path of a document, if it has one, and replicates that with
+ * JSON.PERSIST and JSON.DEL so replicas drop the expiry too */
+static void JSONExpire_DeletePath(RedisModuleCtx *ctx, JSONType_t *jt, RedisModuleString *keyname,
+                                  sds path) {
+    JSONPathNode_t jpn;
+    RedisModuleString *spath = RedisModule_CreateString(ctx, path, sdslen(path));
+    if (PARSE_OK == NodeFromJSONPathMutable(jt, spath, &jpn, 0) && E_OK == jpn.err && jpn.p) {
+        const PathNode *last = &jpn.sp.nodes[jpn.sp.len - 1];
+        JSONTypeTouch(jt);
+        JSONNotify(ctx, keyname, "json.expired", jt, &jpn.sp);
+        if (N_DICT == NODETYPE(jpn.p)) {
+            Node_DictDel(jpn.p, last->value.key);
+        } else {
+            Node_ArrayDelRange(jpn.p, last->value.index, 1);
+        }
+        RedisModule_Replicate(ctx, "JSON.PERSIST", "ss", keyname, spath);
+        RedisModule_Replicate(ctx, "JSON.DEL", "ss", keyname, spath);
+    }
+    JSONPathNode_Free(&jpn);
+    RedisModule_FreeString(ctx, spath);
+}
+
+/* Deletes up to max paths of a document that are due by now, returns the number deleted */
+static size_t JSONExpire_DeleteDue(RedisModuleCtx *ctx, JSONType_t *jt, RedisModuleString *keyname,
+                                   long long now, size_t max) {
+    size_t count = 0;
+    sds path;
+    while (count < max && (path = JSONExpire_TakeDue(jt, now))) {
+        JSONExpire_DeletePath(ctx, jt, keyname, path);
+        sdsfree(path);
+        count++;
+    }
+    return count;
+}
+
+/**
+* Expires the due paths of the document of a key that a command accesses, before the command reads
+* it, and records the key that the document is at for the timer. Called by every command that
+* accesses documents, after checking that the key holds one.
+*/
+static void JSONExpire_Apply(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModuleString *keyname) {
+    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    if (!jt->expires) return;
+    JSONExpire_Track(ctx, jt, keyname);
+    if (JSONExpire_CanDelete(ctx))
+        JSONExpire_DeleteDue(ctx, jt, keyname, RedisModule_Milliseconds(), SIZE_MAX);
+}
+
+/**
+* The expiry timer's tick, which deletes up to JSONEXPIRE_CYCLE_PATHS due paths, the earliest
+* first, and rearms the timer. A due document whose key no longer holds it is parked until it's
+* accessed again.
+*/
+static void JSONExpire_Cycle(RedisModuleCtx *ctx, void *data) {
+    if (JSONExpire_CanDelete(ctx)) {
+        long long now = RedisModule_Milliseconds();
+        int db = RedisModule_GetSelectedDb(ctx);
+        size_t budget = JSONEXPIRE_CYCLE_PATHS;
+        struct JSONExpireDoc *d;
+        while (budget && (d = JSONExpire_NextDue(now))) {
+            JSONType_t *jt = d->jt;
+            RedisModule_SelectDb(ctx, d->db);
+            RedisModuleString *keyname = RedisModule_CreateString(ctx, d->key, sdslen(d->key));
+            RedisModuleKey *key =
+                RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ | REDISMODULE_WRITE);
+
+            // opening a key whose TTL passed frees its document, which takes it out of the heap
+            if (JSONExpire_NextDue(now) == d) {
+                if (RedisModule_ModuleTypeGetType(key) == JSONType &&
+                    RedisModule_ModuleTypeGetValue(key) == jt) {
+                    budget -= JSONExpire_DeleteDue(ctx, jt, keyname, now, budget);
+                } else {
+                    JSONExpire_Park(jt);
+                }
+            }
+            RedisModule_CloseKey(key);
+            RedisModule_FreeString(ctx, keyname);
+        }
+        RedisModule_SelectDb(ctx, db);
+    }
+    _createTimer(ctx, JSONEXPIRE_CYCLE_MS, JSONExpire_Cycle, data);
+}
 
 // == Module JSON commands ==
 
 /**
-* JSON.RESP <key> [path]
+* JSON.RESP <key> [COMPACT] [path]
 * Return the JSON in `key` in RESP.
 *
 * `path` defaults to root if not provided.
-* This command uses the following mapping from JSON to RESP:
+* By default, this command uses the following mapping from JSON to RESP:
 * - JSON Null is mapped to the RESP Null Bulk String
 * - JSON `false` and `true` values are mapped to the respective RESP Simple Strings
 * - JSON Numbers are mapped to RESP Integers or RESP Bulk Strings, depending on type
@@ -167,10 +639,14 @@ static RedisModuleType *JSONType;
 * - JSON Objects are represented as RESP Arrays in which first element is the simple string `{`.
     Each successive entry represents a key-value pair as a two-entries array of bulk strings.
 *
+* `COMPACT` drops the markers and the pairs: arrays are RESP Arrays of their elements, and objects
+* are RESP3 Maps with RESP3 Booleans and Doubles when the client uses RESP3, or else flat RESP Arrays
+* of keys and values, with booleans as the Integers 1 and 0, as Redis replies to RESP2 clients.
+*
 * Reply: Array, specifically the JSON's RESP form.
 */
 int JSONResp_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    if ((argc < 2) || (argc > 3)) {
+    if ((argc < 2) || (argc > 4)) {
         RedisModule_WrongArity(ctx);
         return REDISMODULE_ERR;
     }
@@ -189,18 +665,32 @@ int JSONResp_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
         }
     }
 
+    ObjectRespFormat format = OBJECT_RESP_LEGACY;
+    int pathpos = 2;
+    if (argc > 2 && !strcasecmp("compact", RedisModule_StringPtrLen(argv[2], NULL))) {
+        format = (JSON_GetContextFlags(ctx) & JSON_CTX_FLAGS_RESP3) ? OBJECT_RESP_3
+                                                                     : OBJECT_RESP_COMPACT;
+        pathpos++;
+    }
+    if (argc > pathpos + 1) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+
+    JSONExpire_Apply(ctx, key, argv[1]);
+
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = JSONTypeGet(key);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
-        (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
-    if (PARSE_OK != NodeFromJSONPath(jt->root, spath, &jpn)) {
+        (pathpos < argc ? argv[pathpos] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
+    if (PARSE_OK != NodeFromJSONPath(jt, spath, &jpn)) {
         ReplyWithSearchPathError(ctx, &jpn);
         return REDISMODULE_ERR;
     }
 
     if (E_OK == jpn.err) {
-        ObjectTypeToRespReply(ctx, jpn.n);
+        ObjectTypeToRespReply(ctx, jpn.n, format);
         JSONPathNode_Free(&jpn);
         return REDISMODULE_OK;
     } else {
@@ -211,17 +701,138 @@ int JSONResp_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
     return REDISMODULE_OK;  // this is never reached
 }
 
+/* Replies with a histogram's buckets */
+static void JSONStats_ReplyWithBuckets(RedisModuleCtx *ctx, const uint64_t *buckets, int n) {
+    RedisModule_ReplyWithArray(ctx, n);
+    for (int i = 0; i < n; i++) RedisModule_ReplyWithLongLong(ctx, (long long)buckets[i]);
+}
+
+/* The statistics in the format of an INFO section */
+static sds JSONStats_Info(void) {
+    sds info = sdsnew("# ReJSON\r\n");
+    StatsCounters c;
+    uint64_t depths[STATS_DEPTH_BUCKETS];
+
+    for (StatsPhase p = 0; p < STATS_NPHASES; p++) {
+        Stats_Get(p, &c);
+        sds name = sdsnew(Stats_PhaseName(p));
+        sdsmapchars(name, "-", "_", 1);
+        info = sdscatprintf(info,
+                            "rejson_%s:calls=%llu,errors=%llu,bytes=%llu,nodes=%llu,usec=%llu,"
+                            "usec_per_call=%.2f\r\n",
+                            name, (unsigned long long)c.calls, (unsigned long long)c.errors,
+                            (unsigned long long)c.bytes, (unsigned long long)c.nodes,
+                            (unsigned long long)c.usecs,
+                            c.calls ? (double)c.usecs / c.calls : 0.0);
+        info = sdscatprintf(info, "rejson_%s_latency:", name);
+        for (int i = 0; i < STATS_LATENCY_BUCKETS - 1; i++)
+            info = sdscatprintf(info, "lt%llu=%llu,", 1ULL << i, (unsigned long long)c.latency[i]);
+        info = sdscatprintf(info, "rest=%llu\r\n",
+                            (unsigned long long)c.latency[STATS_LATENCY_BUCKETS - 1]);
+        sdsfree(name);
+    }
+    Stats_GetPathDepths(depths);
+    info = sdscat(info, "rejson_path_depth:");
+    for (int i = 0; i < STATS_DEPTH_BUCKETS; i++)
+        info = sdscatprintf(info, "%s%d=%llu", i ? "," : "", i, (unsigned long long)depths[i]);
+    return sdscatprintf(info, "\r\nrejson_defrag_pending:%llu\r\n",
+                        (unsigned long long)Stats_GetDefragPending());
+}
+
+/**
+ * JSON.STATS [RESET|INFO]
+ * Reports the statistics of the work that the module does, by phase: parsing JSON (`parse`),
+ * looking up paths (`path`), serializing JSON (`serialize`), loading and saving documents to RDB
+ * (`rdb-load` and `rdb-save`), defragmenting documents (`defrag`) and copying the shared values
+ * that writes change (`copy`). Every phase has the number of its calls and of those that failed,
+ * the bytes and nodes that they processed, their total time in microseconds and a histogram of
+ * their latencies, whose bucket i counts the calls that took under 2^i microseconds and whose last
+ * bucket counts the rest. The histogram of the depths of paths follows, whose bucket i counts the
+ * paths of i levels and whose last bucket those that are deeper, and then `defrag-pending`, the
+ * number of documents whose defragmentation stopped to resume later.
+ *
+ * `RESET` zeroes the statistics.
+ * `INFO` reports them as a section in the format of the INFO command.
+ *
+ * Reply: an array of the phases' names and arrays of their statistics' names and values, then
+ * `path-depth` and the histogram, and `defrag-pending` and the number. With `RESET` a simple
+ * string, and with `INFO` a bulk string.
+*/
+int JSONStats_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc > 2) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+
+    if (2 == argc) {
+        const char *subcmd = RedisModule_StringPtrLen(argv[1], NULL);
+        if (!strcasecmp("RESET", subcmd)) {
+            Stats_Reset();
+            RedisModule_ReplyWithSimpleString(ctx, "OK");
+            return REDISMODULE_OK;
+        } else if (!strcasecmp("INFO", subcmd)) {
+            sds info = JSONStats_Info();
+            RedisModule_ReplyWithStringBuffer(ctx, info, sdslen(info));
+            sdsfree(info);
+            return REDISMODULE_OK;
+        }
+        RedisModule_ReplyWithError(ctx, "ERR unknown subcommand - try `JSON.STATS [RESET|INFO]`");
+        return REDISMODULE_ERR;
+    }
+
+    StatsCounters c;
+    uint64_t depths[STATS_DEPTH_BUCKETS];
+    RedisModule_ReplyWithArray(ctx, 2 * STATS_NPHASES + 4);
+    for (StatsPhase p = 0; p < STATS_NPHASES; p++) {
+        Stats_Get(p, &c);
+        RedisModule_ReplyWithSimpleString(ctx, Stats_PhaseName(p));
+        RedisModule_ReplyWithArray(ctx, 12);
+        RedisModule_ReplyWithSimpleString(ctx, "calls");
+        RedisModule_ReplyWithLongLong(ctx, (long long)c.calls);
+        RedisModule_ReplyWithSimpleString(ctx, "errors");
+        RedisModule_ReplyWithLongLong(ctx, (long long)c.errors);
+        RedisModule_ReplyWithSimpleString(ctx, "bytes");
+        RedisModule_ReplyWithLongLong(ctx, (long long)c.bytes);
+        RedisModule_ReplyWithSimpleString(ctx, "nodes");
+        RedisModule_ReplyWithLongLong(ctx, (long long)c.nodes);
+        RedisModule_ReplyWithSimpleString(ctx, "usec");
+        RedisModule_ReplyWithLongLong(ctx, (long long)c.usecs);
+        RedisModule_ReplyWithSimpleString(ctx, "latency");
+        JSONStats_ReplyWithBuckets(ctx, c.latency, STATS_LATENCY_BUCKETS);
+    }
+    Stats_GetPathDepths(depths);
+    RedisModule_ReplyWithSimpleString(ctx, "path-depth");
+    JSONStats_ReplyWithBuckets(ctx, depths, STATS_DEPTH_BUCKETS);
+    RedisModule_ReplyWithSimpleString(ctx, "defrag-pending");
+    RedisModule_ReplyWithLongLong(ctx, (long long)Stats_GetDefragPending());
+    return REDISMODULE_OK;
+}
+
 /**
  * JSON.DEBUG <subcommand & arguments>
  * Report information.
  *
  * Supported subcommands are:
- *   `MEMORY <key> [path]` - report the memory usage in bytes of a value. `path` defaults to root if
- *   not provided.
+ *   `MEMORY <key> [path [DETAILS]]` - report the memory usage in bytes of a value. `path` defaults
+ *   to root if not provided. `DETAILS` reports what the allocator holds for it and how much
+ *   compression saves too.
+ *  `PROFILE <key> [path]` - report the shape of a value: the counts of its values by type and
+ *   encoding, the bytes of unused container entries and histograms of dictionary sizes, array and
+ *   string lengths and depths
+ *  `COMPACT <key>` - rebuild a document's nodes into exact-capacity contiguous memory
+ *  `CACHE` - report the statistics of the serialized values and compiled paths caches
  *  `HELP` - replies with a helpful message
  *
  * Reply: depends on the subcommand used:
- *   `MEMORY` returns an integer, specifically the size in bytes of the value
+ *   `MEMORY` returns an integer, specifically the size in bytes of the value, and with `DETAILS` an
+ *   array of names and integer values: `memory`, `allocated-memory` for the bytes that the
+ *   allocator holds for the value (see ObjectTypeAllocSize), `logical-memory` for the size of the
+ *   value with its strings uncompressed, `compressed-strings` and `cold-memory` for the compressed
+ *   size of a cold document that the command materialized
+ *   `PROFILE` returns an array of names and integer values, or arrays of a histogram's buckets
+ *   (see OBJECT_PROFILE_BUCKETS)
+ *   `COMPACT` returns an integer, specifically the bytes reclaimed
+ *   `CACHE` returns an array of statistics' names and integer values
  *   `HELP` returns an array, specifically with the help message
 */
 int JSONDebug_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
@@ -236,11 +847,16 @@ int JSONDebug_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
     const char *subcmd = RedisModule_StringPtrLen(argv[1], &subcmdlen);
     if (!strncasecmp("memory", subcmd, subcmdlen)) {
         // verify we have enough arguments
-        if ((argc < 3) || (argc > 4)) {
+        if ((argc < 3) || (argc > 5)) {
             RedisModule_WrongArity(ctx);
             return REDISMODULE_ERR;
         }
-        
+        int details = 5 == argc;
+        if (details && strcasecmp("DETAILS", RedisModule_StringPtrLen(argv[4], NULL))) {
+            RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+
         // reply to getkeys-api requests
         if (RedisModule_IsKeysPositionRequest(ctx)) {
             RedisModule_KeyAtPos(ctx, 2);
@@ -258,18 +874,40 @@ int JSONDebug_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
             return REDISMODULE_ERR;
         }
 
-        // validate path
+        // validate path, a cold document's compressed size is taken before it's materialized
         JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+        size_t coldmemory = jt->cold ? jt->coldlen : 0;
+        JSONTypeAccess(jt, 0);
         JSONPathNode_t jpn;
         RedisModuleString *spath =
-            (4 == argc ? argv[3] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
-        if (PARSE_OK != NodeFromJSONPath(jt->root, spath, &jpn)) {
+            (argc > 3 ? argv[3] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
+        if (PARSE_OK != NodeFromJSONPath(jt, spath, &jpn)) {
             ReplyWithSearchPathError(ctx, &jpn);
             return REDISMODULE_ERR;
         }
 
-        if (E_OK == jpn.err) {
-            RedisModule_ReplyWithLongLong(ctx, (long long)ObjectTypeMemoryUsage(jpn.n));
+        if (E_OK == jpn.err && details) {
+            ObjectTypeMemory stats;
+            ObjectTypeMemoryStats(jpn.n, &stats);
+            size_t allocated = jpn.n == jt->root ? JSONTypeAllocatedMemory(jt)
+                                                 : ObjectTypeAllocatedMemory(jpn.n, 1);
+            RedisModule_ReplyWithArray(ctx, 10);
+            RedisModule_ReplyWithSimpleString(ctx, "memory");
+            RedisModule_ReplyWithLongLong(ctx, (long long)stats.memory);
+            RedisModule_ReplyWithSimpleString(ctx, "allocated-memory");
+            RedisModule_ReplyWithLongLong(ctx, (long long)allocated);
+            RedisModule_ReplyWithSimpleString(ctx, "logical-memory");
+            RedisModule_ReplyWithLongLong(ctx, (long long)stats.logical);
+            RedisModule_ReplyWithSimpleString(ctx, "compressed-strings");
+            RedisModule_ReplyWithLongLong(ctx, (long long)stats.compressed);
+            RedisModule_ReplyWithSimpleString(ctx, "cold-memory");
+            RedisModule_ReplyWithLongLong(ctx, jpn.n == jt->root ? (long long)coldmemory : 0);
+            JSONPathNode_Free(&jpn);
+            return REDISMODULE_OK;
+        } else if (E_OK == jpn.err) {
+            size_t memory = jpn.n == jt->root ? JSONTypeRootMemoryUsage(jt)
+                                              : ObjectTypeMemoryUsage(jpn.n);
+            RedisModule_ReplyWithLongLong(ctx, (long long)memory);
             JSONPathNode_Free(&jpn);
             return REDISMODULE_OK;
         } else {
@@ -277,9 +915,140 @@ int JSONDebug_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
             JSONPathNode_Free(&jpn);
             return REDISMODULE_ERR;
         }
+    } else if (!strncasecmp("profile", subcmd, subcmdlen)) {
+        if ((argc < 3) || (argc > 4)) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        // reply to getkeys-api requests
+        if (RedisModule_IsKeysPositionRequest(ctx)) {
+            RedisModule_KeyAtPos(ctx, 2);
+            return REDISMODULE_OK;
+        }
+
+        // key must be empty (reply with null) or a JSON type
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[2], REDISMODULE_READ);
+        int type = RedisModule_KeyType(key);
+        if (REDISMODULE_KEYTYPE_EMPTY == type) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_OK;
+        } else if (RedisModule_ModuleTypeGetType(key) != JSONType) {
+            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+            return REDISMODULE_ERR;
+        }
+
+        // validate path
+        JSONType_t *jt = JSONTypeGet(key);
+        JSONPathNode_t jpn;
+        RedisModuleString *spath =
+            (argc > 3 ? argv[3] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
+        if (PARSE_OK != NodeFromJSONPath(jt, spath, &jpn)) {
+            ReplyWithSearchPathError(ctx, &jpn);
+            return REDISMODULE_ERR;
+        }
+        if (E_OK != jpn.err) {
+            ReplyWithPathError(ctx, &jpn);
+            JSONPathNode_Free(&jpn);
+            return REDISMODULE_ERR;
+        }
+
+        ObjectTypeProfile p;
+        ObjectTypeProfileStats(jpn.n, &p);
+        JSONPathNode_Free(&jpn);
+        struct {
+            const char *name;
+            uint64_t value;
+        } counts[] = {{"nulls", p.nulls},
+                      {"booleans", p.booleans},
+                      {"integers", p.integers},
+                      {"numbers", p.numbers},
+                      {"strings", p.strings},
+                      {"compressed-strings", p.compressed},
+                      {"dicts", p.dicts},
+                      {"indexed-dicts", p.indexed},
+                      {"dict-slack", p.dictslack},
+                      {"arrays", p.arrays},
+                      {"packed-arrays", p.packed},
+                      {"array-slack", p.arrayslack},
+                      {"max-depth", p.maxdepth}};
+        int ncounts = sizeof(counts) / sizeof(counts[0]);
+        RedisModule_ReplyWithArray(ctx, ncounts * 2 + 8);
+        for (int i = 0; i < ncounts; i++) {
+            RedisModule_ReplyWithSimpleString(ctx, counts[i].name);
+            RedisModule_ReplyWithLongLong(ctx, (long long)counts[i].value);
+        }
+        RedisModule_ReplyWithSimpleString(ctx, "dict-sizes");
+        JSONStats_ReplyWithBuckets(ctx, p.dictsizes, OBJECT_PROFILE_BUCKETS);
+        RedisModule_ReplyWithSimpleString(ctx, "array-lengths");
+        JSONStats_ReplyWithBuckets(ctx, p.arraylens, OBJECT_PROFILE_BUCKETS);
+        RedisModule_ReplyWithSimpleString(ctx, "string-lengths");
+        JSONStats_ReplyWithBuckets(ctx, p.strlens, OBJECT_PROFILE_BUCKETS);
+        RedisModule_ReplyWithSimpleString(ctx, "depths");
+        JSONStats_ReplyWithBuckets(ctx, p.depths, OBJECT_PROFILE_BUCKETS);
+        return REDISMODULE_OK;
+    } else if (!strncasecmp("cache", subcmd, subcmdlen)) {
+        if (argc != 2) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        // the subcommand has no keys
+        if (RedisModule_IsKeysPositionRequest(ctx)) return REDISMODULE_OK;
+
+        size_t count, memory, paths;
+        uint64_t hits, misses, pathhits, pathmisses;
+        SerialCache_Stats(&count, &memory, &hits, &misses);
+        PathCache_Stats(&paths, &pathhits, &pathmisses);
+        RedisModule_ReplyWithArray(ctx, 14);
+        RedisModule_ReplyWithSimpleString(ctx, "serialized-values");
+        RedisModule_ReplyWithLongLong(ctx, (long long)count);
+        RedisModule_ReplyWithSimpleString(ctx, "serialized-memory");
+        RedisModule_ReplyWithLongLong(ctx, (long long)memory);
+        RedisModule_ReplyWithSimpleString(ctx, "serialized-hits");
+        RedisModule_ReplyWithLongLong(ctx, (long long)hits);
+        RedisModule_ReplyWithSimpleString(ctx, "serialized-misses");
+        RedisModule_ReplyWithLongLong(ctx, (long long)misses);
+        RedisModule_ReplyWithSimpleString(ctx, "paths");
+        RedisModule_ReplyWithLongLong(ctx, (long long)paths);
+        RedisModule_ReplyWithSimpleString(ctx, "path-hits");
+        RedisModule_ReplyWithLongLong(ctx, (long long)pathhits);
+        RedisModule_ReplyWithSimpleString(ctx, "path-misses");
+        RedisModule_ReplyWithLongLong(ctx, (long long)pathmisses);
+        return REDISMODULE_OK;
+    } else if (!strncasecmp("compact", subcmd, subcmdlen)) {
+        if (argc != 3) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        // reply to getkeys-api requests
+        if (RedisModule_IsKeysPositionRequest(ctx)) {
+            RedisModule_KeyAtPos(ctx, 2);
+            return REDISMODULE_OK;
+        }
+
+        // key must be empty (reply with null) or a JSON type
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[2], REDISMODULE_READ);
+        int type = RedisModule_KeyType(key);
+        if (REDISMODULE_KEYTYPE_EMPTY == type) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_OK;
+        } else if (RedisModule_ModuleTypeGetType(key) != JSONType) {
+            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+            return REDISMODULE_ERR;
+        }
+
+        // the value doesn't change, only its nodes' layout, so there's nothing to replicate
+        JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+        RedisModule_ReplyWithLongLong(ctx, JSONTypeCompact(jt));
+        return REDISMODULE_OK;
     } else if (!strncasecmp("help", subcmd, subcmdlen)) {
-        const char *help[] = {"MEMORY <key> [path] - reports memory usage",
-                              "HELP                - this message", NULL};
+        const char *help[] = {"MEMORY <key> [path [DETAILS]] - reports memory usage",
+                              "PROFILE <key> [path]          - reports the shape of a value",
+                              "COMPACT <key>                 - rebuilds a value's memory compactly",
+                              "CACHE                         - reports the caches' statistics",
+                              "HELP                          - this message", NULL};
 
         RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
         int i = 0;
@@ -322,12 +1091,14 @@ int JSONType_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
         return REDISMODULE_ERR;
     }
 
+    JSONExpire_Apply(ctx, key, argv[1]);
+
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = JSONTypeGet(key);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
-    if (PARSE_OK != NodeFromJSONPath(jt->root, spath, &jpn)) {
+    if (PARSE_OK != NodeFromJSONPath(jt, spath, &jpn)) {
         ReplyWithSearchPathError(ctx, &jpn);
         return REDISMODULE_ERR;
     }
@@ -377,12 +1148,14 @@ int JSONLen_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
         return REDISMODULE_ERR;
     }
 
+    JSONExpire_Apply(ctx, key, argv[1]);
+
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = JSONTypeGet(key);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
-    if (PARSE_OK != NodeFromJSONPath(jt->root, spath, &jpn)) {
+    if (PARSE_OK != NodeFromJSONPath(jt, spath, &jpn)) {
         ReplyWithSearchPathError(ctx, &jpn);
         return REDISMODULE_ERR;
     }
@@ -418,16 +1191,32 @@ error:
     return REDISMODULE_ERR;
 }
 
+/* Replies with a keyval's key, for JSON.OBJKEYS with a prefix */
+static int JSONObjKeys_ReplyKey(Node *kv, void *ctx) {
+    const char *k = kv->value.kvval.key;
+    RedisModule_ReplyWithStringBuffer(ctx, k, strlen(k));
+    return 0;
+}
+
 /**
- * JSON.OBJKEYS <key> [path]
+ * JSON.OBJKEYS <key> [path] [PREFIX <prefix>]
  * Return the keys in the object that's referenced by `path`.
  *
  * `path` defaults to root if not provided. If the object is empty, or either `key` or `path` do not
  * exist then null is returned.
+ * With `PREFIX`, only the keys that start with `prefix` are returned, sorted bytewise. Big objects
+ * (see the `DICT_TRIE_THRESHOLD` module argument) are given a radix tree of their keys by the first
+ * such call, so that listing them doesn't scan the object.
  *
  * Reply: Array, specifically the key names as bulk strings.
 */
 int JSONObjKeys_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModuleString *prefix = NULL;
+    if (argc > 3 && !strcasecmp("prefix", RedisModule_StringPtrLen(argv[argc - 2], NULL))) {
+        prefix = argv[argc - 1];
+        argc -= 2;
+    }
+
     // check args
     if ((argc < 2) || (argc > 3)) {
         RedisModule_WrongArity(ctx);
@@ -447,12 +1236,16 @@ int JSONObjKeys_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
         return REDISMODULE_ERR;
     }
 
+    JSONExpire_Apply(ctx, key, argv[1]);
+
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = JSONTypeGet(key);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
-    if (PARSE_OK != NodeFromJSONPath(jt->root, spath, &jpn)) {
+    int rv = prefix ? NodeFromJSONPathMutable(jt, spath, &jpn, 0)
+                    : NodeFromJSONPath(jt, spath, &jpn);
+    if (PARSE_OK != rv) {
         ReplyWithSearchPathError(ctx, &jpn);
         return REDISMODULE_ERR;
     }
@@ -468,7 +1261,15 @@ int JSONObjKeys_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
     }
 
     // reply with the object's keys if it is a dictionary, error otherwise
-    if (N_DICT == NODETYPE(jpn.n)) {
+    if (N_DICT == NODETYPE(jpn.n) && prefix) {
+        size_t plen;
+        const char *p = RedisModule_StringPtrLen(prefix, &plen);
+        RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+        JSONTYPE_INDEXING_BEGIN(jt);
+        uint32_t count = Node_DictPrefixScan(jpn.n, p, plen, JSONObjKeys_ReplyKey, ctx);
+        JSONTYPE_INDEXING_END();
+        RedisModule_ReplySetArrayLength(ctx, count);
+    } else if (N_DICT == NODETYPE(jpn.n)) {
         int len = Node_Length(jpn.n);
         RedisModule_ReplyWithArray(ctx, len);
         for (int i = 0; i < len; i++) {
@@ -490,68 +1291,44 @@ error:
     return REDISMODULE_ERR;
 }
 
-/**
- * JSON.SET <key> <path> <json> [NX|XX]
- * Sets the JSON value at `path` in `key`
- *
- * For new Redis keys the `path` must be the root. For existing keys, when the entire `path` exists,
- * the value that it contains is replaced with the `json` value.
- *
- * A key (with its respective value) is added to a JSON Object (in a Redis ReJSON data type key) if
- * and only if it is the last child in the `path`. The optional subcommands modify this behavior for
- * both new Redis ReJSON data type keys as well as JSON Object keys in them:
- *   `NX` - only set the key if it does not already exists
- *   `XX` - only set the key if it already exists
- *
- * Reply: Simple String `OK` if executed correctly, or Null Bulk if the specified `NX` or `XX`
- * conditions were not met.
-*/
-int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    // check args
-    if ((argc < 4) || (argc > 5)) {
-        RedisModule_WrongArity(ctx);
-        return REDISMODULE_ERR;
+/* Replies with the error of a failed parse and frees it */
+static void ReplyWithJSONObjectError(RedisModuleCtx *ctx, char *jerr) {
+    if (jerr) {
+        RedisModule_ReplyWithError(ctx, jerr);
+        free(jerr);
+    } else {
+        RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_JSONOBJECT_ERROR);
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_JSONOBJECT_ERROR);
     }
-    RedisModule_AutoMemory(ctx);
+}
 
-    // key must be empty or a JSON type
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+/**
+* Sets a parsed value at a path of a key that's empty or holds a document, as JSON.SET does, and
+* replies like it. The value is owned by jtnew if it's the root of a new document, which must be
+* given for the root path, and is freed unless it's set. subcmd is the optional NX or XX, and set
+* is set when the value is. The effect of setting it is replicated if JSONReplicateEffects is set,
+* otherwise it's up to the caller.
+*/
+static int JSONSet_Value(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModuleString *keyname,
+                         RedisModuleString *path, Object *jo, JSONType_t *jtnew,
+                         RedisModuleString *subcmd, int *set) {
     int type = RedisModule_KeyType(key);
-    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != JSONType) {
-        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
-        return REDISMODULE_ERR;
-    }
-
-    // JSON must be valid
-    size_t jsonlen;
-    const char *json = RedisModule_StringPtrLen(argv[3], &jsonlen);
-    if (!jsonlen) {
-        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EMPTY_STRING);
-        return REDISMODULE_ERR;
-    }
 
-    // Create object from json
-    Object *jo = NULL;
-    char *jerr = NULL;
-    if (JSONOBJECT_OK != CreateNodeFromJSON(json, jsonlen, &jo, &jerr)) {
-        if (jerr) {
-            RedisModule_ReplyWithError(ctx, jerr);
-            free(jerr);
-        } else {
-            RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_JSONOBJECT_ERROR);
-            RedisModule_ReplyWithError(ctx, REJSON_ERROR_JSONOBJECT_ERROR);
-        }
-        return REDISMODULE_ERR;
-    }
+    *set = 0;
 
     // initialize or get JSON type container
     JSONType_t *jt;
+    int write = 0;
     if (REDISMODULE_KEYTYPE_EMPTY == type) {
-        jt = calloc(1, sizeof(JSONType_t));
+        // the path is validated right below, and a new key must be created at the root
+        jt = jtnew ? jtnew : calloc(1, sizeof(JSONType_t));
         jt->root = jo;
     }
     else {
+        JSONExpire_Apply(ctx, key, keyname);
+        // a lazy document that's replaced at the root isn't needed
         jt = RedisModule_ModuleTypeGetValue(key);
+        write = !JSONPath_IsRootPath(path);
     }
 
     /* Validate path against the existing object root, and pretend that the new object is the root
@@ -559,7 +1336,8 @@ int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
      * created at the root.
     */
     JSONPathNode_t jpn;
-    if (PARSE_OK != NodeFromJSONPath(jt->root, argv[2], &jpn)) {
+    if (PARSE_OK != (write ? NodeFromJSONPathMutable(jt, path, &jpn, 0)
+                           : NodeFromJSONPath(jt, path, &jpn))) {
         ReplyWithSearchPathError(ctx, &jpn);
         goto error;
     }
@@ -567,11 +1345,11 @@ int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
 
     // subcommand for key creation behavior modifiers NX and XX
     int subnx = 0, subxx = 0;
-    if (argc > 4) {
-        const char *subcmd = RedisModule_StringPtrLen(argv[4], NULL);
-        if (!strcasecmp("nx", subcmd)) {
+    if (subcmd) {
+        const char *sub = RedisModule_StringPtrLen(subcmd, NULL);
+        if (!strcasecmp("nx", sub)) {
             subnx = 1;
-        } else if (!strcasecmp("xx", subcmd)) {
+        } else if (!strcasecmp("xx", sub)) {
             subxx = 1;
         } else {
             RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
@@ -591,6 +1369,8 @@ int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
         if (subxx) goto null;
 
         RedisModule_ModuleTypeSetValue(key, JSONType, jt);
+        JSONIndex_Track(ctx, jt, keyname);
+        jtnew = NULL;
         goto ok;
     }
 
@@ -624,30 +1404,32 @@ int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
         if (isRootPath) {
             // replacing the root is easy
             RedisModule_DeleteKey(key);
-            jt = calloc(1, sizeof(JSONType_t));
-            jt->root = jo;
+            jt = jtnew;
+            jtnew = NULL;
             RedisModule_ModuleTypeSetValue(key, JSONType, jt);
+            JSONIndex_Track(ctx, jt, keyname);
         } else if (N_DICT == NODETYPE(jpn.p)) {
+            JSONTypeTouch(jt);
             if (OBJ_OK != Node_DictSet(jpn.p, jpn.sp.nodes[jpn.sp.len - 1].value.key, jo)) {
                 RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_DICT_SET);
                 RedisModule_ReplyWithError(ctx, REJSON_ERROR_DICT_SET);
                 goto error;
             }
         } else {  // must be an array
+            JSONTypeTouch(jt);
             int index = jpn.sp.nodes[jpn.sp.len - 1].value.index;
             if (index < 0) index = Node_Length(jpn.p) + index;
-            if (OBJ_OK != Node_ArraySet(jpn.p, index, jo)) {
+            if (OBJ_OK != Node_ArrayReplace(jpn.p, index, jo)) {
                 RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_ARRAY_SET);
                 RedisModule_ReplyWithError(ctx, REJSON_ERROR_ARRAY_SET);
                 goto error;
             }
-            // unlike DictSet, ArraySet does not free so we need to call it explicitly
-            Node_Free(jpn.n);
         }
     } else {  // must be E_NOKEY
         // new keys in the dictionary can be created only if the XX flag is off
         if (subxx) goto null;
 
+        JSONTypeTouch(jt);
         if (OBJ_OK != Node_DictSet(jpn.p, jpn.sp.nodes[jpn.sp.len - 1].value.key, jo)) {
             RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_DICT_SET);
             RedisModule_ReplyWithError(ctx, REJSON_ERROR_DICT_SET);
@@ -657,323 +1439,2157 @@ int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
 
 ok:
     RedisModule_ReplyWithSimpleString(ctx, "OK");
-    RedisModule_ReplicateVerbatim(ctx);
+    *set = 1;
+    if (JSONReplicateEffects) JSONEffect_Set(ctx, keyname, jt, &jpn.sp, jo);
+    JSONNotify(ctx, keyname, "json.set", jt, &jpn.sp);
+    // a new document is deduplicated once its value has been replicated
+    if (isRootPath) JSONTypeDedup(jt);
     JSONPathNode_Free(&jpn);
     return REDISMODULE_OK;
 
 null:
     RedisModule_ReplyWithNull(ctx);
     JSONPathNode_Free(&jpn);
+    if (REDISMODULE_KEYTYPE_EMPTY == type && jt != jtnew) free(jt);
+    if (jtnew) JSONTypeFree(jtnew);
+    else if (jo) Node_Free(jo);
     return REDISMODULE_OK;
 
 error:
     JSONPathNode_Free(&jpn);
-    if (REDISMODULE_KEYTYPE_EMPTY == type) {
-        free(jt);
-    }
-    if (jo) Node_Free(jo);
+    if (REDISMODULE_KEYTYPE_EMPTY == type && jt != jtnew) free(jt);
+    // the new container owns the object
+    if (jtnew) JSONTypeFree(jtnew);
+    else if (jo) Node_Free(jo);
     return REDISMODULE_ERR;
 }
 
 /**
- * JSON.GET <key> [INDENT indentation-string] [NEWLINE newline-string] [SPACE space-string]
- *                [path ...]
- * Return the value at `path` in JSON serialized form.
- *
- * This command accepts multiple `path`s, and defaults to the value's root when none are given.
- *
- * The following subcommands change the reply's and are all set to the empty string by default:
- *   - `INDENT` sets the indentation string for nested levels
- *   - `NEWLINE` sets the string that's printed at the end of each line
- *   - `SPACE` sets the string that's put between a key and a value
- *
- * Reply: Bulk String, specifically the JSON serialization.
- * The reply's structure depends on the on the number of paths. A single path results in the value
- * being itself is returned, whereas multiple paths are returned as a JSON object in which each path
- * is a key.
+* JSON.SET values of at least this many bytes of JSON are parsed by JSONSetParallelThreads threads,
+* see CreateNodeFromJSONParallel. They're set with the PARALLEL_PARSE_SIZE and PARALLEL_PARSE_THREADS
+* module arguments, and fewer than 2 threads disable parallel parsing.
 */
-int JSONGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    if ((argc < 2)) {
-        RedisModule_WrongArity(ctx);
-        return REDISMODULE_ERR;
-    }
-    RedisModule_AutoMemory(ctx);
+static size_t JSONSetParallelSize = 16 * 1024 * 1024;
+static int JSONSetParallelThreads = 0;
 
-    // key must be empty (reply with null) or an object type
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
-    int type = RedisModule_KeyType(key);
-    if (REDISMODULE_KEYTYPE_EMPTY == type) {
-        RedisModule_ReplyWithNull(ctx);
-        return REDISMODULE_OK;
-    } else if (RedisModule_ModuleTypeGetType(key) != JSONType) {
-        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
-        return REDISMODULE_ERR;
-    }
+/* The most threads that parse a value */
+#define JSONSET_MAX_PARALLEL_THREADS 64
 
-    // check for optional arguments
-    int pathpos = 2;
-    JSONSerializeOpt jsopt = {0};
-    if (pathpos < argc) {
-        RMUtil_ParseArgsAfter("indent", argv, argc, "c", &jsopt.indentstr);
-        if (jsopt.indentstr) {
-            pathpos += 2;
-        } else {
-            jsopt.indentstr = "";
-        }
-    }
-    if (pathpos < argc) {
-        RMUtil_ParseArgsAfter("newline", argv, argc, "c", &jsopt.newlinestr);
-        if (jsopt.newlinestr) {
-            pathpos += 2;
-        } else {
-            jsopt.newlinestr = "";
-        }
-    }
-    if (pathpos < argc) {
-        RMUtil_ParseArgsAfter("space", argv, argc, "c", &jsopt.spacestr);
-        if (jsopt.spacestr) {
-            pathpos += 2;
-        } else {
-            jsopt.spacestr = "";
-        }
-    }
+static int _canBlock = -1;
 
-    // initialize the reply
-    sds json = sdsempty();
+/**
+* Checks whether a JSON.SET can block its client while its value is parsed on threads. Transactions
+* and scripts can't block, and commands that are replicated from a master or loaded from the AOF
+* must be applied in the order that they come in. Servers that don't flag the latter, i.e. before
+* the server events of Redis 6, never block.
+*/
+static int JSONSet_CanBlock(RedisModuleCtx *ctx) {
+    if (-1 == _canBlock) {
+        void *events;
+        _canBlock =
+            REDISMODULE_OK == RedisModule_GetApi("RedisModule_SubscribeToServerEvent", &events);
+    }
+    return _canBlock &&
+           !(JSON_GetContextFlags(ctx) & (JSON_CTX_FLAGS_LUA | JSON_CTX_FLAGS_MULTI |
+                                          JSON_CTX_FLAGS_REPLICATED | JSON_CTX_FLAGS_LOADING));
+}
 
-    // validate paths, if none provided default to root
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
-    int npaths = argc - pathpos;
-    int jpnslen = 0;
-    JSONPathNode_t jpns[MAX(npaths, 1)];  // if no paths then the root
-    if (!npaths) {  // default to root
-        NodeFromJSONPath(jt->root, RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1), &jpns[0]);
-        jpnslen = 1;
+/* A JSON.SET whose value is parsed on threads while its client is blocked */
+typedef struct {
+    RedisModuleBlockedClient *bc;
+    sds key, path, subcmd, json;  // copies of the arguments, subcmd is NULL without NX or XX
+    JSONType_t *jtnew;            // the new document of a value at the root
+    Object *jo;
+    char *jerr;
+    int ret;
+} JSONSetTask;
+
+static void JSONSetTask_Free(void *privdata) {
+    JSONSetTask *t = privdata;
+    // the nodes are freed first, as they may be in the document's arena
+    if (t->jtnew) {
+        t->jtnew->root = t->jo;
+        JSONTypeFree(t->jtnew);
     } else {
-        while (jpnslen < npaths) {
-            // validate path correctness
-            if (PARSE_OK != NodeFromJSONPath(jt->root, argv[pathpos + jpnslen], &jpns[jpnslen])) {
-                ReplyWithSearchPathError(ctx, &jpns[jpnslen]);
-                goto error;
-            }
+        Node_Free(t->jo);
+    }
+    if (t->jerr) free(t->jerr);
+    sdsfree(t->key);
+    sdsfree(t->path);
+    sdsfree(t->subcmd);
+    sdsfree(t->json);
+    free(t);
+}
 
-            // deal with path errors
-            if (E_OK != jpns[jpnslen].err) {
-                ReplyWithPathError(ctx, &jpns[jpnslen]);
-                goto error;
-            }
+static void *JSONSetTask_Thread(void *arg) {
+    JSONSetTask *t = arg;
+    NodeArena *prev = Node_SetArena(t->jtnew ? t->jtnew->arena : NULL);
+    t->ret = CreateNodeFromJSONParallel(t->json, sdslen(t->json), JSONSetParallelThreads, &t->jo,
+                                        &t->jerr);
+    Node_SetArena(prev);
+    RedisModule_UnblockClient(t->bc, t);
+    return NULL;
+}
 
-            jpnslen++;
-        }  // while (jpnslen < npaths)
+/* Sets the parsed value once the client is unblocked, as the key may have changed meanwhile */
+static int JSONSetTask_Reply(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    JSONSetTask *t = RedisModule_GetBlockedClientPrivateData(ctx);
+    RedisModule_AutoMemory(ctx);
+    if (JSONOBJECT_OK != t->ret) {
+        ReplyWithJSONObjectError(ctx, t->jerr);
+        t->jerr = NULL;
+        return REDISMODULE_ERR;
     }
 
-    // return the single path's JSON value, or wrap all paths-values as an object
-    if (1 == jpnslen) {
-        SerializeNodeToJSON(jpns[0].n, &jsopt, &json);
-    } else {
-        Node *objReply = NewDictNode(jpnslen);
-        for (int i = 0; i < jpnslen; i++) {
-            Node_DictSet(objReply, jpns[i].spath, jpns[i].n);
-        }
-        SerializeNodeToJSON(objReply, &jsopt, &json);
-
-        // avoid removing the actual data by resetting the reply dict
-        // TODO: need a non-freeing Del
-        for (int i = 0; i < objReply->value.dictval.len; i++) {
-            objReply->value.dictval.entries[i]->value.kvval.val = NULL;
-        }
-        Node_Free(objReply);
+    RedisModuleString *keyname = RedisModule_CreateString(ctx, t->key, sdslen(t->key));
+    RedisModuleString *path = RedisModule_CreateString(ctx, t->path, sdslen(t->path));
+    RedisModuleString *subcmd =
+        t->subcmd ? RedisModule_CreateString(ctx, t->subcmd, sdslen(t->subcmd)) : NULL;
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
     }
 
-    // check whether serialization had succeeded
-    if (!sdslen(json)) {
-        RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_SERIALIZE);
-        RedisModule_ReplyWithError(ctx, REJSON_ERROR_SERIALIZE);
-        goto error;
+    // the value and its document are JSONSet_Value's from here on
+    JSONType_t *jtnew = t->jtnew;
+    Object *jo = t->jo;
+    t->jtnew = NULL;
+    t->jo = NULL;
+    if (jtnew) jtnew->root = jo;
+    int set;
+    int ret = JSONSet_Value(ctx, key, keyname, path, jo, jtnew, subcmd, &set);
+    if (!set || JSONReplicateEffects) return ret;
+    if (subcmd) {
+        RedisModule_Replicate(ctx, "JSON.SET", "ssbs", keyname, path, t->json, sdslen(t->json),
+                              subcmd);
+    } else {
+        RedisModule_Replicate(ctx, "JSON.SET", "ssb", keyname, path, t->json, sdslen(t->json));
     }
+    return ret;
+}
 
-    RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
+/**
+* Parses a JSON.SET value on threads while the client is blocked, and sets it when the parse is done.
+* The arguments are copied, as they don't outlive the command. Returns 0 if the thread can't be
+* started, in which case nothing is replied.
+*/
+static int JSONSet_ParseAsync(RedisModuleCtx *ctx, RedisModuleString **argv,
+                              RedisModuleString *subcmd, JSONType_t *jtnew) {
+    JSONSetTask *t = calloc(1, sizeof(JSONSetTask));
+    size_t len;
+    const char *s = RedisModule_StringPtrLen(argv[1], &len);
+    t->key = sdsnewlen(s, len);
+    s = RedisModule_StringPtrLen(argv[2], &len);
+    t->path = sdsnewlen(s, len);
+    s = RedisModule_StringPtrLen(argv[3], &len);
+    t->json = sdsnewlen(s, len);
+    if (subcmd) {
+        s = RedisModule_StringPtrLen(subcmd, &len);
+        t->subcmd = sdsnewlen(s, len);
+    }
 
-    for (int i = 0; i < jpnslen; i++) {
-        JSONPathNode_Free(&jpns[i]);
+    t->jtnew = jtnew;
+
+    JSON_ScanKernel();  // the scan kernel is picked on the main thread
+    t->bc = RedisModule_BlockClient(ctx, JSONSetTask_Reply, NULL, JSONSetTask_Free, 0);
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, JSONSetTask_Thread, t)) {
+        // the caller keeps the document
+        RedisModule_AbortBlock(t->bc);
+        t->jtnew = NULL;
+        JSONSetTask_Free(t);
+        return 0;
     }
-    sdsfree(json);
-    return REDISMODULE_OK;
+    pthread_detach(tid);
+    return 1;
+}
 
-error:
-    for (int i = 0; i < jpnslen; i++) {
-        JSONPathNode_Free(&jpns[i]);
+/**
+* Gets the validator of the schema at a key for a command, or replies with an error and returns NULL.
+* It belongs to the key's document, and mustn't be used after the key is written to.
+*/
+static JSONSchema *JSONSet_OpenSchema(RedisModuleCtx *ctx, RedisModuleString *keyname) {
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+    if (RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_SCHEMA_KEY);
+        return NULL;
     }
-    sdsfree(json);
-    return REDISMODULE_ERR;
+    JSONExpire_Apply(ctx, key, keyname);
+    char *err = NULL;
+    JSONSchema *schema = JSONTypeSchema(JSONTypeGet(key), &err);
+    if (!schema) ReplyWithJSONObjectError(ctx, err);
+    return schema;
 }
 
 /**
- * JSON.MGET <key> [<key> ...] <path>
- * Returns the values at `path` from multiple `key`s. Non-existing keys and non-existing paths are
- * reported as null.
- * Reply: Array of Bulk Strings, specifically the JSON serialization of the value at each key's
- * path.
+ * JSON.SET <key> <path> <json> [NX|XX] [FORMAT MSGPACK|CBOR|JSON] [SCHEMA schema-key]
+ * Sets the JSON value at `path` in `key`
+ *
+ * For new Redis keys the `path` must be the root. For existing keys, when the entire `path` exists,
+ * the value that it contains is replaced with the `json` value.
+ *
+ * A key (with its respective value) is added to a JSON Object (in a Redis ReJSON data type key) if
+ * and only if it is the last child in the `path`. The optional subcommands modify this behavior for
+ * both new Redis ReJSON data type keys as well as JSON Object keys in them:
+ *   `NX` - only set the key if it does not already exists
+ *   `XX` - only set the key if it already exists
+ *
+ * `FORMAT` gives the value in MessagePack or CBOR instead of JSON, which is decoded straight into
+ * the document.
+ *
+ * `SCHEMA` validates the value against the JSON Schema at `schema-key` (see JSON.SETSCHEMA) before
+ * it's set. The schema is compiled once and kept with its document, and a JSON value is checked as
+ * it's parsed, so a value that doesn't match fails like an invalid JSON does.
+ *
+ * Reply: Simple String `OK` if executed correctly, or Null Bulk if the specified `NX` or `XX`
+ * conditions were not met.
 */
-int JSONMGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    if ((argc < 2)) {
+int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if ((argc < 4) || (argc > 9)) {
         RedisModule_WrongArity(ctx);
         return REDISMODULE_ERR;
     }
+    RedisModule_AutoMemory(ctx);
+
+    // the subcommand, the format and the schema can come in any order
+    RedisModuleString *subcmd = NULL;
+    int packed = 0, schemapos = 0;
+    PackFormat format = PACK_MSGPACK;
+    for (int i = 4; i < argc; i++) {
+        if (i + 1 < argc && !strcasecmp("format", RedisModule_StringPtrLen(argv[i], NULL))) {
+            if (REDISMODULE_OK != JSONFormat_Parse(argv[++i], &packed, &format)) {
+                RedisModule_ReplyWithError(ctx, REJSON_ERROR_FORMAT);
+                return REDISMODULE_ERR;
+            }
+        } else if (i + 1 < argc && !schemapos &&
+                   !strcasecmp("schema", RedisModule_StringPtrLen(argv[i], NULL))) {
+            schemapos = ++i;
+        } else if (!subcmd) {
+            subcmd = argv[i];
+        } else {
+            RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    // reply to getkeys-api requests
     if (RedisModule_IsKeysPositionRequest(ctx)) {
-        for (int i = 1; i < argc - 1; i++) RedisModule_KeyAtPos(ctx, i);
+        RedisModule_KeyAtPos(ctx, 1);
+        if (schemapos) RedisModule_KeyAtPos(ctx, schemapos);
         return REDISMODULE_OK;
     }
-    RedisModule_AutoMemory(ctx);
 
-    // validate search path
-    size_t spathlen;
-    const char *spath = RedisModule_StringPtrLen(argv[argc-1], &spathlen);
-    JSONPathNode_t jpn;
-    jpn.sp = NewSearchPath(0);
-    if (PARSE_ERR == ParseJSONPath(spath, spathlen, &jpn.sp, NULL)) {
-        ReplyWithSearchPathError(ctx, &jpn);
-        goto error;
+    // the schema is compiled before the key is opened for writing, as it may be the same key
+    JSONSchema *schema = NULL;
+    if (schemapos && !(schema = JSONSet_OpenSchema(ctx, argv[schemapos]))) return REDISMODULE_ERR;
+
+    // key must be empty or a JSON type
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
     }
 
-    // iterate keys
-    RedisModule_ReplyWithArray(ctx, argc - 2);
-    int isRootPath = SearchPath_IsRootPath(&jpn.sp);
-    JSONSerializeOpt jsopt = {0};
-    for (int i = 1; i < argc - 1; i++) {
-        RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ);
+    // JSON must be valid
+    size_t jsonlen;
+    const char *json = RedisModule_StringPtrLen(argv[3], &jsonlen);
+    if (!jsonlen) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EMPTY_STRING);
+        return REDISMODULE_ERR;
+    }
 
-        // key must an object type, empties and others return null like Redis' MGET
-        int type = RedisModule_KeyType(key);
-        if (REDISMODULE_KEYTYPE_EMPTY == type) goto null;
-        if (RedisModule_ModuleTypeGetType(key) != JSONType) goto null;
+    /* Create object from json. A new document is built in the arena of its new container, whereas
+     * values that are set in an existing document are allocated on the heap like any other edit.
+     * A big enough document is kept lazy, and invalid JSON is parsed again for its error. Big
+     * values are parsed on threads, while the client is blocked when it can be. Values that are
+     * validated are parsed at once with the schema, and decoded ones are validated once decoded.
+    */
+    Object *jo = NULL;
+    char *jerr = NULL;
+    int ret;
+    JSONType_t *jtnew = JSONPath_IsRootPath(argv[2]) ? NewJSONType() : NULL;
+    if (packed || schema || !jtnew || !JSONTypeLazySize || jsonlen < JSONTypeLazySize ||
+        !JSONTypeSetLazy(jtnew, json, jsonlen)) {
+        int threads =
+            !packed && !schema && jsonlen >= JSONSetParallelSize ? JSONSetParallelThreads : 0;
+        if (threads > 1 && JSONSet_CanBlock(ctx) && JSONSet_ParseAsync(ctx, argv, subcmd, jtnew))
+            return REDISMODULE_OK;
 
-        // follow the path to the target node in the key
-        JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
-        if (isRootPath) {
-            jpn.err = E_OK;
-            jpn.n = jt->root;
+        NodeArena *prev = Node_SetArena(jtnew ? jtnew->arena : NULL);
+        if (packed) {
+            const char *why;
+            ret = OBJ_OK == CreateNodeFromPack(json, jsonlen, format, &jo, &jerr) ? JSONOBJECT_OK
+                                                                                 : JSONOBJECT_ERROR;
+            if (JSONOBJECT_OK == ret && schema && OBJ_OK != JSONSchema_Validate(schema, jo, &why)) {
+                sds msg = sdscatprintf(sdsempty(), REJSON_ERROR_SCHEMA_MISMATCH, why);
+                jerr = strdup(msg);
+                sdsfree(msg);
+                Node_Free(jo);
+                ret = JSONOBJECT_ERROR;
+            }
+        } else if (schema) {
+            ret = CreateNodeFromJSONSchema(json, jsonlen, schema, &jo, &jerr);
         } else {
-            jpn.err = SearchPath_FindEx(&jpn.sp, jt->root, &jpn.n, &jpn.p, &jpn.errlevel);
+            ret = CreateNodeFromJSONParallel(json, jsonlen, threads, &jo, &jerr);
         }
-
-        // deal with path errors by returning null
-        if (E_OK != jpn.err) goto null;
-
-        // serialize it
-        sds json = sdsempty();
-        SerializeNodeToJSON(jpn.n, &jsopt, &json);
-
-        // check whether serialization had succeeded
-        if (!sdslen(json)) {
-            sdsfree(json);
-            RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_SERIALIZE);
-            RedisModule_ReplyWithError(ctx, REJSON_ERROR_SERIALIZE);
-            goto error;
+        Node_SetArena(prev);
+        if (JSONOBJECT_OK != ret) {
+            ReplyWithJSONObjectError(ctx, jerr);
+            if (jtnew) JSONTypeFree(jtnew);
+            return REDISMODULE_ERR;
         }
+        if (jtnew) jtnew->root = jo;
+    }
 
-        // add the serialization of object for that key's path
-        RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
-        sdsfree(json);
-        continue;
+    int set;
+    ret = JSONSet_Value(ctx, key, argv[1], argv[2], jo, jtnew, subcmd, &set);
+    if (set && !JSONReplicateEffects) RedisModule_ReplicateVerbatim(ctx);
+    return ret;
+}
 
-    null:  // reply with null for keys that the path mismatches
-        RedisModule_ReplyWithNull(ctx);
+/* A value that's being set in chunks with JSON.SETCHUNK */
+typedef struct {
+    int db;
+    sds key;
+    sds path;
+    long long seq;        // the number of the next chunk
+    JSONType_t *jtnew;    // the new document of a value at the root, which is built in its arena
+    JSONChunkParser *parser;
+} JSONUpload;
+
+/* The values that are being set in chunks */
+static struct {
+    JSONUpload **items;
+    size_t len, cap;
+} _uploads;
+
+/* Finds the upload to a key in a database, and sets pos to its position */
+static JSONUpload *JSONUpload_Find(int db, const char *key, size_t len, size_t *pos) {
+    for (size_t i = 0; i < _uploads.len; i++) {
+        JSONUpload *u = _uploads.items[i];
+        if (u->db == db && sdslen(u->key) == len && !memcmp(u->key, key, len)) {
+            *pos = i;
+            return u;
+        }
     }
+    return NULL;
+}
 
-    SearchPath_Free(&jpn.sp);
-    return REDISMODULE_OK;
+static JSONUpload *NewJSONUpload(int db, RedisModuleString *key, RedisModuleString *path) {
+    size_t keylen, pathlen;
+    const char *k = RedisModule_StringPtrLen(key, &keylen);
+    const char *p = RedisModule_StringPtrLen(path, &pathlen);
+    JSONUpload *u = calloc(1, sizeof(JSONUpload));
+    u->db = db;
+    u->key = sdsnewlen(k, keylen);
+    u->path = sdsnewlen(p, pathlen);
+    u->jtnew = JSONPath_IsRootPath(path) ? NewJSONType() : NULL;
+    u->parser = NewJSONChunkParser();
+
+    if (_uploads.len == _uploads.cap) {
+        _uploads.cap = _uploads.cap ? _uploads.cap * 2 : 8;
+        _uploads.items = realloc(_uploads.items, _uploads.cap * sizeof(JSONUpload *));
+    }
+    _uploads.items[_uploads.len++] = u;
+    return u;
+}
 
-error:
-    SearchPath_Free(&jpn.sp);
-    return REDISMODULE_ERR;
+/* Removes the upload at a position and frees it, with the nodes it had parsed */
+static void JSONUpload_Remove(size_t pos) {
+    JSONUpload *u = _uploads.items[pos];
+    _uploads.items[pos] = _uploads.items[--_uploads.len];
+    // the parser's nodes are freed first, as they may be in the document's arena
+    JSONChunkParser_Free(u->parser);
+    if (u->jtnew) JSONTypeFree(u->jtnew);
+    sdsfree(u->key);
+    sdsfree(u->path);
+    free(u);
 }
 
 /**
- * JSON.DEL <key> [path]
- * Delete a value.
+ * JSON.SETCHUNK <key> <path> <seq> <chunk> [COMMIT [NX|XX]]
+ * Sets the JSON value at `path` in `key` from chunks, so that a big value doesn't need to be sent
+ * in a single command, nor parsed at once.
  *
- * `path` defaults to root if not provided. Non-existing keys as well as non-existing paths are
- * ignored. Deleting an object's root is equivalent to deleting the key from Redis.
+ * The chunks are numbered from 0, and a chunk 0 starts a new upload to the key, dropping one that
+ * was in progress. The chunks are parsed as they arrive, and the nodes of the value are kept with
+ * the upload. The last chunk is sent with `COMMIT`, which sets the value like JSON.SET does with the
+ * optional `NX` and `XX`. An upload that has an error is dropped.
+ *
+ * Only the committed value is replicated, as a JSON.SET of its serialization.
  *
- * Reply: Integer, specifically the number of paths deleted (0 or 1).
+ * Reply: Simple String `OK` for every chunk, and the reply of JSON.SET for the committed value.
+*/
+int JSONSetChunk_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if ((argc < 5) || (argc > 7)) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    long long seq;
+    if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[3], &seq) || seq < 0) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_CHUNK_INVALID);
+        return REDISMODULE_ERR;
+    }
+    int commit = 0;
+    if (argc > 5) {
+        if (strcasecmp("commit", RedisModule_StringPtrLen(argv[5], NULL))) {
+            RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+        commit = 1;
+    }
+
+    // a chunk 0 starts a new upload, and the others must follow the previous one
+    size_t keylen, pathlen, pos;
+    const char *keystr = RedisModule_StringPtrLen(argv[1], &keylen);
+    const char *pathstr = RedisModule_StringPtrLen(argv[2], &pathlen);
+    int db = RedisModule_GetSelectedDb(ctx);
+    JSONUpload *u = JSONUpload_Find(db, keystr, keylen, &pos);
+    if (!seq) {
+        if (u) JSONUpload_Remove(pos);
+        u = NewJSONUpload(db, argv[1], argv[2]);
+        pos = _uploads.len - 1;
+    } else if (!u || u->seq != seq) {
+        sds err = sdscatprintf(sdsempty(), REJSON_ERROR_CHUNK_SEQ, u ? u->seq : 0);
+        RedisModule_ReplyWithError(ctx, err);
+        sdsfree(err);
+        return REDISMODULE_ERR;
+    } else if (sdslen(u->path) != pathlen || memcmp(u->path, pathstr, pathlen)) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_CHUNK_PATH);
+        return REDISMODULE_ERR;
+    }
+
+    // parse the chunk, and the end of the value when it's committed
+    size_t len;
+    const char *chunk = RedisModule_StringPtrLen(argv[4], &len);
+    Object *jo = NULL;
+    char *jerr = NULL;
+    NodeArena *prev = Node_SetArena(u->jtnew ? u->jtnew->arena : NULL);
+    int ret = JSONChunkParser_Feed(u->parser, chunk, len, &jerr);
+    if (JSONOBJECT_OK == ret && commit && !JSONChunkParser_Length(u->parser)) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EMPTY_STRING);
+        Node_SetArena(prev);
+        JSONUpload_Remove(pos);
+        return REDISMODULE_ERR;
+    }
+    if (JSONOBJECT_OK == ret && commit) ret = JSONChunkParser_Finish(u->parser, &jo, &jerr);
+    Node_SetArena(prev);
+    if (JSONOBJECT_OK != ret) {
+        ReplyWithJSONObjectError(ctx, jerr);
+        JSONUpload_Remove(pos);
+        return REDISMODULE_ERR;
+    }
+    u->seq++;
+    if (!commit) {
+        RedisModule_ReplyWithSimpleString(ctx, "OK");
+        return REDISMODULE_OK;
+    }
+
+    // the upload is done, and its document is the value's if it's set at the root
+    JSONType_t *jtnew = u->jtnew;
+    u->jtnew = NULL;
+    JSONUpload_Remove(pos);
+    if (jtnew) jtnew->root = jo;
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        if (jtnew) JSONTypeFree(jtnew);
+        else Node_Free(jo);
+        return REDISMODULE_ERR;
+    }
+
+    int set;
+    ret = JSONSet_Value(ctx, key, argv[1], argv[2], jo, jtnew, argc > 6 ? argv[6] : NULL, &set);
+    if (!set || JSONReplicateEffects) return ret;
+
+    // a value that's set belongs to the document
+    JSONSerializeOpt jsopt = {"", "", ""};
+    sds json = sdsempty();
+    SerializeNodeToJSON(jo, &jsopt, &json);
+    if (argc > 6) {
+        RedisModule_Replicate(ctx, "JSON.SET", "ssbs", argv[1], argv[2], json, sdslen(json),
+                              argv[6]);
+    } else {
+        RedisModule_Replicate(ctx, "JSON.SET", "ssb", argv[1], argv[2], json, sdslen(json));
+    }
+    sdsfree(json);
+    return ret;
+}
+
+/* Checks whether two search paths have the same parent, i.e. are equal but for their last nodes.
+ * The keys of compiled paths are interned, so they're equal if and only if their pointers are. */
+static int SearchPath_SameParent(const SearchPath *a, const SearchPath *b) {
+    if (a->len != b->len || SearchPath_IsRootPath(a)) return 0;
+    for (int i = 0; i < a->len - 1; i++) {
+        const PathNode *pa = &a->nodes[i], *pb = &b->nodes[i];
+        if (pa->type != pb->type) return 0;
+        if (NT_KEY == pa->type ? pa->value.key != pb->value.key : pa->value.index != pb->value.index)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * JSON.MSET <key> <path> <json> [<path> <json> ...]
+ * Sets the JSON value at each `path` in `key`, like a JSON.SET of every pair in their order does.
+ *
+ * All the paths and values are parsed before the document is changed. A new key must be created by
+ * a first pair at the root. The pairs are then applied in order, and a pair with a path error stops
+ * the command, leaving the pairs before it applied. A path that has the same parent as the previous
+ * pair's path isn't resolved again.
+ *
+ * Reply: Simple String `OK` if executed correctly.
+*/
+int JSONMSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if ((argc < 4) || (argc % 2)) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // key must be empty or a JSON type
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    int npairs = (argc - 2) / 2;
+    int ncompiled = 0, first = 0, changed = 0, ret = REDISMODULE_ERR;
+    JSONPathNode_t *jpns = calloc(npairs, sizeof(JSONPathNode_t));
+    Node **vals = calloc(npairs, sizeof(Node *));
+    JSONType_t *jtnew = NULL;
+
+    // compile the paths, a new key must be created at the root
+    for (; ncompiled < npairs; ncompiled++) {
+        if (PARSE_OK != JSONPathNode_Compile(argv[2 + 2 * ncompiled], &jpns[ncompiled])) {
+            ReplyWithSearchPathError(ctx, &jpns[ncompiled]);
+            goto done;
+        }
+    }
+    if (REDISMODULE_KEYTYPE_EMPTY == type) {
+        if (!SearchPath_IsRootPath(&jpns[0].sp)) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_NEW_NOT_ROOT);
+            goto done;
+        }
+        jtnew = NewJSONType();
+    }
+
+    // parse the values, a new document is built in the arena of its new container
+    for (int i = 0; i < npairs; i++) {
+        size_t jsonlen;
+        const char *json = RedisModule_StringPtrLen(argv[3 + 2 * i], &jsonlen);
+        if (!jsonlen) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_EMPTY_STRING);
+            goto done;
+        }
+        char *jerr = NULL;
+        NodeArena *prev = Node_SetArena(jtnew && !i ? jtnew->arena : NULL);
+        int pret = CreateNodeFromJSON(json, jsonlen, &vals[i], &jerr);
+        Node_SetArena(prev);
+        if (JSONOBJECT_OK != pret) {
+            vals[i] = NULL;
+            if (jerr) {
+                RedisModule_ReplyWithError(ctx, jerr);
+                free(jerr);
+            } else {
+                RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_JSONOBJECT_ERROR);
+                RedisModule_ReplyWithError(ctx, REJSON_ERROR_JSONOBJECT_ERROR);
+            }
+            goto done;
+        }
+    }
+
+    // the first pair of a new key creates it
+    JSONType_t *jt;
+    if (jtnew) {
+        jt = jtnew;
+        jt->root = vals[0];
+        vals[0] = NULL;
+        RedisModule_ModuleTypeSetValue(key, JSONType, jt);
+        JSONIndex_Track(ctx, jt, argv[1]);
+        jtnew = NULL;
+        changed = 1;
+        first = 1;
+        if (JSONReplicateEffects) JSONEffect_Set(ctx, argv[1], jt, &jpns[0].sp, jt->root);
+        JSONNotify(ctx, argv[1], "json.mset", jt, NULL);
+    } else {
+        JSONExpire_Apply(ctx, key, argv[1]);
+        jt = JSONTypeGet(key);
+    }
+
+    // apply the pairs in order, resolving only the last node of paths that share their parent,
+    // whose nodes on the way are the document's own already
+    Node *parent = NULL;  // the parent of the previous pair's path, if it was resolved
+    for (int i = first; i < npairs; i++) {
+        JSONPathNode_t *jpn = &jpns[i];
+        if (SearchPath_IsRootPath(&jpn->sp)) {
+            JSONTypeTouch(jt);
+            Node_Free(jt->root);
+            jt->root = vals[i];
+            vals[i] = NULL;
+            parent = NULL;
+            changed = 1;
+            if (JSONReplicateEffects) JSONEffect_Set(ctx, argv[1], jt, &jpn->sp, jt->root);
+            JSONNotify(ctx, argv[1], "json.mset", jt, NULL);
+            continue;
+        }
+
+        JSONTypeAccessPath(jt, &jpn->sp, 0);
+        if (parent && SearchPath_SameParent(&jpn->sp, &jpns[i - 1].sp)) {
+            SearchPath last = jpn->sp;
+            last.nodes += last.len - 1;
+            last.len = 1;
+            jpn->err =
+                SearchPath_FindEx(&last, parent, &jpn->item, &jpn->n, &jpn->p, &jpn->errlevel);
+            jpn->errlevel += jpn->sp.len - 1;
+        } else {
+            jpn->err = SearchPath_FindEx(&jpn->sp, jt->root, &jpn->item, &jpn->n, &jpn->p,
+                                         &jpn->errlevel);
+        }
+        parent = NULL;
+
+        // only the last node of the path may be missing, and only in an object
+        if (E_OK != jpn->err && E_NOKEY != jpn->err) {
+            ReplyWithPathError(ctx, jpn);
+            goto done;
+        }
+        if (E_NOKEY == jpn->err && jpn->errlevel != jpn->sp.len - 1) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_PATH_NONTERMINAL_KEY);
+            goto done;
+        }
+
+        JSONTypeTouch(jt);
+        changed = 1;
+        if (N_DICT == NODETYPE(jpn->p)) {
+            const char *k = jpn->sp.nodes[jpn->sp.len - 1].value.key;
+            if (OBJ_OK != Node_DictSet(jpn->p, k, vals[i])) {
+                RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_DICT_SET);
+                RedisModule_ReplyWithError(ctx, REJSON_ERROR_DICT_SET);
+                goto done;
+            }
+        } else {  // must be an array
+            int index = jpn->sp.nodes[jpn->sp.len - 1].value.index;
+            if (index < 0) index = Node_Length(jpn->p) + index;
+            if (OBJ_OK != Node_ArrayReplace(jpn->p, index, vals[i])) {
+                RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_ARRAY_SET);
+                RedisModule_ReplyWithError(ctx, REJSON_ERROR_ARRAY_SET);
+                goto done;
+            }
+        }
+        if (JSONReplicateEffects) JSONEffect_Set(ctx, argv[1], jt, &jpn->sp, vals[i]);
+        JSONNotify(ctx, argv[1], "json.mset", jt, &jpn->sp);
+        vals[i] = NULL;
+        parent = jpn->p;
+    }
+
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    ret = REDISMODULE_OK;
+
+done:
+    // the pairs are applied deterministically, so a partial change is replicated as is
+    if (changed && !JSONReplicateEffects) RedisModule_ReplicateVerbatim(ctx);
+    for (int i = 0; i < ncompiled; i++) JSONPathNode_Free(&jpns[i]);
+    if (jtnew) {
+        // the new container owns the first value
+        jtnew->root = vals[0];
+        vals[0] = NULL;
+        JSONTypeFree(jtnew);
+    }
+    for (int i = 0; i < npairs; i++) Node_Free(vals[i]);
+    free(jpns);
+    free(vals);
+    return ret;
+}
+
+/**
+ * JSON.SETSCHEMA <key> <json>
+ * Sets the JSON Schema `json` as the value of `key`, after checking that it compiles.
+ *
+ * A schema is a document like any other, that JSON.SET's `SCHEMA` and JSON.VALIDATE validate values
+ * against. Any document can be used as a schema, and is compiled when it's first used. Setting it
+ * with this command compiles it right away, so an unsupported schema fails here rather than when
+ * values are validated.
+ *
+ * Reply: Simple String `OK`.
+*/
+int JSONSetSchema_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    size_t jsonlen;
+    const char *json = RedisModule_StringPtrLen(argv[2], &jsonlen);
+    if (!jsonlen) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EMPTY_STRING);
+        return REDISMODULE_ERR;
+    }
+
+    // the schema is built in its new document's arena, and compiled into it
+    Object *jo = NULL;
+    char *jerr = NULL;
+    JSONType_t *jtnew = NewJSONType();
+    NodeArena *prev = Node_SetArena(jtnew->arena);
+    int ret = CreateNodeFromJSON(json, jsonlen, &jo, &jerr);
+    Node_SetArena(prev);
+    if (JSONOBJECT_OK == ret) {
+        jtnew->root = jo;
+        if (!JSONTypeSchema(jtnew, &jerr)) ret = JSONOBJECT_ERROR;
+    }
+    if (JSONOBJECT_OK != ret) {
+        ReplyWithJSONObjectError(ctx, jerr);
+        JSONTypeFree(jtnew);
+        return REDISMODULE_ERR;
+    }
+
+    int set;
+    RedisModuleString *root = RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1);
+    ret = JSONSet_Value(ctx, key, argv[1], root, jo, jtnew, NULL, &set);
+    if (set && !JSONReplicateEffects) RedisModule_ReplicateVerbatim(ctx);
+    return ret;
+}
+
+/**
+ * JSON.VALIDATE <schema-key> <json>
+ * Validates `json` against the JSON Schema at `schema-key`, as JSON.SET's `SCHEMA` does, without
+ * setting it.
+ *
+ * Reply: Simple String `OK` if the value is valid, otherwise an error with the position where it
+ * stops matching the schema and the reason.
+*/
+int JSONValidate_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    JSONSchema *schema = JSONSet_OpenSchema(ctx, argv[1]);
+    if (!schema) return REDISMODULE_ERR;
+
+    size_t jsonlen;
+    const char *json = RedisModule_StringPtrLen(argv[2], &jsonlen);
+    if (!jsonlen) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EMPTY_STRING);
+        return REDISMODULE_ERR;
+    }
+
+    Object *jo = NULL;
+    char *jerr = NULL;
+    if (JSONOBJECT_OK != CreateNodeFromJSONSchema(json, jsonlen, schema, &jo, &jerr)) {
+        ReplyWithJSONObjectError(ctx, jerr);
+        return REDISMODULE_ERR;
+    }
+    Node_Free(jo);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/* Composes the key of a serialized value in the cache from the arguments that follow the key of a
+ * JSON.GET, each prefixed by its length. */
+static sds JSONGet_CacheKey(RedisModuleString **argv, int argc) {
+    sds cachekey = sdsempty();
+    for (int i = 0; i < argc; i++) {
+        size_t arglen;
+        const char *arg = RedisModule_StringPtrLen(argv[i], &arglen);
+        uint32_t len = (uint32_t)arglen;
+        cachekey = sdscatlen(cachekey, &len, sizeof(len));
+        cachekey = sdscatlen(cachekey, arg, arglen);
+    }
+    return cachekey;
+}
+
+/**
+* JSON.GET replies of values whose nodes take at least this much memory are serialized on a thread,
+* see JSONGet_ReplyAsync. It's set with the ASYNC_GET_MEMORY module argument, 0 disables it.
+*/
+static size_t JSONGetAsyncMemory = 0;
+
+/* A JSON.GET reply that is serialized on a thread */
+typedef struct {
+    RedisModuleBlockedClient *bc;
+    JSONTypeSnapshot_t *snapshot;  // the document's nodes, which aren't written to while it's held
+    const Node *n;                 // the value in the snapshot
+    sds indentstr, newlinestr, spacestr;
+    const PackFormat *pack;  // the format of a reply that isn't JSON, which points to format
+    PackFormat format;
+    sds json;  // the serialization, which is empty if it had failed
+} JSONGetTask;
+
+static void JSONGetTask_Free(void *privdata) {
+    JSONGetTask *t = privdata;
+    if (t->snapshot) JSONTypeReleaseSnapshot(t->snapshot);
+    sdsfree(t->indentstr);
+    sdsfree(t->newlinestr);
+    sdsfree(t->spacestr);
+    sdsfree(t->json);
+    free(t);
+}
+
+static void *JSONGetTask_Thread(void *arg) {
+    JSONGetTask *t = arg;
+    JSONSerializeOpt opt = {t->indentstr, t->newlinestr, t->spacestr};
+    if (t->pack) SerializeNodeToPack(t->n, t->format, &t->json);
+    else SerializeNodeToJSON(t->n, &opt, &t->json);
+    RedisModule_UnblockClient(t->bc, t);
+    return NULL;
+}
+
+static int JSONGetTask_Reply(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    JSONGetTask *t = RedisModule_GetBlockedClientPrivateData(ctx);
+    if (!sdslen(t->json)) {
+        RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_SERIALIZE);
+        return RedisModule_ReplyWithError(ctx, REJSON_ERROR_SERIALIZE);
+    }
+    return RedisModule_ReplyWithStringBuffer(ctx, t->json, sdslen(t->json));
+}
+
+/**
+* Checks whether a JSON.GET of a document's value is big enough to be serialized on a thread. The
+* root's memory is cached per version, and a value below the root is measured by counting its nodes
+* up to as many as fit in JSONGetAsyncMemory, so the check doesn't walk a whole big value.
+*/
+static int JSONGet_IsAsync(JSONType_t *jt, const Node *n) {
+    if (!JSONGetAsyncMemory || !n || (N_DICT != n->type && N_ARRAY != n->type)) return 0;
+    if (JSONTypeRootMemoryUsage(jt) < JSONGetAsyncMemory) return 0;
+    if (n == jt->root) return 1;
+    size_t limit = (JSONGetAsyncMemory + sizeof(Node) - 1) / sizeof(Node);
+    return Node_Count(n, limit) >= limit;
+}
+
+/**
+* Replies to a JSON.GET of a value by blocking the client while a thread serializes it. The thread
+* reads the value from a snapshot of the document's nodes, which takes O(1). Commands that read the
+* document while the thread does use the same nodes, and a command that writes to it copies the
+* nodes on the way to the values that it writes to first (see JSONTypeAccessPath).
+* The reply is in the pack format, or in JSON if it's NULL. Returns 0 if the thread can't be
+* started or the snapshot can't hold the root, in which case nothing is replied.
+*/
+static int JSONGet_ReplyAsync(RedisModuleCtx *ctx, JSONType_t *jt, const Node *n,
+                              const JSONSerializeOpt *opt, const PackFormat *pack) {
+    JSONGetTask *t = calloc(1, sizeof(JSONGetTask));
+    t->snapshot = JSONTypeSnapshot(jt);
+    t->n = n;
+    if (t->snapshot->root != jt->root) {
+        // the root has as many holders as it can count, so the snapshot holds a copy of it
+        JSONGetTask_Free(t);
+        return 0;
+    }
+    if (pack) {
+        t->format = *pack;
+        t->pack = &t->format;
+    }
+    t->indentstr = sdsnew(opt->indentstr);
+    t->newlinestr = sdsnew(opt->newlinestr);
+    t->spacestr = sdsnew(opt->spacestr);
+    t->json = sdsempty();
+
+    JSON_ScanKernel();  // the scan kernel is picked on the main thread
+    t->bc = RedisModule_BlockClient(ctx, JSONGetTask_Reply, NULL, JSONGetTask_Free, 0);
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, JSONGetTask_Thread, t)) {
+        RedisModule_AbortBlock(t->bc);
+        JSONGetTask_Free(t);
+        return 0;
+    }
+    pthread_detach(tid);
+    return 1;
+}
+
+/* The fragments of a chunked JSON.GET reply */
+typedef struct {
+    RedisModuleCtx *ctx;
+    long len;  // the number of fragments that were replied
+} JSONGetChunks;
+
+static void JSONGet_ReplyChunk(const char *buf, size_t len, void *ctx) {
+    JSONGetChunks *chunks = ctx;
+    RedisModule_ReplyWithStringBuffer(chunks->ctx, buf, len);
+    chunks->len++;
+}
+
+/* Checks whether a path of a JSON.GET with several paths repeats one of the paths before it */
+static int JSONGet_IsDupPath(JSONPathNode_t *jpns, int i) {
+    for (int j = 0; j < i; j++) {
+        if (jpns[j].spathlen == jpns[i].spathlen &&
+            !memcmp(jpns[j].spath, jpns[i].spath, jpns[i].spathlen))
+            return 1;
+    }
+    return 0;
+}
+
+/* Encodes a JSON.GET reply of resolved paths in MessagePack or CBOR, like it is serialized */
+static void JSONGet_Pack(JSONType_t *jt, JSONPathNode_t *jpns, int jpnslen, PackFormat format,
+                         sds *buf) {
+    if (1 == jpnslen) {
+        if (SearchPath_IsMulti(&jpns[0].sp)) JSONPathNode_PackMatches(jt, &jpns[0], format, buf);
+        else SerializeNodeToPack(jpns[0].n, format, buf);
+        return;
+    }
+
+    uint32_t len = 0;
+    for (int i = 0; i < jpnslen; i++) len += !JSONGet_IsDupPath(jpns, i);
+    Pack_BeginDict(format, len, buf);
+    for (int i = 0; i < jpnslen; i++) {
+        if (JSONGet_IsDupPath(jpns, i)) continue;
+        Pack_String(format, jpns[i].spath, jpns[i].spathlen, buf);
+        if (SearchPath_IsMulti(&jpns[i].sp)) JSONPathNode_PackMatches(jt, &jpns[i], format, buf);
+        else SerializeNodeToPack(jpns[i].n, format, buf);
+    }
+}
+
+/* Fetches the document of a key that a reference resolves to, see JSON.GET's RESOLVE */
+static const Node *JSONGet_FetchKeyRef(const char *keyname, size_t len, void *ctx) {
+    RedisModuleCtx *rctx = (RedisModuleCtx *)ctx;
+    RedisModuleString *name = RedisModule_CreateString(rctx, keyname, len);
+    RedisModuleKey *key = RedisModule_OpenKey(rctx, name, REDISMODULE_READ);
+    if (RedisModule_ModuleTypeGetType(key) != JSONType) return NULL;
+    JSONExpire_Apply(rctx, key, name);
+    return JSONTypeGet(key)->root;
+}
+
+/**
+ * JSON.GET <key> [INDENT indentation-string] [NEWLINE newline-string] [SPACE space-string]
+ *                [CHUNKS size] [FORMAT MSGPACK|CBOR|JSON] [RESOLVE depth] [path ...]
+ * Return the value at `path` in JSON serialized form.
+ *
+ * This command accepts multiple `path`s, and defaults to the value's root when none are given.
+ * A path with slices, wildcards or recursive descent returns the array of the values it matches,
+ * which is serialized from the document without the matches being copied.
+ *
+ * The following subcommands change the reply's and are all set to the empty string by default:
+ *   - `INDENT` sets the indentation string for nested levels
+ *   - `NEWLINE` sets the string that's printed at the end of each line
+ *   - `SPACE` sets the string that's put between a key and a value
+ *
+ * `CHUNKS` makes the reply an array of the serialization's fragments, which are replied as they're
+ * made, so that big values aren't held in memory in full while they're serialized. Fragments hold
+ * at least `size` bytes but for the last, and chunked replies aren't cached.
+ *
+ * `FORMAT` replies in MessagePack or CBOR instead of JSON, encoding the values straight from the
+ * document's nodes. The formatting subcommands don't apply to them, nor does `CHUNKS`.
+ *
+ * `RESOLVE` replaces the references to other keys in the values, i.e. objects like
+ * {"$ref":"<key>"}, by the keys' documents, up to `depth` references deep (see json_keyref.h).
+ * All the referenced keys are fetched once before the reply is serialized, and a reference to a
+ * key that's already being resolved is left as it is. Resolved replies aren't cached.
+ *
+ * Reply: Bulk String, specifically the JSON serialization.
+ * The reply's structure depends on the on the number of paths. A single path results in the value
+ * being itself is returned, whereas multiple paths are returned as a JSON object in which each path
+ * is a key.
+*/
+int JSONGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if ((argc < 2)) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // key must be empty (reply with null) or an object type
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY == type) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    } else if (RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    // check for optional arguments
+    int pathpos = 2;
+    JSONSerializeOpt jsopt = {0};
+    if (pathpos < argc) {
+        RMUtil_ParseArgsAfter("indent", argv, argc, "c", &jsopt.indentstr);
+        if (jsopt.indentstr) {
+            pathpos += 2;
+        } else {
+            jsopt.indentstr = "";
+        }
+    }
+    if (pathpos < argc) {
+        RMUtil_ParseArgsAfter("newline", argv, argc, "c", &jsopt.newlinestr);
+        if (jsopt.newlinestr) {
+            pathpos += 2;
+        } else {
+            jsopt.newlinestr = "";
+        }
+    }
+    if (pathpos < argc) {
+        RMUtil_ParseArgsAfter("space", argv, argc, "c", &jsopt.spacestr);
+        if (jsopt.spacestr) {
+            pathpos += 2;
+        } else {
+            jsopt.spacestr = "";
+        }
+    }
+    long long chunk = 0;
+    if (pathpos < argc && RMUtil_ArgExists("chunks", argv, argc, pathpos)) {
+        if (REDISMODULE_OK != RMUtil_ParseArgsAfter("chunks", argv, argc, "l", &chunk) ||
+            chunk < 1) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_GET_CHUNKS);
+            return REDISMODULE_ERR;
+        }
+        pathpos += 2;
+    }
+    PackFormat format;
+    const PackFormat *pack = NULL;
+    if (pathpos < argc && RMUtil_ArgExists("format", argv, argc, pathpos)) {
+        RedisModuleString *name = NULL;
+        int packed;
+        RMUtil_ParseArgsAfter("format", argv, argc, "s", &name);
+        if (!name || REDISMODULE_OK != JSONFormat_Parse(name, &packed, &format)) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_FORMAT);
+            return REDISMODULE_ERR;
+        }
+        if (packed) pack = &format;
+        if (pack && chunk) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_FORMAT_CHUNKS);
+            return REDISMODULE_ERR;
+        }
+        pathpos += 2;
+    }
+    long long resolve = 0;
+    if (pathpos < argc && RMUtil_ArgExists("resolve", argv, argc, pathpos)) {
+        if (REDISMODULE_OK != RMUtil_ParseArgsAfter("resolve", argv, argc, "l", &resolve) ||
+            resolve < 1 || resolve > KEYREF_MAX_DEPTH) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_RESOLVE_DEPTH);
+            return REDISMODULE_ERR;
+        }
+        if (pack) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_FORMAT_RESOLVE);
+            return REDISMODULE_ERR;
+        }
+        pathpos += 2;
+    }
+
+    JSONExpire_Apply(ctx, key, argv[1]);
+
+    // reply with the text of a lazy document for its root without formatting
+    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    int formatted = (jsopt.indentstr && *jsopt.indentstr) ||
+                    (jsopt.newlinestr && *jsopt.newlinestr) || (jsopt.spacestr && *jsopt.spacestr);
+    if (jt->raw && !chunk && !formatted && !pack && !resolve &&
+        (argc == pathpos || (argc == pathpos + 1 && JSONPath_IsRootPath(argv[pathpos])))) {
+        RedisModule_ReplyWithStringBuffer(ctx, jt->raw, sdslen(jt->raw));
+        return REDISMODULE_OK;
+    }
+    JSONTypeAccess(jt, 0);
+
+    // reply with the cached serialization if the document hasn't changed since it was cached, which
+    // can't tell whether the keys that references resolve to have
+    sds cachekey = JSONGet_CacheKey(&argv[2], argc - 2);
+    size_t cachedlen;
+    const char *cached =
+        chunk || resolve
+            ? NULL
+            : SerialCache_Get(&jt->serialized, jt->version, cachekey, sdslen(cachekey), &cachedlen);
+    if (cached) {
+        RedisModule_ReplyWithStringBuffer(ctx, cached, cachedlen);
+        sdsfree(cachekey);
+        return REDISMODULE_OK;
+    }
+
+    // initialize the reply
+    sds json = sdsempty();
+
+    // compile the paths, if none provided default to root. Their lookups are counted as one.
+    uint64_t pathbegin = Stats_Begin();
+    int npaths = MAX(argc - pathpos, 1);
+    int jpnslen = 0;
+    JSONPathNode_t jpns[npaths];
+    int parsed = 1;
+    while (parsed && jpnslen < npaths) {
+        RedisModuleString *path = argc > pathpos ? argv[pathpos + jpnslen]
+                                                 : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1);
+        parsed = PARSE_OK == JSONPathNode_Compile(path, &jpns[jpnslen]);
+        jpnslen++;
+    }
+
+    // resolve the compiled paths, walking the prefixes that several paths share once
+    int nresolved = parsed ? jpnslen : jpnslen - 1;
+    if (nresolved) JSONPathNode_ResolveAll(jt, jpns, nresolved);
+    size_t pathbytes = 0;
+    int patherr = !parsed;
+    for (int i = 0; i < jpnslen; i++) pathbytes += jpns[i].spathlen;
+    for (int i = 0; i < nresolved; i++) {
+        Stats_PathDepth(jpns[i].sp.len);
+        patherr |= E_OK != jpns[i].err;
+    }
+    Stats_End(STATS_PATH, pathbegin, pathbytes, 0, patherr);
+
+    // report the first bad path, in the order of the arguments. Paths that can match multiple values
+    // are searched as they're serialized, and just match nothing where the others have errors.
+    for (int i = 0; i < nresolved; i++) {
+        if (E_OK != jpns[i].err && !SearchPath_IsMulti(&jpns[i].sp)) {
+            ReplyWithPathError(ctx, &jpns[i]);
+            goto error;
+        }
+    }
+    if (!parsed) {
+        ReplyWithSearchPathError(ctx, &jpns[jpnslen - 1]);
+        goto error;
+    }
+
+    // a big value of a single path is serialized on a thread, and isn't cached
+    if (!chunk && !resolve && 1 == jpnslen && !SearchPath_IsMulti(&jpns[0].sp) &&
+        JSONGet_IsAsync(jt, jpns[0].n) &&
+        JSONGet_ReplyAsync(ctx, jt, jpns[0].n, &jsopt, pack)) {
+        JSONPathNode_Free(&jpns[0]);
+        sdsfree(cachekey);
+        sdsfree(json);
+        return REDISMODULE_OK;
+    }
+
+    // return the single path's JSON value, or all paths-values as an object with a key per path,
+    // where the value of a path that can match multiple values is the array of its matches. A
+    // chunked reply is the array of the serialization's fragments, each replied once it's made.
+    // References are resolved as the values are written, with the keys they refer to fetched first.
+    JSONGetChunks chunks = {ctx, 0};
+    KeyRefResolver *refs = NULL;
+    if (chunk) RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+    if (pack) {
+        JSONGet_Pack(jt, jpns, jpnslen, *pack, &json);
+    } else if (1 == jpnslen && !SearchPath_IsMulti(&jpns[0].sp) && !chunk && !resolve) {
+        SerializeNodeToJSON(jpns[0].n, &jsopt, &json);
+    } else {
+        JSONSerializer *s = NewJSONSerializer(&jsopt, json);
+        if (chunk) JSONSerializer_SetFlush(s, chunk, JSONGet_ReplyChunk, &chunks);
+        if (resolve) {
+            size_t keylen;
+            const char *keyname = RedisModule_StringPtrLen(argv[1], &keylen);
+            refs = NewKeyRefResolver(keyname, keylen, resolve, JSONGet_FetchKeyRef, ctx);
+            JSONSerializer_SetWriter(s, KeyRefResolver_Write, refs);
+        }
+        if (1 == jpnslen && !SearchPath_IsMulti(&jpns[0].sp)) {
+            JSONSerializer_Value(s, jpns[0].n);
+        } else if (1 == jpnslen) {
+            JSONPathNode_SerializeMatches(jt, &jpns[0], s);
+        } else {
+            JSONSerializer_BeginDict(s);
+            for (int i = 0; i < jpnslen; i++) {
+                // a path that's repeated is a single key
+                if (JSONGet_IsDupPath(jpns, i)) continue;
+                JSONSerializer_Key(s, jpns[i].spath, jpns[i].spathlen);
+                if (SearchPath_IsMulti(&jpns[i].sp)) {
+                    JSONPathNode_SerializeMatches(jt, &jpns[i], s);
+                } else {
+                    JSONSerializer_Value(s, jpns[i].n);
+                }
+            }
+            JSONSerializer_End(s);
+        }
+        json = JSONSerializer_Free(s);
+        if (refs) KeyRefResolver_Free(refs);
+    }
+    if (chunk) {
+        RedisModule_ReplySetArrayLength(ctx, chunks.len);
+        for (int i = 0; i < jpnslen; i++) {
+            JSONPathNode_Free(&jpns[i]);
+        }
+        sdsfree(cachekey);
+        sdsfree(json);
+        return REDISMODULE_OK;
+    }
+
+    // check whether serialization had succeeded
+    if (!sdslen(json)) {
+        RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_SERIALIZE);
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_SERIALIZE);
+        goto error;
+    }
+
+    RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
+    if (!resolve)
+        SerialCache_Put(&jt->serialized, jt->version, cachekey, sdslen(cachekey), json,
+                        sdslen(json));
+
+    for (int i = 0; i < jpnslen; i++) {
+        JSONPathNode_Free(&jpns[i]);
+    }
+    sdsfree(cachekey);
+    sdsfree(json);
+    return REDISMODULE_OK;
+
+error:
+    for (int i = 0; i < jpnslen; i++) {
+        JSONPathNode_Free(&jpns[i]);
+    }
+    sdsfree(cachekey);
+    sdsfree(json);
+    return REDISMODULE_ERR;
+}
+
+/**
+ * JSON.MGET <key> [<key> ...] <path>
+ * JSON.MGETARRAY <key> [<key> ...] <path>
+ * Returns the values at `path` from multiple `key`s. Non-existing keys and non-existing paths are
+ * reported as null. A path that can match multiple values returns the array of its matches.
+ * The path is compiled once for all the keys, and the values are serialized in a single buffer.
+ * The values are shared with JSON.GET's cache of serialized values.
+ * Reply: JSON.MGET replies with an Array of Bulk Strings, specifically the JSON serialization of the
+ * value at each key's path. JSON.MGETARRAY replies with a Bulk String, specifically a JSON array of
+ * these values.
+*/
+int JSONMGet_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if ((argc < 2)) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    if (RedisModule_IsKeysPositionRequest(ctx)) {
+        for (int i = 1; i < argc - 1; i++) RedisModule_KeyAtPos(ctx, i);
+        return REDISMODULE_OK;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // the actual command
+    const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
+    int asarray = !strcasecmp("json.mgetarray", cmd);
+
+    // validate search path
+    JSONPathNode_t jpn;
+    if (PARSE_OK != JSONPathNode_Compile(argv[argc - 1], &jpn)) {
+        ReplyWithSearchPathError(ctx, &jpn);
+        goto error;
+    }
+
+    // iterate keys, serializing to the end of the buffer that's either reused or the whole reply
+    if (!asarray) RedisModule_ReplyWithArray(ctx, argc - 2);
+    JSONSerializeOpt jsopt = {0};
+    int multi = SearchPath_IsMulti(&jpn.sp);
+    sds cachekey = JSONGet_CacheKey(&argv[argc - 1], 1);
+    sds json = sdsnewlen("[", asarray);
+    for (int i = 1; i < argc - 1; i++) {
+        if (asarray && i > 1) json = sdscatlen(json, ",", 1);
+        else if (!asarray) sdsclear(json);
+        size_t start = sdslen(json);
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ);
+
+        // key must an object type, empties and others return null like Redis' MGET
+        int type = RedisModule_KeyType(key);
+        if (REDISMODULE_KEYTYPE_EMPTY == type) goto null;
+        if (RedisModule_ModuleTypeGetType(key) != JSONType) goto null;
+
+        JSONExpire_Apply(ctx, key, argv[i]);
+
+        // the cached serialization is good if the document hasn't changed since it was cached, and
+        // the text of a lazy document is as good for its root
+        JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+        size_t cachedlen;
+        const char *cached;
+        if (jt->raw && SearchPath_IsRootPath(&jpn.sp)) {
+            cached = jt->raw;
+            cachedlen = sdslen(jt->raw);
+        } else {
+            JSONTypeAccess(jt, 0);
+            cached = SerialCache_Get(&jt->serialized, jt->version, cachekey, sdslen(cachekey),
+                                     &cachedlen);
+        }
+        if (cached) {
+            json = sdscatlen(json, cached, cachedlen);
+        } else {
+            if (multi) {
+                // the array of the values that the path matches
+                JSONSerializer *s = NewJSONSerializer(&jsopt, json);
+                JSONPathNode_SerializeMatches(jt, &jpn, s);
+                json = JSONSerializer_Free(s);
+            } else {
+                // follow the path to the target node in the key
+                JSONPathNode_Resolve(jt, &jpn);
+
+                // deal with path errors by returning null
+                if (E_OK != jpn.err) goto null;
+
+                SerializeNodeToJSON(jpn.n, &jsopt, &json);
+            }
+
+            // check whether serialization had succeeded
+            if (sdslen(json) == start) {
+                RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_SERIALIZE);
+                goto null;
+            }
+            SerialCache_Put(&jt->serialized, jt->version, cachekey, sdslen(cachekey), json + start,
+                            sdslen(json) - start);
+        }
+
+        // add the serialization of object for that key's path
+        if (!asarray) RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
+        continue;
+
+    null:  // reply with null for keys that the path mismatches, or that can't be serialized
+        if (asarray) json = sdscatlen(json, "null", 4);
+        else RedisModule_ReplyWithNull(ctx);
+    }
+
+    if (asarray) {
+        json = sdscatlen(json, "]", 1);
+        RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
+    }
+    sdsfree(cachekey);
+    sdsfree(json);
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_OK;
+
+error:
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_ERR;
+}
+
+/**
+ * JSON.SCAN <cursor> [MATCH <pattern>] [COUNT <count>] [PATH <path> [<path> ...]]
+ * Iterates the documents of the database like SCAN iterates its keys, returning the values at the
+ * `path`s of every document along with its key.
+ *
+ * The keys are those that a SCAN with the same `cursor`, `pattern` and `count` returns. Keys of
+ * other types are skipped, and so are the documents that have none of the paths. The paths are
+ * compiled once for all the documents and default to the root. A path that can match multiple
+ * values returns the array of its matches, and a document where it matches nothing doesn't have it.
+ *
+ * Reply: Array of the next cursor, a Bulk String that's "0" once the iteration is complete, and an
+ * Array of the key of every document that was found followed by the Array of its values: Bulk
+ * Strings of their JSON serializations, or Null Bulks for the paths that the document doesn't have.
+*/
+
+/* The keys that a scan looks at without a COUNT, as many as SCAN's */
+#define JSONSCAN_DEFAULT_COUNT 10
+
+int JSONScan_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 2) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // parse the options, the paths are all the arguments after PATH
+    RedisModuleString *pattern = NULL;
+    long long count = JSONSCAN_DEFAULT_COUNT;
+    int pathpos = argc;
+    for (int i = 2; i < argc && pathpos == argc; i += 2) {
+        const char *opt = RedisModule_StringPtrLen(argv[i], NULL);
+        if (i + 1 == argc) {
+            RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        } else if (!strcasecmp("path", opt)) {
+            pathpos = i + 1;
+        } else if (!strcasecmp("match", opt)) {
+            pattern = argv[i + 1];
+        } else if (!strcasecmp("count", opt)) {
+            if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[i + 1], &count) || count < 1) {
+                RedisModule_ReplyWithError(ctx, REJSON_ERROR_SCAN_COUNT);
+                return REDISMODULE_ERR;
+            }
+        } else {
+            RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    // compile the paths before scanning, if none provided default to root
+    int npaths = MAX(argc - pathpos, 1);
+    JSONPathNode_t jpns[npaths];
+    for (int i = 0; i < npaths; i++) {
+        RedisModuleString *path =
+            pathpos < argc ? argv[pathpos + i] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1);
+        if (PARSE_OK != JSONPathNode_Compile(path, &jpns[i])) {
+            ReplyWithSearchPathError(ctx, &jpns[i]);
+            for (int j = 0; j <= i; j++) JSONPathNode_Free(&jpns[j]);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    // the keys are the server's SCAN's, its errors (e.g. of an invalid cursor) are the reply's
+    if (!pattern) pattern = RedisModule_CreateString(ctx, "*", 1);
+    RedisModuleCallReply *r =
+        RedisModule_Call(ctx, "SCAN", "scscl", argv[1], "MATCH", pattern, "COUNT", count);
+    if (!r || REDISMODULE_REPLY_ARRAY != RedisModule_CallReplyType(r) ||
+        2 != RedisModule_CallReplyLength(r)) {
+        if (r && REDISMODULE_REPLY_ERROR == RedisModule_CallReplyType(r))
+            RedisModule_ReplyWithCallReply(ctx, r);
+        else
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_SCAN);
+        for (int i = 0; i < npaths; i++) JSONPathNode_Free(&jpns[i]);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_ReplyWithArray(ctx, 2);
+    RedisModule_ReplyWithCallReply(ctx, RedisModule_CallReplyArrayElement(r, 0));
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+
+    // the values of a document are serialized to the buffer before its key is known to be replied
+    RedisModuleCallReply *keys = RedisModule_CallReplyArrayElement(r, 1);
+    JSONSerializeOpt jsopt = {0};
+    sds json = sdsempty();
+    size_t ends[npaths];
+    int found[npaths];
+    long replied = 0;
+    for (size_t k = 0; k < RedisModule_CallReplyLength(keys); k++) {
+        RedisModuleString *name =
+            RedisModule_CreateStringFromCallReply(RedisModule_CallReplyArrayElement(keys, k));
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, name, REDISMODULE_READ);
+        if (RedisModule_ModuleTypeGetType(key) != JSONType) goto next;
+        JSONExpire_Apply(ctx, key, name);
+
+        // the text of a lazy document is as good for its root, and spares building its values
+        JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+        int raw = NULL != jt->raw;
+        for (int i = 0; i < npaths; i++) raw &= SearchPath_IsRootPath(&jpns[i].sp);
+        if (!raw) {
+            JSONTypeAccess(jt, 0);
+            JSONPathNode_ResolveAll(jt, jpns, npaths);
+        }
+
+        int nfound = 0;
+        sdsclear(json);
+        for (int i = 0; i < npaths; i++) {
+            size_t start = sdslen(json);
+            if (raw) {
+                json = sdscatsds(json, jt->raw);
+            } else if (SearchPath_IsMulti(&jpns[i].sp)) {
+                JSONSerializer *s = NewJSONSerializer(&jsopt, json);
+                JSONPathNode_SerializeMatches(jt, &jpns[i], s);
+                json = JSONSerializer_Free(s);
+                if (2 == sdslen(json) - start) sdssetlen(json, start);  // matched nothing
+            } else if (E_OK == jpns[i].err) {
+                SerializeNodeToJSON(jpns[i].n, &jsopt, &json);
+            }
+            ends[i] = sdslen(json);
+            found[i] = ends[i] > start;
+            nfound += found[i];
+        }
+        if (!nfound) goto next;
+
+        RedisModule_ReplyWithString(ctx, name);
+        RedisModule_ReplyWithArray(ctx, npaths);
+        for (int i = 0; i < npaths; i++) {
+            size_t start = i ? ends[i - 1] : 0;
+            if (found[i])
+                RedisModule_ReplyWithStringBuffer(ctx, json + start, ends[i] - start);
+            else
+                RedisModule_ReplyWithNull(ctx);
+        }
+        replied += 2;
+
+    next:
+        RedisModule_CloseKey(key);
+        RedisModule_FreeString(ctx, name);
+    }
+    RedisModule_ReplySetArrayLength(ctx, replied);
+
+    sdsfree(json);
+    RedisModule_FreeCallReply(r);
+    for (int i = 0; i < npaths; i++) JSONPathNode_Free(&jpns[i]);
+    return REDISMODULE_OK;
+}
+
+/**
+ * JSON.DEL <key> [path]
+ * Delete a value.
+ *
+ * `path` defaults to root if not provided. Non-existing keys as well as non-existing paths are
+ * ignored. Deleting an object's root is equivalent to deleting the key from Redis.
+ *
+ * Reply: Integer, specifically the number of paths deleted (0 or 1), or the number of values deleted
+ * for a path that can match multiple values.
 */
 int JSONDel_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     // check args
-    if ((argc < 2) || (argc > 3)) {
+    if ((argc < 2) || (argc > 3)) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // key must be empty or a JSON type
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY == type) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    } else if (RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    // validate path, the nodes of a document that's deleted whole aren't written to
+    JSONPathNode_t jpn;
+    RedisModuleString *spath =
+        (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
+    JSONExpire_Apply(ctx, key, argv[1]);
+    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    int whole = JSONPath_IsRootPath(spath);
+    if (whole) JSONTypeAccess(jt, 0);
+    if (PARSE_OK != (whole ? NodeFromJSONPath(jt, spath, &jpn)
+                           : NodeFromJSONPathMutable(jt, spath, &jpn, 0))) {
+        ReplyWithSearchPathError(ctx, &jpn);
+        return REDISMODULE_ERR;
+    }
+
+    // delete every value that a path with multiple values matches, the last first so the indices
+    // of the matches that are before it in the same array stay put
+    if (SearchPath_IsMulti(&jpn.sp)) {
+        JSONPathMatches_t m;
+        if (!JSONPathNode_CollectMatches(jt, &jpn, &m)) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_PATH_DESCENT);
+            goto error;
+        }
+        if (m.len) {
+            JSONTypeTouch(jt);
+            JSONNotify(ctx, argv[1], "json.del", jt, &jpn.sp);
+        }
+        for (size_t i = m.len; i--;) {
+            if (m.items[i].key)
+                Node_DictDel(m.items[i].p, m.items[i].key);
+            else
+                Node_ArrayDelRange(m.items[i].p, m.items[i].index, 1);
+        }
+        free(m.items);
+        RedisModule_ReplyWithLongLong(ctx, (long long)m.len);
+        goto ok;
+    }
+
+    // deal with path errors
+    if (E_NOINDEX == jpn.err || E_NOKEY == jpn.err) {
+        // reply with 0 if there are **any** non-existing elements along the path
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        goto ok;
+    } else if (E_OK != jpn.err) {
+        ReplyWithPathError(ctx, &jpn);
+        goto error;
+    }
+
+    // if it is the root then delete the key, otherwise delete the target from parent container,
+    // which is notified first as its index is resolved in the document as it is
+    JSONTypeTouch(jt);
+    JSONNotify(ctx, argv[1], "json.del", jt, &jpn.sp);
+    if (SearchPath_IsRootPath(&jpn.sp)) {
+        RedisModule_DeleteKey(key);
+    } else if (N_DICT == NODETYPE(jpn.p)) {  // delete from a dict
+        const char *dictkey = jpn.sp.nodes[jpn.sp.len - 1].value.key;
+        if (OBJ_OK != Node_DictDel(jpn.p, dictkey)) {
+            RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_DICT_DEL);
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_DICT_DEL);
+            goto error;
+        }
+    } else {  // container must be an array
+        int index = jpn.sp.nodes[jpn.sp.len - 1].value.index;
+        if (OBJ_OK != Node_ArrayDelRange(jpn.p, index, 1)) {
+            RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_ARRAY_DEL);
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_ARRAY_DEL);
+            goto error;
+        }
+    }  // if (N_DICT)
+
+    RedisModule_ReplyWithLongLong(ctx, (long long)argc - 2);
+
+ok:
+    JSONPathNode_Free(&jpn);
+    RedisModule_ReplicateVerbatim(ctx);
+    return REDISMODULE_OK;
+
+error:
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_ERR;
+}
+
+/**
+* Resolves the path of an expiry command in the document of a key, which must be empty or a JSON
+* type, and sets path to its canonical form (see JSONExpire_PathString). Replies with an error and
+* returns REDISMODULE_ERR for a wrong type or a bad path, and sets jt to NULL for an empty key.
+*/
+static int JSONExpire_Resolve(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModuleString *keyname,
+                              RedisModuleString *spath, JSONType_t **jt, JSONPathNode_t *jpn,
+                              sds *path) {
+    *jt = NULL;
+    *path = NULL;
+    if (REDISMODULE_KEYTYPE_EMPTY == RedisModule_KeyType(key)) return REDISMODULE_OK;
+    if (RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    JSONExpire_Apply(ctx, key, keyname);
+    *jt = JSONTypeGet(key);
+    if (PARSE_OK != NodeFromJSONPath(*jt, spath, jpn)) {
+        ReplyWithSearchPathError(ctx, jpn);
+        return REDISMODULE_ERR;
+    }
+    if (!(*path = JSONExpire_PathString(&jpn->sp))) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EXPIRE_PATH);
+        JSONPathNode_Free(jpn);
+        return REDISMODULE_ERR;
+    }
+    return REDISMODULE_OK;
+}
+
+/**
+ * JSON.EXPIRE <key> <path> <seconds>
+ * JSON.PEXPIREAT <key> <path> <milliseconds-timestamp>
+ * Sets a timeout on the value at `path`, after which it is deleted as if by JSON.DEL. Setting one
+ * again replaces it, and a time that has passed deletes the value right away. The timeout of the
+ * root is the key's own TTL, like EXPIRE's.
+ *
+ * `path` must be a path of a single value through object keys only, since array items shift to
+ * other indexes. Timeouts are kept by path, not by value: the path expires whatever it holds by
+ * then, unless JSON.PERSIST removes its timeout or the document is replaced at the root. Both
+ * commands are replicated as JSON.PEXPIREAT.
+ *
+ * Reply: Integer, 1 if the timeout was set, 0 if the key or the path doesn't exist.
+*/
+int JSONExpire_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (4 != argc) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
+    long long now = RedisModule_Milliseconds(), when;
+    if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[3], &when) ||
+        (strcasecmp("json.pexpireat", cmd) &&
+         (when > (LLONG_MAX - now) / 1000 || when < LLONG_MIN / 1000))) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EXPIRE_TIME);
+        return REDISMODULE_ERR;
+    }
+    if (strcasecmp("json.pexpireat", cmd)) when = now + when * 1000;
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    JSONType_t *jt;
+    JSONPathNode_t jpn;
+    sds path;
+    if (REDISMODULE_OK != JSONExpire_Resolve(ctx, key, argv[1], argv[2], &jt, &jpn, &path))
+        return REDISMODULE_ERR;
+    if (!jt) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    }
+
+    // only existing values get timeouts
+    if (E_NOINDEX == jpn.err || E_NOKEY == jpn.err) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        goto done;
+    } else if (E_OK != jpn.err) {
+        ReplyWithPathError(ctx, &jpn);
+        goto done;
+    }
+
+    // the root's timeout is the key's, replicated as Redis' own commands
+    if (SearchPath_IsRootPath(&jpn.sp)) {
+        if (when <= now) {
+            RedisModule_DeleteKey(key);
+            RedisModule_Replicate(ctx, "DEL", "s", argv[1]);
+        } else {
+            RedisModule_SetExpire(key, when - now);
+            RedisModule_Replicate(ctx, "PEXPIREAT", "sl", argv[1], when);
+        }
+        RedisModule_ReplyWithLongLong(ctx, 1);
+        goto done;
+    }
+
+    JSONExpire_Set(ctx, jt, argv[1], path, when);
+    RedisModule_Replicate(ctx, "JSON.PEXPIREAT", "scl", argv[1], path, when);
+    JSONExpire_Apply(ctx, key, argv[1]);
+    RedisModule_ReplyWithLongLong(ctx, 1);
+
+done:
+    JSONPathNode_Free(&jpn);
+    sdsfree(path);
+    return REDISMODULE_OK;
+}
+
+/**
+ * JSON.TTL <key> [path]
+ * JSON.PTTL <key> [path]
+ * Reports the time that the value at `path` has left before it expires, in seconds or in
+ * milliseconds. `path` defaults to root if not provided.
+ *
+ * Reply: Integer, the time left, -1 if the value doesn't expire, or -2 if the key or the path
+ * doesn't exist.
+*/
+int JSONTTL_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if ((argc < 2) || (argc > 3)) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    RedisModuleString *spath =
+        (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
+    JSONType_t *jt;
+    JSONPathNode_t jpn;
+    sds path;
+    if (REDISMODULE_OK != JSONExpire_Resolve(ctx, key, argv[1], spath, &jt, &jpn, &path))
+        return REDISMODULE_ERR;
+    if (!jt) {
+        RedisModule_ReplyWithLongLong(ctx, -2);
+        return REDISMODULE_OK;
+    }
+
+    // replicas keep expired paths until their masters delete them
+    long long ttl;
+    if (E_NOINDEX == jpn.err || E_NOKEY == jpn.err) {
+        ttl = -2;
+    } else if (E_OK != jpn.err) {
+        ReplyWithPathError(ctx, &jpn);
+        goto done;
+    } else if (SearchPath_IsRootPath(&jpn.sp)) {
+        ttl = RedisModule_GetExpire(key);
+    } else {
+        ttl = JSONExpire_Get(jt, path);
+        if (-1 != ttl) ttl = MAX(ttl - RedisModule_Milliseconds(), 0);
+    }
+    if (ttl >= 0 && strcasecmp("json.pttl", RedisModule_StringPtrLen(argv[0], NULL)))
+        ttl = (ttl + 500) / 1000;
+    RedisModule_ReplyWithLongLong(ctx, ttl);
+
+done:
+    JSONPathNode_Free(&jpn);
+    sdsfree(path);
+    return REDISMODULE_OK;
+}
+
+/**
+ * JSON.PERSIST <key> [path]
+ * Removes the timeout of `path`, which is kept even if the path no longer exists. `path` defaults
+ * to root if not provided.
+ *
+ * Reply: Integer, 1 if the timeout was removed, 0 if the key doesn't exist or the path has none.
+*/
+int JSONPersist_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if ((argc < 2) || (argc > 3)) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    RedisModuleString *spath =
+        (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
+    JSONType_t *jt;
+    JSONPathNode_t jpn;
+    sds path;
+    if (REDISMODULE_OK != JSONExpire_Resolve(ctx, key, argv[1], spath, &jt, &jpn, &path))
+        return REDISMODULE_ERR;
+    if (!jt) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    }
+
+    int removed;
+    if (SearchPath_IsRootPath(&jpn.sp)) {
+        removed = REDISMODULE_NO_EXPIRE != RedisModule_GetExpire(key);
+        if (removed) RedisModule_SetExpire(key, REDISMODULE_NO_EXPIRE);
+    } else {
+        removed = JSONExpire_Remove(jt, path);
+    }
+    if (removed) RedisModule_ReplicateVerbatim(ctx);
+    RedisModule_ReplyWithLongLong(ctx, removed);
+
+    JSONPathNode_Free(&jpn);
+    sdsfree(path);
+    return REDISMODULE_OK;
+}
+
+/* Copies the value at a path of a document to a path of another, or of the same, document like
+ * JSON.SET sets it. The value is cloned without serializing it, except that a whole document that's
+ * copied to the root of a key shares its values with the source like JSON.COPY without paths. */
+static int JSONCopy_Path(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // source must be a JSON type, an empty one has no value to copy
+    RedisModuleKey *skey = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (REDISMODULE_KEYTYPE_EMPTY == RedisModule_KeyType(skey)) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    } else if (RedisModule_ModuleTypeGetType(skey) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    // destination must be empty or a JSON type
+    RedisModuleKey *dkey = RedisModule_OpenKey(ctx, argv[2], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(dkey);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(dkey) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    JSONExpire_Apply(ctx, skey, argv[1]);
+
+    // the whole document is shared, anything else is cloned before the destination is written to
+    JSONType_t *sjt = RedisModule_ModuleTypeGetValue(skey);
+    JSONType_t *jtnew = JSONPath_IsRootPath(argv[4]) ? NewJSONType() : NULL;
+    Object *jo = NULL;
+    if (jtnew && JSONPath_IsRootPath(argv[3])) {
+        JSONTypeFree(jtnew);
+        jtnew = JSONTypeCopy(sjt);
+        jo = jtnew->root;
+    } else {
+        JSONTypeAccess(sjt, 0);
+        JSONPathNode_t jpn;
+        if (PARSE_OK != NodeFromJSONPath(sjt, argv[3], &jpn)) {
+            ReplyWithSearchPathError(ctx, &jpn);
+            if (jtnew) JSONTypeFree(jtnew);
+            return REDISMODULE_ERR;
+        }
+        if (SearchPath_IsMulti(&jpn.sp) || E_OK != jpn.err) {
+            if (SearchPath_IsMulti(&jpn.sp))
+                RedisModule_ReplyWithError(ctx, REJSON_ERROR_COPY_MULTI);
+            else
+                ReplyWithPathError(ctx, &jpn);
+            JSONPathNode_Free(&jpn);
+            if (jtnew) JSONTypeFree(jtnew);
+            return REDISMODULE_ERR;
+        }
+        NodeArena *prev = Node_SetArena(jtnew ? jtnew->arena : NULL);
+        jo = JSONPathNode_Clone(&jpn);
+        Node_SetArena(prev);
+        JSONPathNode_Free(&jpn);
+        if (jtnew) jtnew->root = jo;
+    }
+
+    int set;
+    int ret = JSONSet_Value(ctx, dkey, argv[2], argv[4], jo, jtnew, argc > 5 ? argv[5] : NULL, &set);
+    if (set && !JSONReplicateEffects) RedisModule_ReplicateVerbatim(ctx);
+    return ret;
+}
+
+/**
+ * JSON.COPY <source> <destination> [REPLACE]
+ * JSON.COPY <source> <destination> <srcpath> <dstpath> [NX|XX]
+ * Copies the document at `source` to `destination`, or the value at `srcpath` in `source` to
+ * `dstpath` in `destination`.
+ *
+ * The copy of a document takes O(1): the documents share their values, and a write to either of
+ * them copies the values on the way to those that it changes. A `destination` that exists isn't
+ * overwritten unless `REPLACE` is given, and then it can hold any type.
+ *
+ * A value at a path is copied without serializing it, and is set in `destination` like JSON.SET
+ * sets a value: for a new `destination` the `dstpath` must be the root, and `NX` and `XX` have the
+ * same meaning. `srcpath` must be a path of a single value.
+ *
+ * Reply: Integer, specifically 1 if `source` was copied and 0 if it doesn't exist or the
+ * `destination` exists without `REPLACE`. With paths, the reply is the same as JSON.SET's, or Null
+ * Bulk if `source` doesn't exist.
+*/
+int JSONCopy_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if ((argc < 3) || (argc > 6)) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+    if (argc > 4) return JSONCopy_Path(ctx, argv, argc);
+
+    int replace = 0;
+    if (4 == argc) {
+        if (strcasecmp("replace", RedisModule_StringPtrLen(argv[3], NULL))) {
+            RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+        replace = 1;
+    }
+    size_t srclen, dstlen;
+    const char *src = RedisModule_StringPtrLen(argv[1], &srclen);
+    const char *dst = RedisModule_StringPtrLen(argv[2], &dstlen);
+    if (srclen == dstlen && !memcmp(src, dst, srclen)) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_COPY_SAME);
+        return REDISMODULE_ERR;
+    }
+
+    // source must be empty (reply with 0) or a JSON type
+    RedisModuleKey *skey = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (REDISMODULE_KEYTYPE_EMPTY == RedisModule_KeyType(skey)) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    } else if (RedisModule_ModuleTypeGetType(skey) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *dkey = RedisModule_OpenKey(ctx, argv[2], REDISMODULE_READ | REDISMODULE_WRITE);
+    if (REDISMODULE_KEYTYPE_EMPTY != RedisModule_KeyType(dkey)) {
+        if (!replace) {
+            RedisModule_ReplyWithLongLong(ctx, 0);
+            return REDISMODULE_OK;
+        }
+        RedisModule_DeleteKey(dkey);
+    }
+
+    JSONExpire_Apply(ctx, skey, argv[1]);
+    JSONType_t *jt = JSONTypeCopy(RedisModule_ModuleTypeGetValue(skey));
+    RedisModule_ModuleTypeSetValue(dkey, JSONType, jt);
+    JSONIndex_Track(ctx, jt, argv[2]);
+    JSONNotify(ctx, argv[2], "json.copy", jt, NULL);
+    RedisModule_ReplyWithLongLong(ctx, 1);
+    RedisModule_ReplicateVerbatim(ctx);
+    return REDISMODULE_OK;
+}
+
+/**
+ * JSON.MERGE <key> <path> <json>
+ * Merges the `json` value into the value at `path` in `key`, as a JSON Merge Patch (RFC 7386)
+ *
+ * The members of a `json` object are set in the value, except for those that are null, which are
+ * deleted, and those that are objects, which are merged in the same way. A value that isn't an
+ * object is replaced by an object of the members, and a `json` value that isn't an object replaces
+ * the value. The patch's values are moved into the document instead of being copied.
+ *
+ * For new Redis keys the `path` must be the root, and a key that's missing in an object is added if
+ * it is the last child in the `path`, like JSON.SET does. `path` must be a path of a single value.
+ *
+ * Reply: Simple String `OK`
+*/
+int JSONMerge_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if (argc != 4) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // key must be empty or a JSON type
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+    if (REDISMODULE_KEYTYPE_EMPTY == type && !JSONPath_IsRootPath(argv[2])) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_NEW_NOT_ROOT);
+        return REDISMODULE_ERR;
+    }
+
+    // JSON must be valid
+    size_t jsonlen;
+    const char *json = RedisModule_StringPtrLen(argv[3], &jsonlen);
+    if (!jsonlen) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EMPTY_STRING);
+        return REDISMODULE_ERR;
+    }
+    Object *patch = NULL;
+    char *jerr = NULL;
+    if (JSONOBJECT_OK != CreateNodeFromJSON(json, jsonlen, &patch, &jerr)) {
+        ReplyWithJSONObjectError(ctx, jerr);
+        return REDISMODULE_ERR;
+    }
+
+    // merging into a new key makes a document of the patch
+    if (REDISMODULE_KEYTYPE_EMPTY == type) {
+        JSONType_t *jt = NewJSONType();
+        jt->root = JSONPatch_Merge(NULL, patch);
+        RedisModule_ModuleTypeSetValue(key, JSONType, jt);
+        JSONIndex_Track(ctx, jt, argv[1]);
+        JSONNotify(ctx, argv[1], "json.merge", jt, NULL);
+        RedisModule_ReplyWithSimpleString(ctx, "OK");
+        RedisModule_ReplicateVerbatim(ctx);
+        return REDISMODULE_OK;
+    }
+
+    JSONExpire_Apply(ctx, key, argv[1]);
+
+    // the path must exist, but for the last key of a value that's added to an object
+    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONPathNode_t jpn;
+    if (PARSE_OK != NodeFromJSONPathMutable(jt, argv[2], &jpn, 1)) {
+        ReplyWithSearchPathError(ctx, &jpn);
+        Node_Free(patch);
+        return REDISMODULE_ERR;
+    }
+    if (SearchPath_IsMulti(&jpn.sp)) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_MERGE_MULTI);
+        goto error;
+    }
+    if (E_OK != jpn.err && E_NOKEY != jpn.err) {
+        ReplyWithPathError(ctx, &jpn);
+        goto error;
+    }
+    if (E_NOKEY == jpn.err && jpn.errlevel != jpn.sp.len - 1) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_PATH_NONTERMINAL_KEY);
+        goto error;
+    }
+
+    // an object is merged in place, anything else is replaced by the merged value
+    JSONTypeTouch(jt);
+    Node *target = E_OK == jpn.err ? jpn.n : NULL;
+    Node *merged = JSONPatch_Merge(target, patch);
+    if (E_OK != jpn.err || merged != target) {
+        if (SearchPath_IsRootPath(&jpn.sp)) {
+            Node_Free(jt->root);
+            jt->root = merged;
+        } else if (N_DICT == NODETYPE(jpn.p)) {
+            Node_DictSet(jpn.p, jpn.sp.nodes[jpn.sp.len - 1].value.key, merged);
+        } else {
+            int index = jpn.sp.nodes[jpn.sp.len - 1].value.index;
+            if (index < 0) index = Node_Length(jpn.p) + index;
+            Node_ArrayReplace(jpn.p, index, merged);
+        }
+    }
+    JSONNotify(ctx, argv[1], "json.merge", jt, &jpn.sp);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    RedisModule_ReplicateVerbatim(ctx);
+
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_OK;
+
+error:
+    JSONPathNode_Free(&jpn);
+    Node_Free(patch);
+    return REDISMODULE_ERR;
+}
+
+/**
+ * JSON.PATCH <key> <json>
+ * Applies the `json` array of operations to the document in `key`, as a JSON Patch (RFC 6902)
+ *
+ * The operations are `add`, `remove`, `replace`, `move`, `copy` and `test`, and their paths are
+ * JSON Pointers (RFC 6901) from the root of the document. The patch is atomic: when an operation
+ * is invalid, has a missing path or fails its test, the document remains unchanged. The patch's
+ * values are moved into the document instead of being copied.
+ *
+ * Reply: Simple String `OK`, or an error that names the operation that failed.
+*/
+int JSONPatch_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if (argc != 3) {
         RedisModule_WrongArity(ctx);
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
 
-    // key must be empty or a JSON type
+    // key can't be empty and must be a JSON type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
     int type = RedisModule_KeyType(key);
-    if (REDISMODULE_KEYTYPE_EMPTY == type) {
-        RedisModule_ReplyWithLongLong(ctx, 0);
-        return REDISMODULE_OK;
-    } else if (RedisModule_ModuleTypeGetType(key) != JSONType) {
+    if (REDISMODULE_KEYTYPE_EMPTY == type || RedisModule_ModuleTypeGetType(key) != JSONType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
         return REDISMODULE_ERR;
     }
 
-    // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
-    JSONPathNode_t jpn;
-    RedisModuleString *spath =
-        (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
-    if (PARSE_OK != NodeFromJSONPath(jt->root, spath, &jpn)) {
-        ReplyWithSearchPathError(ctx, &jpn);
+    // JSON must be valid
+    size_t jsonlen;
+    const char *json = RedisModule_StringPtrLen(argv[2], &jsonlen);
+    if (!jsonlen) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EMPTY_STRING);
+        return REDISMODULE_ERR;
+    }
+    Object *patch = NULL;
+    char *jerr = NULL;
+    if (JSONOBJECT_OK != CreateNodeFromJSON(json, jsonlen, &patch, &jerr)) {
+        ReplyWithJSONObjectError(ctx, jerr);
         return REDISMODULE_ERR;
     }
 
-    // deal with path errors
-    if (E_NOINDEX == jpn.err || E_NOKEY == jpn.err) {
-        // reply with 0 if there are **any** non-existing elements along the path
-        RedisModule_ReplyWithLongLong(ctx, 0);
-        goto ok;
-    } else if (E_OK != jpn.err) {
-        ReplyWithPathError(ctx, &jpn);
-        goto error;
+    JSONExpire_Apply(ctx, key, argv[1]);
+
+    // the document is touched only once the whole patch is applied
+    JSONType_t *jt = JSONTypeGetMutable(key);
+    if (OBJ_OK != JSONPatch_Apply(&jt->root, patch, &jerr)) {
+        ReplyWithJSONObjectError(ctx, jerr);
+        return REDISMODULE_ERR;
     }
+    JSONTypeTouch(jt);
+    JSONNotify(ctx, argv[1], "json.patch", jt, NULL);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    RedisModule_ReplicateVerbatim(ctx);
+    return REDISMODULE_OK;
+}
 
-    // if it is the root then delete the key, otherwise delete the target from parent container
-    if (SearchPath_IsRootPath(&jpn.sp)) {
-        RedisModule_DeleteKey(key);
-    } else if (N_DICT == NODETYPE(jpn.p)) {  // delete from a dict
-        const char *dictkey = jpn.sp.nodes[jpn.sp.len - 1].value.key;
-        if (OBJ_OK != Node_DictDel(jpn.p, dictkey)) {
-            RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_DICT_DEL);
-            RedisModule_ReplyWithError(ctx, REJSON_ERROR_DICT_DEL);
-            goto error;
+/* Returns the result of incrementing or multiplying the number n by the number by, or NULL if it
+ * isn't a number or is an infinity */
+static Node *JSONNum_Operate(const Node *n, const Node *by, int incr) {
+    double rz = incr ? NODEVALUE_AS_DOUBLE(n) + NODEVALUE_AS_DOUBLE(by)
+                     : NODEVALUE_AS_DOUBLE(n) * NODEVALUE_AS_DOUBLE(by);
+    if (isnan(rz) || isinf(rz)) return NULL;
+
+    // the result is an integer only if both values were, and providing an int64 can hold it
+    if (N_INTEGER == NODETYPE(n) && N_INTEGER == NODETYPE(by) && rz <= (double)INT64_MAX &&
+        rz >= (double)INT64_MIN)
+        return NewIntNode((int64_t)rz);
+    return NewDoubleNode(rz);
+}
+
+/* Changes every number that a path with multiple values matches, and replies with the array of the
+ * results, in which the matches that aren't numbers are nulls. Nothing is changed if any of the
+ * results would be invalid. */
+static int JSONNum_MultiCommand(RedisModuleCtx *ctx, RedisModuleString *keyname, JSONType_t *jt,
+                                JSONPathNode_t *jpn, const Node *by, int incr) {
+    JSONPathMatches_t m;
+    if (!JSONPathNode_CollectMatches(jt, jpn, &m)) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_PATH_DESCENT);
+        return REDISMODULE_ERR;
+    }
+
+    // compute all the results before changing any of the values
+    Node **results = calloc(m.len ? m.len : 1, sizeof(Node *));
+    int changed = 0;
+    for (size_t i = 0; i < m.len; i++) {
+        Node tmp, *n;
+        JSONPath_MatchValue(&m.items[i], &tmp, &n);
+        if (N_INTEGER != NODETYPE(n) && N_NUMBER != NODETYPE(n)) continue;
+        if (!(results[i] = JSONNum_Operate(n, by, incr))) {
+            for (size_t j = 0; j < i; j++) Node_Free(results[j]);
+            free(results);
+            free(m.items);
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_RESULT_NAN_OR_INF);
+            return REDISMODULE_ERR;
         }
-    } else {  // container must be an array
-        int index = jpn.sp.nodes[jpn.sp.len - 1].value.index;
-        if (OBJ_OK != Node_ArrayDelRange(jpn.p, index, 1)) {
-            RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_ARRAY_DEL);
-            RedisModule_ReplyWithError(ctx, REJSON_ERROR_ARRAY_DEL);
-            goto error;
+        changed = 1;
+    }
+
+    if (changed) {
+        JSONTypeTouch(jt);
+        JSONNotify(ctx, keyname, incr ? "json.numincrby" : "json.nummultby", jt, &jpn->sp);
+    }
+    for (size_t i = 0; i < m.len; i++) {
+        if (!results[i]) continue;
+        if (m.items[i].key) {
+            Node_DictSet(m.items[i].p, m.items[i].key, results[i]);
+        } else {
+            Node_ArrayReplace(m.items[i].p, m.items[i].index, results[i]);
         }
-    }  // if (N_DICT)
+    }
 
-    RedisModule_ReplyWithLongLong(ctx, (long long)argc - 2);
+    // reply with the serialization of the results
+    JSONSerializeOpt jsopt = {0};
+    JSONSerializer *s = NewJSONSerializer(&jsopt, sdsempty());
+    JSONSerializer_BeginArray(s);
+    for (size_t i = 0; i < m.len; i++) JSONSerializer_Value(s, results[i]);
+    JSONSerializer_End(s);
+    sds json = JSONSerializer_Free(s);
+    RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
+    sdsfree(json);
 
-ok:
-    JSONPathNode_Free(&jpn);
+    free(results);
+    free(m.items);
     RedisModule_ReplicateVerbatim(ctx);
     return REDISMODULE_OK;
-
-error:
-    JSONPathNode_Free(&jpn);
-    return REDISMODULE_ERR;
 }
 
 /**
  * JSON.NUMINCRBY <key> [path] <value>
  * JSON.NUMMULTBY <key> [path] <value>
  * Increments/multiplies the value stored under `path` by `value`.
- * `path` must exist path and must be a number value.
- * Reply: String, specifically the resulting JSON number value
+ * `path` must exist path and must be a number value, unless it can match multiple values, in which
+ * case every number that it matches is changed.
+ * Reply: String, specifically the resulting JSON number value, or the array of the results for a
+ * path that can match multiple values
 */
 int JSONNum_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     if ((argc < 3) || (argc > 4)) {
@@ -983,8 +3599,7 @@ int JSONNum_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
     RedisModule_AutoMemory(ctx);
 
     const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
-    double oval, bval, rz;  // original value, by value and the result
-    Object *joval = NULL;   // the by value as a JSON object
+    Object *joval = NULL;  // the by value as a JSON object
 
     // key must be an object type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
@@ -994,30 +3609,32 @@ int JSONNum_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
         return REDISMODULE_ERR;
     }
 
+    JSONExpire_Apply(ctx, key, argv[1]);
+
     // validate path
     JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (4 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
-    if (PARSE_OK != NodeFromJSONPath(jt->root, spath, &jpn)) {
+    if (PARSE_OK != NodeFromJSONPathMutable(jt, spath, &jpn, 0)) {
         ReplyWithSearchPathError(ctx, &jpn);
         return REDISMODULE_ERR;
     }
 
     // deal with path errors
-    if (E_OK != jpn.err) {
+    int multi = SearchPath_IsMulti(&jpn.sp);
+    if (!multi && E_OK != jpn.err) {
         ReplyWithPathError(ctx, &jpn);
         goto error;
     }
 
     // verify that the target value is a number
-    if (N_INTEGER != NODETYPE(jpn.n) && N_NUMBER != NODETYPE(jpn.n)) {
+    if (!multi && N_INTEGER != NODETYPE(jpn.n) && N_NUMBER != NODETYPE(jpn.n)) {
         sds err = sdscatfmt(sdsempty(), REJSON_ERROR_PATH_NANTYPE, NodeTypeStr(NODETYPE(jpn.n)));
         RedisModule_ReplyWithError(ctx, err);
         sdsfree(err);
         goto error;
     }
-    oval = NODEVALUE_AS_DOUBLE(jpn.n);
 
     // we use the json parser to convert the bval arg into a value to catch all of JSON's syntices
     size_t vallen;
@@ -1039,37 +3656,29 @@ int JSONNum_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
         RedisModule_ReplyWithError(ctx, REJSON_ERROR_VALUE_NAN);
         goto error;
     }
-    bval = NODEVALUE_AS_DOUBLE(joval);
-
-    // perform the operation
-    if (!strcasecmp("json.numincrby", cmd)) {
-        rz = oval + bval;
-    } else {
-        rz = oval * bval;
+    int incr = !strcasecmp("json.numincrby", cmd);
+    if (multi) {
+        int ret = JSONNum_MultiCommand(ctx, argv[1], jt, &jpn, joval, incr);
+        Node_Free(joval);
+        JSONPathNode_Free(&jpn);
+        return ret;
     }
 
-    // check that the result is valid
-    if (isnan(rz) || isinf(rz)) {
+    // perform the operation and check that the result is valid
+    Object *orz = JSONNum_Operate(jpn.n, joval, incr);
+    if (!orz) {
         RedisModule_ReplyWithError(ctx, REJSON_ERROR_RESULT_NAN_OR_INF);
         goto error;
     }
 
-    // make an object out of the result per its type
-    Object *orz;
-    // the result is an integer only if both values were, and providing an int64 can hold it
-    if (N_INTEGER == NODETYPE(jpn.n) && N_INTEGER == NODETYPE(joval) && 
-        rz <= (double)INT64_MAX && rz >= (double)INT64_MIN) {
-        orz = NewIntNode((int64_t)rz);
-    } else {
-        orz = NewDoubleNode(rz);
-    }
-
     // replace the original value with the result depending on the parent container's type
+    JSONTypeTouch(jt);
     if (SearchPath_IsRootPath(&jpn.sp)) {
         RedisModule_DeleteKey(key);
         jt = calloc(1, sizeof(JSONType_t));
         jt->root = orz;
         RedisModule_ModuleTypeSetValue(key, JSONType, jt);
+        JSONIndex_Track(ctx, jt, argv[1]);
     } else if (N_DICT == NODETYPE(jpn.p)) {
         if (OBJ_OK != Node_DictSet(jpn.p, jpn.sp.nodes[jpn.sp.len - 1].value.key, orz)) {
             RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_DICT_SET);
@@ -1079,15 +3688,19 @@ int JSONNum_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
     } else {  // container must be an array
         int index = jpn.sp.nodes[jpn.sp.len - 1].value.index;
         if (index < 0) index = Node_Length(jpn.p) + index;
-        if (OBJ_OK != Node_ArraySet(jpn.p, index, orz)) {
+        if (OBJ_OK != Node_ArrayReplace(jpn.p, index, orz)) {
             RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_ARRAY_SET);
             RedisModule_ReplyWithError(ctx, REJSON_ERROR_ARRAY_SET);
             goto error;
         }
-        // unlike DictSet, ArraySet does not free so we need to call it explicitly
-        Node_Free(jpn.n);
     }
     jpn.n = orz;
+    JSONNotify(ctx, argv[1], incr ? "json.numincrby" : "json.nummultby", jt, &jpn.sp);
+    if (JSONReplicateEffects) {
+        JSONEffect_Set(ctx, argv[1], jt, &jpn.sp, orz);
+    } else {
+        RedisModule_ReplicateVerbatim(ctx);
+    }
 
     // reply with the serialization of the new value
     JSONSerializeOpt jsopt = {0};
@@ -1106,6 +3719,147 @@ error:
     return REDISMODULE_ERR;
 }
 
+/**
+ * JSON.MNUMINCRBY <key> <path> <value> [<path> <value> ...]
+ * JSON.MNUMMULTBY <key> <path> <value> [<path> <value> ...]
+ * Increments/multiplies the number at each `path` by its `value`, like a JSON.NUMINCRBY or a
+ * JSON.NUMMULTBY of every pair in their order does. The paths must be paths of single values.
+ *
+ * All the paths and values are parsed before the document is changed. The pairs are then applied in
+ * order, and a pair with an error stops the command, leaving the pairs before it applied.
+ *
+ * Reply: Array of Strings, specifically the resulting JSON number value of every pair
+*/
+int JSONMNum_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if ((argc < 4) || (argc % 2)) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // key must be an object type
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    if (RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
+    int incr = !strcasecmp("json.mnumincrby", cmd);
+    int npairs = (argc - 2) / 2;
+    int ncompiled = 0, changed = 0, ret = REDISMODULE_ERR;
+    JSONPathNode_t *jpns = calloc(npairs, sizeof(JSONPathNode_t));
+    Node **bys = calloc(npairs, sizeof(Node *));
+    sds *results = calloc(npairs, sizeof(sds));
+
+    // compile the paths and parse the values, which must be numbers
+    for (; ncompiled < npairs; ncompiled++) {
+        JSONPathNode_t *jpn = &jpns[ncompiled];
+        if (PARSE_OK != JSONPathNode_Compile(argv[2 + 2 * ncompiled], jpn)) {
+            ReplyWithSearchPathError(ctx, jpn);
+            goto done;
+        }
+        if (SearchPath_IsMulti(&jpn->sp)) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_MNUM_MULTI);
+            ncompiled++;
+            goto done;
+        }
+    }
+    for (int i = 0; i < npairs; i++) {
+        size_t vallen;
+        const char *val = RedisModule_StringPtrLen(argv[3 + 2 * i], &vallen);
+        char *jerr = NULL;
+        if (JSONOBJECT_OK != CreateNodeFromJSON(val, vallen, &bys[i], &jerr)) {
+            bys[i] = NULL;
+            if (jerr) {
+                RedisModule_ReplyWithError(ctx, jerr);
+                free(jerr);
+            } else {
+                RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_JSONOBJECT_ERROR);
+                RedisModule_ReplyWithError(ctx, REJSON_ERROR_JSONOBJECT_ERROR);
+            }
+            goto done;
+        }
+        if (N_INTEGER != NODETYPE(bys[i]) && N_NUMBER != NODETYPE(bys[i])) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_VALUE_NAN);
+            goto done;
+        }
+    }
+
+    JSONExpire_Apply(ctx, key, argv[1]);
+
+    // apply the pairs in order, every path is resolved after the previous pair's change
+    JSONType_t *jt = JSONTypeGet(key);
+    JSONSerializeOpt jsopt = {0};
+    for (int i = 0; i < npairs; i++) {
+        JSONPathNode_t *jpn = &jpns[i];
+        JSONTypeAccessPath(jt, &jpn->sp, 0);
+        JSONPathNode_Resolve(jt, jpn);
+        if (E_OK != jpn->err) {
+            ReplyWithPathError(ctx, jpn);
+            goto done;
+        }
+        if (N_INTEGER != NODETYPE(jpn->n) && N_NUMBER != NODETYPE(jpn->n)) {
+            sds err =
+                sdscatfmt(sdsempty(), REJSON_ERROR_PATH_NANTYPE, NodeTypeStr(NODETYPE(jpn->n)));
+            RedisModule_ReplyWithError(ctx, err);
+            sdsfree(err);
+            goto done;
+        }
+        Node *orz = JSONNum_Operate(jpn->n, bys[i], incr);
+        if (!orz) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_RESULT_NAN_OR_INF);
+            goto done;
+        }
+
+        // replace the original value with the result depending on the parent container's type
+        JSONTypeTouch(jt);
+        changed = 1;
+        if (SearchPath_IsRootPath(&jpn->sp)) {
+            Node_Free(jt->root);
+            jt->root = orz;
+        } else if (N_DICT == NODETYPE(jpn->p)) {
+            if (OBJ_OK != Node_DictSet(jpn->p, jpn->sp.nodes[jpn->sp.len - 1].value.key, orz)) {
+                Node_Free(orz);
+                RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_DICT_SET);
+                RedisModule_ReplyWithError(ctx, REJSON_ERROR_DICT_SET);
+                goto done;
+            }
+        } else {  // container must be an array
+            int index = jpn->sp.nodes[jpn->sp.len - 1].value.index;
+            if (index < 0) index = Node_Length(jpn->p) + index;
+            if (OBJ_OK != Node_ArrayReplace(jpn->p, index, orz)) {
+                Node_Free(orz);
+                RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_ARRAY_SET);
+                RedisModule_ReplyWithError(ctx, REJSON_ERROR_ARRAY_SET);
+                goto done;
+            }
+        }
+        JSONNotify(ctx, argv[1], incr ? "json.mnumincrby" : "json.mnummultby", jt, &jpn->sp);
+        if (JSONReplicateEffects) JSONEffect_Set(ctx, argv[1], jt, &jpn->sp, orz);
+        results[i] = sdsempty();
+        SerializeNodeToJSON(orz, &jsopt, &results[i]);
+    }
+
+    RedisModule_ReplyWithArray(ctx, npairs);
+    for (int i = 0; i < npairs; i++)
+        RedisModule_ReplyWithStringBuffer(ctx, results[i], sdslen(results[i]));
+    ret = REDISMODULE_OK;
+
+done:
+    // the pairs are applied deterministically, so a partial change is replicated as is
+    if (changed && !JSONReplicateEffects) RedisModule_ReplicateVerbatim(ctx);
+    for (int i = 0; i < ncompiled; i++) JSONPathNode_Free(&jpns[i]);
+    for (int i = 0; i < npairs; i++) {
+        Node_Free(bys[i]);
+        sdsfree(results[i]);
+    }
+    free(jpns);
+    free(bys);
+    free(results);
+    return ret;
+}
+
 /**
  * JSON.STRAPPEND <key> [path] <json-string>
  * Append the `json-string` value(s) the string at `path`.
@@ -1128,13 +3882,15 @@ int JSONStrAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
         return REDISMODULE_ERR;
     }
 
+    JSONExpire_Apply(ctx, key, argv[1]);
+
     // validate path
     JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
     JSONPathNode_t jpn;
     Object *objRoot = RedisModule_ModuleTypeGetValue(key);
     RedisModuleString *spath =
         (4 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
-    if (PARSE_OK != NodeFromJSONPath(jt->root, spath, &jpn)) {
+    if (PARSE_OK != NodeFromJSONPathMutable(jt, spath, &jpn, 0)) {
         ReplyWithSearchPathError(ctx, &jpn);
         return REDISMODULE_ERR;
     }
@@ -1176,14 +3932,21 @@ int JSONStrAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
     // the value must be a string
     if (N_STRING != NODETYPE(jo)) {
         sds err = sdscatfmt(sdsempty(), "ERR wrong type of value - expected %s but found %s",
-                            NodeTypeStr(N_STRING), NodeTypeStr(NODETYPE(jpn.n)));
+                            NodeTypeStr(N_STRING), NodeTypeStr(NODETYPE(jo)));
         RedisModule_ReplyWithError(ctx, err);
         sdsfree(err);
+        Node_Free(jo);
+        goto error;
     }
 
-    // actually concatenate the strings
+    // actually concatenate the strings, the target grows with room for the next appends
+    JSONTypeTouch(jt);
     Node_StringAppend(jpn.n, jo);
+    Node_Free(jo);
+    Node_ArrayChanged(jpn.p);
+    JSONNotify(ctx, argv[1], "json.strappend", jt, &jpn.sp);
     RedisModule_ReplyWithLongLong(ctx, (long long)Node_Length(jpn.n));
+    RedisModule_ReplicateVerbatim(ctx);
 
     JSONPathNode_Free(&jpn);
     return REDISMODULE_OK;
@@ -1218,10 +3981,12 @@ int JSONArrInsert_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
         return REDISMODULE_ERR;
     }
 
+    JSONExpire_Apply(ctx, key, argv[1]);
+
     // validate path
     JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
     JSONPathNode_t jpn;
-    if (PARSE_OK != NodeFromJSONPath(jt->root, argv[2], &jpn)) {
+    if (PARSE_OK != NodeFromJSONPathMutable(jt, argv[2], &jpn, 0)) {
         ReplyWithSearchPathError(ctx, &jpn);
         return REDISMODULE_ERR;
     }
@@ -1291,13 +4056,27 @@ int JSONArrInsert_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
         }
     }
 
-    // insert the sub array to the target array
+    // insert the sub array to the target array, its effect is encoded before its values move
+    sds values = NULL;
+    if (JSONReplicateEffects) {
+        values = sdsempty();
+        SerializeNodeToBinary(sub, &values);
+    }
+    JSONTypeTouch(jt);
     if (OBJ_OK != Node_ArrayInsert(jpn.n, index, sub)) {
         Node_Free(sub);
+        sdsfree(values);
         RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_INSERT);
         RedisModule_ReplyWithError(ctx, REJSON_ERROR_INSERT);
         goto error;
     }
+    JSONNotify(ctx, argv[1], "json.arrinsert", jt, &jpn.sp);
+    if (values) {
+        JSONEffect_Insert(ctx, argv[1], jt, &jpn.sp, index, values);
+        sdsfree(values);
+    } else {
+        RedisModule_ReplicateVerbatim(ctx);
+    }
 
     RedisModule_ReplyWithLongLong(ctx, Node_Length(jpn.n));
 
@@ -1329,10 +4108,12 @@ int JSONArrAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
         return REDISMODULE_ERR;
     }
 
+    JSONExpire_Apply(ctx, key, argv[1]);
+
     // validate path
     JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
     JSONPathNode_t jpn;
-    if (PARSE_OK != NodeFromJSONPath(jt->root, argv[2], &jpn)) {
+    if (PARSE_OK != NodeFromJSONPathMutable(jt, argv[2], &jpn, 0)) {
         ReplyWithSearchPathError(ctx, &jpn);
         return REDISMODULE_ERR;
     }
@@ -1386,13 +4167,28 @@ int JSONArrAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
         }
     }
 
-    // insert the sub array to the target array
-    if (OBJ_OK != Node_ArrayInsert(jpn.n, Node_Length(jpn.n), sub)) {
+    // insert the sub array to the target array, its effect is encoded before its values move
+    sds values = NULL;
+    if (JSONReplicateEffects) {
+        values = sdsempty();
+        SerializeNodeToBinary(sub, &values);
+    }
+    JSONTypeTouch(jt);
+    long long index = Node_Length(jpn.n);
+    if (OBJ_OK != Node_ArrayInsert(jpn.n, index, sub)) {
         Node_Free(sub);
+        sdsfree(values);
         RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_INSERT);
         RedisModule_ReplyWithError(ctx, REJSON_ERROR_INSERT);
         goto error;
     }
+    JSONNotify(ctx, argv[1], "json.arrappend", jt, &jpn.sp);
+    if (values) {
+        JSONEffect_Insert(ctx, argv[1], jt, &jpn.sp, index, values);
+        sdsfree(values);
+    } else {
+        RedisModule_ReplicateVerbatim(ctx);
+    }
 
     RedisModule_ReplyWithLongLong(ctx, Node_Length(jpn.n));
 
@@ -1404,28 +4200,151 @@ error:
     return REDISMODULE_ERR;
 }
 
+/* The arguments and reply of JSON.ARRINDEX and JSON.ARRCOUNT, which differ in their search */
+static int JSONArrSearch(RedisModuleCtx *ctx, RedisModuleString **argv, int argc,
+                         int (*search)(Node *arr, Node *n, int start, int stop)) {
+    // the optional USEINDEX is always last
+    int useindex = argc > 4 && !strcasecmp("useindex", RedisModule_StringPtrLen(argv[argc - 1], NULL));
+    if (useindex) argc--;
+
+    // check args
+    if ((argc < 4) || (argc > 6)) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // key can't be empty and must be a JSON type
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY == type || RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    // validate path
+    Object *jo = NULL;
+    JSONExpire_Apply(ctx, key, argv[1]);
+    JSONType_t *jt = JSONTypeGet(key);
+    JSONPathNode_t jpn;
+    int rv = useindex ? NodeFromJSONPathMutable(jt, argv[2], &jpn, 0)
+                      : NodeFromJSONPath(jt, argv[2], &jpn);
+    if (PARSE_OK != rv) {
+        ReplyWithSearchPathError(ctx, &jpn);
+        return REDISMODULE_ERR;
+    }
+
+    // deal with path errors
+    if (E_OK != jpn.err) {
+        ReplyWithPathError(ctx, &jpn);
+        goto error;
+    }
+
+    // verify that the target's type is an array
+    if (N_ARRAY != NODETYPE(jpn.n)) {
+        ReplyWithPathTypeError(ctx, N_ARRAY, NODETYPE(jpn.n));
+        goto error;
+    }
+
+    // the JSON value to search for must be valid
+    size_t jsonlen;
+    const char *json = RedisModule_StringPtrLen(argv[3], &jsonlen);
+    if (!jsonlen) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EMPTY_STRING);
+        goto error;
+    }
+
+    // create an object from json
+    char *jerr = NULL;
+    if (JSONOBJECT_OK != CreateNodeFromJSON(json, jsonlen, &jo, &jerr)) {
+        if (jerr) {
+            RedisModule_ReplyWithError(ctx, jerr);
+            free(jerr);
+        } else {
+            RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_JSONOBJECT_ERROR);
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_JSONOBJECT_ERROR);
+        }
+        goto error;
+    }
+
+    // get start (inclusive) & stop (exlusive) indices
+    long long start = 0, stop = 0;
+    if (argc > 4) {
+        if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[4], &start)) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_INDEX_INVALID);
+            goto error;
+        }
+        if (argc > 5) {
+            if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[5], &stop)) {
+                RedisModule_ReplyWithError(ctx, REJSON_ERROR_INDEX_INVALID);
+                goto error;
+            }
+        }
+    }
+
+    // the array stays indexed, the index is built by the first search and kept up to date by writes
+    if (useindex) {
+        JSONTYPE_INDEXING_BEGIN(jt);
+        Node_ArraySetIndexed(jpn.n, 1);
+        JSONTYPE_INDEXING_END();
+    }
+
+    RedisModule_ReplyWithLongLong(ctx, search(jpn.n, jo, (int)start, (int)stop));
+
+    Node_Free(jo);
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_OK;
+
+error:
+    Node_Free(jo);
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_ERR;
+}
+
 /**
- * JSON.ARRINDEX <key> <path> <scalar> [start [stop]]
+ * JSON.ARRINDEX <key> <path> <scalar> [start [stop]] [USEINDEX]
  * Search for the first occurance of a scalar JSON value in an array.
  *
  * The optional inclusive `start` (default 0) and exclusive `stop` (default 0, meaning that the last
  * element is included) specify a slice of the array to search.
  *
+ * `USEINDEX` indexes the array by a hash table of its items, so that this and later searches of it
+ * take O(1) instead of scanning it. The array stays indexed until it's replaced, or the document is
+ * copied or loaded.
+ *
  * Note: out of range errors are treated by rounding the index to the array's start and end. An
  * inverse index range (e.g, from 1 to 0) will return unfound.
  *
- * Reply: Integer, specifically the position of the scalar value in the array or -1 if unfound.
+ * Reply: Integer, specifically the position of the scalar value in the array or -1 if unfound.
+*/
+int JSONArrIndex_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return JSONArrSearch(ctx, argv, argc, Node_ArrayIndex);
+}
+
+/**
+ * JSON.ARRCOUNT <key> <path> <scalar> [start [stop]] [USEINDEX]
+ * Count the occurances of a scalar JSON value in an array.
+ *
+ * The optional `start`, `stop` and `USEINDEX` are like in JSON.ARRINDEX.
+ *
+ * Reply: Integer, specifically the number of times that the scalar value is in the array.
 */
-int JSONArrIndex_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+int JSONArrCount_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return JSONArrSearch(ctx, argv, argc, Node_ArrayCount);
+}
+
+/* The arguments and reply of JSON.ARRINSORT and JSON.ARRBSEARCH, which differ in their insert */
+static int JSONArrSorted(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int insert) {
     // check args
-    if ((argc < 4) || (argc > 6)) {
+    if (argc != 4) {
         RedisModule_WrongArity(ctx);
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
 
     // key can't be empty and must be a JSON type
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    RedisModuleKey *key =
+        RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | (insert ? REDISMODULE_WRITE : 0));
     int type = RedisModule_KeyType(key);
     if (REDISMODULE_KEYTYPE_EMPTY == type || RedisModule_ModuleTypeGetType(key) != JSONType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
@@ -1433,9 +4352,12 @@ int JSONArrIndex_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
     }
 
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    Object *jo = NULL;
+    JSONExpire_Apply(ctx, key, argv[1]);
+    JSONType_t *jt = insert ? RedisModule_ModuleTypeGetValue(key) : JSONTypeGet(key);
     JSONPathNode_t jpn;
-    if (PARSE_OK != NodeFromJSONPath(jt->root, argv[2], &jpn)) {
+    if (PARSE_OK != (insert ? NodeFromJSONPathMutable(jt, argv[2], &jpn, 0)
+                            : NodeFromJSONPath(jt, argv[2], &jpn))) {
         ReplyWithSearchPathError(ctx, &jpn);
         return REDISMODULE_ERR;
     }
@@ -1452,16 +4374,13 @@ int JSONArrIndex_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
         goto error;
     }
 
-    // the JSON value to search for must be valid
+    // the JSON value must be valid
     size_t jsonlen;
     const char *json = RedisModule_StringPtrLen(argv[3], &jsonlen);
     if (!jsonlen) {
         RedisModule_ReplyWithError(ctx, REJSON_ERROR_EMPTY_STRING);
         goto error;
     }
-
-    // create an object from json
-    Object *jo = NULL;
     char *jerr = NULL;
     if (JSONOBJECT_OK != CreateNodeFromJSON(json, jsonlen, &jo, &jerr)) {
         if (jerr) {
@@ -1474,31 +4393,81 @@ int JSONArrIndex_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
         goto error;
     }
 
-    // get start (inclusive) & stop (exlusive) indices
-    long long start = 0, stop = 0;
-    if (argc > 4) {
-        if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[4], &start)) {
-            RedisModule_ReplyWithError(ctx, REJSON_ERROR_INDEX_INVALID);
-            goto error;
-        }
-        if (argc > 5) {
-            if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[5], &stop)) {
-                RedisModule_ReplyWithError(ctx, REJSON_ERROR_INDEX_INVALID);
-                goto error;
-            }
-        }
+    // a search replies with the first equal item, if there's one
+    int index = Node_ArrayBisect(jpn.n, jo, insert);
+    if (!insert) {
+        Node tmp, *item = NULL;
+        int found = index < (int)Node_Length(jpn.n) &&
+                    OBJ_OK == Node_ArrayItemView(jpn.n, index, &tmp, &item) &&
+                    !Node_Compare(item, jo);
+        RedisModule_ReplyWithLongLong(ctx, found ? index : -1);
+        Node_Free(jo);
+        JSONPathNode_Free(&jpn);
+        return REDISMODULE_OK;
     }
 
-    RedisModule_ReplyWithLongLong(ctx, Node_ArrayIndex(jpn.n, jo, (int)start, (int)stop));
+    // an insert goes after the equal items, and its effect is encoded before the value moves
+    Node *sub = NewArrayNode(1);
+    Node_ArrayAppend(sub, jo);
+    jo = NULL;
+    sds values = NULL;
+    if (JSONReplicateEffects) {
+        values = sdsempty();
+        SerializeNodeToBinary(sub, &values);
+    }
+    JSONTypeTouch(jt);
+    if (OBJ_OK != Node_ArrayInsert(jpn.n, index, sub)) {
+        Node_Free(sub);
+        sdsfree(values);
+        RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_INSERT);
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_INSERT);
+        goto error;
+    }
+    JSONNotify(ctx, argv[1], "json.arrinsort", jt, &jpn.sp);
+    if (values) {
+        JSONEffect_Insert(ctx, argv[1], jt, &jpn.sp, index, values);
+        sdsfree(values);
+    } else {
+        RedisModule_ReplicateVerbatim(ctx);
+    }
 
+    RedisModule_ReplyWithLongLong(ctx, index);
     JSONPathNode_Free(&jpn);
     return REDISMODULE_OK;
 
 error:
+    Node_Free(jo);
     JSONPathNode_Free(&jpn);
     return REDISMODULE_ERR;
 }
 
+/**
+ * JSON.ARRINSORT <key> <path> <json>
+ * Insert the `json` value into the sorted array at `path`, where it keeps the array sorted.
+ *
+ * The array's items must be in ascending order of JSON values: null, false, true, numbers, strings,
+ * arrays and then objects. Numbers are ordered by their values, strings by their bytes, and
+ * containers by their items or members in turn. The value's position is found with a binary search,
+ * after the items that equal it, and arrays of numbers are searched without unpacking them.
+ *
+ * Reply: Integer, specifically the index that the value was inserted at.
+*/
+int JSONArrInsort_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return JSONArrSorted(ctx, argv, argc, 1);
+}
+
+/**
+ * JSON.ARRBSEARCH <key> <path> <json>
+ * Search for the `json` value in the sorted array at `path` with a binary search.
+ *
+ * The array's items must be in the order of JSON.ARRINSORT, and numbers equal by their values.
+ *
+ * Reply: Integer, specifically the index of the first item that equals the value, or -1 if unfound.
+*/
+int JSONArrBsearch_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return JSONArrSorted(ctx, argv, argc, 0);
+}
+
 /**
 * JSON.ARRPOP <key> [path [index]]
 * Remove and return element from the index in the array.
@@ -1525,12 +4494,14 @@ int JSONArrPop_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int a
         return REDISMODULE_ERR;
     }
 
+    JSONExpire_Apply(ctx, key, argv[1]);
+
     // validate path
     JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (argc > 2 ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
-    if (PARSE_OK != NodeFromJSONPath(jt->root, spath, &jpn)) {
+    if (PARSE_OK != NodeFromJSONPathMutable(jt, spath, &jpn, 0)) {
         ReplyWithSearchPathError(ctx, &jpn);
         return REDISMODULE_ERR;
     }
@@ -1561,151 +4532,794 @@ int JSONArrPop_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int a
         goto error;
     }
 
-    // convert negative index
-    if (index < 0) index = len + index;
-    if (index < 0) index = 0;
-    if (index >= len) index = len - 1;
+    // convert negative index
+    if (index < 0) index = len + index;
+    if (index < 0) index = 0;
+    if (index >= len) index = len - 1;
+
+    // get and serialize the popped array item
+    JSONSerializeOpt jsopt = {0};
+    sds json = sdsempty();
+    Node tmp, *item;
+    Node_ArrayItemView(jpn.n, index, &tmp, &item);
+    SerializeNodeToJSON(item, &jsopt, &json);
+
+    // check whether serialization had succeeded
+    if (!sdslen(json)) {
+        sdsfree(json);
+        RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_SERIALIZE);
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_SERIALIZE);
+        goto error;
+    }
+
+    // delete the item from the array
+    JSONTypeTouch(jt);
+    Node_ArrayDelRange(jpn.n, index, 1);
+    JSONNotify(ctx, argv[1], "json.arrpop", jt, &jpn.sp);
+    if (JSONReplicateEffects) {
+        JSONEffect_DelRange(ctx, argv[1], jt, &jpn.sp, index, 1);
+    } else {
+        RedisModule_ReplicateVerbatim(ctx);
+    }
+
+    // reply with the serialization
+    RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
+    sdsfree(json);
+
+ok:
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_OK;
+
+error:
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_ERR;
+}
+
+/**
+* JSON.ARRTRIM <key> <path> <start> <stop>
+* Trim an array so that it contains only the specified inclusive range of elements.
+*
+* This command is extremely forgiving and using it with out of range indexes will not produce an
+* error. If `start` is larger than the array's size or `start` > `stop`, the result will be an empty
+* array. If `start` is < 0 then it will be treated as 0. If end is larger than the end of the array,
+* it will be treated like the last element in it.
+*
+* Reply: Integer, specifically the array's new size.
+*/
+int JSONArrTrim_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if (argc != 5) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // key can't be empty and must be a JSON type
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY == type || RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    JSONExpire_Apply(ctx, key, argv[1]);
+
+    // validate path
+    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONPathNode_t jpn;
+    if (PARSE_OK != NodeFromJSONPathMutable(jt, argv[2], &jpn, 0)) {
+        ReplyWithSearchPathError(ctx, &jpn);
+        return REDISMODULE_ERR;
+    }
+
+    // deal with path errors
+    if (E_OK != jpn.err) {
+        ReplyWithPathError(ctx, &jpn);
+        goto error;
+    }
+
+    // verify that the target's type is an array
+    if (N_ARRAY != NODETYPE(jpn.n)) {
+        ReplyWithPathTypeError(ctx, N_ARRAY, NODETYPE(jpn.n));
+        goto error;
+    }
+
+    // get start & stop
+    long long start, stop, left, right;
+    long long len = (long long)Node_Length(jpn.n);
+    if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[3], &start)) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_INDEX_INVALID);
+        goto error;
+    }
+    if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[4], &stop)) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_INDEX_INVALID);
+        goto error;
+    }
+
+    // convert negative indexes
+    if (start < 0) start = len + start;
+    if (stop < 0) stop = len + stop;
+
+    if (start < 0) start = 0;            // start at the beginning
+    if (start > stop || start >= len) {  // empty the array
+        left = len;
+        right = 0;
+    } else {  // set the boundries
+        left = start;
+        if (stop >= len) stop = len - 1;
+        right = len - stop - 1;
+    }
+
+    // trim the array
+    JSONTypeTouch(jt);
+    Node_ArrayDelRange(jpn.n, 0, left);
+    Node_ArrayDelRange(jpn.n, -right, right);
+    JSONNotify(ctx, argv[1], "json.arrtrim", jt, &jpn.sp);
+    if (!JSONReplicateEffects) {
+        RedisModule_ReplicateVerbatim(ctx);
+    } else {
+        if (left) JSONEffect_DelRange(ctx, argv[1], jt, &jpn.sp, 0, left);
+        if (right) JSONEffect_DelRange(ctx, argv[1], jt, &jpn.sp, len - left - right, right);
+    }
+
+    RedisModule_ReplyWithLongLong(ctx, (long long)Node_Length(jpn.n));
+
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_OK;
+
+error:
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_ERR;
+}
+
+// == Replication commands ==
+
+/* Decodes the path of an effect into a search path of its keys and indexes */
+static int JSONApply_ParsePath(RedisModuleString *arg, SearchPath *sp) {
+    size_t len;
+    const char *buf = RedisModule_StringPtrLen(arg, &len);
+    BinaryReader r;
+    Node n;
+    BinaryReader_Init(&r, buf, len);
+    if (OBJ_OK != BinaryReader_Read(&r, &n) || N_ARRAY != n.type) return REDISMODULE_ERR;
+
+    *sp = NewSearchPath(n.value.arrval.len);
+    for (uint32_t i = n.value.arrval.len; i; i--) {
+        Node item;
+        if (OBJ_OK != BinaryReader_Read(&r, &item)) return REDISMODULE_ERR;
+        if (N_STRING == item.type) {
+            SearchPath_AppendKey(sp, item.value.strval.data, item.value.strval.len);
+        } else if (N_INTEGER == item.type && item.value.intval >= 0 &&
+                   item.value.intval <= INT_MAX) {
+            SearchPath_AppendIndex(sp, (int)item.value.intval);
+        } else {
+            return REDISMODULE_ERR;
+        }
+    }
+    if (r.p != r.end) return REDISMODULE_ERR;
+    if (!sp->len) SearchPath_AppendRoot(sp);
+    return REDISMODULE_OK;
+}
+
+/**
+ * JSON._APPLY <key> <path> SET <value>
+ * JSON._APPLY <key> <path> INSERT <index> <values>
+ * JSON._APPLY <key> <path> DELRANGE <index> <count>
+ * Applies an effect of a write command, which is how writes are replicated when the module is
+ * loaded with REPLICATE_EFFECTS. It isn't meant to be called by clients.
+ *
+ * `path` is the binary encoding of an array of keys and non-negative indexes, which is empty for
+ * the root. `SET` sets the binary encoding of a value at `path` like JSON.SET does, and creates the
+ * key with a root. `INSERT` inserts the values of the binary encoding of an array before `index` in
+ * the array at `path`, and `DELRANGE` deletes `count` of its items from `index`.
+ *
+ * Reply: Simple String `OK`, or an error if the effect doesn't apply to the key.
+*/
+int JSONApply_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if ((argc < 5) || (argc > 6)) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // key must be empty or a JSON type
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    const char *op = RedisModule_StringPtrLen(argv[3], NULL);
+    int isset = 5 == argc && !strcasecmp("set", op);
+    int isinsert = 6 == argc && !strcasecmp("insert", op);
+    long long index = 0, count = 0;
+    if (!isset && !isinsert && (6 != argc || strcasecmp("delrange", op) ||
+                                REDISMODULE_OK != RedisModule_StringToLongLong(argv[5], &count))) {
+        RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+    if (!isset && (REDISMODULE_OK != RedisModule_StringToLongLong(argv[4], &index) || index < 0 ||
+                   count < 0)) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_INDEX_INVALID);
+        return REDISMODULE_ERR;
+    }
+
+    SearchPath sp = {0};
+    Node *value = NULL;
+    JSONType_t *jtnew = NULL;
+    if (REDISMODULE_OK != JSONApply_ParsePath(argv[2], &sp)) goto invalid;
+    int isroot = SearchPath_IsRootPath(&sp);
+
+    // values are decoded straight into the document, and a new root into its new container
+    if (isset || isinsert) {
+        size_t len;
+        const char *buf = RedisModule_StringPtrLen(argv[isset ? 4 : 5], &len);
+        if (isset && isroot) jtnew = NewJSONType();
+        NodeArena *prev = Node_SetArena(jtnew ? jtnew->arena : NULL);
+        int ret = CreateNodeFromBinary(buf, len, &value);
+        Node_SetArena(prev);
+        if (OBJ_OK != ret || (isinsert && N_ARRAY != NODETYPE(value))) goto invalid;
+    }
+
+    // setting the root replaces the document or creates the key
+    if (isset && isroot) {
+        jtnew->root = value;
+        if (REDISMODULE_KEYTYPE_EMPTY != type) RedisModule_DeleteKey(key);
+        RedisModule_ModuleTypeSetValue(key, JSONType, jtnew);
+        JSONIndex_Track(ctx, jtnew, argv[1]);
+        JSONNotify(ctx, argv[1], "json.set", jtnew, NULL);
+        SearchPath_Free(&sp);
+        return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+    if (REDISMODULE_KEYTYPE_EMPTY == type) goto invalid;
+
+    JSONExpire_Apply(ctx, key, argv[1]);
+
+    // the path must exist, but for the last key of a value that's set in a dictionary
+    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONTypeAccessPath(jt, &sp, 0);
+    Node *n = jt->root, *p = NULL, tmp;
+    int errlevel = -1;
+    PathError err = E_OK;
+    if (!isroot) err = SearchPath_FindEx(&sp, jt->root, &tmp, &n, &p, &errlevel);
+    const PathNode *last = &sp.nodes[sp.len - 1];
+    if (isset) {
+        if (E_OK != err && (E_NOKEY != err || errlevel != sp.len - 1)) goto invalid;
+        JSONTypeTouch(jt);
+        if (N_DICT == NODETYPE(p)) {
+            if (OBJ_OK != Node_DictSet(p, last->value.key, value)) goto invalid;
+        } else {
+            if (OBJ_OK != Node_ArrayReplace(p, last->value.index, value)) goto invalid;
+        }
+    } else {
+        if (E_OK != err || N_ARRAY != NODETYPE(n) || index + count > Node_Length(n)) goto invalid;
+        JSONTypeTouch(jt);
+        if (isinsert) {
+            if (OBJ_OK != Node_ArrayInsert(n, (int)index, value)) goto invalid;
+        } else {
+            Node_ArrayDelRange(n, (int)index, (int)count);
+        }
+    }
+
+    // a replica's notifications name the kinds of the effects, as their commands aren't known
+    JSONNotify(ctx, argv[1], isset ? "json.set" : isinsert ? "json.insert" : "json.delrange", jt,
+               &sp);
+    SearchPath_Free(&sp);
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+
+invalid:
+    SearchPath_Free(&sp);
+    if (jtnew) {
+        jtnew->root = value;
+        JSONTypeFree(jtnew);
+    } else {
+        Node_Free(value);
+    }
+    RedisModule_ReplyWithError(ctx, REJSON_ERROR_EFFECT);
+    return REDISMODULE_ERR;
+}
+
+// == Index commands ==
+
+/* RedisModule_SubscribeToKeyspaceEvents, which redismodule.h predates, resolved by OnLoad */
+typedef int (*JSONIndex_KeyspaceNotify)(RedisModuleCtx *ctx, int type, const char *event,
+                                        RedisModuleString *key);
+static int (*_subscribeToKeyspaceEvents)(RedisModuleCtx *ctx, int types,
+                                         JSONIndex_KeyspaceNotify callback) = NULL;
+
+/**
+* Tracks the documents that RESTORE, RENAME and MOVE set at keys, which they do without the module's
+* commands, so only the indexes of the key's database follow them (see JSONIndex_Track).
+*/
+static int JSONIndex_KeyspaceEvent(RedisModuleCtx *ctx, int type, const char *event,
+                                   RedisModuleString *key) {
+    if (strcmp("restore", event) && strcmp("rename_to", event) && strcmp("move_to", event))
+        return REDISMODULE_OK;
+    RedisModuleKey *k = RedisModule_OpenKey(ctx, key, REDISMODULE_READ);
+    if (RedisModule_ModuleTypeGetType(k) == JSONType)
+        JSONIndex_Track(ctx, RedisModule_ModuleTypeGetValue(k), key);
+    RedisModule_CloseKey(k);
+    return REDISMODULE_OK;
+}
+
+/**
+ * JSON.INDEX CREATE <index> <path> <HASH|SORTED>
+ * JSON.INDEX DROP <index>
+ * JSON.INDEX INFO <index>
+ * Manage the secondary index that's stored at the key `index`.
+ *
+ * `CREATE` indexes the documents of the database by their values at `path`, which must be a path of
+ * a single value. A HASH index has strings, numbers, booleans and nulls for looking up exact values,
+ * and a SORTED index has numbers for looking up ranges. Documents that have no such value at the
+ * path aren't indexed. `DROP` deletes the index, like deleting its key does, and `INFO` reports the
+ * index's path, its type and the number of indexed documents (and values, for a HASH index).
+ *
+ * Reply: depends on the subcommand used:
+ *   `CREATE` returns a simple string, specifically OK
+ *   `DROP` returns an integer, specifically the number of indexes deleted (0 or 1)
+ *   `INFO` returns an array of the index's properties' names and values, or null if there's none
+*/
+int JSONIndex_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 3) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    const char *subcmd = RedisModule_StringPtrLen(argv[1], NULL);
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[2], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+
+    if (!strcasecmp("create", subcmd)) {
+        if (argc != 5) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_ERR;
+        }
+        if (REDISMODULE_KEYTYPE_EMPTY != type) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_INDEX_EXISTS);
+            return REDISMODULE_ERR;
+        }
+
+        JSONIndexKind kind;
+        const char *skind = RedisModule_StringPtrLen(argv[4], NULL);
+        if (!strcasecmp("hash", skind)) {
+            kind = JSONINDEX_HASH;
+        } else if (!strcasecmp("sorted", skind)) {
+            kind = JSONINDEX_SORTED;
+        } else {
+            RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+
+        // validate path
+        JSONPathNode_t jpn;
+        if (PARSE_OK != JSONPathNode_Compile(argv[3], &jpn)) {
+            ReplyWithSearchPathError(ctx, &jpn);
+            return REDISMODULE_ERR;
+        }
+        int multi = SearchPath_IsMulti(&jpn.sp);
+        JSONPathNode_Free(&jpn);
+        if (multi) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_INDEX_PATH);
+            return REDISMODULE_ERR;
+        }
+
+        size_t pathlen;
+        const char *path = RedisModule_StringPtrLen(argv[3], &pathlen);
+        JSONIndex *ix = NewJSONIndex(path, pathlen, kind);
+        RedisModule_ModuleTypeSetValue(key, JSONIndexType, ix);
+        JSONIndex_Build(ctx, ix, JSONType);
 
-    // get and serialize the popped array item
-    JSONSerializeOpt jsopt = {0};
-    sds json = sdsempty();
-    Node *item;
-    Node_ArrayItem(jpn.n, index, &item);
-    SerializeNodeToJSON(item, &jsopt, &json);
+        RedisModule_ReplyWithSimpleString(ctx, "OK");
+        RedisModule_ReplicateVerbatim(ctx);
+        return REDISMODULE_OK;
+    }
 
-    // check whether serialization had succeeded
-    if (!sdslen(json)) {
-        sdsfree(json);
-        RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_SERIALIZE);
-        RedisModule_ReplyWithError(ctx, REJSON_ERROR_SERIALIZE);
-        goto error;
+    if (argc != 3) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != JSONIndexType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
     }
 
-    // delete the item from the array
-    Node_ArrayDelRange(jpn.n, index, 1);
+    if (!strcasecmp("drop", subcmd)) {
+        if (REDISMODULE_KEYTYPE_EMPTY == type) {
+            RedisModule_ReplyWithLongLong(ctx, 0);
+            return REDISMODULE_OK;
+        }
+        RedisModule_DeleteKey(key);
+        RedisModule_ReplyWithLongLong(ctx, 1);
+        RedisModule_ReplicateVerbatim(ctx);
+        return REDISMODULE_OK;
+    } else if (!strcasecmp("info", subcmd)) {
+        if (REDISMODULE_KEYTYPE_EMPTY == type) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_OK;
+        }
+        JSONIndex *ix = RedisModule_ModuleTypeGetValue(key);
+        JSONIndex_Build(ctx, ix, JSONType);
+
+        int hash = JSONINDEX_HASH == ix->kind;
+        RedisModule_ReplyWithArray(ctx, hash ? 8 : 6);
+        RedisModule_ReplyWithSimpleString(ctx, "path");
+        RedisModule_ReplyWithStringBuffer(ctx, ix->path->str, ix->path->len);
+        RedisModule_ReplyWithSimpleString(ctx, "type");
+        RedisModule_ReplyWithSimpleString(ctx, JSONIndex_KindName(ix->kind));
+        RedisModule_ReplyWithSimpleString(ctx, "docs");
+        RedisModule_ReplyWithLongLong(ctx, (long long)ix->ndocs);
+        if (hash) {
+            RedisModule_ReplyWithSimpleString(ctx, "values");
+            RedisModule_ReplyWithLongLong(ctx, (long long)ix->nvalues);
+        }
+        return REDISMODULE_OK;
+    }
 
-    // reply with the serialization
-    RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
-    sdsfree(json);
+    RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+    return REDISMODULE_ERR;
+}
 
-ok:
-    JSONPathNode_Free(&jpn);
-    return REDISMODULE_OK;
+/* The documents that a query finds */
+typedef struct {
+    JSONType_t **jts;
+    sds *keys;
+    size_t len;
+    size_t cap;
+} JSONQueryResults_t;
+
+static void JSONQuery_CollectResult(JSONType_t *jt, const char *key, size_t len, void *ctx) {
+    JSONQueryResults_t *r = ctx;
+    if (r->len == r->cap) {
+        r->cap = r->cap ? r->cap * 2 : 16;
+        r->jts = realloc(r->jts, r->cap * sizeof(JSONType_t *));
+        r->keys = realloc(r->keys, r->cap * sizeof(sds));
+    }
+    r->jts[r->len] = jt;
+    r->keys[r->len++] = sdsnewlen(key, len);
+}
 
-error:
-    JSONPathNode_Free(&jpn);
-    return REDISMODULE_ERR;
+/* Parses an end of a range, which is excluded if it is prefixed with a left parenthesis */
+static int JSONQuery_ParseRangeEnd(RedisModuleString *arg, double *d, int *ex) {
+    size_t len;
+    const char *s = RedisModule_StringPtrLen(arg, &len);
+    *ex = len && '(' == *s;
+    if (*ex) {
+        s++;
+        len--;
+    }
+    char *end;
+    *d = strtod(s, &end);
+    return len && end == s + len && !isnan(*d);
 }
 
 /**
-* JSON.ARRTRIM <key> <path> <start> <stop>
-* Trim an array so that it contains only the specified inclusive range of elements.
-*
-* This command is extremely forgiving and using it with out of range indexes will not produce an
-* error. If `start` is larger than the array's size or `start` > `stop`, the result will be an empty
-* array. If `start` is < 0 then it will be treated as 0. If end is larger than the end of the array,
-* it will be treated like the last element in it.
-*
-* Reply: Integer, specifically the array's new size.
+ * JSON.QUERY <index> EQ <json> [LIMIT <offset> <count>]
+ * JSON.QUERY <index> RANGE <min> <max> [LIMIT <offset> <count>]
+ * Find the keys of the documents that an index has for a value or a range of values.
+ *
+ * `EQ` finds the documents whose value at the index's path is the JSON scalar `json`, where numbers
+ * are compared as doubles. `RANGE` finds the documents of a SORTED index whose value is between `min`
+ * and `max` in ascending order. Like in ZRANGEBYSCORE, `-inf` and `+inf` are the unbounded ends, and
+ * an end that's prefixed by `(` is excluded. `LIMIT` skips the first `offset` keys, and returns up
+ * to `count` keys, or all of them if `count` is negative. Keys that no longer hold their documents,
+ * e.g. that expired, aren't counted.
+ *
+ * The documents aren't read: the index is only brought up to date with the documents that were
+ * written since it was last used.
+ *
+ * Reply: Array of Bulk Strings, specifically the keys of the documents.
 */
-int JSONArrTrim_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    // check args
-    if (argc != 5) {
+int JSONQuery_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 4) {
         RedisModule_WrongArity(ctx);
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
 
-    // key can't be empty and must be a JSON type
+    // the index must exist
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
     int type = RedisModule_KeyType(key);
-    if (REDISMODULE_KEYTYPE_EMPTY == type || RedisModule_ModuleTypeGetType(key) != JSONType) {
+    if (REDISMODULE_KEYTYPE_EMPTY == type) {
+        RedisModule_ReplyWithArray(ctx, 0);
+        return REDISMODULE_OK;
+    } else if (RedisModule_ModuleTypeGetType(key) != JSONIndexType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
         return REDISMODULE_ERR;
     }
+    JSONIndex *ix = RedisModule_ModuleTypeGetValue(key);
 
-    // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
-    JSONPathNode_t jpn;
-    if (PARSE_OK != NodeFromJSONPath(jt->root, argv[2], &jpn)) {
-        ReplyWithSearchPathError(ctx, &jpn);
+    // the arguments of the lookup
+    const char *op = RedisModule_StringPtrLen(argv[2], NULL);
+    int range = !strcasecmp("range", op);
+    if (!range && strcasecmp("eq", op)) {
+        RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
         return REDISMODULE_ERR;
     }
-
-    // deal with path errors
-    if (E_OK != jpn.err) {
-        ReplyWithPathError(ctx, &jpn);
-        goto error;
+    int next = range ? 5 : 4;
+    if (argc != next && argc != next + 3) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
     }
 
-    // verify that the target's type is an array
-    if (N_ARRAY != NODETYPE(jpn.n)) {
-        ReplyWithPathTypeError(ctx, N_ARRAY, NODETYPE(jpn.n));
-        goto error;
+    long long offset = 0, count = -1;
+    if (argc > next) {
+        if (strcasecmp("limit", RedisModule_StringPtrLen(argv[next], NULL))) {
+            RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+        if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[next + 1], &offset) ||
+            REDISMODULE_OK != RedisModule_StringToLongLong(argv[next + 2], &count) || offset < 0) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_QUERY_LIMIT);
+            return REDISMODULE_ERR;
+        }
     }
 
-    // get start & stop
-    long long start, stop, left, right;
-    long long len = (long long)Node_Length(jpn.n);
-    if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[3], &start)) {
-        RedisModule_ReplyWithError(ctx, REJSON_ERROR_INDEX_INVALID);
-        goto error;
+    double min, max;
+    int minex, maxex;
+    Node *value = NULL;
+    if (range) {
+        if (JSONINDEX_SORTED != ix->kind) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_INDEX_NOT_SORTED);
+            return REDISMODULE_ERR;
+        }
+        if (!JSONQuery_ParseRangeEnd(argv[3], &min, &minex) ||
+            !JSONQuery_ParseRangeEnd(argv[4], &max, &maxex)) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_QUERY_RANGE);
+            return REDISMODULE_ERR;
+        }
+    } else {
+        size_t jsonlen;
+        const char *json = RedisModule_StringPtrLen(argv[3], &jsonlen);
+        char *jerr = NULL;
+        if (JSONOBJECT_OK != CreateNodeFromJSON(json, jsonlen, &value, &jerr)) {
+            if (jerr) {
+                RedisModule_ReplyWithError(ctx, jerr);
+                free(jerr);
+            } else {
+                RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_JSONOBJECT_ERROR);
+                RedisModule_ReplyWithError(ctx, REJSON_ERROR_JSONOBJECT_ERROR);
+            }
+            return REDISMODULE_ERR;
+        }
+        if (N_DICT == NODETYPE(value) || N_ARRAY == NODETYPE(value)) {
+            Node_Free(value);
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_QUERY_VALUE);
+            return REDISMODULE_ERR;
+        }
     }
-    if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[4], &stop)) {
-        RedisModule_ReplyWithError(ctx, REJSON_ERROR_INDEX_INVALID);
-        goto error;
+
+    /* Only the keys that still hold their documents count for the offset and the count, so the
+     * documents are collected a page at a time, and the page is checked before it's replied to. A
+     * key that's opened may expire, which removes its document from the index at or after its
+     * position in it, so a page in which some expire is collected again from the same position. */
+    JSONIndex_Build(ctx, ix, JSONType);
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+    long long replied = 0, skip = offset;
+    size_t pos = 0;
+    JSONQueryResults_t r = {0};
+    for (;;) {
+        long long want = count < 0 ? -1 : skip + count - replied;
+        if (!want) break;
+        r.len = 0;
+        if (range)
+            JSONIndex_Range(ix, min, minex, max, maxex, pos, want, JSONQuery_CollectResult, &r);
+        else
+            JSONIndex_Lookup(ix, value, pos, want, JSONQuery_CollectResult, &r);
+        if (!r.len) break;
+
+        size_t ndocs = ix->ndocs;
+        int *live = calloc(r.len, sizeof(int));
+        for (size_t i = 0; i < r.len; i++) {
+            RedisModuleString *name = RedisModule_CreateString(ctx, r.keys[i], sdslen(r.keys[i]));
+            RedisModuleKey *doc = RedisModule_OpenKey(ctx, name, REDISMODULE_READ);
+            live[i] = RedisModule_ModuleTypeGetType(doc) == JSONType &&
+                      RedisModule_ModuleTypeGetValue(doc) == r.jts[i];
+            RedisModule_CloseKey(doc);
+            RedisModule_FreeString(ctx, name);
+        }
+        int expired = ix->ndocs != ndocs;
+        for (size_t i = 0; i < r.len; i++) {
+            if (!expired && live[i] && skip) {
+                skip--;
+            } else if (!expired && live[i]) {
+                RedisModule_ReplyWithStringBuffer(ctx, r.keys[i], sdslen(r.keys[i]));
+                replied++;
+            }
+            sdsfree(r.keys[i]);
+        }
+        free(live);
+        if (expired) continue;
+        if (want >= 0 && r.len < (size_t)want) break;  // the index has no more of them
+        pos += r.len;
     }
+    RedisModule_ReplySetArrayLength(ctx, replied);
 
-    // convert negative indexes
-    if (start < 0) start = len + start;
-    if (stop < 0) stop = len + stop;
+    Node_Free(value);
+    free(r.jts);
+    free(r.keys);
+    return REDISMODULE_OK;
+}
 
-    if (start < 0) start = 0;            // start at the beginning
-    if (start > stop || start >= len) {  // empty the array
-        left = len;
-        right = 0;
-    } else {  // set the boundries
-        left = start;
-        if (stop >= len) stop = len - 1;
-        right = len - stop - 1;
+/* Sets the dictionary of compressed values to a file's last COMPRESS_WINDOW bytes */
+static int LoadCompressionDictionary(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return REDISMODULE_ERR;
+
+    char buf[COMPRESS_WINDOW];
+    size_t len = 0;
+    if (!fseek(f, 0, SEEK_END)) {
+        long size = ftell(f);
+        if (size > COMPRESS_WINDOW) fseek(f, size - COMPRESS_WINDOW, SEEK_SET);
+        else rewind(f);
+        len = fread(buf, 1, sizeof(buf), f);
     }
+    int ok = !ferror(f);
+    fclose(f);
+    if (!ok) return REDISMODULE_ERR;
+    Compress_SetDictionary(buf, len);
+    return REDISMODULE_OK;
+}
 
-    // trim the array
-    Node_ArrayDelRange(jpn.n, 0, left);
-    Node_ArrayDelRange(jpn.n, -right, right);
+/* The values of the settings that are applied by functions */
+static size_t _pathCacheSize = PATH_CACHE_CAPACITY;
+static size_t _serialCacheMemory = SERIAL_CACHE_MAX_MEMORY;
+static sds _compressionDictionary = NULL;
 
-    RedisModule_ReplyWithLongLong(ctx, (long long)Node_Length(jpn.n));
+static int ApplyPathCacheSize(const ModuleConfigParam *p) {
+    PathCache_SetCapacity(_pathCacheSize);
+    return 1;
+}
 
-    JSONPathNode_Free(&jpn);
-    return REDISMODULE_OK;
+static int ApplySerialCacheMemory(const ModuleConfigParam *p) {
+    SerialCache_SetMaxMemory(_serialCacheMemory);
+    return 1;
+}
 
-error:
-    JSONPathNode_Free(&jpn);
+static int ApplyCompressionDictionary(const ModuleConfigParam *p) {
+    return REDISMODULE_OK == LoadCompressionDictionary(_compressionDictionary);
+}
+
+/* The module's settings, see docs/index.md */
+static ModuleConfigParam _config[] = {
+    {"AOF_CHUNK_SIZE", MODULECONFIG_SIZE, &JSONTypeAofChunkSize, 0, LLONG_MAX, 0, NULL},
+    {"PATH_CACHE_SIZE", MODULECONFIG_SIZE, &_pathCacheSize, 0, UINT32_MAX, 0, ApplyPathCacheSize},
+    {"SERIAL_CACHE_MEMORY", MODULECONFIG_SIZE, &_serialCacheMemory, 0, LLONG_MAX, 0,
+     ApplySerialCacheMemory},
+    {"ASYNC_GET_MEMORY", MODULECONFIG_SIZE, &JSONGetAsyncMemory, 0, LLONG_MAX, 0, NULL},
+    {"LAZY_DOCUMENT_SIZE", MODULECONFIG_SIZE, &JSONTypeLazySize, 0, LLONG_MAX, 0, NULL},
+    {"STRING_COMPRESSION_SIZE", MODULECONFIG_UINT32, &NodeStringCompressSize, 0, UINT32_MAX, 0,
+     NULL},
+    {"COMPRESSION_DICTIONARY", MODULECONFIG_STRING, &_compressionDictionary, 0, 0,
+     MODULECONFIG_F_LOAD_ONLY, ApplyCompressionDictionary},
+    {"COLD_DOCUMENT_SECONDS", MODULECONFIG_UINT32, &JSONTypeColdSeconds, 0, UINT32_MAX, 0, NULL},
+    {"LAZY_RDB_LOAD", MODULECONFIG_INT, &JSONTypeLazyLoad, 0, 1, 0, NULL},
+    {"LAZYFREE_NODES", MODULECONFIG_SIZE, &JSONTypeLazyFreeNodes, 0, LLONG_MAX, 0, NULL},
+    {"DEDUP", MODULECONFIG_INT, &JSONTypeDedupValues, 0, 1, 0, NULL},
+    {"NOTIFY_PATHS", MODULECONFIG_INT, &JSONNotifyPaths, 0, 1, 0, NULL},
+    {"DEFRAG_SLICE_USEC", MODULECONFIG_SIZE, &JSONTypeDefragSliceUsecs, 0, UINT32_MAX, 0, NULL},
+    {"PARALLEL_PARSE_SIZE", MODULECONFIG_SIZE, &JSONSetParallelSize, 0, LLONG_MAX, 0, NULL},
+    {"PARALLEL_PARSE_THREADS", MODULECONFIG_INT, &JSONSetParallelThreads, 0,
+     JSONSET_MAX_PARALLEL_THREADS, 0, NULL},
+    {"REPLICATE_EFFECTS", MODULECONFIG_INT, &JSONReplicateEffects, 0, 1, 0, NULL},
+    {"DICT_HASH_THRESHOLD", MODULECONFIG_UINT32, &NodeDictHashThreshold, 0, UINT32_MAX, 0, NULL},
+    {"DICT_TRIE_THRESHOLD", MODULECONFIG_UINT32, &NodeDictTrieThreshold, 0, UINT32_MAX, 0, NULL},
+    {"ARRAY_GROWTH_CHUNK", MODULECONFIG_UINT32, &NodeArrayGrowthChunk, 0, 1 << 30, 0, NULL},
+    {"PARSE_MAX_LEVELS", MODULECONFIG_INT, &JSONObjectMaxLevels, 2, JSONSL_MAX_LEVELS, 0, NULL},
+    {"PARSE_NUMBER_TEXT", MODULECONFIG_INT, &JSONObjectNumberText, 0, 1, 0, NULL},
+    {NULL},
+};
+
+/**
+ * JSON.CONFIG GET <pattern>
+ * JSON.CONFIG SET <name> <value>
+ * Reads and changes the module's settings at runtime, like CONFIG does the server's. The settings
+ * are the module arguments, and `GET` replies with those whose names match the glob-style pattern.
+ * A change applies right away to what the module does from then on, and lasts until the module is
+ * loaded again. `COMPRESSION_DICTIONARY` can only be given as a module argument.
+ *
+ * Reply: with `GET`, an array of the names and values of the settings. With `SET`, Simple String
+ * `OK`, or an error if the setting is unknown or the value is out of its range.
+*/
+int JSONConfig_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 3) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+
+    const char *subcmd = RedisModule_StringPtrLen(argv[1], NULL);
+    const char *name = RedisModule_StringPtrLen(argv[2], NULL);
+    if (!strcasecmp("GET", subcmd) && 3 == argc) {
+        long len = 0;
+        RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+        for (ModuleConfigParam *p = _config; p->name; p++) {
+            if (!ModuleConfig_Match(name, p->name)) continue;
+            sds value = ModuleConfig_Get(p, sdsempty());
+            RedisModule_ReplyWithSimpleString(ctx, p->name);
+            RedisModule_ReplyWithStringBuffer(ctx, value, sdslen(value));
+            sdsfree(value);
+            len += 2;
+        }
+        RedisModule_ReplySetArrayLength(ctx, len);
+        return REDISMODULE_OK;
+    }
+    if (!strcasecmp("SET", subcmd) && 4 == argc) {
+        ModuleConfigParam *p = ModuleConfig_Find(_config, name);
+        size_t len;
+        const char *value = RedisModule_StringPtrLen(argv[3], &len);
+        const char *err = p ? ModuleConfig_Set(p, value, len, 0) : MODULECONFIG_ERROR_UNKNOWN;
+        if (err) {
+            RedisModule_ReplyWithError(ctx, err);
+            return REDISMODULE_ERR;
+        }
+        RedisModule_ReplyWithSimpleString(ctx, "OK");
+        return REDISMODULE_OK;
+    }
+    RedisModule_ReplyWithError(ctx, "ERR unknown subcommand - try `JSON.CONFIG GET|SET`");
     return REDISMODULE_ERR;
 }
 
-int RedisModule_OnLoad(RedisModuleCtx *ctx) __attribute__((visibility("default")));
-int RedisModule_OnLoad(RedisModuleCtx *ctx) {
+int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+    __attribute__((visibility("default")));
+int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     // Register the module
     if (RedisModule_Init(ctx, RLMODULE_NAME, 1, REDISMODULE_APIVER_1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    // Module arguments come in name-value pairs of settings
+    for (int i = 0; i < argc; i += 2) {
+        const char *name = RedisModule_StringPtrLen(argv[i], NULL);
+        ModuleConfigParam *p = ModuleConfig_Find(_config, name);
+        if (!p) {
+            RM_LOG_WARNING(ctx, "Unknown module argument %s", name);
+            return REDISMODULE_ERR;
+        }
+        size_t len = 0;
+        const char *value = i + 1 < argc ? RedisModule_StringPtrLen(argv[i + 1], &len) : "";
+        if (ModuleConfig_Set(p, value, len, 1)) {
+            RM_LOG_WARNING(ctx, "Invalid value for module argument %s: %s", name, value);
+            return REDISMODULE_ERR;
+        }
+    }
+
     // Register the JSON data type
     RedisModuleTypeMethods tm = { .version = REDISMODULE_TYPE_METHOD_VERSION,
                                   .rdb_load = JSONTypeRdbLoad,
                                   .rdb_save = JSONTypeRdbSave,
                                   .aof_rewrite = JSONTypeAofRewrite,
                                   .mem_usage = JSONTypeMemoryUsage,
-                                  .free = JSONTypeFree };
+                                  .free = JSONTypeFree,
+                                  .defrag = JSONTypeDefragInit() ? JSONTypeDefrag : NULL };
     JSONType = RedisModule_CreateDataType(ctx, JSONTYPE_NAME, JSONTYPE_ENCODING_VERSION, &tm);
     if (NULL == JSONType) return REDISMODULE_ERR;
 
+    // Register the index data type
+    RedisModuleTypeMethods itm = { .version = REDISMODULE_TYPE_METHOD_VERSION,
+                                   .rdb_load = JSONIndexRdbLoad,
+                                   .rdb_save = JSONIndexRdbSave,
+                                   .aof_rewrite = JSONIndexAofRewrite,
+                                   .mem_usage = JSONIndexMemoryUsage,
+                                   .free = JSONIndexFree };
+    JSONIndexType =
+        RedisModule_CreateDataType(ctx, JSONINDEX_TYPE_NAME, JSONINDEX_ENCODING_VERSION, &itm);
+    if (NULL == JSONIndexType) return REDISMODULE_ERR;
+
     /* Module commands. */
     /* Generic JSON type commands. */
     if (RedisModule_CreateCommand(ctx, "json.resp", JSONResp_RedisCommand, "readonly", 1, 1, 1) ==
         REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    if (RedisModule_CreateCommand(ctx, "json.stats", JSONStats_RedisCommand, "readonly", 0, 0, 0) ==
+        REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.config", JSONConfig_RedisCommand, "admin", 0, 0, 0) ==
+        REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
     if (RedisModule_CreateCommand(ctx, "json.debug", JSONDebug_RedisCommand, "readonly getkeys-api",
                                   1, 1, 1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
@@ -1714,7 +5328,23 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
         REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
-    if (RedisModule_CreateCommand(ctx, "json.set", JSONSet_RedisCommand, "write deny-oom", 1, 1,
+    if (RedisModule_CreateCommand(ctx, "json.set", JSONSet_RedisCommand,
+                                  "write deny-oom getkeys-api", 1, 1, 1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.setchunk", JSONSetChunk_RedisCommand,
+                                  "write deny-oom", 1, 1, 1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.mset", JSONMSet_RedisCommand, "write deny-oom", 1, 1,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.setschema", JSONSetSchema_RedisCommand,
+                                  "write deny-oom", 1, 1, 1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.validate", JSONValidate_RedisCommand, "readonly", 1, 1,
                                   1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
@@ -1722,10 +5352,18 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
         REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
-    if (RedisModule_CreateCommand(ctx, "json.mget", JSONMGet_RedisCommand, "readonly getkeys-api",
+    if (RedisModule_CreateCommand(ctx, "json.mget", JSONMGet_GenericCommand, "readonly getkeys-api",
                                   1, 1, 1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    if (RedisModule_CreateCommand(ctx, "json.mgetarray", JSONMGet_GenericCommand,
+                                  "readonly getkeys-api", 1, 1, 1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.scan", JSONScan_RedisCommand, "readonly", 0, 0, 0) ==
+        REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
     if (RedisModule_CreateCommand(ctx, "json.del", JSONDel_RedisCommand, "write", 1, 1, 1) ==
         REDISMODULE_ERR)
         return REDISMODULE_ERR;
@@ -1734,7 +5372,40 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
         REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    if (RedisModule_CreateCommand(ctx, "json.copy", JSONCopy_RedisCommand, "write deny-oom", 1, 2,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    /* JSON expiry commands. */
+    if (RedisModule_CreateCommand(ctx, "json.expire", JSONExpire_GenericCommand, "write", 1, 1,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.pexpireat", JSONExpire_GenericCommand, "write", 1, 1,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.ttl", JSONTTL_GenericCommand, "readonly", 1, 1, 1) ==
+        REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.pttl", JSONTTL_GenericCommand, "readonly", 1, 1, 1) ==
+        REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.persist", JSONPersist_RedisCommand, "write", 1, 1,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
     /* JSON number commands. */
+    if (RedisModule_CreateCommand(ctx, "json.merge", JSONMerge_RedisCommand, "write deny-oom", 1, 1,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.patch", JSONPatch_RedisCommand, "write deny-oom", 1, 1,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
     if (RedisModule_CreateCommand(ctx, "json.numincrby", JSONNum_GenericCommand, "write", 1, 1,
                                   1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
@@ -1743,6 +5414,14 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
                                   1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    if (RedisModule_CreateCommand(ctx, "json.mnumincrby", JSONMNum_GenericCommand, "write", 1, 1,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.mnummultby", JSONMNum_GenericCommand, "write", 1, 1,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
     /* JSON string commands. */
     if (RedisModule_CreateCommand(ctx, "json.strlen", JSONLen_GenericCommand, "readonly", 1, 1,
                                   1) == REDISMODULE_ERR)
@@ -1765,6 +5444,18 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
                                   "write deny-oom", 1, 1, 1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    if (RedisModule_CreateCommand(ctx, "json.arrcount", JSONArrCount_RedisCommand, "readonly", 1, 1,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.arrinsort", JSONArrInsort_RedisCommand,
+                                  "write deny-oom", 1, 1, 1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.arrbsearch", JSONArrBsearch_RedisCommand, "readonly",
+                                  1, 1, 1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
     if (RedisModule_CreateCommand(ctx, "json.arrindex", JSONArrIndex_RedisCommand, "readonly", 1, 1,
                                   1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
@@ -1786,6 +5477,46 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
                                   1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    /* Index commands. */
+    if (RedisModule_CreateCommand(ctx, "json.index", JSONIndex_RedisCommand, "write deny-oom", 2, 2,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.query", JSONQuery_RedisCommand, "readonly", 1, 1, 1) ==
+        REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    /* Replication commands. */
+    if (RedisModule_CreateCommand(ctx, "json._apply", JSONApply_RedisCommand, "write", 1, 1, 1) ==
+        REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    // expiring paths are deleted by a timer too, on servers that have timers
+    if (REDISMODULE_OK == RedisModule_GetApi("RedisModule_CreateTimer", (void **)&_createTimer)) {
+        _createTimer(ctx, JSONEXPIRE_CYCLE_MS, JSONExpire_Cycle, NULL);
+    } else {
+        _createTimer = NULL;
+        RM_LOG_WARNING(ctx, "Expiring paths are only deleted on access, the server has no timers");
+    }
+
+    // the indexes follow restored, renamed and moved keys on servers that have keyspace events
+    if (REDISMODULE_OK == RedisModule_GetApi("RedisModule_SubscribeToKeyspaceEvents",
+                                             (void **)&_subscribeToKeyspaceEvents) &&
+        REDISMODULE_OK ==
+            _subscribeToKeyspaceEvents(ctx, JSON_NOTIFY_GENERIC, JSONIndex_KeyspaceEvent)) {
+        JSONIndex_FollowKeys();
+    } else {
+        _subscribeToKeyspaceEvents = NULL;
+    }
+
+    // changes are notified on servers that have keyspace notifications and publishing
+    if (REDISMODULE_OK !=
+        RedisModule_GetApi("RedisModule_NotifyKeyspaceEvent", (void **)&_notifyKeyspaceEvent))
+        _notifyKeyspaceEvent = NULL;
+    if (REDISMODULE_OK !=
+        RedisModule_GetApi("RedisModule_PublishMessage", (void **)&_publishMessage))
+        _publishMessage = NULL;
+
     RM_LOG_WARNING(ctx, "%s - %s v%d.%d.%d [encver %d]", RLMODULE_DESC, PROJECT_BUILD_TYPE,
                    PROJECT_VERSION_MAJOR, PROJECT_VERSION_MINOR, PROJECT_VERSION_PATCH,
                    JSONTYPE_ENCODING_VERSION);
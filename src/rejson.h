@@ -19,14 +19,23 @@
 #define __REJSON_H__
 
 #include <logging.h>
+#include <pthread.h>
 #include <sds.h>
 #include <string.h>
 #include <util.h>
 #include "config.h"
 #include "json_object.h"
+#include "json_patch.h"
+#include "json_keyref.h"
+#include "json_scan.h"
 #include "json_path.h"
+#include "path_cache.h"
 #include "object.h"
 #include "json_type.h"
+#include "json_index.h"
+#include "json_expire.h"
+#include "module_config.h"
+#include "object_pack.h"
 #include "redismodule.h"
 
 #define RLMODULE_NAME "ReJSON"
@@ -41,9 +50,11 @@
 #define REJSON_ERROR_PATH_NANTYPE "ERR wrong type of path value - expected a number but found %s"
 #define REJSON_ERROR_PATH_WRONGTYPE "ERR wrong type of path value - expected %s but found %s"
 #define REJSON_ERROR_PATH_NONTERMINAL_KEY "ERR missing key at non-terminal path level"
+#define REJSON_ERROR_PATH_DESCENT "ERR recursive descent can't be used in paths that change values"
 #define REJSON_ERROR_INDEX_INVALID "ERR array index must be an integer"
 #define REJSON_ERROR_INDEX_OUTOFRANGE "ERR index out of range"
 #define REJSON_ERROR_VALUE_NAN "ERR value is not a number type"
+#define REJSON_ERROR_MNUM_MULTI "ERR the paths must be paths of single values"
 #define REJSON_ERROR_RESULT_NAN_OR_INF "ERR result is not a number or an infinty"
 #define REJSON_ERROR_DICT_SET "ERR could not set key in dictionary"
 #define REJSON_ERROR_ARRAY_SET "ERR could not set item in array"
@@ -52,5 +63,30 @@
 #define REJSON_ERROR_ARRAY_DEL "ERR could not delete from array"
 #define REJSON_ERROR_INSERT "ERR could not insert into array"
 #define REJSON_ERROR_INSERT_SUBARRY "ERR could not prepare the insert operation"
+#define REJSON_ERROR_GET_CHUNKS "ERR the chunks' size must be a positive integer"
+#define REJSON_ERROR_CHUNK_INVALID "ERR the chunk's number must be a non-negative integer"
+#define REJSON_ERROR_CHUNK_SEQ "ERR expected chunk %lld"
+#define REJSON_ERROR_CHUNK_PATH "ERR the path differs from the path of the upload's first chunk"
+#define REJSON_ERROR_INDEX_EXISTS "ERR the key already exists"
+#define REJSON_ERROR_INDEX_PATH "ERR an index's path must be a path of a single value"
+#define REJSON_ERROR_INDEX_NOT_SORTED "ERR ranges can only be queried in sorted indexes"
+#define REJSON_ERROR_QUERY_VALUE "ERR the value must be a JSON string, number, boolean or null"
+#define REJSON_ERROR_QUERY_RANGE "ERR min or max is not a number"
+#define REJSON_ERROR_QUERY_LIMIT "ERR the offset of a limit must be a non-negative integer"
+#define REJSON_ERROR_SCAN_COUNT "ERR the count must be a positive integer"
+#define REJSON_ERROR_SCAN "ERR the keys of the database couldn't be scanned"
+#define REJSON_ERROR_COPY_SAME "ERR source and destination objects are the same"
+#define REJSON_ERROR_COPY_MULTI "ERR the source path must be a path of a single value"
+#define REJSON_ERROR_MERGE_MULTI "ERR the path must be a path of a single value"
+#define REJSON_ERROR_FORMAT "ERR the format must be JSON, MSGPACK or CBOR"
+#define REJSON_ERROR_EFFECT "ERR the effect doesn't apply to the key"
+#define REJSON_ERROR_FORMAT_CHUNKS "ERR chunked replies can only be serialized as JSON"
+#define REJSON_ERROR_RESOLVE_DEPTH "ERR the depth of references must be between 1 and 32"
+#define REJSON_ERROR_FORMAT_RESOLVE "ERR references can only be resolved in JSON"
+#define REJSON_ERROR_SCHEMA_KEY "ERR the schema's key doesn't hold a JSON document"
+#define REJSON_ERROR_SCHEMA_MISMATCH "ERR JSON value doesn't match the schema: %s"
+#define REJSON_ERROR_EXPIRE_TIME "ERR invalid expire time"
+#define REJSON_ERROR_EXPIRE_PATH \
+    "ERR an expiring path must be a path of a single value through object keys only"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,129 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "serial_cache.h"
+
+/* An entry holds its key and then its value */
+struct SerialCacheEntry {
+    SerialCacheEntry **owner;         // the head of the document's list
+    SerialCacheEntry *next, *prev;    // the neighbours in the document's list
+    SerialCacheEntry *older, *newer;  // the neighbours in the cache's LRU list
+    uint64_t version;                 // the document's version when it was cached
+    size_t keylen;
+    size_t len;
+    char data[];
+};
+
+#define __serialcache_size(e) (sizeof(SerialCacheEntry) + (e)->keylen + (e)->len)
+
+/* The doubly linked list of all the entries, from the least to the most recently used one */
+static struct {
+    size_t maxmemory;
+    size_t memory;
+    size_t count;
+    SerialCacheEntry *oldest;
+    SerialCacheEntry *newest;
+    uint64_t hits;
+    uint64_t misses;
+} _cache = {.maxmemory = SERIAL_CACHE_MAX_MEMORY};
+
+static void __serialcache_unlink(SerialCacheEntry *e) {
+    if (e->older) e->older->newer = e->newer;
+    else _cache.oldest = e->newer;
+    if (e->newer) e->newer->older = e->older;
+    else _cache.newest = e->older;
+}
+
+static void __serialcache_pushnewest(SerialCacheEntry *e) {
+    e->older = _cache.newest;
+    e->newer = NULL;
+    if (_cache.newest) _cache.newest->newer = e;
+    else _cache.oldest = e;
+    _cache.newest = e;
+}
+
+/* Removes an entry from its document and from the cache, and frees it */
+static void __serialcache_free(SerialCacheEntry *e) {
+    if (e->prev) e->prev->next = e->next;
+    else *e->owner = e->next;
+    if (e->next) e->next->prev = e->prev;
+    __serialcache_unlink(e);
+    _cache.memory -= __serialcache_size(e);
+    _cache.count--;
+    free(e);
+}
+
+const char *SerialCache_Get(SerialCacheEntry **entries, uint64_t version, const char *key,
+                            size_t keylen, size_t *len) {
+    SerialCacheEntry *e = *entries;
+    while (e) {
+        SerialCacheEntry *next = e->next;
+        if (e->version != version) {
+            __serialcache_free(e);
+        } else if (e->keylen == keylen && !memcmp(e->data, key, keylen)) {
+            _cache.hits++;
+            if (e != _cache.newest) {
+                __serialcache_unlink(e);
+                __serialcache_pushnewest(e);
+            }
+            *len = e->len;
+            return e->data + keylen;
+        }
+        e = next;
+    }
+    _cache.misses++;
+    return NULL;
+}
+
+void SerialCache_Put(SerialCacheEntry **entries, uint64_t version, const char *key, size_t keylen,
+                     const char *value, size_t len) {
+    size_t size = sizeof(SerialCacheEntry) + keylen + len;
+    if (size > _cache.maxmemory) return;
+    while (_cache.memory + size > _cache.maxmemory) __serialcache_free(_cache.oldest);
+
+    SerialCacheEntry *e = malloc(size);
+    e->owner = entries;
+    e->prev = NULL;
+    e->next = *entries;
+    if (*entries) (*entries)->prev = e;
+    *entries = e;
+    __serialcache_pushnewest(e);
+    e->version = version;
+    e->keylen = keylen;
+    e->len = len;
+    memcpy(e->data, key, keylen);
+    memcpy(e->data + keylen, value, len);
+    _cache.memory += size;
+    _cache.count++;
+}
+
+void SerialCache_Drop(SerialCacheEntry **entries) {
+    while (*entries) __serialcache_free(*entries);
+}
+
+void SerialCache_SetMaxMemory(size_t bytes) {
+    _cache.maxmemory = bytes;
+    while (_cache.memory > _cache.maxmemory) __serialcache_free(_cache.oldest);
+}
+
+void SerialCache_Stats(size_t *count, size_t *memory, uint64_t *hits, uint64_t *misses) {
+    if (count) *count = _cache.count;
+    if (memory) *memory = _cache.memory;
+    if (hits) *hits = _cache.hits;
+    if (misses) *misses = _cache.misses;
+}
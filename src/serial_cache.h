@@ -0,0 +1,67 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SERIAL_CACHE_H__
+#define __SERIAL_CACHE_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef REDIS_MODULE_TARGET
+#include <alloc.h>
+#endif
+
+/**
+* A memory bounded LRU cache of serialized values, so documents that are read much more often than
+* they are written aren't serialized over and over. Every document owns a list of its cached
+* serializations, each keyed by a string that the caller composes (e.g. of the paths and formatting
+* options of a read), and stamped with the document's version when it was serialized. Writers bump
+* the version, which makes the older entries stale: they are never returned, and are freed when
+* they are met.
+* The cache isn't thread safe, it is meant for Redis' main thread.
+*/
+
+/* The default memory limit of the cache in bytes */
+#define SERIAL_CACHE_MAX_MEMORY (16 << 20)
+
+typedef struct SerialCacheEntry SerialCacheEntry;
+
+/**
+* Returns the value that's cached for the key in a document's list of entries at the document's
+* current version and sets its length, or returns NULL if there's none.
+* The value is valid until the next call to a SerialCache function.
+*/
+const char *SerialCache_Get(SerialCacheEntry **entries, uint64_t version, const char *key,
+                            size_t keylen, size_t *len);
+
+/** Caches a copy of a value for the key in a document's list of entries, at the given version */
+void SerialCache_Put(SerialCacheEntry **entries, uint64_t version, const char *key, size_t keylen,
+                     const char *value, size_t len);
+
+/** Frees all the entries of a document, must be called before the document is freed */
+void SerialCache_Drop(SerialCacheEntry **entries);
+
+/**
+* Sets the memory limit of the cache in bytes, evicting the least recently used entries as needed.
+* 0 disables the cache.
+*/
+void SerialCache_SetMaxMemory(size_t bytes);
+
+/** Reports the number of cached values, the memory they take, and the hits and misses so far */
+void SerialCache_Stats(size_t *count, size_t *memory, uint64_t *hits, uint64_t *misses);
+
+#endif
@@ -0,0 +1,79 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+static StatsCounters _counters[STATS_NPHASES];
+static uint64_t _depths[STATS_DEPTH_BUCKETS];
+static uint64_t _defragPending = 0;
+
+static const char *_names[STATS_NPHASES] = {"parse", "path", "serialize", "rdb-load", "rdb-save",
+                                             "defrag", "copy"};
+
+#define __stats_add(x, v) __atomic_fetch_add(&(x), (v), __ATOMIC_RELAXED)
+#define __stats_load(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+
+uint64_t Stats_Begin(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void Stats_End(StatsPhase phase, uint64_t begin, size_t bytes, size_t nodes, int error) {
+    StatsCounters *c = &_counters[phase];
+    uint64_t usecs = (Stats_Begin() - begin) / 1000;
+    int bucket = usecs ? 64 - __builtin_clzll(usecs) : 0;
+
+    __stats_add(c->calls, 1);
+    if (error) __stats_add(c->errors, 1);
+    __stats_add(c->bytes, bytes);
+    __stats_add(c->nodes, nodes);
+    __stats_add(c->usecs, usecs);
+    __stats_add(c->latency[bucket < STATS_LATENCY_BUCKETS ? bucket : STATS_LATENCY_BUCKETS - 1], 1);
+}
+
+void Stats_PathDepth(size_t depth) {
+    __stats_add(_depths[depth < STATS_DEPTH_BUCKETS ? depth : STATS_DEPTH_BUCKETS - 1], 1);
+}
+
+void Stats_Get(StatsPhase phase, StatsCounters *c) {
+    StatsCounters *s = &_counters[phase];
+    c->calls = __stats_load(s->calls);
+    c->errors = __stats_load(s->errors);
+    c->bytes = __stats_load(s->bytes);
+    c->nodes = __stats_load(s->nodes);
+    c->usecs = __stats_load(s->usecs);
+    for (int i = 0; i < STATS_LATENCY_BUCKETS; i++) c->latency[i] = __stats_load(s->latency[i]);
+}
+
+void Stats_GetPathDepths(uint64_t depths[STATS_DEPTH_BUCKETS]) {
+    for (int i = 0; i < STATS_DEPTH_BUCKETS; i++) depths[i] = __stats_load(_depths[i]);
+}
+
+void Stats_DefragPending(int delta) { __stats_add(_defragPending, (uint64_t)(int64_t)delta); }
+
+uint64_t Stats_GetDefragPending(void) { return __stats_load(_defragPending); }
+
+void Stats_Reset(void) {
+    // calls that end while the counters are zeroed may be partly counted, which is fine for stats
+    memset(_counters, 0, sizeof(_counters));
+    memset(_depths, 0, sizeof(_depths));
+}
+
+const char *Stats_PhaseName(StatsPhase phase) { return _names[phase]; }
@@ -0,0 +1,86 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef REDIS_MODULE_TARGET
+#include <alloc.h>
+#endif
+
+/**
+* Process-wide counters of where the time goes: the calls of every phase of the work, e.g. parsing
+* JSON, with their bytes, nodes and total time, and a histogram of their latencies. The counters
+* are updated atomically, as threads serialize values too, and are cheap enough to always be on.
+*/
+
+typedef enum {
+    STATS_PARSE,      // CreateNodeFromJSON, the bytes and nodes are the input and what it builds
+    STATS_PATH,       // path lookups, the bytes are the path's
+    STATS_SERIALIZE,  // SerializeNodeToJSON, the bytes are its output
+    STATS_RDB_LOAD,   // documents loaded from RDB, the bytes are their encodings
+    STATS_RDB_SAVE,   // documents saved to RDB, the bytes are their encodings
+    STATS_DEFRAG,     // documents defragmented, the bytes and nodes are what was moved and walked
+    STATS_COPY,       // copies of shared nodes before writes, the nodes are the copies
+    STATS_NPHASES
+} StatsPhase;
+
+/* Latency bucket i counts the calls that took under 2^i microseconds, the last one the rest */
+#define STATS_LATENCY_BUCKETS 16
+/* Depth bucket i counts the paths of i levels, the last one of that many levels or more */
+#define STATS_DEPTH_BUCKETS 16
+
+typedef struct {
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t bytes;
+    uint64_t nodes;
+    uint64_t usecs;  // the total time of the calls in microseconds
+    uint64_t latency[STATS_LATENCY_BUCKETS];
+} StatsCounters;
+
+/** Returns the time that a phase begins at, to be passed to Stats_End */
+uint64_t Stats_Begin(void);
+
+/** Counts a call of a phase that began at begin, and its bytes and nodes */
+void Stats_End(StatsPhase phase, uint64_t begin, size_t bytes, size_t nodes, int error);
+
+/** Counts a path's depth */
+void Stats_PathDepth(size_t depth);
+
+/** Reads the counters of a phase */
+void Stats_Get(StatsPhase phase, StatsCounters *c);
+
+/** Reads the histogram of path depths */
+void Stats_GetPathDepths(uint64_t depths[STATS_DEPTH_BUCKETS]);
+
+/** Counts the documents whose defragmentation stopped to resume later, which delta adds to */
+void Stats_DefragPending(int delta);
+
+/** Reads the number of documents whose defragmentation is pending, which resetting keeps */
+uint64_t Stats_GetDefragPending(void);
+
+/** Zeroes all the counters */
+void Stats_Reset(void);
+
+/** The name of a phase, e.g. "parse" */
+const char *Stats_PhaseName(StatsPhase phase);
+
+#endif
@@ -1,10 +1,19 @@
 #include <stdio.h>
 #include "../src/json_object.h"
 
+/* Usage: json_validator [-p jsonsl|direct] filename
+*  with the direct parser, documents are also parsed by jsonsl and both trees must serialize alike,
+*  and ValidateJSON must agree, with a compact copy that parses to the same tree */
 int main(int argc, char **argv) {
- 
-    if (argc != 2) {
-        printf("usage: %s filename\n", argv[0]);
+    JSONParser parser = JSONPARSER_JSONSL;
+    int arg = 1;
+
+    if (argc == 4 && !strcmp("-p", argv[1])) {
+        parser = strcmp("direct", argv[2]) ? JSONPARSER_JSONSL : JSONPARSER_DIRECT;
+        arg = 3;
+    }
+    if (argc != arg + 1) {
+        printf("usage: %s [-p jsonsl|direct] filename\n", argv[0]);
         exit(1);
     }
 
@@ -12,7 +21,7 @@ int main(int argc, char **argv) {
     long len;
     char *json;
 
-    f = fopen(argv[1], "rb");
+    f = fopen(argv[arg], "rb");
     fseek(f, 0, SEEK_END);
     len = ftell(f);
     fseek(f, 0, SEEK_SET);
@@ -23,11 +32,41 @@ int main(int argc, char **argv) {
 
     Node *n = NULL;
     char *err = NULL;
-    int ret = CreateNodeFromJSON(json, len, &n, &err);
+    int ret = CreateNodeFromJSONWith(parser, json, len, &n, &err);
 
     if (ret || err) {
         ret = 1;
         printf("-%s\n", err ? err : "ERR unknown");
+        // succeeds, so that the tests of invalid documents, which are expected to fail, don't
+        if (JSONPARSER_DIRECT == parser && JSONOBJECT_OK == ValidateJSON(json, len, NULL, NULL)) {
+            ret = 0;
+            printf("-ERR the validator disagrees\n");
+        }
+    } else if (JSONPARSER_DIRECT == parser) {
+        Node *expected = NULL, *compacted = NULL;
+        JSONSerializeOpt opt = {"", "", ""};
+        sds s1 = sdsempty(), s2 = sdsempty(), s3 = sdsempty(), compact = sdsempty();
+        CreateNodeFromJSONWith(JSONPARSER_JSONSL, json, len, &expected, NULL);
+        SerializeNodeToJSON(n, &opt, &s1);
+        SerializeNodeToJSON(expected, &opt, &s2);
+        if (JSONOBJECT_OK == ValidateJSON(json, len, &compact, NULL) &&
+            JSONOBJECT_OK == CreateNodeFromJSON(compact, sdslen(compact), &compacted, NULL))
+            SerializeNodeToJSON(compacted, &opt, &s3);
+        if (sdscmp(s1, s2)) {
+            ret = 1;
+            printf("-ERR the parsers disagree\n");
+        } else if (sdscmp(s2, s3)) {
+            ret = 1;
+            printf("-ERR the validator disagrees\n");
+        } else {
+            printf("+OK\n");
+        }
+        sdsfree(s1);
+        sdsfree(s2);
+        sdsfree(s3);
+        sdsfree(compact);
+        if (expected) Node_Free(expected);
+        if (compacted) Node_Free(compacted);
     } else {
         printf("+OK\n");
     }
@@ -3,6 +3,7 @@ import redis
 import unittest
 import json
 import os
+import time
 
 # Path to module
 module_path = os.environ['REDIS_MODULE_PATH']
@@ -169,6 +170,75 @@ class ReJSONTestCase(ModuleTestCase(module_path=module_path, redis_path=redis_pa
             with self.assertRaises(redis.exceptions.ResponseError) as cm:
                 r.execute_command('JSON.SET', 'test', '.foo[1]', 'null', 'XX')
 
+    def testSetParallelParse(self):
+        """Test JSON.SET's values that are parsed on threads while the client is blocked"""
+
+        doc = {'a': [{'n': i, 's': 'x' * 10} for i in range(1000)], 'b': {'c': [1, 2, 3]}}
+        big = json.dumps(doc)
+        with self.redis() as r:
+            r.delete('test')
+            conf = r.execute_command('JSON.CONFIG', 'GET', 'PARALLEL_PARSE_*')
+            self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'PARALLEL_PARSE_THREADS', '4'))
+            self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'PARALLEL_PARSE_SIZE', '1'))
+            try:
+                # the root and a path
+                self.assertOk(r.execute_command('JSON.SET', 'test', '.', big))
+                self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test')))
+                self.assertOk(r.execute_command('JSON.SET', 'test', 'b', '{"c":[4,5],"d":{}}'))
+                self.assertEqual({'c': [4, 5], 'd': {}},
+                                 json.loads(r.execute_command('JSON.GET', 'test', 'b')))
+
+                # NX and XX are checked once the value is parsed
+                self.assertIsNone(r.execute_command('JSON.SET', 'test', '.', big, 'NX'))
+                self.assertIsNone(r.execute_command('JSON.SET', 'test', 'e', '[1]', 'XX'))
+                self.assertOk(r.execute_command('JSON.SET', 'test', 'e', '[1]', 'NX'))
+                self.assertIsNone(r.execute_command('JSON.SET', 'test', 'e', '[2]', 'NX'))
+                self.assertOk(r.execute_command('JSON.SET', 'test', 'e', '[2]', 'XX'))
+                self.assertEqual('[2]', r.execute_command('JSON.GET', 'test', 'e'))
+                r.delete('test')
+                self.assertIsNone(r.execute_command('JSON.SET', 'test', '.', big, 'XX'))
+                self.assertNotExists(r, 'test')
+                self.assertOk(r.execute_command('JSON.SET', 'test', '.', big, 'NX'))
+                self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test')))
+
+                # invalid JSON replies with the parser's error and leaves the document as it was
+                for bad in ('[1,2,', '{"a":1,}', '[1]x'):
+                    with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                        r.execute_command('JSON.SET', 'test', '.', bad)
+                    with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                        r.execute_command('JSON.SET', 'test', 'b', bad)
+                self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test')))
+
+                # the key becomes a string while the client is blocked. The server sleeps while
+                # both commands are sent, so they're read before the blocked client is replied to,
+                # and whichever of them runs first the JSON.SET fails.
+                sleeper = r.connection_pool.get_connection('DEBUG')
+                setter = r.connection_pool.get_connection('JSON.SET')
+                try:
+                    sleeper.send_command('DEBUG', 'SLEEP', '0.5')
+                    time.sleep(0.1)
+                    setter.send_command('JSON.SET', 'test', '.', big)
+                    time.sleep(0.1)
+                    self.assertTrue(r.execute_command('SET', 'test', 'str'))
+                    with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                        setter.read_response()
+                    self.assertIn('WRONGTYPE', str(cm.exception))
+                    sleeper.read_response()
+                finally:
+                    r.connection_pool.release(sleeper)
+                    r.connection_pool.release(setter)
+                self.assertEqual('str', r.get('test'))
+                r.delete('test')
+
+                # transactions don't block, and parse on the threads while the server waits
+                p = r.pipeline(transaction=True)
+                p.execute_command('JSON.SET', 'test', '.', big)
+                p.execute_command('JSON.GET', 'test', 'b.c')
+                self.assertEqual(['OK', '[1,2,3]'], p.execute())
+            finally:
+                for name, val in zip(conf[::2], conf[1::2]):
+                    self.assertOk(r.execute_command('JSON.CONFIG', 'SET', name, val))
+
     def testGetNonExistantPathsFromBasicDocumentShouldFail(self):
         """Test failure of getting non-existing values"""
 
@@ -209,6 +279,366 @@ class ReJSONTestCase(ModuleTestCase(module_path=module_path, redis_path=redis_pa
             data = json.loads(r.execute_command('JSON.GET', 'test', *docs['values'].keys()))
             self.assertDictEqual(data, docs['values'])
 
+    def testGetSharedPrefixPaths(self):
+        """Test JSON.GET with paths that share prefixes, that are repeated or that fail"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.',
+                                            '{"a":{"b":{"c":[1,2.5,"x"],"d":null}},"e":[]}'))
+            paths = ['.a.b.c[0]', '.e', '.a.b.d', 'a.b.c[-1]', '.a.b.c[0]', '.a.b']
+            data = json.loads(r.execute_command('JSON.GET', 'test', *paths))
+            self.assertEqual(data, {'.a.b.c[0]': 1, '.e': [], '.a.b.d': None, 'a.b.c[-1]': 'x',
+                                    '.a.b': {'c': [1, 2.5, 'x'], 'd': None}})
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.GET', 'test', '.a.b.c[0]', '.a.b.c[3]')
+
+    def testGetMultiValuePaths(self):
+        """Test JSON.GET with slices, wildcards and recursive descent"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = {'items': [{'price': 1, 'n': 'a'}, {'price': 2.5}, {'n': 'c', 'x': {'price': 9}}],
+                   'nums': [1, 2, 3, 4, 5, 6]}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            tests = [('.items[0:2].price', [1, 2.5]), ('.items[*].n', ['a', 'c']),
+                     ('.nums[-2:]', [5, 6]), ('.nums[::2]', [1, 3, 5]), ('.nums[4:1]', []),
+                     ('..price', [1, 2.5, 9]), ('.items[2].*', ['c', {'price': 9}]),
+                     ('.nothing[*]', [])]
+            for p, v in tests:
+                self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test', p)), v, p)
+
+            # with other paths, and from multiple keys
+            data = json.loads(r.execute_command('JSON.GET', 'test', '.nums[0]', '.nums[:2]'))
+            self.assertEqual(data, {'.nums[0]': 1, '.nums[:2]': [1, 2]})
+            raw = r.execute_command('JSON.MGET', 'test', 'foo', '.nums[1:3]')
+            self.assertEqual(json.loads(raw[0]), [2, 3])
+            self.assertEqual(raw[1], None)
+
+            # other commands can't change multiple values
+            for p in ['.nums[:2]', '.items[*].price', '..price']:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON.SET', 'test', p, '0')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.GET', 'test', '.nums[::0]')
+
+    def testFilterPaths(self):
+        """Test filter expressions with JSON.GET, JSON.DEL and JSON.NUMINCRBY"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = {'orders': [{'id': 1, 'status': 'open', 'price': 20},
+                              {'id': 2, 'status': 'closed', 'price': 30, 'tags': ['x']},
+                              {'id': 3, 'status': 'open', 'price': 5}]}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            tests = [('.orders[?(@.status=="open")].id', [1, 3]),
+                     ('.orders[?(@.status == "open" && @.price < 10)].id', [3]),
+                     ('.orders[?(@.price >= 30 || @.id == 1)].id', [1, 2]),
+                     ('.orders[?(@.tags)].id', [2]), ('.orders[?(!(@.price > 1))]', [])]
+            for p, v in tests:
+                self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test', p)), v, p)
+
+            raw = r.execute_command('JSON.NUMINCRBY', 'test', '.orders[?(@.status=="open")].price', 1)
+            self.assertEqual(json.loads(raw), [21, 6])
+            self.assertEqual(r.execute_command('JSON.DEL', 'test', '.orders[?(@.price > 20)]'), 2)
+            data = json.loads(r.execute_command('JSON.GET', 'test', '.orders[*].id'))
+            self.assertEqual(data, [3])
+
+            # changes can't be made through a recursive descent, and filters must be valid
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.DEL', 'test', '..price')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.GET', 'test', '.orders[?(@.id = 1)]')
+
+    def testGetCachedValues(self):
+        """Test that JSON.GET's cached replies follow the document's changes"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"a":[1],"b":"x","n":1}'))
+            stats = r.execute_command('JSON.DEBUG', 'CACHE')
+            hits = stats[stats.index('serialized-hits') + 1]
+            for _ in range(3):
+                self.assertEqual(r.execute_command('JSON.GET', 'test', 'a'), '[1]')
+            stats = r.execute_command('JSON.DEBUG', 'CACHE')
+            self.assertEqual(stats[stats.index('serialized-hits') + 1], hits + 2)
+            # the formatting options are a part of the cache key
+            self.assertEqual(r.execute_command('JSON.GET', 'test', 'NEWLINE', '\n', 'a'),
+                             '[\n1\n]')
+
+            r.execute_command('JSON.ARRAPPEND', 'test', 'a', '2')
+            self.assertEqual(r.execute_command('JSON.GET', 'test', 'a'), '[1,2]')
+            r.execute_command('JSON.ARRPOP', 'test', 'a')
+            self.assertEqual(r.execute_command('JSON.GET', 'test', 'a'), '[1]')
+            r.execute_command('JSON.STRAPPEND', 'test', 'b', '"y"')
+            self.assertEqual(r.execute_command('JSON.GET', 'test', 'b'), '"xy"')
+            r.execute_command('JSON.NUMINCRBY', 'test', 'n', 1)
+            self.assertEqual(r.execute_command('JSON.GET', 'test', 'n'), '2')
+            self.assertOk(r.execute_command('JSON.SET', 'test', 'b', '"z"'))
+            self.assertEqual(r.execute_command('JSON.GET', 'test', 'b'), '"z"')
+            self.assertEqual(r.execute_command('JSON.DEL', 'test', 'b'), 1)
+            self.assertEqual(r.execute_command('JSON.GET', 'test'), '{"a":[1],"n":2}')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '[]'))
+            self.assertEqual(r.execute_command('JSON.GET', 'test'), '[]')
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{}'))
+            self.assertEqual(r.execute_command('JSON.GET', 'test'), '{}')
+
+    def testGetChunkedReplies(self):
+        """Test JSON.GET's replies in chunks"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(docs['basic'])))
+            whole = r.execute_command('JSON.GET', 'test')
+            chunks = r.execute_command('JSON.GET', 'test', 'CHUNKS', 16)
+            self.assertGreater(len(chunks), 1)
+            self.assertTrue(all(len(c) >= 16 for c in chunks[:-1]))
+            self.assertEqual(''.join(chunks), whole)
+            self.assertEqual(r.execute_command('JSON.GET', 'test', 'CHUNKS', 1000, 'arr[*]', 'int'),
+                             [r.execute_command('JSON.GET', 'test', 'arr[*]', 'int')])
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.GET', 'test', 'CHUNKS', 0)
+
+    def testGetAsyncReplies(self):
+        """Test JSON.GET's replies that are serialized on a thread"""
+
+        doc = {'a': [{'n': i, 's': 'x' * 10} for i in range(1000)], 'b': {'c': [1, 2, 3]}}
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'ASYNC_GET_MEMORY', '1'))
+            try:
+                # the root and values below it, and the scalars that aren't blocked for
+                self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test')))
+                self.assertEqual(doc['a'], json.loads(r.execute_command('JSON.GET', 'test', 'a')))
+                self.assertEqual('[1,2,3]', r.execute_command('JSON.GET', 'test', 'b.c'))
+                self.assertEqual('1', r.execute_command('JSON.GET', 'test', 'b.c[0]'))
+                pretty = r.execute_command('JSON.GET', 'test', 'INDENT', ' ', 'NEWLINE', '\n', 'b')
+                self.assertIn('\n', pretty)
+                self.assertEqual(doc['b'], json.loads(pretty))
+
+                # a write while the client is blocked replies with either document as a whole, and
+                # copies only the nodes on its way if the snapshot still shares them
+                self.assertOk(r.execute_command('JSON.STATS', 'RESET'))
+                conn = r.connection_pool.get_connection('JSON.GET')
+                try:
+                    conn.send_command('JSON.GET', 'test')
+                    self.assertOk(r.execute_command('JSON.SET', 'test', 'a[0].n', '-1'))
+                    self.assertEqual(1, r.execute_command('JSON.DEL', 'test', 'b'))
+                    reply = json.loads(conn.read_response())
+                finally:
+                    r.connection_pool.release(conn)
+                stats = r.execute_command('JSON.STATS')
+                stats = dict(zip(stats[::2], stats[1::2]))
+                copied = dict(zip(stats['copy'][::2], stats['copy'][1::2]))
+                self.assertLessEqual(copied['calls'], 2)
+                self.assertLess(copied['nodes'], 30)
+                self.assertIn(reply['a'][0]['n'], (0, -1))
+                self.assertEqual(reply['a'][1:], doc['a'][1:])
+                changed = dict(a=[dict(doc['a'][0], n=-1)] + doc['a'][1:])
+                self.assertEqual(changed, json.loads(r.execute_command('JSON.GET', 'test')))
+                self.assertEqual('-1', r.execute_command('JSON.GET', 'test', 'a[0].n'))
+            finally:
+                self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'ASYNC_GET_MEMORY', '0'))
+
+    def testDebugMemoryFollowsChanges(self):
+        """Test that the memory usage that's measured once per change is up to date"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"a":[1,2,3],"b":"x"}'))
+            r.execute_command('JSON.STRAPPEND', 'test', 'b', '"y"')
+            m1 = r.execute_command('JSON.DEBUG', 'MEMORY', 'test')
+            self.assertEqual(r.execute_command('JSON.DEBUG', 'MEMORY', 'test'), m1)
+            r.execute_command('JSON.STRAPPEND', 'test', 'b', json.dumps('y' * 1000))
+            m2 = r.execute_command('JSON.DEBUG', 'MEMORY', 'test')
+            self.assertGreaterEqual(m2, m1 + 1000)
+            self.assertEqual(r.execute_command('JSON.DEL', 'test', 'b'), 1)
+            self.assertLess(r.execute_command('JSON.DEBUG', 'MEMORY', 'test'), m1)
+            self.assertLess(r.execute_command('JSON.DEBUG', 'MEMORY', 'test', 'a'),
+                            r.execute_command('JSON.DEBUG', 'MEMORY', 'test'))
+
+    def testDebugMemoryDetails(self):
+        """Test that JSON.DEBUG MEMORY reports the details of the memory usage"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"a":[1,2,3],"b":"x"}'))
+            details = r.execute_command('JSON.DEBUG', 'MEMORY', 'test', 'a', 'DETAILS')
+            details = dict(zip(details[::2], details[1::2]))
+            self.assertEqual(details['memory'],
+                             r.execute_command('JSON.DEBUG', 'MEMORY', 'test', 'a'))
+            self.assertEqual(details['logical-memory'], details['memory'])
+            self.assertEqual(details['compressed-strings'], 0)
+            self.assertEqual(details['cold-memory'], 0)
+            self.assertGreaterEqual(details['allocated-memory'], details['memory'])
+
+            # the whole document's allocations include its arena's blocks
+            details = r.execute_command('JSON.DEBUG', 'MEMORY', 'test', '.', 'DETAILS')
+            details = dict(zip(details[::2], details[1::2]))
+            self.assertGreaterEqual(details['allocated-memory'], 4096)
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.DEBUG', 'MEMORY', 'test', '.', 'SIZES')
+
+    def testDebugProfile(self):
+        """Test that JSON.DEBUG PROFILE reports the shape of a value"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.',
+                                            '{"a":[1,2,3],"b":"xyz","c":{"d":[null,true,1.5]}}'))
+            profile = r.execute_command('JSON.DEBUG', 'PROFILE', 'test')
+            profile = dict(zip(profile[::2], profile[1::2]))
+            self.assertEqual(profile['dicts'], 2)
+            self.assertEqual(profile['arrays'], 2)
+            self.assertEqual(profile['packed-arrays'], 1)
+            self.assertEqual(profile['integers'], 3)
+            self.assertEqual(profile['strings'], 1)
+            self.assertEqual(profile['max-depth'], 3)
+            self.assertEqual(profile['string-lengths'][2], 1)
+            self.assertEqual(profile['array-lengths'][2], 2)
+            self.assertEqual(profile['depths'][:4], [1, 3, 4, 3])
+            profile = r.execute_command('JSON.DEBUG', 'PROFILE', 'test', '.c.d')
+            profile = dict(zip(profile[::2], profile[1::2]))
+            self.assertEqual(profile['arrays'], 1)
+            self.assertEqual(profile['dicts'], 0)
+            self.assertIsNone(r.execute_command('JSON.DEBUG', 'PROFILE', 'missing'))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.DEBUG', 'PROFILE', 'test', '.x')
+
+    def testPackedArrayLookups(self):
+        """Test that reading items of packed arrays keeps them packed, and writing unpacks them"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"a":[1,2,3],"b":[1.5,2.5]}'))
+            self.assertEqual(r.execute_command('JSON.GET', 'test', '.a[1]'), '2')
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test', '.a[-1]', '.b[0]')),
+                             {'.a[-1]': 3, '.b[0]': 1.5})
+            self.assertEqual(r.execute_command('JSON.TYPE', 'test', '.b[1]'), 'number')
+            self.assertOk(r.execute_command('JSON.COPY', 'test', 'test', '.a[0]', '.c'))
+            profile = r.execute_command('JSON.DEBUG', 'PROFILE', 'test')
+            profile = dict(zip(profile[::2], profile[1::2]))
+            self.assertEqual(profile['packed-arrays'], 2)
+
+            self.assertEqual(r.execute_command('JSON.NUMINCRBY', 'test', '.a[1]', 10), '12')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.b[0]', '"x"'))
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test')),
+                             {'a': [1, 12, 3], 'b': ['x', 2.5], 'c': 1})
+            profile = r.execute_command('JSON.DEBUG', 'PROFILE', 'test')
+            profile = dict(zip(profile[::2], profile[1::2]))
+            self.assertEqual(profile['packed-arrays'], 0)
+
+    def testDebugCompact(self):
+        """Test that JSON.DEBUG COMPACT reclaims the slack of a document and keeps its value"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"a":[],"b":{}}'))
+            for i in range(1000):
+                r.execute_command('JSON.ARRAPPEND', 'test', '.a', '"x{}"'.format(i))
+                r.execute_command('JSON.SET', 'test', '.b.k{}'.format(i), i)
+            r.execute_command('JSON.ARRTRIM', 'test', '.a', 0, 600)
+            value = r.execute_command('JSON.GET', 'test')
+            before = r.execute_command('JSON.DEBUG', 'MEMORY', 'test')
+            self.assertGreater(r.execute_command('JSON.DEBUG', 'COMPACT', 'test'), 0)
+            self.assertLess(r.execute_command('JSON.DEBUG', 'MEMORY', 'test'), before)
+            self.assertEqual(r.execute_command('JSON.GET', 'test'), value)
+            self.assertIsNone(r.execute_command('JSON.DEBUG', 'COMPACT', 'missing'))
+
+    def testStatsCommand(self):
+        """Test that JSON.STATS counts the work of the commands"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.STATS', 'RESET'))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"a":{"b":[1,2,3]}}'))
+            self.assertEqual(r.execute_command('JSON.GET', 'test', '.a.b'), '[1,2,3]')
+            stats = r.execute_command('JSON.STATS')
+            stats = dict(zip(stats[::2], stats[1::2]))
+            self.assertEqual(sorted(stats.keys()),
+                             ['copy', 'defrag', 'defrag-pending', 'parse', 'path', 'path-depth',
+                              'rdb-load', 'rdb-save', 'serialize'])
+            self.assertEqual(stats['defrag-pending'], 0)
+            parse = dict(zip(stats['parse'][::2], stats['parse'][1::2]))
+            self.assertEqual(parse['calls'], 1)
+            self.assertEqual(parse['errors'], 0)
+            self.assertEqual(parse['bytes'], len('{"a":{"b":[1,2,3]}}'))
+            self.assertEqual(sum(parse['latency']), 1)
+            self.assertGreater(stats['path-depth'][2], 0)
+            info = r.execute_command('JSON.STATS', 'INFO')
+            self.assertTrue(info.startswith('# ReJSON'))
+            self.assertTrue('rejson_parse:calls=1,' in info)
+            self.assertTrue('rejson_defrag_pending:0' in info)
+            self.assertOk(r.execute_command('JSON.STATS', 'RESET'))
+            stats = r.execute_command('JSON.STATS')
+            self.assertEqual(stats[1][1], 0)
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.STATS', 'FOO')
+
+    def testMSetCommand(self):
+        """Test REJSON.MSET command"""
+
+        with self.redis() as r:
+            r.delete('test')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.MSET', 'test', '.foo', '1')
+            self.assertOk(r.execute_command('JSON.MSET', 'test', '.', '{"foo":{"x":1},"bar":[1,2]}',
+                                            '.foo.y', '2', '.foo.x', '"x"', '.bar[-1]', '{"z":0}'))
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test')),
+                             {'foo': {'x': 'x', 'y': 2}, 'bar': [1, {'z': 0}]})
+
+            # nothing is set when a path or a value is invalid
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.MSET', 'test', '.baz', '1', '.bar[', '2')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.MSET', 'test', '.baz', '1', '.bar', '{')
+            self.assertIsNone(r.execute_command('JSON.TYPE', 'test', '.baz'))
+
+            # the pairs before a path error remain set
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.MSET', 'test', '.baz', '1', '.qux.a', '2', '.baz', '3')
+            self.assertEqual(r.execute_command('JSON.GET', 'test', '.baz'), '1')
+
+            # pairs can refer to the values that previous pairs had set
+            self.assertOk(r.execute_command('JSON.MSET', 'test', '.qux', '{}', '.qux.a', '[0]',
+                                            '.qux.a[0]', '5'))
+            self.assertEqual(r.execute_command('JSON.GET', 'test', '.qux'), '{"a":[5]}')
+
+    def testSetChunkCommand(self):
+        """Test REJSON.SETCHUNK command"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = json.dumps(docs['basic'])
+            chunks = [doc[i:i + 7] for i in range(0, len(doc), 7)]
+            for i, chunk in enumerate(chunks[:-1]):
+                self.assertOk(r.execute_command('JSON.SETCHUNK', 'test', '.', i, chunk))
+            self.assertOk(r.execute_command('JSON.SETCHUNK', 'test', '.', len(chunks) - 1,
+                                            chunks[-1], 'COMMIT'))
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test')), docs['basic'])
+
+            # chunks must follow each other with the same path
+            self.assertOk(r.execute_command('JSON.SETCHUNK', 'test', '.foo', 0, '[1,'))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SETCHUNK', 'test', '.foo', 2, '2]')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SETCHUNK', 'test', '.bar', 1, '2]')
+            self.assertIsNone(r.execute_command('JSON.SETCHUNK', 'test', '.foo', 1, '2]', 'COMMIT',
+                                                'XX'))
+            self.assertIsNone(r.execute_command('JSON.TYPE', 'test', '.foo'))
+
+            # an upload with an error is dropped
+            self.assertOk(r.execute_command('JSON.SETCHUNK', 'test', '.foo', 0, '{"a":'))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SETCHUNK', 'test', '.foo', 1, '}', 'COMMIT')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SETCHUNK', 'test', '.foo', 1, '1}', 'COMMIT')
+            self.assertOk(r.execute_command('JSON.SETCHUNK', 'test', '.foo', 0, '"scal'))
+            self.assertOk(r.execute_command('JSON.SETCHUNK', 'test', '.foo', 1, 'ar"', 'COMMIT'))
+            self.assertEqual(r.execute_command('JSON.GET', 'test', '.foo'), '"scalar"')
+
     def testMgetCommand(self):
         """Test REJSON.MGET command"""
 
@@ -235,6 +665,68 @@ class ReJSONTestCase(ModuleTestCase(module_path=module_path, redis_path=redis_pa
             self.assertTrue(json.loads(raw[1]))
             self.assertEqual(raw[2], None)
 
+    def testMgetArrayCommand(self):
+        """Test REJSON.MGETARRAY command"""
+
+        with self.redis() as r:
+            r.delete('test', 'foo')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"a":{"b":[1,"s",null]}}'))
+            self.assertOk(r.execute_command('JSON.SET', 'foo', '.', '{"a":3}'))
+            raw = r.execute_command('JSON.MGETARRAY', 'test', 'foo', 'bar', '.a')
+            self.assertListEqual(json.loads(raw), [{'b': [1, 's', None]}, 3, None])
+
+            # the values are the ones JSON.MGET returns, after a change too
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.a', '"new"'))
+            raw = r.execute_command('JSON.MGETARRAY', 'test', 'foo', '.a')
+            self.assertEqual(raw, '[{}]'.format(','.join(r.execute_command('JSON.MGET', 'test',
+                                                                            'foo', '.a'))))
+            self.assertEqual(r.execute_command('JSON.MGETARRAY', 'test', '.b'), '[null]')
+
+    def testScanCommand(self):
+        """Test JSON.SCAN command"""
+
+        with self.redis() as r:
+            r.flushdb()
+            for d in range(0, 20):
+                doc = {'name': 'n{}'.format(d), 'tags': ['t'] * (d % 3)}
+                if d % 2:
+                    doc['score'] = d
+                self.assertOk(r.execute_command('JSON.SET', 'scan:{}'.format(d), '.',
+                                                json.dumps(doc)))
+            r.set('scan:string', 'x')
+            self.assertOk(r.execute_command('JSON.SET', 'other', '.', '{"score":1}'))
+
+            # iterate to the end, collecting the projected values of every document
+            found, cursor = {}, '0'
+            while True:
+                cursor, items = r.execute_command('JSON.SCAN', cursor, 'MATCH', 'scan:*',
+                                                  'COUNT', '5', 'PATH', 'score', 'tags[*]')
+                for key, values in zip(items[::2], items[1::2]):
+                    self.assertNotIn(key, found)
+                    found[key] = values
+                if '0' == cursor:
+                    break
+
+            # documents without any of the paths are skipped, missing paths are nulls
+            self.assertEqual(sorted('scan:{}'.format(d) for d in range(0, 20) if d % 2 or d % 3),
+                             sorted(found.keys()))
+            self.assertEqual(['3', None], found['scan:3'])
+            self.assertEqual([None, '["t","t"]'], found['scan:2'])
+            self.assertEqual(['5', '["t","t"]'], found['scan:5'])
+
+            # the root is the default path
+            cursor, items = r.execute_command('JSON.SCAN', '0', 'MATCH', 'other', 'COUNT', '1000')
+            self.assertEqual(['other', ['{"score":1}']], items)
+
+            with self.assertRaises(redis.exceptions.ResponseError):
+                r.execute_command('JSON.SCAN', '0', 'COUNT', '0')
+            with self.assertRaises(redis.exceptions.ResponseError):
+                r.execute_command('JSON.SCAN', '0', 'PATH')
+            with self.assertRaises(redis.exceptions.ResponseError):
+                r.execute_command('JSON.SCAN', '0', 'PATH', '.[')
+            with self.assertRaises(redis.exceptions.ResponseError):
+                r.execute_command('JSON.SCAN', 'nocursor')
+
     def testDelCommand(self):
         """Test REJSON.DEL command"""
 
@@ -271,6 +763,107 @@ class ReJSONTestCase(ModuleTestCase(module_path=module_path, redis_path=redis_pa
             self.assertEqual(r.execute_command('JSON.DEL', 'test', '.'), 1)
             self.assertIsNone(r.execute_command('JSON.GET', 'test'))
 
+    def testCopyCommand(self):
+        """Test JSON.COPY command"""
+
+        with self.redis() as r:
+            r.delete('test', 'copy')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(docs['basic'])))
+            self.assertEqual(r.execute_command('JSON.COPY', 'test', 'copy'), 1)
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'copy')), docs['basic'])
+
+            # the documents are independent once copied
+            self.assertEqual(r.execute_command('JSON.ARRAPPEND', 'copy', '.arr', '42'), 7)
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.dict.new_child_1', '"new"'))
+            self.assertEqual(r.execute_command('JSON.ARRLEN', 'test', '.arr'), 6)
+            self.assertIsNone(r.execute_command('JSON.TYPE', 'copy', '.dict.new_child_1'))
+            r.delete('test')
+            self.assertEqual(r.execute_command('JSON.GET', 'copy', '.arr[-1]'), '42')
+
+            # an existing destination is only replaced when asked to
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '[1]'))
+            self.assertEqual(r.execute_command('JSON.COPY', 'test', 'copy'), 0)
+            self.assertEqual(r.execute_command('JSON.COPY', 'test', 'copy', 'REPLACE'), 1)
+            self.assertEqual(r.execute_command('JSON.GET', 'copy'), '[1]')
+            self.assertEqual(r.execute_command('JSON.COPY', 'missing', 'copy'), 0)
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.COPY', 'test', 'test')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.COPY', 'test', 'copy', 'NX')
+
+            # values are copied between paths like JSON.SET sets them
+            r.delete('test', 'copy')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(docs['basic'])))
+            self.assertOk(r.execute_command('JSON.COPY', 'test', 'copy', '.dict', '.'))
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'copy')), docs['basic']['dict'])
+            self.assertOk(r.execute_command('JSON.COPY', 'test', 'copy', '.arr', '.arr'))
+            self.assertIsNone(r.execute_command('JSON.COPY', 'test', 'copy', '.arr', '.arr', 'NX'))
+            self.assertOk(r.execute_command('JSON.COPY', 'test', 'test', '.arr', '.dict.arr'))
+            self.assertEqual(r.execute_command('JSON.ARRAPPEND', 'copy', '.arr', '42'), 7)
+            self.assertEqual(r.execute_command('JSON.ARRLEN', 'test', '.arr'), 6)
+            self.assertEqual(r.execute_command('JSON.ARRLEN', 'test', '.dict.arr'), 6)
+            self.assertIsNone(r.execute_command('JSON.COPY', 'missing', 'copy', '.', '.new'))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.COPY', 'test', 'new', '.arr', '.arr')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.COPY', 'test', 'copy', '.arr[*]', '.all')
+
+            # a write to a copy copies the nodes on its way, and the documents share the rest
+            big = {'a': {'b': [{'n': i} for i in range(1000)]}, 'c': {'d': 1}}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(big)))
+            self.assertEqual(r.execute_command('JSON.COPY', 'test', 'copy', 'REPLACE'), 1)
+            self.assertOk(r.execute_command('JSON.STATS', 'RESET'))
+            self.assertOk(r.execute_command('JSON.SET', 'copy', '.c.d', '2'))
+            self.assertOk(r.execute_command('JSON.SET', 'copy', '.a.b[500].n', '-1'))
+            self.assertEqual(r.execute_command('JSON.NUMINCRBY', 'test', '.a.b[1].n', 1), '2')
+            stats = r.execute_command('JSON.STATS')
+            stats = dict(zip(stats[::2], stats[1::2]))
+            copied = dict(zip(stats['copy'][::2], stats['copy'][1::2]))
+            self.assertEqual(copied['calls'], 3)
+            self.assertGreater(copied['nodes'], 0)
+            self.assertLess(copied['nodes'], 30)
+            self.assertEqual(r.execute_command('JSON.GET', 'test', '.c.d'), '1')
+            self.assertEqual(r.execute_command('JSON.GET', 'test', '.a.b[500].n'), '500')
+            self.assertEqual(r.execute_command('JSON.GET', 'copy', '.a.b[1].n'), '1')
+            big['c']['d'] = 2
+            big['a']['b'][500]['n'] = -1
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'copy')), big)
+            r.delete('test')
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'copy')), big)
+
+    def testFormatCommands(self):
+        """Test JSON.SET and JSON.GET with MessagePack and CBOR values"""
+
+        with self.redis() as r:
+            r.delete('test', 'copy')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(docs['basic'])))
+            for fmt in ['MSGPACK', 'CBOR']:
+                # values go back and forth without changing
+                packed = r.execute_command('JSON.GET', 'test', 'FORMAT', fmt)
+                self.assertOk(r.execute_command('JSON.SET', 'copy', '.', packed, 'FORMAT', fmt))
+                self.assertEqual(json.loads(r.execute_command('JSON.GET', 'copy')), docs['basic'])
+                packed = r.execute_command('JSON.GET', 'test', 'FORMAT', fmt, '.arr', '.dict')
+                self.assertOk(r.execute_command('JSON.SET', 'copy', '.', packed, 'FORMAT', fmt))
+                self.assertEqual(json.loads(r.execute_command('JSON.GET', 'copy', '.arr')),
+                                 docs['basic']['arr'])
+
+            # small values in both formats
+            self.assertEqual(r.execute_command('JSON.GET', 'test', 'FORMAT', 'MSGPACK', '.arr[0]'),
+                             '\x2a')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.new', '\x81\xa1a\x01',
+                                            'FORMAT', 'MSGPACK', 'NX'))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.new', '\xa1\x61a\x02', 'XX',
+                                            'FORMAT', 'CBOR'))
+            self.assertEqual(r.execute_command('JSON.GET', 'test', '.new'), '{"a":2}')
+
+            # invalid encodings and formats
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SET', 'test', '.new', '\x81\x01\x01', 'FORMAT', 'MSGPACK')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SET', 'test', '.new', '[]', 'FORMAT', 'YAML')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.GET', 'test', 'CHUNKS', '10', 'FORMAT', 'CBOR')
+
     def testObjectCRUD(self):
         """Test JSON Object CRUDness"""
         with self.redis() as r:
@@ -412,6 +1005,84 @@ class ReJSONTestCase(ModuleTestCase(module_path=module_path, redis_path=redis_pa
             self.assertEqual(r.execute_command('JSON.ARRINDEX', 'test', '.arr', 2, 3), 5)
             self.assertEqual(r.execute_command('JSON.ARRINDEX', 'test', '.arr', '[4]'), -1)
 
+    def testArrCountCommand(self):
+        """Test JSON.ARRCOUNT command"""
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.',
+                                            '{ "arr": [0, 1, 2, 3, 2, 1, 0], '
+                                            '"mix": ["foo", null, "foobar", "foo", true, null] }'))
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.arr', 0), 2)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.arr', 3), 1)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.arr', 4), 0)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.arr', 2, 3), 1)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.arr', 1, 0, -2), 1)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.arr', 1.0), 0)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.mix', '"foo"'), 2)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.mix', 'null'), 2)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.mix', 'true'), 1)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.mix', '[4]'), 0)
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.ARRCOUNT', 'test', '.', 0)
+
+    def testArrIndexUseIndex(self):
+        """Test JSON.ARRINDEX and JSON.ARRCOUNT with USEINDEX"""
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.',
+                                            '{ "ids": [1, 2, 3, 2, 1], "names": ["a", "b", "a"] }'))
+            self.assertEqual(r.execute_command('JSON.ARRINDEX', 'test', '.ids', 2, 'USEINDEX'), 1)
+            self.assertEqual(r.execute_command('JSON.ARRINDEX', 'test', '.ids', 2, 2, 'useindex'), 3)
+            self.assertEqual(r.execute_command('JSON.ARRINDEX', 'test', '.ids', 4, 'USEINDEX'), -1)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.ids', 1, 'USEINDEX'), 2)
+
+            # writes keep the index up to date
+            self.assertEqual(r.execute_command('JSON.ARRAPPEND', 'test', '.ids', 4, 1), 7)
+            self.assertEqual(r.execute_command('JSON.ARRINDEX', 'test', '.ids', 4), 5)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.ids', 1), 3)
+            self.assertEqual(r.execute_command('JSON.ARRINSERT', 'test', '.ids', 0, 4), 8)
+            self.assertEqual(r.execute_command('JSON.ARRINDEX', 'test', '.ids', 4), 0)
+            self.assertEqual(r.execute_command('JSON.ARRPOP', 'test', '.ids', 0), '4')
+            self.assertEqual(r.execute_command('JSON.ARRINDEX', 'test', '.ids', 4), 5)
+            self.assertEqual(r.execute_command('JSON.NUMINCRBY', 'test', '.ids[0]', 9), '10')
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.ids', 1), 2)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.ids', 10), 1)
+
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.names', '"a"', 'USEINDEX'), 2)
+            self.assertEqual(r.execute_command('JSON.STRAPPEND', 'test', '.names[0]', '"b"'), 2)
+            self.assertEqual(r.execute_command('JSON.ARRCOUNT', 'test', '.names', '"a"'), 1)
+            self.assertEqual(r.execute_command('JSON.ARRINDEX', 'test', '.names', '"ab"'), 0)
+
+    def testSortedArrayCommands(self):
+        """Test JSON.ARRINSORT and JSON.ARRBSEARCH commands"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"scores":[],"mixed":[]}'))
+
+            # numbers go after their equals, whatever their types
+            for v in ['5', '1', '3', '3.0', '10', '-2']:
+                r.execute_command('JSON.ARRINSORT', 'test', '.scores', v)
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test', '.scores')),
+                             [-2, 1, 3, 3.0, 5, 10])
+            self.assertEqual(r.execute_command('JSON.ARRINSORT', 'test', '.scores', '4'), 4)
+            self.assertEqual(r.execute_command('JSON.ARRBSEARCH', 'test', '.scores', '3'), 2)
+            self.assertEqual(r.execute_command('JSON.ARRBSEARCH', 'test', '.scores', '4.0'), 4)
+            self.assertEqual(r.execute_command('JSON.ARRBSEARCH', 'test', '.scores', '7'), -1)
+
+            # values of different types are ordered by their types
+            for v in ['"b"', '{"a":1}', '2', 'true', '[1]', 'null', '"a"', 'false']:
+                r.execute_command('JSON.ARRINSORT', 'test', '.mixed', v)
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test', '.mixed')),
+                             [None, False, True, 2, 'a', 'b', [1], {'a': 1}])
+            self.assertEqual(r.execute_command('JSON.ARRBSEARCH', 'test', '.mixed', '"b"'), 5)
+            self.assertEqual(r.execute_command('JSON.ARRBSEARCH', 'test', '.mixed', '[1]'), 6)
+
+            with self.assertRaises(redis.exceptions.ResponseError):
+                r.execute_command('JSON.ARRINSORT', 'test', '.', '1')
+            with self.assertRaises(redis.exceptions.ResponseError):
+                r.execute_command('JSON.ARRBSEARCH', 'test', '.scores')
+
     def testArrTrimCommand(self):
         """Test JSON.ARRTRIM command"""
 
@@ -511,6 +1182,21 @@ class ReJSONTestCase(ModuleTestCase(module_path=module_path, redis_path=redis_pa
             with self.assertRaises(redis.exceptions.ResponseError) as cm:
                 r.execute_command('JSON.OBJKEYS', 'test', '.null')
 
+            # keys by prefix are sorted, whether the object is scanned or has a tree of its keys
+            doc = {'user:{}:{}'.format(region, i): i for region in ['eu', 'us'] for i in range(1500)}
+            doc['user'] = None
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps({'big': doc})))
+            for prefix in ['user:eu:14', 'user', 'user:us:1499', 'nope', '']:
+                expected = sorted(k for k in doc if k.startswith(prefix))
+                self.assertEqual(expected, r.execute_command('JSON.OBJKEYS', 'test', '.big', 'PREFIX', prefix))
+            self.assertEqual(1, r.execute_command('JSON.DEL', 'test', '.big["user:eu:140"]'))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.big["user:eu:14x"]', '1'))
+            self.assertEqual(['user:eu:14', 'user:eu:141', 'user:eu:142', 'user:eu:143', 'user:eu:144',
+                              'user:eu:145', 'user:eu:146', 'user:eu:147', 'user:eu:148', 'user:eu:149',
+                              'user:eu:14x'],
+                             r.execute_command('JSON.OBJKEYS', 'test', '.big', 'PREFIX', 'user:eu:14'))
+            self.assertEqual(['big'], r.execute_command('JSON.OBJKEYS', 'test', 'prefix', 'b'))
+
     def testNumIncrCommand(self):
         """Test JSON.NUMINCRBY command"""
 
@@ -535,6 +1221,219 @@ class ReJSONTestCase(ModuleTestCase(module_path=module_path, redis_path=redis_pa
             self.assertEqual('1', r.execute_command('JSON.NUMINCRBY', 'num', '.', 1))
             self.assertEqual('2.5', r.execute_command('JSON.NUMINCRBY', 'num', '.', 1.5))            
 
+    def testMNumCommands(self):
+        """Test JSON.MNUMINCRBY and JSON.MNUMMULTBY commands"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"a":1,"b":[1,2.5],"c":"x"}'))
+            self.assertEqual(['3', '3', '-7'], r.execute_command('JSON.MNUMINCRBY', 'test', '.a', 2,
+                                                                 '.b[1]', .5, '.a', -10))
+            self.assertEqual(['-14', '9'], r.execute_command('JSON.MNUMMULTBY', 'test', '.a', 2,
+                                                             '.b[-1]', 3))
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test')),
+                             {'a': -14, 'b': [1, 9], 'c': 'x'})
+
+            # nothing is changed when a path or a value is invalid
+            for args in [('.a', '1', '.b', '"x"'), ('.a', '1', '$..a', '1'), ('.a', '1', '.b[', '1')]:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON.MNUMINCRBY', 'test', *args)
+            self.assertEqual('-14', r.execute_command('JSON.GET', 'test', '.a'))
+
+            # a pair with a path error stops the command, after the pairs before it
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.MNUMINCRBY', 'test', '.a', 1, '.c', 1)
+            self.assertEqual('-13', r.execute_command('JSON.GET', 'test', '.a'))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.MNUMINCRBY', 'test', '.a')
+
+    def testNumberTextCommands(self):
+        """Test that numbers keep their text until they're changed"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = '{"a":1.50,"b":1E3,"c":[1.50],"d":-0.0}'
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', doc))
+            self.assertEqual('{"a":1.50,"b":1E3,"c":[1.5],"d":-0.0}',
+                             r.execute_command('JSON.GET', 'test'))
+            self.assertEqual('1.50', r.execute_command('JSON.GET', 'test', '.a'))
+            self.assertEqual('number', r.execute_command('JSON.TYPE', 'test', '.a'))
+            self.assertEqual('2', r.execute_command('JSON.NUMINCRBY', 'test', '.a', '0.50'))
+            self.assertEqual('2', r.execute_command('JSON.GET', 'test', '.a'))
+            self.assertEqual('1E3', r.execute_command('JSON.GET', 'test', '.b'))
+
+            # the text survives a reload
+            r.execute_command('DEBUG', 'RELOAD')
+            self.assertEqual('1E3', r.execute_command('JSON.GET', 'test', '.b'))
+
+            self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'PARSE_NUMBER_TEXT', '0'))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.a', '1.50'))
+            self.assertEqual('1.5', r.execute_command('JSON.GET', 'test', '.a'))
+            self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'PARSE_NUMBER_TEXT', '1'))
+
+    def testDedup(self):
+        """Test that DEDUP makes a document's equal values share their memory"""
+
+        item = {'name': 'x' * 100, 'tags': ['a' * 50, 'b' * 50], 'n': 1.5}
+        doc = json.dumps({'items': [item] * 100, 'other': item})
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', doc))
+            full = r.execute_command('JSON.DEBUG', 'MEMORY', 'test', 'items')
+            self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'DEDUP', '1'))
+            try:
+                self.assertOk(r.execute_command('JSON.SET', 'test', '.', doc))
+                self.assertEqual(json.loads(doc), json.loads(r.execute_command('JSON.GET', 'test')))
+
+                # the items are counted once, and the other copy doesn't count at all
+                items = r.execute_command('JSON.DEBUG', 'MEMORY', 'test', 'items')
+                self.assertLess(items * 10, full)
+                self.assertEqual(r.execute_command('JSON.DEBUG', 'MEMORY', 'test', 'other'),
+                                 r.execute_command('JSON.DEBUG', 'MEMORY', 'test', 'items[0]'))
+
+                # writing to a value leaves its equals as they are
+                self.assertOk(r.execute_command('JSON.SET', 'test', 'items[3].n', '2'))
+                self.assertEqual('2', r.execute_command('JSON.GET', 'test', 'items[3].n'))
+                self.assertEqual('1.5', r.execute_command('JSON.GET', 'test', 'items[4].n'))
+                self.assertEqual('1.5', r.execute_command('JSON.GET', 'test', 'other.n'))
+
+                # compacting and reloading deduplicate the document again
+                r.execute_command('JSON.DEBUG', 'COMPACT', 'test')
+                items = r.execute_command('JSON.DEBUG', 'MEMORY', 'test', 'items')
+                self.assertLess(items * 10, full)
+                r.execute_command('DEBUG', 'RELOAD')
+                items = r.execute_command('JSON.DEBUG', 'MEMORY', 'test', 'items')
+                self.assertLess(items * 10, full)
+                self.assertEqual('2', r.execute_command('JSON.GET', 'test', 'items[3].n'))
+            finally:
+                self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'DEDUP', '0'))
+
+    def testNotifyPaths(self):
+        """Test that NOTIFY_PATHS publishes the paths that writes change"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"a":{"b":1},"c":[1,2,3]}'))
+            p = r.pubsub(ignore_subscribe_messages=True)
+            p.subscribe('__jsonpath@0__:test')
+            p.get_message(timeout=1)
+            self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'NOTIFY_PATHS', '1'))
+            try:
+                def published():
+                    m = p.get_message(timeout=1)
+                    return m['data'] if m else None
+
+                r.execute_command('JSON.NUMINCRBY', 'test', 'a.b', '1')
+                self.assertEqual('json.numincrby .a.b', published())
+                r.execute_command('JSON.ARRAPPEND', 'test', 'c', '4')
+                self.assertEqual('json.arrappend .c', published())
+
+                # negative indices are resolved before the item is deleted
+                r.execute_command('JSON.DEL', 'test', 'c[-1]')
+                self.assertEqual('json.del .c[3]', published())
+
+                # paths of multiple values are published up to their first wildcard
+                r.execute_command('JSON.NUMINCRBY', 'test', 'c[*]', '1')
+                self.assertEqual('json.numincrby .c', published())
+
+                # keys are quoted with a quote that they don't contain, so the paths parse
+                self.assertOk(r.execute_command('JSON.SET', 'test', '["q\'"]', '{"x\\"]":1}'))
+                self.assertEqual('json.set ["q\'"]', published())
+                self.assertOk(r.execute_command('JSON.SET', 'test', '["q\'"][\'x"]\']', '2'))
+                path = published()
+                self.assertEqual('json.set ["q\'"][\'x"]\']', path)
+                self.assertEqual('2', r.execute_command('JSON.GET', 'test', path.split(' ', 1)[1]))
+                self.assertOk(r.execute_command('JSON.SET', 'test', '["q\'"][\'"\']', '1'))
+                self.assertEqual('json.set ["q\'"][\'"\']', published())
+                self.assertEqual(1, r.execute_command('JSON.DEL', 'test', '["q\'"]'))
+                published()
+                self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{}'))
+                self.assertEqual('json.set .', published())
+
+                # nothing is published once it's unset
+                self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'NOTIFY_PATHS', '0'))
+                self.assertOk(r.execute_command('JSON.SET', 'test', '.', '[]'))
+                self.assertIsNone(published())
+            finally:
+                self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'NOTIFY_PATHS', '0'))
+                p.close()
+
+    def testApplyCommand(self):
+        """Test JSON._APPLY, which applies the binary encoded effects of writes"""
+
+        with self.redis() as r:
+            r.delete('test')
+            root, a = '\x07\x00', '\x07\x01\x21a'
+            self.assertOk(r.execute_command('JSON._APPLY', 'test', root, 'SET',
+                                            '\x06\x01\x01a\x07\x02\x91\x92'))
+            self.assertOk(r.execute_command('JSON._APPLY', 'test', a, 'INSERT', 1, '\x07\x01\x95'))
+            self.assertEqual('[1,5,2]', r.execute_command('JSON.GET', 'test', '.a'))
+            self.assertOk(r.execute_command('JSON._APPLY', 'test', a, 'DELRANGE', 0, 2))
+            self.assertOk(r.execute_command('JSON._APPLY', 'test', '\x07\x02\x21a\x90', 'SET',
+                                            '\x93'))
+            self.assertOk(r.execute_command('JSON._APPLY', 'test', '\x07\x01\x21b', 'SET',
+                                            '\x22hi'))
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test')),
+                             {'a': [3], 'b': 'hi'})
+
+            # effects that don't apply change nothing
+            for args in [('\x07\x02\x21x\x21y', 'SET', '\x90'), (a, 'SET', '\x07'),
+                         (a, 'DELRANGE', 0, 2), (a, 'INSERT', 2, '\x07\x01\x90'),
+                         ('\x07\x01\x21b', 'INSERT', 0, '\x07\x00'), ('\x00', 'SET', '\x90')]:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON._APPLY', 'test', *args)
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test')),
+                             {'a': [3], 'b': 'hi'})
+
+    def testMergeCommand(self):
+        """Test JSON.MERGE, which merges a JSON Merge Patch into a value"""
+
+        with self.redis() as r:
+            r.delete('test')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.MERGE', 'test', '.a', '{}')
+            self.assertOk(r.execute_command('JSON.MERGE', 'test', '.', '{"a":{"b":null,"c":1}}'))
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test')), {'a': {'c': 1}})
+            self.assertOk(r.execute_command('JSON.MERGE', 'test', '.a', '{"c":null,"d":[1]}'))
+            self.assertOk(r.execute_command('JSON.MERGE', 'test', '.e', '{"f":null}'))
+            self.assertOk(r.execute_command('JSON.MERGE', 'test', '.a.d[0]', '{"g":2}'))
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test')),
+                             {'a': {'d': [{'g': 2}]}, 'e': {}})
+            for path in ['.x.y', '..d']:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON.MERGE', 'test', path, '1')
+            self.assertOk(r.execute_command('JSON.MERGE', 'test', '.', '"s"'))
+            self.assertEqual('"s"', r.execute_command('JSON.GET', 'test'))
+
+    def testPatchCommand(self):
+        """Test JSON.PATCH, which applies a JSON Patch atomically"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"a":[1,2],"b":{"c":"d"}}'))
+            self.assertOk(r.execute_command('JSON.PATCH', 'test', json.dumps([
+                {'op': 'add', 'path': '/a/-', 'value': 3},
+                {'op': 'move', 'from': '/b/c', 'path': '/e'},
+                {'op': 'copy', 'from': '/a', 'path': '/b/a'},
+                {'op': 'replace', 'path': '/a/0', 'value': {'x~/': None}},
+                {'op': 'remove', 'path': '/a/0/x~0~1'},
+                {'op': 'test', 'path': '/e', 'value': 'd'}])))
+            doc = {'a': [{}, 2, 3], 'b': {'a': [1, 2, 3]}, 'e': 'd'}
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test')), doc)
+
+            # a patch that fails changes nothing
+            for patch in ['{}', '[{"op":"add","path":"/x"}]', '[{"op":"nop","path":""}]',
+                          '[{"op":"remove","path":"/a"},{"op":"test","path":"/e","value":1}]',
+                          '[{"op":"add","path":"/a/4","value":1}]',
+                          '[{"op":"move","from":"/b","path":"/b/c"}]']:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON.PATCH', 'test', patch)
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test')), doc)
+
+            r.delete('test')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.PATCH', 'test', '[]')
+
     def testStrCommands(self):
         """Test JSON.STRAPPEND and JSON.STRLEN commands"""
 
@@ -546,6 +1445,16 @@ class ReJSONTestCase(ModuleTestCase(module_path=module_path, redis_path=redis_pa
             self.assertEqual(6, r.execute_command('JSON.STRAPPEND', 'test', '.', '"bar"'))
             self.assertEqual('"foobar"', r.execute_command('JSON.GET', 'test', '.'))
 
+            # many appends, and a value that isn't a string
+            for i in range(1000):
+                r.execute_command('JSON.STRAPPEND', 'test', '.', '"-line"')
+            self.assertEqual(5006, r.execute_command('JSON.STRLEN', 'test', '.'))
+            self.assertEqual('foobar' + '-line' * 1000,
+                             json.loads(r.execute_command('JSON.GET', 'test')))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.STRAPPEND', 'test', '.', '1')
+            self.assertEqual(5006, r.execute_command('JSON.STRLEN', 'test', '.'))
+
     def testRespCommand(self):
         """Test JSON.RESP command"""
 
@@ -575,6 +1484,28 @@ class ReJSONTestCase(ModuleTestCase(module_path=module_path, redis_path=redis_pa
             self.assertEqual(1, resp[1])
             self.assertEqual(2, resp[2])
 
+    def testRespCompactCommand(self):
+        """Test JSON.RESP's COMPACT replies to RESP2 clients"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.',
+                                            '{"a":[1,true,false],"b":{"c":null,"d":"x"},"e":2.5}'))
+            resp = r.execute_command('JSON.RESP', 'test', 'COMPACT')
+            self.assertEqual(['a', [1, 1, 0], 'b', ['c', None, 'd', 'x'], 'e', '2.5'], resp)
+            self.assertEqual([1, 1, 0], r.execute_command('JSON.RESP', 'test', 'compact', '.a'))
+            self.assertEqual('x', r.execute_command('JSON.RESP', 'test', 'COMPACT', '.b.d'))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.e', '[]'))
+            self.assertEqual([], r.execute_command('JSON.RESP', 'test', 'COMPACT', '.e'))
+            self.assertOk(r.execute_command('JSON.ARRAPPEND', 'test', '.e', '3', '4'))
+            self.assertEqual([3, 4], r.execute_command('JSON.RESP', 'test', 'COMPACT', '.e'))
+
+            # the default replies don't change
+            resp = r.execute_command('JSON.RESP', 'test', '.a')
+            self.assertEqual(['[', 1, 'true', 'false'], resp)
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.RESP', 'test', 'COMPACT', '.a', '.b')
+
     def testAllJSONCaseFiles(self):
         """Test using all JSON test case files"""
         self.maxDiff = None
@@ -616,5 +1547,319 @@ class ReJSONTestCase(ModuleTestCase(module_path=module_path, redis_path=redis_pa
                             else:
                                 self.assertEqual(d1, d2, path)
 
+    def testIndexAndQueryCommands(self):
+        """Test JSON.INDEX and JSON.QUERY, and that indexes follow writes and reloads"""
+
+        with self.redis() as r:
+            r.flushdb()
+            for i in range(10):
+                doc = {'email': 'u{}@x.io'.format(i % 3), 'score': i * 1.5}
+                self.assertOk(r.execute_command('JSON.SET', 'u{}'.format(i), '.', json.dumps(doc)))
+            self.assertOk(r.execute_command('JSON.INDEX', 'CREATE', 'byemail', '.email', 'HASH'))
+            self.assertOk(r.execute_command('JSON.INDEX', 'CREATE', 'byscore', '.score', 'SORTED'))
+            info = r.execute_command('JSON.INDEX', 'INFO', 'byemail')
+            self.assertEqual(info, ['path', '.email', 'type', 'hash', 'docs', 10, 'values', 3])
+
+            def query(*args):
+                return sorted(r.execute_command('JSON.QUERY', *args))
+
+            self.assertEqual(query('byemail', 'EQ', '"u1@x.io"'), ['u1', 'u4', 'u7'])
+            self.assertEqual(query('byscore', 'RANGE', '3', '(6'), ['u2', 'u3'])
+            self.assertEqual(r.execute_command('JSON.QUERY', 'byscore', 'RANGE', '-inf', '+inf',
+                                               'LIMIT', 1, 2), ['u1', 'u2'])
+
+            # writes, deletions and new keys are followed
+            self.assertOk(r.execute_command('JSON.SET', 'u1', '.email', '"new@x.io"'))
+            r.execute_command('JSON.NUMINCRBY', 'u2', '.score', 100)
+            r.delete('u4')
+            self.assertOk(r.execute_command('JSON.SET', 'n', '.', '{"email":"u1@x.io","score":1}'))
+            self.assertEqual(query('byemail', 'EQ', '"u1@x.io"'), ['n', 'u7'])
+            self.assertEqual(query('byscore', 'EQ', '103'), ['u2'])
+            self.assertEqual(query('byscore', 'RANGE', '1', '1.5'), ['n', 'u1'])
+
+            # indexes are rebuilt after reloading
+            r.execute_command('DEBUG', 'RELOAD')
+            self.assertEqual(query('byemail', 'EQ', '"u1@x.io"'), ['n', 'u7'])
+            self.assertEqual(query('byscore', 'RANGE', '(100', '+inf'), ['u2'])
+
+            # restored, renamed and moved keys are followed
+            dump = r.dump('u7')
+            r.delete('u7')
+            r.restore('r7', 0, dump)
+            self.assertTrue(r.rename('n', 'renamed'))
+            self.assertEqual(query('byemail', 'EQ', '"u1@x.io"'), ['r7', 'renamed'])
+            self.assertTrue(r.move('renamed', 1))
+            self.assertEqual(query('byemail', 'EQ', '"u1@x.io"'), ['r7'])
+            r.execute_command('SELECT', 1)
+            r.delete('renamed')
+            r.execute_command('SELECT', 0)
+
+            # keys that expired don't count for LIMIT
+            self.assertEqual(query('byemail', 'EQ', '"u0@x.io"'), ['u0', 'u3', 'u6', 'u9'])
+            for k in ('u0', 'u3', 'u5', 'u6'):
+                r.pexpire(k, 1)
+            time.sleep(0.1)
+            self.assertEqual(r.execute_command('JSON.QUERY', 'byemail', 'EQ', '"u0@x.io"',
+                                               'LIMIT', 0, 1), ['u9'])
+            self.assertEqual(r.execute_command('JSON.QUERY', 'byscore', 'RANGE', '-inf', '+inf',
+                                               'LIMIT', 1, 2), ['r7', 'u8'])
+
+            self.assertEqual(r.execute_command('JSON.INDEX', 'DROP', 'byemail'), 1)
+            self.assertEqual(r.execute_command('JSON.QUERY', 'byemail', 'EQ', '"u1@x.io"'), [])
+            for args in [('CREATE', 'bad', '..email', 'HASH'), ('CREATE', 'bad', '.email', 'TREE'),
+                         ('CREATE', 'byscore', '.score', 'HASH')]:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON.INDEX', *args)
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.QUERY', 'u1', 'EQ', '1')
+
+    def testAofRewriteBigDocument(self):
+        """Test rewriting a document that is written in chunks to the AOF, and loading it"""
+
+        with self.redis() as r:
+            r.flushdb()
+            doc = {
+                'records': [{'id': i, 'name': 'user {}'.format(i), 'tags': ['a', 'b'] * (i % 5)}
+                            for i in range(40000)],
+                'nested': {'odd key"]': list(range(100000)), 'empty': {}},
+                'small': True,
+            }
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            r.execute_command('CONFIG', 'SET', 'appendonly', 'yes')
+            while r.info('persistence')['aof_rewrite_in_progress'] or \
+                    r.info('persistence')['aof_rewrite_scheduled']:
+                time.sleep(0.1)
+            r.execute_command('BGREWRITEAOF')
+            while r.info('persistence')['aof_rewrite_in_progress'] or \
+                    r.info('persistence')['aof_rewrite_scheduled']:
+                time.sleep(0.1)
+            r.execute_command('DEBUG', 'LOADAOF')
+            self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test')), doc)
+            r.execute_command('CONFIG', 'SET', 'appendonly', 'no')
+
+    def testAofRewriteQuotedKeys(self):
+        """Test rewriting documents in chunks whose keys need quotes in paths, and loading them"""
+
+        def member(i):
+            return {'id': i, 'text': 'x' * 20, 'items': list(range(i % 7))}
+
+        keys = ['a"b', "c'd", 'e]f', 'g"]h', "i']j", '\u00fc', '\u65e5\u672c', 'k l', '1m']
+        doc = {k: {k: [member(i) for i in range(5)], 'n': i} for i, k in enumerate(keys)}
+        # a dictionary with a key that has both quotes is set whole
+        doc['both'] = {'o"\'p': [member(i) for i in range(5)], 'q': [member(i) for i in range(5)]}
+        with self.redis() as r:
+            r.flushdb()
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.',
+                                            json.dumps(doc, ensure_ascii=False)))
+            self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'AOF_CHUNK_SIZE', '64'))
+            try:
+                r.execute_command('CONFIG', 'SET', 'appendonly', 'yes')
+                while r.info('persistence')['aof_rewrite_in_progress'] or \
+                        r.info('persistence')['aof_rewrite_scheduled']:
+                    time.sleep(0.1)
+                r.execute_command('BGREWRITEAOF')
+                while r.info('persistence')['aof_rewrite_in_progress'] or \
+                        r.info('persistence')['aof_rewrite_scheduled']:
+                    time.sleep(0.1)
+                r.execute_command('DEBUG', 'LOADAOF')
+                self.assertEqual(json.loads(r.execute_command('JSON.GET', 'test')), doc)
+            finally:
+                r.execute_command('CONFIG', 'SET', 'appendonly', 'no')
+                self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'AOF_CHUNK_SIZE', '1048576'))
+
+    def testConfigCommand(self):
+        """Test JSON.CONFIG command"""
+
+        with self.redis() as r:
+            r.delete('test')
+            conf = r.execute_command('JSON.CONFIG', 'GET', '*')
+            conf = dict(zip(conf[::2], conf[1::2]))
+            self.assertEqual('512', conf['PARSE_MAX_LEVELS'])
+            self.assertEqual(['DICT_HASH_THRESHOLD', '32'],
+                             r.execute_command('JSON.CONFIG', 'GET', 'dict_hash_*'))
+            self.assertEqual([], r.execute_command('JSON.CONFIG', 'GET', 'nosuch*'))
+
+            self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'parse_max_levels', '4'))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '[{"a":1}]'))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SET', 'test', '.', '[[[[1]]]]')
+            self.assertOk(r.execute_command('JSON.CONFIG', 'SET', 'PARSE_MAX_LEVELS', '512'))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '[[[[1]]]]'))
+
+            for args in [('SET', 'NOSUCH', '1'), ('SET', 'PARSE_MAX_LEVELS', '1'),
+                         ('SET', 'LAZY_RDB_LOAD', 'yes'), ('SET', 'COMPRESSION_DICTIONARY', '/x'),
+                         ('NOSUCH', '*')]:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON.CONFIG', *args)
+
+    def testExpireCommands(self):
+        """Test JSON.EXPIRE, JSON.PEXPIREAT, JSON.TTL, JSON.PTTL and JSON.PERSIST commands"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertEqual(0, r.execute_command('JSON.EXPIRE', 'test', '.a', 10))
+            self.assertEqual(-2, r.execute_command('JSON.TTL', 'test', '.a'))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.',
+                                            '{"a":1,"b":{"c":[1,2,3]},"d":"x"}'))
+            self.assertEqual(0, r.execute_command('JSON.EXPIRE', 'test', '.nosuch', 10))
+            self.assertEqual(-2, r.execute_command('JSON.TTL', 'test', '.nosuch'))
+            self.assertEqual(-1, r.execute_command('JSON.TTL', 'test', '.a'))
+            self.assertEqual(-1, r.execute_command('JSON.TTL', 'test'))
+            for path in ['..a', '.b.c[-1]', '.b.c[1]', '.b.c[1].x']:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON.EXPIRE', 'test', path, 10)
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.EXPIRE', 'test', '.a', 'soon')
+
+            # paths are kept in their canonical form
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'test', '["a"]', 100))
+            self.assertTrue(0 < r.execute_command('JSON.TTL', 'test', '.a') <= 100)
+            self.assertTrue(99000 < r.execute_command('JSON.PTTL', 'test', '.a') <= 100000)
+            self.assertEqual(1, r.execute_command('JSON.PERSIST', 'test', '.a'))
+            self.assertEqual(0, r.execute_command('JSON.PERSIST', 'test', '.a'))
+            self.assertEqual(-1, r.execute_command('JSON.TTL', 'test', '.a'))
+
+            # expired values are deleted on access and by the timer
+            now = int(time.time() * 1000)
+            self.assertEqual(1, r.execute_command('JSON.PEXPIREAT', 'test', '.b.c', now + 100))
+            self.assertEqual(1, r.execute_command('JSON.PEXPIREAT', 'test', '.d', now + 100))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'test', '.a', 1000))
+            self.assertEqual('[1,2,3]', r.execute_command('JSON.GET', 'test', '.b.c'))
+            time.sleep(0.2)
+            self.assertEqual('{}', r.execute_command('JSON.GET', 'test', '.b'))
+            self.assertEqual(['a', 'b'], r.execute_command('JSON.OBJKEYS', 'test'))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'test', '.a', -1))
+            self.assertEqual('{"b":{}}', r.execute_command('JSON.GET', 'test'))
+
+            # keys with quotes expire, and their deletions are written to the AOF with paths that
+            # parse, so loading it deletes them too
+            r.execute_command('CONFIG', 'SET', 'appendonly', 'yes')
+            try:
+                while r.info('persistence')['aof_rewrite_in_progress'] or \
+                        r.info('persistence')['aof_rewrite_scheduled']:
+                    time.sleep(0.1)
+                self.assertOk(r.execute_command('JSON.SET', 'test', '.b',
+                                                '{"q\\"]":1,"s\'":2,"k":{"x\\"y":3}}'))
+                now = int(time.time() * 1000)
+                for path in ['.b[\'q"]\']', '.b["s\'"]', '.b.k[\'x"y\']']:
+                    self.assertEqual(1, r.execute_command('JSON.PEXPIREAT', 'test', path,
+                                                          now + 100))
+                    self.assertTrue(0 < r.execute_command('JSON.PTTL', 'test', path) <= 100)
+                time.sleep(0.3)
+                self.assertEqual('{"k":{}}', r.execute_command('JSON.GET', 'test', '.b'))
+                r.execute_command('DEBUG', 'LOADAOF')
+                self.assertEqual('{"k":{}}', r.execute_command('JSON.GET', 'test', '.b'))
+            finally:
+                r.execute_command('CONFIG', 'SET', 'appendonly', 'no')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.b', '{}'))
+
+            r.delete('other')
+            self.assertOk(r.execute_command('JSON.SET', 'other', '.', '{"a":1,"b":2}'))
+            self.assertEqual(1, r.execute_command('JSON.PEXPIREAT', 'other', '.a',
+                                                  int(time.time() * 1000) + 100))
+            time.sleep(0.5)
+            self.assertEqual(1, r.execute_command('JSON.OBJLEN', 'other'))
+
+            # the root's timeout is the key's
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'test', '.', 100))
+            self.assertTrue(0 < r.ttl('test') <= 100)
+            self.assertTrue(0 < r.execute_command('JSON.TTL', 'test') <= 100)
+            self.assertEqual(1, r.execute_command('JSON.PERSIST', 'test'))
+            self.assertEqual(-1, r.ttl('test'))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'test', '.', 0))
+            self.assertFalse(r.exists('test'))
+
+            # expiries are kept across RDB
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"a":1,"b":2}'))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'test', '.a', 100))
+            for _ in r.retry_with_rdb_reload():
+                self.assertTrue(0 < r.execute_command('JSON.TTL', 'test', '.a') <= 100)
+                self.assertEqual(-1, r.execute_command('JSON.TTL', 'test', '.b'))
+
+    def testGetResolve(self):
+        """Test JSON.GET's RESOLVE of references to other keys"""
+
+        with self.redis() as r:
+            r.delete('u:1', 'u:2', 'u:3', 'nosuch', 'str')
+            r.set('str', 'x')
+            self.assertOk(r.execute_command('JSON.SET', 'u:1', '.',
+                                            '{"name":"a","boss":{"$ref":"u:2"},"me":{"$ref":"u:1"}}'))
+            self.assertOk(r.execute_command('JSON.SET', 'u:2', '.',
+                                            '{"name":"b","boss":{"$ref":"u:3"},"team":[{"$ref":"u:1"},'
+                                            '{"$ref":"nosuch"},{"$ref":"str"}]}'))
+            self.assertOk(r.execute_command('JSON.SET', 'u:3', '.', '{"name":"c","n":[1,2]}'))
+
+            # references to the key or to documents being resolved are kept, missing keys are null
+            self.assertEqual('{"name":"a","boss":{"name":"b","boss":{"$ref":"u:3"},"team":'
+                             '[{"$ref":"u:1"},{"$ref":"nosuch"},{"$ref":"str"}]},"me":{"$ref":"u:1"}}',
+                             r.execute_command('JSON.GET', 'u:1', 'RESOLVE', 1))
+            self.assertEqual('{"name":"b","boss":{"name":"c","n":[1,2]},'
+                             '"team":[{"name":"a","boss":{"$ref":"u:2"},"me":{"$ref":"u:1"}},null,null]}',
+                             r.execute_command('JSON.GET', 'u:2', 'RESOLVE', 2))
+            self.assertEqual('{"name":"b","boss":{"name":"c","n":[1,2]},'
+                             '"team":[{"$ref":"u:1"},null,null]}',
+                             r.execute_command('JSON.GET', 'u:1', 'RESOLVE', 2, '.boss'))
+            self.assertEqual('{"$ref":"u:2"}', r.execute_command('JSON.GET', 'u:1', '.boss'))
+
+            for args in [['RESOLVE', 0], ['RESOLVE', 33], ['RESOLVE', 'deep'],
+                         ['FORMAT', 'MSGPACK', 'RESOLVE', 1]]:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON.GET', 'u:1', *args)
+
+    def testSchemaCommands(self):
+        """Test JSON.SETSCHEMA, JSON.VALIDATE and JSON.SET's SCHEMA"""
+
+        with self.redis() as r:
+            r.delete('schema', 'test', 'str')
+            r.set('str', 'x')
+            schema = ('{"type":"object","required":["id"],"additionalProperties":false,'
+                      '"properties":{"id":{"type":"integer","minimum":1},'
+                      '"tags":{"type":"array","items":{"type":"string"},"maxItems":2}}}')
+            self.assertOk(r.execute_command('JSON.SETSCHEMA', 'schema', schema))
+            self.assertEqual('"integer"', r.execute_command('JSON.GET', 'schema', '.properties.id.type'))
+            self.assertOk(r.execute_command('JSON.VALIDATE', 'schema', '{"id":1,"tags":["a"]}'))
+            for value in ['{"id":0}', '{"tags":[]}', '{"id":1,"tags":["a",1]}',
+                          '{"id":1,"tags":["a","b","c"]}', '{"id":1,"x":1}', '[1]', '"id"', '{"id":']:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON.VALIDATE', 'schema', value)
+            for key in ['nosuch', 'str']:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON.VALIDATE', key, '{"id":1}')
+
+            # unsupported schemas aren't set
+            for bad in ['{"pattern":"^a"}', '{"type":"int"}', '1', '{']:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON.SETSCHEMA', 'bad', bad)
+            self.assertFalse(r.exists('bad'))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SETSCHEMA', 'str', schema)
+
+            # values are validated before they're set, at any path
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"id":1}', 'SCHEMA', 'schema'))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SET', 'test', '.', '{"id":-1}', 'SCHEMA', 'schema')
+            self.assertEqual('{"id":1}', r.execute_command('JSON.GET', 'test'))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.user', '{"id":2}', 'NX',
+                                            'SCHEMA', 'schema'))
+            self.assertIsNone(r.execute_command('JSON.SET', 'test', '.user', '{"id":3}', 'SCHEMA',
+                                                'schema', 'NX'))
+            self.assertEqual('2', r.execute_command('JSON.GET', 'test', '.user.id'))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SET', 'test', '.', '{"id":1}', 'SCHEMA', 'nosuch')
+
+            # the schema is compiled again when its document changes
+            self.assertOk(r.execute_command('JSON.SET', 'schema', '.properties.id.minimum', 5))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.VALIDATE', 'schema', '{"id":1}')
+            self.assertOk(r.execute_command('JSON.VALIDATE', 'schema', '{"id":5}'))
+            self.assertOk(r.execute_command('JSON.SET', 'schema', '.properties.id.minimum', '"5"'))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.VALIDATE', 'schema', '{"id":5}')
+
+            # a schema survives restarts as a document, and is compiled on first use
+            self.assertOk(r.execute_command('JSON.SET', 'schema', '.properties.id.minimum', 5))
+            for _ in r.retry_with_rdb_reload():
+                self.assertOk(r.execute_command('JSON.VALIDATE', 'schema', '{"id":5}'))
+
 if __name__ == '__main__':
     unittest.main()
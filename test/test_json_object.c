@@ -2,8 +2,15 @@
 #include <assert.h>
 #include <string.h>
 #include <dirent.h>
+#include <malloc.h>
 #include "minunit.h"
 #include "../src/json_object.h"
+#include "../src/json_scan.h"
+#include "../src/object_binary.h"
+#include "../src/json_patch.h"
+#include "../src/json_keyref.h"
+#include "../src/object_pack.h"
+#include "../src/stats.h"
 
 #define _JSTR(e) "\"" #e "\""
 
@@ -76,33 +83,111 @@ MU_TEST(test_jo_create_literal_double) {
     mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
     mu_check(NULL != n);
     mu_check(N_NUMBER == n->type);
-    mu_assert_double_eq(0, n->value.numval);
+    mu_assert_double_eq(0, Node_Number(n));
     Node_Free(n);
 
     json = "-0.0";
     mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
     mu_check(NULL != n);
     mu_check(N_NUMBER == n->type);
-    mu_assert_double_eq(0, n->value.numval);
+    mu_assert_double_eq(0, Node_Number(n));
     Node_Free(n);
 
     json = "63.79";
     mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
     mu_check(NULL != n);
     mu_check(N_NUMBER == n->type);
-    mu_assert_double_eq(63.79, n->value.numval);
+    mu_assert_double_eq(63.79, Node_Number(n));
     Node_Free(n);
 
     json = "-4.2";
     mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
     mu_check(NULL != n);
     mu_check(N_NUMBER == n->type);
-    mu_assert_double_eq(-4.2, n->value.numval);
+    mu_assert_double_eq(-4.2, Node_Number(n));
     Node_Free(n);
 
     // TODO: check more notations
 }
 
+MU_TEST(test_jo_number_text) {
+    Node *n, *m;
+    JSONSerializeOpt opt = {"", "", ""};
+    const char *jsons[] = {
+        "1.50", "1E3", "-0.0", "2.5e-3", "0.10000000000000000555111512312578270211815834045",
+        "{" _JSTR(a) ":1.10," _JSTR(b) ":{" _JSTR(c) ":-1e+300}}", NULL};
+
+    // members and roots are written as they were parsed, by both parsers and from their binary
+    for (int i = 0; jsons[i]; i++) {
+        for (int parser = JSONPARSER_JSONSL; parser <= JSONPARSER_DIRECT; parser++) {
+            size_t len = strlen(jsons[i]);
+            mu_check(JSONOBJECT_OK == CreateNodeFromJSONWith(parser, jsons[i], len, &n, NULL));
+            sds bin = sdsempty();
+            SerializeNodeToBinary(n, &bin);
+            mu_check(OBJ_OK == CreateNodeFromBinary(bin, sdslen(bin), &m));
+            sds a = sdsempty(), b = sdsempty();
+            SerializeNodeToJSON(n, &opt, &a);
+            SerializeNodeToJSON(m, &opt, &b);
+            mu_check(!strcmp(jsons[i], a));
+            mu_check(!strcmp(jsons[i], b));
+            sdsfree(a);
+            sdsfree(b);
+            sdsfree(bin);
+            Node_Free(m);
+            Node_Free(n);
+        }
+    }
+
+    // the values are converted when needed, and copies keep the text
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON("1.50", 4, &n, NULL));
+    mu_check(N_NUMBER == n->type && (n->flags & NODE_F_NUMBER_TEXT));
+    mu_assert_double_eq(1.5, Node_Number(n));
+    m = Node_Clone(n);
+    mu_check((m->flags & NODE_F_NUMBER_TEXT) && 4 == m->value.strval.len);
+    mu_check(!memcmp("1.50", m->value.strval.data, 4));
+    Node_Free(m);
+
+    // numbers in arrays are packed as doubles
+    m = NewArrayNode(1);
+    Node_ArrayAppend(m, n);
+    mu_check(m->flags & NODE_F_PACKED_NUM);
+    sds str = sdsempty();
+    SerializeNodeToJSON(m, &opt, &str);
+    mu_check(!strcmp("[1.5]", str));
+    sdsfree(str);
+    Node_Free(m);
+    const char *json = "[1.50,{" _JSTR(a) ":1.50}]";
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
+    str = sdsempty();
+    SerializeNodeToJSON(n, &opt, &str);
+    mu_check(!strcmp("[1.5,{" _JSTR(a) ":1.50}]", str));
+    sdsfree(str);
+    Node_Free(n);
+
+    // the text of an encoding must be a number in range
+    const char *bad[] = {"1.", "01", "1e", "x", "1e999", NULL};
+    for (int i = 0; bad[i]; i++) {
+        size_t len = strlen(bad[i]);
+        sds bin = sdscatlen(sdsnewlen("\x0a", 1), (char[]){len}, 1);
+        bin = sdscatlen(bin, bad[i], len);
+        mu_check(OBJ_ERR == CreateNodeFromBinary(bin, sdslen(bin), &n));
+        mu_check(OBJ_ERR == ValidateBinary(bin, sdslen(bin)));
+        sdsfree(bin);
+    }
+
+    // without the setting, numbers are values
+    JSONObjectNumberText = 0;
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON("1.50", 4, &n, NULL));
+    mu_check(N_NUMBER == n->type && !(n->flags & NODE_F_NUMBER_TEXT));
+    Node_Free(n);
+    JSONObjectNumberText = 1;
+
+    // out of range numbers still fail to parse
+    json = "{" _JSTR(a) ":1e999}";
+    mu_check(JSONOBJECT_ERROR == CreateNodeFromJSON(json, strlen(json), &n, NULL));
+    mu_check(JSONOBJECT_ERROR == CreateNodeFromJSON("1e999", 5, &n, NULL));
+}
+
 MU_TEST(test_jo_create_literal_string) {
     Node *n;
     char err[4096];
@@ -114,6 +199,51 @@ MU_TEST(test_jo_create_literal_string) {
     mu_check(0 == strncmp("foo", n->value.strval.data, n->value.strval.len));
     Node_Free(n);
 
+    // escapes between long runs of plain characters, including a surrogate pair
+    json = "\"<p class=\\\"x\\\">a long run of text<\\/p>\\n\\u00e9\\ud83d\\ude00 and the rest\"";
+    const char *expected = "<p class=\"x\">a long run of text</p>\n\xc3\xa9\xf0\x9f\x98\x80 and the rest";
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
+    mu_check(N_STRING == n->type);
+    mu_check(strlen(expected) == n->value.strval.len);
+    mu_check(0 == memcmp(expected, n->value.strval.data, n->value.strval.len));
+    Node_Free(n);
+
+    // a lone high surrogate is an error
+    json = "\"abc\\ud83d and more\"";
+    mu_check(JSONOBJECT_ERROR == CreateNodeFromJSON(json, strlen(json), &n, NULL));
+    json = "\"abc\\u00\"";
+    mu_check(JSONOBJECT_ERROR == CreateNodeFromJSON(json, strlen(json), &n, NULL));
+
+    // long strings are unescaped right into their nodes, unless they're compressed
+    sds esc = sdsnew("\""), unesc = sdsempty();
+    for (int i = 0; i < 100; i++) {
+        esc = sdscat(esc, "line\\t\\\"quoted\\\"\\u00e9\\n");
+        unesc = sdscat(unesc, "line\t\"quoted\"\xc3\xa9\n");
+    }
+    esc = sdscat(esc, "\"");
+    for (int compress = 0; compress < 2; compress++) {
+        NodeStringCompressSize = compress ? 64 : 0;
+        for (int parser = JSONPARSER_JSONSL; parser <= JSONPARSER_DIRECT; parser++) {
+            // in an arena and on the heap
+            NodeArena *a = parser == JSONPARSER_DIRECT ? NewNodeArena() : NULL;
+            NodeArena *prev = Node_SetArena(a);
+            mu_check(JSONOBJECT_OK == CreateNodeFromJSONWith(parser, esc, sdslen(esc), &n, NULL));
+            Node_SetArena(prev);
+            char *tmp;
+            mu_assert_int_eq(sdslen(unesc), n->value.strval.len);
+            mu_check(!memcmp(unesc, Node_StringData(n, &tmp), sdslen(unesc)));
+            mu_check(!!compress == !!(n->flags & NODE_F_COMPRESSED));
+            free(tmp);
+            Node_Free(n);
+            NodeArena_Free(a);
+        }
+    }
+    NodeStringCompressSize = 0;
+    esc[sdslen(esc) - 2] = 'x';  // an invalid escape at the end
+    mu_check(JSONOBJECT_ERROR == CreateNodeFromJSON(esc, sdslen(esc), &n, NULL));
+    sdsfree(esc);
+    sdsfree(unesc);
+
     // TODO: more weird chars
 }
 
@@ -280,6 +410,39 @@ MU_TEST(test_oj_integer) {
     Node_Free(n);
 }
 
+MU_TEST(test_oj_double) {
+    Node *n;
+    sds str;
+    JSONSerializeOpt opt = {"", "", ""};
+    const double vals[] = {0, 2.5, -1.2, 0.1, 1e21, 1e-7, 123456789012.5, 1.7976931348623157e308};
+    const char *jsons[] = {"0",    "2.5",           "-1.2", "0.1", "1000000000000000000000",
+                           "1e-7", "123456789012.5", "1.7976931348623157e+308"};
+
+    for (int i = 0; i < sizeof(vals) / sizeof(double); i++) {
+        str = sdsempty();
+        n = NewDoubleNode(vals[i]);
+        SerializeNodeToJSON(n, &opt, &str);
+        mu_check(!strcmp(jsons[i], str));
+        sdsfree(str);
+        Node_Free(n);
+    }
+
+    // every double is serialized with digits that parse back to it
+    srand(6379);
+    for (int i = 0; i < 100000; i++) {
+        uint64_t bits = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand();
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        if (!isfinite(d)) continue;
+        str = sdsempty();
+        n = NewDoubleNode(d);
+        SerializeNodeToJSON(n, &opt, &str);
+        mu_check(d == strtod(str, NULL));
+        sdsfree(str);
+        Node_Free(n);
+    }
+}
+
 MU_TEST(test_oj_string) {
     Node *n;
     sds str = sdsempty();
@@ -307,6 +470,14 @@ MU_TEST(test_oj_keyval) {
     mu_check(0 == strncmp(json, str, strlen(str)));
     sdsfree(str);
     Node_Free(n);
+
+    // keys are escaped like string values
+    str = sdsempty();
+    n = NewKeyValNode("f\"o/o", 5, NewIntNode(1));
+    SerializeNodeToJSON(n, &opt, &str);
+    mu_check(!strcmp("\"f\\\"o\\/o\":1", str));
+    sdsfree(str);
+    Node_Free(n);
 }
 
 MU_TEST(test_oj_dict) {
@@ -325,6 +496,147 @@ MU_TEST(test_oj_dict) {
     Node_Free(n);
 }
 
+MU_TEST(test_oj_keyvalues) {
+    JSONSerializeOpt opts[] = {{"", "", ""}, {"  ", "\n", " "}};
+    const char *keys[] = {"foo", ".bar[0]", "q\"uote"};
+    size_t keylens[] = {3, 7, 6};
+    char *err = NULL;
+    Node *vals[3];
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON("[1,2.5]", 7, &vals[0], &err));
+    vals[1] = NULL;
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON("{\"a\":{}}", 8, &vals[2], &err));
+
+    // the serialization is the same as that of a dictionary of the keys and values
+    for (int i = 0; i < sizeof(opts) / sizeof(JSONSerializeOpt); i++) {
+        for (int n = 0; n <= 3; n++) {
+            Node *dict = NewDictNode(n);
+            for (int j = 0; j < n; j++) Node_DictSet(dict, keys[j], vals[j]);
+            sds expected = sdsempty(), str = sdsempty();
+            SerializeNodeToJSON(dict, &opts[i], &expected);
+            SerializeKeyValuesToJSON(keys, keylens, vals, n, &opts[i], &str);
+            mu_check(!strcmp(expected, str));
+            sdsfree(expected);
+            sdsfree(str);
+            for (int j = 0; j < n; j++) dict->value.dictval.entries[j]->value.kvval.val = NULL;
+            Node_Free(dict);
+        }
+    }
+    Node_Free(vals[0]);
+    Node_Free(vals[2]);
+}
+
+MU_TEST(test_oj_serializer) {
+    JSONSerializeOpt opts[] = {{"", "", ""}, {"  ", "\n", " "}};
+    const char *json = "[[1,2.5],{\"foo\":[1,2.5],\"q\\\"uote\":null},[],{},null]";
+    char *err = NULL;
+    Node *doc, *arr;
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &doc, &err));
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON("[1,2.5]", 7, &arr, &err));
+
+    // the serialization of the streamed values is the same as that of the document
+    for (int i = 0; i < sizeof(opts) / sizeof(JSONSerializeOpt); i++) {
+        sds expected = sdsempty();
+        SerializeNodeToJSON(doc, &opts[i], &expected);
+        JSONSerializer *s = NewJSONSerializer(&opts[i], sdsempty());
+        JSONSerializer_BeginArray(s);
+        JSONSerializer_Value(s, arr);
+        JSONSerializer_BeginDict(s);
+        JSONSerializer_Key(s, "foo", 3);
+        JSONSerializer_Value(s, arr);
+        JSONSerializer_Key(s, "q\"uote", 6);
+        JSONSerializer_Value(s, NULL);
+        JSONSerializer_End(s);
+        JSONSerializer_BeginArray(s);
+        JSONSerializer_End(s);
+        JSONSerializer_BeginDict(s);
+        JSONSerializer_End(s);
+        JSONSerializer_Value(s, NULL);
+        JSONSerializer_End(s);
+        sds str = JSONSerializer_Free(s);
+        mu_check(!strcmp(expected, str));
+        sdsfree(expected);
+        sdsfree(str);
+    }
+    Node_Free(doc);
+    Node_Free(arr);
+}
+
+/* Appends a flushed fragment to an sds, after checking that it isn't smaller than a chunk */
+static size_t _flushChunk;
+static int _flushedSmall;
+
+static void _flushAppend(const char *buf, size_t len, void *ctx) {
+    sds *out = ctx;
+    // only the last fragment may be smaller than a chunk, and none is empty
+    if (_flushedSmall || !len) _flushedSmall = 2;
+    else if (len < _flushChunk) _flushedSmall = 1;
+    *out = sdscatlen(*out, buf, len);
+}
+
+MU_TEST(test_oj_serializer_flush) {
+    JSONSerializeOpt opt = {"  ", "\n", " "};
+    const char *json = "{\"a\":[1,2.5,\"str\",[3,4],{\"b\":[5,6,7,8]}],\"c\":{},\"d\":[[[9]]]}";
+    Node *doc;
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &doc, NULL));
+    sds expected = sdsempty();
+    SerializeNodeToJSON(doc, &opt, &expected);
+
+    for (_flushChunk = 1; _flushChunk <= sdslen(expected) + 1; _flushChunk++) {
+        sds out = sdsempty();
+        _flushedSmall = 0;
+        JSONSerializer *s = NewJSONSerializer(&opt, sdsempty());
+        JSONSerializer_SetFlush(s, _flushChunk, _flushAppend, &out);
+        JSONSerializer_Value(s, doc);
+        sds rest = JSONSerializer_Free(s);
+        mu_check(!sdslen(rest));
+        mu_check(_flushedSmall < 2);
+        mu_check(!strcmp(expected, out));
+        sdsfree(rest);
+        sdsfree(out);
+    }
+    sdsfree(expected);
+    Node_Free(doc);
+}
+
+MU_TEST(test_oj_serializer_deep) {
+    // nested deeper than the walk's inlined frames, with packed arrays and dictionaries' keys
+    JSONSerializeOpt compact = {0}, pretty = {" ", "\n", " "};
+    Node *root = NewArrayNode(2), *n = root;
+    sds expected = sdsempty(), expectedpretty = sdsempty();
+    for (int i = 0; i < 100; i++) {
+        Node *d = NewDictNode(1), *packed = NewArrayNode(2);
+        Node_ArrayAppend(packed, NewIntNode(i));
+        Node_ArrayAppend(packed, NewIntNode(-i));
+        Node_ArrayAppend(n, packed);
+        Node_ArrayAppend(n, d);
+        n = i < 99 ? NewArrayNode(2) : NULL;
+        Node_DictSet(d, "k", n);
+        expected = sdscatprintf(expected, "[[%d,%d],{\"k\":", i, -i);
+        expectedpretty = sdscatprintf(
+            expectedpretty, "[\n%*s[\n%*s%d,\n%*s%d\n%*s],\n%*s{\n%*s\"k\": ", 2 * i + 1, "",
+            2 * i + 2, "", i, 2 * i + 2, "", -i, 2 * i + 1, "", 2 * i + 1, "", 2 * i + 2, "");
+    }
+    expected = sdscat(expected, "null");
+    expectedpretty = sdscat(expectedpretty, "null");
+    for (int i = 99; i >= 0; i--) {
+        expected = sdscat(expected, "}]");
+        expectedpretty = sdscatprintf(expectedpretty, "\n%*s}\n%*s]", 2 * i + 1, "", 2 * i, "");
+    }
+
+    sds str = sdsempty();
+    SerializeNodeToJSON(root, &compact, &str);
+    mu_check(!strcmp(expected, str));
+    sdsfree(str);
+    str = sdsempty();
+    SerializeNodeToJSON(root, &pretty, &str);
+    mu_check(!strcmp(expectedpretty, str));
+    sdsfree(str);
+
+    sdsfree(expected);
+    sdsfree(expectedpretty);
+    Node_Free(root);
+}
+
 MU_TEST(test_oj_array) {
     Node *n;
     sds str = sdsempty();
@@ -370,28 +682,1191 @@ MU_TEST(test_oj_special_characters) {
     Node_Free(n);
 }
 
+MU_TEST(test_oj_scan_kernels) {
+    const char *kernels[] = {"avx2", "sse2", "neon", "scalar"};
+    const char *kernel = JSON_ScanKernel();
+    char buf[256];
+
+    // every available kernel stops where the scalar one does, wherever the character is
+    srand(6379);
+    for (int k = 0; k < sizeof(kernels) / sizeof(char *); k++) {
+        if (!JSON_ScanUseKernel(kernels[k])) continue;
+        for (int i = 0; i < 20000; i++) {
+            int len = rand() % sizeof(buf);
+            for (int j = 0; j < len; j++) buf[j] = 'a' + rand() % 26;
+            if (len && rand() % 4) buf[rand() % len] = (char)(rand() % 256);
+            const char *end = buf + len;
+            const char *p = buf;
+            while (p < end && (unsigned char)*p >= 0x20 && (unsigned char)*p <= 0x7e &&
+                   *p != '"' && *p != '\\' && *p != '/')
+                p++;
+            mu_check(p == JSON_ScanEscape(buf, end));
+        }
+    }
+    mu_check(JSON_ScanUseKernel(kernel));
+    mu_check(!JSON_ScanUseKernel("foo"));
+}
+
+MU_TEST(test_jo_create_arena) {
+    Node *n, *m;
+    sds str = sdsempty();
+    JSONSerializeOpt opt = {"", "", ""};
+    char *json = "{" _JSTR(foo) ":[1,2.5,true,null," _JSTR(bar) "]," _JSTR(baz) ":{" _JSTR(qux) ":"
+        _JSTR(quux) "}}";
+
+    // build the document in an arena
+    NodeArena *a = NewNodeArena();
+    NodeArena *prev = Node_SetArena(a);
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
+    mu_check(a == Node_SetArena(prev));
+    mu_check(n->flags & NODE_F_ARENA);
+    mu_check(a->size > 0);
+    SerializeNodeToJSON(n, &opt, &str);
+    mu_check(!strcmp(json, str));
+    sdsfree(str);
+
+    // modify it with nodes from the heap, which also moves grown entries out of the arena
+    mu_check(OBJ_OK == Node_DictGet(n, "foo", &m));
+    for (int i = 0; i < 100; i++) mu_check(OBJ_OK == Node_ArrayAppend(m, NewIntNode(i)));
+    mu_check(!(m->flags & NODE_F_ARENA_DATA));
+    mu_check(OBJ_OK == Node_DictGet(n, "baz", &m));
+    mu_check(OBJ_OK == Node_DictGet(m, "qux", &m));
+    Node *s = NewCStringNode("corge");
+    mu_check(OBJ_OK == Node_StringAppend(m, s));
+    Node_Free(s);
+    mu_check(!strcmp("quuxcorge", m->value.strval.data));
+    mu_check(OBJ_OK == Node_DictSet(n, "grault", NewCStringNode("garply")));
+    mu_check(OBJ_OK == Node_DictDel(n, "baz"));
+    mu_assert_int_eq(2, Node_Length(n));
+
+    // free the heap memory, then the arena
+    Node_Free(n);
+    NodeArena_Free(a);
+}
+
+MU_TEST(test_jo_create_packed_array) {
+    Node *n, *m;
+    sds str;
+    JSONSerializeOpt opt = {"", "", ""};
+    const char *jsons[] = {"[1,2,3,-4,5000000000]", "[1.5,-2.25,0.125]", "[1,2.5,3]",
+                           "{" _JSTR(foo) ":[[1,2],[3.5]]}", NULL};
+
+    for (int i = 0; jsons[i]; i++) {
+        mu_check(JSONOBJECT_OK == CreateNodeFromJSON(jsons[i], strlen(jsons[i]), &n, NULL));
+        str = sdsempty();
+        SerializeNodeToJSON(n, &opt, &str);
+        mu_check(!strcmp(jsons[i], str));
+        sdsfree(str);
+        if (0 == i) mu_check(n->flags & NODE_F_PACKED_INT);
+        if (1 == i) mu_check(n->flags & NODE_F_PACKED_NUM);
+        if (2 == i) mu_check(!(n->flags & NODE_F_PACKED));
+        if (3 == i) {
+            mu_check(OBJ_OK == Node_DictGet(n, "foo", &m));
+            mu_check(!(m->flags & NODE_F_PACKED));
+            mu_check(OBJ_OK == Node_ArrayItem(m, 1, &m));
+            mu_check(m->flags & NODE_F_PACKED_NUM);
+        }
+        Node_Free(n);
+    }
+
+    // a scalar is never left packed in its wrapper
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON("2.5", 3, &n, NULL));
+    mu_check(N_NUMBER == n->type && 2.5 == Node_Number(n));
+    Node_Free(n);
+}
+
+MU_TEST(test_jo_create_direct) {
+    Node *n, *m;
+    sds json, str;
+    JSONSerializeOpt opt = {"", "", ""};
+
+    // big enough to be indexed, with a duplicate key that keeps its first position
+    json = sdsnew("{");
+    for (int i = 0; i < 40; i++) json = sdscatprintf(json, "\"k%d\":%d,", i, i);
+    json = sdscat(json, "\"k7\":[1,2,3],\"k7\":[1.5,2.5]}");
+    mu_check(JSONOBJECT_OK ==
+             CreateNodeFromJSONWith(JSONPARSER_DIRECT, json, sdslen(json), &n, NULL));
+    mu_check(N_DICT == n->type && 40 == n->value.dictval.len);
+    mu_check(OBJ_OK == Node_DictGet(n, "k7", &m));
+    mu_check(N_ARRAY == m->type && (m->flags & NODE_F_PACKED_NUM));
+    mu_check(OBJ_OK == Node_DictGet(n, "k39", &m));
+    mu_check(N_INTEGER == m->type && 39 == m->value.intval);
+    str = sdsempty();
+    SerializeNodeToJSON(n, &opt, &str);
+    mu_check(!strncmp("{\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,\"k6\":6,"
+                      "\"k7\":[1.5,2.5],\"k8\":8",
+                      str, 61));
+    sdsfree(str);
+    Node_Free(n);
+    sdsfree(json);
+
+    // containers nest as deep as with jsonsl
+    json = sdsempty();
+    for (int i = 0; i < 511; i++) json = sdscat(json, "[");
+    for (int i = 0; i < 511; i++) json = sdscat(json, "]");
+    mu_check(JSONOBJECT_OK ==
+             CreateNodeFromJSONWith(JSONPARSER_DIRECT, json, sdslen(json), &n, NULL));
+    Node_Free(n);
+    str = sdscatsds(sdscat(sdsempty(), "["), json);
+    str = sdscat(str, "]");
+    mu_check(JSONOBJECT_ERROR ==
+             CreateNodeFromJSONWith(JSONPARSER_DIRECT, str, sdslen(str), &n, NULL));
+    sdsfree(str);
+    sdsfree(json);
+
+    // both backends take a lower limit
+    JSONObjectMaxLevels = 4;
+    for (int parser = JSONPARSER_JSONSL; parser <= JSONPARSER_DIRECT; parser++) {
+        int ok = JSONOBJECT_OK == CreateNodeFromJSONWith(parser, "[{\"a\":1}]", 9, &n, NULL);
+        if (ok) Node_Free(n);
+        ok = ok && JSONOBJECT_ERROR == CreateNodeFromJSONWith(parser, "[[[[1]]]]", 9, &n, NULL);
+        mu_check(ok);
+    }
+    JSONObjectMaxLevels = JSONSL_MAX_LEVELS;
+
+    // errors in the middle of containers free what was parsed
+    const char *bad[] = {"[1,\"a\",{\"b\":[2", "{\"a\":[1,2],\"b\":tru}", "[{\"a\":1}] 2",
+                         "[1,2,]", "{\"a\":\"\\x\"}", "[0x10]", NULL};
+    for (int i = 0; bad[i]; i++) {
+        char *err = NULL;
+        mu_check(JSONOBJECT_ERROR ==
+                 CreateNodeFromJSONWith(JSONPARSER_DIRECT, bad[i], strlen(bad[i]), &n, &err));
+        mu_check(NULL != err);
+        free(err);
+    }
+}
+
+MU_TEST(test_jo_lexer_pool) {
+    Node *n;
+    char *err = NULL;
+
+    // lexers are reused by parses that need more levels, fewer, and that fail inside values
+    sds deep = sdsempty();
+    for (int i = 0; i < 300; i++) deep = sdscat(deep, "[");
+    for (int i = 0; i < 300; i++) deep = sdscat(deep, "]");
+    const char *values[] = {"[1]", "{\"a\":\"\\u0041\"}", deep, "[\"\\n", "{\"a\":[1,",
+                            "{\"b\":\"x\"}", deep, "[true]", NULL};
+    const int ok[] = {1, 1, 1, 0, 0, 1, 1, 1};
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; values[i]; i++) {
+            int ret = CreateNodeFromJSONWith(JSONPARSER_JSONSL, values[i], strlen(values[i]), &n,
+                                             &err);
+            mu_check(ok[i] ? JSONOBJECT_OK == ret : JSONOBJECT_ERROR == ret);
+            if (JSONOBJECT_OK == ret) {
+                Node_Free(n);
+            } else {
+                free(err);
+                err = NULL;
+            }
+        }
+    }
+
+    // an escaped string after one that failed in its escapes is unescaped
+    mu_check(JSONOBJECT_ERROR == CreateNodeFromJSONWith(JSONPARSER_JSONSL, "[\"\\t", 4, &n, NULL));
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSONWith(JSONPARSER_JSONSL, "[\"ab\"]", 6, &n, NULL));
+    Node *item;
+    Node_ArrayItem(n, 0, &item);
+    mu_check(2 == item->value.strval.len);
+    Node_Free(n);
+
+    // a small lexer still stops at the levels' limit, and a big one at a lower limit
+    JSONObjectMaxLevels = 4;
+    mu_check(JSONOBJECT_ERROR == CreateNodeFromJSONWith(JSONPARSER_JSONSL, "[[[[1]]]]", 9, &n, NULL));
+    mu_check(JSONOBJECT_ERROR ==
+             CreateNodeFromJSONWith(JSONPARSER_JSONSL, deep, sdslen(deep), &n, NULL));
+    JSONObjectMaxLevels = JSONSL_MAX_LEVELS;
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSONWith(JSONPARSER_JSONSL, "[[[[1]]]]", 9, &n, NULL));
+    Node_Free(n);
+
+    // scalars are wrapped in a list on the stack when they're short, and on the heap otherwise
+    sds str = sdsnew("\"\\u0041");
+    for (int i = 0; i < 1000; i++) str = sdscat(str, "b");
+    str = sdscat(str, "\"");
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON("\"\\u0041b\"", 9, &n, NULL));
+    mu_check(N_STRING == n->type && 2 == n->value.strval.len);
+    Node_Free(n);
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(str, sdslen(str), &n, NULL));
+    mu_check(N_STRING == n->type && 1001 == n->value.strval.len);
+    Node_Free(n);
+    sdsfree(str);
+    sdsfree(deep);
+}
+
+MU_TEST(test_jo_create_scalar) {
+    Node *n, *m;
+    JSONSerializeOpt opt = {"", "", ""};
+
+    // the scalars parse like the full parser parses them
+    const char *good[] = {"1", " -42 ", "2.5", "1e3", "-0", "-9223372036854775808",
+                          "true", "false", "\t\"\"\n", "\"a value\"", NULL};
+    for (int i = 0; good[i]; i++) {
+        mu_check(JSONOBJECT_OK == CreateScalarNodeFromJSON(good[i], strlen(good[i]), &n));
+        mu_check(JSONOBJECT_OK ==
+                 CreateNodeFromJSONWith(JSONPARSER_JSONSL, good[i], strlen(good[i]), &m, NULL));
+        sds a = sdsempty(), b = sdsempty();
+        SerializeNodeToJSON(n, &opt, &a);
+        SerializeNodeToJSON(m, &opt, &b);
+        mu_check(!strcmp(a, b));
+        sdsfree(a);
+        sdsfree(b);
+        Node_Free(n);
+        Node_Free(m);
+    }
+    n = (Node *)1;
+    mu_check(JSONOBJECT_OK == CreateScalarNodeFromJSON("null", 4, &n));
+    mu_check(NULL == n);
+
+    // containers, escapes and errors are left to the full parser
+    const char *other[] = {"",      " ",     "[1]",  "{}",      "\"a\\\"b\"", "\"a\"b\"",
+                           "\"abc", "tru",   "nul",  "truex",   "01",          "1.",
+                           "0x10",  "1 2",   "-",    "\"\x01\"", NULL};
+    for (int i = 0; other[i]; i++)
+        mu_check(JSONOBJECT_ERROR == CreateScalarNodeFromJSON(other[i], strlen(other[i]), &n));
+}
+
+MU_TEST(test_jo_validate) {
+    Node *n;
+    sds compact, str;
+    JSONSerializeOpt opt = {"", "", ""};
+
+    // the compact copy keeps the values as they are written, whitespace in strings included
+    compact = sdsnew("x");
+    const char *json = " {\n\t\"a b\" : [ 1.0 , \"\\u0041 \" ,true,null ] , \"c\":{ } } ";
+    mu_check(JSONOBJECT_OK == ValidateJSON(json, strlen(json), &compact, NULL));
+    mu_check(!strcmp("x{\"a b\":[1.0,\"\\u0041 \",true,null],\"c\":{}}", compact));
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(compact + 1, sdslen(compact) - 1, &n, NULL));
+    str = sdsempty();
+    SerializeNodeToJSON(n, &opt, &str);
+    mu_check(!strcmp("{\"a b\":[1,\"A \",true,null],\"c\":{}}", str));
+    sdsfree(str);
+    Node_Free(n);
+
+    // errors are those of the parsers, and leave the compact copy as it was
+    const char *bad[] = {"[1, 2", "{\"a\" : tru}", "[1e999]", "[\"\\x\"]", " ", "[1] 2", NULL};
+    for (int i = 0; bad[i]; i++) {
+        char *err = NULL;
+        mu_check(JSONOBJECT_ERROR == ValidateJSON(bad[i], strlen(bad[i]), &compact, &err));
+        mu_check(NULL != err);
+        free(err);
+        mu_check(JSONOBJECT_ERROR == CreateNodeFromJSON(bad[i], strlen(bad[i]), &n, NULL));
+    }
+    mu_check(!strcmp("x{\"a b\":[1.0,\"\\u0041 \",true,null],\"c\":{}}", compact));
+    sdsfree(compact);
+    mu_check(JSONOBJECT_OK == ValidateJSON("42", 2, NULL, NULL));
+}
+
+MU_TEST(test_jo_create_chunked) {
+    Node *n, *m;
+    sds str, expected;
+    char *err;
+    JSONSerializeOpt opt = {"", "", ""};
+    const char *jsons[] = {
+        "null", " true ", "-123", "1.5e3", "\"a \\\"quoted\\\" \\u00e9 string\"", "{}", "[]",
+        "[1,-2,300000,0.25]", "[true,false,null,\"x\",[]]",
+        " {" _JSTR(key) ": {" _JSTR(b) ":[[],{},[{" _JSTR(c) ":[1,2]}]]}, " _JSTR(d) ":\"\"} ", NULL};
+
+    for (int i = 0; jsons[i]; i++) {
+        size_t len = strlen(jsons[i]);
+        mu_check(JSONOBJECT_OK == CreateNodeFromJSON(jsons[i], len, &n, NULL));
+        expected = sdsempty();
+        SerializeNodeToJSON(n, &opt, &expected);
+        Node_Free(n);
+
+        // split in two at every position, and a byte at a time
+        for (size_t at = 0; at <= len + 1; at++) {
+            JSONChunkParser *p = NewJSONChunkParser();
+            if (at <= len) {
+                mu_check(JSONOBJECT_OK == JSONChunkParser_Feed(p, jsons[i], at, NULL));
+                mu_check(JSONOBJECT_OK == JSONChunkParser_Feed(p, jsons[i] + at, len - at, NULL));
+            } else {
+                for (size_t j = 0; j < len; j++)
+                    mu_check(JSONOBJECT_OK == JSONChunkParser_Feed(p, jsons[i] + j, 1, NULL));
+            }
+            mu_check(len == JSONChunkParser_Length(p));
+            mu_check(JSONOBJECT_OK == JSONChunkParser_Finish(p, &m, NULL));
+            JSONChunkParser_Free(p);
+            str = sdsempty();
+            SerializeNodeToJSON(m, &opt, &str);
+            mu_check(!strcmp(expected, str));
+            sdsfree(str);
+            Node_Free(m);
+        }
+        sdsfree(expected);
+    }
+
+    // errors are reported as the chunk that has them is fed, and incomplete values when finished
+    JSONChunkParser *p = NewJSONChunkParser();
+    mu_check(JSONOBJECT_OK == JSONChunkParser_Feed(p, "[1, 2", 5, NULL));
+    err = NULL;
+    mu_check(JSONOBJECT_ERROR == JSONChunkParser_Feed(p, "x]", 2, &err));
+    mu_check(err && !strncmp("ERR JSON lexer error", err, 20));
+    free(err);
+    mu_check(JSONOBJECT_ERROR == JSONChunkParser_Finish(p, &m, NULL));
+    JSONChunkParser_Free(p);
+
+    p = NewJSONChunkParser();
+    mu_check(JSONOBJECT_OK == JSONChunkParser_Feed(p, "{\"a\":[1,", 8, NULL));
+    err = NULL;
+    mu_check(JSONOBJECT_ERROR == JSONChunkParser_Finish(p, &m, &err));
+    mu_check(err && !strcmp("ERR JSON value incomplete - 2 containers unterminated", err));
+    free(err);
+    JSONChunkParser_Free(p);
+
+    p = NewJSONChunkParser();
+    mu_check(JSONOBJECT_OK == JSONChunkParser_Feed(p, "  ", 2, NULL));
+    mu_check(JSONOBJECT_ERROR == JSONChunkParser_Finish(p, &m, NULL));
+    JSONChunkParser_Free(p);
+}
+
+MU_TEST(test_jo_create_parallel) {
+    Node *n, *m;
+    sds str, expected;
+    size_t cuts[9], count;
+    char *err, *perr;
+    JSONSerializeOpt opt = {"", "", ""};
+
+    // the split is at the top level only, past strings and their escapes
+    const char *split = " [1, \"a,\\\"]\", [2, 3], {\"b\": [4, 5]}, 6] ";
+    mu_check(4 == JSON_ScanSplit(split, strlen(split), 8, cuts, &count));
+    mu_check(5 == count && 1 == cuts[0] && strlen(split) - 2 == cuts[4]);
+    for (int i = 1; i < 4; i++) mu_check(',' == split[cuts[i]]);
+    mu_check(1 == JSON_ScanSplit(split, strlen(split), 1, cuts, &count));
+    const char *nosplit[] = {"1", "\"a\"", "[]", "{ }", "[1, 2}", "[1, 2] 3", "[1, \"2]", "[[1]",
+                             NULL};
+    for (int i = 0; nosplit[i]; i++)
+        mu_check(0 == JSON_ScanSplit(nosplit[i], strlen(nosplit[i]), 8, cuts, &count));
+
+    // big containers of every kind are the same as when they're parsed by a single thread
+    sds jsons[4];
+    jsons[0] = sdsnew("[");
+    jsons[1] = sdsnew("[");
+    jsons[2] = sdsnew("{");
+    jsons[3] = sdsnew("[");
+    for (int i = 0; i < 1000; i++) {
+        const char *sep = i ? "," : "";
+        jsons[0] = sdscatprintf(jsons[0], "%s%d", sep, i * 1000);
+        jsons[1] = sdscatprintf(jsons[1], "%s%d", sep, i);
+        jsons[2] = sdscatprintf(jsons[2], "%s\"k%d\":{\"v\":[%d,\"s,]\"]}", sep, i % 700, i);
+        if (i == 500) jsons[3] = sdscatprintf(jsons[3], "%s\"x\"", sep);
+        else jsons[3] = sdscatprintf(jsons[3], "%s%d.5", sep, i);
+    }
+    jsons[0] = sdscat(jsons[0], "]");
+    jsons[1] = sdscat(jsons[1], ",1.5]");
+    jsons[2] = sdscat(jsons[2], "}");
+    jsons[3] = sdscat(jsons[3], "]");
+    for (int i = 0; i < 4; i++) {
+        mu_check(JSONOBJECT_OK == CreateNodeFromJSON(jsons[i], sdslen(jsons[i]), &n, NULL));
+        expected = sdsempty();
+        SerializeNodeToJSON(n, &opt, &expected);
+
+        for (int arena = 0; arena < 2; arena++) {
+            NodeArena *a = arena ? NewNodeArena() : NULL;
+            NodeArena *prev = Node_SetArena(a);
+            mu_check(JSONOBJECT_OK ==
+                     CreateNodeFromJSONParallel(jsons[i], sdslen(jsons[i]), 4, &m, NULL));
+            Node_SetArena(prev);
+            mu_check(n->type == m->type && Node_Length(n) == Node_Length(m));
+            mu_check((n->flags & NODE_F_PACKED) == (m->flags & NODE_F_PACKED));
+            str = sdsempty();
+            SerializeNodeToJSON(m, &opt, &str);
+            mu_check(!strcmp(expected, str));
+            sdsfree(str);
+            Node_Free(m);
+            NodeArena_Free(a);
+        }
+        sdsfree(expected);
+        Node_Free(n);
+        sdsfree(jsons[i]);
+    }
+
+    // invalid JSON gives the error of a single parse, whichever range has it
+    const char *bad[] = {"[1, 2, 3, 4, 5, 6, 7, 8, 9, 10, ]", "[1, 2, 3, 4, , 5, 6, 7, 8, 9, 10]",
+                         "[1, 2, 3, 4, 5, 6, 7, 8, 9, 1x]", "{\"a\": 1, \"b\": 2, \"c\": 3, 4}",
+                         "[1, 2, 3, 4, 5, 6, 7, 8, 9, 10} ", NULL};
+    for (int i = 0; bad[i]; i++) {
+        err = perr = NULL;
+        mu_check(JSONOBJECT_ERROR == CreateNodeFromJSON(bad[i], strlen(bad[i]), &n, &err));
+        mu_check(JSONOBJECT_ERROR ==
+                 CreateNodeFromJSONParallel(bad[i], strlen(bad[i]), 3, &n, &perr));
+        mu_check(err && perr && !strcmp(err, perr));
+        free(err);
+        free(perr);
+    }
+}
+
+MU_TEST(test_jo_binary) {
+    Node *n, *m;
+    sds str, bin;
+    JSONSerializeOpt opt = {"", "", ""};
+    const char *jsons[] = {
+        "null", "true", "-16", "111", "112", "-9223372036854775808", "0.1", "\"\"", "{}", "[]",
+        "\"a string that is too long to be encoded with its length in the tag\"",
+        "[1,-2,300000,9223372036854775807]", "[0.5,-1e+300]", "[1,2.5,\"x\",null,false]",
+        "{" _JSTR(a) ":{" _JSTR(b) ":[[],{},[{" _JSTR(c) ":[1,2]}]]}," _JSTR(d) ":{}}", NULL};
+
+    for (int i = 0; jsons[i]; i++) {
+        mu_check(JSONOBJECT_OK == CreateNodeFromJSON(jsons[i], strlen(jsons[i]), &n, NULL));
+        bin = sdsempty();
+        SerializeNodeToBinary(n, &bin);
+        mu_check(OBJ_OK == CreateNodeFromBinary(bin, sdslen(bin), &m));
+        str = sdsempty();
+        SerializeNodeToJSON(m, &opt, &str);
+        mu_check(!strcmp(jsons[i], str));
+        if (n && N_ARRAY == n->type)
+            mu_check((n->flags & NODE_F_PACKED) == (m->flags & NODE_F_PACKED));
+        Node_Free(m);
+
+        // truncated or padded encodings are invalid
+        for (size_t len = 0; len < sdslen(bin); len++)
+            mu_check(OBJ_ERR == CreateNodeFromBinary(bin, len, &m));
+        bin = sdscatlen(bin, "", 1);
+        mu_check(OBJ_ERR == CreateNodeFromBinary(bin, sdslen(bin), &m));
+
+        sdsfree(str);
+        sdsfree(bin);
+        Node_Free(n);
+    }
+
+    // small values take a byte
+    n = NewDictNode(1);
+    Node_DictSet(n, "k", NewIntNode(7));
+    bin = sdsempty();
+    SerializeNodeToBinary(n, &bin);
+    mu_check(5 == sdslen(bin));
+    sdsfree(bin);
+    Node_Free(n);
+}
+
+MU_TEST(test_jo_pack) {
+    Node *n, *m;
+    sds str, buf;
+    char *err;
+    JSONSerializeOpt opt = {"", "", ""};
+    const char *jsons[] = {
+        "null", "true", "-32", "-33", "127", "128", "-9223372036854775808", "4294967296", "0.1",
+        "\"\"", "{}", "[]",
+        "\"a string that is too long to be encoded with its length in the tag\"",
+        "[1,-2,300000,9223372036854775807]", "[0.5,-1e+300]", "[1,2.5,\"x\",null,false]",
+        "{" _JSTR(a) ":{" _JSTR(b) ":[[],{},[{" _JSTR(c) ":[1,2]}]]}," _JSTR(d) ":{}}", NULL};
+
+    for (int f = PACK_MSGPACK; f <= PACK_CBOR; f++) {
+        for (int i = 0; jsons[i]; i++) {
+            mu_check(JSONOBJECT_OK == CreateNodeFromJSON(jsons[i], strlen(jsons[i]), &n, NULL));
+            buf = sdsempty();
+            SerializeNodeToPack(n, f, &buf);
+            mu_check(OBJ_OK == CreateNodeFromPack(buf, sdslen(buf), f, &m, NULL));
+            str = sdsempty();
+            SerializeNodeToJSON(m, &opt, &str);
+            mu_check(!strcmp(jsons[i], str));
+            Node_Free(m);
+
+            // truncated or padded encodings are invalid
+            for (size_t len = 0; len < sdslen(buf); len++)
+                mu_check(OBJ_ERR == CreateNodeFromPack(buf, len, f, &m, NULL));
+            buf = sdscatlen(buf, "", 1);
+            mu_check(OBJ_ERR == CreateNodeFromPack(buf, sdslen(buf), f, &m, NULL));
+
+            sdsfree(str);
+            sdsfree(buf);
+            Node_Free(n);
+        }
+    }
+
+    // encodings from other encoders
+    struct {
+        PackFormat format;
+        const char *buf;
+        size_t len;
+        const char *json;
+    } valid[] = {
+        {PACK_MSGPACK, "\x81\xa1" "a\x01", 4, "{\"a\":1}"},
+        {PACK_MSGPACK, "\xca\x3f\xc0\x00\x00", 5, "1.5"},
+        {PACK_MSGPACK, "\xc4\x02hi", 4, "\"hi\""},
+        {PACK_MSGPACK, "\xdc\x00\x01\xd0\xff", 5, "[-1]"},
+        {PACK_CBOR, "\x82\x01\x82\x02\x03", 5, "[1,[2,3]]"},
+        {PACK_CBOR, "\x9f\x01\x9f\xff\xff", 5, "[1,[]]"},
+        {PACK_CBOR, "\xbf\x61" "a\xf9\x3c\x00\xff", 7, "{\"a\":1}"},
+        {PACK_CBOR, "\xc1\x1a\x51\x4b\x67\xb0", 6, "1363896240"},
+        {PACK_CBOR, "\x3b\x7f\xff\xff\xff\xff\xff\xff\xff", 9, "-9223372036854775808"},
+    };
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+        mu_check(OBJ_OK ==
+                 CreateNodeFromPack(valid[i].buf, valid[i].len, valid[i].format, &n, NULL));
+        str = sdsempty();
+        SerializeNodeToJSON(n, &opt, &str);
+        mu_check(!strcmp(valid[i].json, str));
+        sdsfree(str);
+        Node_Free(n);
+    }
+
+    // values that JSON can't hold
+    struct {
+        PackFormat format;
+        const char *buf;
+        size_t len;
+    } invalid[] = {
+        {PACK_MSGPACK, "\x81\x01\x01", 3},                         // a key that isn't a string
+        {PACK_MSGPACK, "\xcf\x80\x00\x00\x00\x00\x00\x00\x00", 9},  // out of int64's range
+        {PACK_MSGPACK, "\xd4\x01\x00", 3},                         // an extension type
+        {PACK_MSGPACK, "\xdd\xff\xff\xff\xff", 5},                 // a length that's too big
+        {PACK_CBOR, "\xf9\x7c\x00", 3},                            // an infinity
+        {PACK_CBOR, "\xf7", 1},                                    // undefined
+        {PACK_CBOR, "\x7f\x61" "a\xff", 4},                        // an indefinite length string
+        {PACK_CBOR, "\x81\xff", 2},                                // a break out of place
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        err = NULL;
+        mu_check(OBJ_ERR ==
+                 CreateNodeFromPack(invalid[i].buf, invalid[i].len, invalid[i].format, &n, &err));
+        mu_check(err && !strncmp("ERR invalid ", err, 12));
+        free(err);
+    }
+
+    // nesting is as limited as JSON's
+    buf = sdsempty();
+    for (int i = 0; i < PACK_MAX_DEPTH; i++) buf = sdscatlen(buf, "\x81", 1);
+    buf = sdscatlen(buf, "\x01", 1);
+    mu_check(OBJ_ERR == CreateNodeFromPack(buf, sdslen(buf), PACK_CBOR, &n, NULL));
+    mu_check(OBJ_OK == CreateNodeFromPack(buf + 2, sdslen(buf) - 2, PACK_CBOR, &n, NULL));
+    Node_Free(n);
+    sdsfree(buf);
+}
+
+MU_TEST(test_jo_compressed_strings) {
+    Node *n, *m, *s;
+    sds json = sdsnew("{" _JSTR(long) ":\""), out[3], expected[3];
+    JSONSerializeOpt opt = {"", "", ""};
+
+    for (int i = 0; i < 100; i++) json = sdscat(json, "a \\\"quoted\\\" value, ");
+    json = sdscat(json, "\"," _JSTR(short) ":\"value\"}");
+
+    // the serializations of the values are the same when their strings are compressed
+    for (int c = 0; c < 2; c++) {
+        NodeStringCompressSize = c ? 64 : 0;
+        mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, sdslen(json), &n, NULL));
+        mu_check(OBJ_OK == Node_DictGet(n, "long", &s));
+        mu_check(c == !!(s->flags & NODE_F_COMPRESSED));
+        mu_assert_int_eq(1800, Node_Length(s));
+        out[0] = sdsempty();
+        SerializeNodeToJSON(n, &opt, &out[0]);
+        out[1] = sdsempty();
+        SerializeNodeToBinary(n, &out[1]);
+        out[2] = sdsempty();
+        SerializeNodeToPack(n, PACK_MSGPACK, &out[2]);
+        mu_check(!strcmp(json, out[0]));
+        Node_Free(n);
+        if (!c) {
+            for (int i = 0; i < 3; i++) expected[i] = out[i];
+            continue;
+        }
+
+        // loading the binary encoding compresses the strings again
+        mu_check(OBJ_OK == CreateNodeFromBinary(out[1], sdslen(out[1]), &m));
+        mu_check(OBJ_OK == Node_DictGet(m, "long", &s));
+        mu_check(s->flags & NODE_F_COMPRESSED);
+        Node_Free(m);
+        for (int i = 0; i < 3; i++) {
+            mu_check(sdslen(expected[i]) == sdslen(out[i]));
+            mu_check(!memcmp(expected[i], out[i], sdslen(out[i])));
+            sdsfree(expected[i]);
+            sdsfree(out[i]);
+        }
+    }
+    NodeStringCompressSize = 0;
+    sdsfree(json);
+}
+
+MU_TEST(test_oj_binary_layout) {
+    const char *json = "[{\"a\":1,\"b\":\"x\"},{\"a\":2000,\"b\":[true]},\"str\",[],{},"
+                       "null,3.5,{\"c\":{\"d\":1}}]";
+    JSONSerializeOpt opt = {"", "", ""};
+    Node *n, *root;
+    sds bin = sdsempty(), str;
+
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
+    SerializeNodeToBinary(n, &bin);
+    Node_Free(n);
+
+    // loaded in an arena, the nodes of an array's items and of a dictionary's keyvals are in a row
+    NodeArena *arena = NewNodeArena();
+    NodeArena *prev = Node_SetArena(arena);
+    mu_check(OBJ_OK == CreateNodeFromBinary(bin, sdslen(bin), &root));
+    Node_SetArena(prev);
+    Node **items = root->value.arrval.entries;
+    for (int i = 0; i < 4; i++) mu_check(items[i + 1] == items[i] + 1);
+    // null doesn't take a slot
+    mu_check(items[6] == items[4] + 1);
+    mu_check(items[7] == items[6] + 1);
+    Node **kvs = items[0]->value.dictval.entries;
+    mu_check(kvs[1] == kvs[0] + 1);
+    str = sdsempty();
+    SerializeNodeToJSON(root, &opt, &str);
+    mu_check(!strcmp(str, json));
+    sdsfree(str);
+
+    // the nodes can still be replaced, deleted and added
+    Node_ArrayDelRange(root, 1, 2);
+    Node_ArraySet(root, 0, NewStringNode("y", 1));
+    Node *sub = NewArrayNode(1);
+    Node_ArrayAppend(sub, Node_Clone(root));
+    Node_ArrayInsert(root, 0, sub);
+    Node_DictSet(root->value.arrval.entries[6], "c", NewIntNode(5000));
+    str = sdsempty();
+    SerializeNodeToJSON(root, &opt, &str);
+    mu_check(!strcmp(str, "[[\"y\",[],{},null,3.5,{\"c\":{\"d\":1}}],\"y\",[],{},null,3.5,"
+                          "{\"c\":5000}]"));
+    sdsfree(str);
+
+    Node_Free(root);
+    NodeArena_Free(arena);
+    sdsfree(bin);
+}
+
+MU_TEST(test_oj_binary) {
+    Node *n;
+    sds str, bin, expected;
+    JSONSerializeOpt opts[] = {{"", "", ""}, {"\t", "\n", " "}};
+    const char *jsons[] = {
+        "null", "false", "-16", "-9223372036854775808", "0.1", "\"\\u0001\\\\\"", "{}", "[]",
+        "[1,-2,300000]", "[0.5,-1e+300]", "[1,2.5,\"x\",null,[true]]",
+        "{" _JSTR(a) ":{" _JSTR(b) ":[[],{},[{" _JSTR(c) ":[1,2]}]]}," _JSTR(d) ":{}}", NULL};
+
+    for (int i = 0; jsons[i]; i++) {
+        mu_check(JSONOBJECT_OK == CreateNodeFromJSON(jsons[i], strlen(jsons[i]), &n, NULL));
+        bin = sdsempty();
+        SerializeNodeToBinary(n, &bin);
+        mu_check(OBJ_OK == ValidateBinary(bin, sdslen(bin)));
+        for (int j = 0; j < 2; j++) {
+            expected = sdsempty();
+            SerializeNodeToJSON(n, &opts[j], &expected);
+            str = sdsnew("prefix");
+            mu_check(JSONOBJECT_OK == SerializeBinaryToJSON(bin, sdslen(bin), &opts[j], &str));
+            mu_check(sdslen(str) == 6 + sdslen(expected));
+            mu_check(!strcmp(str + 6, expected));
+            sdsfree(expected);
+            sdsfree(str);
+        }
+
+        // truncated or padded encodings are invalid, and nothing is written for them
+        str = sdsempty();
+        for (size_t len = 0; len < sdslen(bin); len++) {
+            mu_check(JSONOBJECT_ERROR == SerializeBinaryToJSON(bin, len, &opts[0], &str));
+            mu_check(OBJ_ERR == ValidateBinary(bin, len));
+        }
+        bin = sdscatlen(bin, "", 1);
+        mu_check(JSONOBJECT_ERROR == SerializeBinaryToJSON(bin, sdslen(bin), &opts[0], &str));
+        mu_check(OBJ_ERR == ValidateBinary(bin, sdslen(bin)));
+        mu_check(!sdslen(str));
+
+        sdsfree(str);
+        sdsfree(bin);
+        Node_Free(n);
+    }
+
+    // containers that are nested deeper than the validation tracks inline
+    bin = sdsempty();
+    for (int i = 0; i < 100; i++)
+        bin = i % 2 ? sdscatlen(bin, "\x06\x01\x01k", 4) : sdscatlen(bin, "\x07\x01", 2);
+    bin = sdscatlen(bin, "\x00", 1);
+    mu_check(OBJ_OK == ValidateBinary(bin, sdslen(bin)));
+    mu_check(OBJ_ERR == ValidateBinary(bin, sdslen(bin) - 1));
+    sdsfree(bin);
+}
+
+/* Parses a document and a patch, applies it with JSONPatch_Apply, or merges it if merge is set, and
+ * returns the compact JSON of the result or of NULL if the patch fails */
+static sds _patchJSON(const char *json, const char *patch, int merge) {
+    Node *doc, *p;
+    JSONSerializeOpt opt = {"", "", ""};
+    char *err = NULL;
+
+    assert(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &doc, NULL));
+    assert(JSONOBJECT_OK == CreateNodeFromJSON(patch, strlen(patch), &p, NULL));
+    if (merge) {
+        Node *m = JSONPatch_Merge(doc, p);
+        if (m != doc) Node_Free(doc);
+        doc = m;
+    } else if (OBJ_OK != JSONPatch_Apply(&doc, p, &err)) {
+        assert(err && !strncmp(err, "ERR ", 4));
+        free(err);
+        sds ret = sdsempty();
+        SerializeNodeToJSON(doc, &opt, &ret);
+        Node_Free(doc);
+
+        // a failed patch leaves the document as it was
+        assert(!strcmp(ret, json));
+        sdsfree(ret);
+        return NULL;
+    }
+    sds ret = sdsempty();
+    SerializeNodeToJSON(doc, &opt, &ret);
+    Node_Free(doc);
+    return ret;
+}
+
+MU_TEST(test_oj_merge_patch) {
+    const char *cases[][3] = {
+        // RFC 7386's examples
+        {"{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+        {"{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}"},
+        {"{\"a\":\"b\"}", "{\"a\":null}", "{}"},
+        {"{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}"},
+        {"{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+        {"{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}"},
+        {"{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}", "{\"a\":{\"b\":\"d\"}}"},
+        {"{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}"},
+        {"[\"a\",\"b\"]", "[\"c\",\"d\"]", "[\"c\",\"d\"]"},
+        {"{\"a\":\"b\"}", "[\"c\"]", "[\"c\"]"},
+        {"{\"a\":\"foo\"}", "null", "null"},
+        {"{\"a\":\"foo\"}", "\"bar\"", "\"bar\""},
+        {"{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}"},
+        {"[1,2]", "{\"a\":\"b\",\"c\":null}", "{\"a\":\"b\"}"},
+        {"{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}"},
+        {NULL, NULL, NULL}};
+
+    for (int i = 0; cases[i][0]; i++) {
+        sds ret = _patchJSON(cases[i][0], cases[i][1], 1);
+        mu_check(!strcmp(cases[i][2], ret));
+        sdsfree(ret);
+    }
+}
+
+/* The documents that references resolve to in test_oj_keyrefs, and the number of fetches */
+static const char *_refKeys[] = {"a", "b", "c"};
+static Node *_refDocs[3];
+static int _refFetches;
+
+static const Node *_fetchRef(const char *key, size_t len, void *ctx) {
+    _refFetches++;
+    for (int i = 0; i < 3; i++) {
+        if (len == strlen(_refKeys[i]) && !memcmp(key, _refKeys[i], len)) return _refDocs[i];
+    }
+    return NULL;
+}
+
+/* Serializes a value of the document at key a with its references resolved */
+static sds _resolve(const Node *n, int depth, size_t *fetched) {
+    JSONSerializeOpt opt = {0};
+    KeyRefResolver *r = NewKeyRefResolver("a", 1, depth, _fetchRef, NULL);
+    JSONSerializer *s = NewJSONSerializer(&opt, sdsempty());
+    JSONSerializer_SetWriter(s, KeyRefResolver_Write, r);
+    JSONSerializer_Value(s, n);
+    *fetched = KeyRefResolver_Fetched(r);
+    KeyRefResolver_Free(r);
+    return JSONSerializer_Free(s);
+}
+
+MU_TEST(test_oj_keyrefs) {
+    const char *jsons[] = {
+        "{\"name\":\"a\",\"friend\":{\"$ref\":\"b\"},\"self\":{\"$ref\":\"a\"},\"n\":[1,2]}",
+        "{\"name\":\"b\",\"friend\":{\"$ref\":\"c\"},\"back\":{\"$ref\":\"a\"}}",
+        "[1,{\"$ref\":\"b\"},{\"$ref\":\"nosuch\"},{\"$ref\":1},{\"$ref\":\"c\",\"x\":1}]"};
+    for (int i = 0; i < 3; i++)
+        mu_check(JSONOBJECT_OK == CreateNodeFromJSON(jsons[i], strlen(jsons[i]), &_refDocs[i], NULL));
+    mu_check(KeyRef_Target(_refDocs[0]->value.dictval.entries[1]->value.kvval.val));
+    mu_check(!KeyRef_Target(_refDocs[0]));
+
+    // references that go deeper or back to a document being resolved are kept, missing keys are null
+    struct {
+        int depth;
+        const char *expected;
+        size_t fetched;
+    } cases[] = {
+        {1, "{\"name\":\"a\",\"friend\":{\"name\":\"b\",\"friend\":{\"$ref\":\"c\"},"
+            "\"back\":{\"$ref\":\"a\"}},\"self\":{\"$ref\":\"a\"},\"n\":[1,2]}", 1},
+        {3, "{\"name\":\"a\",\"friend\":{\"name\":\"b\",\"friend\":[1,{\"$ref\":\"b\"},null,"
+            "{\"$ref\":1},{\"$ref\":\"c\",\"x\":1}],\"back\":{\"$ref\":\"a\"}},"
+            "\"self\":{\"$ref\":\"a\"},\"n\":[1,2]}", 3},
+    };
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        size_t fetched;
+        _refFetches = 0;
+        sds json = _resolve(_refDocs[0], cases[i].depth, &fetched);
+        mu_check(!strcmp(cases[i].expected, json));
+        mu_check(cases[i].fetched == fetched);
+        mu_check(cases[i].fetched == _refFetches);
+        sdsfree(json);
+    }
+
+    // values without references are serialized as they are, and a reference can be the value
+    size_t fetched;
+    sds json = _resolve(_refDocs[0]->value.dictval.entries[3]->value.kvval.val, 2, &fetched);
+    mu_check(!strcmp("[1,2]", json));
+    mu_check(0 == fetched);
+    sdsfree(json);
+    json = _resolve(_refDocs[1]->value.dictval.entries[1]->value.kvval.val, 1, &fetched);
+    mu_check(!strcmp("[1,{\"$ref\":\"b\"},{\"$ref\":\"nosuch\"},{\"$ref\":1},"
+                     "{\"$ref\":\"c\",\"x\":1}]", json));
+    mu_check(1 == fetched);
+    sdsfree(json);
+
+    for (int i = 0; i < 3; i++) Node_Free(_refDocs[i]);
+}
+
+MU_TEST(test_oj_schema) {
+    const char *json =
+        "{\"type\":\"object\",\"required\":[\"id\",\"tags\"],\"additionalProperties\":false,"
+        "\"properties\":{\"id\":{\"type\":\"integer\",\"minimum\":1},"
+        "\"name\":{\"type\":\"string\",\"minLength\":2,\"maxLength\":4},"
+        "\"score\":{\"type\":\"number\",\"exclusiveMaximum\":10,\"multipleOf\":0.5},"
+        "\"kind\":{\"enum\":[\"a\",1,null,true]},"
+        "\"tags\":{\"type\":\"array\",\"minItems\":3,\"maxItems\":5,\"items\":{\"type\":\"integer\"}},"
+        "\"any\":true,\"none\":false}}";
+    Node *root;
+    char *err = NULL;
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &root, NULL));
+    JSONSchema *schema = NewJSONSchema(root, NULL);
+    mu_check(schema);
+    Node_Free(root);
+
+    struct {
+        const char *json;
+        int valid;
+    } cases[] = {
+        {"{\"id\":1,\"tags\":[1,2,3]}", 1},
+        {"{\"id\":1,\"name\":\"\\u00e9t\\u00e9\",\"score\":9.5,\"kind\":1.0,\"tags\":[1,2,3],\"any\":[{}]}", 1},
+        {"{\"id\":2.0,\"kind\":null,\"tags\":[1,2,3,4,5]}", 1},
+        {"{\"tags\":[1,2,3]}", 0},
+        {"{\"id\":0,\"tags\":[1,2,3]}", 0},
+        {"{\"id\":1.5,\"tags\":[1,2,3]}", 0},
+        {"{\"id\":1,\"name\":\"a\",\"tags\":[1,2,3]}", 0},
+        {"{\"id\":1,\"name\":\"abcde\",\"tags\":[1,2,3]}", 0},
+        {"{\"id\":1,\"name\":\"\\u00e9\",\"tags\":[1,2,3]}", 0},
+        {"{\"id\":1,\"score\":10,\"tags\":[1,2,3]}", 0},
+        {"{\"id\":1,\"score\":1.2,\"tags\":[1,2,3]}", 0},
+        {"{\"id\":1,\"kind\":\"b\",\"tags\":[1,2,3]}", 0},
+        {"{\"id\":1,\"kind\":false,\"tags\":[1,2,3]}", 0},
+        {"{\"id\":1,\"tags\":[1,2]}", 0},
+        {"{\"id\":1,\"tags\":[1,2,\"3\"]}", 0},
+        {"{\"id\":1,\"tags\":[1,2,3],\"none\":1}", 0},
+        {"{\"id\":1,\"tags\":[1,2,3],\"other\":1}", 0},
+        {"[1]", 0},
+        {"1", 0},
+    };
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        Node *n = NULL;
+        int ret = CreateNodeFromJSONSchema(cases[i].json, strlen(cases[i].json), schema, &n, &err);
+        mu_check((JSONOBJECT_OK == ret) == cases[i].valid);
+        if (JSONOBJECT_OK == ret) {
+            const char *why;
+            mu_check(OBJ_OK == JSONSchema_Validate(schema, n, &why));
+            Node_Free(n);
+        } else {
+            mu_check(err && !strncmp("ERR JSON value doesn't match the schema", err, 39));
+            free(err);
+            err = NULL;
+
+            // values that are built without the schema fail its validation the same
+            const char *why;
+            mu_check(JSONOBJECT_OK == CreateNodeFromJSON(cases[i].json, strlen(cases[i].json), &n, NULL));
+            mu_check(OBJ_ERR == JSONSchema_Validate(schema, n, &why));
+            Node_Free(n);
+        }
+    }
+
+    // invalid JSON fails as it does without a schema
+    Node *n = NULL;
+    mu_check(JSONOBJECT_ERROR == CreateNodeFromJSONSchema("{\"id\":", 6, schema, &n, &err));
+    mu_check(!strncmp("ERR JSON value incomplete", err, 25));
+    free(err);
+    JSONSchema_Free(schema);
+
+    // the containers are created with room for the entries that the schema guarantees
+    json = "{\"required\":[\"k0\",\"k1\",\"k2\",\"k3\",\"k4\",\"k5\",\"k6\",\"k7\",\"k8\",\"k9\",\"k10\","
+           "\"k11\",\"k12\",\"k13\",\"k14\",\"k15\",\"k16\",\"k17\",\"k18\",\"k19\",\"k20\",\"k21\","
+           "\"k22\",\"k23\",\"k24\",\"k25\",\"k26\",\"k27\",\"k28\",\"k29\",\"k30\",\"k31\"],"
+           "\"properties\":{\"k0\":{\"minItems\":100}}}";
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &root, NULL));
+    schema = NewJSONSchema(root, NULL);
+    Node_Free(root);
+    sds value = sdsnew("{\"k0\":[");
+    for (int i = 0; i < 100; i++) value = sdscatprintf(value, "%s%d", i ? "," : "", i);
+    value = sdscat(value, "]");
+    for (int i = 1; i < 32; i++) value = sdscatprintf(value, ",\"k%d\":%d", i, i);
+    value = sdscat(value, "}");
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSONSchema(value, sdslen(value), schema, &n, NULL));
+    mu_check(n->flags & NODE_F_DICT_INDEXED);
+    mu_check(32 == n->value.dictval.cap);
+    Node *arr;
+    mu_check(OBJ_OK == Node_DictGet(n, "k0", &arr));
+    mu_check(100 == arr->value.arrval.cap && (arr->flags & NODE_F_PACKED_INT));
+    Node_Free(n);
+    sdsfree(value);
+    JSONSchema_Free(schema);
+
+    // unsupported keywords and invalid schemas don't compile, true and false do
+    const char *schemas[] = {"{\"pattern\":\"^a\"}", "{\"items\":[{}]}", "{\"type\":\"int\"}",
+                             "{\"minLength\":-1}", "{\"enum\":[[1]]}", "{\"multipleOf\":0}",
+                             "{\"properties\":{\"a\":1}}", "[]"};
+    for (int i = 0; i < sizeof(schemas) / sizeof(schemas[0]); i++) {
+        mu_check(JSONOBJECT_OK == CreateNodeFromJSON(schemas[i], strlen(schemas[i]), &root, NULL));
+        mu_check(!NewJSONSchema(root, &err));
+        mu_check(err && !strncmp("ERR ", err, 4));
+        free(err);
+        err = NULL;
+        Node_Free(root);
+    }
+    for (int b = 0; b < 2; b++) {
+        Node *bval = NewBoolNode(b);
+        schema = NewJSONSchema(bval, NULL);
+        mu_check(schema);
+        mu_check(b == (JSONOBJECT_OK == CreateNodeFromJSONSchema("[{}]", 4, schema, &n, NULL)));
+        if (b) Node_Free(n);
+        JSONSchema_Free(schema);
+        Node_Free(bval);
+    }
+}
+
+MU_TEST(test_oj_json_patch) {
+    const char *cases[][3] = {
+        {"{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/baz\",\"value\":\"qux\"}]",
+         "{\"foo\":\"bar\",\"baz\":\"qux\"}"},
+        {"{\"foo\":[\"bar\",\"baz\"]}", "[{\"op\":\"add\",\"path\":\"/foo/1\",\"value\":\"qux\"}]",
+         "{\"foo\":[\"bar\",\"qux\",\"baz\"]}"},
+        {"{\"foo\":[1,2]}", "[{\"op\":\"add\",\"path\":\"/foo/-\",\"value\":3}]",
+         "{\"foo\":[1,2,3]}"},
+        {"{\"foo\":[1,2]}", "[{\"op\":\"add\",\"path\":\"/foo/0\",\"value\":[0]}]",
+         "{\"foo\":[[0],1,2]}"},
+        {"{\"baz\":\"qux\",\"foo\":\"bar\"}", "[{\"op\":\"remove\",\"path\":\"/baz\"}]",
+         "{\"foo\":\"bar\"}"},
+        {"{\"foo\":[\"bar\",\"qux\",\"baz\"]}", "[{\"op\":\"remove\",\"path\":\"/foo/1\"}]",
+         "{\"foo\":[\"bar\",\"baz\"]}"},
+        {"{\"baz\":\"qux\",\"foo\":\"bar\"}",
+         "[{\"op\":\"replace\",\"path\":\"/baz\",\"value\":\"boo\"}]",
+         "{\"baz\":\"boo\",\"foo\":\"bar\"}"},
+        {"[1,2,3]", "[{\"op\":\"replace\",\"path\":\"/1\",\"value\":\"x\"}]", "[1,\"x\",3]"},
+        {"{\"foo\":{\"bar\":\"baz\",\"waldo\":\"fred\"},\"qux\":{\"corge\":\"grault\"}}",
+         "[{\"op\":\"move\",\"from\":\"/foo/waldo\",\"path\":\"/qux/thud\"}]",
+         "{\"foo\":{\"bar\":\"baz\"},\"qux\":{\"corge\":\"grault\",\"thud\":\"fred\"}}"},
+        {"{\"foo\":[\"all\",\"grass\",\"cows\",\"eat\"]}",
+         "[{\"op\":\"move\",\"from\":\"/foo/1\",\"path\":\"/foo/3\"}]",
+         "{\"foo\":[\"all\",\"cows\",\"eat\",\"grass\"]}"},
+        {"{\"a\":[1,2.5]}", "[{\"op\":\"copy\",\"from\":\"/a/1\",\"path\":\"/b\"},"
+                            "{\"op\":\"copy\",\"from\":\"/a\",\"path\":\"/a/0\"}]",
+         "{\"a\":[[1,2.5],1,2.5],\"b\":2.5}"},
+        {"{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}",
+         "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"qux\"},"
+         "{\"op\":\"test\",\"path\":\"/foo/1\",\"value\":2.0},"
+         "{\"op\":\"test\",\"path\":\"\",\"value\":{\"foo\":[\"a\",2,\"c\"],\"baz\":\"qux\"}}]",
+         "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}"},
+        {"{\"/\":0,\"m~n\":1}", "[{\"op\":\"replace\",\"path\":\"/~1\",\"value\":2},"
+                               "{\"op\":\"remove\",\"path\":\"/m~0n\"}]",
+         "{\"\\/\":2}"},
+        {"{\"a\":1}", "[{\"op\":\"replace\",\"path\":\"\",\"value\":[true]},"
+                     "{\"op\":\"add\",\"path\":\"/0\",\"value\":null}]",
+         "[null,true]"},
+        {"{\"a\":1}", "[]", "{\"a\":1}"},
+
+        // failures, after which the document is unchanged
+        {"{\"a\":1}", "{\"op\":\"add\",\"path\":\"/b\",\"value\":1}", NULL},
+        {"{\"a\":1}", "[{\"op\":\"frob\",\"path\":\"/b\"}]", NULL},
+        {"{\"a\":1}", "[{\"op\":\"add\",\"path\":\"/b\"}]", NULL},
+        {"{\"a\":1}", "[{\"op\":\"add\",\"path\":\"b\",\"value\":1}]", NULL},
+        {"{\"a\":1}", "[{\"op\":\"add\",\"path\":\"/b/c\",\"value\":1}]", NULL},
+        {"{\"a\":1}", "[{\"op\":\"remove\",\"path\":\"/b\"}]", NULL},
+        {"{\"a\":1}", "[{\"op\":\"remove\",\"path\":\"\"}]", NULL},
+        {"{\"a\":1}", "[{\"op\":\"replace\",\"path\":\"/b\",\"value\":1}]", NULL},
+        {"{\"a\":1}", "[{\"op\":\"test\",\"path\":\"/a\",\"value\":\"1\"}]", NULL},
+        {"{\"a\":1}", "[{\"op\":\"add\",\"path\":\"/a~2\",\"value\":1}]", NULL},
+        {"[1,2]", "[{\"op\":\"add\",\"path\":\"/3\",\"value\":1}]", NULL},
+        {"[1,2]", "[{\"op\":\"add\",\"path\":\"/01\",\"value\":1}]", NULL},
+        {"[1,2]", "[{\"op\":\"remove\",\"path\":\"/-\"}]", NULL},
+        {"{\"a\":{\"b\":1}}", "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/a/c\"}]", NULL},
+        {"{\"a\":[1,2]}", "[{\"op\":\"remove\",\"path\":\"/a/0\"},"
+                         "{\"op\":\"add\",\"path\":\"/b\",\"value\":{}},"
+                         "{\"op\":\"test\",\"path\":\"/a\",\"value\":[1]}]",
+         NULL},
+        {"{\"a\":[1,2]}", "[{\"op\":\"move\",\"from\":\"/a/0\",\"path\":\"/x/y\"}]", NULL},
+        {NULL, NULL, NULL}};
+
+    for (int i = 0; cases[i][0]; i++) {
+        sds ret = _patchJSON(cases[i][0], cases[i][1], 0);
+        if (cases[i][2]) {
+            mu_check(ret && !strcmp(cases[i][2], ret));
+        } else {
+            mu_check(!ret);
+        }
+        sdsfree(ret);
+    }
+}
+
 MU_TEST_SUITE(test_json_literals) {
     MU_RUN_TEST(test_jo_create_literal_null);
     MU_RUN_TEST(test_jo_create_literal_true);
     MU_RUN_TEST(test_jo_create_literal_false);
     MU_RUN_TEST(test_jo_create_literal_integer);
     MU_RUN_TEST(test_jo_create_literal_double);
+    MU_RUN_TEST(test_jo_number_text);
     MU_RUN_TEST(test_jo_create_literal_string);
     MU_RUN_TEST(test_jo_create_literal_dict);
     MU_RUN_TEST(test_jo_create_literal_array);
 }
 
-MU_TEST_SUITE(test_json_object) { MU_RUN_TEST(test_jo_create_object); }
+MU_TEST(test_jo_stats) {
+    Node *n, *m;
+    StatsCounters c;
+    const char *json = "{" _JSTR(foo) ":[1,2," _JSTR(bar) "]}";
+    JSONSerializeOpt opt = {"", "", ""};
+    sds out = sdsempty();
+
+    Stats_Reset();
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
+    mu_check(JSONOBJECT_ERROR == CreateNodeFromJSON("[1,", 3, &m, NULL));
+    SerializeNodeToJSON(n, &opt, &out);
+    Node_Free(n);
+
+    Stats_Get(STATS_PARSE, &c);
+    mu_assert_int_eq(2, c.calls);
+    mu_assert_int_eq(1, c.errors);
+    mu_assert_int_eq(strlen(json) + 3, c.bytes);
+    // the dict, its key-value, the array and the string, as small integers are shared
+    mu_check(c.nodes >= 4);
+    uint64_t total = 0;
+    for (int i = 0; i < STATS_LATENCY_BUCKETS; i++) total += c.latency[i];
+    mu_assert_int_eq(2, total);
+
+    Stats_Get(STATS_SERIALIZE, &c);
+    mu_assert_int_eq(1, c.calls);
+    mu_assert_int_eq(0, c.errors);
+    mu_assert_int_eq(sdslen(out), c.bytes);
+    sdsfree(out);
+
+    Stats_Reset();
+    Stats_Get(STATS_PARSE, &c);
+    mu_assert_int_eq(0, c.calls);
+    mu_assert_int_eq(0, c.bytes);
+}
+
+/* A defragmentation's allocator that moves every allocation, and counts the moves */
+static void *__defragMove(void *ptr, void *ctx) {
+    size_t size = malloc_usable_size(ptr);
+    void *moved = malloc(size);
+    memcpy(moved, ptr, size);
+    free(ptr);
+    ++*(size_t *)ctx;
+    return moved;
+}
+
+static int __defragStop(void *ctx) { return 1; }
+
+MU_TEST(test_jo_defrag) {
+    Node *n, *m;
+    JSONSerializeOpt opt = {"", "", ""};
+    sds json = sdsnew("{");
+    for (int i = 0; i < 100; i++) {
+        json = sdscatprintf(json,
+                            "%s" _JSTR(k%d) ":{" _JSTR(s) ":" _JSTR(short) "," _JSTR(l) ":"
+                            _JSTR(a string that is too long to be inlined) "," _JSTR(n) ":1.50,"
+                            _JSTR(i) ":[1,2,3]," _JSTR(a) ":[null,true," _JSTR(x) ",-5000]}",
+                            i ? "," : "", i);
+    }
+    json = sdscat(json, "}");
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, sdslen(json), &n, NULL));
+    sdsfree(json);
+
+    // a string with room and an array with a head gap
+    mu_check(OBJ_OK == Node_DictGet(n, "k1", &m));
+    mu_check(OBJ_OK == Node_DictGet(m, "l", &m));
+    Node *tail = NewCStringNode(", appended to");
+    mu_check(OBJ_OK == Node_StringAppend(m, tail));
+    Node_Free(tail);
+    mu_check(m->flags & NODE_F_STRING_ROOM);
+    mu_check(OBJ_OK == Node_DictGet(n, "k2", &m));
+    mu_check(OBJ_OK == Node_DictGet(m, "a", &m));
+    mu_check(OBJ_OK == Node_ArrayDelRange(m, 0, 1));
+    mu_check(Node_ArrayGap(m) > 0);
+
+    sds expected = sdsempty(), out = sdsempty();
+    SerializeNodeToJSON(n, &opt, &expected);
+
+    // a walk without stops moves everything at once
+    size_t moves = 0;
+    Node *root = n;
+    NodeDefragCursor c = {0};
+    NodeDefragOpt o = {.alloc = __defragMove, .ctx = &moves};
+    mu_check(1 == Node_Defrag(&n, &c, &o));
+    mu_check(n != root && moves == o.moved && o.bytes > 0);
+    mu_check(o.nodes > 100 * 8 && !c.started);
+    SerializeNodeToJSON(n, &opt, &out);
+    mu_check(!strcmp(expected, out));
+
+    // a walk that stops every time resumes where it stopped, though the tree changes meanwhile
+    int calls = 0;
+    o = (NodeDefragOpt){.alloc = __defragMove, .stop = __defragStop, .ctx = &moves};
+    while (!Node_Defrag(&n, &c, &o)) {
+        if (++calls == 5) {
+            mu_check(OBJ_OK == Node_DictDel(n, "k0"));
+            mu_check(OBJ_OK == Node_DictDel(n, "k99"));
+        }
+    }
+    mu_check(calls > (int)(o.nodes / OBJECT_DEFRAG_STOP_INTERVAL) - 2);
+    mu_check(o.nodes > 98 * 8);
+    mu_check(OBJ_OK == Node_DictGet(n, "k1", &m));
+    mu_check(OBJ_OK == Node_DictGet(m, "l", &m));
+    mu_check(!strcmp("a string that is too long to be inlined, appended to", m->value.strval.data));
+    mu_check(OBJ_OK == Node_DictGet(n, "k2", &m));
+    mu_check(OBJ_OK == Node_DictGet(m, "a", &m));
+    mu_assert_int_eq(3, Node_Length(m));
+    mu_check(OBJ_ERR == Node_DictGet(n, "k0", &m));
+    mu_assert_int_eq(98, Node_Length(n));
+    NodeDefragCursor_Free(&c);
+    Node_Free(n);
+
+    // what's in an arena stays there
+    NodeArena *a = NewNodeArena();
+    NodeArena *prev = Node_SetArena(a);
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(expected, sdslen(expected), &n, NULL));
+    Node_SetArena(prev);
+    root = n;
+    moves = 0;
+    o = (NodeDefragOpt){.alloc = __defragMove, .ctx = &moves};
+    mu_check(1 == Node_Defrag(&n, &c, &o));
+    mu_check(n == root && 0 == moves);
+    NodeDefragCursor_Free(&c);
+    Node_Free(n);
+    NodeArena_Free(a);
+    sdsfree(expected);
+    sdsfree(out);
+}
+
+MU_TEST_SUITE(test_json_object) {
+    MU_RUN_TEST(test_jo_create_object);
+    MU_RUN_TEST(test_jo_create_arena);
+    MU_RUN_TEST(test_jo_create_packed_array);
+    MU_RUN_TEST(test_jo_create_direct);
+    MU_RUN_TEST(test_jo_lexer_pool);
+    MU_RUN_TEST(test_jo_create_scalar);
+    MU_RUN_TEST(test_jo_validate);
+    MU_RUN_TEST(test_jo_create_chunked);
+    MU_RUN_TEST(test_jo_create_parallel);
+    MU_RUN_TEST(test_jo_binary);
+    MU_RUN_TEST(test_jo_pack);
+    MU_RUN_TEST(test_jo_compressed_strings);
+    MU_RUN_TEST(test_jo_stats);
+    MU_RUN_TEST(test_jo_defrag);
+}
 
 MU_TEST_SUITE(test_object_to_json) {
     MU_RUN_TEST(test_oj_null);
     MU_RUN_TEST(test_oj_boolean);
     MU_RUN_TEST(test_oj_integer);
+    MU_RUN_TEST(test_oj_double);
     MU_RUN_TEST(test_oj_string);
     MU_RUN_TEST(test_oj_keyval);
     MU_RUN_TEST(test_oj_dict);
+    MU_RUN_TEST(test_oj_keyvalues);
+    MU_RUN_TEST(test_oj_serializer);
+    MU_RUN_TEST(test_oj_serializer_flush);
+    MU_RUN_TEST(test_oj_serializer_deep);
     MU_RUN_TEST(test_oj_array);
     MU_RUN_TEST(test_oj_special_characters);
+    MU_RUN_TEST(test_oj_scan_kernels);
+    MU_RUN_TEST(test_oj_binary);
+    MU_RUN_TEST(test_oj_binary_layout);
+    MU_RUN_TEST(test_oj_merge_patch);
+    MU_RUN_TEST(test_oj_json_patch);
+    MU_RUN_TEST(test_oj_keyrefs);
+    MU_RUN_TEST(test_oj_schema);
 }
 
 int main(int argc, char *argv[]) {
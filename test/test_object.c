@@ -3,7 +3,10 @@
 #include <string.h>
 #include "../src/json_path.h"
 #include "../src/object.h"
+#include "../src/object_search.h"
 #include "../src/path.h"
+#include "../src/path_cache.h"
+#include "../src/serial_cache.h"
 #include "minunit.h"
 
 MU_TEST(testNodeString) {
@@ -183,6 +186,1073 @@ MU_TEST(testObject) {
     Node_Free(root);
 }
 
+MU_TEST(testObjectHashIndex) {
+    char key[32];
+    Node *root = NewDictNode(1), *n;
+    mu_check(NULL != root);
+
+    // grow way past the threshold so the dictionary is indexed and resized a few times
+    const int count = 1000;
+    for (int i = 0; i < count; i++) {
+        sprintf(key, "key%d", i);
+        mu_check(OBJ_OK == Node_DictSet(root, key, NewIntNode(i)));
+    }
+    mu_assert_int_eq(count, Node_Length(root));
+    mu_check(root->flags & NODE_F_DICT_INDEXED);
+    mu_check(Node_DictIndexSize(root) > 0);
+
+    // insertion order is kept
+    for (int i = 0; i < count; i++) {
+        sprintf(key, "key%d", i);
+        mu_check(!strcmp(key, root->value.dictval.entries[i]->value.kvval.key));
+        mu_check(OBJ_OK == Node_DictGet(root, key, &n));
+        mu_check(i == n->value.intval);
+    }
+
+    // replace, delete every other key and verify the rest is still found
+    mu_check(OBJ_OK == Node_DictSet(root, "key0", NewIntNode(-1)));
+    mu_assert_int_eq(count, Node_Length(root));
+    for (int i = 0; i < count; i += 2) {
+        sprintf(key, "key%d", i);
+        mu_check(OBJ_OK == Node_DictDel(root, key));
+        mu_check(OBJ_ERR == Node_DictGet(root, key, &n));
+    }
+    mu_assert_int_eq(count / 2, Node_Length(root));
+    for (int i = 1; i < count; i += 2) {
+        sprintf(key, "key%d", i);
+        mu_check(OBJ_OK == Node_DictGet(root, key, &n));
+        mu_check(i == n->value.intval);
+    }
+    mu_check(OBJ_ERR == Node_DictDel(root, "key0"));
+    mu_check(OBJ_OK == Node_DictSet(root, "key0", NULL));
+    mu_check(OBJ_OK == Node_DictGet(root, "key0", &n));
+    mu_check(NULL == n);
+
+    Node_Free(root);
+
+    // small dictionaries are not indexed
+    root = NewDictNode(1);
+    mu_check(OBJ_OK == Node_DictSet(root, "foo", NULL));
+    mu_check(!(root->flags & NODE_F_DICT_INDEXED));
+    mu_assert_int_eq(0, Node_DictIndexSize(root));
+    Node_Free(root);
+}
+
+/* Collects the keys of a prefix scan, up to a limit */
+typedef struct {
+    const char *keys[2048];
+    int len, limit;
+} __prefixKeys;
+
+static int __collectKey(Node *kv, void *ctx) {
+    __prefixKeys *pk = ctx;
+    pk->keys[pk->len++] = kv->value.kvval.key;
+    return pk->len == pk->limit;
+}
+
+/* Checks that a prefix scan of the tree indexed dictionary visits what a scan of plain does */
+static int __checkPrefix(Node *obj, Node *plain, const char *prefix, int expected) {
+    __prefixKeys a = {.limit = 2048}, b = {.limit = 2048};
+    uint32_t threshold = NodeDictTrieThreshold;
+    int ok = expected == Node_DictPrefixScan(obj, prefix, strlen(prefix), __collectKey, &a);
+    NodeDictTrieThreshold = 0;
+    ok = ok && expected == Node_DictPrefixScan(plain, prefix, strlen(prefix), __collectKey, &b);
+    NodeDictTrieThreshold = threshold;
+    for (int i = 0; ok && i < a.len; i++) {
+        ok = a.keys[i] == b.keys[i] && !strncmp(a.keys[i], prefix, strlen(prefix));
+        if (i) ok = ok && strcmp(a.keys[i - 1], a.keys[i]) < 0;
+    }
+    return ok;
+}
+
+MU_TEST(testDictPrefixScan) {
+    char key[64];
+    Node *obj = NewDictNode(0), *plain = NewDictNode(0);
+    uint32_t threshold = NodeDictTrieThreshold;
+    NodeDictTrieThreshold = 64;
+
+    // keys with long shared prefixes, in no particular order, and ones that are prefixes of others
+    for (int i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "user:%s:%d", i % 3 ? "eu" : "us-east", (i * 7919) % 1000);
+        Node_DictSet(obj, key, NewIntNode(i));
+        Node_DictSet(plain, key, NewIntNode(i));
+    }
+    Node_DictSet(obj, "user", NULL);
+    Node_DictSet(plain, "user", NULL);
+    Node_DictSet(obj, "", NULL);
+    Node_DictSet(plain, "", NULL);
+    mu_check(__checkPrefix(obj, plain, "user:eu:12", 7));
+    mu_check(obj->flags & NODE_F_DICT_TRIE);
+    mu_check(!(plain->flags & NODE_F_DICT_TRIE));
+    mu_check(Node_DictIndexSize(obj) > Node_DictIndexSize(plain));
+    mu_check(__checkPrefix(obj, plain, "user:us-east:", 334));
+    mu_check(__checkPrefix(obj, plain, "user", 1001));
+    mu_check(__checkPrefix(obj, plain, "", 1002));
+    mu_check(__checkPrefix(obj, plain, "user:us-east:0", 1));
+    mu_check(__checkPrefix(obj, plain, "user:eu:9999", 0));
+    mu_check(__checkPrefix(obj, plain, "user:as", 0));
+    mu_check(__checkPrefix(obj, plain, "z", 0));
+
+    // the visitor stops the scan
+    __prefixKeys pk = {.limit = 3};
+    mu_assert_int_eq(3, Node_DictPrefixScan(obj, "user:", 5, __collectKey, &pk));
+
+    // added keys are added to the tree, and deleting keys makes it be built again
+    Node_DictSet(obj, "user:eu:12x", NULL);
+    Node_DictSet(plain, "user:eu:12x", NULL);
+    mu_check(__checkPrefix(obj, plain, "user:eu:12", 8));
+    for (int i = 0; i < 1000; i += 3) {
+        snprintf(key, sizeof(key), "user:eu:%d", i);
+        Node_DictDel(obj, key);
+        Node_DictDel(plain, key);
+    }
+    mu_check(__checkPrefix(obj, plain, "user:eu:1", 52));
+    mu_check(__checkPrefix(obj, plain, "user:", 779));
+
+    // a copy has no tree until it's scanned
+    Node *copy = Node_Clone(obj);
+    mu_check(!(copy->flags & NODE_F_DICT_TRIE));
+    mu_check(__checkPrefix(copy, plain, "user:us", 334));
+    Node_Free(copy);
+    Node_Free(obj);
+    Node_Free(plain);
+
+    // the tree of a dictionary in an arena is freed with it
+    NodeArena *arena = NewNodeArena();
+    Node_SetArena(arena);
+    obj = NewDictNode(0);
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        Node_DictSet(obj, key, NewIntNode(i));
+    }
+    pk.len = 0;
+    pk.limit = 2048;
+    mu_assert_int_eq(11, Node_DictPrefixScan(obj, "k1", 2, __collectKey, &pk));
+    mu_check(obj->flags & NODE_F_DICT_TRIE);
+    Node_SetArena(NULL);
+    Node_Free(obj);
+    NodeArena_Free(arena);
+
+    NodeDictTrieThreshold = threshold;
+}
+
+MU_TEST(testSharedNodes) {
+    // booleans and small integers are shared
+    Node *n = NewIntNode(42), *m = NewIntNode(42);
+    mu_check(n == m);
+    mu_check(n->flags & NODE_F_STATIC);
+    mu_check(42 == n->value.intval);
+    mu_check(NewBoolNode(1) == NewBoolNode(2));
+    mu_check(NewBoolNode(0) != NewBoolNode(1));
+    mu_check(!NewBoolNode(0)->value.boolval);
+    n = NewIntNode(OBJECT_SHARED_INT_MAX + 1);
+    mu_check(!(n->flags & NODE_F_STATIC));
+    Node_Free(n);
+
+    // freeing a container doesn't free its shared nodes
+    n = NewArrayNode(2);
+    mu_check(OBJ_OK == Node_ArrayAppend(n, NewIntNode(-1)));
+    mu_check(OBJ_OK == Node_ArrayAppend(n, NewBoolNode(1)));
+    Node_Free(n);
+    mu_check(-1 == NewIntNode(-1)->value.intval);
+    mu_check(NewBoolNode(1)->value.boolval);
+
+    // short strings are inlined, and moved out of the node when appended to
+    n = NewCStringNode("foo");
+    mu_check(n->flags & NODE_F_INLINE_DATA);
+    mu_check(n->value.strval.data == (char *)(n + 1));
+    m = NewCStringNode("0123456789012345678901234567890123456789");
+    mu_check(!(m->flags & NODE_F_INLINE_DATA));
+    mu_check(OBJ_OK == Node_StringAppend(n, m));
+    mu_check(!(n->flags & NODE_F_INLINE_DATA));
+    mu_assert_int_eq(43, Node_Length(n));
+    mu_check(!strcmp("foo0123456789012345678901234567890123456789", n->value.strval.data));
+    Node_Free(m);
+    Node_Free(n);
+}
+
+MU_TEST(testPackedArray) {
+    Node tmp, *n, *sub;
+    Node *arr = NewArrayNode(0);
+
+    // integers pack an empty array
+    for (int i = 0; i < 100; i++) mu_check(OBJ_OK == Node_ArrayAppendInt(arr, i * 1000));
+    mu_check(OBJ_OK == Node_ArrayAppend(arr, NewIntNode(-5)));
+    mu_check(arr->flags & NODE_F_PACKED_INT);
+    mu_assert_int_eq(101, Node_Length(arr));
+    n = NewIntNode(42000);
+    mu_assert_int_eq(42, Node_ArrayIndex(arr, n, 0, 0));
+    Node_Free(n);
+    mu_assert_int_eq(100, Node_ArrayIndex(arr, NewIntNode(-5), 0, 0));
+    n = NewDoubleNode(42000);
+    mu_assert_int_eq(-1, Node_ArrayIndex(arr, n, 0, 0));
+    Node_Free(n);
+    mu_check(OBJ_OK == Node_ArrayItemView(arr, 7, &tmp, &n));
+    mu_check(N_INTEGER == n->type && 7000 == n->value.intval);
+    mu_check(OBJ_ERR == Node_ArrayItemView(arr, 101, &tmp, &n));
+
+    // delete and insert values while packed
+    mu_check(OBJ_OK == Node_ArrayDelRange(arr, 0, 10));
+    mu_assert_int_eq(91, Node_Length(arr));
+    sub = NewArrayNode(2);
+    mu_check(OBJ_OK == Node_ArrayAppend(sub, NewIntNode(1)));
+    mu_check(OBJ_OK == Node_ArrayAppend(sub, NewIntNode(2)));
+    mu_check(OBJ_OK == Node_ArrayInsert(arr, 0, sub));
+    mu_check(arr->flags & NODE_F_PACKED_INT);
+    mu_assert_int_eq(93, Node_Length(arr));
+    mu_check(OBJ_OK == Node_ArrayItemView(arr, 2, &tmp, &n));
+    mu_check(10000 == n->value.intval);
+
+    // a value of another type makes it generic
+    mu_check(OBJ_OK == Node_ArrayAppend(arr, NewDoubleNode(0.5)));
+    mu_check(!(arr->flags & NODE_F_PACKED));
+    mu_assert_int_eq(94, Node_Length(arr));
+    mu_check(OBJ_OK == Node_ArrayItem(arr, 1, &n));
+    mu_check(N_INTEGER == n->type && 2 == n->value.intval);
+    mu_check(OBJ_OK == Node_ArrayItem(arr, 93, &n));
+    mu_check(N_NUMBER == n->type && 0.5 == n->value.numval);
+    Node_Free(arr);
+
+    // doubles, and item access that unpacks the array
+    arr = NewArrayNode(1);
+    mu_check(OBJ_OK == Node_ArrayAppendDouble(arr, 1.5));
+    mu_check(OBJ_OK == Node_ArrayAppendDouble(arr, 2.5));
+    mu_check(arr->flags & NODE_F_PACKED_NUM);
+    n = NewDoubleNode(2.5);
+    mu_assert_int_eq(1, Node_ArrayIndex(arr, n, 0, 0));
+    Node_Free(n);
+    mu_check(OBJ_OK == Node_ArrayAppendInt(arr, 3));
+    mu_check(!(arr->flags & NODE_F_PACKED));
+    mu_check(OBJ_OK == Node_ArrayItem(arr, 2, &n));
+    mu_check(N_INTEGER == n->type && 3 == n->value.intval);
+    Node_Free(arr);
+
+    arr = NewArrayNode(1);
+    mu_check(OBJ_OK == Node_ArrayAppendDouble(arr, 1.5));
+    mu_check(OBJ_OK == Node_ArrayItem(arr, 0, &n));
+    mu_check(!(arr->flags & NODE_F_PACKED));
+    mu_check(N_NUMBER == n->type && 1.5 == n->value.numval);
+    Node_Free(arr);
+}
+
+MU_TEST(testArraySearch) {
+    const char *kernels[] = {"avx2", "sse2", "neon", "scalar"};
+    const char *kernel = ObjectSearch_Kernel();
+    int64_t ints[67];
+    double nums[67];
+
+    // every kernel finds and counts the same values, whatever their alignment and the tail's length
+    for (int i = 0; i < 67; i++) {
+        ints[i] = (i % 5) * 0x100000001LL;
+        nums[i] = i % 5 ? i % 5 * 0.5 : (i % 2 ? -0.0 : 0.0);
+    }
+    ints[61] = 0x100000000LL;  // equal to 1 in one half only
+    for (int k = 0; k < 4; k++) {
+        if (!ObjectSearch_UseKernel(kernels[k])) continue;
+        for (uint32_t n = 0; n <= 66; n += 11) {
+            mu_assert_int_eq(n > 3 ? 3 : n, ObjectSearch_FindInt(ints + 1, n, 4 * 0x100000001LL));
+            mu_assert_int_eq(n > 3 ? 3 : n, ObjectSearch_FindDouble(nums + 1, n, 2));
+            mu_assert_int_eq(n, ObjectSearch_FindDouble(nums + 1, n, 3));
+            mu_assert_int_eq(n / 5, ObjectSearch_CountInt(ints + 1, n, 0));
+            mu_assert_int_eq(n / 5, ObjectSearch_CountDouble(nums + 1, n, -0.0));
+        }
+        mu_assert_int_eq(60, ObjectSearch_FindInt(ints + 1, 66, 0x100000000LL));
+        mu_assert_int_eq(13, ObjectSearch_CountInt(ints + 1, 66, 0x100000001LL));
+        mu_assert_int_eq(14, ObjectSearch_CountDouble(nums + 1, 66, 0.5));
+    }
+    mu_check(!ObjectSearch_UseKernel("none"));
+    mu_check(ObjectSearch_UseKernel(kernel));
+
+    // packed arrays are searched and counted in the range
+    Node *arr = NewArrayNode(0), *n;
+    for (int i = 0; i < 100; i++) Node_ArrayAppendInt(arr, i % 10);
+    mu_check(arr->flags & NODE_F_PACKED_INT);
+    n = NewIntNode(3);
+    mu_assert_int_eq(10, Node_ArrayCount(arr, n, 0, 0));
+    mu_assert_int_eq(13, Node_ArrayIndex(arr, n, 5, 0));
+    mu_assert_int_eq(2, Node_ArrayCount(arr, n, 5, 25));
+    mu_assert_int_eq(1, Node_ArrayCount(arr, n, -10, 0));
+    mu_assert_int_eq(0, Node_ArrayCount(arr, n, 10, 5));
+    Node_Free(n);
+    n = NewDoubleNode(3);
+    mu_assert_int_eq(0, Node_ArrayCount(arr, n, 0, 0));
+    Node_Free(n);
+    Node_Free(arr);
+
+    // generic arrays compare strings by length first, and count nulls and booleans
+    arr = NewArrayNode(0);
+    for (int i = 0; i < 30; i++) {
+        Node_ArrayAppend(arr, i % 3 ? NewCStringNode(i % 3 == 1 ? "foo" : "foobar") : NULL);
+    }
+    Node_ArrayAppend(arr, NewBoolNode(1));
+    n = NewCStringNode("foobar");
+    mu_assert_int_eq(2, Node_ArrayIndex(arr, n, 0, 0));
+    mu_assert_int_eq(10, Node_ArrayCount(arr, n, 0, 0));
+    Node_Free(n);
+    n = NewCStringNode("fob");
+    mu_assert_int_eq(-1, Node_ArrayIndex(arr, n, 0, 0));
+    mu_assert_int_eq(0, Node_ArrayCount(arr, n, 0, 0));
+    Node_Free(n);
+    mu_assert_int_eq(10, Node_ArrayCount(arr, NULL, 0, 0));
+    n = NewBoolNode(1);
+    mu_assert_int_eq(1, Node_ArrayCount(arr, n, 0, 0));
+    Node_Free(n);
+    n = NewDictNode(1);
+    mu_assert_int_eq(0, Node_ArrayCount(arr, n, 0, 0));
+    Node_Free(n);
+    Node_Free(arr);
+}
+
+MU_TEST(testArrayBisect) {
+    // values of different types are ordered by their types, and numbers by value
+    Node *vals[] = {NULL,
+                    NewBoolNode(0),
+                    NewBoolNode(1),
+                    NewIntNode(-5),
+                    NewDoubleNode(1.5),
+                    NewIntNode(2),
+                    NewCStringNode("a"),
+                    NewCStringNode("ab"),
+                    NewCStringNode("b"),
+                    NewArrayNode(0),
+                    NewDictNode(0)};
+    int nvals = sizeof(vals) / sizeof(Node *);
+    Node_ArrayAppend(vals[9], NewIntNode(1));
+    Node_DictSet(vals[10], "k", NULL);
+    for (int i = 0; i < nvals; i++) {
+        for (int j = 0; j < nvals; j++) {
+            int c = Node_Compare(vals[i], vals[j]);
+            mu_check(i < j ? c < 0 : i > j ? c > 0 : !c);
+        }
+    }
+    Node *one = NewIntNode(1), *onedbl = NewDoubleNode(1.0);
+    mu_assert_int_eq(0, Node_Compare(one, onedbl));
+    Node_Free(one);
+    Node_Free(onedbl);
+
+    // the insertion points of a generic array's values, before or after their equals
+    Node *arr = NewArrayNode(0), *n;
+    for (int i = 0; i < nvals; i++) Node_ArrayAppend(arr, vals[i]);
+    for (int i = 0; i < nvals; i++) {
+        Node tmp, *item;
+        Node_ArrayItemView(arr, i, &tmp, &item);
+        mu_assert_int_eq(i, Node_ArrayBisect(arr, item, 0));
+        mu_assert_int_eq(i + 1, Node_ArrayBisect(arr, item, 1));
+    }
+    n = NewCStringNode("aa");
+    mu_assert_int_eq(7, Node_ArrayBisect(arr, n, 0));
+    Node_Free(n);
+    Node_Free(arr);
+
+    // packed arrays are searched as they are, with needles of any type
+    arr = NewArrayNode(0);
+    for (int i = 0; i < 100; i++) Node_ArrayAppendInt(arr, i / 2 * 10);
+    n = NewIntNode(250);
+    mu_assert_int_eq(50, Node_ArrayBisect(arr, n, 0));
+    mu_assert_int_eq(52, Node_ArrayBisect(arr, n, 1));
+    Node_Free(n);
+    n = NewDoubleNode(255.5);
+    mu_assert_int_eq(52, Node_ArrayBisect(arr, n, 0));
+    Node_Free(n);
+    n = NewCStringNode("x");
+    mu_assert_int_eq(100, Node_ArrayBisect(arr, n, 0));
+    mu_assert_int_eq(0, Node_ArrayBisect(arr, NULL, 1));
+    Node_Free(n);
+    mu_check(arr->flags & NODE_F_PACKED_INT);
+    Node_Free(arr);
+
+    arr = NewArrayNode(0);
+    for (int i = 0; i < 10; i++) Node_ArrayAppendDouble(arr, i * 0.5);
+    n = NewDoubleNode(2.0);
+    mu_assert_int_eq(4, Node_ArrayBisect(arr, n, 0));
+    Node_Free(n);
+    n = NewIntNode(2);
+    mu_assert_int_eq(5, Node_ArrayBisect(arr, n, 1));
+    Node_Free(n);
+    mu_check(arr->flags & NODE_F_PACKED_NUM);
+    Node_Free(arr);
+}
+
+/* Checks that the searches of the indexed array find what those of the plain one do */
+static int __checkIndexed(Node *indexed, Node *plain) {
+    Node *needles[] = {NewIntNode(3), NewIntNode(5000), NewDoubleNode(1.5), NewCStringNode("7"),
+                       NewCStringNode("x"), NewBoolNode(1), NULL};
+    int ok = 1;
+    for (int i = 0; i < sizeof(needles) / sizeof(Node *); i++) {
+        ok &= Node_ArrayIndex(indexed, needles[i], 0, 0) == Node_ArrayIndex(plain, needles[i], 0, 0);
+        ok &= Node_ArrayIndex(indexed, needles[i], 5, -3) == Node_ArrayIndex(plain, needles[i], 5, -3);
+        ok &= Node_ArrayCount(indexed, needles[i], 0, 0) == Node_ArrayCount(plain, needles[i], 0, 0);
+        ok &= Node_ArrayCount(indexed, needles[i], 7, 30) == Node_ArrayCount(plain, needles[i], 7, 30);
+        Node_Free(needles[i]);
+    }
+    return ok;
+}
+
+MU_TEST(testArrayIndexed) {
+    Node *arr = NewArrayNode(0), *plain = NewArrayNode(0), *sub;
+    char buf[16];
+
+    // a packed array is indexed as it's appended to
+    for (int i = 0; i < 50; i++) {
+        Node_ArrayAppendInt(arr, i % 10);
+        Node_ArrayAppendInt(plain, i % 10);
+    }
+    mu_assert_int_eq(OBJ_OK, Node_ArraySetIndexed(arr, 1));
+    mu_check(arr->flags & NODE_F_ARRAY_INDEXED);
+    mu_check(__checkIndexed(arr, plain));
+    mu_check(Node_ArrayIndexSize(arr) >= 100 * sizeof(uint32_t));
+    mu_assert_int_eq(0, Node_ArrayIndexSize(plain));
+    for (int i = 0; i < 1000; i++) {
+        Node_ArrayAppendInt(arr, i);
+        Node_ArrayAppendInt(plain, i);
+    }
+    mu_check(__checkIndexed(arr, plain));
+
+    // and other changes make it be built again
+    Node_ArrayAppend(arr, NewDoubleNode(1.5));
+    Node_ArrayAppend(plain, NewDoubleNode(1.5));
+    mu_check(!(arr->flags & NODE_F_PACKED));
+    mu_check(__checkIndexed(arr, plain));
+    for (int i = 0; i < 20; i++) {
+        snprintf(buf, sizeof(buf), "%d", i);
+        Node_ArrayPrepend(arr, NewCStringNode(buf));
+        Node_ArrayPrepend(plain, NewCStringNode(buf));
+    }
+    mu_check(__checkIndexed(arr, plain));
+    Node_ArrayDelRange(arr, 10, 5);
+    Node_ArrayDelRange(plain, 10, 5);
+    mu_check(__checkIndexed(arr, plain));
+    Node *n;
+    mu_check(OBJ_OK == Node_ArrayItem(arr, 3, &n));
+    Node_Free(n);
+    Node_ArraySet(arr, 3, NewBoolNode(1));
+    mu_check(OBJ_OK == Node_ArrayItem(plain, 3, &n));
+    Node_Free(n);
+    Node_ArraySet(plain, 3, NewBoolNode(1));
+    mu_check(__checkIndexed(arr, plain));
+    sub = NewArrayNode(2);
+    Node_ArrayAppend(sub, NULL);
+    Node_ArrayAppend(sub, NewCStringNode("x"));
+    Node_ArrayInsert(arr, Node_Length(arr), Node_Clone(sub));
+    Node_ArrayInsert(plain, Node_Length(plain), sub);
+    mu_check(__checkIndexed(arr, plain));
+
+    // a string that's changed in place is reported
+    mu_check(OBJ_OK == Node_ArrayItem(arr, 0, &n));
+    mu_check(OBJ_OK == Node_StringAppend(n, (sub = NewCStringNode("x"))));
+    Node_Free(sub);
+    Node_ArrayChanged(arr);
+    mu_check(OBJ_OK == Node_ArrayItem(plain, 0, &n));
+    mu_check(OBJ_OK == Node_StringAppend(n, (sub = NewCStringNode("x"))));
+    Node_Free(sub);
+    mu_check(__checkIndexed(arr, plain));
+
+    // clones aren't indexed, and neither are arrays that stop being indexed
+    sub = Node_Clone(arr);
+    mu_check(!(sub->flags & NODE_F_ARRAY_INDEXED));
+    mu_check(__checkIndexed(sub, plain));
+    Node_Free(sub);
+    mu_assert_int_eq(OBJ_OK, Node_ArraySetIndexed(plain, 0));
+    sub = NewDictNode(1);
+    mu_assert_int_eq(OBJ_ERR, Node_ArraySetIndexed(sub, 1));
+    Node_Free(sub);
+    Node_Free(arr);
+    Node_Free(plain);
+
+    // the index of an array in an arena is freed with the arena
+    NodeArena *a = NewNodeArena();
+    NodeArena *prev = Node_SetArena(a);
+    arr = NewArrayNode(0);
+    for (int i = 0; i < 100; i++) Node_ArrayAppendInt(arr, i);
+    Node_SetArena(prev);
+    mu_assert_int_eq(OBJ_ERR, Node_ArraySetIndexed(arr, 1));
+    Node_SetArena(a);
+    mu_assert_int_eq(OBJ_OK, Node_ArraySetIndexed(arr, 1));
+    Node_SetArena(prev);
+    n = NewIntNode(42);
+    mu_assert_int_eq(42, Node_ArrayIndex(arr, n, 0, 0));
+    mu_assert_int_eq(-1, Node_ArrayIndex(arr, n, 43, 0));
+    Node_Free(n);
+    NodeArena_Free(a);
+}
+
+/* Checks that an array's items are the model's values, as integers or as strings */
+static int __checkArray(Node *arr, const int *model, int len, int packed) {
+    Node tmp, *n;
+    char buf[16];
+    if (len != Node_Length(arr)) return 0;
+    for (int i = 0; i < len; i++) {
+        if (OBJ_OK != Node_ArrayItemView(arr, i, &tmp, &n)) return 0;
+        if (packed && n->value.intval != model[i]) return 0;
+        if (!packed && (snprintf(buf, sizeof(buf), "%d", model[i]) != n->value.strval.len ||
+                        strncmp(buf, n->value.strval.data, n->value.strval.len)))
+            return 0;
+    }
+    return 1;
+}
+
+MU_TEST(testArrayGrowth) {
+    Node *arr = NewArrayNode(0);
+
+    // powers of 2 up to the chunk, then whole chunks
+    uint32_t chunk = NodeArrayGrowthChunk;
+    NodeArrayGrowthChunk = 16;
+    for (int i = 0; i < 40; i++) Node_ArrayAppend(arr, NewCStringNode("x"));
+    mu_check(48 == arr->value.arrval.cap);
+    Node_Free(arr);
+
+    NodeArrayGrowthChunk = 0;
+    arr = NewArrayNode(0);
+    for (int i = 0; i < 40; i++) Node_ArrayAppend(arr, NewCStringNode("x"));
+    mu_check(64 == arr->value.arrval.cap);
+    Node_Free(arr);
+    NodeArrayGrowthChunk = chunk;
+}
+
+MU_TEST(testArrayHeadGap) {
+    int model[2048];
+    char buf[16];
+
+    // a queue: append at the tail and delete from the head, or prepend and trim the tail
+    for (int packed = 0; packed < 2; packed++) {
+        Node *arr = NewArrayNode(0);
+        int len = 0, next = 0;
+        srand(1);
+        for (int op = 0; op < 20000; op++) {
+            int r = rand() % 8, v = 2000 + next++;
+            Node *n = packed ? NewIntNode(v) : NewStringNode(buf, sprintf(buf, "%d", v));
+            if (len >= 2000) r = 5;
+            if (r < 2) {  // prepend
+                mu_check(OBJ_OK == Node_ArrayPrepend(arr, n));
+                memmove(&model[1], model, len++ * sizeof(int));
+                model[0] = v;
+            } else if (r < 4) {  // append
+                mu_check(OBJ_OK == Node_ArrayAppend(arr, n));
+                model[len++] = v;
+            } else if (r < 5) {  // insert in the middle
+                Node *sub = NewArrayNode(1);
+                int index = len ? rand() % len : 0;
+                Node_ArrayAppend(sub, n);
+                mu_check(OBJ_OK == Node_ArrayInsert(arr, index, sub));
+                memmove(&model[index + 1], &model[index], (len++ - index) * sizeof(int));
+                model[index] = v;
+            } else {  // delete a range at the head, the tail or in the middle
+                Node_Free(n);
+                if (!len) continue;
+                int count = 1 + rand() % 3, start = 5 == r ? 0 : 6 == r ? MAX(len - count, 0)
+                                                                         : rand() % len;
+                int stop = MIN(start + count, len);
+                mu_check(OBJ_OK == Node_ArrayDelRange(arr, start, count));
+                memmove(&model[start], &model[stop], (len - stop) * sizeof(int));
+                len -= stop - start;
+            }
+            mu_check(__checkArray(arr, model, len, packed));
+            mu_check(!!(arr->flags & NODE_F_PACKED) == packed || !len);
+        }
+        Node_Free(arr);
+    }
+
+    // prepending makes a gap that's bounded by the items, deleting at the head grows it, and it's
+    // taken back when the array shrinks or is emptied
+    Node *arr = NewArrayNode(0);
+    for (int i = 0; i < 1000; i++) mu_check(OBJ_OK == Node_ArrayPrepend(arr, NewIntNode(i)));
+    mu_check(Node_ArrayGap(arr) <= Node_Length(arr) / 2 + 4);
+    mu_check(arr->value.arrval.cap + Node_ArrayGap(arr) <= 4 * Node_Length(arr));
+    uint32_t gap = Node_ArrayGap(arr);
+    mu_check(OBJ_OK == Node_ArrayDelRange(arr, 0, 100));
+    mu_assert_int_eq(900, Node_Length(arr));
+    mu_check(Node_ArrayGap(arr) == gap + 100);
+    mu_check(OBJ_OK == Node_ArrayDelRange(arr, 0, 890));
+    mu_assert_int_eq(10, Node_Length(arr));
+    mu_assert_int_eq(0, Node_ArrayGap(arr));
+    Node *n;
+    mu_check(OBJ_OK == Node_ArrayItem(arr, 0, &n));
+    mu_assert_int_eq(9, n->value.intval);
+    mu_check(OBJ_OK == Node_ArrayDelRange(arr, 0, 10));
+    mu_assert_int_eq(0, Node_ArrayGap(arr));
+    Node_Free(arr);
+}
+
+static size_t __exactSize(const void *ptr, size_t size) { return size; }
+
+static size_t __roundSize(const void *ptr, size_t size) { return (size + 63) & ~(size_t)63; }
+
+MU_TEST(testAllocatedSize) {
+    const char *longstr = "a string that is too long to be inlined";
+    size_t len = strlen(longstr);
+
+    // shared nodes take nothing
+    mu_assert_int_eq(0, Node_AllocatedSize(NULL, __exactSize, 1));
+    mu_assert_int_eq(0, Node_AllocatedSize(NewBoolNode(1), __exactSize, 1));
+    mu_assert_int_eq(0, Node_AllocatedSize(NewIntNode(5), __exactSize, 1));
+
+    // strings count with their NULL terminators, inlined ones in the node's allocation
+    Node *num = NewDoubleNode(1.5), *inl = NewCStringNode("bar"), *str = NewCStringNode(longstr);
+    mu_assert_int_eq(sizeof(Node), Node_AllocatedSize(num, __exactSize, 1));
+    mu_assert_int_eq(sizeof(Node) + 4, Node_AllocatedSize(inl, __exactSize, 1));
+    mu_assert_int_eq(sizeof(Node) + len + 1, Node_AllocatedSize(str, __exactSize, 1));
+    mu_assert_int_eq(__roundSize(NULL, sizeof(Node)) + __roundSize(NULL, len + 1),
+                     Node_AllocatedSize(str, __roundSize, 1));
+
+    // containers count their entries' capacity, and keyvals their share of the key
+    Node *dict = NewDictNode(4), *arr = NewArrayNode(3);
+    mu_check(OBJ_OK == Node_DictSet(dict, "allocated", NULL));
+    Node *kv = dict->value.dictval.entries[0];
+    mu_assert_int_eq(sizeof(Node) + 4 * sizeof(Node *), Node_AllocatedSize(dict, __exactSize, 1));
+    mu_assert_int_eq(sizeof(Node) + 3 * sizeof(Node *), Node_AllocatedSize(arr, __exactSize, 1));
+    mu_assert_int_eq(Intern_MemoryShare(kv->value.kvval.key),
+                     Intern_AllocatedShare(kv->value.kvval.key, __exactSize));
+    mu_assert_int_eq(sizeof(Node) + Intern_MemoryShare(kv->value.kvval.key),
+                     Node_AllocatedSize(kv, __exactSize, 1));
+
+    // what's in an arena counts as its aligned size, or not at all
+    NodeArena *a = NewNodeArena();
+    NodeArena *prev = Node_SetArena(a);
+    Node *astr = NewCStringNode(longstr);
+    Node_SetArena(prev);
+    mu_assert_int_eq(sizeof(Node) + ((len + 1 + 7) & ~7), Node_AllocatedSize(astr, __exactSize, 1));
+    mu_assert_int_eq(0, Node_AllocatedSize(astr, __exactSize, 0));
+
+    // and the arena's blocks, with their headers, are powers of 2
+    mu_assert_int_eq(OBJECT_ARENA_MIN_BLOCK, a->size);
+    mu_assert_int_eq(sizeof(NodeArena) + a->size, NodeArena_AllocatedSize(a, __exactSize));
+
+    Node_Free(astr);
+    NodeArena_Free(a);
+    Node_Free(num);
+    Node_Free(inl);
+    Node_Free(str);
+    Node_Free(dict);
+    Node_Free(arr);
+}
+
+MU_TEST(testStringGrowth) {
+    Node *str = NewCStringNode("log:"), *line = NewCStringNode("a line of the log\n");
+    char *expected = calloc(1, 4 + 1000 * 18 + 1);
+    strcpy(expected, "log:");
+
+    // appends grow the data with room, so most of them don't reallocate it
+    int moves = 0;
+    for (int i = 0; i < 1000; i++) {
+        const char *data = str->value.strval.data;
+        mu_check(OBJ_OK == Node_StringAppend(str, line));
+        moves += data != str->value.strval.data;
+        strcat(expected, "a line of the log\n");
+    }
+    mu_check(moves < 20);
+    mu_check(str->flags & NODE_F_STRING_ROOM);
+    mu_check(!(str->flags & NODE_F_INLINE_DATA));
+    mu_check(strlen(expected) == Node_Length(str));
+    mu_check(!strcmp(expected, str->value.strval.data));
+    mu_check(str->value.strval.cap >= strlen(expected) + 1);
+    mu_assert_int_eq(sizeof(Node) + str->value.strval.cap, Node_AllocatedSize(str, __exactSize, 1));
+
+    // copies take the exact size
+    Node *copy = Node_Clone(str);
+    mu_check(!(copy->flags & NODE_F_STRING_ROOM));
+    mu_check(strlen(expected) == Node_StringMemory(copy));
+    Node_Free(copy);
+
+    free(expected);
+    Node_Free(line);
+    Node_Free(str);
+}
+
+MU_TEST(testContainerShrink) {
+    char key[16];
+
+    // arrays and dictionaries that lose most of their entries shrink, whichever end they lose them at
+    for (int packed = 0; packed < 2; packed++) {
+        for (int head = 0; head < 2; head++) {
+            Node *arr = NewArrayNode(0);
+            for (int i = 0; i < 10000; i++)
+                Node_ArrayAppend(arr, packed ? NewIntNode(i) : NewDoubleNode(i + 0.5));
+            mu_check(arr->value.arrval.cap >= 10000);
+            for (int i = 0; i < 9990; i++) Node_ArrayDelRange(arr, head ? 0 : -1, 1);
+            mu_assert_int_eq(10, Node_Length(arr));
+            mu_check(arr->value.arrval.cap + Node_ArrayGap(arr) <= 4 * Node_Length(arr) + 3);
+            for (int i = 0; i < 10; i++) {
+                Node *n;
+                mu_check(OBJ_OK == Node_ArrayItem(arr, i, &n));
+                int v = head ? 9990 + i : i;
+                mu_check(packed ? n->value.intval == v : n->value.numval == v + 0.5);
+            }
+            Node_Free(arr);
+        }
+    }
+
+    Node *obj = NewDictNode(0);
+    for (int i = 0; i < 1000; i++) {
+        sprintf(key, "%d", i);
+        Node_DictSet(obj, key, NewIntNode(i));
+    }
+    mu_check(obj->flags & NODE_F_DICT_INDEXED);
+    for (int i = 0; i < 990; i++) {
+        sprintf(key, "%d", i);
+        mu_check(OBJ_OK == Node_DictDel(obj, key));
+    }
+    mu_assert_int_eq(10, Node_Length(obj));
+    mu_check(obj->value.dictval.cap <= 4 * Node_Length(obj) + 3);
+    for (int i = 0; i < 1000; i++) {
+        Node *n;
+        sprintf(key, "%d", i);
+        mu_check((i >= 990) == (OBJ_OK == Node_DictGet(obj, key, &n)));
+        if (i >= 990) mu_assert_int_eq(i, n->value.intval);
+    }
+    Node_Free(obj);
+
+    // entries in an arena stay as they are
+    NodeArena *arena = NewNodeArena();
+    NodeArena *prev = Node_SetArena(arena);
+    Node *arr = NewArrayNode(1000);
+    for (int i = 0; i < 1000; i++) Node_ArrayAppend(arr, NewIntNode(i));
+    Node_SetArena(prev);
+    mu_check(OBJ_OK == Node_ArrayDelRange(arr, 10, 990));
+    mu_assert_int_eq(1000, arr->value.arrval.cap);
+    Node_Free(arr);
+    NodeArena_Free(arena);
+}
+
+static void __countVisits(Node *n, void *ctx) { ++*(size_t *)ctx; }
+
+static void __countBegins(Node *n, void *ctx) { ++*(size_t *)ctx; }
+
+MU_TEST(testDeepTree) {
+    // a tree that's nested deeper than the C stack could recurse, of alternating arrays and dicts
+    const int depth = 200000;
+    Node *root = NewArrayNode(1), *n = root;
+    for (int i = 1; i < depth; i++) {
+        Node *child = i % 2 ? NewDictNode(1) : NewArrayNode(1);
+        if (n->type == N_ARRAY) {
+            mu_check(OBJ_OK == Node_ArrayAppend(n, child));
+        } else {
+            mu_check(OBJ_OK == Node_DictSet(n, "k", child));
+        }
+        n = child;
+    }
+    mu_check(N_DICT == n->type && OBJ_OK == Node_DictSet(n, "k", NewIntNode(1)));
+
+    // the dicts' keyvals are counted as nodes of their own
+    size_t nodes = depth + depth / 2 + 1;
+    mu_assert_int_eq(nodes, Node_Count(root, 0));
+    mu_assert_int_eq(100, Node_Count(root, 100));
+
+    size_t visits = 0;
+    Node_Traverse(root, __countVisits, &visits);
+    mu_assert_int_eq(nodes, visits);
+
+    size_t begins = 0;
+    NodeSerializerOpt so = {.fBegin = __countBegins, .xBegin = 0xff};
+    Node_Serializer(root, &so, &begins);
+    mu_assert_int_eq(nodes, begins);
+
+    Node_Free(root);
+}
+
+MU_TEST(testInternedKeys) {
+    size_t count, before;
+    Node *n;
+    Intern_Stats(&before, NULL);
+
+    // the same key is shared by all of the dictionaries
+    Node *d1 = NewDictNode(1), *d2 = NewDictNode(1);
+    mu_check(OBJ_OK == Node_DictSet(d1, "interned", NULL));
+    mu_check(OBJ_OK == Node_DictSet(d2, "interned", NewIntNode(1)));
+    mu_check(d1->value.dictval.entries[0]->value.kvval.key ==
+             d2->value.dictval.entries[0]->value.kvval.key);
+    mu_check(d1->value.dictval.entries[0]->value.kvval.key == Intern_Find("interned", 8));
+    Intern_Stats(&count, NULL);
+    mu_assert_int_eq(before + 1, count);
+    mu_check(OBJ_ERR == Node_DictGet(d1, "not interned", &n));
+    mu_check(NULL == Intern_Find("not interned", 12));
+
+    // and is freed with its last reference
+    Node_Free(d1);
+    mu_check(OBJ_OK == Node_DictGet(d2, "interned", &n));
+    mu_check(OBJ_OK == Node_DictDel(d2, "interned"));
+    mu_check(NULL == Intern_Find("interned", 8));
+    Intern_Stats(&count, NULL);
+    mu_assert_int_eq(before, count);
+
+    // arenas hold the references to the keys of their nodes
+    NodeArena *a = NewNodeArena();
+    NodeArena *prev = Node_SetArena(a);
+    mu_check(OBJ_OK == Node_DictSet(d2, "arena", NULL));
+    Node_SetArena(prev);
+    mu_check(NULL != Intern_Find("arena", 5));
+    Node_Free(d2);
+    mu_check(NULL != Intern_Find("arena", 5));
+    NodeArena_Free(a);
+    mu_check(NULL == Intern_Find("arena", 5));
+}
+
+MU_TEST(testNodeClone) {
+    char key[32];
+    Node *root = NewDictNode(1), *n, *c;
+    for (int i = 0; i < 100; i++) {
+        sprintf(key, "key%d", i);
+        mu_check(OBJ_OK == Node_DictSet(root, key, NewIntNode(i)));
+    }
+    Node *packed = NewArrayNode(0), *mixed = NewArrayNode(0);
+    mu_check(OBJ_OK == Node_ArrayAppendInt(packed, 7));
+    mu_check(OBJ_OK == Node_ArrayAppendInt(packed, 8));
+    mu_check(OBJ_OK == Node_ArrayAppend(mixed, NewStringNode("str", 3)));
+    mu_check(OBJ_OK == Node_ArrayAppend(mixed, NewBoolNode(1)));
+    mu_check(OBJ_OK == Node_ArrayAppend(mixed, NewDoubleNode(1.5)));
+    mu_check(OBJ_OK == Node_DictSet(root, "packed", packed));
+    mu_check(OBJ_OK == Node_DictSet(root, "mixed", mixed));
+
+    // the clone has its own nodes of the exact sizes, and the same keys and flags
+    Node *clone = Node_Clone(root);
+    mu_check(clone != root);
+    mu_assert_int_eq(Node_Length(root), Node_Length(clone));
+    mu_assert_int_eq(Node_Length(root), clone->value.dictval.cap);
+    mu_check(clone->flags & NODE_F_DICT_INDEXED);
+    mu_check(root->value.dictval.entries[0]->value.kvval.key ==
+             clone->value.dictval.entries[0]->value.kvval.key);
+    mu_check(OBJ_OK == Node_DictGet(clone, "key42", &n));
+    mu_assert_int_eq(42, n->value.intval);
+    mu_check(OBJ_OK == Node_DictGet(clone, "packed", &c));
+    mu_check(c != packed && (c->flags & NODE_F_PACKED_INT));
+    mu_assert_int_eq(2, c->value.arrval.cap);
+    mu_check(OBJ_OK == Node_ArrayItem(c, 1, &n));
+    mu_assert_int_eq(8, n->value.intval);
+    mu_check(OBJ_OK == Node_DictGet(clone, "mixed", &c));
+    mu_check(OBJ_OK == Node_ArrayItem(c, 0, &n));
+    mu_check(n != mixed->value.arrval.entries[0] && 3 == n->value.strval.len &&
+             !strncmp("str", n->value.strval.data, 3));
+    mu_check(OBJ_OK == Node_ArrayItem(c, 1, &n));
+    mu_check(n == NewBoolNode(1));
+
+    // changing the clone leaves the original as it is
+    mu_check(OBJ_OK == Node_DictDel(clone, "key42"));
+    mu_check(OBJ_OK == Node_DictGet(root, "key42", &n));
+    Node_Free(root);
+    mu_check(OBJ_OK == Node_DictGet(clone, "key43", &n));
+    mu_check(NULL != Intern_Find("key43", 5));
+    Node_Free(clone);
+    mu_check(NULL == Intern_Find("key43", 5));
+
+    // a clone in an arena holds its keys in the arena
+    NodeArena *a = NewNodeArena();
+    root = NewDictNode(1);
+    mu_check(OBJ_OK == Node_DictSet(root, "cloned", NULL));
+    NodeArena *prev = Node_SetArena(a);
+    clone = Node_Clone(root);
+    Node_SetArena(prev);
+    Node_Free(root);
+    mu_check(NULL != Intern_Find("cloned", 6));
+    NodeArena_Free(a);
+    mu_check(NULL == Intern_Find("cloned", 6));
+    mu_check(NULL == Node_Clone(NULL));
+}
+
+MU_TEST(testNodeDedup) {
+    const char *text = "a string that's long enough not to be inlined";
+    Node *root = NewArrayNode(0), *n;
+    for (int i = 0; i < 3; i++) {
+        Node *d = NewDictNode(2), *arr = NewArrayNode(0);
+        mu_check(OBJ_OK == Node_ArrayAppend(arr, NewIntNode(1)));
+        mu_check(OBJ_OK == Node_ArrayAppend(arr, NewDoubleNode(2.5)));
+        mu_check(OBJ_OK == Node_DictSet(d, "a", NewStringNode(text, strlen(text))));
+        mu_check(OBJ_OK == Node_DictSet(d, "b", arr));
+        mu_check(OBJ_OK == Node_ArrayAppend(root, d));
+    }
+    mu_check(OBJ_OK == Node_ArrayAppend(root, NewStringNode(text, strlen(text))));
+    mu_check(OBJ_OK == Node_ArrayAppend(root, NewStringNode("other", 5)));
+
+    // the dictionaries are a single node, whose children the other copies didn't allocate
+    size_t shared = 0;
+    Node *dedup = Node_Dedup(root, &shared);
+    Node **e = dedup->value.arrval.entries;
+    mu_assert_int_eq(5, dedup->value.arrval.len);
+    mu_check(e[0] == e[1] && e[1] == e[2]);
+    mu_check(2 == e[0]->refs);
+    mu_assert_int_eq(2 * 4 + 1, shared);
+    mu_check(OBJ_OK == Node_DictGet(e[0], "a", &n));
+    mu_check(n == e[3] && 1 == n->refs);
+    mu_check(e[4] != n && !e[4]->refs);
+    mu_check(OBJ_OK == Node_DictGet(e[0], "b", &n));
+    mu_check(!n->refs);
+
+    // a unique traversal visits the shared nodes once
+    size_t all = 0, unique = 0;
+    Node_Traverse(dedup, __countVisits, &all);
+    Node_TraverseUnique(dedup, __countVisits, &unique);
+    mu_assert_int_eq(1 + 3 * 7 + 2, all);
+    mu_assert_int_eq(1 + 7 + 1, unique);
+
+    // freeing releases a holder of a shared node until the last one
+    Node_Free(e[1]);
+    mu_check(1 == e[0]->refs);
+    Node_Free(e[3]);
+    mu_check(OBJ_OK == Node_DictGet(e[0], "a", &n));
+    mu_check(!n->refs && !strcmp(text, n->value.strval.data));
+    e[1] = e[3] = NULL;
+
+    // a clone has its own nodes
+    Node *clone = Node_Clone(dedup);
+    e = clone->value.arrval.entries;
+    mu_check(e[0] != e[2] && !e[0]->refs);
+    Node_Free(clone);
+    Node_Free(dedup);
+    Node_Free(root);
+    mu_check(NULL == Node_Dedup(NULL, NULL));
+}
+
+MU_TEST(testNodeOwnPath) {
+    // {"a": {"b": [1, "x", {"c": "y"}]}, "d": [{"e": 0}, ... {"e": 99}], "f": [1, 2]}
+    Node *root = NewDictNode(3), *a = NewDictNode(1), *b = NewArrayNode(3), *c = NewDictNode(1);
+    Node *d = NewArrayNode(100), *f = NewArrayNode(2), *n;
+    mu_check(OBJ_OK == Node_DictSet(c, "c", NewStringNode("y", 1)));
+    mu_check(OBJ_OK == Node_ArrayAppend(b, NewIntNode(1)));
+    mu_check(OBJ_OK == Node_ArrayAppend(b, NewStringNode("x", 1)));
+    mu_check(OBJ_OK == Node_ArrayAppend(b, c));
+    mu_check(OBJ_OK == Node_DictSet(a, "b", b));
+    for (int i = 0; i < 100; i++) {
+        Node *e = NewDictNode(1);
+        mu_check(OBJ_OK == Node_DictSet(e, "e", NewIntNode(i)));
+        mu_check(OBJ_OK == Node_ArrayAppend(d, e));
+    }
+    mu_check(OBJ_OK == Node_ArrayAppendInt(f, 1));
+    mu_check(OBJ_OK == Node_ArrayAppendInt(f, 2));
+    mu_check(OBJ_OK == Node_DictSet(root, "a", a));
+    mu_check(OBJ_OK == Node_DictSet(root, "d", d));
+    mu_check(OBJ_OK == Node_DictSet(root, "f", f));
+
+    // a tree that shares the root copies the nodes on the path's way, and holds their siblings
+    Node *copy = Node_Share(root);
+    mu_check(copy == root && 1 == root->refs);
+    SearchPath sp = NewSearchPath(4);
+    SearchPath_AppendKey(&sp, "a", 1);
+    SearchPath_AppendKey(&sp, "b", 1);
+    SearchPath_AppendIndex(&sp, -1);
+    SearchPath_AppendKey(&sp, "c", 1);
+    uint64_t created = Node_CreatedCount();
+    SearchPath_Own(&sp, &copy, 0);
+    mu_check(copy != root && !root->refs && !copy->refs);
+    // the copies are the root, a, b, c and "y", and the five keyvals of the dictionaries
+    mu_assert_int_eq(5 + 5, Node_CreatedCount() - created);
+    mu_check(OBJ_OK == Node_DictGet(copy, "d", &n) && n == d && 1 == d->refs);
+    mu_check(OBJ_OK == Node_DictGet(copy, "f", &n) && n == f && 1 == f->refs);
+    mu_check(OBJ_OK == Node_DictGet(copy, "a", &n) && n != a && !a->refs);
+    mu_check(OBJ_OK == Node_DictGet(n, "b", &n) && n != b && !n->refs);
+    mu_check(b->value.arrval.entries[1] == n->value.arrval.entries[1]);
+    mu_check(1 == b->value.arrval.entries[1]->refs);
+    mu_check(OBJ_OK == Node_ArrayItem(n, 2, &n) && n != c);
+    mu_check(OBJ_OK == Node_DictSet(n, "c", NewStringNode("z", 1)));
+
+    // owning it again copies nothing, and the original tree is unchanged
+    created = Node_CreatedCount();
+    SearchPath_Own(&sp, &copy, 0);
+    mu_assert_int_eq(0, Node_CreatedCount() - created);
+    mu_check(OBJ_OK == Node_DictGet(c, "c", &n) && !strcmp("y", n->value.strval.data));
+
+    // a path that matches multiple values owns all of them, an item of a packed array its array
+    SearchPath all = NewSearchPath(2);
+    SearchPath_AppendKey(&all, "d", 1);
+    SearchPath_AppendWildcard(&all);
+    SearchPath_Own(&all, &copy, 0);
+    mu_check(OBJ_OK == Node_DictGet(copy, "d", &n) && n != d && !d->refs);
+    mu_check(OBJ_OK == Node_ArrayItem(n, 0, &n) && n != d->value.arrval.entries[0]);
+    mu_check(!d->value.arrval.entries[0]->refs);
+    SearchPath packed = NewSearchPath(2);
+    SearchPath_AppendKey(&packed, "f", 1);
+    SearchPath_AppendIndex(&packed, 0);
+    SearchPath_Own(&packed, &copy, 0);
+    mu_check(OBJ_OK == Node_DictGet(copy, "f", &n) && n != f && !f->refs);
+    mu_check(OBJ_OK == Node_ArrayReplace(n, 0, NewIntNode(7)));
+    mu_check(OBJ_OK == Node_ArrayItem(f, 0, &n) && 1 == n->value.intval);
+
+    // deep owning leaves no shared node, and either tree frees its own
+    Node *other = Node_Share(copy);
+    Node_OwnAll(&other);
+    size_t nodes = 0, unique = 0;
+    Node_Traverse(other, __countVisits, &nodes);
+    Node_TraverseUnique(other, __countVisits, &unique);
+    mu_assert_int_eq(nodes, unique);
+    mu_check(!copy->refs && !other->refs);
+    Node_Free(other);
+    Node_Free(root);
+    Node_Free(copy);
+    SearchPath_Free(&sp);
+    SearchPath_Free(&all);
+    SearchPath_Free(&packed);
+    mu_check(NULL == Node_Share(NULL));
+}
+
+MU_TEST(testStringCompression) {
+    char in[3000], out[3000], dict[600];
+    char *tmp;
+    Node *n, *m, *arr;
+
+    // the stream round trips, and only fits when it's small enough
+    for (int i = 0; i < 3000; i++) in[i] = "json"[i % 4] + i / 500;
+    size_t clen = Compress(in, 3000, out, sizeof(out));
+    mu_check(clen > 0 && clen < 300);
+    mu_check(Decompress(out, clen, dict, 600) == 0);
+    mu_check(!Compress(in, 3000, out, clen - 1));
+    char *dec = malloc(3000);
+    mu_check(Decompress(out, clen, dec, 3000));
+    mu_check(!memcmp(in, dec, 3000));
+    mu_check(!Decompress(out, clen - 1, dec, 3000));
+
+    // a dictionary helps with values that don't repeat themselves
+    for (uint32_t i = 0, x = 1; i < 600; i++, x = x * 1103515245 + 12345) dict[i] = x >> 16;
+    mu_check(!Compress(dict + 100, 100, out, 80));
+    Compress_SetDictionary(dict, 600);
+    mu_assert_int_eq(600, Compress_DictionarySize());
+    clen = Compress(dict + 100, 100, out, 80);
+    mu_check(clen > 0);
+    mu_check(Decompress(out, clen, dec, 100) && !memcmp(dict + 100, dec, 100));
+    Compress_SetDictionary(NULL, 0);
+    free(dec);
+
+    // strings over the size are compressed, unless compressing doesn't save enough
+    NodeStringCompressSize = 64;
+    n = NewStringNode(in, 3000);
+    mu_check(n->flags & NODE_F_COMPRESSED);
+    mu_assert_int_eq(3000, Node_Length(n));
+    mu_check(Node_StringMemory(n) < 300);
+    mu_check(!memcmp(in, Node_StringData(n, &tmp), 3000) && !tmp[3000]);
+    free(tmp);
+    m = NewStringNode("0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ!?", 64);
+    mu_check(!(m->flags & NODE_F_COMPRESSED));
+    mu_check(m->value.strval.data == Node_StringData(m, &tmp) && !tmp);
+
+    // clones stay compressed, and compressed strings compare by their values
+    arr = NewArrayNode(0);
+    mu_check(OBJ_OK == Node_ArrayAppend(arr, m));
+    mu_check(OBJ_OK == Node_ArrayAppend(arr, Node_Clone(n)));
+    mu_check(arr->value.arrval.entries[1]->flags & NODE_F_COMPRESSED);
+    mu_assert_int_eq(1, Node_ArrayIndex(arr, n, 0, 0));
+
+    // appending decompresses the string
+    mu_check(OBJ_OK == Node_StringAppend(n, m));
+    mu_check(!(n->flags & NODE_F_COMPRESSED));
+    mu_assert_int_eq(3064, Node_Length(n));
+    mu_check(!memcmp(in, n->value.strval.data, 3000));
+    mu_check(!strcmp(m->value.strval.data, n->value.strval.data + 3000));
+    mu_assert_int_eq(-1, Node_ArrayIndex(arr, n, 0, 0));
+
+    // and so does a compressed string that's built in an arena
+    NodeArena *a = NewNodeArena();
+    NodeArena *prev = Node_SetArena(a);
+    Node *c = NewStringNode(in, 3000);
+    Node_SetArena(prev);
+    mu_check((c->flags & NODE_F_COMPRESSED) && (c->flags & NODE_F_ARENA_DATA));
+    mu_check(OBJ_OK == Node_StringAppend(c, arr->value.arrval.entries[1]));
+    mu_check(!(c->flags & (NODE_F_COMPRESSED | NODE_F_ARENA_DATA)));
+    mu_assert_int_eq(6000, Node_Length(c));
+    mu_check(!memcmp(in, c->value.strval.data + 3000, 3000));
+    NodeStringCompressSize = 0;
+
+    Node_Free(c);
+    NodeArena_Free(a);
+    Node_Free(n);
+    Node_Free(arr);
+}
+
 MU_TEST(testPath) {
     Node *root = NewDictNode(1);
     mu_check(root != NULL);
@@ -200,8 +1270,8 @@ MU_TEST(testPath) {
     SearchPath_AppendKey(&sp, "baz", 3);
     SearchPath_AppendIndex(&sp, 0);
 
-    Node *n = NULL;
-    PathError pe = SearchPath_Find(&sp, root, &n);
+    Node tmp, *n = NULL;
+    PathError pe = SearchPath_Find(&sp, root, &tmp, &n);
 
     mu_check(pe == E_OK);
     mu_check(n != NULL);
@@ -232,7 +1302,7 @@ MU_TEST(testPathEx) {
     mu_check(OBJ_OK == Node_DictSet(dict, "f2", NewIntNode(6379)));
     mu_check(OBJ_OK == Node_DictSet(root, "dict", dict));
 
-    Node *n = NULL;
+    Node tmp, *n = NULL;
     Node *p = NULL;
     int errlevel = 0;
     SearchPath sp;
@@ -242,7 +1312,7 @@ MU_TEST(testPathEx) {
     sp = NewSearchPath(2);
     SearchPath_AppendKey(&sp, "arr", 3);
     SearchPath_AppendIndex(&sp, 0);
-    pe = SearchPath_FindEx(&sp, root, &n, &p, &errlevel);
+    pe = SearchPath_FindEx(&sp, root, &tmp, &n, &p, &errlevel);
     mu_check(pe == E_OK);
     mu_check(arr == p);
     mu_check(n != NULL);
@@ -253,7 +1323,7 @@ MU_TEST(testPathEx) {
     // check for non existing key in root
     sp = NewSearchPath(1);
     SearchPath_AppendKey(&sp, "qux", 3);
-    pe = SearchPath_FindEx(&sp, root, &n, &p, &errlevel);
+    pe = SearchPath_FindEx(&sp, root, &tmp, &n, &p, &errlevel);
     mu_check(E_NOKEY == pe);
     mu_check(0 == errlevel);
     mu_check(p == root);
@@ -263,7 +1333,7 @@ MU_TEST(testPathEx) {
     sp = NewSearchPath(2);
     SearchPath_AppendKey(&sp, "dict", 4);
     SearchPath_AppendKey(&sp, "f0", 2);
-    pe = SearchPath_FindEx(&sp, root, &n, &p, &errlevel);
+    pe = SearchPath_FindEx(&sp, root, &tmp, &n, &p, &errlevel);
     mu_check(E_NOKEY == pe);
     mu_check(1 == errlevel);
     mu_check(p == dict);
@@ -273,7 +1343,7 @@ MU_TEST(testPathEx) {
     sp = NewSearchPath(2);
     SearchPath_AppendKey(&sp, "foo", 3);
     SearchPath_AppendIndex(&sp, 0);
-    pe = SearchPath_FindEx(&sp, root, &n, &p, &errlevel);
+    pe = SearchPath_FindEx(&sp, root, &tmp, &n, &p, &errlevel);
     mu_check(E_BADTYPE == pe);
     mu_check(1 == errlevel);
     SearchPath_Free(&sp);
@@ -282,7 +1352,7 @@ MU_TEST(testPathEx) {
     sp = NewSearchPath(2);
     SearchPath_AppendKey(&sp, "arr", 3);
     SearchPath_AppendIndex(&sp, 99);
-    pe = SearchPath_FindEx(&sp, root, &n, &p, &errlevel);
+    pe = SearchPath_FindEx(&sp, root, &tmp, &n, &p, &errlevel);
     mu_check(E_NOINDEX == pe);
     mu_check(1 == errlevel);
     mu_check(arr == p);
@@ -292,7 +1362,7 @@ MU_TEST(testPathEx) {
 }
 
 MU_TEST(testPathArray) {
-    Node *n, *arr = NewArrayNode(0);
+    Node tmp, *n, *arr = NewArrayNode(0);
     SearchPath sp;
     PathError pe;
 
@@ -308,7 +1378,7 @@ MU_TEST(testPathArray) {
     for (int i = 0; i < 5; i++) {
         sp = NewSearchPath(1);
         SearchPath_AppendIndex(&sp, i);
-        pe = SearchPath_Find(&sp, arr, &n);
+        pe = SearchPath_Find(&sp, arr, &tmp, &n);
         mu_check(pe == E_OK);
         mu_check(NULL != n);
         mu_check(N_INTEGER == n->type);
@@ -320,7 +1390,7 @@ MU_TEST(testPathArray) {
     for (int i = -1; i > -6; i--) {
         sp = NewSearchPath(1);
         SearchPath_AppendIndex(&sp, i);
-        pe = SearchPath_Find(&sp, arr, &n);
+        pe = SearchPath_Find(&sp, arr, &tmp, &n);
         mu_check(pe == E_OK);
         mu_check(NULL != n);
         mu_check(N_INTEGER == n->type);
@@ -331,16 +1401,29 @@ MU_TEST(testPathArray) {
     // verify that out of bounds access errs
     sp = NewSearchPath(1);
     SearchPath_AppendIndex(&sp, 5);
-    pe = SearchPath_Find(&sp, arr, &n);
+    pe = SearchPath_Find(&sp, arr, &tmp, &n);
     mu_check(E_NOINDEX == pe);
     SearchPath_Free(&sp);
 
     sp = NewSearchPath(1);
     SearchPath_AppendIndex(&sp, -6);
-    pe = SearchPath_Find(&sp, arr, &n);
+    pe = SearchPath_Find(&sp, arr, &tmp, &n);
     mu_check(E_NOINDEX == pe);
     SearchPath_Free(&sp);
 
+    // lookups read the items of a packed array as they are, and replacing one unpacks it
+    mu_check(arr->flags & NODE_F_PACKED_INT);
+    sp = NewSearchPath(1);
+    SearchPath_AppendIndex(&sp, 2);
+    mu_check(E_OK == SearchPath_Find(&sp, arr, &tmp, &n));
+    mu_check(&tmp == n);
+    mu_check(OBJ_OK == Node_ArrayReplace(arr, 2, NewStringNode("two", 3)));
+    mu_check(!(arr->flags & NODE_F_PACKED));
+    mu_check(E_OK == SearchPath_Find(&sp, arr, &tmp, &n));
+    mu_check(N_STRING == n->type && &tmp != n);
+    mu_check(OBJ_ERR == Node_ArrayReplace(arr, 5, NULL));
+    SearchPath_Free(&sp);
+
     Node_Free(arr);
 }
 
@@ -365,7 +1448,7 @@ MU_TEST(testPathParse) {
 
     const char *badpaths[] = {
         "3",        "6379",        "foo[bar]", "foo[]",         "foo[3",        "bar[\"]",
-        "foo..bar", "foo[\"bar']", "foo/bar",  "foo.bar[-1.2]", "foo.bar[1.1]", "foo.bar[+3]",
+        "foo...bar", "foo[\"bar']", "foo/bar",  "foo.bar[-1.2]", "foo.bar[1.1]", "foo.bar[+3]",
         "1foo",     "f?oo",        "foo\n",    "foo\tbar",      "foobar[-i]",   NULL};
 
     for (int idx = 0; badpaths[idx] != NULL; idx++) {
@@ -387,17 +1470,395 @@ MU_TEST(testPathParseRoot) {
     SearchPath_Free(&sp);
 }
 
+MU_TEST(testPathParseMulti) {
+    const char *path = "foo[1:2][:-3][::2][-1:][2:5:3][*].*..bar..[0]..*";
+
+    SearchPath sp = NewSearchPath(0);
+    int rc = ParseJSONPath(path, strlen(path), &sp, NULL);
+    mu_assert_int_eq(rc, PARSE_OK);
+    mu_assert_int_eq(sp.len, 14);
+    mu_check(SearchPath_IsMulti(&sp));
+
+    PathSlice slices[] = {{1, 2, 1}, {0, -3, 1}, {0, SEARCHPATH_SLICE_END, 2},
+                          {-1, SEARCHPATH_SLICE_END, 1}, {2, 5, 3}};
+    for (int i = 0; i < 5; i++) {
+        mu_check(NT_SLICE == sp.nodes[i + 1].type);
+        mu_assert_int_eq(slices[i].start, sp.nodes[i + 1].value.slice.start);
+        mu_assert_int_eq(slices[i].end, sp.nodes[i + 1].value.slice.end);
+        mu_assert_int_eq(slices[i].step, sp.nodes[i + 1].value.slice.step);
+    }
+    mu_check(NT_WILDCARD == sp.nodes[6].type && NT_WILDCARD == sp.nodes[7].type);
+    mu_check(NT_DESCENT == sp.nodes[8].type);
+    mu_check(NT_KEY == sp.nodes[9].type && !strcmp("bar", sp.nodes[9].value.key));
+    mu_check(NT_DESCENT == sp.nodes[10].type && NT_INDEX == sp.nodes[11].type);
+    mu_check(NT_DESCENT == sp.nodes[12].type && NT_WILDCARD == sp.nodes[13].type);
+    SearchPath_Free(&sp);
+
+    sp = NewSearchPath(0);
+    mu_check(PARSE_OK == ParseJSONPath("foo.bar[3]", 10, &sp, NULL));
+    mu_check(!SearchPath_IsMulti(&sp));
+    SearchPath_Free(&sp);
+
+    const char *badpaths[] = {"foo[1:2:0]", "foo[::-1]", "foo[1:2:3:4]", "foo[1:x]", "foo[:-]",
+                              "foo.*bar",   "foo[*x]",   "foo[*",        "foo..",    "foo..*x",
+                              NULL};
+    for (int idx = 0; badpaths[idx] != NULL; idx++) {
+        sp = NewSearchPath(0);
+        mu_check(ParseJSONPath(badpaths[idx], strlen(badpaths[idx]), &sp, NULL) == PARSE_ERR);
+        SearchPath_Free(&sp);
+    }
+}
+
+/* Prints the matches of a path as a comma separated list */
+static void matchVisitor(Node *n, Node *p, const char *key, int index, void *ctx) {
+    char *s = ctx;
+    size_t len = strlen(s);
+    const char *sep = len ? "," : "";
+    if (!n) {
+        snprintf(s + len, 256 - len, "%snull", sep);
+    } else if (N_INTEGER == n->type) {
+        snprintf(s + len, 256 - len, "%s%lld", sep, (long long)n->value.intval);
+    } else if (N_STRING == n->type) {
+        snprintf(s + len, 256 - len, "%s%.*s", sep, (int)n->value.strval.len, n->value.strval.data);
+    } else {
+        snprintf(s + len, 256 - len, "%s%s", sep, N_DICT == n->type ? "{}" : "[]");
+    }
+}
+
+MU_TEST(testPathFindEach) {
+    const char *tests[][2] = {
+        {"arr[*]", "0,1,2,3,4,5"},
+        {"arr[1:3]", "1,2"},
+        {"arr[::2]", "0,2,4"},
+        {"arr[-2:]", "4,5"},
+        {"arr[:-4]", "0,1"},
+        {"arr[4:1]", ""},
+        {"arr[-100:100:3]", "0,3"},
+        {"arr[2]", "2"},
+        {"objs[*].id", "a,b"},
+        {"objs[*].x", "1"},
+        {".*", "[],[]"},
+        {"..id", "a,b"},
+        {"..x", "1"},
+        {"..[1]", "1,{}"},
+        {"objs..*", "{},{},a,b,1"},
+        {"missing[*]", ""},
+        {"arr.*.foo", ""},
+    };
+
+    // {"arr":[0,1,2,3,4,5],"objs":[{"id":"a"},{"id":"b","x":1}]}, where arr is packed
+    Node *root = NewDictNode(2);
+    Node *arr = NewArrayNode(6);
+    Node *objs = NewArrayNode(2);
+    Node *a = NewDictNode(1), *b = NewDictNode(2);
+    for (int i = 0; i < 6; i++) Node_ArrayAppendInt(arr, i);
+    Node_DictSet(a, "id", NewCStringNode("a"));
+    Node_DictSet(b, "id", NewCStringNode("b"));
+    Node_DictSet(b, "x", NewIntNode(1));
+    Node_ArrayAppend(objs, a);
+    Node_ArrayAppend(objs, b);
+    Node_DictSet(root, "arr", arr);
+    Node_DictSet(root, "objs", objs);
+
+    for (int interned = 0; interned < 2; interned++) {
+        for (int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+            SearchPath sp = NewSearchPath(0);
+            mu_check(PARSE_OK == ParseJSONPath(tests[i][0], strlen(tests[i][0]), &sp, NULL));
+            if (interned) SearchPath_Intern(&sp);
+            char s[256] = "";
+            size_t count = SearchPath_FindEach(&sp, root, matchVisitor, s);
+            mu_check(!strcmp(tests[i][1], s));
+            size_t expected = *s ? 1 : 0;
+            for (char *c = s; *c; c++) expected += ',' == *c;
+            mu_assert_int_eq(expected, count);
+
+            // single value lookups can't return multiple matches
+            Node tmp, *n;
+            if (SearchPath_IsMulti(&sp)) mu_check(E_OK != SearchPath_Find(&sp, root, &tmp, &n));
+            if (!strncmp("arr[", tests[i][0], 4) && SearchPath_IsMulti(&sp))
+                mu_check(E_MULTI == SearchPath_Find(&sp, root, &tmp, &n));
+            SearchPath_Free(&sp);
+        }
+    }
+
+    // the matches aren't copies, and packed arrays stay packed
+    mu_check(arr->flags & NODE_F_PACKED);
+
+    Node_Free(root);
+}
+
+MU_TEST(testPathFilter) {
+    const char *tests[][2] = {
+        {"orders[?(@.status==\"open\")].id", "1,3"},
+        {"orders[?(@.status == 'open' && @.price < 10)].id", "3"},
+        {"orders[?(@.status != 'open' || @.price >= 20)].id", "1,2"},
+        {"orders[?(!(@.price > 5))].id", "3"},
+        {"orders[?(@.tags)].id", "2"},
+        {"orders[?(!@.tags)].id", "1,3"},
+        {"orders[?(@.tags[0] == 'x')].id", "2"},
+        {"orders[?(@.price == @.id)].id", ""},
+        {"orders[?(@.price > 'a')].id", ""},
+        {"orders[?(@.price != 'a')].id", "1,2,3"},
+        {"orders[?(@.gift == true)].id", "2"},
+        {"orders[?(@.gift == null)].id", "3"},
+        {"orders[?(@.status == 'it\\'s')].id", ""},
+        {"nums[?(@ >= 2)]", "2,3"},
+        {"orders[?(@.id==2)].tags[*]", "x,y"},
+    };
+
+    // {"orders":[{"id":1,"status":"open","price":20},
+    //            {"id":2,"status":"closed","price":30,"tags":["x","y"],"gift":true},
+    //            {"id":3,"status":"open","price":5,"gift":null}],"nums":[1,2,3]}, where nums is packed
+    Node *root = NewDictNode(2);
+    Node *orders = NewArrayNode(3);
+    Node *nums = NewArrayNode(3);
+    for (int i = 1; i <= 3; i++) {
+        Node *o = NewDictNode(5);
+        Node_DictSet(o, "id", NewIntNode(i));
+        Node_DictSet(o, "status", NewCStringNode(2 == i ? "closed" : "open"));
+        Node_DictSet(o, "price", 1 == i ? NewIntNode(20) : NewDoubleNode(2 == i ? 30 : 5));
+        if (2 == i) {
+            Node *tags = NewArrayNode(2);
+            Node_ArrayAppend(tags, NewCStringNode("x"));
+            Node_ArrayAppend(tags, NewCStringNode("y"));
+            Node_DictSet(o, "tags", tags);
+            Node_DictSet(o, "gift", NewBoolNode(1));
+        }
+        if (3 == i) Node_DictSet(o, "gift", NULL);
+        Node_ArrayAppend(orders, o);
+        Node_ArrayAppendInt(nums, i);
+    }
+    Node_DictSet(root, "orders", orders);
+    Node_DictSet(root, "nums", nums);
+
+    for (int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        SearchPath sp = NewSearchPath(0);
+        mu_check(PARSE_OK == ParseJSONPath(tests[i][0], strlen(tests[i][0]), &sp, NULL));
+        mu_check(SearchPath_IsMulti(&sp));
+        char s[256] = "";
+        SearchPath_FindEach(&sp, root, matchVisitor, s);
+        mu_check(!strcmp(tests[i][1], s));
+        SearchPath_Free(&sp);
+    }
+    mu_check(nums->flags & NODE_F_PACKED);
+
+    const char *badpaths[] = {"orders[?@.id==1]",     "orders[?(@.id==1]",   "orders[?(@.id==)]",
+                              "orders[?(@.id=1)]",    "orders[?(1==1)]",     "orders[?(@.id=='x)]",
+                              "orders[?(@[*]==1)]",   "orders[?(@.id==1)",   "orders[?(@.id==1)x]",
+                              "orders[?(@.id==1 &&)]", "orders[?(@.id==nil)]", NULL};
+    for (int idx = 0; badpaths[idx] != NULL; idx++) {
+        SearchPath sp = NewSearchPath(0);
+        mu_check(ParseJSONPath(badpaths[idx], strlen(badpaths[idx]), &sp, NULL) == PARSE_ERR);
+        SearchPath_Free(&sp);
+    }
+
+    Node_Free(root);
+}
+
+MU_TEST(testPathFindAll) {
+    const char *json[] = {".", ".foo", ".foo.bar", ".foo.bar[1]", ".foo.bar[-1]", ".foo.bar[5]",
+                          ".foo.baz", ".foo.baz.qux", ".arr[0]", ".foo.bar[1]", "['foo'].bar",
+                          ".foo.bar[0].x"};
+    int n = sizeof(json) / sizeof(char *);
+    SearchPath sp[n];
+    SearchPathMatch matches[n];
+
+    // {"foo":{"bar":[1,"2",null]},"arr":[{}]}
+    Node *root = NewDictNode(2);
+    Node *foo = NewDictNode(1);
+    Node *bar = NewArrayNode(3);
+    Node *arr = NewArrayNode(1);
+    Node_ArrayAppend(bar, NewIntNode(1));
+    Node_ArrayAppend(bar, NewCStringNode("2"));
+    Node_ArrayAppend(bar, NULL);
+    Node_DictSet(foo, "bar", bar);
+    Node_ArrayAppend(arr, NewDictNode(0));
+    Node_DictSet(root, "foo", foo);
+    Node_DictSet(root, "arr", arr);
+
+    // every match is what SearchPath_FindEx finds, for interned and plain paths alike
+    for (int interned = 0; interned < 2; interned++) {
+        for (int i = 0; i < n; i++) {
+            sp[i] = NewSearchPath(0);
+            mu_check(PARSE_OK == ParseJSONPath(json[i], strlen(json[i]), &sp[i], NULL));
+            if (interned) SearchPath_Intern(&sp[i]);
+            matches[i].path = &sp[i];
+        }
+        SearchPath_FindAll(matches, n, root);
+
+        mu_check(E_OK == matches[0].err && root == matches[0].n && !matches[0].p);
+        for (int i = 1; i < n; i++) {
+            Node tmp, *en, *ep;
+            int errnode = -1;
+            PathError err = SearchPath_FindEx(&sp[i], root, &tmp, &en, &ep, &errnode);
+            mu_assert_int_eq(err, matches[i].err);
+            mu_check(en == matches[i].n && ep == matches[i].p);
+            if (E_OK != err) mu_assert_int_eq(errnode, matches[i].errnode);
+        }
+        mu_check(E_NOINDEX == matches[5].err && bar == matches[5].p);
+        mu_check(E_NOKEY == matches[7].err && 1 == matches[7].errnode);
+        mu_check(E_BADTYPE == matches[11].err);
+        for (int i = 0; i < n; i++) SearchPath_Free(&sp[i]);
+    }
+
+    Node_Free(root);
+}
+
+MU_TEST(testPathCache) {
+    Node *root = NewDictNode(1), *dict = NewDictNode(1), *n, *p, tmp;
+    CompiledPath *cp, *cp2;
+    size_t count;
+    uint64_t hits, misses, hits0, misses0;
+    int errlevel;
+    char path[32];
+
+    Node_DictSet(dict, "bar", NewIntNode(42));
+    Node_DictSet(root, "foo", dict);
+    PathCache_SetCapacity(4);
+    PathCache_Stats(NULL, &hits0, &misses0);
+
+    // the compiled path is shared and its keys are interned
+    cp = PathCache_Get(".foo.bar", 8, NULL);
+    mu_check(NULL != cp);
+    mu_check(cp->sp.interned);
+    mu_check(cp->sp.nodes[0].value.key == Intern_Find("foo", 3));
+    mu_check(E_OK == SearchPath_FindEx(&cp->sp, root, &tmp, &n, &p, &errlevel));
+    mu_check(42 == n->value.intval && dict == p);
+    cp2 = PathCache_Get(".foo.bar", 8, NULL);
+    mu_check(cp == cp2);
+    PathCache_Release(cp2);
+    PathCache_Stats(&count, &hits, &misses);
+    mu_check(1 == count && hits0 + 1 == hits && misses0 + 1 == misses);
+
+    // a key that no document has
+    cp2 = PathCache_Get(".foo.qux", 8, NULL);
+    mu_check(E_NOKEY == SearchPath_FindEx(&cp2->sp, root, &tmp, &n, &p, &errlevel));
+    mu_check(1 == errlevel);
+    PathCache_Release(cp2);
+
+    // invalid paths aren't cached
+    JSONSearchPathError_t err = {0};
+    mu_check(NULL == PathCache_Get(".foo[x]", 7, &err));
+    mu_check(NULL != err.errmsg);
+
+    // evicted paths live on as long as they are referenced
+    for (int i = 0; i < 10; i++) {
+        int len = snprintf(path, sizeof(path), "foo.bar[%d]", i);
+        PathCache_Release(PathCache_Get(path, len, NULL));
+    }
+    PathCache_Stats(&count, NULL, NULL);
+    mu_check(4 == count);
+    mu_check(E_OK == SearchPath_FindEx(&cp->sp, root, &tmp, &n, &p, &errlevel));
+    mu_check(42 == n->value.intval);
+    cp2 = PathCache_Get(".foo.bar", 8, NULL);
+    mu_check(cp != cp2);
+    PathCache_Release(cp2);
+    PathCache_Release(cp);
+
+    // without the cache every path is compiled
+    PathCache_SetCapacity(0);
+    PathCache_Stats(&count, NULL, NULL);
+    mu_check(0 == count);
+    cp = PathCache_Get(".foo", 4, NULL);
+    cp2 = PathCache_Get(".foo", 4, NULL);
+    mu_check(cp != cp2);
+    PathCache_Release(cp);
+    PathCache_Release(cp2);
+    PathCache_SetCapacity(PATH_CACHE_CAPACITY);
+
+    Node_Free(root);
+}
+
+MU_TEST(testSerialCache) {
+    SerialCacheEntry *doc1 = NULL, *doc2 = NULL;
+    size_t len, count, memory;
+    uint64_t hits, misses;
+
+    // values are cached per document, key and version
+    SerialCache_Put(&doc1, 0, "a", 1, "[1,2]", 5);
+    SerialCache_Put(&doc2, 0, "a", 1, "{}", 2);
+    const char *v = SerialCache_Get(&doc1, 0, "a", 1, &len);
+    mu_check(v);
+    mu_check(5 == len && !memcmp("[1,2]", v, len));
+    v = SerialCache_Get(&doc2, 0, "a", 1, &len);
+    mu_check(v);
+    mu_check(2 == len && !memcmp("{}", v, len));
+    mu_check(!SerialCache_Get(&doc1, 0, "b", 1, &len));
+    SerialCache_Stats(&count, &memory, &hits, &misses);
+    mu_check(2 == count);
+    mu_check(2 == hits && 1 == misses);
+
+    // a new version makes the document's entries stale, and they're freed when met
+    mu_check(!SerialCache_Get(&doc1, 1, "a", 1, &len));
+    mu_check(!doc1);
+    SerialCache_Stats(&count, NULL, NULL, NULL);
+    mu_check(1 == count);
+
+    // dropping a document frees its entries
+    SerialCache_Drop(&doc2);
+    mu_check(!doc2);
+    SerialCache_Stats(&count, &memory, NULL, NULL);
+    mu_check(0 == count && 0 == memory);
+
+    // the least recently used entries are evicted to stay within the memory limit
+    SerialCache_Put(&doc1, 1, "a", 1, "1", 1);
+    SerialCache_Stats(NULL, &memory, NULL, NULL);
+    SerialCache_SetMaxMemory(memory * 2);
+    SerialCache_Put(&doc2, 0, "b", 1, "2", 1);
+    mu_check(SerialCache_Get(&doc1, 1, "a", 1, &len));
+    SerialCache_Put(&doc2, 0, "c", 1, "3", 1);
+    mu_check(SerialCache_Get(&doc1, 1, "a", 1, &len));
+    mu_check(!SerialCache_Get(&doc2, 0, "b", 1, &len));
+    mu_check(SerialCache_Get(&doc2, 0, "c", 1, &len));
+
+    // values that can't fit aren't cached, and a 0 limit disables the cache
+    char big[256] = {0};
+    mu_check(!SerialCache_Get(&doc1, 1, "big", 3, &len));
+    SerialCache_Put(&doc1, 1, "big", 3, big, sizeof(big));
+    mu_check(!SerialCache_Get(&doc1, 1, "big", 3, &len));
+    SerialCache_SetMaxMemory(0);
+    mu_check(!doc1 && !doc2);
+    SerialCache_Put(&doc1, 1, "a", 1, "1", 1);
+    mu_check(!doc1);
+
+    SerialCache_SetMaxMemory(SERIAL_CACHE_MAX_MEMORY);
+}
+
 MU_TEST_SUITE(test_object) {
     // MU_SUITE_CONFIGURE(&test_setup, &test_teardown);
 
     MU_RUN_TEST(testNodeString);
     MU_RUN_TEST(testNodeArray);
     MU_RUN_TEST(testObject);
+    MU_RUN_TEST(testObjectHashIndex);
+    MU_RUN_TEST(testDictPrefixScan);
+    MU_RUN_TEST(testSharedNodes);
+    MU_RUN_TEST(testPackedArray);
+    MU_RUN_TEST(testArraySearch);
+    MU_RUN_TEST(testArrayBisect);
+    MU_RUN_TEST(testArrayIndexed);
+    MU_RUN_TEST(testArrayHeadGap);
+    MU_RUN_TEST(testArrayGrowth);
+    MU_RUN_TEST(testAllocatedSize);
+    MU_RUN_TEST(testStringGrowth);
+    MU_RUN_TEST(testContainerShrink);
+    MU_RUN_TEST(testDeepTree);
+    MU_RUN_TEST(testInternedKeys);
+    MU_RUN_TEST(testNodeClone);
+    MU_RUN_TEST(testNodeDedup);
+    MU_RUN_TEST(testNodeOwnPath);
+    MU_RUN_TEST(testStringCompression);
     MU_RUN_TEST(testPath);
     MU_RUN_TEST(testPathEx);
     MU_RUN_TEST(testPathArray);
     MU_RUN_TEST(testPathParse);
     MU_RUN_TEST(testPathParseRoot);
+    MU_RUN_TEST(testPathParseMulti);
+    MU_RUN_TEST(testPathFindEach);
+    MU_RUN_TEST(testPathFilter);
+    MU_RUN_TEST(testPathFindAll);
+    MU_RUN_TEST(testPathCache);
+    MU_RUN_TEST(testSerialCache);
 }
 
 int main(int argc, char *argv[]) {
@@ -1,90 +1,249 @@
+# A workload driver that benchmarks the module's commands and compares the results with a baseline
+from __future__ import print_function
 import multiprocessing
 import time
 import redis
-import random
 import sys
 import argparse
-from urlparse import urlparse
+import json
 import os
-from itertools import chain
-from collections import defaultdict
 import math
+try:
+    from urlparse import urlparse
+except ImportError:
+    from urllib.parse import urlparse
 
-def ping(r):
-    r.ping()
+# the operations after which the values that workloads grow are reset, untimed
+RESET_EVERY = 1000
 
-def jsonset(r):
-    r.execute_command('JSON.SET', 'j', '.', '{}')
+clock = getattr(time, 'perf_counter', time.time)
+
+def MakeObject(keys, depth, size):
+    """A dictionary of string fields f0, f1... with another such dictionary at 'n' for every level"""
+    obj = {'f{}'.format(i): 'x' * size for i in range(keys)}
+    if depth > 1:
+        obj['n'] = MakeObject(keys, depth - 1, size)
+    return obj
+
+def MakeContext(args, wpid):
+    """What the operations of a worker use: its keys, the document and the paths in it"""
+    doc = {
+        'obj': MakeObject(max(args.keys, 1), max(args.depth, 1), args.value_size),
+        'arr': list(range(args.array_size)),
+        'str': 'x' * args.value_size,
+        'num': 0,
+        'tmp': [],
+    }
+    key = 'bench:{}'.format(wpid)
+    return {
+        'key': key,
+        'other': '{}:other'.format(key),
+        'doc': json.dumps(doc, separators=(',', ':')),
+        'value': json.dumps('x' * args.value_size),
+        'deep': '.obj' + '.n' * (max(args.depth, 1) - 1),
+        'mkeys': [key] * 10,
+        'index': 'bench:index',
+    }
+
+def ResetStr(c):
+    return [('JSON.SET', c['key'], '.str', c['value'])]
+
+def ResetTmp(c):
+    return [('JSON.SET', c['key'], '.tmp', '[]')]
+
+# name: the commands of an operation, given the context and the operation's number, and the
+# untimed commands that reset what it grows, if it does
+WORKLOADS = [
+    ('set', lambda c, i: [('JSON.SET', c['key'], c['deep'] + '.f0', c['value'])], None),
+    ('set_doc', lambda c, i: [('JSON.SET', c['other'], '.', c['doc'])], None),
+    ('setchunk', lambda c, i: [('JSON.SETCHUNK', c['other'], '.', 0, c['doc'], 'COMMIT')], None),
+    ('mset', lambda c, i: [('JSON.MSET', c['key'], c['deep'] + '.f0', c['value'], '.str',
+                            c['value'])], None),
+    ('get', lambda c, i: [('JSON.GET', c['key'], c['deep'] + '.f0')], None),
+    ('get_doc', lambda c, i: [('JSON.GET', c['key'], '.')], None),
+    ('mget', lambda c, i: [('JSON.MGET', ) + tuple(c['mkeys']) + (c['deep'] + '.f0', )], None),
+    ('mgetarray', lambda c, i: [('JSON.MGETARRAY', ) + tuple(c['mkeys']) + (c['deep'] + '.f0', )],
+     None),
+    ('resp', lambda c, i: [('JSON.RESP', c['key'], c['deep'])], None),
+    ('type', lambda c, i: [('JSON.TYPE', c['key'], c['deep'] + '.f0')], None),
+    ('del', lambda c, i: [('JSON.DEL', c['key'], '.tmp'), ('JSON.SET', c['key'], '.tmp', '[]')],
+     None),
+    ('copy', lambda c, i: [('JSON.COPY', c['key'], c['other'], 'REPLACE')], None),
+    ('merge', lambda c, i: [('JSON.MERGE', c['key'], c['deep'], '{"f0":' + c['value'] + '}')],
+     None),
+    ('patch', lambda c, i: [('JSON.PATCH', c['key'],
+                             '[{"op":"replace","path":"/num","value":' + str(i) + '}]')], None),
+    ('numincrby', lambda c, i: [('JSON.NUMINCRBY', c['key'], '.num', 1)], None),
+    ('nummultby', lambda c, i: [('JSON.NUMMULTBY', c['key'], '.num', 1)], None),
+    ('mnumincrby', lambda c, i: [('JSON.MNUMINCRBY', c['key'], '.num', 1, '.num', 1)], None),
+    ('mnummultby', lambda c, i: [('JSON.MNUMMULTBY', c['key'], '.num', 1, '.num', 1)], None),
+    ('strappend', lambda c, i: [('JSON.STRAPPEND', c['key'], '.str', '"x"')], ResetStr),
+    ('strlen', lambda c, i: [('JSON.STRLEN', c['key'], '.str')], None),
+    ('arrappend', lambda c, i: [('JSON.ARRAPPEND', c['key'], '.tmp', i)], ResetTmp),
+    ('arrinsert', lambda c, i: [('JSON.ARRINSERT', c['key'], '.tmp', 0, i)], ResetTmp),
+    ('arrpop', lambda c, i: [('JSON.ARRAPPEND', c['key'], '.tmp', i),
+                             ('JSON.ARRPOP', c['key'], '.tmp')], None),
+    ('arrtrim', lambda c, i: [('JSON.ARRAPPEND', c['key'], '.tmp', i),
+                              ('JSON.ARRTRIM', c['key'], '.tmp', 0, 99)], None),
+    ('arrlen', lambda c, i: [('JSON.ARRLEN', c['key'], '.arr')], None),
+    ('arrindex', lambda c, i: [('JSON.ARRINDEX', c['key'], '.arr', -1)], None),
+    ('arrcount', lambda c, i: [('JSON.ARRCOUNT', c['key'], '.arr', 0)], None),
+    ('objkeys', lambda c, i: [('JSON.OBJKEYS', c['key'], c['deep'])], None),
+    ('objlen', lambda c, i: [('JSON.OBJLEN', c['key'], c['deep'])], None),
+    ('query', lambda c, i: [('JSON.QUERY', c['index'], 'EQ', 0, 'LIMIT', 0, 10)], None),
+    ('debug_memory', lambda c, i: [('JSON.DEBUG', 'MEMORY', c['key'])], None),
+    ('stats', lambda c, i: [('JSON.STATS', )], None),
+]
+WORKLOAD_NAMES = [name for name, _, _ in WORKLOADS]
 
 def runWorker(ctx):
+    """Runs a workload's operations and returns their latencies in seconds and the elapsed time"""
     wpid = os.getpid()
-    print '{} '.format(wpid),
-    sys.stdout.flush()
-
-    rep = defaultdict(int)
+    _, op, reset = WORKLOADS[WORKLOAD_NAMES.index(ctx['workload'])]
+    c = MakeContext(ctx['args'], wpid)
     r = redis.StrictRedis(host=ctx['host'], port=ctx['port'])
-    work = ctx['work']
-    if ctx['pipeline'] == 0:
-        for i in range(0, ctx['count']):
-            key = '{}:{}'.format(wpid, i)
-            s0 = time.time()
-            work(r)
-            s1 = time.time() - s0
-            bin = int(math.floor(s1 * 1000)) + 1
-            rep[bin] += 1
-    else:        
-        for i in range(0, ctx['count'], ctx['pipeline']):
-            p = r.pipeline()
-            s0 = time.time()
-            for j in range(0, ctx['pipeline']):
-                key = '{}:{}'.format(wpid, i)
-                work(p)
+    r.execute_command('JSON.SET', c['key'], '.', c['doc'])
+    r.execute_command('JSON.SET', c['other'], '.', c['doc'])
+
+    latencies = []
+    elapsed = 0
+    pipeline = max(ctx['pipeline'], 1)
+    for i in range(0, ctx['count'], pipeline):
+        batch = range(i, min(i + pipeline, ctx['count']))
+        p = r.pipeline(transaction=False) if ctx['pipeline'] else r
+        s0 = clock()
+        for j in batch:
+            for cmd in op(c, j):
+                p.execute_command(*cmd)
+        if ctx['pipeline']:
             p.execute()
-            s1 = time.time() - s0
-            bin = int(math.floor(s1 * 1000)) + 1
-            rep[bin] += ctx['pipeline']
+        s1 = clock() - s0
+        elapsed += s1
+        latencies.append(s1)
+        if reset and (batch[-1] + 1) // RESET_EVERY != i // RESET_EVERY:
+            for cmd in reset(c):
+                r.execute_command(*cmd)
+
+    r.delete(c['key'], c['other'])
+    return latencies, ctx['count'], elapsed
+
+def Percentile(latencies, p):
+    """The p-th percentile of sorted latencies, in milliseconds"""
+    if not latencies:
+        return 0
+    i = min(len(latencies) - 1, max(0, int(math.ceil(p / 100.0 * len(latencies))) - 1))
+    return round(latencies[i] * 1000, 4)
+
+def RunWorkload(pool, name, args, uri):
+    ctx = {
+        'workload': name,
+        'count': args.count // args.workers,
+        'pipeline': args.pipeline,
+        'host': uri.hostname,
+        'port': uri.port,
+        'args': args,
+    }
+    results = pool.map(runWorker, (ctx, ) * args.workers)
+    latencies = sorted(l for res in results for l in res[0])
+    return {
+        'ops': sum(res[1] for res in results),
+        'ops/sec': round(sum(res[1] / res[2] for res in results if res[2]), 2),
+        'p50': Percentile(latencies, 50),
+        'p99': Percentile(latencies, 99),
+        'p999': Percentile(latencies, 99.9),
+    }
 
-    return rep
+def Compare(results, baseline, threshold):
+    """Adds the changes from the baseline to the results, returns the names of the regressions"""
+    regressions = []
+    for name, res in results.items():
+        base = baseline.get(name)
+        if not base:
+            continue
+        res['ops/sec change'] = round(100.0 * (res['ops/sec'] - base['ops/sec']) / base['ops/sec'], 1) \
+            if base['ops/sec'] else 0
+        res['p99 change'] = round(100.0 * (res['p99'] - base['p99']) / base['p99'], 1) \
+            if base['p99'] else 0
+        if res['ops/sec change'] < -threshold or res['p99 change'] > threshold:
+            regressions.append(name)
+    return regressions
+
+def Report(results, regressions):
+    header = '{:<14} {:>12} {:>10} {:>10} {:>10}'.format('workload', 'ops/sec', 'p50 ms', 'p99 ms',
+                                                         'p999 ms')
+    compared = any('p99 change' in res for res in results.values())
+    if compared:
+        header += ' {:>9} {:>9}'.format('ops/sec %', 'p99 %')
+    print(header)
+    for name in WORKLOAD_NAMES:
+        if name not in results:
+            continue
+        res = results[name]
+        line = '{:<14} {:>12.2f} {:>10.4f} {:>10.4f} {:>10.4f}'.format(name, res['ops/sec'], res['p50'],
+                                                                       res['p99'], res['p999'])
+        if 'p99 change' in res:
+            line += ' {:>+9.1f} {:>+9.1f}'.format(res['ops/sec change'], res['p99 change'])
+        if name in regressions:
+            line += '  REGRESSION'
+        print(line)
 
 if __name__ == '__main__':
     parser = argparse.ArgumentParser(description='ReJSON Benchmark', formatter_class=argparse.ArgumentDefaultsHelpFormatter)
-    parser.add_argument('-c', '--count', type=int, default=100000, help='total number of operations')
-    parser.add_argument('-p', '--pipeline', type=int, default=0, help='pipeline size')
+    parser.add_argument('-c', '--count', type=int, default=100000, help='number of operations of each workload')
+    parser.add_argument('-p', '--pipeline', type=int, default=0, help='pipeline size, latencies are then of whole pipelines')
     parser.add_argument('-w', '--workers', type=int, default=8, help='number of worker processes')
     parser.add_argument('-u', '--uri', type=str, default='redis://localhost:6379', help='Redis server URI')
+    parser.add_argument('-t', '--workloads', type=str, default=','.join(WORKLOAD_NAMES), help='comma separated workloads to run')
+    parser.add_argument('--keys', type=int, default=10, help='fields of every level of the document\'s object')
+    parser.add_argument('--depth', type=int, default=3, help='levels of the document\'s object, the depth of its paths')
+    parser.add_argument('--array-size', type=int, default=1000, help='items of the document\'s array')
+    parser.add_argument('--value-size', type=int, default=32, help='length of the document\'s strings')
+    parser.add_argument('--save', type=str, help='file to save the results to as a JSON baseline')
+    parser.add_argument('--baseline', type=str, help='JSON baseline file to compare the results with')
+    parser.add_argument('--threshold', type=float, default=10, help='percents of lower ops/sec or higher p99 latency that are regressions')
     args = parser.parse_args()
     uri = urlparse(args.uri)
 
-    r = redis.Redis(host=uri.hostname, port=uri.port)
+    workloads = [name for name in args.workloads.split(',') if name]
+    for name in workloads:
+        if name not in WORKLOAD_NAMES:
+            parser.error('unknown workload {}, expecting one of {}'.format(name, ', '.join(WORKLOAD_NAMES)))
+    config = {name: getattr(args, name) for name in ['count', 'pipeline', 'workers', 'keys', 'depth',
+                                                     'array_size', 'value_size']}
 
-    pool = multiprocessing.Pool(args.workers)
-    s0 = time.time()
-    ctx = {
-        'count': args.count / args.workers,
-        'pipeline': args.pipeline,
-        'host': uri.hostname,
-        'port': uri.port,
-        'work': jsonset,
-    }
+    r = redis.StrictRedis(host=uri.hostname, port=uri.port)
+    if 'query' in workloads:
+        r.delete('bench:index')
+        r.execute_command('JSON.INDEX', 'CREATE', 'bench:index', '.num', 'HASH')
 
-    print 'Starting workers: ',
-    sys.stdout.flush()
-    results = pool.map(runWorker, (ctx, ) * args.workers)
-    print
+    print('Count: {}, Workers: {}, Pipeline: {}'.format(args.count, args.workers, args.pipeline))
+    print('Document: {} keys, depth {}, {} array items, {} bytes values'.format(args.keys, args.depth,
+          args.array_size, args.value_size))
+    print('Using hiredis: {}'.format(redis.utils.HIREDIS_AVAILABLE))
+    print()
     sys.stdout.flush()
 
-    s1 = time.time() - s0
-    agg = defaultdict(int)
-    for res in results:
-        for k, v in res.iteritems():
-            agg[k] += v
-
-    print
-    print 'Count: {}, Workers: {}, Pipeline: {}'.format(args.count, args.workers, args.pipeline)
-    print 'Using hireds: {}'.format(redis.utils.HIREDIS_AVAILABLE)
-    print 'Runtime: {} seconds'.format(round(s1, 2))
-    print 'Throughput: {} requests per second'.format(round(args.count/s1, 2))
-    for k, v in sorted(agg.items()):
-        perc = 100.0 * v / args.count
-        print '{}% <= {} milliseconds'.format(perc, k)
-    
\ No newline at end of file
+    pool = multiprocessing.Pool(args.workers)
+    results = {}
+    for name in workloads:
+        results[name] = RunWorkload(pool, name, args, uri)
+    pool.close()
+    if 'query' in workloads:
+        r.delete('bench:index')
+
+    if args.save:
+        with open(args.save, 'w') as f:
+            json.dump({'config': config, 'results': results}, f, indent=2, sort_keys=True)
+
+    regressions = []
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if baseline.get('config') != config:
+            print('Warning: the baseline was run with {}'.format(baseline.get('config')))
+        regressions = Compare(results, baseline['results'], args.threshold)
+    Report(results, regressions)
+    if regressions:
+        print()
+        print('Regressions above {}%: {}'.format(args.threshold, ', '.join(regressions)))
+        sys.exit(1)
@@ -1,10 +1,14 @@
-# Creates count of keys from a document
+# Compares the memory that ReJSON reports for documents of different shapes with what the server uses
+from __future__ import print_function
 import sys
 import argparse
-from urlparse import urlparse
 import os
+import json
 import redis
-from disposableredis import DisposableRedis
+try:
+    from urlparse import urlparse
+except ImportError:
+    from urllib.parse import urlparse
 
 # http://code.activestate.com/recipes/577081-humanized-representation-of-a-number-of-bytes/#c7
 def GetHumanReadable(size, precision=2):
@@ -16,64 +20,88 @@ def GetHumanReadable(size, precision=2):
     fmt = '{{:4.{}f}} {{}}'.format(precision)
     return fmt.format(size, suffixes[suffixIndex])
 
-if __name__ == '__main__':
-    # handle arguments
-    parser = argparse.ArgumentParser(description='ReJSON memory profiler', formatter_class=argparse.ArgumentDefaultsHelpFormatter)
-    parser.add_argument('file', type=str, default=None, help='JSON filename')
-    parser.add_argument('-u', '--uri', type=str, default=None, help='Redis server URI')
-    parser.add_argument('-s', '--steps', type=int, default=5, help='number of steps')
-    parser.add_argument('-c', '--count', type=int, default=1, help='initial count of documents')
-    args = parser.parse_args()
-    if args.uri is not None:
-        uri = urlparse(args.uri)
-    else:
-        uri = None
+# the generated documents, by the name of their shape
+SHAPES = {
+    'flat': lambda: {'field{}'.format(i): 'value {}'.format(i) for i in range(100)},
+    'nested': lambda: Nest(20),
+    'integers': lambda: list(range(100000, 101000)),
+    'doubles': lambda: [i + 0.5 for i in range(1000)],
+    'strings': lambda: ['item {}'.format(i) for i in range(1000)],
+    'long-strings': lambda: ['{:0>100}'.format(i) for i in range(100)],
+    'records': lambda: [{'id': 100000 + i, 'name': 'user {}'.format(i), 'active': True,
+                         'tags': ['a', 'b']} for i in range(100)],
+}
 
-    # initialize
-    port = None
-    serverpath = os.path.abspath(os.path.join(os.getcwd(), '../../redis/src/redis-server'))
-    serverargs = {
-        'loadmodule': os.path.abspath(os.path.join(os.getcwd(), '../lib/rejson.so')),
-        'save': '',
-    }
+def Nest(depth):
+    """An object with a few fields and another such object in 'child', depth levels deep"""
+    obj = {'id': depth, 'name': 'level {}'.format(depth)}
+    if depth > 1:
+        obj['child'] = Nest(depth - 1)
+    return obj
 
-    with open(args.file) as f:
-        json = f.read()
-    
-    count = args.count
-    info = {
-        'before': [],
-        'after': [],
-    }
+def UsedMemory(r):
+    return r.info(section='memory')['used_memory']
 
-    # TODO make client connect to an existing instance
-    # client = DisposableRedis(port=port, path=serverpath, **serverargs)
-    r = redis.StrictRedis()
+def KeysOverhead(r, count):
+    """What count keys cost the server by themselves, measured with empty strings"""
+    before = UsedMemory(r)
+    for i in range(count):
+        r.set('memprof:{}'.format(i), '')
+    overhead = UsedMemory(r) - before
+    r.delete(*['memprof:{}'.format(i) for i in range(count)])
+    return overhead
 
-    # Print file and ReJSON sizes
-    r.execute_command('JSON.SET', 'json', '.', json)
-    print 'File size: {}'.format(GetHumanReadable(len(json)))
-    print 'As ReJSON: {}'.format(GetHumanReadable(r.execute_command('JSON.MEMORY', 'json')))
-    print
+def Profile(r, name, doc, count, overhead):
+    """Sets count copies of a document and compares the reported memory with the server's"""
+    before = UsedMemory(r)
+    for i in range(count):
+        r.execute_command('JSON.SET', 'memprof:{}'.format(i), '.', doc)
+    actual = UsedMemory(r) - before - overhead
+    reply = r.execute_command('JSON.DEBUG', 'MEMORY', 'memprof:0', '.', 'DETAILS')
+    details = dict(zip(reply[::2], reply[1::2]))
+    r.delete(*['memprof:{}'.format(i) for i in range(count)])
+    return {
+        'shape': name,
+        'json': len(doc),
+        'reported': details[b'memory'] * count,
+        'allocated': details[b'allocated-memory'] * count,
+        'actual': actual,
+    }
+
+def Report(rows, count):
+    print('| Shape | JSON | Reported | Allocated | Actual | Reported/Actual | Allocated/Actual |')
+    print('| ----- | ---- | -------- | --------- | ------ | --------------- | ---------------- |')
+    for row in rows:
+        actual = max(row['actual'], 1)
+        print('| {} | {} | {} | {} | {} | {:.2f} | {:.2f} |'.format(
+            row['shape'], GetHumanReadable(row['json']), GetHumanReadable(row['reported'] / count),
+            GetHumanReadable(row['allocated'] / count), GetHumanReadable(row['actual'] / count),
+            float(row['reported']) / actual, float(row['allocated']) / actual))
 
-    # do the steps
-    print '| Step | Documents | Dataset memory | Server memory |'
-    print '| ---- | --------- | -------------- | ------------- |'
-    for i in range(0, args.steps):
-        # with client as r:
-            # create documents
-            info['before'].append(r.info(section='memory'))
-            for j in range(0, count):
-                r.execute_command('JSON.SET', 'json:{}:{}'.format(i, j), '.', json)
-            info['after'].append(r.info(section='memory'))
+if __name__ == '__main__':
+    # handle arguments
+    parser = argparse.ArgumentParser(description='ReJSON memory profiler', formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument('files', type=str, nargs='*', help='JSON files to profile as shapes of their own')
+    parser.add_argument('-u', '--uri', type=str, default='redis://localhost:6379', help='Redis server URI')
+    parser.add_argument('-c', '--count', type=int, default=1000, help='number of documents of every shape')
+    parser.add_argument('-s', '--shapes', type=str, default=','.join(sorted(SHAPES)), help='comma separated generated shapes')
+    args = parser.parse_args()
+    uri = urlparse(args.uri)
 
-            # print report
-            row = [i + 1, count,
-                GetHumanReadable(info['after'][-1]['used_memory_dataset'] - info['before'][-1]['used_memory_dataset']),
-                GetHumanReadable(info['after'][-1]['used_memory'] - info['before'][-1]['used_memory'])]
-            fmt = '| {{:>4}} | {{:>{}}} | {{:>14}} | {{:>13}} |'.format(max(args.steps, 9))
-            print fmt.format(*row)
+    docs = []
+    for name in [name for name in args.shapes.split(',') if name]:
+        if name not in SHAPES:
+            parser.error('unknown shape {}, expecting one of {}'.format(name, ', '.join(sorted(SHAPES))))
+        docs.append((name, json.dumps(SHAPES[name]())))
+    for path in args.files:
+        with open(path) as f:
+            docs.append((os.path.basename(path), f.read()))
 
-            # wrap up
-            count = count * 10
-    print
\ No newline at end of file
+    # the sizes are per document, and the actual memory is the growth of the server's used_memory
+    # without the keys' own overhead
+    r = redis.StrictRedis(host=uri.hostname, port=uri.port)
+    overhead = KeysOverhead(r, args.count)
+    print('Documents per shape: {}, keys overhead: {} per key'.format(
+        args.count, GetHumanReadable(overhead / args.count)))
+    print()
+    Report([Profile(r, name, doc, args.count, overhead) for name, doc in docs], args.count)
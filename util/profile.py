@@ -0,0 +1,138 @@
+# Samples the keyspace with JSON.DEBUG PROFILE and recommends encodings
+import sys
+import argparse
+from urlparse import urlparse
+import redis
+
+JSONTYPE_NAME = 'ReJSON-RL'
+# the compiled-in number of entries from which dictionaries are hash indexed (see object.h)
+DICT_HASH_THRESHOLD = 32
+
+COUNTS = ['nulls', 'booleans', 'integers', 'numbers', 'strings', 'compressed-strings', 'dicts',
+          'indexed-dicts', 'dict-slack', 'arrays', 'packed-arrays', 'array-slack']
+HISTOGRAMS = ['dict-sizes', 'array-lengths', 'string-lengths', 'depths']
+
+# http://code.activestate.com/recipes/577081-humanized-representation-of-a-number-of-bytes/#c7
+def GetHumanReadable(size, precision=2):
+    suffixes = ['B ', 'KB', 'MB', 'GB', 'TB', 'PB', 'ZB']
+    suffixIndex = 0
+    while size > 1024:
+        suffixIndex += 1  # increment the index of the suffix
+        size = size / 1024.0  # apply the division
+    fmt = '{{:4.{}f}} {{}}'.format(precision)
+    return fmt.format(size, suffixes[suffixIndex])
+
+def BucketRange(i, last):
+    """The lengths that a length histogram's bucket counts"""
+    if i == 0:
+        return '0'
+    if i == last:
+        return '>= {}'.format(2 ** (i - 1))
+    if i == 1:
+        return '1'
+    return '{}-{}'.format(2 ** (i - 1), 2 ** i - 1)
+
+def Percentile(buckets, p):
+    """The bucket of a histogram that holds its p-th percentile"""
+    total = sum(buckets)
+    seen = 0
+    for i, count in enumerate(buckets):
+        seen += count
+        if total and seen * 100 >= total * p:
+            return i
+    return 0
+
+def Sample(r, count, match):
+    """Sums the profiles of up to count JSON keys"""
+    total = {name: 0 for name in COUNTS}
+    total.update({name: None for name in HISTOGRAMS})
+    total['max-depth'] = 0
+    keys = 0
+    for key in r.scan_iter(match=match, count=1000):
+        if r.type(key) != JSONTYPE_NAME:
+            continue
+        reply = r.execute_command('JSON.DEBUG', 'PROFILE', key)
+        if reply is None:
+            continue
+        profile = dict(zip(reply[::2], reply[1::2]))
+        for name in COUNTS:
+            total[name] += profile[name]
+        for name in HISTOGRAMS:
+            if total[name] is None:
+                total[name] = list(profile[name])
+            else:
+                total[name] = [a + b for a, b in zip(total[name], profile[name])]
+        total['max-depth'] = max(total['max-depth'], profile['max-depth'])
+        keys += 1
+        if keys == count:
+            break
+    return keys, total
+
+def Recommend(total):
+    """Recommendations for the encodings of the sampled documents"""
+    recs = []
+    sizes = total['dict-sizes']
+    big = sum(sizes[DICT_HASH_THRESHOLD.bit_length():])
+    if total['dicts'] and big * 100 > total['dicts'] * 10:
+        recs.append('{:.1f}% of dictionaries have {} members or more and are hash indexed, which '
+                    'costs memory: keep OBJECT_DICT_HASH_THRESHOLD as it is unless memory matters '
+                    'more than lookups'.format(big * 100.0 / total['dicts'], DICT_HASH_THRESHOLD))
+    elif total['dicts'] and Percentile(sizes, 99) >= DICT_HASH_THRESHOLD.bit_length():
+        recs.append('the largest 1% of dictionaries are hash indexed, consider a lower '
+                    'OBJECT_DICT_HASH_THRESHOLD if their lookups are hot')
+
+    numeric = total['integers'] + total['numbers']
+    if total['arrays'] and numeric and not total['packed-arrays']:
+        recs.append('no array is packed although there are {} numbers, check whether arrays mix '
+                    'numbers with other values'.format(numeric))
+
+    lengths = total['string-lengths']
+    longer = sum(lengths[8:])
+    if longer and not total['compressed-strings']:
+        recs.append('{} strings are 128 bytes long or more, consider the STRING_COMPRESSION_SIZE '
+                    'module argument'.format(longer))
+
+    slack = total['dict-slack'] + total['array-slack']
+    if slack:
+        recs.append('{} are unused container entries'.format(GetHumanReadable(slack)))
+
+    if total['max-depth'] > 64:
+        recs.append('documents are {} levels deep, consider flattening them'.format(
+            total['max-depth']))
+    return recs
+
+if __name__ == '__main__':
+    # handle arguments
+    parser = argparse.ArgumentParser(description='ReJSON keyspace profiler', formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument('-u', '--uri', type=str, default='redis://localhost:6379', help='Redis server URI')
+    parser.add_argument('-n', '--count', type=int, default=1000, help='number of keys to sample')
+    parser.add_argument('-m', '--match', type=str, default='*', help='pattern of the sampled keys')
+    args = parser.parse_args()
+    uri = urlparse(args.uri)
+
+    r = redis.StrictRedis(host=uri.hostname, port=uri.port or 6379, password=uri.password)
+    keys, total = Sample(r, args.count, args.match)
+    if not keys:
+        print 'No JSON keys found'
+        sys.exit(1)
+
+    print 'Sampled {} keys'.format(keys)
+    print
+    print '| Value | Count |'
+    print '| ----- | ----- |'
+    for name in COUNTS:
+        print '| {} | {} |'.format(name, total[name])
+    print '| max-depth | {} |'.format(total['max-depth'])
+    for name in HISTOGRAMS:
+        print
+        print '| {} | Count |'.format(name)
+        print '| {} | ----- |'.format('-' * len(name))
+        last = len(total[name]) - 1
+        for i, count in enumerate(total[name]):
+            if count:
+                label = str(i) if name == 'depths' else BucketRange(i, last)
+                print '| {} | {} |'.format(label, count)
+    print
+    print 'Recommendations:'
+    for rec in Recommend(total) or ['none, the current encodings fit the sample']:
+        print '* {}'.format(rec)